@@ -10,7 +10,9 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <chrono>
 #include <future>
+#include <thread>
 #include <memory>
 #include <boost/asio.hpp>
 #include <ait/serializable.h>
@@ -181,6 +183,26 @@ public:
 		//return receiveDataBlocking(reinterpret_cast<uint8_t*>(&data), sizeof(T));
 	}
 
+	//! Waits until at least byteSize bytes can be read without blocking. Returns false on timeout.
+	template <typename Rep, typename Period>
+	bool waitForData(size_t byteSize, const std::chrono::duration<Rep, Period>& timeout) {
+		const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+		for (;;) {
+			boost::system::error_code ec;
+			const size_t available = socket_.available(ec);
+			if (ec) {
+				throw ANNOTATE_EXC_BOOST(Error, std::string("Unable to query available data on socket"), ec);
+			}
+			if (available >= byteSize) {
+				return true;
+			}
+			if (std::chrono::steady_clock::now() >= deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
 	//! Blocking call. Returns the number of sent bytes.
 	size_t sendDataBlocking(const uint8_t* data, size_t byteSize) {
 		boost::system::error_code ec;
@@ -8,6 +8,11 @@
 
 #pragma once
 
+#include <cstdint>
+#include <type_traits>
+#if defined(__AVX__)
+  #include <immintrin.h>
+#endif
 #include "../math/geometry.h"
 
 namespace bh {
@@ -42,7 +47,9 @@ private:
 
 ///
 /// AABB tree for collision detection with arbitrary collider objects.
-/// The tree is build using the median element along each axis (cyclic) for the split.
+/// The tree is build top-down with a binned surface area heuristic (SAH) for the splits. Nodes are stored
+/// in depth-first order (the left child of a node directly follows it) together with a compact copy of the
+/// bounding boxes that is used for traversal.
 /// The collider object has to define two methods:
 ///     SimpleRayIntersection intersect(const RayDataType& ray, const FloatT t_min, const FloatT t_max) const;
 ///     BoundingBoxType boundingBox() const;
@@ -58,6 +65,7 @@ public:
   using size_t = std::size_t;
   using ColliderType = ColliderT;
   using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatT)
 
   using BoundingBoxType = BoundingBox3D<FloatT>;
   using RayType = Ray<FloatT>;
@@ -172,7 +180,95 @@ public:
                                               const FloatT t_min = 0,
                                               const FloatT t_max = std::numeric_limits<FloatT>::max()) const;
 
+  /// Returns true if any collider is hit with t_min <= t <= t_max (i.e. for occlusion tests).
+  /// Traversal is iterative, stops at the first hit and does not allocate so it can be called
+  /// concurrently from many threads.
+  bool intersectsAny(const RayType& ray,
+                     const FloatT t_min = 0,
+                     const FloatT t_max = std::numeric_limits<FloatT>::max()) const;
+
+  bool intersectsAny(const RayDataType& ray,
+                     const FloatT t_min = 0,
+                     const FloatT t_max = std::numeric_limits<FloatT>::max()) const;
+
+  /// Number of rays that are traversed together by the packet queries.
+  static constexpr size_t kPacketSize = 8;
+
+  /// Any-hit query for multiple rays. The rays are traversed in packets of kPacketSize rays so
+  /// coherent rays (i.e. with a common origin) share most of the node visits.
+  void intersectsAny(const RayDataType* rays,
+                     const size_t num_rays,
+                     const FloatT t_min,
+                     const FloatT t_max,
+                     bool* results) const;
+
+  /// Closest-hit query for multiple rays using packet traversal.
+  void intersect(const RayDataType* rays,
+                 const size_t num_rays,
+                 const FloatT t_min,
+                 const FloatT t_max,
+                 RayIntersection* results) const;
+
+  /// Same as the packet queries above but the packets are distributed over all threads (OpenMP).
+  void intersectsAnyParallel(const RayDataType* rays,
+                             const size_t num_rays,
+                             const FloatT t_min,
+                             const FloatT t_max,
+                             bool* results) const;
+
+  void intersectParallel(const RayDataType* rays,
+                         const size_t num_rays,
+                         const FloatT t_min,
+                         const FloatT t_max,
+                         RayIntersection* results) const;
+
 private:
+  static constexpr size_t kMaxTraversalStackSize = 128;
+  // Below this depth splits use the SAH. Deeper nodes are split at the median so that the
+  // depth of the tree (and the traversal stack) stays bounded.
+  static constexpr size_t kMaxSAHDepth = 64;
+  static constexpr size_t kNumSAHBins = 16;
+
+  /// Compact node used for traversal. The first child of an inner node is the next node.
+  struct FlatNode {
+    FloatT bbox_min[3];
+    FloatT bbox_max[3];
+    // Second child for inner nodes, kNoChild for leaves
+    size_t second_child_index;
+  };
+
+  /// Rays of a packet in structure-of-arrays layout
+  struct RayPacket {
+    alignas(32) FloatT origin[3][kPacketSize];
+    alignas(32) FloatT inv_direction[3][kPacketSize];
+    const RayDataType* rays[kPacketSize];
+    uint32_t valid_mask;
+  };
+
+  template <typename ColliderIterator>
+  struct BuildEntry {
+    ColliderIterator collider_it;
+    BoundingBoxType bounding_box;
+    Vector3 center;
+  };
+
+  void initRayPacket(const RayDataType* rays, const size_t num_rays, RayPacket* packet) const;
+
+  /// Returns a bit mask of the packet rays that intersect the node's bounding box with t_min <= t <= t_upper[i].
+  uint32_t intersectPacket(const FlatNode& node, const RayPacket& packet,
+                           const FloatT t_min, const FloatT* t_upper) const;
+
+  uint32_t intersectPacket(const FlatNode& node, const RayPacket& packet,
+                           const FloatT t_min, const FloatT* t_upper, std::false_type) const;
+
+  uint32_t intersectPacket(const FlatNode& node, const RayPacket& packet,
+                           const FloatT t_min, const FloatT* t_upper, std::true_type) const;
+
+  void intersectsAnyPacket(const RayPacket& packet, const FloatT t_min, const FloatT t_max, bool* results) const;
+
+  void intersectPacket(const RayPacket& packet, const FloatT t_min, const FloatT t_max,
+                       RayIntersection* results) const;
+
   RayIntersection _intersect(const RayDataType& ray,
                              const FloatT t_min = 0,
                              const FloatT t_max = std::numeric_limits<FloatT>::max()) const;
@@ -199,10 +295,13 @@ private:
   void build(const ColliderIterator first, const ColliderIterator last);
 
   template <typename ColliderIterator>
-  void splitMedianRecursive(const size_t node_index,
-                            const typename std::vector<ColliderIterator>::iterator first,
-                            const typename std::vector<ColliderIterator>::iterator last,
-                            const size_t sort_axis);
+  size_t splitSAHRecursive(const typename std::vector<BuildEntry<ColliderIterator>>::iterator first,
+                           const typename std::vector<BuildEntry<ColliderIterator>>::iterator last,
+                           const size_t depth);
+
+  static FloatT computeSurfaceArea(const BoundingBoxType& bbox);
+
+  void buildFlatNodes();
 
   size_t allocateNode();
 
@@ -212,6 +311,7 @@ private:
                             size_t* num_leaf_nodes, size_t* max_depth) const;
 
   NodeContainer nodes_;
+  std::vector<FlatNode> flat_nodes_;
 };
 
 }
@@ -99,6 +99,18 @@ auto AABBTree<ColliderT, FloatT>::Node::collider() -> ColliderT& {
 
 // AABBTree implementation
 
+template <typename ColliderT, typename FloatT>
+constexpr std::size_t AABBTree<ColliderT, FloatT>::kPacketSize;
+
+template <typename ColliderT, typename FloatT>
+constexpr std::size_t AABBTree<ColliderT, FloatT>::kMaxTraversalStackSize;
+
+template <typename ColliderT, typename FloatT>
+constexpr std::size_t AABBTree<ColliderT, FloatT>::kMaxSAHDepth;
+
+template <typename ColliderT, typename FloatT>
+constexpr std::size_t AABBTree<ColliderT, FloatT>::kNumSAHBins;
+
 template <typename ColliderT, typename FloatT>
 template <typename ColliderContainer>
 AABBTree<ColliderT, FloatT>::AABBTree::AABBTree(const ColliderContainer& container) {
@@ -163,7 +175,7 @@ auto AABBTree<ColliderT, FloatT>::getCollider(const size_t node_index) const ->
 
 template <typename ColliderT, typename FloatT>
 auto AABBTree<ColliderT, FloatT>::getCollider(const size_t node_index) -> ColliderT& {
-  return nodes_[index].collider();
+  return nodes_[node_index].collider();
 }
 
 template <typename ColliderT, typename FloatT>
@@ -239,8 +251,7 @@ auto AABBTree<ColliderT, FloatT>::intersectRange(
         const RayDataType& ray,
         const FloatT t_min,
         const FloatT t_max) const -> std::vector<RayIntersection> {
-  RayIntersection cri = _intersectRange(ray, t_min, t_max);
-  return cri;
+  return _intersectRange(ray, t_min, t_max);
 }
 
 template <typename ColliderT, typename FloatT>
@@ -287,55 +298,417 @@ void AABBTree<ColliderT, FloatT>::_intersectRangeRecursive(
   }
 }
 
+template <typename ColliderT, typename FloatT>
+auto AABBTree<ColliderT, FloatT>::intersectsAny(
+        const RayType& ray,
+        const FloatT t_min,
+        const FloatT t_max) const -> bool {
+  return intersectsAny(RayDataType(ray), t_min, t_max);
+}
+
+template <typename ColliderT, typename FloatT>
+auto AABBTree<ColliderT, FloatT>::intersectsAny(
+        const RayDataType& ray,
+        const FloatT t_min,
+        const FloatT t_max) const -> bool {
+  if (flat_nodes_.empty()) {
+    return false;
+  }
+  size_t stack[kMaxTraversalStackSize];
+  size_t stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    const size_t node_index = stack[--stack_size];
+    const FlatNode& flat_node = flat_nodes_[node_index];
+    FloatT t_lower = t_min;
+    FloatT t_upper = t_max;
+    for (size_t i = 0; i < 3; ++i) {
+      const FloatT t0 = (flat_node.bbox_min[i] - ray.origin(i)) * ray.inv_direction(i);
+      const FloatT t1 = (flat_node.bbox_max[i] - ray.origin(i)) * ray.inv_direction(i);
+      t_lower = std::max(t_lower, std::min(t0, t1));
+      t_upper = std::min(t_upper, std::max(t0, t1));
+    }
+    if (t_upper < t_lower) {
+      continue;
+    }
+    if (flat_node.second_child_index == kNoChild) {
+      if (getNode(node_index).collider().intersect(ray, t_min, t_max).doesIntersect()) {
+        return true;
+      }
+      continue;
+    }
+    BH_ASSERT(stack_size + 2 <= kMaxTraversalStackSize);
+    stack[stack_size++] = flat_node.second_child_index;
+    stack[stack_size++] = node_index + 1;
+  }
+  return false;
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::intersectsAny(
+        const RayDataType* rays,
+        const size_t num_rays,
+        const FloatT t_min,
+        const FloatT t_max,
+        bool* results) const {
+  RayPacket packet;
+  for (size_t i = 0; i < num_rays; i += kPacketSize) {
+    const size_t packet_size = std::min(kPacketSize, num_rays - i);
+    initRayPacket(rays + i, packet_size, &packet);
+    intersectsAnyPacket(packet, t_min, t_max, results + i);
+  }
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::intersect(
+        const RayDataType* rays,
+        const size_t num_rays,
+        const FloatT t_min,
+        const FloatT t_max,
+        RayIntersection* results) const {
+  RayPacket packet;
+  for (size_t i = 0; i < num_rays; i += kPacketSize) {
+    const size_t packet_size = std::min(kPacketSize, num_rays - i);
+    initRayPacket(rays + i, packet_size, &packet);
+    intersectPacket(packet, t_min, t_max, results + i);
+  }
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::intersectsAnyParallel(
+        const RayDataType* rays,
+        const size_t num_rays,
+        const FloatT t_min,
+        const FloatT t_max,
+        bool* results) const {
+  const std::ptrdiff_t num_packets = (num_rays + kPacketSize - 1) / kPacketSize;
+#pragma omp parallel for schedule(dynamic, 16)
+  for (std::ptrdiff_t p = 0; p < num_packets; ++p) {
+    const size_t offset = p * kPacketSize;
+    intersectsAny(rays + offset, std::min(kPacketSize, num_rays - offset), t_min, t_max, results + offset);
+  }
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::intersectParallel(
+        const RayDataType* rays,
+        const size_t num_rays,
+        const FloatT t_min,
+        const FloatT t_max,
+        RayIntersection* results) const {
+  const std::ptrdiff_t num_packets = (num_rays + kPacketSize - 1) / kPacketSize;
+#pragma omp parallel for schedule(dynamic, 16)
+  for (std::ptrdiff_t p = 0; p < num_packets; ++p) {
+    const size_t offset = p * kPacketSize;
+    intersect(rays + offset, std::min(kPacketSize, num_rays - offset), t_min, t_max, results + offset);
+  }
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::initRayPacket(
+        const RayDataType* rays, const size_t num_rays, RayPacket* packet) const {
+  packet->valid_mask = 0;
+  for (size_t k = 0; k < kPacketSize; ++k) {
+    // Unused lanes repeat the first ray so that they do not produce NaNs
+    const RayDataType& ray = rays[k < num_rays ? k : 0];
+    for (size_t i = 0; i < 3; ++i) {
+      packet->origin[i][k] = ray.origin(i);
+      packet->inv_direction[i][k] = ray.inv_direction(i);
+    }
+    packet->rays[k] = &ray;
+    if (k < num_rays) {
+      packet->valid_mask |= uint32_t(1) << k;
+    }
+  }
+}
+
+template <typename ColliderT, typename FloatT>
+auto AABBTree<ColliderT, FloatT>::intersectPacket(
+        const FlatNode& node, const RayPacket& packet,
+        const FloatT t_min, const FloatT* t_upper) const -> uint32_t {
+#if defined(__AVX__)
+  return intersectPacket(node, packet, t_min, t_upper,
+                         std::integral_constant<bool, std::is_same<FloatT, float>::value && kPacketSize == 8>());
+#else
+  return intersectPacket(node, packet, t_min, t_upper, std::false_type());
+#endif
+}
+
+template <typename ColliderT, typename FloatT>
+auto AABBTree<ColliderT, FloatT>::intersectPacket(
+        const FlatNode& node, const RayPacket& packet,
+        const FloatT t_min, const FloatT* t_upper, std::false_type) const -> uint32_t {
+  uint32_t mask = 0;
+  for (size_t k = 0; k < kPacketSize; ++k) {
+    FloatT t_lower_k = t_min;
+    FloatT t_upper_k = t_upper[k];
+    for (size_t i = 0; i < 3; ++i) {
+      const FloatT t0 = (node.bbox_min[i] - packet.origin[i][k]) * packet.inv_direction[i][k];
+      const FloatT t1 = (node.bbox_max[i] - packet.origin[i][k]) * packet.inv_direction[i][k];
+      t_lower_k = std::max(t_lower_k, std::min(t0, t1));
+      t_upper_k = std::min(t_upper_k, std::max(t0, t1));
+    }
+    mask |= uint32_t(t_upper_k >= t_lower_k) << k;
+  }
+  return mask;
+}
+
+template <typename ColliderT, typename FloatT>
+auto AABBTree<ColliderT, FloatT>::intersectPacket(
+        const FlatNode& node, const RayPacket& packet,
+        const FloatT t_min, const FloatT* t_upper, std::true_type) const -> uint32_t {
+#if defined(__AVX__)
+  // Operand order of min/max follows the scalar code so that NaNs (0 * inf) are handled the same way
+  __m256 t_lower_k = _mm256_set1_ps(t_min);
+  __m256 t_upper_k = _mm256_loadu_ps(t_upper);
+  for (size_t i = 0; i < 3; ++i) {
+    const __m256 origin = _mm256_load_ps(packet.origin[i]);
+    const __m256 inv_direction = _mm256_load_ps(packet.inv_direction[i]);
+    const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bbox_min[i]), origin), inv_direction);
+    const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bbox_max[i]), origin), inv_direction);
+    t_lower_k = _mm256_max_ps(_mm256_min_ps(t1, t0), t_lower_k);
+    t_upper_k = _mm256_min_ps(_mm256_max_ps(t1, t0), t_upper_k);
+  }
+  return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(t_upper_k, t_lower_k, _CMP_GE_OQ)));
+#else
+  return intersectPacket(node, packet, t_min, t_upper, std::false_type());
+#endif
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::intersectsAnyPacket(
+        const RayPacket& packet, const FloatT t_min, const FloatT t_max, bool* results) const {
+  for (size_t k = 0; k < kPacketSize; ++k) {
+    if (packet.valid_mask & (uint32_t(1) << k)) {
+      results[k] = false;
+    }
+  }
+  if (flat_nodes_.empty()) {
+    return;
+  }
+  alignas(32) FloatT t_upper[kPacketSize];
+  std::fill(t_upper, t_upper + kPacketSize, t_max);
+  uint32_t active_mask = packet.valid_mask;
+  size_t stack[kMaxTraversalStackSize];
+  size_t stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    const size_t node_index = stack[--stack_size];
+    const FlatNode& flat_node = flat_nodes_[node_index];
+    uint32_t hit_mask = intersectPacket(flat_node, packet, t_min, t_upper) & active_mask;
+    if (hit_mask == 0) {
+      continue;
+    }
+    if (flat_node.second_child_index == kNoChild) {
+      const ColliderT& collider = getNode(node_index).collider();
+      for (size_t k = 0; hit_mask != 0; ++k, hit_mask >>= 1) {
+        if ((hit_mask & 1) && collider.intersect(*packet.rays[k], t_min, t_max).doesIntersect()) {
+          results[k] = true;
+          active_mask &= ~(uint32_t(1) << k);
+          // Finished rays do not pass any more bounding box tests
+          t_upper[k] = -std::numeric_limits<FloatT>::max();
+        }
+      }
+      if (active_mask == 0) {
+        return;
+      }
+      continue;
+    }
+    BH_ASSERT(stack_size + 2 <= kMaxTraversalStackSize);
+    stack[stack_size++] = flat_node.second_child_index;
+    stack[stack_size++] = node_index + 1;
+  }
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::intersectPacket(
+        const RayPacket& packet, const FloatT t_min, const FloatT t_max, RayIntersection* results) const {
+  for (size_t k = 0; k < kPacketSize; ++k) {
+    if (packet.valid_mask & (uint32_t(1) << k)) {
+      results[k] = RayIntersection();
+    }
+  }
+  if (flat_nodes_.empty()) {
+    return;
+  }
+  // The upper bound of each ray shrinks to the closest hit so far
+  alignas(32) FloatT t_upper[kPacketSize];
+  std::fill(t_upper, t_upper + kPacketSize, t_max);
+  RayIntersection closest[kPacketSize];
+  std::pair<size_t, size_t> stack[kMaxTraversalStackSize];
+  size_t stack_size = 0;
+  stack[stack_size++] = std::make_pair(size_t(0), size_t(0));
+  while (stack_size > 0) {
+    const size_t node_index = stack[stack_size - 1].first;
+    const size_t depth = stack[stack_size - 1].second;
+    --stack_size;
+    const FlatNode& flat_node = flat_nodes_[node_index];
+    uint32_t hit_mask = intersectPacket(flat_node, packet, t_min, t_upper) & packet.valid_mask;
+    if (hit_mask == 0) {
+      continue;
+    }
+    if (flat_node.second_child_index == kNoChild) {
+      const ColliderT& collider = getNode(node_index).collider();
+      for (size_t k = 0; hit_mask != 0; ++k, hit_mask >>= 1) {
+        if (hit_mask & 1) {
+          const SimpleRayIntersection ri = collider.intersect(*packet.rays[k], t_min, t_upper[k]);
+          if (ri.doesIntersect() && ri.rayT() <= closest[k].rayT()) {
+            closest[k] = RayIntersection(node_index, depth, ri.rayT());
+            t_upper[k] = ri.rayT();
+          }
+        }
+      }
+      continue;
+    }
+    BH_ASSERT(stack_size + 2 <= kMaxTraversalStackSize);
+    stack[stack_size++] = std::make_pair(flat_node.second_child_index, depth + 1);
+    stack[stack_size++] = std::make_pair(node_index + 1, depth + 1);
+  }
+  for (size_t k = 0; k < kPacketSize; ++k) {
+    if (packet.valid_mask & (uint32_t(1) << k)) {
+      results[k] = closest[k];
+    }
+  }
+}
+
 template <typename ColliderT, typename FloatT>
 template <typename ColliderIterator>
 void AABBTree<ColliderT, FloatT>::build(const ColliderIterator first, const ColliderIterator last) {
-  std::vector<ColliderIterator> iterators;
-  iterators.reserve(last - first);
+  std::vector<BuildEntry<ColliderIterator>> entries;
+  entries.reserve(last - first);
   for (ColliderIterator it = first; it != last; ++it) {
-    iterators.push_back(it);
+    BuildEntry<ColliderIterator> entry;
+    entry.collider_it = it;
+    entry.bounding_box = it->boundingBox();
+    entry.center = entry.bounding_box.getCenter();
+    entries.push_back(entry);
   }
   nodes_.clear();
-  const size_t root_index= allocateNode();
-  const size_t initial_sort_axis = 0;
-  splitMedianRecursive<ColliderIterator>(root_index, iterators.begin(), iterators.end(), initial_sort_axis);
+  flat_nodes_.clear();
+  if (entries.empty()) {
+    return;
+  }
+  nodes_.reserve(2 * entries.size() - 1);
+  const size_t initial_depth = 0;
+  splitSAHRecursive<ColliderIterator>(entries.begin(), entries.end(), initial_depth);
   nodes_.shrink_to_fit();
+  buildFlatNodes();
   printInfo();
 }
 
 template <typename ColliderT, typename FloatT>
 template <typename ColliderIterator>
-void AABBTree<ColliderT, FloatT>::splitMedianRecursive(
-        const size_t node_index,
-        const typename std::vector<ColliderIterator>::iterator first,
-        const typename std::vector<ColliderIterator>::iterator last,
-        const size_t sort_axis) {
-  if (last - first > 1) {
-    std::stable_sort(first, last, [&](const ColliderIterator& it_a, const ColliderIterator& it_b) -> bool {
-      return it_a->boundingBox().getCenter(sort_axis) < it_b->boundingBox().getCenter(sort_axis);
-    });
-
-    const std::size_t next_sort_axis = (sort_axis + 1) % 3;
-
-    // Careful: Make sure to always use getNode(node_index), as the std::vector could be resized in the recursive calls
+auto AABBTree<ColliderT, FloatT>::splitSAHRecursive(
+        const typename std::vector<BuildEntry<ColliderIterator>>::iterator first,
+        const typename std::vector<BuildEntry<ColliderIterator>>::iterator last,
+        const size_t depth) -> size_t {
+  using BuildEntryType = BuildEntry<ColliderIterator>;
+  const size_t node_index = allocateNode();
+  if (last - first == 1) {
+    getNode(node_index).bounding_box_ = first->bounding_box;
+    getNode(node_index).collider_ = *first->collider_it;
+    return node_index;
+  }
 
-    const size_t left_child_index = allocateNode();
-    getNode(node_index).left_child_index_ = left_child_index;
-    const size_t right_child_index = allocateNode();
-    getNode(node_index).right_child_index_ = right_child_index;
+  BoundingBoxType center_bbox;
+  for (auto it = first; it != last; ++it) {
+    center_bbox.include(it->center);
+  }
+  size_t axis;
+  const FloatT max_extent = center_bbox.getMaxExtent(&axis);
+  const FloatT axis_min = center_bbox.getMinimum(axis);
+
+  auto middle = first + (last - first) / 2;
+  bool use_median_split = max_extent <= 0 || depth >= kMaxSAHDepth;
+  if (!use_median_split) {
+    // Binned SAH: evaluate the split planes between kNumSAHBins equally sized bins along the axis
+    const FloatT bin_scale = kNumSAHBins * (1 - std::numeric_limits<FloatT>::epsilon()) / max_extent;
+    const auto compute_bin = [&](const BuildEntryType& entry) -> size_t {
+      return std::min(kNumSAHBins - 1, static_cast<size_t>((entry.center(axis) - axis_min) * bin_scale));
+    };
+    size_t bin_counts[kNumSAHBins] = { 0 };
+    BoundingBoxType bin_bboxes[kNumSAHBins];
+    for (auto it = first; it != last; ++it) {
+      const size_t bin = compute_bin(*it);
+      ++bin_counts[bin];
+      bin_bboxes[bin].include(it->bounding_box);
+    }
+    FloatT right_costs[kNumSAHBins];
+    BoundingBoxType right_bbox;
+    size_t right_count = 0;
+    for (size_t bin = kNumSAHBins - 1; bin > 0; --bin) {
+      right_bbox.include(bin_bboxes[bin]);
+      right_count += bin_counts[bin];
+      right_costs[bin] = right_count > 0 ? right_count * computeSurfaceArea(right_bbox) : 0;
+    }
+    BoundingBoxType left_bbox;
+    size_t left_count = 0;
+    size_t best_split_bin = 0;
+    FloatT best_cost = std::numeric_limits<FloatT>::max();
+    for (size_t bin = 1; bin < kNumSAHBins; ++bin) {
+      left_bbox.include(bin_bboxes[bin - 1]);
+      left_count += bin_counts[bin - 1];
+      if (left_count == 0 || left_count == static_cast<size_t>(last - first)) {
+        continue;
+      }
+      const FloatT cost = left_count * computeSurfaceArea(left_bbox) + right_costs[bin];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_split_bin = bin;
+      }
+    }
+    if (best_split_bin > 0) {
+      middle = std::partition(first, last, [&](const BuildEntryType& entry) {
+        return compute_bin(entry) < best_split_bin;
+      });
+    }
+    use_median_split = middle == first || middle == last;
+  }
+  if (use_median_split) {
+    middle = first + (last - first) / 2;
+    std::nth_element(first, middle, last, [axis](const BuildEntryType& a, const BuildEntryType& b) {
+      return a.center(axis) < b.center(axis);
+    });
+  }
 
-    const typename std::vector<ColliderIterator>::iterator middle = first + (last - first) / 2;
-    splitMedianRecursive<ColliderIterator>(getNode(node_index).leftChildIndex(), first, middle, next_sort_axis);
-    splitMedianRecursive<ColliderIterator>(getNode(node_index).rightChildIndex(), middle, last, next_sort_axis);
+  // Careful: Make sure to always use getNode(node_index), as the std::vector could be resized in the recursive calls
+  const size_t left_child_index = splitSAHRecursive<ColliderIterator>(first, middle, depth + 1);
+  const size_t right_child_index = splitSAHRecursive<ColliderIterator>(middle, last, depth + 1);
+  getNode(node_index).left_child_index_ = left_child_index;
+  getNode(node_index).right_child_index_ = right_child_index;
+  updateBoundingBox(&getNode(node_index));
+  return node_index;
+}
 
-    updateBoundingBox(&getNode(node_index));
+template <typename ColliderT, typename FloatT>
+auto AABBTree<ColliderT, FloatT>::computeSurfaceArea(const BoundingBoxType& bbox) -> FloatT {
+  if (!bbox.isValid()) {
+    return 0;
   }
-  else {
-    const ColliderT collider = **first;
-    getNode(node_index).bounding_box_ = collider.boundingBox();
-    getNode(node_index).collider_ = collider;
+  const Vector3 extent = bbox.getExtent();
+  return 2 * (extent(0) * extent(1) + extent(1) * extent(2) + extent(2) * extent(0));
+}
+
+template <typename ColliderT, typename FloatT>
+void AABBTree<ColliderT, FloatT>::buildFlatNodes() {
+  flat_nodes_.resize(nodes_.size());
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const Node& node = nodes_[i];
+    FlatNode& flat_node = flat_nodes_[i];
+    for (size_t j = 0; j < 3; ++j) {
+      flat_node.bbox_min[j] = node.boundingBox().getMinimum(j);
+      flat_node.bbox_max[j] = node.boundingBox().getMaximum(j);
+    }
+    if (node.isLeaf()) {
+      flat_node.second_child_index = kNoChild;
+    }
+    else {
+      BH_ASSERT(node.leftChildIndex() == i + 1);
+      flat_node.second_child_index = node.rightChildIndex();
+    }
   }
 }
+
 template <typename ColliderT, typename FloatT>
 auto AABBTree<ColliderT, FloatT>::allocateNode() -> size_t {
   const size_t new_index = nodes_.size();
@@ -9,6 +9,12 @@
 
 #include <cstddef>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
 #include "common.h"
 
 namespace bh {
@@ -78,6 +84,14 @@ std::vector<IndexT> argsort(OrderIt first_order, OrderIt last_order);
 template <typename OrderIt, typename Compare, typename IndexT = std::size_t>
 std::vector<IndexT> argsort(OrderIt first_order, OrderIt last_order, Compare comp);
 
+/// Sort range [first, last) with all threads (OpenMP).
+/// Chunks of the range are sorted in parallel and then merged pairwise. The sort is not stable.
+template <typename RandomIt, typename Compare>
+void parallelSort(RandomIt first, RandomIt last, Compare comp);
+
+template <typename RandomIt>
+void parallelSort(RandomIt first, RandomIt last);
+
 template <typename Set1, typename Set2>
 std::size_t computeSetIntersectionSize(const Set1& set1, const Set2& set2);
 
@@ -151,6 +165,45 @@ std::vector<IndexT> argsort(OrderIt first_order, OrderIt last_order, Compare com
   argsort(indices.begin(), indices.end(), first_order, last_order, comp);
   return indices;};
 
+template <typename RandomIt, typename Compare>
+void parallelSort(RandomIt first, RandomIt last, Compare comp) {
+  // Small ranges are not worth the merge overhead
+  const std::ptrdiff_t min_chunk_size = 1 << 14;
+  const std::ptrdiff_t size = last - first;
+#ifdef _OPENMP
+  const std::ptrdiff_t num_chunks = std::min<std::ptrdiff_t>(omp_get_max_threads(), size / min_chunk_size);
+#else
+  const std::ptrdiff_t num_chunks = 1;
+#endif
+  if (num_chunks <= 1) {
+    std::sort(first, last, comp);
+    return;
+  }
+  std::vector<std::ptrdiff_t> chunk_bounds(num_chunks + 1);
+  for (std::ptrdiff_t i = 0; i <= num_chunks; ++i) {
+    chunk_bounds[i] = size * i / num_chunks;
+  }
+#pragma omp parallel for
+  for (std::ptrdiff_t i = 0; i < num_chunks; ++i) {
+    std::sort(first + chunk_bounds[i], first + chunk_bounds[i + 1], comp);
+  }
+  for (std::ptrdiff_t step = 1; step < num_chunks; step *= 2) {
+#pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < num_chunks; i += 2 * step) {
+      if (i + step < num_chunks) {
+        const std::ptrdiff_t end_chunk = std::min(i + 2 * step, num_chunks);
+        std::inplace_merge(first + chunk_bounds[i], first + chunk_bounds[i + step], first + chunk_bounds[end_chunk], comp);
+      }
+    }
+  }
+}
+
+template <typename RandomIt>
+void parallelSort(RandomIt first, RandomIt last) {
+  using ValueType = typename std::iterator_traits<RandomIt>::value_type;
+  parallelSort(first, last, std::less<ValueType>());
+}
+
 template <typename Set1, typename Set2>
 std::size_t computeSetIntersectionSize(const Set1& set1, const Set2& set2) {
     static_assert(std::is_same<typename Set1::key_type, typename Set2::key_type>::value, "Key must be same type");
@@ -0,0 +1,239 @@
+//==================================================
+// append_only_journal.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 20.05.17
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/crc.hpp>
+#include "common.h"
+#include "memory_mapped_file.h"
+
+namespace bh {
+
+///
+/// Append-only file of typed binary records (POSIX only).
+///
+/// Each record is stored as
+///   uint32 type | uint32 payload size | payload | uint32 CRC-32 of type, size and payload
+/// in host byte order. Appended records are buffered and written and fsync'ed in batches.
+/// A torn or corrupted record at the end of the file (i.e. after a crash) ends the valid part
+/// of the journal. It is ignored when reading and cut off when the journal is opened for appending.
+///
+class AppendOnlyJournal {
+public:
+  struct Record {
+    uint32_t type;
+    std::string payload;
+  };
+
+  /// Returns true if the file exists and is not empty.
+  static bool exists(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    const off_t size = ::lseek(fd, 0, SEEK_END);
+    ::close(fd);
+    return size > 0;
+  }
+
+  /// Reads all valid records of a journal file. A missing file has no records.
+  /// Returns the size in bytes of the valid part of the file.
+  static std::size_t readRecords(const std::string& filename, std::vector<Record>* records) {
+    records->clear();
+    if (!exists(filename)) {
+      return 0;
+    }
+    const MemoryMappedFile file(filename);
+    std::size_t offset = 0;
+    while (file.size() - offset >= kRecordOverhead) {
+      uint32_t type;
+      uint32_t payload_size;
+      std::memcpy(&type, file.data() + offset, sizeof(type));
+      std::memcpy(&payload_size, file.data() + offset + sizeof(type), sizeof(payload_size));
+      if (file.size() - offset - kRecordOverhead < payload_size) {
+        break;
+      }
+      const char* payload = file.data() + offset + 2 * sizeof(uint32_t);
+      uint32_t checksum;
+      std::memcpy(&checksum, payload + payload_size, sizeof(checksum));
+      if (checksum != computeChecksum(type, payload, payload_size)) {
+        break;
+      }
+      records->push_back(Record { type, std::string(payload, payload_size) });
+      offset += kRecordOverhead + payload_size;
+    }
+    return offset;
+  }
+
+  /// Forces the content of a file to disk.
+  static void syncFile(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw BH_EXCEPTION(std::string("Unable to open file for syncing: ") + filename);
+    }
+    const int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+      throw BH_EXCEPTION(std::string("Unable to sync file: ") + filename);
+    }
+  }
+
+  /// Computes the CRC-32 of the content of a file. A missing or empty file has checksum 0.
+  static uint32_t computeFileChecksum(const std::string& filename) {
+    if (!exists(filename)) {
+      return 0;
+    }
+    const MemoryMappedFile file(filename);
+    boost::crc_32_type crc;
+    crc.process_bytes(file.data(), file.size());
+    return crc.checksum();
+  }
+
+  /// Records are synced after sync_batch_size records or when the oldest unsynced record
+  /// is older than sync_interval seconds (checked on append).
+  AppendOnlyJournal(const std::size_t sync_batch_size = 64, const double sync_interval = 10)
+      : fd_(-1), size_(0), num_buffered_records_(0),
+        sync_batch_size_(sync_batch_size), sync_interval_(sync_interval) {}
+
+  AppendOnlyJournal(const AppendOnlyJournal&) = delete;
+  AppendOnlyJournal& operator=(const AppendOnlyJournal&) = delete;
+
+  ~AppendOnlyJournal() {
+    try {
+      close();
+    }
+    catch (const bh::Exception& err) {
+      std::cerr << "ERROR: Failed to close journal: " << err.what() << std::endl;
+    }
+  }
+
+  /// Opens a journal for appending. Everything after the first valid_size bytes is discarded.
+  void open(const std::string& filename, const std::size_t valid_size) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    BH_ASSERT_STR(fd_ < 0, "Journal is already open");
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd_ < 0) {
+      throw BH_EXCEPTION(std::string("Unable to open journal file: ") + filename);
+    }
+    if (::ftruncate(fd_, static_cast<off_t>(valid_size)) != 0
+        || ::lseek(fd_, static_cast<off_t>(valid_size), SEEK_SET) < 0) {
+      ::close(fd_);
+      fd_ = -1;
+      throw BH_EXCEPTION(std::string("Unable to truncate journal file: ") + filename);
+    }
+    filename_ = filename;
+    size_ = valid_size;
+  }
+
+  /// Writes and syncs the buffered records and closes the file.
+  void close() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+      return;
+    }
+    syncWithoutLock();
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  bool isOpen() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return fd_ >= 0;
+  }
+
+  const std::string& filename() const {
+    return filename_;
+  }
+
+  /// Size of the journal in bytes including buffered records.
+  std::size_t size() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return size_ + buffer_.size();
+  }
+
+  /// Appends a record. Thread-safe.
+  void append(const uint32_t type, const std::string& payload) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    BH_ASSERT_STR(fd_ >= 0, "Journal is not open");
+    const uint32_t payload_size = static_cast<uint32_t>(payload.size());
+    const uint32_t checksum = computeChecksum(type, payload.data(), payload_size);
+    buffer_.append(reinterpret_cast<const char*>(&type), sizeof(type));
+    buffer_.append(reinterpret_cast<const char*>(&payload_size), sizeof(payload_size));
+    buffer_.append(payload);
+    buffer_.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    if (num_buffered_records_ == 0) {
+      first_buffered_time_ = Clock::now();
+    }
+    ++num_buffered_records_;
+    const double buffered_time = std::chrono::duration<double>(Clock::now() - first_buffered_time_).count();
+    if (num_buffered_records_ >= sync_batch_size_ || buffered_time >= sync_interval_) {
+      syncWithoutLock();
+    }
+  }
+
+  /// Writes the buffered records and forces them to disk.
+  void sync() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    BH_ASSERT_STR(fd_ >= 0, "Journal is not open");
+    syncWithoutLock();
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::size_t kRecordOverhead = 3 * sizeof(uint32_t);
+
+  static uint32_t computeChecksum(const uint32_t type, const char* payload, const uint32_t payload_size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(&type, sizeof(type));
+    crc.process_bytes(&payload_size, sizeof(payload_size));
+    crc.process_bytes(payload, payload_size);
+    return crc.checksum();
+  }
+
+  void syncWithoutLock() {
+    std::size_t written = 0;
+    while (written < buffer_.size()) {
+      const ssize_t result = ::write(fd_, buffer_.data() + written, buffer_.size() - written);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw BH_EXCEPTION(std::string("Unable to write to journal file: ") + filename_);
+      }
+      written += static_cast<std::size_t>(result);
+    }
+    if (::fsync(fd_) != 0) {
+      throw BH_EXCEPTION(std::string("Unable to sync journal file: ") + filename_);
+    }
+    size_ += buffer_.size();
+    buffer_.clear();
+    num_buffered_records_ = 0;
+  }
+
+  mutable std::mutex mutex_;
+  int fd_;
+  std::string filename_;
+  std::size_t size_;
+  std::string buffer_;
+  std::size_t num_buffered_records_;
+  Clock::time_point first_buffered_time_;
+  std::size_t sync_batch_size_;
+  double sync_interval_;
+};
+
+}
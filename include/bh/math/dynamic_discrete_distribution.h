@@ -0,0 +1,137 @@
+//==================================================
+// dynamic_discrete_distribution.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 17.05.17
+//
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "../common.h"
+
+namespace bh {
+
+///
+/// Discrete distribution with probabilities proportional to non-negative weights.
+/// Weights are kept in a Fenwick tree so that single weights can be changed and elements can be
+/// appended in O(log N). Sampling is O(log N) as well.
+///
+template <typename FloatT>
+class DynamicDiscreteDistribution {
+public:
+  using FloatType = FloatT;
+  using size_t = std::size_t;
+
+  DynamicDiscreteDistribution()
+      : tree_(1, 0) {}
+
+  /// Replaces all weights. The tree is built in O(N).
+  template <typename Iterator>
+  void assign(Iterator first, Iterator last) {
+    weights_.assign(first, last);
+    tree_.assign(weights_.size() + 1, 0);
+    for (size_t i = 1; i < tree_.size(); ++i) {
+      tree_[i] += weights_[i - 1];
+      const size_t parent = i + lowestBit(i);
+      if (parent < tree_.size()) {
+        tree_[parent] += tree_[i];
+      }
+    }
+  }
+
+  void clear() {
+    weights_.clear();
+    tree_.assign(1, 0);
+  }
+
+  bool empty() const {
+    return weights_.empty();
+  }
+
+  size_t size() const {
+    return weights_.size();
+  }
+
+  void push_back(const FloatType weight) {
+    BH_ASSERT(weight >= 0);
+    // The new tree node covers the range (i - lowestBit(i), i] and is computed from the existing nodes
+    const size_t i = tree_.size();
+    FloatType node_sum = weight;
+    for (size_t child_size = 1; child_size < lowestBit(i); child_size <<= 1) {
+      node_sum += tree_[i - child_size];
+    }
+    weights_.push_back(weight);
+    tree_.push_back(node_sum);
+  }
+
+  FloatType weight(const size_t index) const {
+    return weights_[index];
+  }
+
+  void setWeight(const size_t index, const FloatType weight) {
+    BH_ASSERT(index < weights_.size());
+    BH_ASSERT(weight >= 0);
+    const FloatType delta = weight - weights_[index];
+    weights_[index] = weight;
+    for (size_t i = index + 1; i < tree_.size(); i += lowestBit(i)) {
+      tree_[i] += delta;
+    }
+  }
+
+  /// Sum of the weights of the elements [0, index).
+  FloatType prefixWeight(size_t index) const {
+    FloatType sum = 0;
+    for (; index > 0; index -= lowestBit(index)) {
+      sum += tree_[index];
+    }
+    return sum;
+  }
+
+  FloatType totalWeight() const {
+    return prefixWeight(weights_.size());
+  }
+
+  /// Returns the index of the element at the cumulative weight u * totalWeight() for u in [0, 1).
+  size_t sample(const FloatType u) const {
+    BH_ASSERT(!empty());
+    FloatType target = u * totalWeight();
+    // Descend the implicit tree to find the last position with a prefix sum <= target
+    size_t position = 0;
+    size_t step = 1;
+    while ((step << 1) < tree_.size()) {
+      step <<= 1;
+    }
+    for (; step > 0; step >>= 1) {
+      const size_t next = position + step;
+      if (next < tree_.size() && tree_[next] <= target) {
+        position = next;
+        target -= tree_[next];
+      }
+    }
+    // Skip elements with zero weight that can be hit due to rounding
+    size_t index = std::min(position, weights_.size() - 1);
+    while (index > 0 && weights_[index] <= 0) {
+      --index;
+    }
+    return index;
+  }
+
+  template <typename RandomT>
+  size_t operator()(RandomT& random) const {
+    return sample(random.sampleUniform());
+  }
+
+private:
+  static size_t lowestBit(const size_t i) {
+    return i & (~i + 1);
+  }
+
+  std::vector<FloatType> weights_;
+  // 1-based Fenwick tree. Node i holds the sum of the weights in (i - lowestBit(i), i].
+  std::vector<FloatType> tree_;
+};
+
+}
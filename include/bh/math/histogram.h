@@ -19,7 +19,7 @@ std::vector<N> computeHistogram(const Iterator first, const Iterator last,
 /// The bins are given by the range [first_bin, last_bin), i.e. the first bin is [*first_bin, *(first_bin + 1)).
 /// Condition: last_bin - first_bin >= 2.
 /// Values below *first_bin are ignored.
-template <typename Iterator, typename BinIterator, typename N = size_t>
+template <typename Iterator, typename BinIterator, typename N>
 std::vector<N> computeHistogram(const Iterator first, const Iterator last,
                                 const BinIterator first_bin, const BinIterator last_bin) {
   BH_ASSERT(last_bin - first_bin >= 2);
@@ -7,8 +7,14 @@
 //==================================================
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <functional>
+#include <list>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <boost/functional/hash.hpp>
 
 namespace bh {
 
@@ -37,6 +43,130 @@ private:
   FactoryType factory_;
 };
 
+/// Least-recently-used cache of shared instances with a weight budget.
+/// The weight of an entry is given by a user function (i.e. number of bytes) and defaults to 1.
+/// Evicted instances stay alive as long as somebody else holds a reference.
+/// The cache is not thread-safe.
+template <typename KeyT, typename ValueT, typename HashT = std::hash<KeyT>>
+class LRUCache {
+public:
+  using FactoryType = std::function<std::shared_ptr<ValueT>(const KeyT&)>;
+  using WeightFunctionType = std::function<std::size_t(const ValueT&)>;
+
+  LRUCache(const std::size_t capacity);
+
+  LRUCache(const std::size_t capacity, const FactoryType factory,
+           const WeightFunctionType weight_function = WeightFunctionType());
+
+  void setFactory(const FactoryType factory);
+
+  void setWeightFunction(const WeightFunctionType weight_function);
+
+  void setCapacity(const std::size_t capacity);
+
+  void clear();
+
+  std::size_t size() const;
+
+  std::size_t capacity() const;
+
+  std::size_t weight() const;
+
+  bool hasInstance(const KeyT& key) const;
+
+  /// Return cached instance and mark it as most recently used or nullptr if not cached.
+  std::shared_ptr<ValueT> find(const KeyT& key);
+
+  /// Return cached instance or create it with the factory and insert it.
+  std::shared_ptr<ValueT> getInstance(const KeyT& key);
+
+  void insert(const KeyT& key, const std::shared_ptr<ValueT>& value);
+
+  bool erase(const KeyT& key);
+
+  std::size_t numHits() const;
+
+  std::size_t numMisses() const;
+
+  std::size_t numEvictions() const;
+
+  void resetStatistics();
+
+private:
+  struct Entry {
+    KeyT key;
+    std::shared_ptr<ValueT> value;
+    std::size_t weight;
+  };
+  using EntryList = std::list<Entry>;
+
+  std::size_t computeWeight(const ValueT& value) const;
+
+  void evict();
+
+  std::size_t capacity_;
+  std::size_t weight_;
+  EntryList entries_;
+  std::unordered_map<KeyT, typename EntryList::iterator, HashT> entry_map_;
+  FactoryType factory_;
+  WeightFunctionType weight_function_;
+  std::size_t num_hits_;
+  std::size_t num_misses_;
+  std::size_t num_evictions_;
+};
+
+/// Slab allocator for objects of a single type that belong to one owner (e.g. the nodes of one tree).
+/// Objects are carved out of slabs with a bump pointer and freed objects are reused through a free list.
+/// Slabs grow geometrically up to max_slab_capacity so that small owners stay small.
+/// release() and the destructor return all slabs at once without running destructors of the objects,
+/// so this must only be used for objects with a trivial destructor or after the owner destroyed them.
+/// Not thread-safe.
+template <typename T>
+class ObjectArena {
+public:
+  static constexpr std::size_t kInitialSlabCapacity = 64;
+  static constexpr std::size_t kDefaultMaxSlabCapacity = 1 << 16;
+
+  explicit ObjectArena(const std::size_t max_slab_capacity = kDefaultMaxSlabCapacity);
+
+  ObjectArena(const ObjectArena&) = delete;
+  ObjectArena& operator=(const ObjectArena&) = delete;
+
+  /// Return uninitialized memory for one object of type T
+  void* allocate();
+
+  /// Return memory of a single object to the free list (the object must have been destroyed)
+  void deallocate(void* ptr);
+
+  /// Free all slabs
+  void release();
+
+  void swap(ObjectArena& other);
+
+  /// Number of live objects
+  std::size_t numAllocated() const;
+
+  /// Bytes held by the slabs (including free objects)
+  std::size_t memoryUsage() const;
+
+private:
+  union Slot {
+    Slot* next;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void addSlab();
+
+  std::size_t max_slab_capacity_;
+  std::size_t next_slab_capacity_;
+  std::vector<std::unique_ptr<Slot[]>> slabs_;
+  Slot* bump_ptr_;
+  Slot* bump_end_;
+  Slot* free_list_;
+  std::size_t num_allocated_;
+  std::size_t num_reserved_;
+};
+
 // -------------------------
 // Hash function for pairs and tuples
 // -------------------------
@@ -181,4 +311,262 @@ CacheStorage<KeyT, ValueT, HashT>::getInstance(const KeyT& key, const bool do_au
   return shared_ptr;
 }
 
+// -------------------------
+// LRU cache implementation
+// -------------------------
+
+template <typename KeyT, typename ValueT, typename HashT>
+LRUCache<KeyT, ValueT, HashT>::LRUCache(const std::size_t capacity)
+    : LRUCache(capacity, [](const KeyT& key) { return std::make_shared<ValueT>(); }) {}
+
+template <typename KeyT, typename ValueT, typename HashT>
+LRUCache<KeyT, ValueT, HashT>::LRUCache(
+    const std::size_t capacity, const FactoryType factory, const WeightFunctionType weight_function)
+    : capacity_(capacity), weight_(0), factory_(factory), weight_function_(weight_function),
+      num_hits_(0), num_misses_(0), num_evictions_(0) {}
+
+template <typename KeyT, typename ValueT, typename HashT>
+void
+LRUCache<KeyT, ValueT, HashT>::setFactory(const FactoryType factory) {
+  factory_ = factory;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+void
+LRUCache<KeyT, ValueT, HashT>::setWeightFunction(const WeightFunctionType weight_function) {
+  weight_function_ = weight_function;
+  weight_ = 0;
+  for (Entry& entry : entries_) {
+    entry.weight = computeWeight(*entry.value);
+    weight_ += entry.weight;
+  }
+  evict();
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+void
+LRUCache<KeyT, ValueT, HashT>::setCapacity(const std::size_t capacity) {
+  capacity_ = capacity;
+  evict();
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+void
+LRUCache<KeyT, ValueT, HashT>::clear() {
+  entries_.clear();
+  entry_map_.clear();
+  weight_ = 0;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::size_t
+LRUCache<KeyT, ValueT, HashT>::size() const {
+  return entries_.size();
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::size_t
+LRUCache<KeyT, ValueT, HashT>::capacity() const {
+  return capacity_;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::size_t
+LRUCache<KeyT, ValueT, HashT>::weight() const {
+  return weight_;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+bool
+LRUCache<KeyT, ValueT, HashT>::hasInstance(const KeyT& key) const {
+  return entry_map_.count(key) > 0;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::shared_ptr<ValueT>
+LRUCache<KeyT, ValueT, HashT>::find(const KeyT& key) {
+  auto it = entry_map_.find(key);
+  if (it == entry_map_.end()) {
+    ++num_misses_;
+    return std::shared_ptr<ValueT>();
+  }
+  ++num_hits_;
+  // Move entry to the front of the recently-used list
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->value;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::shared_ptr<ValueT>
+LRUCache<KeyT, ValueT, HashT>::getInstance(const KeyT& key) {
+  std::shared_ptr<ValueT> value = find(key);
+  if (!value) {
+    value = factory_(key);
+    insert(key, value);
+  }
+  return value;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+void
+LRUCache<KeyT, ValueT, HashT>::insert(const KeyT& key, const std::shared_ptr<ValueT>& value) {
+  erase(key);
+  const std::size_t weight = computeWeight(*value);
+  entries_.push_front(Entry { key, value, weight });
+  entry_map_.emplace(key, entries_.begin());
+  weight_ += weight;
+  evict();
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+bool
+LRUCache<KeyT, ValueT, HashT>::erase(const KeyT& key) {
+  auto it = entry_map_.find(key);
+  if (it == entry_map_.end()) {
+    return false;
+  }
+  weight_ -= it->second->weight;
+  entries_.erase(it->second);
+  entry_map_.erase(it);
+  return true;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::size_t
+LRUCache<KeyT, ValueT, HashT>::numHits() const {
+  return num_hits_;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::size_t
+LRUCache<KeyT, ValueT, HashT>::numMisses() const {
+  return num_misses_;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::size_t
+LRUCache<KeyT, ValueT, HashT>::numEvictions() const {
+  return num_evictions_;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+void
+LRUCache<KeyT, ValueT, HashT>::resetStatistics() {
+  num_hits_ = 0;
+  num_misses_ = 0;
+  num_evictions_ = 0;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+std::size_t
+LRUCache<KeyT, ValueT, HashT>::computeWeight(const ValueT& value) const {
+  if (weight_function_) {
+    return weight_function_(value);
+  }
+  return 1;
+}
+
+template <typename KeyT, typename ValueT, typename HashT>
+void
+LRUCache<KeyT, ValueT, HashT>::evict() {
+  // Always keep the most recently used entry even if it exceeds the capacity on its own
+  while (weight_ > capacity_ && entries_.size() > 1) {
+    const Entry& entry = entries_.back();
+    weight_ -= entry.weight;
+    entry_map_.erase(entry.key);
+    entries_.pop_back();
+    ++num_evictions_;
+  }
+}
+
+// -------------------------
+// Object arena implementation
+// -------------------------
+
+template <typename T>
+constexpr std::size_t ObjectArena<T>::kInitialSlabCapacity;
+
+template <typename T>
+constexpr std::size_t ObjectArena<T>::kDefaultMaxSlabCapacity;
+
+template <typename T>
+ObjectArena<T>::ObjectArena(const std::size_t max_slab_capacity)
+    : max_slab_capacity_(std::max<std::size_t>(max_slab_capacity, 1)),
+      next_slab_capacity_(std::min(kInitialSlabCapacity, max_slab_capacity_)),
+      bump_ptr_(nullptr), bump_end_(nullptr), free_list_(nullptr),
+      num_allocated_(0), num_reserved_(0) {}
+
+template <typename T>
+void* ObjectArena<T>::allocate() {
+  Slot* slot;
+  if (free_list_ != nullptr) {
+    slot = free_list_;
+    free_list_ = slot->next;
+  }
+  else {
+    if (bump_ptr_ == bump_end_) {
+      addSlab();
+    }
+    slot = bump_ptr_;
+    ++bump_ptr_;
+  }
+  ++num_allocated_;
+  return slot;
+}
+
+template <typename T>
+void ObjectArena<T>::deallocate(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  Slot* slot = static_cast<Slot*>(ptr);
+  slot->next = free_list_;
+  free_list_ = slot;
+  --num_allocated_;
+}
+
+template <typename T>
+void ObjectArena<T>::release() {
+  slabs_.clear();
+  slabs_.shrink_to_fit();
+  next_slab_capacity_ = std::min(kInitialSlabCapacity, max_slab_capacity_);
+  bump_ptr_ = nullptr;
+  bump_end_ = nullptr;
+  free_list_ = nullptr;
+  num_allocated_ = 0;
+  num_reserved_ = 0;
+}
+
+template <typename T>
+void ObjectArena<T>::swap(ObjectArena& other) {
+  std::swap(max_slab_capacity_, other.max_slab_capacity_);
+  std::swap(next_slab_capacity_, other.next_slab_capacity_);
+  slabs_.swap(other.slabs_);
+  std::swap(bump_ptr_, other.bump_ptr_);
+  std::swap(bump_end_, other.bump_end_);
+  std::swap(free_list_, other.free_list_);
+  std::swap(num_allocated_, other.num_allocated_);
+  std::swap(num_reserved_, other.num_reserved_);
+}
+
+template <typename T>
+std::size_t ObjectArena<T>::numAllocated() const {
+  return num_allocated_;
+}
+
+template <typename T>
+std::size_t ObjectArena<T>::memoryUsage() const {
+  return num_reserved_ * sizeof(Slot) + slabs_.capacity() * sizeof(std::unique_ptr<Slot[]>);
+}
+
+template <typename T>
+void ObjectArena<T>::addSlab() {
+  const std::size_t capacity = next_slab_capacity_;
+  slabs_.emplace_back(new Slot[capacity]);
+  bump_ptr_ = slabs_.back().get();
+  bump_end_ = bump_ptr_ + capacity;
+  num_reserved_ += capacity;
+  next_slab_capacity_ = std::min(2 * capacity, max_slab_capacity_);
+}
+
 }
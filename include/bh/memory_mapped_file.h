@@ -0,0 +1,81 @@
+//==================================================
+// memory_mapped_file.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 14.05.17
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "common.h"
+
+namespace bh {
+
+///
+/// Read-only memory mapping of a whole file (POSIX only).
+///
+class MemoryMappedFile {
+public:
+  explicit MemoryMappedFile(const std::string& filename)
+      : data_(nullptr), size_(0) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw BH_EXCEPTION(std::string("Unable to open file: ") + filename);
+    }
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0) {
+      ::close(fd);
+      throw BH_EXCEPTION(std::string("Unable to get size of file: ") + filename);
+    }
+    size_ = static_cast<std::size_t>(file_stat.st_size);
+    if (size_ > 0) {
+      void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        throw BH_EXCEPTION(std::string("Unable to map file into memory: ") + filename);
+      }
+      // The file is read front to back
+      ::madvise(data, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(data);
+    }
+    ::close(fd);
+  }
+
+  MemoryMappedFile(const MemoryMappedFile&) = delete;
+  MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+  ~MemoryMappedFile() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  const char* begin() const {
+    return data_;
+  }
+
+  const char* end() const {
+    return data_ + size_;
+  }
+
+private:
+  const char* data_;
+  std::size_t size_;
+};
+
+}
@@ -0,0 +1,296 @@
+//==================================================
+// ply_point_reader.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 12.05.17
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../common.h"
+#include "../eigen.h"
+
+namespace bh {
+
+///
+/// Streaming reader for the vertex positions of a PLY file.
+/// Only the x, y, z properties of the vertex element are returned. The vertex element has to be
+/// the first element of the file (as written by COLMAP, MeshLab, etc.). Points are read in chunks
+/// so that large point clouds don't have to be kept in memory.
+///
+class PlyPointReader {
+public:
+  using size_t = std::size_t;
+
+  explicit PlyPointReader(const std::string& filename)
+      : num_points_(0), num_points_read_(0), vertex_size_(0) {
+    in_.open(filename, std::ios::binary);
+    if (!in_) {
+      throw BH_EXCEPTION(std::string("Unable to open PLY file: ") + filename);
+    }
+    readHeader();
+  }
+
+  size_t numOfPoints() const {
+    return num_points_;
+  }
+
+  size_t numOfPointsRead() const {
+    return num_points_read_;
+  }
+
+  bool hasMorePoints() const {
+    return num_points_read_ < num_points_;
+  }
+
+  /// Reads up to max_points points and replaces the content of points with them.
+  /// Returns the number of points that were read (0 if all points have been read).
+  template <typename FloatT>
+  size_t readPoints(const size_t max_points, std::vector<Eigen::Matrix<FloatT, 3, 1>>* points) {
+    const size_t num_points = std::min(max_points, num_points_ - num_points_read_);
+    points->resize(num_points);
+    if (format_ == Format::ASCII) {
+      std::string line;
+      std::vector<double> values(properties_.size());
+      for (size_t i = 0; i < num_points; ++i) {
+        if (!std::getline(in_, line)) {
+          throw BH_EXCEPTION("Unexpected end of PLY file");
+        }
+        std::istringstream line_in(line);
+        for (size_t j = 0; j < values.size(); ++j) {
+          line_in >> values[j];
+        }
+        if (!line_in) {
+          throw BH_EXCEPTION("Invalid vertex in PLY file");
+        }
+        for (size_t k = 0; k < 3; ++k) {
+          (*points)[i](k) = static_cast<FloatT>(values[xyz_property_indices_[k]]);
+        }
+      }
+    }
+    else {
+      buffer_.resize(num_points * vertex_size_);
+      in_.read(buffer_.data(), buffer_.size());
+      if (!in_) {
+        throw BH_EXCEPTION("Unexpected end of PLY file");
+      }
+      for (size_t i = 0; i < num_points; ++i) {
+        const char* vertex_data = buffer_.data() + i * vertex_size_;
+        for (size_t k = 0; k < 3; ++k) {
+          const Property& property = properties_[xyz_property_indices_[k]];
+          (*points)[i](k) = static_cast<FloatT>(readBinaryValue(vertex_data + property.offset, property.type));
+        }
+      }
+    }
+    num_points_read_ += num_points;
+    return num_points;
+  }
+
+private:
+  enum class Format {
+    ASCII,
+    BINARY_LITTLE_ENDIAN,
+    BINARY_BIG_ENDIAN,
+  };
+
+  enum class Type {
+    INT8,
+    UINT8,
+    INT16,
+    UINT16,
+    INT32,
+    UINT32,
+    FLOAT32,
+    FLOAT64,
+  };
+
+  struct Property {
+    std::string name;
+    Type type;
+    size_t offset;
+  };
+
+  static bool parseType(const std::string& name, Type* type, size_t* size) {
+    if (name == "char" || name == "int8") {
+      *type = Type::INT8;
+      *size = 1;
+    }
+    else if (name == "uchar" || name == "uint8") {
+      *type = Type::UINT8;
+      *size = 1;
+    }
+    else if (name == "short" || name == "int16") {
+      *type = Type::INT16;
+      *size = 2;
+    }
+    else if (name == "ushort" || name == "uint16") {
+      *type = Type::UINT16;
+      *size = 2;
+    }
+    else if (name == "int" || name == "int32") {
+      *type = Type::INT32;
+      *size = 4;
+    }
+    else if (name == "uint" || name == "uint32") {
+      *type = Type::UINT32;
+      *size = 4;
+    }
+    else if (name == "float" || name == "float32") {
+      *type = Type::FLOAT32;
+      *size = 4;
+    }
+    else if (name == "double" || name == "float64") {
+      *type = Type::FLOAT64;
+      *size = 8;
+    }
+    else {
+      return false;
+    }
+    return true;
+  }
+
+  static bool isHostLittleEndian() {
+    const uint16_t value = 1;
+    char byte;
+    std::memcpy(&byte, &value, 1);
+    return byte == 1;
+  }
+
+  template <typename T>
+  T readBinaryValue(const char* data) const {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, data, sizeof(T));
+    if ((format_ == Format::BINARY_LITTLE_ENDIAN) != isHostLittleEndian()) {
+      std::reverse(bytes, bytes + sizeof(T));
+    }
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+  }
+
+  double readBinaryValue(const char* data, const Type type) const {
+    switch (type) {
+      case Type::INT8:
+        return readBinaryValue<int8_t>(data);
+      case Type::UINT8:
+        return readBinaryValue<uint8_t>(data);
+      case Type::INT16:
+        return readBinaryValue<int16_t>(data);
+      case Type::UINT16:
+        return readBinaryValue<uint16_t>(data);
+      case Type::INT32:
+        return readBinaryValue<int32_t>(data);
+      case Type::UINT32:
+        return readBinaryValue<uint32_t>(data);
+      case Type::FLOAT32:
+        return readBinaryValue<float>(data);
+      case Type::FLOAT64:
+        return readBinaryValue<double>(data);
+    }
+    return 0;
+  }
+
+  void readHeader() {
+    std::string line;
+    std::getline(in_, line);
+    if (line.substr(0, 3) != "ply") {
+      throw BH_EXCEPTION("Not a PLY file");
+    }
+    bool format_found = false;
+    bool vertex_element_found = false;
+    bool in_vertex_element = false;
+    while (std::getline(in_, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      std::istringstream line_in(line);
+      std::string keyword;
+      line_in >> keyword;
+      if (keyword == "format") {
+        std::string format;
+        line_in >> format;
+        if (format == "ascii") {
+          format_ = Format::ASCII;
+        }
+        else if (format == "binary_little_endian") {
+          format_ = Format::BINARY_LITTLE_ENDIAN;
+        }
+        else if (format == "binary_big_endian") {
+          format_ = Format::BINARY_BIG_ENDIAN;
+        }
+        else {
+          throw BH_EXCEPTION(std::string("Unknown PLY format: ") + format);
+        }
+        format_found = true;
+      }
+      else if (keyword == "element") {
+        std::string name;
+        line_in >> name;
+        if (name == "vertex") {
+          if (vertex_element_found) {
+            throw BH_EXCEPTION("PLY file has multiple vertex elements");
+          }
+          line_in >> num_points_;
+          vertex_element_found = true;
+          in_vertex_element = true;
+        }
+        else {
+          if (!vertex_element_found) {
+            throw BH_EXCEPTION("PLY vertex element has to be the first element");
+          }
+          in_vertex_element = false;
+        }
+      }
+      else if (keyword == "property" && in_vertex_element) {
+        std::string type_name;
+        std::string name;
+        line_in >> type_name >> name;
+        if (type_name == "list") {
+          throw BH_EXCEPTION("List properties are not supported for PLY vertices");
+        }
+        Type type;
+        size_t size;
+        if (!parseType(type_name, &type, &size)) {
+          throw BH_EXCEPTION(std::string("Unknown PLY property type: ") + type_name);
+        }
+        properties_.push_back(Property { name, type, vertex_size_ });
+        vertex_size_ += size;
+      }
+      else if (keyword == "end_header") {
+        break;
+      }
+    }
+    if (!format_found || !vertex_element_found) {
+      throw BH_EXCEPTION("Invalid PLY header");
+    }
+    const char* xyz_names[3] = { "x", "y", "z" };
+    for (size_t k = 0; k < 3; ++k) {
+      const auto it = std::find_if(properties_.begin(), properties_.end(), [&](const Property& property) {
+        return property.name == xyz_names[k];
+      });
+      if (it == properties_.end()) {
+        throw BH_EXCEPTION(std::string("PLY vertex element has no property ") + xyz_names[k]);
+      }
+      xyz_property_indices_[k] = it - properties_.begin();
+    }
+  }
+
+  std::ifstream in_;
+  Format format_;
+  size_t num_points_;
+  size_t num_points_read_;
+  std::vector<Property> properties_;
+  size_t vertex_size_;
+  size_t xyz_property_indices_[3];
+  std::vector<char> buffer_;
+};
+
+}
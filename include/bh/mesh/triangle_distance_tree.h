@@ -0,0 +1,138 @@
+//==================================================
+// triangle_distance_tree.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 12.05.17
+//
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#if defined(__AVX__)
+  #include <immintrin.h>
+#endif
+#include "../common.h"
+#include "../eigen.h"
+#include "../math/geometry.h"
+
+namespace bh {
+
+///
+/// Bounding volume hierarchy over triangles for point-to-mesh distance queries.
+/// Leaves hold up to kLeafSize triangles in structure-of-arrays layout so that the distance of a point
+/// to all triangles of a leaf is computed at once (with AVX for float trees if available).
+/// The tree is build by median splits along the largest extent of the triangle centers.
+///
+template <typename FloatT = float>
+class TriangleDistanceTree {
+public:
+  using size_t = std::size_t;
+  using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatT)
+  using TriangleType = Triangle<FloatT>;
+  using BoundingBoxType = BoundingBox3D<FloatT>;
+
+  static constexpr size_t kLeafSize = 8;
+  static const size_t kInvalidIndex = size_t(-1);
+
+  struct QueryResult {
+    QueryResult()
+        : distance_square(std::numeric_limits<FloatT>::max()), triangle_index(kInvalidIndex) {}
+
+    bool isValid() const {
+      return triangle_index != kInvalidIndex;
+    }
+
+    FloatT distance_square;
+    // Index of the closest triangle (in the order given to the constructor), kInvalidIndex if there is no
+    // triangle within the maximum distance.
+    size_t triangle_index;
+  };
+
+  TriangleDistanceTree();
+
+  template <typename TriangleContainer>
+  explicit TriangleDistanceTree(const TriangleContainer& triangles);
+
+  template <typename TriangleIterator>
+  TriangleDistanceTree(const TriangleIterator first, const TriangleIterator last);
+
+  size_t numOfTriangles() const;
+
+  /// Closest triangle to a point. Triangles further away than max_distance are ignored.
+  QueryResult findClosestTriangle(const Vector3& point,
+                                  const FloatT max_distance = std::numeric_limits<FloatT>::max()) const;
+
+  /// Closest triangles for many points. The points are distributed over all threads (OpenMP).
+  void findClosestTriangles(const Vector3* points,
+                            const size_t num_points,
+                            const FloatT max_distance,
+                            QueryResult* results) const;
+
+  /// Squared Euclidean distance of a point to a (filled) triangle.
+  static FloatT computePointTriangleDistanceSquare(const Vector3& point, const TriangleType& triangle);
+
+private:
+  static constexpr size_t kMaxTraversalStackSize = 64;
+
+  /// Inner nodes have num_triangles == 0, the first child is the next node and the second child is given by offset.
+  /// For leaves offset is the index of the leaf block.
+  struct Node {
+    FloatT bbox_min[3];
+    FloatT bbox_max[3];
+    uint32_t offset;
+    uint32_t num_triangles;
+  };
+
+  /// Triangles of a leaf in structure-of-arrays layout. Unused lanes repeat the first triangle.
+  struct LeafBlock {
+    // Edge origins (v1, v2, v3) and edge vectors (v2 - v1, v3 - v2, v1 - v3)
+    FloatT edge_origin[3][3][kLeafSize];
+    FloatT edge[3][3][kLeafSize];
+    FloatT edge_inv_length_square[3][kLeafSize];
+    // Unnormalized normal and its inverse squared length (0 for degenerate triangles)
+    FloatT normal[3][kLeafSize];
+    FloatT normal_inv_length_square[kLeafSize];
+    size_t triangle_indices[kLeafSize];
+  };
+
+  struct BuildEntry {
+    size_t triangle_index;
+    Vector3 center;
+  };
+
+  template <typename TriangleIterator>
+  void build(const TriangleIterator first, const TriangleIterator last);
+
+  void buildRecursive(const typename std::vector<BuildEntry>::iterator first,
+                      const typename std::vector<BuildEntry>::iterator last,
+                      const std::vector<TriangleType>& triangles);
+
+  void initLeafBlock(const typename std::vector<BuildEntry>::const_iterator first,
+                     const typename std::vector<BuildEntry>::const_iterator last,
+                     const std::vector<TriangleType>& triangles,
+                     LeafBlock* block) const;
+
+  FloatT computeBoundingBoxDistanceSquare(const Node& node, const Vector3& point) const;
+
+  /// Squared distances of a point to all triangles of a leaf block
+  void computeLeafDistancesSquare(const LeafBlock& block, const Vector3& point, FloatT* distances_square) const;
+
+  void computeLeafDistancesSquare(const LeafBlock& block, const Vector3& point, FloatT* distances_square,
+                                  std::false_type) const;
+
+  void computeLeafDistancesSquare(const LeafBlock& block, const Vector3& point, FloatT* distances_square,
+                                  std::true_type) const;
+
+  std::vector<Node> nodes_;
+  std::vector<LeafBlock> leaf_blocks_;
+  size_t num_triangles_;
+};
+
+}
+
+#include "triangle_distance_tree.hxx"
@@ -0,0 +1,323 @@
+//==================================================
+// triangle_distance_tree.hxx
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 12.05.17
+//
+
+#include <algorithm>
+
+namespace bh {
+
+template <typename FloatT>
+constexpr std::size_t TriangleDistanceTree<FloatT>::kLeafSize;
+
+template <typename FloatT>
+constexpr std::size_t TriangleDistanceTree<FloatT>::kMaxTraversalStackSize;
+
+template <typename FloatT>
+TriangleDistanceTree<FloatT>::TriangleDistanceTree()
+    : num_triangles_(0) {}
+
+template <typename FloatT>
+template <typename TriangleContainer>
+TriangleDistanceTree<FloatT>::TriangleDistanceTree(const TriangleContainer& triangles)
+    : num_triangles_(0) {
+  build(std::begin(triangles), std::end(triangles));
+}
+
+template <typename FloatT>
+template <typename TriangleIterator>
+TriangleDistanceTree<FloatT>::TriangleDistanceTree(const TriangleIterator first, const TriangleIterator last)
+    : num_triangles_(0) {
+  build(first, last);
+}
+
+template <typename FloatT>
+auto TriangleDistanceTree<FloatT>::numOfTriangles() const -> size_t {
+  return num_triangles_;
+}
+
+template <typename FloatT>
+auto TriangleDistanceTree<FloatT>::findClosestTriangle(
+        const Vector3& point, const FloatT max_distance) const -> QueryResult {
+  QueryResult result;
+  if (nodes_.empty()) {
+    return result;
+  }
+  FloatT best_distance_square = max_distance < std::sqrt(std::numeric_limits<FloatT>::max())
+                                ? max_distance * max_distance : std::numeric_limits<FloatT>::max();
+  // Nodes are visited closest bounding box first so that the bound shrinks quickly
+  std::pair<size_t, FloatT> stack[kMaxTraversalStackSize];
+  size_t stack_size = 0;
+  stack[stack_size++] = std::make_pair(size_t(0), computeBoundingBoxDistanceSquare(nodes_[0], point));
+  FloatT leaf_distances_square[kLeafSize];
+  while (stack_size > 0) {
+    --stack_size;
+    if (stack[stack_size].second > best_distance_square) {
+      continue;
+    }
+    const size_t node_index = stack[stack_size].first;
+    const Node& node = nodes_[node_index];
+    if (node.num_triangles > 0) {
+      const LeafBlock& block = leaf_blocks_[node.offset];
+      computeLeafDistancesSquare(block, point, leaf_distances_square);
+      for (size_t k = 0; k < node.num_triangles; ++k) {
+        if (leaf_distances_square[k] <= best_distance_square) {
+          best_distance_square = leaf_distances_square[k];
+          result.distance_square = leaf_distances_square[k];
+          result.triangle_index = block.triangle_indices[k];
+        }
+      }
+      continue;
+    }
+    const size_t first_child = node_index + 1;
+    const size_t second_child = node.offset;
+    const FloatT first_distance_square = computeBoundingBoxDistanceSquare(nodes_[first_child], point);
+    const FloatT second_distance_square = computeBoundingBoxDistanceSquare(nodes_[second_child], point);
+    BH_ASSERT(stack_size + 2 <= kMaxTraversalStackSize);
+    if (first_distance_square <= second_distance_square) {
+      stack[stack_size++] = std::make_pair(second_child, second_distance_square);
+      stack[stack_size++] = std::make_pair(first_child, first_distance_square);
+    }
+    else {
+      stack[stack_size++] = std::make_pair(first_child, first_distance_square);
+      stack[stack_size++] = std::make_pair(second_child, second_distance_square);
+    }
+  }
+  return result;
+}
+
+template <typename FloatT>
+void TriangleDistanceTree<FloatT>::findClosestTriangles(
+        const Vector3* points,
+        const size_t num_points,
+        const FloatT max_distance,
+        QueryResult* results) const {
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(num_points); ++i) {
+    results[i] = findClosestTriangle(points[i], max_distance);
+  }
+}
+
+template <typename FloatT>
+auto TriangleDistanceTree<FloatT>::computePointTriangleDistanceSquare(
+        const Vector3& point, const TriangleType& triangle) -> FloatT {
+  const Vector3 vertices[3] = { triangle.v1(), triangle.v2(), triangle.v3() };
+  const Vector3 normal = (vertices[1] - vertices[0]).cross(vertices[2] - vertices[0]);
+  bool inside = normal.squaredNorm() > 0;
+  FloatT edge_distance_square = std::numeric_limits<FloatT>::max();
+  for (size_t i = 0; i < 3; ++i) {
+    const Vector3 edge = vertices[(i + 1) % 3] - vertices[i];
+    const Vector3 d = point - vertices[i];
+    const FloatT edge_length_square = edge.squaredNorm();
+    FloatT t = edge_length_square > 0 ? d.dot(edge) / edge_length_square : 0;
+    t = std::min(std::max(t, FloatT(0)), FloatT(1));
+    edge_distance_square = std::min(edge_distance_square, (d - t * edge).squaredNorm());
+    inside = inside && edge.cross(d).dot(normal) >= 0;
+  }
+  if (inside) {
+    const FloatT plane_distance = (point - vertices[0]).dot(normal);
+    return plane_distance * plane_distance / normal.squaredNorm();
+  }
+  return edge_distance_square;
+}
+
+template <typename FloatT>
+template <typename TriangleIterator>
+void TriangleDistanceTree<FloatT>::build(const TriangleIterator first, const TriangleIterator last) {
+  const std::vector<TriangleType> triangles(first, last);
+  BH_ASSERT(triangles.size() < std::numeric_limits<uint32_t>::max());
+  num_triangles_ = triangles.size();
+  nodes_.clear();
+  leaf_blocks_.clear();
+  if (triangles.empty()) {
+    return;
+  }
+  std::vector<BuildEntry> entries(triangles.size());
+  for (size_t i = 0; i < triangles.size(); ++i) {
+    entries[i].triangle_index = i;
+    entries[i].center = triangles[i].getCenter();
+  }
+  nodes_.reserve(2 * (triangles.size() / kLeafSize + 1));
+  leaf_blocks_.reserve(triangles.size() / kLeafSize + 1);
+  buildRecursive(entries.begin(), entries.end(), triangles);
+}
+
+template <typename FloatT>
+void TriangleDistanceTree<FloatT>::buildRecursive(
+        const typename std::vector<BuildEntry>::iterator first,
+        const typename std::vector<BuildEntry>::iterator last,
+        const std::vector<TriangleType>& triangles) {
+  const size_t node_index = nodes_.size();
+  nodes_.emplace_back();
+  BoundingBoxType bbox;
+  BoundingBoxType center_bbox;
+  for (auto it = first; it != last; ++it) {
+    const TriangleType& triangle = triangles[it->triangle_index];
+    bbox.include(triangle.v1());
+    bbox.include(triangle.v2());
+    bbox.include(triangle.v3());
+    center_bbox.include(it->center);
+  }
+  for (size_t i = 0; i < 3; ++i) {
+    nodes_[node_index].bbox_min[i] = bbox.getMinimum(i);
+    nodes_[node_index].bbox_max[i] = bbox.getMaximum(i);
+  }
+
+  if (static_cast<size_t>(last - first) <= kLeafSize) {
+    nodes_[node_index].offset = static_cast<uint32_t>(leaf_blocks_.size());
+    nodes_[node_index].num_triangles = static_cast<uint32_t>(last - first);
+    leaf_blocks_.emplace_back();
+    initLeafBlock(first, last, triangles, &leaf_blocks_.back());
+    return;
+  }
+
+  size_t axis;
+  center_bbox.getMaxExtent(&axis);
+  const auto middle = first + (last - first) / 2;
+  std::nth_element(first, middle, last, [axis](const BuildEntry& a, const BuildEntry& b) {
+    return a.center(axis) < b.center(axis);
+  });
+  buildRecursive(first, middle, triangles);
+  nodes_[node_index].offset = static_cast<uint32_t>(nodes_.size());
+  nodes_[node_index].num_triangles = 0;
+  buildRecursive(middle, last, triangles);
+}
+
+template <typename FloatT>
+void TriangleDistanceTree<FloatT>::initLeafBlock(
+        const typename std::vector<BuildEntry>::const_iterator first,
+        const typename std::vector<BuildEntry>::const_iterator last,
+        const std::vector<TriangleType>& triangles,
+        LeafBlock* block) const {
+  for (size_t k = 0; k < kLeafSize; ++k) {
+    const size_t triangle_index = k < static_cast<size_t>(last - first) ? (first + k)->triangle_index
+                                                                         : first->triangle_index;
+    const TriangleType& triangle = triangles[triangle_index];
+    const Vector3 vertices[3] = { triangle.v1(), triangle.v2(), triangle.v3() };
+    for (size_t i = 0; i < 3; ++i) {
+      const Vector3 edge = vertices[(i + 1) % 3] - vertices[i];
+      const FloatT edge_length_square = edge.squaredNorm();
+      for (size_t j = 0; j < 3; ++j) {
+        block->edge_origin[i][j][k] = vertices[i](j);
+        block->edge[i][j][k] = edge(j);
+      }
+      block->edge_inv_length_square[i][k] = edge_length_square > 0 ? 1 / edge_length_square : 0;
+    }
+    const Vector3 normal = (vertices[1] - vertices[0]).cross(vertices[2] - vertices[0]);
+    const FloatT normal_length_square = normal.squaredNorm();
+    for (size_t j = 0; j < 3; ++j) {
+      block->normal[j][k] = normal(j);
+    }
+    block->normal_inv_length_square[k] = normal_length_square > 0 ? 1 / normal_length_square : 0;
+    block->triangle_indices[k] = triangle_index;
+  }
+}
+
+template <typename FloatT>
+auto TriangleDistanceTree<FloatT>::computeBoundingBoxDistanceSquare(
+        const Node& node, const Vector3& point) const -> FloatT {
+  FloatT distance_square = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    const FloatT d = std::max(std::max(node.bbox_min[i] - point(i), point(i) - node.bbox_max[i]), FloatT(0));
+    distance_square += d * d;
+  }
+  return distance_square;
+}
+
+template <typename FloatT>
+void TriangleDistanceTree<FloatT>::computeLeafDistancesSquare(
+        const LeafBlock& block, const Vector3& point, FloatT* distances_square) const {
+#if defined(__AVX__)
+  computeLeafDistancesSquare(block, point, distances_square,
+                             std::integral_constant<bool, std::is_same<FloatT, float>::value && kLeafSize == 8>());
+#else
+  computeLeafDistancesSquare(block, point, distances_square, std::false_type());
+#endif
+}
+
+template <typename FloatT>
+void TriangleDistanceTree<FloatT>::computeLeafDistancesSquare(
+        const LeafBlock& block, const Vector3& point, FloatT* distances_square, std::false_type) const {
+  // Same computation as computePointTriangleDistanceSquare() but with precomputed edges
+  for (size_t k = 0; k < kLeafSize; ++k) {
+    bool inside = block.normal_inv_length_square[k] > 0;
+    FloatT edge_distance_square = std::numeric_limits<FloatT>::max();
+    FloatT plane_distance = 0;
+    for (size_t i = 0; i < 3; ++i) {
+      const FloatT dx = point(0) - block.edge_origin[i][0][k];
+      const FloatT dy = point(1) - block.edge_origin[i][1][k];
+      const FloatT dz = point(2) - block.edge_origin[i][2][k];
+      const FloatT ex = block.edge[i][0][k];
+      const FloatT ey = block.edge[i][1][k];
+      const FloatT ez = block.edge[i][2][k];
+      FloatT t = (dx * ex + dy * ey + dz * ez) * block.edge_inv_length_square[i][k];
+      t = std::min(std::max(t, FloatT(0)), FloatT(1));
+      const FloatT qx = dx - t * ex;
+      const FloatT qy = dy - t * ey;
+      const FloatT qz = dz - t * ez;
+      edge_distance_square = std::min(edge_distance_square, qx * qx + qy * qy + qz * qz);
+      const FloatT side = (ey * dz - ez * dy) * block.normal[0][k]
+                        + (ez * dx - ex * dz) * block.normal[1][k]
+                        + (ex * dy - ey * dx) * block.normal[2][k];
+      inside = inside && side >= 0;
+      if (i == 0) {
+        plane_distance = dx * block.normal[0][k] + dy * block.normal[1][k] + dz * block.normal[2][k];
+      }
+    }
+    distances_square[k] = inside
+                          ? plane_distance * plane_distance * block.normal_inv_length_square[k]
+                          : edge_distance_square;
+  }
+}
+
+template <typename FloatT>
+void TriangleDistanceTree<FloatT>::computeLeafDistancesSquare(
+        const LeafBlock& block, const Vector3& point, FloatT* distances_square, std::true_type) const {
+#if defined(__AVX__)
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1);
+  const __m256 px = _mm256_set1_ps(point(0));
+  const __m256 py = _mm256_set1_ps(point(1));
+  const __m256 pz = _mm256_set1_ps(point(2));
+  const __m256 nx = _mm256_loadu_ps(block.normal[0]);
+  const __m256 ny = _mm256_loadu_ps(block.normal[1]);
+  const __m256 nz = _mm256_loadu_ps(block.normal[2]);
+  const __m256 normal_inv_length_square = _mm256_loadu_ps(block.normal_inv_length_square);
+  __m256 inside = _mm256_cmp_ps(normal_inv_length_square, zero, _CMP_GT_OQ);
+  __m256 edge_distance_square = _mm256_set1_ps(std::numeric_limits<float>::max());
+  __m256 plane_distance = zero;
+  for (size_t i = 0; i < 3; ++i) {
+    const __m256 dx = _mm256_sub_ps(px, _mm256_loadu_ps(block.edge_origin[i][0]));
+    const __m256 dy = _mm256_sub_ps(py, _mm256_loadu_ps(block.edge_origin[i][1]));
+    const __m256 dz = _mm256_sub_ps(pz, _mm256_loadu_ps(block.edge_origin[i][2]));
+    const __m256 ex = _mm256_loadu_ps(block.edge[i][0]);
+    const __m256 ey = _mm256_loadu_ps(block.edge[i][1]);
+    const __m256 ez = _mm256_loadu_ps(block.edge[i][2]);
+    const __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, ex), _mm256_mul_ps(dy, ey)), _mm256_mul_ps(dz, ez));
+    __m256 t = _mm256_mul_ps(dot, _mm256_loadu_ps(block.edge_inv_length_square[i]));
+    t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+    const __m256 qx = _mm256_sub_ps(dx, _mm256_mul_ps(t, ex));
+    const __m256 qy = _mm256_sub_ps(dy, _mm256_mul_ps(t, ey));
+    const __m256 qz = _mm256_sub_ps(dz, _mm256_mul_ps(t, ez));
+    const __m256 q_square = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, qx), _mm256_mul_ps(qy, qy)), _mm256_mul_ps(qz, qz));
+    edge_distance_square = _mm256_min_ps(edge_distance_square, q_square);
+    const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(ey, dz), _mm256_mul_ps(ez, dy));
+    const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(ez, dx), _mm256_mul_ps(ex, dz));
+    const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(ex, dy), _mm256_mul_ps(ey, dx));
+    const __m256 side = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, nx), _mm256_mul_ps(cy, ny)), _mm256_mul_ps(cz, nz));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(side, zero, _CMP_GE_OQ));
+    if (i == 0) {
+      plane_distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, nx), _mm256_mul_ps(dy, ny)), _mm256_mul_ps(dz, nz));
+    }
+  }
+  const __m256 plane_distance_square = _mm256_mul_ps(_mm256_mul_ps(plane_distance, plane_distance), normal_inv_length_square);
+  _mm256_storeu_ps(distances_square, _mm256_blendv_ps(edge_distance_square, plane_distance_square, inside));
+#else
+  computeLeafDistancesSquare(block, point, distances_square, std::false_type());
+#endif
+}
+
+}
@@ -72,6 +72,12 @@ public:
   template <typename Iterator>
   Result knnSearch(Iterator begin, Iterator end, std::size_t knn) const;
 
+  /// Batched search for a range of points. The results are stored row-wise with knn entries per point.
+  /// Missing neighbors have an invalid index (-1) and maximum distance.
+  template <typename Iterator>
+  void knnSearch(Iterator begin, Iterator end, std::size_t knn,
+                 std::vector<IndexType>* indices, std::vector<DistanceType>* distances) const;
+
   void radiusSearch(const Point& point, FloatType radius, std::size_t max_results,
       std::vector<IndexType>* indices, std::vector<DistanceType>* distances) const;
 
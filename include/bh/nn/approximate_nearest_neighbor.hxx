@@ -185,6 +185,30 @@ auto ApproximateNearestNeighbor<FloatT, dimension, NormT>::knnSearch(
   return knnSearch(points, knn);
 }
 
+template<typename FloatT, std::size_t dimension, typename NormT>
+template<typename Iterator>
+void ApproximateNearestNeighbor<FloatT, dimension, NormT>::knnSearch(
+        Iterator begin, Iterator end, std::size_t knn,
+        std::vector <IndexType> *indices, std::vector <DistanceType> *distances) const {
+  const std::size_t num_points = end - begin;
+  indices->assign(num_points * knn, static_cast<IndexType>(-1));
+  distances->assign(num_points * knn, std::numeric_limits<DistanceType>::max());
+  if (empty() || num_points == 0) {
+    return;
+  }
+  // FLANN expects the queries in row-major order
+  std::vector<FlannElementType> queries(num_points * dimension);
+  for (Iterator it = begin; it != end; ++it) {
+    for (std::size_t col = 0; col < dimension; ++col) {
+      queries[(it - begin) * dimension + col] = static_cast<FlannElementType>((*it)(col));
+    }
+  }
+  FlannMatrix flann_queries(queries.data(), num_points, dimension);
+  FlannIndexMatrix flann_indices(indices->data(), num_points, knn);
+  FlannDistanceMatrix flann_distances(distances->data(), num_points, knn);
+  index_.knnSearch(flann_queries, flann_indices, flann_distances, knn, search_params_);
+}
+
 template<typename FloatT, std::size_t dimension, typename NormT>
 void ApproximateNearestNeighbor<FloatT, dimension, NormT>::radiusSearch(
         const Point &point, FloatType radius, std::size_t max_results,
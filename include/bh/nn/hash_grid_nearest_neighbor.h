@@ -0,0 +1,109 @@
+//==================================================
+// hash_grid_nearest_neighbor.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 16.05.17
+//
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "../common.h"
+#include "../eigen.h"
+
+namespace bh {
+
+///
+/// Dynamic exact nearest neighbor index for 3D points.
+/// Points are sorted into a uniform hash grid. Insertion is O(1) amortized and never rebuilds the index.
+/// Queries visit the grid cells in growing shells around the query point until the result is exact.
+/// The cell size should be in the order of typical query distances.
+/// Distances are squared euclidean distances (as with ApproximateNearestNeighbor).
+/// Const queries can run concurrently, insertions have to be synchronized with queries by the caller.
+///
+template <typename FloatT>
+class HashGridNearestNeighbor {
+public:
+  using FloatType = FloatT;
+  using Point = Eigen::Matrix<FloatType, 3, 1>;
+  using IndexType = std::size_t;
+  using DistanceType = FloatType;
+
+  struct SingleResult {
+    std::vector<IndexType> indices;
+    std::vector<DistanceType> distances;
+  };
+
+  explicit HashGridNearestNeighbor(const FloatType cell_size = 1);
+
+  void clear();
+
+  FloatType cellSize() const;
+
+  /// Change the cell size. All points are resorted into the new grid.
+  void setCellSize(const FloatType cell_size);
+
+  void reserve(const std::size_t num_points);
+
+  template <typename Iterator>
+  void addPoints(Iterator begin, Iterator end);
+
+  /// Add a point. The index of the point is the number of previously added points.
+  void addPoint(const Point& point);
+
+  const Point& getPoint(const IndexType point_id) const;
+
+  /// Find the knn nearest neighbors sorted by increasing distance.
+  /// The result vectors are resized to the number of found neighbors.
+  void knnSearch(const Point& point, const std::size_t knn,
+                 std::vector<IndexType>* indices, std::vector<DistanceType>* distances) const;
+
+  SingleResult knnSearch(const Point& point, const std::size_t knn) const;
+
+  /// Find all neighbors with a squared distance of at most radius_square sorted by increasing distance.
+  /// At most max_results neighbors are returned.
+  void radiusSearch(const Point& point, const FloatType radius_square, const std::size_t max_results,
+                    std::vector<IndexType>* indices, std::vector<DistanceType>* distances) const;
+
+  bool empty() const;
+
+  std::size_t numPoints() const;
+
+  std::size_t numCells() const;
+
+private:
+  // Cell coordinates are stored with 21 bits per axis
+  static constexpr int64_t kCoordinateOffset = int64_t(1) << 20;
+  static constexpr int64_t kMaxCoordinate = (int64_t(1) << 21) - 1;
+
+  using CellKey = uint64_t;
+  using Neighbor = std::pair<DistanceType, IndexType>;
+
+  int64_t computeCellCoordinate(const FloatType value) const;
+
+  CellKey computeCellKey(const int64_t x, const int64_t y, const int64_t z) const;
+
+  CellKey computeCellKey(const Point& point) const;
+
+  /// Call func(point_index) for all points in the cells with the given cell coordinate range
+  template <typename Func>
+  void forEachPointInCellBox(const int64_t min_coord[3], const int64_t max_coord[3], Func func) const;
+
+  /// Call func(point_index) for all points in the shell of cells with Chebyshev distance radius
+  /// around the center cell
+  template <typename Func>
+  void forEachPointInCellShell(const int64_t center[3], const int64_t radius, Func func) const;
+
+  FloatType cell_size_;
+  std::vector<Point> points_;
+  std::unordered_map<CellKey, std::vector<IndexType>> cells_;
+  int64_t min_cell_coord_[3];
+  int64_t max_cell_coord_[3];
+};
+
+}
+
+#include "hash_grid_nearest_neighbor.hxx"
@@ -0,0 +1,291 @@
+//==================================================
+// hash_grid_nearest_neighbor.hxx
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 16.05.17
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace bh {
+
+template <typename FloatT>
+constexpr int64_t HashGridNearestNeighbor<FloatT>::kCoordinateOffset;
+
+template <typename FloatT>
+constexpr int64_t HashGridNearestNeighbor<FloatT>::kMaxCoordinate;
+
+template <typename FloatT>
+HashGridNearestNeighbor<FloatT>::HashGridNearestNeighbor(const FloatType cell_size)
+    : cell_size_(cell_size) {
+  BH_ASSERT(cell_size_ > 0);
+  clear();
+}
+
+template <typename FloatT>
+void HashGridNearestNeighbor<FloatT>::clear() {
+  points_.clear();
+  cells_.clear();
+  for (std::size_t i = 0; i < 3; ++i) {
+    min_cell_coord_[i] = std::numeric_limits<int64_t>::max();
+    max_cell_coord_[i] = std::numeric_limits<int64_t>::lowest();
+  }
+}
+
+template <typename FloatT>
+auto HashGridNearestNeighbor<FloatT>::cellSize() const -> FloatType {
+  return cell_size_;
+}
+
+template <typename FloatT>
+void HashGridNearestNeighbor<FloatT>::setCellSize(const FloatType cell_size) {
+  BH_ASSERT(cell_size > 0);
+  std::vector<Point> points;
+  points.swap(points_);
+  clear();
+  cell_size_ = cell_size;
+  addPoints(points.begin(), points.end());
+}
+
+template <typename FloatT>
+void HashGridNearestNeighbor<FloatT>::reserve(const std::size_t num_points) {
+  points_.reserve(num_points);
+}
+
+template <typename FloatT>
+template <typename Iterator>
+void HashGridNearestNeighbor<FloatT>::addPoints(Iterator begin, Iterator end) {
+  for (Iterator it = begin; it != end; ++it) {
+    addPoint(*it);
+  }
+}
+
+template <typename FloatT>
+void HashGridNearestNeighbor<FloatT>::addPoint(const Point& point) {
+  const CellKey key = computeCellKey(point);
+  for (std::size_t i = 0; i < 3; ++i) {
+    const int64_t coord = computeCellCoordinate(point(i));
+    min_cell_coord_[i] = std::min(min_cell_coord_[i], coord);
+    max_cell_coord_[i] = std::max(max_cell_coord_[i], coord);
+  }
+  cells_[key].push_back(points_.size());
+  points_.push_back(point);
+}
+
+template <typename FloatT>
+auto HashGridNearestNeighbor<FloatT>::getPoint(const IndexType point_id) const -> const Point& {
+  return points_[point_id];
+}
+
+template <typename FloatT>
+void HashGridNearestNeighbor<FloatT>::knnSearch(
+    const Point& point, const std::size_t knn,
+    std::vector<IndexType>* indices, std::vector<DistanceType>* distances) const {
+  indices->clear();
+  distances->clear();
+  const std::size_t num_neighbors = std::min(knn, numPoints());
+  if (num_neighbors == 0) {
+    return;
+  }
+  // Max-heap of the nearest neighbors found so far (ties are broken by the point index)
+  std::vector<Neighbor> heap;
+  heap.reserve(num_neighbors);
+  auto visit_point = [&](const IndexType index) {
+    const Neighbor neighbor((points_[index] - point).squaredNorm(), index);
+    if (heap.size() < num_neighbors) {
+      heap.push_back(neighbor);
+      std::push_heap(heap.begin(), heap.end());
+    }
+    else if (neighbor < heap.front()) {
+      std::pop_heap(heap.begin(), heap.end());
+      heap.back() = neighbor;
+      std::push_heap(heap.begin(), heap.end());
+    }
+  };
+  int64_t center[3];
+  int64_t max_radius = 0;
+  for (std::size_t i = 0; i < 3; ++i) {
+    center[i] = computeCellCoordinate(point(i));
+    max_radius = std::max(max_radius, std::max(center[i] - min_cell_coord_[i], max_cell_coord_[i] - center[i]));
+  }
+  for (int64_t radius = 0; radius <= max_radius; ++radius) {
+    // Once the box of visited cells is larger than the number of occupied cells a linear scan is cheaper
+    const int64_t box_width = 2 * radius + 1;
+    if (box_width * box_width * box_width > static_cast<int64_t>(cells_.size())) {
+      heap.clear();
+      for (IndexType index = 0; index < points_.size(); ++index) {
+        visit_point(index);
+      }
+      break;
+    }
+    forEachPointInCellShell(center, radius, visit_point);
+    // All points outside of the visited cells are at least radius * cell_size away
+    const FloatType min_unvisited_distance = radius * cell_size_;
+    if (heap.size() == num_neighbors && heap.front().first < min_unvisited_distance * min_unvisited_distance) {
+      break;
+    }
+  }
+  std::sort_heap(heap.begin(), heap.end());
+  indices->reserve(heap.size());
+  distances->reserve(heap.size());
+  for (const Neighbor& neighbor : heap) {
+    distances->push_back(neighbor.first);
+    indices->push_back(neighbor.second);
+  }
+}
+
+template <typename FloatT>
+auto HashGridNearestNeighbor<FloatT>::knnSearch(const Point& point, const std::size_t knn) const -> SingleResult {
+  SingleResult result;
+  knnSearch(point, knn, &result.indices, &result.distances);
+  return result;
+}
+
+template <typename FloatT>
+void HashGridNearestNeighbor<FloatT>::radiusSearch(
+    const Point& point, const FloatType radius_square, const std::size_t max_results,
+    std::vector<IndexType>* indices, std::vector<DistanceType>* distances) const {
+  indices->clear();
+  distances->clear();
+  if (empty() || max_results == 0) {
+    return;
+  }
+  std::vector<Neighbor> neighbors;
+  auto visit_point = [&](const IndexType index) {
+    const DistanceType distance_square = (points_[index] - point).squaredNorm();
+    if (distance_square <= radius_square) {
+      neighbors.emplace_back(distance_square, index);
+    }
+  };
+  const FloatType radius = std::sqrt(std::max(radius_square, FloatType(0)));
+  int64_t min_coord[3];
+  int64_t max_coord[3];
+  int64_t num_box_cells = 1;
+  for (std::size_t i = 0; i < 3; ++i) {
+    min_coord[i] = std::max(computeCellCoordinate(point(i) - radius), min_cell_coord_[i]);
+    max_coord[i] = std::min(computeCellCoordinate(point(i) + radius), max_cell_coord_[i]);
+    if (min_coord[i] > max_coord[i]) {
+      return;
+    }
+    num_box_cells *= max_coord[i] - min_coord[i] + 1;
+  }
+  if (num_box_cells > static_cast<int64_t>(cells_.size())) {
+    for (IndexType index = 0; index < points_.size(); ++index) {
+      visit_point(index);
+    }
+  }
+  else {
+    forEachPointInCellBox(min_coord, max_coord, visit_point);
+  }
+  std::sort(neighbors.begin(), neighbors.end());
+  if (neighbors.size() > max_results) {
+    neighbors.resize(max_results);
+  }
+  indices->reserve(neighbors.size());
+  distances->reserve(neighbors.size());
+  for (const Neighbor& neighbor : neighbors) {
+    distances->push_back(neighbor.first);
+    indices->push_back(neighbor.second);
+  }
+}
+
+template <typename FloatT>
+bool HashGridNearestNeighbor<FloatT>::empty() const {
+  return points_.empty();
+}
+
+template <typename FloatT>
+std::size_t HashGridNearestNeighbor<FloatT>::numPoints() const {
+  return points_.size();
+}
+
+template <typename FloatT>
+std::size_t HashGridNearestNeighbor<FloatT>::numCells() const {
+  return cells_.size();
+}
+
+template <typename FloatT>
+int64_t HashGridNearestNeighbor<FloatT>::computeCellCoordinate(const FloatType value) const {
+  return static_cast<int64_t>(std::floor(value / cell_size_));
+}
+
+template <typename FloatT>
+auto HashGridNearestNeighbor<FloatT>::computeCellKey(const int64_t x, const int64_t y, const int64_t z) const
+-> CellKey {
+  const uint64_t ux = static_cast<uint64_t>(x + kCoordinateOffset);
+  const uint64_t uy = static_cast<uint64_t>(y + kCoordinateOffset);
+  const uint64_t uz = static_cast<uint64_t>(z + kCoordinateOffset);
+  return (ux << 42) | (uy << 21) | uz;
+}
+
+template <typename FloatT>
+auto HashGridNearestNeighbor<FloatT>::computeCellKey(const Point& point) const -> CellKey {
+  int64_t coord[3];
+  for (std::size_t i = 0; i < 3; ++i) {
+    coord[i] = computeCellCoordinate(point(i));
+    if (coord[i] + kCoordinateOffset < 0 || coord[i] + kCoordinateOffset > kMaxCoordinate) {
+      throw BH_EXCEPTION("Point is outside of the range of the hash grid. Increase the cell size.");
+    }
+  }
+  return computeCellKey(coord[0], coord[1], coord[2]);
+}
+
+template <typename FloatT>
+template <typename Func>
+void HashGridNearestNeighbor<FloatT>::forEachPointInCellBox(
+    const int64_t min_coord[3], const int64_t max_coord[3], Func func) const {
+  for (int64_t x = min_coord[0]; x <= max_coord[0]; ++x) {
+    for (int64_t y = min_coord[1]; y <= max_coord[1]; ++y) {
+      for (int64_t z = min_coord[2]; z <= max_coord[2]; ++z) {
+        const auto it = cells_.find(computeCellKey(x, y, z));
+        if (it == cells_.end()) {
+          continue;
+        }
+        for (const IndexType index : it->second) {
+          func(index);
+        }
+      }
+    }
+  }
+}
+
+template <typename FloatT>
+template <typename Func>
+void HashGridNearestNeighbor<FloatT>::forEachPointInCellShell(
+    const int64_t center[3], const int64_t radius, Func func) const {
+  // Only cells inside of the occupied range have to be visited
+  int64_t min_coord[3];
+  int64_t max_coord[3];
+  for (std::size_t i = 0; i < 3; ++i) {
+    min_coord[i] = std::max(center[i] - radius, min_cell_coord_[i]);
+    max_coord[i] = std::min(center[i] + radius, max_cell_coord_[i]);
+    if (min_coord[i] > max_coord[i]) {
+      return;
+    }
+  }
+  for (int64_t x = min_coord[0]; x <= max_coord[0]; ++x) {
+    const bool x_on_shell = std::abs(x - center[0]) == radius;
+    for (int64_t y = min_coord[1]; y <= max_coord[1]; ++y) {
+      const bool xy_on_shell = x_on_shell || std::abs(y - center[1]) == radius;
+      // Inside of the shell only the two z faces have to be visited
+      const int64_t z_step = xy_on_shell || radius == 0 ? 1 : 2 * radius;
+      for (int64_t z = center[2] - radius; z <= center[2] + radius; z += z_step) {
+        if (z < min_coord[2] || z > max_coord[2]) {
+          continue;
+        }
+        const auto it = cells_.find(computeCellKey(x, y, z));
+        if (it == cells_.end()) {
+          continue;
+        }
+        for (const IndexType index : it->second) {
+          func(index);
+        }
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,73 @@
+//==================================================
+// voxel_hash_point_index.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 12.05.17
+//
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "../common.h"
+#include "../eigen.h"
+#include "../math/geometry.h"
+
+namespace bh {
+
+///
+/// Spatial index for range queries on large point sets.
+/// Points are sorted into a hash map of voxels. The points of a voxel are stored contiguously so a
+/// box query only touches the voxels overlapping the box. The voxel size should be in the order of the
+/// query box size.
+///
+template <typename FloatT = float>
+class VoxelHashPointIndex {
+public:
+  using size_t = std::size_t;
+  using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatT)
+  using BoundingBoxType = BoundingBox3D<FloatT>;
+
+  explicit VoxelHashPointIndex(const FloatT voxel_size);
+
+  /// Builds the index from a range of points. Previously indexed points are discarded.
+  template <typename PointIterator>
+  void build(const PointIterator first, const PointIterator last);
+
+  FloatT voxelSize() const;
+
+  size_t numOfPoints() const;
+
+  size_t numOfVoxels() const;
+
+  /// Calls func(const Vector3& point) for each point inside of the bounding box.
+  template <typename Func>
+  void forEachPointInBox(const BoundingBoxType& bbox, Func func) const;
+
+private:
+  // Voxel coordinates are stored with 21 bits per axis
+  static constexpr int64_t kCoordinateOffset = int64_t(1) << 20;
+  static constexpr int64_t kMaxCoordinate = (int64_t(1) << 21) - 1;
+
+  struct VoxelRange {
+    size_t offset;
+    size_t size;
+  };
+
+  int64_t computeVoxelCoordinate(const FloatT value) const;
+
+  uint64_t computeKey(const int64_t x, const int64_t y, const int64_t z) const;
+
+  uint64_t computeKey(const Vector3& point) const;
+
+  FloatT voxel_size_;
+  std::vector<Vector3> points_;
+  std::unordered_map<uint64_t, VoxelRange> voxels_;
+};
+
+}
+
+#include "voxel_hash_point_index.hxx"
@@ -0,0 +1,130 @@
+//==================================================
+// voxel_hash_point_index.hxx
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 12.05.17
+//
+
+#include <cmath>
+
+namespace bh {
+
+template <typename FloatT>
+constexpr int64_t VoxelHashPointIndex<FloatT>::kCoordinateOffset;
+
+template <typename FloatT>
+constexpr int64_t VoxelHashPointIndex<FloatT>::kMaxCoordinate;
+
+template <typename FloatT>
+VoxelHashPointIndex<FloatT>::VoxelHashPointIndex(const FloatT voxel_size)
+    : voxel_size_(voxel_size) {
+  BH_ASSERT(voxel_size_ > 0);
+}
+
+template <typename FloatT>
+template <typename PointIterator>
+void VoxelHashPointIndex<FloatT>::build(const PointIterator first, const PointIterator last) {
+  points_.clear();
+  voxels_.clear();
+  // First pass counts the points per voxel, second pass sorts the points into their voxel ranges
+  std::vector<uint64_t> keys;
+  for (PointIterator it = first; it != last; ++it) {
+    keys.push_back(computeKey(*it));
+  }
+  for (const uint64_t key : keys) {
+    auto it = voxels_.find(key);
+    if (it == voxels_.end()) {
+      voxels_.emplace(key, VoxelRange { 0, 1 });
+    }
+    else {
+      ++it->second.size;
+    }
+  }
+  size_t offset = 0;
+  for (auto& entry : voxels_) {
+    entry.second.offset = offset;
+    offset += entry.second.size;
+    entry.second.size = 0;
+  }
+  points_.resize(keys.size());
+  size_t i = 0;
+  for (PointIterator it = first; it != last; ++it, ++i) {
+    VoxelRange& range = voxels_.at(keys[i]);
+    points_[range.offset + range.size] = *it;
+    ++range.size;
+  }
+}
+
+template <typename FloatT>
+FloatT VoxelHashPointIndex<FloatT>::voxelSize() const {
+  return voxel_size_;
+}
+
+template <typename FloatT>
+auto VoxelHashPointIndex<FloatT>::numOfPoints() const -> size_t {
+  return points_.size();
+}
+
+template <typename FloatT>
+auto VoxelHashPointIndex<FloatT>::numOfVoxels() const -> size_t {
+  return voxels_.size();
+}
+
+template <typename FloatT>
+template <typename Func>
+void VoxelHashPointIndex<FloatT>::forEachPointInBox(const BoundingBoxType& bbox, Func func) const {
+  if (points_.empty() || !bbox.isValid()) {
+    return;
+  }
+  int64_t min_coord[3];
+  int64_t max_coord[3];
+  for (size_t i = 0; i < 3; ++i) {
+    min_coord[i] = std::max(computeVoxelCoordinate(bbox.getMinimum(i)), -kCoordinateOffset);
+    max_coord[i] = std::min(computeVoxelCoordinate(bbox.getMaximum(i)), kMaxCoordinate - kCoordinateOffset);
+  }
+  for (int64_t x = min_coord[0]; x <= max_coord[0]; ++x) {
+    for (int64_t y = min_coord[1]; y <= max_coord[1]; ++y) {
+      for (int64_t z = min_coord[2]; z <= max_coord[2]; ++z) {
+        const auto it = voxels_.find(computeKey(x, y, z));
+        if (it == voxels_.end()) {
+          continue;
+        }
+        const VoxelRange& range = it->second;
+        for (size_t j = range.offset; j < range.offset + range.size; ++j) {
+          const Vector3& point = points_[j];
+          if (bbox.isInside(point)) {
+            func(point);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename FloatT>
+int64_t VoxelHashPointIndex<FloatT>::computeVoxelCoordinate(const FloatT value) const {
+  return static_cast<int64_t>(std::floor(value / voxel_size_));
+}
+
+template <typename FloatT>
+uint64_t VoxelHashPointIndex<FloatT>::computeKey(const int64_t x, const int64_t y, const int64_t z) const {
+  const uint64_t ux = static_cast<uint64_t>(x + kCoordinateOffset);
+  const uint64_t uy = static_cast<uint64_t>(y + kCoordinateOffset);
+  const uint64_t uz = static_cast<uint64_t>(z + kCoordinateOffset);
+  return (ux << 42) | (uy << 21) | uz;
+}
+
+template <typename FloatT>
+uint64_t VoxelHashPointIndex<FloatT>::computeKey(const Vector3& point) const {
+  int64_t coord[3];
+  for (size_t i = 0; i < 3; ++i) {
+    coord[i] = computeVoxelCoordinate(point(i));
+    if (coord[i] + kCoordinateOffset < 0 || coord[i] + kCoordinateOffset > kMaxCoordinate) {
+      throw BH_EXCEPTION("Point is outside of the range of the voxel hash index. Increase the voxel size.");
+    }
+  }
+  return computeKey(coord[0], coord[1], coord[2]);
+}
+
+}
@@ -5,7 +5,15 @@
  *      Author: bhepp
  */
 
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <random>
+#include <vector>
+#include "common.h"
 #include "eigen.h"
 
 namespace bh {
@@ -197,4 +205,260 @@ private:
   mutable std::uniform_int_distribution<IntType> uniform_int_dist_;
 };
 
+
+/// Counter-based random number generator Philox4x32-10 (Salmon et al., Parallel Random Numbers: As Easy as 1, 2, 3).
+///
+/// Each 128 bit counter is mapped to 128 random bits by a keyed bijection, so any element of the sequence
+/// can be computed directly and independent streams are obtained by partitioning the counter space.
+class Philox4x32 {
+public:
+  using Counter = std::array<std::uint32_t, 4>;
+  using Key = std::array<std::uint32_t, 2>;
+
+  static constexpr std::size_t kNumRounds = 10;
+
+  static Counter generate(const Counter& counter, const Key& key) {
+    Counter result = counter;
+    generate(&result[0], &result[1], &result[2], &result[3], key[0], key[1]);
+    return result;
+  }
+
+  /// Computes the random block of a counter in place. Written on scalars so that loops over counters can be vectorized.
+  static inline void generate(std::uint32_t* c0, std::uint32_t* c1, std::uint32_t* c2, std::uint32_t* c3,
+                              std::uint32_t k0, std::uint32_t k1) {
+    for (std::size_t round = 0; round < kNumRounds; ++round) {
+      const std::uint64_t product0 = static_cast<std::uint64_t>(kMultiplier0) * (*c0);
+      const std::uint64_t product1 = static_cast<std::uint64_t>(kMultiplier1) * (*c2);
+      const std::uint32_t hi0 = static_cast<std::uint32_t>(product0 >> 32);
+      const std::uint32_t lo0 = static_cast<std::uint32_t>(product0);
+      const std::uint32_t hi1 = static_cast<std::uint32_t>(product1 >> 32);
+      const std::uint32_t lo1 = static_cast<std::uint32_t>(product1);
+      *c0 = hi1 ^ (*c1) ^ k0;
+      *c1 = lo1;
+      *c2 = hi0 ^ (*c3) ^ k1;
+      *c3 = lo0;
+      k0 += kWeyl0;
+      k1 += kWeyl1;
+    }
+  }
+
+private:
+  static constexpr std::uint32_t kMultiplier0 = 0xD2511F53;
+  static constexpr std::uint32_t kMultiplier1 = 0xCD9E8D57;
+  static constexpr std::uint32_t kWeyl0 = 0x9E3779B9;
+  static constexpr std::uint32_t kWeyl1 = 0xBB67AE85;
+};
+
+/// Random stream based on Philox4x32 keyed by (seed, stream id).
+///
+/// The counter of block i of a stream is (i, stream id) so that streams never overlap and creating a stream is free.
+/// Samples only depend on (seed, stream id, position in the stream), i.e. parallel code that assigns a stream to each
+/// work item produces the same samples as the serial code independent of the number of threads.
+/// Uniform samples use 2 random words for double precision and 1 word otherwise.
+template <typename FloatT>
+class RandomStream {
+public:
+  using FloatType = FloatT;
+  using Vector3 = Eigen::Matrix<FloatType, 3, 1>;
+  using Quaternion = Eigen::Quaternion<FloatType>;
+
+  static constexpr FloatType kSphereSquaredNormThreshold = FloatType { 0.001 };
+  static constexpr std::size_t kWordsPerBlock = 4;
+  static constexpr std::size_t kWordsPerUniform = sizeof(FloatType) > sizeof(std::uint32_t) ? 2 : 1;
+  static constexpr std::size_t kUniformsPerBlock = kWordsPerBlock / kWordsPerUniform;
+
+  RandomStream(const std::uint64_t seed, const std::uint64_t stream_id, const std::uint64_t block_index = 0)
+  : key_ {{ static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) }},
+    stream_id_(stream_id), block_index_(block_index), word_index_(kWordsPerBlock) {}
+
+  std::uint64_t streamId() const {
+    return stream_id_;
+  }
+
+  /// Index of the next block that will be generated.
+  std::uint64_t blockIndex() const {
+    return block_index_;
+  }
+
+  /// Next random 32 bit word
+  std::uint32_t sampleWord() {
+    if (word_index_ >= kWordsPerBlock) {
+      generateBlock(block_index_, &block_);
+      ++block_index_;
+      word_index_ = 0;
+    }
+    return block_[word_index_++];
+  }
+
+  bool sampleBernoulli(const FloatType true_probability) {
+    return sampleUniform() <= true_probability;
+  }
+
+  /// Sample from a standard normal distribution (Box-Muller transform of two uniform samples)
+  FloatType sampleNormal() {
+    const FloatType u1 = 1 - sampleUniform();
+    const FloatType u2 = sampleUniform();
+    return std::sqrt(-2 * std::log(u1)) * std::cos(FloatType(2 * M_PI) * u2);
+  }
+
+  FloatType sampleNormal(const FloatType mean, const FloatType sigma) {
+    return mean + sigma * sampleNormal();
+  }
+
+  /// Sample uniform number from interval [0, 1)
+  FloatType sampleUniform() {
+    if (kWordsPerUniform == 2) {
+      const std::uint32_t hi = sampleWord();
+      const std::uint32_t lo = sampleWord();
+      return toUniform(hi, lo);
+    }
+    return toUniform(sampleWord(), 0);
+  }
+
+  /// Sample uniform number from interval [min, max) (excluding max)
+  FloatType sampleUniform(const FloatType min, const FloatType max) {
+    return min + (max - min) * sampleUniform();
+  }
+
+  /// Sample uniform integer from interval [0, max) (excluding max). max has to be positive.
+  std::uint64_t sampleUniformIntExclusive(const std::uint64_t max) {
+    BH_ASSERT(max > 0);
+    const std::uint64_t random_max = std::numeric_limits<std::uint64_t>::max();
+    const std::uint64_t unbiased_sample_range = random_max - random_max % max;
+    std::uint64_t sample;
+    do {
+      const std::uint64_t hi = sampleWord();
+      sample = (hi << 32) | sampleWord();
+    }
+    while (sample >= unbiased_sample_range);
+    return sample % max;
+  }
+
+  template <typename Vector3T>
+  void sampleSphericalShell(const FloatType min_radius, const FloatType max_radius, Vector3T* vec) {
+    sampleUnitSphere(vec);
+    (*vec) *= sampleUniform(min_radius, max_radius);
+  }
+
+  template <typename Vector3T>
+  void sampleUnitSphere(Vector3T* vec) {
+    EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(Vector3T, 3);
+    do {
+      (*vec)(0) = sampleNormal();
+      (*vec)(1) = sampleNormal();
+      (*vec)(2) = sampleNormal();
+    }
+    while (vec->squaredNorm() < kSphereSquaredNormThreshold);
+    vec->normalize();
+  }
+
+  /// Sample a uniformly distributed rotation from three uniform samples (Shoemake, Uniform Random Rotations)
+  Quaternion sampleUnitQuaternion() {
+    const FloatType u1 = sampleUniform();
+    const FloatType u2 = sampleUniform();
+    const FloatType u3 = sampleUniform();
+    return toUnitQuaternion(u1, u2, u3);
+  }
+
+  /// Fills out with the next count uniform samples. Equivalent to calling sampleUniform() count times.
+  /// Whole blocks are generated in a vectorizable loop.
+  void generateUniforms(const std::size_t count, FloatType* out) {
+    std::size_t i = 0;
+    // Consume partially used block
+    while (i < count && word_index_ < kWordsPerBlock) {
+      out[i++] = sampleUniform();
+    }
+    const std::size_t num_blocks = (count - i) / kUniformsPerBlock;
+    const std::uint64_t first_block_index = block_index_;
+    const std::uint32_t s0 = static_cast<std::uint32_t>(stream_id_);
+    const std::uint32_t s1 = static_cast<std::uint32_t>(stream_id_ >> 32);
+    const std::uint32_t k0 = key_[0];
+    const std::uint32_t k1 = key_[1];
+    FloatType* block_out = out + i;
+#pragma omp simd
+    for (std::size_t j = 0; j < num_blocks; ++j) {
+      const std::uint64_t block_index = first_block_index + j;
+      std::uint32_t c0 = static_cast<std::uint32_t>(block_index);
+      std::uint32_t c1 = static_cast<std::uint32_t>(block_index >> 32);
+      std::uint32_t c2 = s0;
+      std::uint32_t c3 = s1;
+      Philox4x32::generate(&c0, &c1, &c2, &c3, k0, k1);
+      if (kWordsPerUniform == 2) {
+        block_out[2 * j] = toUniform(c0, c1);
+        block_out[2 * j + 1] = toUniform(c2, c3);
+      }
+      else {
+        block_out[4 * j] = toUniform(c0, 0);
+        block_out[4 * j + 1] = toUniform(c1, 0);
+        block_out[4 * j + 2] = toUniform(c2, 0);
+        block_out[4 * j + 3] = toUniform(c3, 0);
+      }
+    }
+    block_index_ += num_blocks;
+    i += num_blocks * kUniformsPerBlock;
+    for (; i < count; ++i) {
+      out[i] = sampleUniform();
+    }
+  }
+
+  /// Fills out with the next count unit quaternions. Equivalent to calling sampleUnitQuaternion() count times.
+  template <typename Allocator>
+  void generateUnitQuaternions(const std::size_t count, std::vector<Quaternion, Allocator>* out) {
+    std::vector<FloatType> uniforms(3 * count);
+    generateUniforms(uniforms.size(), uniforms.data());
+    std::vector<FloatType> coefficients(4 * count);
+#pragma omp simd
+    for (std::size_t i = 0; i < count; ++i) {
+      toUnitQuaternionCoefficients(uniforms[3 * i], uniforms[3 * i + 1], uniforms[3 * i + 2], &coefficients[4 * i]);
+    }
+    out->resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      (*out)[i] = Quaternion(coefficients.data() + 4 * i);
+    }
+  }
+
+private:
+  static FloatType toUniform(const std::uint32_t hi, const std::uint32_t lo) {
+    if (kWordsPerUniform == 2) {
+      // 53 random bits
+      const std::uint64_t bits = ((static_cast<std::uint64_t>(hi) << 32) | lo) >> 11;
+      return static_cast<FloatType>(bits) * FloatType(1.0 / 9007199254740992.0);
+    }
+    // 24 random bits
+    return static_cast<FloatType>(hi >> 8) * FloatType(1.0 / 16777216.0);
+  }
+
+  /// Coefficients in Eigen's storage order (x, y, z, w)
+  static inline void toUnitQuaternionCoefficients(const FloatType u1, const FloatType u2, const FloatType u3,
+                                                  FloatType* coefficients) {
+    const FloatType r1 = std::sqrt(1 - u1);
+    const FloatType r2 = std::sqrt(u1);
+    const FloatType angle1 = FloatType(2 * M_PI) * u2;
+    const FloatType angle2 = FloatType(2 * M_PI) * u3;
+    coefficients[0] = r1 * std::sin(angle1);
+    coefficients[1] = r1 * std::cos(angle1);
+    coefficients[2] = r2 * std::sin(angle2);
+    coefficients[3] = r2 * std::cos(angle2);
+  }
+
+  static Quaternion toUnitQuaternion(const FloatType u1, const FloatType u2, const FloatType u3) {
+    FloatType coefficients[4];
+    toUnitQuaternionCoefficients(u1, u2, u3, coefficients);
+    return Quaternion(coefficients);
+  }
+
+  void generateBlock(const std::uint64_t block_index, Philox4x32::Counter* block) const {
+    const Philox4x32::Counter counter = {{
+        static_cast<std::uint32_t>(block_index), static_cast<std::uint32_t>(block_index >> 32),
+        static_cast<std::uint32_t>(stream_id_), static_cast<std::uint32_t>(stream_id_ >> 32) }};
+    *block = Philox4x32::generate(counter, key_);
+  }
+
+  Philox4x32::Key key_;
+  std::uint64_t stream_id_;
+  std::uint64_t block_index_;
+  Philox4x32::Counter block_;
+  std::size_t word_index_;
+};
+
 }
@@ -77,6 +77,9 @@ public:
     template <typename T>
     void bindData(const int index, const std::vector<T>& data);
 
+    /// Reset statement and clear bindings so that it can be executed again.
+    void reset();
+
     void finish();
 
   private:
@@ -94,6 +97,11 @@ public:
 
   Statement prepare(const string& query);
 
+  /// Wait up to the given time when the database is locked by another connection.
+  void setBusyTimeout(const int timeout_ms);
+
+  bool hasTable(const string& table_name);
+
   void executeWithoutResult(const Statement& statement);
 
   void executeWithoutResult(const string& query);
@@ -142,6 +150,19 @@ auto SQLite3::prepare(const string& query) -> Statement {
   return Statement(this, stmt);
 }
 
+void SQLite3::setBusyTimeout(const int timeout_ms) {
+  int result = sqlite3_busy_timeout(db_, timeout_ms);
+  throwIfError(result);
+}
+
+bool SQLite3::hasTable(const string& table_name) {
+  Statement statement = prepare("SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = ?1");
+  int result = sqlite3_bind_text(statement.stmt_, 1, table_name.c_str(), table_name.length(), SQLITE_TRANSIENT);
+  throwIfError(result);
+  const RowResult row_result = executeSingle(statement);
+  return row_result.getInt(0) > 0;
+}
+
 void SQLite3::executeWithoutResult(const Statement& statement) {
   int result = sqlite3_step(statement.stmt_);
   if (result == SQLITE_ROW) {
@@ -274,6 +295,13 @@ void SQLite3::Statement::finish() {
   }
 }
 
+void SQLite3::Statement::reset() {
+  int result = sqlite3_reset(stmt_);
+  sqlite_db_->throwIfError(result);
+  result = sqlite3_clear_bindings(stmt_);
+  sqlite_db_->throwIfError(result);
+}
+
 void SQLite3::Statement::bindNull(const int index) {
   int result = sqlite3_bind_null(stmt_, index);
   sqlite_db_->throwIfError(result);
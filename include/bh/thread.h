@@ -11,6 +11,8 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <deque>
+#include <functional>
 #include <bh/common.h>
 
 namespace bh {
@@ -248,4 +250,115 @@ private:
   bool verbose_;
 };
 
+/// Blocking queue with a fixed capacity for connecting pipeline stages.
+/// Producers block while the queue is full and consumers block while it is empty.
+/// After close() pushing fails and popping returns the remaining items and then fails.
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(const std::size_t capacity)
+  : capacity_(capacity), closed_(false), num_push_waits_(0), num_pop_waits_(0) {
+    BH_ASSERT(capacity_ > 0);
+  }
+
+  BoundedQueue(const BoundedQueue& other) = delete;
+  BoundedQueue& operator=(const BoundedQueue& other) = delete;
+
+  bool push(T&& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.size() >= capacity_ && !closed_) {
+      ++num_push_waits_;
+      not_full_cond_.wait(lock, [this]() {
+        return queue_.size() < capacity_ || closed_;
+      });
+    }
+    if (closed_) {
+      return false;
+    }
+    queue_.push_back(std::move(item));
+    lock.unlock();
+    not_empty_cond_.notify_one();
+    return true;
+  }
+
+  bool push(const T& item) {
+    T item_copy(item);
+    return push(std::move(item_copy));
+  }
+
+  bool pop(T* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.empty() && !closed_) {
+      ++num_pop_waits_;
+      not_empty_cond_.wait(lock, [this]() {
+        return !queue_.empty() || closed_;
+      });
+    }
+    if (queue_.empty()) {
+      return false;
+    }
+    *item = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_cond_.notify_one();
+    return true;
+  }
+
+  bool tryPop(T* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.empty()) {
+      return false;
+    }
+    *item = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    not_full_cond_.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    closed_ = true;
+    lock.unlock();
+    not_full_cond_.notify_all();
+    not_empty_cond_.notify_all();
+  }
+
+  bool isClosed() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return closed_;
+  }
+
+  std::size_t size() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+  std::size_t capacity() const {
+    return capacity_;
+  }
+
+  /// Number of times a producer had to wait for a full queue
+  std::size_t numPushWaits() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return num_push_waits_;
+  }
+
+  /// Number of times a consumer had to wait for an empty queue
+  std::size_t numPopWaits() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return num_pop_waits_;
+  }
+
+private:
+  const std::size_t capacity_;
+  std::deque<T> queue_;
+  bool closed_;
+  std::size_t num_push_waits_;
+  std::size_t num_pop_waits_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_full_cond_;
+  std::condition_variable not_empty_cond_;
+};
+
 }
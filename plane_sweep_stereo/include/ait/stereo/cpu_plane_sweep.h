@@ -0,0 +1,204 @@
+//==================================================
+// cpu_plane_sweep.h
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 20, 2016
+//==================================================
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include <opencv2/core/core.hpp>
+
+namespace ait
+{
+namespace stereo
+{
+
+// Pinhole camera with the same conventions as PSL::CameraMatrix (x_camera = R * x_world + T).
+class PlaneSweepCamera
+{
+public:
+  PlaneSweepCamera()
+  {
+    K_.setIdentity();
+    R_.setIdentity();
+    T_.setZero();
+  }
+
+  // Construct from any camera with getK(), getR() and getT() (i.e. PSL::CameraMatrix<double>)
+  template <typename CameraT>
+  explicit PlaneSweepCamera(const CameraT &camera)
+  {
+    setKRT(camera.getK().template cast<double>(), camera.getR().template cast<double>(), camera.getT().template cast<double>());
+  }
+
+  void setKRT(const Eigen::Matrix3d &K, const Eigen::Matrix3d &R, const Eigen::Vector3d &T)
+  {
+    K_ = K;
+    R_ = R;
+    T_ = T;
+  }
+
+  const Eigen::Matrix3d& getK() const
+  {
+    return K_;
+  }
+
+  const Eigen::Matrix3d& getR() const
+  {
+    return R_;
+  }
+
+  const Eigen::Vector3d& getT() const
+  {
+    return T_;
+  }
+
+  // Camera center in world coordinates
+  Eigen::Vector3d getC() const
+  {
+    return -R_.transpose() * T_;
+  }
+
+private:
+  Eigen::Matrix3d K_;
+  Eigen::Matrix3d R_;
+  Eigen::Vector3d T_;
+};
+
+enum class PlaneSweepMatchingCost
+{
+  SAD,
+  ZNCC,
+};
+
+enum class PlaneSweepPlaneMode
+{
+  UNIFORM_DEPTH,
+  UNIFORM_DISPARITY,
+};
+
+// Fronto-parallel plane sweep stereo on the CPU (counterpart to PSL::CudaPlaneSweep without occlusion handling).
+//
+// For each plane the other images are warped into the reference view with the plane induced homography
+// (bilinear sampling, AVX2 gathers if available), a per-pixel SAD or ZNCC cost is aggregated with a box
+// filter and the best plane per pixel is kept in a running buffer. Only the best cost and the costs of the
+// neighbouring planes are stored for sub-pixel interpolation so memory does not grow with the number of planes.
+// The reference image is processed in strips of rows in parallel (OpenMP); each strip sweeps all planes.
+class CpuPlaneSweep
+{
+public:
+  class Error : public std::runtime_error
+  {
+  public:
+    Error(const std::string &msg)
+    : std::runtime_error(msg)
+    {
+    }
+  };
+
+  CpuPlaneSweep();
+
+  void setScale(double scale);
+  void setZRange(double min_z, double max_z);
+  void setMatchWindowSize(int width, int height);
+  void setNumPlanes(int num_planes);
+  void setPlaneGenerationMode(PlaneSweepPlaneMode plane_mode);
+  void setMatchingCosts(PlaneSweepMatchingCost matching_cost);
+  // Number of reference rows per parallel task (0 chooses automatically)
+  void setStripHeight(int strip_height);
+  // Minimum fraction of valid (inside of the other image) pixels in a matching window
+  void setMinValidWindowFraction(double min_valid_window_fraction);
+  // Color matching is only used for SAD, ZNCC always uses intensities
+  void enableColorMatching(bool enable = true);
+  void enableSubPixel(bool enable = true);
+
+  // Images are 8 bit grayscale or BGR. Returns the id of the image.
+  int addImage(const cv::Mat &image, const PlaneSweepCamera &camera);
+
+  template <typename CameraT>
+  int addImage(const cv::Mat &image, const CameraT &camera)
+  {
+    return addImage(image, PlaneSweepCamera(camera));
+  }
+
+  void deleteImage(int id);
+
+  // Compute the depth map for the reference image
+  void process(int ref_id);
+
+  // Depth along the optical axis of the reference camera (CV_32F, 0 for invalid pixels)
+  const cv::Mat& getBestDepth() const
+  {
+    return best_depth_;
+  }
+
+  // Matching cost of the best plane (CV_32F, infinity for invalid pixels)
+  const cv::Mat& getBestCosts() const
+  {
+    return best_costs_;
+  }
+
+  // Camera of an image after scaling
+  const PlaneSweepCamera& getCamera(int id) const;
+
+  // Image after scaling
+  const cv::Mat& getImage(int id) const;
+
+  const std::vector<double>& getPlaneDepths() const
+  {
+    return plane_depths_;
+  }
+
+  // Write a depth map in the COLMAP array format (as read by reconstruction::DataArray::readColmapFormat)
+  static void writeColmapDepthMap(const std::string &filename, const cv::Mat &depth);
+
+  // Write the inverse depth as a color coded image for inspection
+  static void saveInvDepthAsColorImage(const std::string &filename, const cv::Mat &depth, double min_z, double max_z);
+
+private:
+  struct Image
+  {
+    PlaneSweepCamera camera;
+    cv::Mat image;
+    // CV_32F planes used for matching
+    cv::Mat intensity;
+    std::vector<cv::Mat> color_channels;
+  };
+
+  struct WarpTarget;
+  struct StripBuffers;
+
+  void computePlaneDepths();
+  void processStrip(const Image &ref_image, const std::vector<WarpTarget> &targets,
+      int row_begin, int row_end, StripBuffers &buffers);
+
+  double scale_;
+  double min_z_;
+  double max_z_;
+  int window_width_;
+  int window_height_;
+  int num_planes_;
+  PlaneSweepPlaneMode plane_mode_;
+  PlaneSweepMatchingCost matching_cost_;
+  int strip_height_;
+  double min_valid_window_fraction_;
+  bool color_matching_;
+  bool sub_pixel_;
+
+  int next_image_id_;
+  std::map<int, Image> images_;
+
+  std::vector<double> plane_depths_;
+  cv::Mat best_depth_;
+  cv::Mat best_costs_;
+};
+
+}  // namespace stereo
+}  // namespace ait
@@ -0,0 +1,721 @@
+//==================================================
+// cpu_plane_sweep.cpp
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 20, 2016
+//==================================================
+
+#include <ait/stereo/cpu_plane_sweep.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#endif
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
+namespace ait
+{
+namespace stereo
+{
+
+namespace
+{
+
+const float kInvalidCost = std::numeric_limits<float>::infinity();
+
+// Per-row warp coordinates. Pixels outside of the target image are marked invalid and
+// their coordinates are clamped so that the interpolation can read without bounds checks.
+struct WarpRow
+{
+  std::vector<int> index;
+  std::vector<float> weight_x;
+  std::vector<float> weight_y;
+  std::vector<float> valid;
+
+  void resize(int width)
+  {
+    index.resize(width);
+    weight_x.resize(width);
+    weight_y.resize(width);
+    valid.resize(width);
+  }
+};
+
+void computeWarpRow(const float *H, int y, int width, int target_width, int target_height, WarpRow &row)
+{
+  const float max_u = static_cast<float>(target_width - 1);
+  const float max_v = static_cast<float>(target_height - 1);
+  const float nu_offset = H[1] * y + H[2];
+  const float nv_offset = H[4] * y + H[5];
+  const float nw_offset = H[7] * y + H[8];
+  int x = 0;
+#if defined(__AVX2__)
+  const __m256 step = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 max_u8 = _mm256_set1_ps(max_u);
+  const __m256 max_v8 = _mm256_set1_ps(max_v);
+  const __m256i max_x0 = _mm256_set1_epi32(target_width - 2);
+  const __m256i max_y0 = _mm256_set1_epi32(target_height - 2);
+  const __m256i stride = _mm256_set1_epi32(target_width);
+  for (; x + 8 <= width; x += 8)
+  {
+    const __m256 xs = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), step);
+    const __m256 nu = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(H[0]), xs), _mm256_set1_ps(nu_offset));
+    const __m256 nv = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(H[3]), xs), _mm256_set1_ps(nv_offset));
+    const __m256 nw = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(H[6]), xs), _mm256_set1_ps(nw_offset));
+    const __m256 u = _mm256_div_ps(nu, nw);
+    const __m256 v = _mm256_div_ps(nv, nw);
+    __m256 valid_mask = _mm256_cmp_ps(nw, zero, _CMP_GT_OQ);
+    valid_mask = _mm256_and_ps(valid_mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    valid_mask = _mm256_and_ps(valid_mask, _mm256_cmp_ps(u, max_u8, _CMP_LE_OQ));
+    valid_mask = _mm256_and_ps(valid_mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    valid_mask = _mm256_and_ps(valid_mask, _mm256_cmp_ps(v, max_v8, _CMP_LE_OQ));
+    // max/min return the second operand for NaN so invalid coordinates end up in the image
+    const __m256 uc = _mm256_min_ps(_mm256_max_ps(u, zero), max_u8);
+    const __m256 vc = _mm256_min_ps(_mm256_max_ps(v, zero), max_v8);
+    const __m256i x0 = _mm256_min_epi32(_mm256_cvttps_epi32(uc), max_x0);
+    const __m256i y0 = _mm256_min_epi32(_mm256_cvttps_epi32(vc), max_y0);
+    const __m256 wx = _mm256_sub_ps(uc, _mm256_cvtepi32_ps(x0));
+    const __m256 wy = _mm256_sub_ps(vc, _mm256_cvtepi32_ps(y0));
+    const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y0, stride), x0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&row.index[x]), index);
+    _mm256_storeu_ps(&row.weight_x[x], wx);
+    _mm256_storeu_ps(&row.weight_y[x], wy);
+    _mm256_storeu_ps(&row.valid[x], _mm256_and_ps(valid_mask, one));
+  }
+#endif
+  for (; x < width; ++x)
+  {
+    const float nu = H[0] * x + nu_offset;
+    const float nv = H[3] * x + nv_offset;
+    const float nw = H[6] * x + nw_offset;
+    const float u = nu / nw;
+    const float v = nv / nw;
+    const bool valid = nw > 0 && u >= 0 && u <= max_u && v >= 0 && v <= max_v;
+    const float uc = std::min(std::max(0.0f, u), max_u);
+    const float vc = std::min(std::max(0.0f, v), max_v);
+    const int x0 = std::min(static_cast<int>(uc), target_width - 2);
+    const int y0 = std::min(static_cast<int>(vc), target_height - 2);
+    row.index[x] = y0 * target_width + x0;
+    row.weight_x[x] = uc - x0;
+    row.weight_y[x] = vc - y0;
+    row.valid[x] = valid ? 1.0f : 0.0f;
+  }
+}
+
+// Bilinear interpolation of a continuous CV_32F image. Invalid pixels are set to 0.
+void interpolateRow(const float *data, int stride, const WarpRow &row, int width, float *out)
+{
+  int x = 0;
+#if defined(__AVX2__)
+  for (; x + 8 <= width; x += 8)
+  {
+    const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&row.index[x]));
+    const __m256 wx = _mm256_loadu_ps(&row.weight_x[x]);
+    const __m256 wy = _mm256_loadu_ps(&row.weight_y[x]);
+    const __m256 p00 = _mm256_i32gather_ps(data, index, 4);
+    const __m256 p01 = _mm256_i32gather_ps(data + 1, index, 4);
+    const __m256 p10 = _mm256_i32gather_ps(data + stride, index, 4);
+    const __m256 p11 = _mm256_i32gather_ps(data + stride + 1, index, 4);
+    const __m256 top = _mm256_add_ps(p00, _mm256_mul_ps(wx, _mm256_sub_ps(p01, p00)));
+    const __m256 bottom = _mm256_add_ps(p10, _mm256_mul_ps(wx, _mm256_sub_ps(p11, p10)));
+    const __m256 value = _mm256_add_ps(top, _mm256_mul_ps(wy, _mm256_sub_ps(bottom, top)));
+    _mm256_storeu_ps(out + x, _mm256_mul_ps(value, _mm256_loadu_ps(&row.valid[x])));
+  }
+#endif
+  for (; x < width; ++x)
+  {
+    const float *p = data + row.index[x];
+    const float top = p[0] + row.weight_x[x] * (p[1] - p[0]);
+    const float bottom = p[stride] + row.weight_x[x] * (p[stride + 1] - p[stride]);
+    out[x] = (top + row.weight_y[x] * (bottom - top)) * row.valid[x];
+  }
+}
+
+// Box filter of rows [out_begin, out_begin + out_rows) of the input (which holds in_rows rows).
+// The window is clipped at the borders of the input which coincide with the image borders.
+void boxAggregate(const float *in, int in_rows, int width, int out_begin, int out_rows,
+    int radius_x, int radius_y, std::vector<float> &column_sums, float *out)
+{
+  column_sums.resize(width);
+  for (int r = 0; r < out_rows; ++r)
+  {
+    const int y = out_begin + r;
+    const int y_begin = std::max(0, y - radius_y);
+    const int y_end = std::min(in_rows, y + radius_y + 1);
+    std::fill(column_sums.begin(), column_sums.end(), 0.0f);
+    for (int yy = y_begin; yy < y_end; ++yy)
+    {
+      const float *in_row = in + yy * width;
+      for (int x = 0; x < width; ++x)
+      {
+        column_sums[x] += in_row[x];
+      }
+    }
+    float *out_row = out + r * width;
+    double sum = 0;
+    for (int x = 0; x < std::min(radius_x, width); ++x)
+    {
+      sum += column_sums[x];
+    }
+    for (int x = 0; x < width; ++x)
+    {
+      if (x + radius_x < width)
+      {
+        sum += column_sums[x + radius_x];
+      }
+      if (x - radius_x - 1 >= 0)
+      {
+        sum -= column_sums[x - radius_x - 1];
+      }
+      out_row[x] = static_cast<float>(sum);
+    }
+  }
+}
+
+}  // namespace
+
+struct CpuPlaneSweep::WarpTarget
+{
+  const Image *image;
+  // Row-major homographies from reference pixels to target pixels, one per plane
+  std::vector<float> homographies;
+};
+
+struct CpuPlaneSweep::StripBuffers
+{
+  WarpRow warp_row;
+  std::vector<float> column_sums;
+  std::vector<float> sample;
+  // Per-pixel quantities for the extended strip (including the window border)
+  std::vector<std::vector<float>> quantities;
+  // Aggregated quantities for the strip
+  std::vector<std::vector<float>> aggregated;
+  std::vector<float> plane_cost_sum;
+  std::vector<float> plane_num_valid;
+};
+
+CpuPlaneSweep::CpuPlaneSweep()
+: scale_(1.0),
+  min_z_(0.5),
+  max_z_(10.0),
+  window_width_(7),
+  window_height_(7),
+  num_planes_(64),
+  plane_mode_(PlaneSweepPlaneMode::UNIFORM_DISPARITY),
+  matching_cost_(PlaneSweepMatchingCost::SAD),
+  strip_height_(0),
+  min_valid_window_fraction_(0.5),
+  color_matching_(false),
+  sub_pixel_(true),
+  next_image_id_(0)
+{
+}
+
+void CpuPlaneSweep::setScale(double scale)
+{
+  if (scale <= 0)
+  {
+    throw Error("Scale has to be positive");
+  }
+  scale_ = scale;
+}
+
+void CpuPlaneSweep::setZRange(double min_z, double max_z)
+{
+  if (min_z <= 0 || max_z <= min_z)
+  {
+    throw Error("Invalid depth range");
+  }
+  min_z_ = min_z;
+  max_z_ = max_z;
+}
+
+void CpuPlaneSweep::setMatchWindowSize(int width, int height)
+{
+  if (width <= 0 || height <= 0 || width % 2 == 0 || height % 2 == 0)
+  {
+    throw Error("Match window size has to be positive and odd");
+  }
+  window_width_ = width;
+  window_height_ = height;
+}
+
+void CpuPlaneSweep::setNumPlanes(int num_planes)
+{
+  if (num_planes <= 0)
+  {
+    throw Error("Number of planes has to be positive");
+  }
+  num_planes_ = num_planes;
+}
+
+void CpuPlaneSweep::setPlaneGenerationMode(PlaneSweepPlaneMode plane_mode)
+{
+  plane_mode_ = plane_mode;
+}
+
+void CpuPlaneSweep::setMatchingCosts(PlaneSweepMatchingCost matching_cost)
+{
+  matching_cost_ = matching_cost;
+}
+
+void CpuPlaneSweep::setStripHeight(int strip_height)
+{
+  strip_height_ = strip_height;
+}
+
+void CpuPlaneSweep::setMinValidWindowFraction(double min_valid_window_fraction)
+{
+  min_valid_window_fraction_ = min_valid_window_fraction;
+}
+
+void CpuPlaneSweep::enableColorMatching(bool enable)
+{
+  color_matching_ = enable;
+}
+
+void CpuPlaneSweep::enableSubPixel(bool enable)
+{
+  sub_pixel_ = enable;
+}
+
+int CpuPlaneSweep::addImage(const cv::Mat &image, const PlaneSweepCamera &camera)
+{
+  if (image.depth() != CV_8U || (image.channels() != 1 && image.channels() != 3))
+  {
+    throw Error("Images have to be 8 bit grayscale or BGR");
+  }
+  Image entry;
+  Eigen::Matrix3d K = camera.getK();
+  if (scale_ != 1.0)
+  {
+    cv::resize(image, entry.image, cv::Size(), scale_, scale_, cv::INTER_AREA);
+    K.row(0) *= scale_;
+    K.row(1) *= scale_;
+  }
+  else
+  {
+    entry.image = image.clone();
+  }
+  if (entry.image.cols < 2 || entry.image.rows < 2)
+  {
+    throw Error("Images have to be at least 2x2 pixels");
+  }
+  entry.camera.setKRT(K, camera.getR(), camera.getT());
+
+  cv::Mat gray;
+  if (entry.image.channels() == 3)
+  {
+    cv::cvtColor(entry.image, gray, cv::COLOR_BGR2GRAY);
+    std::vector<cv::Mat> channels;
+    cv::split(entry.image, channels);
+    for (const cv::Mat &channel : channels)
+    {
+      cv::Mat channel_float;
+      channel.convertTo(channel_float, CV_32F);
+      entry.color_channels.push_back(channel_float);
+    }
+  }
+  else
+  {
+    gray = entry.image;
+  }
+  gray.convertTo(entry.intensity, CV_32F);
+
+  const int id = next_image_id_++;
+  images_.emplace(id, std::move(entry));
+  return id;
+}
+
+void CpuPlaneSweep::deleteImage(int id)
+{
+  images_.erase(id);
+}
+
+const PlaneSweepCamera& CpuPlaneSweep::getCamera(int id) const
+{
+  auto it = images_.find(id);
+  if (it == images_.end())
+  {
+    throw Error("Unknown image id");
+  }
+  return it->second.camera;
+}
+
+const cv::Mat& CpuPlaneSweep::getImage(int id) const
+{
+  auto it = images_.find(id);
+  if (it == images_.end())
+  {
+    throw Error("Unknown image id");
+  }
+  return it->second.image;
+}
+
+void CpuPlaneSweep::computePlaneDepths()
+{
+  plane_depths_.resize(num_planes_);
+  for (int k = 0; k < num_planes_; ++k)
+  {
+    const double t = num_planes_ > 1 ? k / static_cast<double>(num_planes_ - 1) : 0.0;
+    if (plane_mode_ == PlaneSweepPlaneMode::UNIFORM_DISPARITY)
+    {
+      plane_depths_[k] = 1.0 / (1.0 / min_z_ + t * (1.0 / max_z_ - 1.0 / min_z_));
+    }
+    else
+    {
+      plane_depths_[k] = min_z_ + t * (max_z_ - min_z_);
+    }
+  }
+}
+
+void CpuPlaneSweep::process(int ref_id)
+{
+  auto ref_it = images_.find(ref_id);
+  if (ref_it == images_.end())
+  {
+    throw Error("Unknown reference image id");
+  }
+  if (images_.size() < 2)
+  {
+    throw Error("Plane sweep needs at least two images");
+  }
+  const Image &ref_image = ref_it->second;
+  const bool use_color = color_matching_ && matching_cost_ == PlaneSweepMatchingCost::SAD;
+  for (const auto &entry : images_)
+  {
+    if (use_color && entry.second.color_channels.empty())
+    {
+      throw Error("Color matching requires color images");
+    }
+  }
+  computePlaneDepths();
+
+  // Plane z = d in reference camera coordinates induces the homography
+  // H = K_t * (R_rel + t_rel * [0 0 1] / d) * K_ref^-1
+  const Eigen::Matrix3d K_ref_inv = ref_image.camera.getK().inverse();
+  std::vector<WarpTarget> targets;
+  for (const auto &entry : images_)
+  {
+    if (entry.first == ref_id)
+    {
+      continue;
+    }
+    const PlaneSweepCamera &camera = entry.second.camera;
+    const Eigen::Matrix3d R_rel = camera.getR() * ref_image.camera.getR().transpose();
+    const Eigen::Vector3d t_rel = camera.getT() - R_rel * ref_image.camera.getT();
+    const Eigen::Matrix3d A = camera.getK() * R_rel * K_ref_inv;
+    const Eigen::Vector3d b = camera.getK() * t_rel;
+    const Eigen::RowVector3d n = K_ref_inv.row(2);
+    WarpTarget target;
+    target.image = &entry.second;
+    target.homographies.resize(9 * num_planes_);
+    for (int k = 0; k < num_planes_; ++k)
+    {
+      const Eigen::Matrix3d H = A + b * n / plane_depths_[k];
+      for (int i = 0; i < 3; ++i)
+      {
+        for (int j = 0; j < 3; ++j)
+        {
+          target.homographies[9 * k + 3 * i + j] = static_cast<float>(H(i, j));
+        }
+      }
+    }
+    targets.push_back(std::move(target));
+  }
+
+  const int width = ref_image.intensity.cols;
+  const int height = ref_image.intensity.rows;
+  best_depth_ = cv::Mat(height, width, CV_32F);
+  best_costs_ = cv::Mat(height, width, CV_32F);
+
+  int strip_height = strip_height_;
+  if (strip_height <= 0)
+  {
+    strip_height = std::max(32, 4 * window_height_);
+  }
+  const int num_strips = (height + strip_height - 1) / strip_height;
+#pragma omp parallel
+  {
+    StripBuffers buffers;
+#pragma omp for schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip)
+    {
+      const int row_begin = strip * strip_height;
+      const int row_end = std::min(height, row_begin + strip_height);
+      processStrip(ref_image, targets, row_begin, row_end, buffers);
+    }
+  }
+}
+
+void CpuPlaneSweep::processStrip(const Image &ref_image, const std::vector<WarpTarget> &targets,
+    int row_begin, int row_end, StripBuffers &buffers)
+{
+  const int width = ref_image.intensity.cols;
+  const int height = ref_image.intensity.rows;
+  const int radius_x = window_width_ / 2;
+  const int radius_y = window_height_ / 2;
+  const int ext_begin = std::max(0, row_begin - radius_y);
+  const int ext_end = std::min(height, row_end + radius_y);
+  const int ext_rows = ext_end - ext_begin;
+  const int rows = row_end - row_begin;
+  const size_t ext_size = static_cast<size_t>(ext_rows) * width;
+  const size_t size = static_cast<size_t>(rows) * width;
+  const bool zncc = matching_cost_ == PlaneSweepMatchingCost::ZNCC;
+  const bool use_color = color_matching_ && !zncc;
+
+  // SAD: valid, cost. ZNCC: valid, o, o^2, r * o, r, r^2 (all masked by valid).
+  const size_t num_quantities = zncc ? 6 : 2;
+  buffers.quantities.resize(num_quantities);
+  buffers.aggregated.resize(num_quantities);
+  for (size_t q = 0; q < num_quantities; ++q)
+  {
+    buffers.quantities[q].resize(ext_size);
+    buffers.aggregated[q].resize(size);
+  }
+  buffers.warp_row.resize(width);
+  buffers.sample.resize(width);
+  buffers.plane_cost_sum.resize(size);
+  buffers.plane_num_valid.resize(size);
+
+  // Running state of the sweep for the strip
+  std::vector<float> best_cost(size, kInvalidCost);
+  std::vector<int> best_plane(size, -1);
+  std::vector<float> best_prev_cost(size, kInvalidCost);
+  std::vector<float> best_next_cost(size, kInvalidCost);
+  std::vector<float> prev_plane_cost(size, kInvalidCost);
+
+  // Number of image pixels covered by the (clipped) window of each pixel
+  std::vector<float> min_valid_count(size);
+  for (int r = 0; r < rows; ++r)
+  {
+    const int y = row_begin + r;
+    const int window_rows = std::min(height - 1, y + radius_y) - std::max(0, y - radius_y) + 1;
+    for (int x = 0; x < width; ++x)
+    {
+      const int window_cols = std::min(width - 1, x + radius_x) - std::max(0, x - radius_x) + 1;
+      min_valid_count[r * width + x] = std::max(1.0f,
+          static_cast<float>(min_valid_window_fraction_ * window_rows * window_cols));
+    }
+  }
+
+  const size_t num_channels = use_color ? ref_image.color_channels.size() : 1;
+  const float channel_normalization = 1.0f / num_channels;
+
+  for (int k = 0; k < num_planes_; ++k)
+  {
+    std::fill(buffers.plane_cost_sum.begin(), buffers.plane_cost_sum.end(), 0.0f);
+    std::fill(buffers.plane_num_valid.begin(), buffers.plane_num_valid.end(), 0.0f);
+
+    for (const WarpTarget &target : targets)
+    {
+      const Image &target_image = *target.image;
+      const float *H = &target.homographies[9 * k];
+      const int target_width = target_image.intensity.cols;
+      const int target_height = target_image.intensity.rows;
+
+      for (int e = 0; e < ext_rows; ++e)
+      {
+        const int y = ext_begin + e;
+        computeWarpRow(H, y, width, target_width, target_height, buffers.warp_row);
+        const float *valid = buffers.warp_row.valid.data();
+        float *q_valid = &buffers.quantities[0][e * width];
+        std::copy(valid, valid + width, q_valid);
+        if (!zncc)
+        {
+          float *q_cost = &buffers.quantities[1][e * width];
+          std::fill(q_cost, q_cost + width, 0.0f);
+          for (size_t c = 0; c < num_channels; ++c)
+          {
+            const cv::Mat &target_channel = use_color ? target_image.color_channels[c] : target_image.intensity;
+            const cv::Mat &ref_channel = use_color ? ref_image.color_channels[c] : ref_image.intensity;
+            interpolateRow(target_channel.ptr<float>(), target_width, buffers.warp_row, width, buffers.sample.data());
+            const float *ref_row = ref_channel.ptr<float>(y);
+            for (int x = 0; x < width; ++x)
+            {
+              q_cost[x] += std::abs(ref_row[x] - buffers.sample[x]) * valid[x];
+            }
+          }
+          for (int x = 0; x < width; ++x)
+          {
+            q_cost[x] *= channel_normalization;
+          }
+        }
+        else
+        {
+          interpolateRow(target_image.intensity.ptr<float>(), target_width, buffers.warp_row, width, buffers.sample.data());
+          const float *ref_row = ref_image.intensity.ptr<float>(y);
+          float *q_o = &buffers.quantities[1][e * width];
+          float *q_oo = &buffers.quantities[2][e * width];
+          float *q_ro = &buffers.quantities[3][e * width];
+          float *q_r = &buffers.quantities[4][e * width];
+          float *q_rr = &buffers.quantities[5][e * width];
+          for (int x = 0; x < width; ++x)
+          {
+            const float o = buffers.sample[x];
+            const float r = ref_row[x] * valid[x];
+            q_o[x] = o;
+            q_oo[x] = o * o;
+            q_ro[x] = r * o;
+            q_r[x] = r;
+            q_rr[x] = r * ref_row[x];
+          }
+        }
+      }
+
+      for (size_t q = 0; q < num_quantities; ++q)
+      {
+        boxAggregate(buffers.quantities[q].data(), ext_rows, width, row_begin - ext_begin, rows,
+            radius_x, radius_y, buffers.column_sums, buffers.aggregated[q].data());
+      }
+
+      const float *n = buffers.aggregated[0].data();
+      for (size_t i = 0; i < size; ++i)
+      {
+        if (n[i] < min_valid_count[i])
+        {
+          continue;
+        }
+        float cost;
+        if (!zncc)
+        {
+          cost = buffers.aggregated[1][i] / n[i];
+        }
+        else
+        {
+          const float inv_n = 1.0f / n[i];
+          const float mean_o = buffers.aggregated[1][i] * inv_n;
+          const float mean_r = buffers.aggregated[4][i] * inv_n;
+          const float var_o = buffers.aggregated[2][i] * inv_n - mean_o * mean_o;
+          const float var_r = buffers.aggregated[5][i] * inv_n - mean_r * mean_r;
+          const float cov = buffers.aggregated[3][i] * inv_n - mean_r * mean_o;
+          // Textureless windows do not provide a meaningful correlation
+          const float kMinVariance = 1e-2f;
+          if (var_o < kMinVariance || var_r < kMinVariance)
+          {
+            continue;
+          }
+          const float ncc = cov / std::sqrt(var_o * var_r);
+          cost = 1.0f - std::max(-1.0f, std::min(1.0f, ncc));
+        }
+        buffers.plane_cost_sum[i] += cost;
+        buffers.plane_num_valid[i] += 1;
+      }
+    }
+
+    // Update running best plane and the costs of its neighbours
+    for (size_t i = 0; i < size; ++i)
+    {
+      const float cost = buffers.plane_num_valid[i] > 0
+          ? buffers.plane_cost_sum[i] / buffers.plane_num_valid[i] : kInvalidCost;
+      if (cost < best_cost[i])
+      {
+        best_cost[i] = cost;
+        best_plane[i] = k;
+        best_prev_cost[i] = prev_plane_cost[i];
+        best_next_cost[i] = kInvalidCost;
+      }
+      else if (best_plane[i] == k - 1)
+      {
+        best_next_cost[i] = cost;
+      }
+      prev_plane_cost[i] = cost;
+    }
+  }
+
+  for (int r = 0; r < rows; ++r)
+  {
+    float *depth_row = best_depth_.ptr<float>(row_begin + r);
+    float *cost_row = best_costs_.ptr<float>(row_begin + r);
+    for (int x = 0; x < width; ++x)
+    {
+      const size_t i = static_cast<size_t>(r) * width + x;
+      const int k = best_plane[i];
+      cost_row[x] = best_cost[i];
+      if (k < 0)
+      {
+        depth_row[x] = 0;
+        continue;
+      }
+      double depth = plane_depths_[k];
+      const float prev = best_prev_cost[i];
+      const float next = best_next_cost[i];
+      if (sub_pixel_ && k > 0 && k + 1 < num_planes_ && std::isfinite(prev) && std::isfinite(next))
+      {
+        // Parabola through the three costs, interpolated linearly in inverse depth
+        const double denominator = prev - 2.0 * best_cost[i] + next;
+        if (denominator > 0)
+        {
+          const double offset = std::max(-0.5, std::min(0.5, 0.5 * (prev - next) / denominator));
+          const double inv_depth = 1.0 / plane_depths_[k];
+          const double inv_depth_neighbour = 1.0 / plane_depths_[offset >= 0 ? k + 1 : k - 1];
+          depth = 1.0 / (inv_depth + std::abs(offset) * (inv_depth_neighbour - inv_depth));
+        }
+      }
+      depth_row[x] = static_cast<float>(depth);
+    }
+  }
+}
+
+void CpuPlaneSweep::writeColmapDepthMap(const std::string &filename, const cv::Mat &depth)
+{
+  if (depth.type() != CV_32F)
+  {
+    throw Error("Depth map has to be of type CV_32F");
+  }
+  std::ofstream text_out(filename, std::ios_base::out);
+  if (!text_out)
+  {
+    throw Error("Unable to open depth map file for writing: " + filename);
+  }
+  text_out << depth.cols << "&" << depth.rows << "&" << 1 << "&";
+  text_out.close();
+
+  std::ofstream binary_out(filename, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+  if (!binary_out)
+  {
+    throw Error("Unable to open depth map file for writing: " + filename);
+  }
+  for (int y = 0; y < depth.rows; ++y)
+  {
+    binary_out.write(reinterpret_cast<const char*>(depth.ptr<float>(y)), depth.cols * sizeof(float));
+  }
+}
+
+void CpuPlaneSweep::saveInvDepthAsColorImage(const std::string &filename, const cv::Mat &depth, double min_z, double max_z)
+{
+  cv::Mat inv_depth_img(depth.rows, depth.cols, CV_8U);
+  for (int y = 0; y < depth.rows; ++y)
+  {
+    for (int x = 0; x < depth.cols; ++x)
+    {
+      const float d = depth.at<float>(y, x);
+      if (d <= 0)
+      {
+        inv_depth_img.at<uint8_t>(y, x) = 0;
+        continue;
+      }
+      const double t = (1.0 / d - 1.0 / max_z) / (1.0 / min_z - 1.0 / max_z);
+      inv_depth_img.at<uint8_t>(y, x) = static_cast<uint8_t>(std::round(255 * std::max(0.0, std::min(1.0, t))));
+    }
+  }
+  cv::Mat color_img;
+  cv::applyColorMap(inv_depth_img, color_img, cv::COLORMAP_JET);
+  color_img.setTo(cv::Scalar(0, 0, 0), inv_depth_img == 0);
+  if (!cv::imwrite(filename, color_img))
+  {
+    throw Error("Unable to write image: " + filename);
+  }
+}
+
+}  // namespace stereo
+}  // namespace ait
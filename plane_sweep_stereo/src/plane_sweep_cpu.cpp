@@ -0,0 +1,134 @@
+//==================================================
+// plane_sweep_cpu.cpp
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 20, 2016
+//==================================================
+
+// Plane sweep stereo on a calibrated stereo pair without CUDA.
+// Writes the depth map in the COLMAP format so that it can be used in place of COLMAP's dense stereo output.
+
+#include <iostream>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include <Eigen/Dense>
+#include <opencv2/highgui/highgui.hpp>
+#include <ait/stereo/stereo_calibration.h>
+#include <ait/stereo/cpu_plane_sweep.h>
+#include <ait/utilities.h>
+
+int main(int argc, char* argv[])
+{
+  namespace po = boost::program_options;
+  namespace ast = ait::stereo;
+
+  std::string calib_file;
+  std::string img_left_file;
+  std::string img_right_file;
+  std::string depth_output_file;
+  std::string inv_depth_image_file;
+  double min_z;
+  double max_z;
+  double scale;
+  int window_size;
+  int num_planes;
+  std::string matching_cost;
+  bool color_matching;
+  bool uniform_depth;
+
+  try
+  {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help", "Produce help message")
+            ("calib-file", po::value<std::string>(&calib_file)->default_value("camera_calibration_stereo.yml"), "Stereo calibration file.")
+            ("left-img", po::value<std::string>(&img_left_file)->required(), "Left frame (reference image).")
+            ("right-img", po::value<std::string>(&img_right_file)->required(), "Right frame.")
+            ("depth-output", po::value<std::string>(&depth_output_file)->default_value(""), "Output depth map in COLMAP format (.bin).")
+            ("inv-depth-image", po::value<std::string>(&inv_depth_image_file)->default_value(""), "Output color coded inverse depth image.")
+            ("min-z", po::value<double>(&min_z)->default_value(0.4), "Minimum depth.")
+            ("max-z", po::value<double>(&max_z)->default_value(5.0), "Maximum depth.")
+            ("scale", po::value<double>(&scale)->default_value(1.0), "Image scale.")
+            ("window-size", po::value<int>(&window_size)->default_value(15), "Matching window size (odd).")
+            ("num-planes", po::value<int>(&num_planes)->default_value(128), "Number of planes.")
+            ("cost", po::value<std::string>(&matching_cost)->default_value("sad"), "Matching cost (sad or zncc).")
+            ("color", po::bool_switch(&color_matching), "Use color for SAD matching.")
+            ("uniform-depth", po::bool_switch(&uniform_depth), "Sample planes uniformly in depth instead of disparity.")
+            ;
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    po::notify(vm);
+
+    // Try to read stereo camera calibration
+    ast::StereoCameraCalibration calib = ast::StereoCameraCalibration::readStereoCalibration(calib_file);
+    ast::PlaneSweepCamera camera_left;
+    ast::PlaneSweepCamera camera_right;
+    camera_left.setKRT(calib.left.getCameraMatrixEigen(), Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero());
+    camera_right.setKRT(calib.right.getCameraMatrixEigen(), calib.getRotationEigen(), calib.getTranslationEigen());
+
+    // Load images
+    cv::Mat img_left = cv::imread(img_left_file, color_matching ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE);
+    if (img_left.data == nullptr)
+    {
+      throw std::runtime_error("Unable to read left image");
+    }
+    cv::Mat img_right = cv::imread(img_right_file, color_matching ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE);
+    if (img_right.data == nullptr)
+    {
+      throw std::runtime_error("Unable to read right image");
+    }
+
+    ast::CpuPlaneSweep plane_sweep;
+    plane_sweep.setScale(scale);
+    plane_sweep.setZRange(min_z, max_z);
+    plane_sweep.setMatchWindowSize(window_size, window_size);
+    plane_sweep.setNumPlanes(num_planes);
+    plane_sweep.setPlaneGenerationMode(uniform_depth ? ast::PlaneSweepPlaneMode::UNIFORM_DEPTH : ast::PlaneSweepPlaneMode::UNIFORM_DISPARITY);
+    if (matching_cost == "sad")
+    {
+      plane_sweep.setMatchingCosts(ast::PlaneSweepMatchingCost::SAD);
+    }
+    else if (matching_cost == "zncc")
+    {
+      plane_sweep.setMatchingCosts(ast::PlaneSweepMatchingCost::ZNCC);
+    }
+    else
+    {
+      throw std::runtime_error("Unknown matching cost: " + matching_cost);
+    }
+    plane_sweep.enableColorMatching(color_matching);
+    plane_sweep.enableSubPixel();
+
+    const int id_left = plane_sweep.addImage(img_left, camera_left);
+    plane_sweep.addImage(img_right, camera_right);
+
+    ait::Timer timer;
+    plane_sweep.process(id_left);
+    timer.printTiming("Plane sweep stereo on CPU");
+
+    const cv::Mat &depth = plane_sweep.getBestDepth();
+    if (!depth_output_file.empty())
+    {
+      ast::CpuPlaneSweep::writeColmapDepthMap(depth_output_file, depth);
+    }
+    if (!inv_depth_image_file.empty())
+    {
+      ast::CpuPlaneSweep::saveInvDepthAsColorImage(inv_depth_image_file, depth, min_z, max_z);
+    }
+  }
+  catch (const std::exception &err)
+  {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+//==================================================
+// descriptor_distance.h
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Sep 3, 2016
+//==================================================
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#if defined(__AVX__) || defined(__SSE2__)
+  #include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#endif
+
+namespace ait
+{
+namespace stereo
+{
+
+// Squared L2 distance of two float descriptors.
+// Accumulates in double like cv::norm(..., cv::NORM_L2) so that the ranking of candidates is the same.
+inline double computeDescriptorL2DistanceSquared(const float *a, const float *b, int size)
+{
+  int i = 0;
+  double sum = 0;
+#if defined(__AVX__)
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  for (; i + 8 <= size; i += 8)
+  {
+    const __m256d a0 = _mm256_cvtps_pd(_mm_loadu_ps(a + i));
+    const __m256d b0 = _mm256_cvtps_pd(_mm_loadu_ps(b + i));
+    const __m256d a1 = _mm256_cvtps_pd(_mm_loadu_ps(a + i + 4));
+    const __m256d b1 = _mm256_cvtps_pd(_mm_loadu_ps(b + i + 4));
+    const __m256d d0 = _mm256_sub_pd(a0, b0);
+    const __m256d d1 = _mm256_sub_pd(a1, b1);
+    acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+    acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+  sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  for (; i + 4 <= size; i += 4)
+  {
+    const __m128 a4 = _mm_loadu_ps(a + i);
+    const __m128 b4 = _mm_loadu_ps(b + i);
+    const __m128d d0 = _mm_sub_pd(_mm_cvtps_pd(a4), _mm_cvtps_pd(b4));
+    const __m128d d1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(a4, a4)), _mm_cvtps_pd(_mm_movehl_ps(b4, b4)));
+    acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+    acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  sum = lanes[0] + lanes[1];
+#endif
+  for (; i < size; ++i)
+  {
+    const double d = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+    sum += d * d;
+  }
+  return sum;
+}
+
+inline int popcount64(std::uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  return static_cast<int>(__popcnt64(value));
+#elif defined(__GNUC__)
+  return __builtin_popcountll(value);
+#else
+  value = value - ((value >> 1) & 0x5555555555555555ULL);
+  value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+  value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<int>((value * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Hamming distance of two binary descriptors (same as cv::norm(..., cv::NORM_HAMMING)).
+// Compiles to the popcnt instruction if available (-msse4.2 / -mpopcnt).
+inline int computeDescriptorHammingDistance(const std::uint8_t *a, const std::uint8_t *b, int size)
+{
+  int i = 0;
+  int distance = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    std::uint64_t a8;
+    std::uint64_t b8;
+    std::memcpy(&a8, a + i, sizeof(a8));
+    std::memcpy(&b8, b + i, sizeof(b8));
+    distance += popcount64(a8 ^ b8);
+  }
+  for (; i < size; ++i)
+  {
+    distance += popcount64(static_cast<std::uint64_t>(a[i] ^ b[i]));
+  }
+  return distance;
+}
+
+}  // namespace stereo
+}  // namespace ait
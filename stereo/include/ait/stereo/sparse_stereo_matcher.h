@@ -165,6 +165,10 @@ class SparseStereoMatcher
   double ratio_test_threshold_;
   double epipolar_constraint_threshold_;
   int match_norm_;
+  double epipolar_max_y_difference_;
+  double epipolar_min_disparity_;
+  double epipolar_max_disparity_;
+  double epipolar_row_bucket_height_;
   bool bf_matcher_cross_check_;
   cv::Ptr<cv::flann::IndexParams> flann_index_params_;
   cv::Ptr<cv::flann::SearchParams> flann_search_params_;
@@ -207,6 +211,41 @@ public:
     match_norm_ = match_norm;
   }
 
+  // Maximum difference in y of left and right keypoints for matchFeaturesCustom
+  double getEpipolarMaxYDifference() const
+  {
+    return epipolar_max_y_difference_;
+  }
+  void setEpipolarMaxYDifference(double epipolar_max_y_difference)
+  {
+    epipolar_max_y_difference_ = epipolar_max_y_difference;
+  }
+
+  // Range of disparities (left x - right x) considered by matchFeaturesCustom (unbounded by default)
+  double getEpipolarMinDisparity() const
+  {
+    return epipolar_min_disparity_;
+  }
+  double getEpipolarMaxDisparity() const
+  {
+    return epipolar_max_disparity_;
+  }
+  void setEpipolarDisparityRange(double min_disparity, double max_disparity)
+  {
+    epipolar_min_disparity_ = min_disparity;
+    epipolar_max_disparity_ = max_disparity;
+  }
+
+  // Height of the row buckets used by matchFeaturesCustom (0 means the maximum y difference)
+  double getEpipolarRowBucketHeight() const
+  {
+    return epipolar_row_bucket_height_;
+  }
+  void setEpipolarRowBucketHeight(double epipolar_row_bucket_height)
+  {
+    epipolar_row_bucket_height_ = epipolar_row_bucket_height;
+  }
+
   const cv::Ptr<cv::flann::IndexParams> getFlannIndexParams() const
   {
     return flann_index_params_;
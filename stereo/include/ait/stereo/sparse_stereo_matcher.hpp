@@ -7,8 +7,11 @@
 //==================================================
 
 #include <ait/utilities.h>
+#include <cmath>
+#include <cstdint>
 #include <limits>
 #include <thread>
+#include "ait/stereo/descriptor_distance.h"
 #include <opencv2/features2d.hpp>
 #if OPENCV_3
 //  #include <opencv2/xfeatures2d.hpp>
@@ -500,6 +503,10 @@ SparseStereoMatcher<T>::SparseStereoMatcher(const cv::Ptr<T> &feature_detector,
   ratio_test_threshold_(0.7),
   epipolar_constraint_threshold_(0.5),
   match_norm_(cv::NORM_L2),
+  epipolar_max_y_difference_(10),
+  epipolar_min_disparity_(-std::numeric_limits<double>::infinity()),
+  epipolar_max_disparity_(std::numeric_limits<double>::infinity()),
+  epipolar_row_bucket_height_(0),
   bf_matcher_cross_check_(true),
   flann_index_params_(cv::makePtr<cv::flann::KDTreeIndexParams>(5)),
   flann_search_params_(cv::makePtr<cv::flann::SearchParams>(50, 0, true))
@@ -686,67 +693,148 @@ std::vector<cv::DMatch> SparseStereoMatcher<T>::matchFeaturesCustom(
   {
     right_descriptors_mat.convertTo(right_descriptors_mat, CV_32F);
   }
+  if (left_points.empty() || right_points.empty())
+  {
+    return std::vector<cv::DMatch>();
+  }
+  if (!left_descriptors_mat.isContinuous())
+  {
+    left_descriptors_mat = left_descriptors_mat.clone();
+  }
+  if (!right_descriptors_mat.isContinuous())
+  {
+    right_descriptors_mat = right_descriptors_mat.clone();
+  }
 
+  // Row index of the right keypoints. Keypoints are bucketed by y with a counting sort so that
+  // the indices within a bucket stay in ascending order.
   ProfilingTimer timer;
-  std::vector<int> left_y_sorted_indices;
-  std::vector<int> right_y_sorted_indices;
-  left_y_sorted_indices.reserve(left_descriptors_mat.rows);
-  right_y_sorted_indices.reserve(right_descriptors_mat.rows);
-  for (int i = 0; i < left_descriptors_mat.rows; ++i)
+  const double max_y_diff = epipolar_max_y_difference_;
+  const double bucket_height = epipolar_row_bucket_height_ > 0 ? epipolar_row_bucket_height_ : std::max(max_y_diff, 1.0);
+  double min_y = std::numeric_limits<double>::infinity();
+  double max_y = -std::numeric_limits<double>::infinity();
+  for (const cv::Point2d &point : right_points)
   {
-    left_y_sorted_indices.push_back(i);
+    min_y = std::min(min_y, point.y);
+    max_y = std::max(max_y, point.y);
   }
-  for (int i = 0; i < right_descriptors_mat.rows; ++i)
+  const int num_buckets = static_cast<int>((max_y - min_y) / bucket_height) + 1;
+  const auto compute_bucket = [&](double y) -> int
+  {
+    const double bucket = std::floor((y - min_y) / bucket_height);
+    return static_cast<int>(std::max(0.0, std::min(bucket, static_cast<double>(num_buckets - 1))));
+  };
+  std::vector<int> bucket_offsets(num_buckets + 1, 0);
+  for (const cv::Point2d &point : right_points)
   {
-    right_y_sorted_indices.push_back(i);
+    ++bucket_offsets[compute_bucket(point.y) + 1];
   }
-  std::sort(left_y_sorted_indices.begin(), left_y_sorted_indices.end(), [&](int a, int b)
+  for (int b = 0; b < num_buckets; ++b)
   {
-    return left_points[a].y < left_points[b].y;
-  });
-  std::sort(right_y_sorted_indices.begin(), right_y_sorted_indices.end(), [&](int a, int b)
+    bucket_offsets[b + 1] += bucket_offsets[b];
+  }
+  std::vector<int> bucket_indices(right_points.size());
+  std::vector<int> bucket_fill(bucket_offsets.begin(), bucket_offsets.end() - 1);
+  for (int j = 0; j < static_cast<int>(right_points.size()); ++j)
   {
-    return right_points[a].y < right_points[b].y;
-  });
-  timer.stopAndPrintTiming("Sorting keypoint indices by y");
+    bucket_indices[bucket_fill[compute_bucket(right_points[j].y)]++] = j;
+  }
+  // Left keypoints are grouped by the same buckets so that each parallel task scans the same right buckets
+  std::vector<int> left_bucket_offsets(num_buckets + 1, 0);
+  for (const cv::Point2d &point : left_points)
+  {
+    ++left_bucket_offsets[compute_bucket(point.y) + 1];
+  }
+  for (int b = 0; b < num_buckets; ++b)
+  {
+    left_bucket_offsets[b + 1] += left_bucket_offsets[b];
+  }
+  std::vector<int> left_bucket_indices(left_points.size());
+  bucket_fill.assign(left_bucket_offsets.begin(), left_bucket_offsets.end() - 1);
+  for (int i = 0; i < static_cast<int>(left_points.size()); ++i)
+  {
+    left_bucket_indices[bucket_fill[compute_bucket(left_points[i].y)]++] = i;
+  }
+  if (verbose)
+  {
+    timer.stopAndPrintTiming("building epipolar row index");
+  }
 
-  timer.start();
-  double max_y_diff = 10;
-  std::vector<cv::DMatch> matches;
-  int right_begin_j = 0;
-  int right_end_j = 0;
-  for (int i = 0; i < left_points.size(); ++i)
+  // Use the SIMD kernels for the common descriptor types and fall back to cv::norm otherwise.
+  // Distances are compared as squared L2 distances which does not change the ranking.
+  const int descriptor_size = left_descriptors_mat.cols;
+  const bool use_l2_kernel = left_descriptors_mat.type() == CV_32F && right_descriptors_mat.type() == CV_32F
+      && match_norm_ == cv::NORM_L2;
+  const bool use_hamming_kernel = left_descriptors_mat.type() == CV_8U && right_descriptors_mat.type() == CV_8U
+      && match_norm_ == cv::NORM_HAMMING;
+  const auto compute_score = [&](int i, int j) -> double
   {
-    double best_score = std::numeric_limits<double>::infinity();
-    int best_index = -1;
-    while (right_end_j < right_points.size() - 1
-        && right_points[right_end_j].y < left_points[i].y + max_y_diff)
+    if (use_l2_kernel)
     {
-      ++right_end_j;
+      return computeDescriptorL2DistanceSquared(
+          left_descriptors_mat.ptr<float>(i), right_descriptors_mat.ptr<float>(j), descriptor_size);
     }
-    while (right_begin_j < right_end_j
-        && right_points[right_begin_j].y - max_y_diff > left_points[i].y)
+    else if (use_hamming_kernel)
     {
-      ++right_begin_j;
+      return computeDescriptorHammingDistance(
+          left_descriptors_mat.ptr<std::uint8_t>(i), right_descriptors_mat.ptr<std::uint8_t>(j), descriptor_size);
     }
-    for (int j = right_begin_j; j <= right_end_j; ++j)
+    return cv::norm(left_descriptors_mat.row(i), right_descriptors_mat.row(j), match_norm_);
+  };
+
+  timer.start();
+  std::vector<int> best_indices(left_points.size(), -1);
+  std::vector<double> best_scores(left_points.size(), std::numeric_limits<double>::infinity());
+#pragma omp parallel for schedule(dynamic)
+  for (int left_bucket = 0; left_bucket < num_buckets; ++left_bucket)
+  {
+    for (int k = left_bucket_offsets[left_bucket]; k < left_bucket_offsets[left_bucket + 1]; ++k)
     {
-      double score = cv::norm(left_descriptors_mat.row(i), right_descriptors_mat.row(j), cv::NORM_L2);
-      if (score < best_score)
+      const int i = left_bucket_indices[k];
+      const cv::Point2d &left_point = left_points[i];
+      const int bucket_begin = compute_bucket(left_point.y - max_y_diff);
+      const int bucket_end = compute_bucket(left_point.y + max_y_diff);
+      double best_score = std::numeric_limits<double>::infinity();
+      int best_index = -1;
+      for (int l = bucket_offsets[bucket_begin]; l < bucket_offsets[bucket_end + 1]; ++l)
       {
-        best_score = score;
-        best_index = j;
+        const int j = bucket_indices[l];
+        const cv::Point2d &right_point = right_points[j];
+        if (std::abs(right_point.y - left_point.y) > max_y_diff)
+        {
+          continue;
+        }
+        const double disparity = left_point.x - right_point.x;
+        if (disparity < epipolar_min_disparity_ || disparity > epipolar_max_disparity_)
+        {
+          continue;
+        }
+        const double score = compute_score(i, j);
+        // Buckets are not visited in index order so ties are resolved explicitly
+        if (score < best_score || (score == best_score && j < best_index))
+        {
+          best_score = score;
+          best_index = j;
+        }
       }
+      best_indices[i] = best_index;
+      best_scores[i] = use_l2_kernel ? std::sqrt(best_score) : best_score;
     }
-    if (best_index >= 0)
+  }
+
+  std::vector<cv::DMatch> matches;
+  for (int i = 0; i < static_cast<int>(left_points.size()); ++i)
+  {
+    if (best_indices[i] >= 0)
     {
-      matches.push_back(cv::DMatch(i, best_index, best_score));
+      matches.push_back(cv::DMatch(i, best_indices[i], best_scores[i]));
     }
   }
-  timer.stopAndPrintTiming("performing epipolar-based matching");
+  if (verbose)
+  {
+    timer.stopAndPrintTiming("performing epipolar-based matching");
+  }
   return matches;
-//  std::vector<cv::DMatch> filtered_matches = filterMatchesWithLoweRatioTest(all_matches, ratio_test_threshold, verbose);
-//  return filtered_matches;
 }
 
 template <typename T>
@@ -0,0 +1,545 @@
+//==================================================
+// DepthFrameCodec.h
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 7, 2016
+//==================================================
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ait/common.h>
+
+namespace ait
+{
+
+namespace video
+{
+
+// Lossless codec for 16 bit depth frames.
+//
+// The frame is split into horizontal tiles that are encoded independently (and in parallel with OpenMP).
+// Each tile is encoded in two stages:
+//   1. Every pixel is predicted from its left, upper and upper-left neighbours (LOCO-I median predictor,
+//      the first row of a tile only uses the left neighbour). The residual is zigzag-mapped and written
+//      as a 1-3 byte varint so that the typical small residuals take a single byte.
+//   2. The varint stream is compressed with a byte-oriented LZ77 coder using the LZ4 block format which
+//      takes care of the long runs of invalid (zero) depth and repeated residual patterns.
+// Each tile falls back to the varint stream or the raw pixels if a stage does not reduce the size (i.e. noise).
+//
+// Encoded frame layout (little endian):
+//   FrameHeader | uint32_t encoded tile size [num_tiles] | tiles
+//   tile: uint32_t TileMode | uint32_t varint size | payload
+class DepthFrameCodec
+{
+public:
+	static const std::uint32_t MAGIC = 0x31435044; // "DPC1"
+	static const std::uint16_t VERSION = 1;
+	static const unsigned int DEFAULT_TILE_HEIGHT = 32;
+	// Frames with a larger width or height are rejected by the decoder
+	static const std::uint32_t MAX_FRAME_DIMENSION = 16384;
+
+	class Error : public std::runtime_error
+	{
+	public:
+		Error(const std::string &str)
+			: std::runtime_error(str) {
+		}
+	};
+
+	struct FrameHeader
+	{
+		std::uint32_t magic;
+		std::uint16_t version;
+		std::uint16_t reserved;
+		std::uint32_t width;
+		std::uint32_t height;
+		std::uint32_t tile_height;
+		std::uint32_t num_tiles;
+	};
+
+	DepthFrameCodec(unsigned int tile_height = DEFAULT_TILE_HEIGHT)
+		: tile_height_(tile_height) {
+		AIT_ASSERT(tile_height_ > 0);
+	}
+
+	unsigned int getTileHeight() const {
+		return tile_height_;
+	}
+
+	// Upper bound for the encoded size of a frame
+	size_t getMaxEncodedSize(size_t width, size_t height) const {
+		const size_t num_tiles = getNumTiles(height);
+		return sizeof(FrameHeader) + num_tiles * (sizeof(std::uint32_t) + TILE_HEADER_SIZE) + width * height * sizeof(std::uint16_t);
+	}
+
+	// Encode a frame. row_stride is given in number of elements.
+	void encode(const std::uint16_t* data, size_t width, size_t height, size_t row_stride, std::vector<std::uint8_t>& output) const {
+		AIT_ASSERT(row_stride >= width);
+		const size_t num_tiles = getNumTiles(height);
+		FrameHeader header;
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.reserved = 0;
+		header.width = static_cast<std::uint32_t>(width);
+		header.height = static_cast<std::uint32_t>(height);
+		header.tile_height = tile_height_;
+		header.num_tiles = static_cast<std::uint32_t>(num_tiles);
+
+		std::vector<std::vector<std::uint8_t>> encoded_tiles(num_tiles);
+#pragma omp parallel
+		{
+			std::vector<std::uint8_t> varint_buffer;
+			std::vector<std::uint32_t> hash_table;
+#pragma omp for schedule(dynamic)
+			for (int tile = 0; tile < static_cast<int>(num_tiles); ++tile) {
+				const size_t row_begin = tile * tile_height_;
+				const size_t row_end = std::min(row_begin + tile_height_, height);
+				encodeTile(data + row_begin * row_stride, width, row_end - row_begin, row_stride,
+					varint_buffer, hash_table, encoded_tiles[tile]);
+			}
+		}
+
+		size_t total_size = sizeof(FrameHeader) + num_tiles * sizeof(std::uint32_t);
+		for (const std::vector<std::uint8_t>& encoded_tile : encoded_tiles) {
+			total_size += encoded_tile.size();
+		}
+		output.resize(total_size);
+		std::uint8_t* out = output.data();
+		std::memcpy(out, &header, sizeof(FrameHeader));
+		out += sizeof(FrameHeader);
+		for (const std::vector<std::uint8_t>& encoded_tile : encoded_tiles) {
+			writeUint32(out, static_cast<std::uint32_t>(encoded_tile.size()));
+			out += sizeof(std::uint32_t);
+		}
+		for (const std::vector<std::uint8_t>& encoded_tile : encoded_tiles) {
+			std::memcpy(out, encoded_tile.data(), encoded_tile.size());
+			out += encoded_tile.size();
+		}
+	}
+
+	// Decode a frame into a continuous buffer of width * height elements
+	void decode(const std::uint8_t* data, size_t size, std::vector<std::uint16_t>& output, size_t* width, size_t* height) const {
+		const FrameHeader header = readHeader(data, size);
+		const size_t num_tiles = header.num_tiles;
+		const std::uint8_t* tile_sizes = data + sizeof(FrameHeader);
+		std::vector<size_t> tile_offsets(num_tiles + 1);
+		tile_offsets[0] = sizeof(FrameHeader) + num_tiles * sizeof(std::uint32_t);
+		for (size_t tile = 0; tile < num_tiles; ++tile) {
+			tile_offsets[tile + 1] = tile_offsets[tile] + readUint32(tile_sizes + tile * sizeof(std::uint32_t));
+		}
+		if (tile_offsets[num_tiles] > size) {
+			throw ANNOTATE_EXC(Error, "Encoded depth frame is truncated");
+		}
+		// Every tile has to be able to hold its pixels before the output buffer is sized from the header.
+		// A pixel takes at least one varint byte and the LZ stage expands by less than LZ_MAX_EXPANSION.
+		for (size_t tile = 0; tile < num_tiles; ++tile) {
+			const size_t tile_size = tile_offsets[tile + 1] - tile_offsets[tile];
+			const size_t row_begin = tile * header.tile_height;
+			const size_t row_end = std::min<size_t>(row_begin + header.tile_height, header.height);
+			if (tile_size < TILE_HEADER_SIZE
+				|| (row_end - row_begin) * header.width > LZ_MAX_EXPANSION * (tile_size - TILE_HEADER_SIZE)) {
+				throw ANNOTATE_EXC(Error, "Encoded depth frame does not match its header");
+			}
+		}
+
+		output.resize(static_cast<size_t>(header.width) * header.height);
+		bool success = true;
+#pragma omp parallel
+		{
+			std::vector<std::uint8_t> varint_buffer;
+#pragma omp for schedule(dynamic)
+			for (int tile = 0; tile < static_cast<int>(num_tiles); ++tile) {
+				const size_t row_begin = tile * header.tile_height;
+				const size_t row_end = std::min<size_t>(row_begin + header.tile_height, header.height);
+				const bool tile_success = decodeTile(data + tile_offsets[tile], tile_offsets[tile + 1] - tile_offsets[tile],
+					header.width, row_end - row_begin, varint_buffer, output.data() + row_begin * header.width);
+				if (!tile_success) {
+#pragma omp critical
+					success = false;
+				}
+			}
+		}
+		if (!success) {
+			throw ANNOTATE_EXC(Error, "Encoded depth frame is corrupted");
+		}
+		*width = header.width;
+		*height = header.height;
+	}
+
+	// Read and validate the header of an encoded frame
+	static FrameHeader readHeader(const std::uint8_t* data, size_t size) {
+		FrameHeader header;
+		if (size < sizeof(FrameHeader)) {
+			throw ANNOTATE_EXC(Error, "Encoded depth frame is too small");
+		}
+		std::memcpy(&header, data, sizeof(FrameHeader));
+		if (header.magic != MAGIC || header.version != VERSION) {
+			throw ANNOTATE_EXC(Error, "Invalid depth frame header");
+		}
+		if (header.width > MAX_FRAME_DIMENSION || header.height > MAX_FRAME_DIMENSION) {
+			throw ANNOTATE_EXC(Error, "Depth frame dimensions exceed the maximum");
+		}
+		if (header.tile_height == 0
+			|| header.num_tiles != (header.height + header.tile_height - 1) / header.tile_height
+			|| size < sizeof(FrameHeader) + static_cast<size_t>(header.num_tiles) * sizeof(std::uint32_t)) {
+			throw ANNOTATE_EXC(Error, "Inconsistent depth frame header");
+		}
+		return header;
+	}
+
+private:
+	enum TileMode : std::uint32_t {
+		TILE_RAW = 0,
+		TILE_VARINT = 1,
+		TILE_VARINT_LZ = 2,
+	};
+
+	static const size_t TILE_HEADER_SIZE = 2 * sizeof(std::uint32_t);
+
+	// LZ parameters (same as LZ4 so that the end of block rules are compatible)
+	static const size_t LZ_MIN_MATCH = 4;
+	static const size_t LZ_LAST_LITERALS = 5;
+	static const size_t LZ_MATCH_FIND_LIMIT = 12;
+	static const size_t LZ_MAX_OFFSET = 65535;
+	// Upper bound of decompressed / compressed size (a match byte adds at most 255 bytes of output)
+	static const size_t LZ_MAX_EXPANSION = 255;
+	static const unsigned int LZ_HASH_BITS = 14;
+
+	size_t getNumTiles(size_t height) const {
+		return (height + tile_height_ - 1) / tile_height_;
+	}
+
+	static void writeUint32(std::uint8_t* out, std::uint32_t value) {
+		out[0] = static_cast<std::uint8_t>(value);
+		out[1] = static_cast<std::uint8_t>(value >> 8);
+		out[2] = static_cast<std::uint8_t>(value >> 16);
+		out[3] = static_cast<std::uint8_t>(value >> 24);
+	}
+
+	static std::uint32_t readUint32(const std::uint8_t* in) {
+		return static_cast<std::uint32_t>(in[0])
+			| (static_cast<std::uint32_t>(in[1]) << 8)
+			| (static_cast<std::uint32_t>(in[2]) << 16)
+			| (static_cast<std::uint32_t>(in[3]) << 24);
+	}
+
+	static std::uint16_t predict(std::uint16_t left, std::uint16_t up, std::uint16_t up_left) {
+		const std::uint16_t min_value = std::min(left, up);
+		const std::uint16_t max_value = std::max(left, up);
+		if (up_left >= max_value) {
+			return min_value;
+		}
+		else if (up_left <= min_value) {
+			return max_value;
+		}
+		return static_cast<std::uint16_t>(left + up - up_left);
+	}
+
+	// Computes the prediction for pixel x of a row. prev_row is nullptr for the first row of a tile.
+	static std::uint16_t predictPixel(const std::uint16_t* row, const std::uint16_t* prev_row, size_t x) {
+		if (prev_row == nullptr) {
+			return x > 0 ? row[x - 1] : 0;
+		}
+		if (x == 0) {
+			return prev_row[0];
+		}
+		return predict(row[x - 1], prev_row[x], prev_row[x - 1]);
+	}
+
+	static std::uint8_t* writeVarint(std::uint8_t* out, std::uint16_t value) {
+		if (value < 0x80) {
+			*out++ = static_cast<std::uint8_t>(value);
+		}
+		else if (value < 0x4000) {
+			*out++ = static_cast<std::uint8_t>(value | 0x80);
+			*out++ = static_cast<std::uint8_t>(value >> 7);
+		}
+		else {
+			*out++ = static_cast<std::uint8_t>(value | 0x80);
+			*out++ = static_cast<std::uint8_t>((value >> 7) | 0x80);
+			*out++ = static_cast<std::uint8_t>(value >> 14);
+		}
+		return out;
+	}
+
+	static std::uint16_t zigzagEncode(std::uint16_t value, std::uint16_t prediction) {
+		const std::int16_t residual = static_cast<std::int16_t>(static_cast<std::uint16_t>(value - prediction));
+		return static_cast<std::uint16_t>((static_cast<std::uint16_t>(residual) << 1) ^ static_cast<std::uint16_t>(residual >> 15));
+	}
+
+	static std::uint16_t zigzagDecode(std::uint16_t code, std::uint16_t prediction) {
+		const std::uint16_t residual = static_cast<std::uint16_t>((code >> 1) ^ (~(code & 1) + 1));
+		return static_cast<std::uint16_t>(prediction + residual);
+	}
+
+	void encodeTile(const std::uint16_t* data, size_t width, size_t rows, size_t row_stride,
+			std::vector<std::uint8_t>& varint_buffer, std::vector<std::uint32_t>& hash_table,
+			std::vector<std::uint8_t>& output) const {
+		varint_buffer.resize(3 * width * rows);
+		std::uint8_t* out = varint_buffer.data();
+		const std::uint16_t* prev_row = nullptr;
+		for (size_t y = 0; y < rows; ++y) {
+			const std::uint16_t* row = data + y * row_stride;
+			for (size_t x = 0; x < width; ++x) {
+				out = writeVarint(out, zigzagEncode(row[x], predictPixel(row, prev_row, x)));
+			}
+			prev_row = row;
+		}
+		const size_t varint_size = out - varint_buffer.data();
+		const size_t raw_size = width * rows * sizeof(std::uint16_t);
+
+		TileMode mode = TILE_VARINT_LZ;
+		output.resize(TILE_HEADER_SIZE + getMaxLZSize(varint_size));
+		size_t payload_size = compressLZ(varint_buffer.data(), varint_size, hash_table, output.data() + TILE_HEADER_SIZE);
+		if (payload_size >= varint_size) {
+			mode = TILE_VARINT;
+			payload_size = varint_size;
+			std::memcpy(output.data() + TILE_HEADER_SIZE, varint_buffer.data(), varint_size);
+		}
+		if (payload_size >= raw_size) {
+			mode = TILE_RAW;
+			payload_size = raw_size;
+			output.resize(TILE_HEADER_SIZE + raw_size);
+			std::uint8_t* raw_out = output.data() + TILE_HEADER_SIZE;
+			for (size_t y = 0; y < rows; ++y) {
+				const std::uint16_t* row = data + y * row_stride;
+				for (size_t x = 0; x < width; ++x) {
+					*raw_out++ = static_cast<std::uint8_t>(row[x]);
+					*raw_out++ = static_cast<std::uint8_t>(row[x] >> 8);
+				}
+			}
+		}
+		output.resize(TILE_HEADER_SIZE + payload_size);
+		writeUint32(output.data(), mode);
+		writeUint32(output.data() + sizeof(std::uint32_t), static_cast<std::uint32_t>(varint_size));
+	}
+
+	bool decodeTile(const std::uint8_t* data, size_t size, size_t width, size_t rows,
+			std::vector<std::uint8_t>& varint_buffer, std::uint16_t* output) const {
+		if (size < TILE_HEADER_SIZE) {
+			return false;
+		}
+		const std::uint32_t mode = readUint32(data);
+		const size_t varint_size = readUint32(data + sizeof(std::uint32_t));
+		const std::uint8_t* payload = data + TILE_HEADER_SIZE;
+		const size_t payload_size = size - TILE_HEADER_SIZE;
+		const std::uint8_t* in;
+		if (mode == TILE_RAW) {
+			if (payload_size != width * rows * sizeof(std::uint16_t)) {
+				return false;
+			}
+			for (size_t i = 0; i < width * rows; ++i) {
+				output[i] = static_cast<std::uint16_t>(payload[2 * i] | (payload[2 * i + 1] << 8));
+			}
+			return true;
+		}
+		else if (mode == TILE_VARINT) {
+			if (payload_size != varint_size) {
+				return false;
+			}
+			in = payload;
+		}
+		else if (mode == TILE_VARINT_LZ) {
+			if (varint_size > 3 * width * rows) {
+				return false;
+			}
+			varint_buffer.resize(varint_size);
+			if (!decompressLZ(payload, payload_size, varint_buffer.data(), varint_size)) {
+				return false;
+			}
+			in = varint_buffer.data();
+		}
+		else {
+			return false;
+		}
+
+		const std::uint8_t* in_end = in + varint_size;
+		const std::uint16_t* prev_row = nullptr;
+		for (size_t y = 0; y < rows; ++y) {
+			std::uint16_t* row = output + y * width;
+			for (size_t x = 0; x < width; ++x) {
+				if (in == in_end) {
+					return false;
+				}
+				std::uint16_t code = *in++;
+				if (code & 0x80) {
+					if (in == in_end) {
+						return false;
+					}
+					code = (code & 0x7F) | (static_cast<std::uint16_t>(*in & 0x7F) << 7);
+					if (*in++ & 0x80) {
+						if (in == in_end) {
+							return false;
+						}
+						code |= static_cast<std::uint16_t>(*in++) << 14;
+					}
+				}
+				row[x] = zigzagDecode(code, predictPixel(row, prev_row, x));
+			}
+			prev_row = row;
+		}
+		return in == in_end;
+	}
+
+	static size_t getMaxLZSize(size_t input_size) {
+		return input_size + input_size / 255 + 16;
+	}
+
+	static std::uint32_t readLZWord(const std::uint8_t* ptr) {
+		std::uint32_t value;
+		std::memcpy(&value, ptr, sizeof(value));
+		return value;
+	}
+
+	static std::uint32_t hashLZWord(std::uint32_t word) {
+		return (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+	}
+
+	static std::uint8_t* writeLZLength(std::uint8_t* out, size_t length) {
+		while (length >= 255) {
+			*out++ = 255;
+			length -= 255;
+		}
+		*out++ = static_cast<std::uint8_t>(length);
+		return out;
+	}
+
+	static std::uint8_t* writeLZSequence(std::uint8_t* out, const std::uint8_t* literals, size_t literal_length,
+			size_t offset, size_t match_length) {
+		std::uint8_t* token = out++;
+		*token = static_cast<std::uint8_t>(std::min<size_t>(literal_length, 15) << 4);
+		if (literal_length >= 15) {
+			out = writeLZLength(out, literal_length - 15);
+		}
+		std::memcpy(out, literals, literal_length);
+		out += literal_length;
+		if (match_length > 0) {
+			*out++ = static_cast<std::uint8_t>(offset);
+			*out++ = static_cast<std::uint8_t>(offset >> 8);
+			const size_t length_code = match_length - LZ_MIN_MATCH;
+			*token |= static_cast<std::uint8_t>(std::min<size_t>(length_code, 15));
+			if (length_code >= 15) {
+				out = writeLZLength(out, length_code - 15);
+			}
+		}
+		return out;
+	}
+
+	// Greedy single-probe LZ77 in the LZ4 block format. Returns the compressed size.
+	static size_t compressLZ(const std::uint8_t* input, size_t input_size, std::vector<std::uint32_t>& hash_table, std::uint8_t* output) {
+		std::uint8_t* out = output;
+		const std::uint8_t* anchor = input;
+		if (input_size > LZ_MATCH_FIND_LIMIT) {
+			hash_table.assign(size_t(1) << LZ_HASH_BITS, 0);
+			const std::uint8_t* match_limit = input + input_size - LZ_LAST_LITERALS;
+			const std::uint8_t* ip = input + 1;
+			const std::uint8_t* const ip_limit = input + input_size - LZ_MATCH_FIND_LIMIT;
+			hash_table[hashLZWord(readLZWord(input))] = 0;
+			while (ip < ip_limit) {
+				const std::uint32_t word = readLZWord(ip);
+				std::uint32_t& entry = hash_table[hashLZWord(word)];
+				const std::uint8_t* candidate = input + entry;
+				entry = static_cast<std::uint32_t>(ip - input);
+				if (candidate >= ip || static_cast<size_t>(ip - candidate) > LZ_MAX_OFFSET || readLZWord(candidate) != word) {
+					++ip;
+					continue;
+				}
+				// Extend the match backwards over pending literals and forwards up to the limit
+				while (ip > anchor && candidate > input && ip[-1] == candidate[-1]) {
+					--ip;
+					--candidate;
+				}
+				const std::uint8_t* match_end = ip + LZ_MIN_MATCH;
+				const std::uint8_t* candidate_end = candidate + LZ_MIN_MATCH;
+				while (match_end < match_limit && *match_end == *candidate_end) {
+					++match_end;
+					++candidate_end;
+				}
+				out = writeLZSequence(out, anchor, ip - anchor, ip - candidate, match_end - ip);
+				// Keep the hash table warm inside of long matches
+				if (match_end - 2 > input && match_end < ip_limit) {
+					hash_table[hashLZWord(readLZWord(match_end - 2))] = static_cast<std::uint32_t>(match_end - 2 - input);
+				}
+				ip = match_end;
+				anchor = ip;
+			}
+		}
+		out = writeLZSequence(out, anchor, input + input_size - anchor, 0, 0);
+		return out - output;
+	}
+
+	static bool readLZLength(const std::uint8_t*& in, const std::uint8_t* in_end, size_t& length) {
+		std::uint8_t value;
+		do {
+			if (in == in_end) {
+				return false;
+			}
+			value = *in++;
+			length += value;
+		} while (value == 255);
+		return true;
+	}
+
+	static bool decompressLZ(const std::uint8_t* input, size_t input_size, std::uint8_t* output, size_t output_size) {
+		const std::uint8_t* in = input;
+		const std::uint8_t* const in_end = input + input_size;
+		std::uint8_t* out = output;
+		std::uint8_t* const out_end = output + output_size;
+		while (in < in_end) {
+			const std::uint8_t token = *in++;
+			size_t literal_length = token >> 4;
+			if (literal_length == 15 && !readLZLength(in, in_end, literal_length)) {
+				return false;
+			}
+			if (literal_length > static_cast<size_t>(in_end - in) || literal_length > static_cast<size_t>(out_end - out)) {
+				return false;
+			}
+			std::memcpy(out, in, literal_length);
+			in += literal_length;
+			out += literal_length;
+			if (in == in_end) {
+				// The last sequence only contains literals
+				break;
+			}
+			if (in_end - in < 2) {
+				return false;
+			}
+			const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+			in += 2;
+			size_t match_length = token & 15;
+			if (match_length == 15 && !readLZLength(in, in_end, match_length)) {
+				return false;
+			}
+			match_length += LZ_MIN_MATCH;
+			if (offset == 0 || offset > static_cast<size_t>(out - output) || match_length > static_cast<size_t>(out_end - out)) {
+				return false;
+			}
+			const std::uint8_t* match = out - offset;
+			if (offset >= match_length) {
+				std::memcpy(out, match, match_length);
+				out += match_length;
+			}
+			else {
+				// Overlapping match (i.e. a run)
+				for (size_t i = 0; i < match_length; ++i) {
+					*out++ = *match++;
+				}
+			}
+		}
+		return out == out_end;
+	}
+
+	unsigned int tile_height_;
+};
+
+}
+
+}
@@ -14,6 +14,8 @@
 #include <atomic>
 #include <mutex>
 #include <string>
+#include <deque>
+#include <tuple>
 #include <condition_variable>
 
 #include <gst/gst.h>
@@ -23,6 +25,7 @@
 #include <ait/common.h>
 
 #include "GstMetaCorrespondence.h"
+#include "SPSCFixedQueue.h"
 
 #define FUNCTION_LINE_STRING (std::string(__FILE__) + " [" + std::string(__FUNCTION__) + ":" + std::to_string(__LINE__) + "]")
 #define ANNOTATE_EXC(type, s) type (std::string(FUNCTION_LINE_STRING).append(": ").append(s))
@@ -266,105 +269,6 @@ protected:
 	}
 };
 
-template <typename T>
-class SPSCFixedQueue
-{
-public:
-	SPSCFixedQueue(unsigned int max_queue_size = 5)
-		: max_queue_size_(max_queue_size), discard_everything_(false) {
-	}
-
-	void setDiscardEverything(bool discard_everything) {
-		discard_everything_ = discard_everything;
-	}
-
-	unsigned int getMaxQueueSize() const {
-		return max_queue_size_;
-	}
-
-	bool empty() const {
-		return queue_.empty();
-	}
-
-	size_t size() const {
-		return queue_.size();
-	}
-
-	void clear() {
-		queue_.clear();
-	}
-
-	template <typename TMutex>
-	T popFront(const std::unique_lock<TMutex>& lock) {
-		if (!lock) {
-			throw ANNOTATE_EXC(std::runtime_error, "Lock has not been acquired");
-		}
-		return popFrontWithoutLocking();
-	}
-
-	template <typename TMutex>
-	T popFront(const std::lock_guard<TMutex>& lock) {
-		return popFrontWithoutLocking();
-	}
-
-	T popFront() {
-		std::lock_guard<std::mutex> lock(mutex_);
-		return popFrontWithoutLocking();
-	}
-
-	std::mutex& getMutex() {
-		return mutex_;
-	}
-
-	std::condition_variable& getQueueFilledCondition() {
-		return queue_filled_condition_;
-	}
-
-	bool pushBack(T& element, bool block = false) {
-		if (block) {
-			std::unique_lock<std::mutex> lock(mutex_);
-			while (queue_.size() >= max_queue_size_ && !discard_everything_) {
-				queue_space_available_condition_.wait_for(lock, std::chrono::milliseconds(100),
-					[&]() { return queue_.size() < max_queue_size_ || discard_everything_; });
-			}
-			if (discard_everything_) {
-				return false;
-			}
-			queue_.push_back(std::move(element));
-			queue_filled_condition_.notify_one();
-			return true;
-		}
-		else {
-			if (queue_.size() < max_queue_size_) {
-				{
-					std::lock_guard<std::mutex> lock(mutex_);
-					queue_.push_back(std::move(element));
-				}
-				queue_filled_condition_.notify_one();
-				return true;
-			}
-			else {
-				return false;
-			}
-		}
-	}
-
-private:
-	T popFrontWithoutLocking() {
-		T element(std::move(queue_.front()));
-		queue_.pop_front();
-		queue_space_available_condition_.notify_one();
-		return element;
-	}
-
-	std::deque<T> queue_;
-	unsigned int max_queue_size_;
-	std::mutex mutex_;
-	std::condition_variable queue_filled_condition_;
-	std::condition_variable queue_space_available_condition_;
-	std::atomic<bool> discard_everything_;
-};
-
 template <typename TUserData>
 class GstreamerPipeline;
 
@@ -679,28 +583,17 @@ public:
 		return appsrcsink_queue_.size();
 	}
 
-	template <typename TMutex>
-	OutputTupleType popOutput(const std::unique_lock<TMutex>& lock) {
-		return appsrcsink_queue_.popFront(lock);
-	}
-
-	template <typename TMutex>
-	OutputTupleType popOutput(const std::lock_guard<TMutex>& lock) {
-		return appsrcsink_queue_.popFront(lock);
+	// Wait until output is available. Returns false on timeout or when the pipeline is stopped.
+	template <typename Rep, typename Period>
+	bool waitForOutput(const std::chrono::duration<Rep, Period>& timeout) {
+		return appsrcsink_queue_.waitForElement(timeout);
 	}
 
+	// Must only be called from a single consumer thread
 	OutputTupleType popOutput() {
 		return appsrcsink_queue_.popFront();
 	}
 
-	std::mutex& getMutex() {
-		return appsrcsink_queue_.getMutex();
-	}
-
-	std::condition_variable& getOutputCondition() {
-		return appsrcsink_queue_.getQueueFilledCondition();
-	}
-
 	bool pushInput(GstBufferWrapper& buffer, const TUserData& user_data) {
 		ensureInitialized();
 		AIT_ASSERT(GST_IS_BUFFER(buffer.get()));
@@ -760,10 +653,11 @@ public:
 
 	void start() {
 		ensureInitialized();
-		appsrcsink_queue_.clear();
 		if (message_thread_.joinable()) {
 			stop();
 		}
+		// The appsink is idle now so the queue can be cleared from this side
+		appsrcsink_queue_.clear();
 		appsrcsink_queue_.setDiscardEverything(false);
 		terminate_ = false;
 		// Start playing
@@ -0,0 +1,334 @@
+//==================================================
+// SPSCFixedQueue.h
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 7, 2016
+//==================================================
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#include <ait/common.h>
+
+namespace ait {
+
+#ifndef AIT_CACHE_LINE_SIZE
+#define AIT_CACHE_LINE_SIZE 64
+#endif
+
+// Event count for blocking on lock-free data structures with a single waiting thread.
+// The waiter reads the current key with prepareWait(), re-checks its condition and then calls wait(key).
+// Any notify() after prepareWait() makes wait() return. Notifying is only a fence and a load unless
+// the thread is actually waiting, in which case a single futex wake (or condition variable) is used.
+class EventCount
+{
+public:
+	EventCount()
+		: key_(0), waiting_(false) {
+	}
+
+	EventCount(const EventCount&) = delete;
+	void operator=(const EventCount&) = delete;
+
+	std::uint32_t prepareWait() {
+		waiting_.store(true, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return key_.load(std::memory_order_seq_cst);
+	}
+
+	void cancelWait() {
+		waiting_.store(false, std::memory_order_relaxed);
+	}
+
+	// Returns false on timeout
+	bool wait(const std::uint32_t key, const std::chrono::microseconds timeout) {
+		bool notified = true;
+		if (key_.load(std::memory_order_seq_cst) == key) {
+#if defined(__linux__)
+			struct timespec ts;
+			ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+			ts.tv_nsec = static_cast<long>((timeout.count() % 1000000) * 1000);
+			syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&key_),
+				FUTEX_WAIT_PRIVATE, key, &ts, nullptr, 0);
+			notified = key_.load(std::memory_order_seq_cst) != key;
+#else
+			std::unique_lock<std::mutex> lock(mutex_);
+			notified = condition_.wait_for(lock, timeout, [&]() {
+				return key_.load(std::memory_order_seq_cst) != key;
+			});
+#endif
+		}
+		waiting_.store(false, std::memory_order_relaxed);
+		return notified;
+	}
+
+	// The fence orders the caller's preceding state change before reading the waiting flag.
+	// Either the waiter sees the new state when it re-checks its condition or we see the waiter here.
+	// Clearing the flag ensures that only the first notification after prepareWait() pays for a wake.
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting_.load(std::memory_order_relaxed) && waiting_.exchange(false, std::memory_order_seq_cst)) {
+			key_.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+			syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&key_),
+				FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+			}
+			condition_.notify_one();
+#endif
+		}
+	}
+
+	// Wake the waiter even if it has not registered yet (i.e. for shutdown)
+	void forceNotify() {
+		waiting_.store(true, std::memory_order_seq_cst);
+		notify();
+	}
+
+private:
+	static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "Futex requires a plain 32 bit atomic");
+
+	std::atomic<std::uint32_t> key_;
+	std::atomic<bool> waiting_;
+#if !defined(__linux__)
+	std::mutex mutex_;
+	std::condition_variable condition_;
+#endif
+};
+
+// Wait-free single-producer/single-consumer ring buffer.
+// Storage for the slots is allocated once with a power-of-two size so that no allocation happens per element
+// and elements only need to be move-constructible. The producer and consumer indices live on separate cache
+// lines and each side keeps a cached copy of the other index to avoid cache line transfers on every operation.
+// Blocking push and pop are optional and implemented with event counts that are only touched when a thread waits.
+template <typename T>
+class SPSCFixedQueue
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	SPSCFixedQueue(unsigned int max_queue_size = 5)
+		: max_queue_size_(max_queue_size),
+		capacity_(roundUpToPowerOfTwo(max_queue_size)), mask_(capacity_ - 1),
+		slots_(new Slot[capacity_]),
+		head_(0), cached_tail_(0), tail_(0), cached_head_(0),
+		discard_everything_(false),
+		// Spinning only helps if producer and consumer can run at the same time
+		num_spin_iterations_(std::thread::hardware_concurrency() > 1 ? 1000 : 0) {
+		AIT_ASSERT(max_queue_size_ > 0);
+	}
+
+	SPSCFixedQueue(const SPSCFixedQueue&) = delete;
+	void operator=(const SPSCFixedQueue&) = delete;
+
+	~SPSCFixedQueue() {
+		clear();
+	}
+
+	// Discarding wakes up and rejects blocked producers. A waiting consumer keeps waiting for elements.
+	void setDiscardEverything(bool discard_everything) {
+		discard_everything_ = discard_everything;
+		not_full_event_.forceNotify();
+	}
+
+	unsigned int getMaxQueueSize() const {
+		return max_queue_size_;
+	}
+
+	size_t getCapacity() const {
+		return capacity_;
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	size_t size() const {
+		const size_t head = head_.load(std::memory_order_acquire);
+		const size_t tail = tail_.load(std::memory_order_acquire);
+		return tail - head;
+	}
+
+	// Must only be called by the consumer or while the producer is idle
+	void clear() {
+		while (!empty()) {
+			T element(popFront());
+		}
+	}
+
+	// Consumer: Remove the first element. The queue must not be empty.
+	T popFront() {
+		const size_t head = head_.load(std::memory_order_relaxed);
+		if (head == cached_tail_) {
+			cached_tail_ = tail_.load(std::memory_order_acquire);
+			AIT_ASSERT(head != cached_tail_);
+		}
+		T* element_ptr = slots_[head & mask_].ptr();
+		T element(std::move(*element_ptr));
+		element_ptr->~T();
+		head_.store(head + 1, std::memory_order_release);
+		not_full_event_.notify();
+		return element;
+	}
+
+	// Consumer: Wait until an element is available. Returns false on timeout.
+	template <typename Rep, typename Period>
+	bool waitForElement(const std::chrono::duration<Rep, Period>& timeout) {
+		const bool abort_on_discard = false;
+		return waitUntil(not_empty_event_, timeout, abort_on_discard, [this]() {
+			return hasElementForConsumer();
+		});
+	}
+
+	// Producer: Never blocks
+	bool tryPushBack(T&& element) {
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - cached_head_ >= max_queue_size_) {
+			cached_head_ = head_.load(std::memory_order_acquire);
+			if (tail - cached_head_ >= max_queue_size_) {
+				return false;
+			}
+		}
+		new (slots_[tail & mask_].storage()) T(std::move(element));
+		tail_.store(tail + 1, std::memory_order_release);
+		not_empty_event_.notify();
+		return true;
+	}
+
+	// Producer: Push element and optionally wait for free space. Returns false if the element was discarded.
+	bool pushBack(T& element, bool block = false) {
+		if (!block) {
+			return tryPushBack(std::move(element));
+		}
+		while (!discard_everything_) {
+			if (tryPushBack(std::move(element))) {
+				return true;
+			}
+			const bool abort_on_discard = true;
+			waitUntil(not_full_event_, std::chrono::milliseconds(100), abort_on_discard, [this]() {
+				return hasSpaceForProducer();
+			});
+		}
+		return false;
+	}
+
+private:
+	struct Slot {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+
+		void* storage() {
+			return &data;
+		}
+
+		T* ptr() {
+			return reinterpret_cast<T*>(&data);
+		}
+	};
+
+	static void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#else
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+	}
+
+	static size_t roundUpToPowerOfTwo(const size_t value) {
+		size_t power = 1;
+		while (power < value) {
+			power <<= 1;
+		}
+		return power;
+	}
+
+	bool hasElementForConsumer() const {
+		return head_.load(std::memory_order_relaxed) != tail_.load(std::memory_order_acquire);
+	}
+
+	bool hasSpaceForProducer() const {
+		return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire) < max_queue_size_;
+	}
+
+	// Returns false on timeout. If abort_on_discard is set discarding makes the wait return false immediately.
+	// Otherwise the wait is re-armed after any wake-up until the predicate holds or the timeout is reached.
+	template <typename Rep, typename Period, typename Predicate>
+	bool waitUntil(EventCount& event, const std::chrono::duration<Rep, Period>& timeout,
+			const bool abort_on_discard, Predicate&& predicate) {
+		// Spin for a short while before sleeping because a futex round trip costs more than a typical push
+		for (unsigned int i = 0; i < num_spin_iterations_; ++i) {
+			if (predicate()) {
+				return true;
+			}
+			cpuRelax();
+		}
+		const clock::time_point deadline = clock::now() + std::chrono::duration_cast<clock::duration>(timeout);
+		while (true) {
+			if (predicate()) {
+				return true;
+			}
+			if (abort_on_discard && discard_everything_) {
+				return false;
+			}
+			const std::uint32_t key = event.prepareWait();
+			if (predicate() || (abort_on_discard && discard_everything_)) {
+				event.cancelWait();
+				continue;
+			}
+			const clock::time_point now = clock::now();
+			if (now >= deadline) {
+				event.cancelWait();
+				return predicate();
+			}
+			event.wait(key, std::chrono::duration_cast<std::chrono::microseconds>(deadline - now));
+		}
+	}
+
+	const unsigned int max_queue_size_;
+	const size_t capacity_;
+	const size_t mask_;
+	std::unique_ptr<Slot[]> slots_;
+
+	// Padding instead of alignas so that the queue can be heap-allocated without over-aligned new
+	char padding0_[AIT_CACHE_LINE_SIZE];
+	// Consumer side
+	std::atomic<size_t> head_;
+	size_t cached_tail_;
+	char padding1_[AIT_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+	// Producer side
+	std::atomic<size_t> tail_;
+	size_t cached_head_;
+	char padding2_[AIT_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+	// The events are written by different sides so they are kept on separate cache lines as well
+	EventCount not_empty_event_;
+	char padding3_[AIT_CACHE_LINE_SIZE - sizeof(EventCount) % AIT_CACHE_LINE_SIZE];
+	EventCount not_full_event_;
+	char padding4_[AIT_CACHE_LINE_SIZE - sizeof(EventCount) % AIT_CACHE_LINE_SIZE];
+	std::atomic<bool> discard_everything_;
+	const unsigned int num_spin_iterations_;
+};
+
+}
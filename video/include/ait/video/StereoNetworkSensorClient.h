@@ -8,7 +8,9 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <string>
 #include <opencv2/core.hpp>
 #include <ait/video/StereoNetworkSensorProtocol.h>
 #include <gst/gst.h>
@@ -51,6 +53,22 @@ public:
 		network_client_->sendDataBlocking(stereo_initialization);
 	}
 
+	//! Waits for the capabilities reply of the server.
+	//! Returns false if none arrived within the timeout (old servers never send one).
+	template <typename Rep, typename Period>
+	bool receiveServerCapabilities(StereoServerCapabilities& capabilities, const std::chrono::duration<Rep, Period>& timeout) {
+		if (!network_client_->waitForData(sizeof(StereoPacketHeader), timeout)) {
+			return false;
+		}
+		StereoPacketHeader header;
+		network_client_->receiveDataBlocking(reinterpret_cast<uint8_t*>(&header), sizeof(header));
+		if (header.packet_type != StereoPacketType::SERVER_2_CLIENT_CAPABILITIES) {
+			throw typename TNetworkClient::Error(std::string("Unexpected packet from server: ") + std::to_string(static_cast<int>(header.packet_type)));
+		}
+		network_client_->receiveDataBlocking(capabilities);
+		return true;
+	}
+
 	void sendGstreamerData(GstBufferWrapper& buffer, const TUserData& user_data) {
 		StereoPacketHeader packet_header;
 		packet_header.client_type = client_type_;
@@ -80,6 +98,18 @@ public:
 		network_client_->sendDataBlocking(buffer.getData(), buffer.getSize());
 	}
 
+	void sendDepthFrame(const StereoDepthFrameInfo& depth_frame_info, const std::vector<uint8_t>& encoded_depth_frame, size_t decoded_size) {
+		StereoPacketHeader packet_header;
+		packet_header.client_type = client_type_;
+		packet_header.packet_type = StereoPacketType::CLIENT_2_SERVER_DEPTH_FRAME;
+		packet_header.packet_size = encoded_depth_frame.size();
+		packet_header.packet_size_decompressed = decoded_size;
+		network_client_->sendDataBlocking(packet_header);
+
+		network_client_->sendDataBlocking(depth_frame_info);
+		network_client_->sendDataBlocking(encoded_depth_frame.data(), encoded_depth_frame.size());
+	}
+
 	void sendGstreamerParameters(GstCapsWrapper gst_caps, const TUserParameters& user_parameters) {
 		StereoPacketHeader packet_header;
 		packet_header.client_type = client_type_;
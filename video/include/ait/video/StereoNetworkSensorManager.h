@@ -16,6 +16,7 @@
 #include <ait/video/StereoNetworkSensorClient.h>
 #include <ait/video/StereoNetworkSensorProtocol.h>
 #include <ait/video/EncodingGstreamerPipeline.h>
+#include <ait/video/DepthFrameCodec.h>
 
 namespace ait
 {
@@ -28,20 +29,32 @@ namespace ait
 			using clock = std::chrono::system_clock;
 
 			const std::chrono::seconds CONNECTION_ATTEMPT_TIMEOUT = std::chrono::seconds(2);
+			// Servers without depth frame support never reply to the initialization packet
+			const std::chrono::milliseconds SERVER_CAPABILITIES_TIMEOUT = std::chrono::milliseconds(1000);
 			const uint8_t DEPTH_UINT8_TRUNCATION_THRESHOLD = 5;
 
 			const unsigned int NUMBER_OF_VALIDATION_PIXELS_PER_IMAGE = 1000;
+			const float DEPTH_UINT16_SCALE = 1000;
 
-            using PipelineUserDataType = std::tuple<StereoFrameInfo, StereoFrameLocationInfo>;
+            using NetworkUserDataType = std::tuple<StereoFrameInfo, StereoFrameLocationInfo>;
+            struct EncodedDepthFrame {
+                StereoDepthFrameInfo info;
+                std::vector<uint8_t> data;
+                size_t decoded_size;
+            };
+            // The encoded depth frame is passed along with the frame through the pipeline but sent in its own packet
+            using PipelineUserDataType = std::tuple<NetworkUserDataType, std::shared_ptr<const EncodedDepthFrame>>;
 
 		public:
 			StereoNetworkSensorManager(const StereoCalibration& stereo_calibration, const StereoClientType& client_type, const std::string& remote_ip, unsigned int remote_port)
 				: pipeline_initialized_(false),
 				stereo_calibration_(stereo_calibration),
+				use_compression_(false),
 				network_client_(std::make_shared<TNetworkClient>()),
 				stereo_sensor_client_(network_client_, client_type),
 				remote_ip_(remote_ip), remote_port_(remote_port) {
 				terminate_ = false;
+				depth_frames_accepted_ = false;
 				pipeline_.setStateChangeCallback(std::bind(&StereoNetworkSensorManager::stateChangeCallback, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 				initializeValidationPixelLocations();
 			}
@@ -71,6 +84,7 @@ namespace ait
 				return pipeline_;
 			}
 
+			//! Additionally send the lossless 16 bit depth frame with DepthFrameCodec
 			void setUseCompression(bool use_compression) {
 				use_compression_ = use_compression;
 			}
@@ -127,7 +141,11 @@ namespace ait
                 frame_info.timestamp = timestamp;
                 const cv::Mat& merged_frame = processFrames(left_frame, right_frame, depth_frame, frame_info);
 
-                return pipeline_.pushInput(merged_frame, std::make_tuple(frame_info, location_info));
+                std::shared_ptr<const EncodedDepthFrame> encoded_depth_frame;
+                if (use_compression_ && depth_frames_accepted_) {
+                    encoded_depth_frame = encodeDepthFrame(timestamp, depth_frame);
+                }
+                return pipeline_.pushInput(merged_frame, std::make_tuple(std::make_tuple(frame_info, location_info), encoded_depth_frame));
             }
 
 		protected:
@@ -136,6 +154,7 @@ namespace ait
 					try {
 					    // Ensure connection is closed
 					    network_client_->close();
+					    depth_frames_accepted_ = false;
 						std::cout << "Trying to establish connection ..." << std::endl;
 						//network_client_->open(remote_ip_, remote_port_);
 						clock::time_point connect_start = clock::now();
@@ -162,20 +181,31 @@ namespace ait
 						stereo_initilization.client_type = StereoClientType::CLIENT_ZED;
 						stereo_initilization.calibration = stereo_calibration_;
 						stereo_sensor_client_.sendInitialization(stereo_initilization);
+						if (use_compression_) {
+							StereoServerCapabilities server_capabilities;
+							if (!stereo_sensor_client_.receiveServerCapabilities(server_capabilities, SERVER_CAPABILITIES_TIMEOUT)) {
+								std::cout << "Server did not announce its capabilities. Sending Gstreamer frames only." << std::endl;
+							}
+							else if (!server_capabilities.supportsDepthCodec(StereoDepthCodec::PREDICTIVE_LZ)) {
+								std::cout << "Server does not support lossless depth frames. Sending Gstreamer frames only." << std::endl;
+							}
+							else {
+								depth_frames_accepted_ = true;
+							}
+						}
 
 						bool outputCapsSent = false;
 						RateCounter frame_rate_counter;
 						size_t byte_counter = 0;
 						while (!terminate_ || pipeline_.hasOutput()) {
-							std::unique_lock<std::mutex> lock(pipeline_.getMutex());
-							pipeline_.getOutputCondition().wait_for(lock, std::chrono::milliseconds(100), [this]() { return pipeline_.hasOutput(); });
-							if (pipeline_.hasOutput()) {
-								std::tuple<GstBufferWrapper, PipelineUserDataType> output_tuple(std::move(pipeline_.popOutput(lock)));
+							if (pipeline_.waitForOutput(std::chrono::milliseconds(100))) {
+								std::tuple<GstBufferWrapper, PipelineUserDataType> output_tuple(pipeline_.popOutput());
 								GstBufferWrapper& buffer = std::get<0>(output_tuple);
 								const PipelineUserDataType& pipeline_user_data = std::get<1>(output_tuple);
-								const StereoFrameInfo& frame_info = std::get<0>(pipeline_user_data);
-//								const StereoFrameLocationInfo& location_info = std::get<1>(pipeline_user_data);
-								lock.unlock();
+								const NetworkUserDataType& network_user_data = std::get<0>(pipeline_user_data);
+								const std::shared_ptr<const EncodedDepthFrame>& encoded_depth_frame = std::get<1>(pipeline_user_data);
+								const StereoFrameInfo& frame_info = std::get<0>(network_user_data);
+//								const StereoFrameLocationInfo& location_info = std::get<1>(network_user_data);
 								if (!pipeline_.isPlaying()) {
 									continue;
 								}
@@ -192,12 +222,18 @@ namespace ait
 									unsigned int frame_count = frame_rate_counter.getCount();
 									byte_counter += sizeof(StereoPacketHeader) + sizeof(GstreamerBufferInfo) + sizeof(StereoFrameInfo) + sizeof(StereoFrameLocationInfo)
 										+ frame_info.validation_pixel_values.size() + buffer.getSize();
+									if (encoded_depth_frame && depth_frames_accepted_) {
+										byte_counter += sizeof(StereoPacketHeader) + sizeof(StereoDepthFrameInfo) + encoded_depth_frame->data.size();
+									}
 									if (frame_rate_counter.reportRate(rate)) {
 										double bandwidth = rate * byte_counter / static_cast<double>(frame_count) / 1024.0;
 										byte_counter = 0;
 										std::cout << "Sending Gstreamer buffers with " << rate << " Hz. Bandwidth: " << bandwidth << "kB/s" << std::endl;
 									}
-									stereo_sensor_client_.sendGstreamerData(buffer, pipeline_user_data);
+									stereo_sensor_client_.sendGstreamerData(buffer, network_user_data);
+									if (encoded_depth_frame && depth_frames_accepted_) {
+										stereo_sensor_client_.sendDepthFrame(encoded_depth_frame->info, encoded_depth_frame->data, encoded_depth_frame->decoded_size);
+									}
 								}
 								catch (const typename TNetworkClient::Error& err) {
 									std::cerr << "Network error occured: " << err.what() << std::endl;
@@ -275,6 +311,18 @@ namespace ait
                 return merged_frame;
             }
 
+			std::shared_ptr<const EncodedDepthFrame> encodeDepthFrame(double timestamp, const cv::Mat& depth_frame) {
+				const cv::Mat& depth_frame_uint16 = convertDepthFrameFloatToUint16(depth_frame);
+				AIT_ASSERT(depth_frame_uint16.isContinuous());
+				std::shared_ptr<EncodedDepthFrame> encoded_depth_frame = std::make_shared<EncodedDepthFrame>();
+				encoded_depth_frame->info.timestamp = timestamp;
+				encoded_depth_frame->info.depth_scale = DEPTH_UINT16_SCALE;
+				encoded_depth_frame->decoded_size = depth_frame_uint16.rows * depth_frame_uint16.cols * depth_frame_uint16.elemSize();
+				depth_codec_.encode(depth_frame_uint16.ptr<uint16_t>(), depth_frame_uint16.cols, depth_frame_uint16.rows,
+					depth_frame_uint16.cols, encoded_depth_frame->data);
+				return encoded_depth_frame;
+			}
+
 			const cv::Mat& convertDepthFrameFloatToUint16(const cv::Mat& depth_frame)
 			{
 				// Convert float to uint16_t depth image (scaled by 1000)
@@ -282,13 +330,13 @@ namespace ait
 				if (depth_frame_uint16.empty()
 					|| depth_frame_uint16.rows != depth_frame.rows
 					|| depth_frame_uint16.cols != depth_frame.cols) {
-					depth_frame_uint16 = cv::Mat(depth_frame.rows, depth_frame.cols, CV_16S);
+					depth_frame_uint16 = cv::Mat(depth_frame.rows, depth_frame.cols, CV_16U);
 				}
 #pragma omp parallel for
 				for (int i = 0; i < depth_frame.rows * depth_frame.cols; ++i) {
 					float depth = depth_frame.at<float>(i);
-					if (std::isfinite(depth)) {
-						depth_frame_uint16.at<uint16_t>(i) = static_cast<uint16_t>(depth * 1000);
+					if (std::isfinite(depth) && depth > 0 && depth * DEPTH_UINT16_SCALE <= std::numeric_limits<uint16_t>::max()) {
+						depth_frame_uint16.at<uint16_t>(i) = static_cast<uint16_t>(depth * DEPTH_UINT16_SCALE);
 					}
 					else {
 						depth_frame_uint16.at<uint16_t>(i) = 0.0;
@@ -448,9 +496,12 @@ namespace ait
 			bool inverse_depth_;
 
 			std::thread pipeline_output_thread_;
-			StereoNetworkSensorClient<TNetworkClient, PipelineUserDataType, StereoFrameParameters> stereo_sensor_client_;
+			StereoNetworkSensorClient<TNetworkClient, NetworkUserDataType, StereoFrameParameters> stereo_sensor_client_;
 
 			bool use_compression_;
+			// Set per connection once the server offered StereoDepthCodec::PREDICTIVE_LZ
+			std::atomic_bool depth_frames_accepted_;
+			DepthFrameCodec depth_codec_;
 		};
 
 	}
@@ -26,6 +26,24 @@ enum class StereoPacketType
 
 	CLIENT_2_SERVER_GSTREAMER_PARAMETERS = 512 + 1,
 	CLIENT_2_SERVER_GSTREAMER_FRAME = 512 + 2,
+	// Lossless depth frame following the Gstreamer frame it belongs to.
+	// Only sent if the server offered the codec in SERVER_2_CLIENT_CAPABILITIES.
+	CLIENT_2_SERVER_DEPTH_FRAME = 512 + 3,
+
+	// packets from server to client
+	// Sent by the server after it received CLIENT_2_SERVER_INITIALIZATION. Servers that do not
+	// send it only understand the packets above CLIENT_2_SERVER_DEPTH_FRAME.
+	SERVER_2_CLIENT_CAPABILITIES = 1024 + 1,
+};
+
+// Encoding of CLIENT_2_SERVER_DEPTH_FRAME packets
+enum class StereoDepthCodec
+{
+	// No depth frame packets are sent
+	NONE = 0,
+
+	// ait::video::DepthFrameCodec (predictive varint + LZ4 block format)
+	PREDICTIVE_LZ = 1,
 };
 
 struct StereoPacketHeader
@@ -76,10 +94,54 @@ struct StereoCalibration
 
 struct StereoInitializationPacket
 {
+	StereoInitializationPacket()
+		: client_type(StereoClientType::CLIENT_UNKNOWN) {
+	}
+
 	StereoClientType client_type;
 	StereoCalibration calibration;
 };
 
+// Reply of the server to CLIENT_2_SERVER_INITIALIZATION. The client picks the depth codec from the offered ones.
+// If no reply arrives the client assumes an old server and only sends Gstreamer frames.
+struct StereoServerCapabilities : public Serializable<StereoServerCapabilities>
+{
+	static constexpr std::uint32_t PROTOCOL_VERSION = 1;
+
+	StereoServerCapabilities()
+		: protocol_version(PROTOCOL_VERSION), depth_codec_mask(0) {
+	}
+
+	~StereoServerCapabilities() override {
+	};
+
+	static std::uint32_t depthCodecBit(const StereoDepthCodec codec) {
+		return std::uint32_t(1) << static_cast<std::uint32_t>(codec);
+	}
+
+	bool supportsDepthCodec(const StereoDepthCodec codec) const {
+		return (depth_codec_mask & depthCodecBit(codec)) != 0;
+	}
+
+	std::uint32_t protocol_version;
+	// Bit i is set if StereoDepthCodec(i) can be decoded by the server
+	std::uint32_t depth_codec_mask;
+
+	size_t _write(Writer& writer) const override {
+		size_t written = 0;
+		written += writer.write(protocol_version);
+		written += writer.write(depth_codec_mask);
+		return written;
+	}
+
+	size_t _read(Reader& reader) override {
+		size_t bytes_read = 0;
+		bytes_read += reader.read(protocol_version);
+		bytes_read += reader.read(depth_codec_mask);
+		return bytes_read;
+	}
+};
+
 struct GstreamerBufferInfo : public Serializable<GstreamerBufferInfo>
 {
 	~GstreamerBufferInfo() override {
@@ -195,6 +257,32 @@ struct StereoFrameInfo : public Serializable<StereoFrameInfo>
 	}
 };
 
+// Sent in front of the encoded depth frame. The packet header holds the encoded size
+// and the size of the decoded 16 bit depth frame.
+struct StereoDepthFrameInfo : public Serializable<StereoDepthFrameInfo>
+{
+	~StereoDepthFrameInfo() override {
+	};
+
+	double timestamp;
+	// Depth value in meters = pixel value / depth_scale
+	float depth_scale;
+
+	size_t _write(Writer& writer) const override {
+		size_t written = 0;
+		written += writer.write(timestamp);
+		written += writer.write(depth_scale);
+		return written;
+	}
+
+	size_t _read(Reader& reader) override {
+		size_t bytes_read = 0;
+		bytes_read += reader.read(timestamp);
+		bytes_read += reader.read(depth_scale);
+		return bytes_read;
+	}
+};
+
 struct StereoFrameLocationInfo : public Serializable<StereoFrameLocationInfo>
 {
 	StereoFrameLocationInfo() {
@@ -0,0 +1,193 @@
+//==================================================
+// depth_codec_benchmark.cpp
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 7, 2016
+//==================================================
+
+// Compression ratio and encode/decode throughput of DepthFrameCodec on recorded depth frames.
+// Frames are read with OpenCV. 16 bit images are used as is, floating point images are
+// interpreted as meters and converted like StereoNetworkSensorManager does (millimeters).
+// If zlib is available the same frames are also compressed with zlib (level 1) for reference.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <cstring>
+
+#include <opencv2/opencv.hpp>
+#if WITH_ZLIB
+	#include <zlib.h>
+#endif
+
+#include <ait/video/DepthFrameCodec.h>
+
+using clock_type = std::chrono::high_resolution_clock;
+
+#if WITH_ZLIB
+const int ZLIB_LEVEL = 1;
+
+struct ZlibResult {
+	size_t compressed_bytes;
+	double compress_time;
+	double decompress_time;
+};
+
+bool benchmarkZlib(const cv::Mat& depth_frame, int repetitions, ZlibResult& result) {
+	const size_t raw_bytes = depth_frame.rows * depth_frame.cols * sizeof(uint16_t);
+	std::vector<Bytef> compressed(compressBound(raw_bytes));
+	std::vector<uint16_t> decompressed(depth_frame.rows * depth_frame.cols);
+	uLongf compressed_size = 0;
+	const clock_type::time_point compress_start = clock_type::now();
+	for (int r = 0; r < repetitions; ++r) {
+		compressed_size = compressed.size();
+		if (compress2(compressed.data(), &compressed_size, depth_frame.data, raw_bytes, ZLIB_LEVEL) != Z_OK) {
+			return false;
+		}
+	}
+	result.compress_time = std::chrono::duration<double>(clock_type::now() - compress_start).count() / repetitions;
+
+	const clock_type::time_point decompress_start = clock_type::now();
+	for (int r = 0; r < repetitions; ++r) {
+		uLongf decompressed_size = raw_bytes;
+		if (uncompress(reinterpret_cast<Bytef*>(decompressed.data()), &decompressed_size, compressed.data(), compressed_size) != Z_OK
+			|| decompressed_size != raw_bytes) {
+			return false;
+		}
+	}
+	result.decompress_time = std::chrono::duration<double>(clock_type::now() - decompress_start).count() / repetitions;
+	result.compressed_bytes = compressed_size;
+	return std::memcmp(decompressed.data(), depth_frame.data, raw_bytes) == 0;
+}
+#endif
+
+bool loadDepthFrame(const std::string& filename, cv::Mat& depth_frame_uint16) {
+	cv::Mat depth_frame = cv::imread(filename, cv::IMREAD_ANYDEPTH | cv::IMREAD_GRAYSCALE);
+	if (depth_frame.empty()) {
+		return false;
+	}
+	if (depth_frame.depth() == CV_16U) {
+		depth_frame_uint16 = depth_frame;
+	}
+	else if (depth_frame.depth() == CV_32F) {
+		depth_frame_uint16 = cv::Mat(depth_frame.rows, depth_frame.cols, CV_16U);
+		for (int i = 0; i < depth_frame.rows * depth_frame.cols; ++i) {
+			const float depth = depth_frame.at<float>(i);
+			if (std::isfinite(depth) && depth > 0 && depth * 1000 <= std::numeric_limits<uint16_t>::max()) {
+				depth_frame_uint16.at<uint16_t>(i) = static_cast<uint16_t>(depth * 1000);
+			}
+			else {
+				depth_frame_uint16.at<uint16_t>(i) = 0;
+			}
+		}
+	}
+	else {
+		std::cerr << "Unsupported depth frame type in " << filename << std::endl;
+		return false;
+	}
+	if (!depth_frame_uint16.isContinuous()) {
+		depth_frame_uint16 = depth_frame_uint16.clone();
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "Usage: " << argv[0] << " [--repetitions N] [--tile-height N] <depth frame> [<depth frame> ...]" << std::endl;
+		return 1;
+	}
+	int repetitions = 10;
+	unsigned int tile_height = ait::video::DepthFrameCodec::DEFAULT_TILE_HEIGHT;
+	std::vector<std::string> filenames;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg(argv[i]);
+		if (arg == "--repetitions" && i + 1 < argc) {
+			repetitions = std::stoi(argv[++i]);
+		}
+		else if (arg == "--tile-height" && i + 1 < argc) {
+			tile_height = static_cast<unsigned int>(std::stoi(argv[++i]));
+		}
+		else {
+			filenames.push_back(arg);
+		}
+	}
+
+	ait::video::DepthFrameCodec codec(tile_height);
+	std::vector<uint8_t> encoded;
+	std::vector<uint16_t> decoded;
+	size_t total_raw_bytes = 0;
+	size_t total_encoded_bytes = 0;
+	double total_encode_time = 0;
+	double total_decode_time = 0;
+#if WITH_ZLIB
+	size_t total_zlib_bytes = 0;
+	double total_zlib_compress_time = 0;
+	double total_zlib_decompress_time = 0;
+#endif
+	for (const std::string& filename : filenames) {
+		cv::Mat depth_frame;
+		if (!loadDepthFrame(filename, depth_frame)) {
+			std::cerr << "Unable to load depth frame " << filename << std::endl;
+			continue;
+		}
+		const size_t raw_bytes = depth_frame.rows * depth_frame.cols * sizeof(uint16_t);
+
+		const clock_type::time_point encode_start = clock_type::now();
+		for (int r = 0; r < repetitions; ++r) {
+			codec.encode(depth_frame.ptr<uint16_t>(), depth_frame.cols, depth_frame.rows, depth_frame.cols, encoded);
+		}
+		const double encode_time = std::chrono::duration<double>(clock_type::now() - encode_start).count() / repetitions;
+
+		size_t width, height;
+		const clock_type::time_point decode_start = clock_type::now();
+		for (int r = 0; r < repetitions; ++r) {
+			codec.decode(encoded.data(), encoded.size(), decoded, &width, &height);
+		}
+		const double decode_time = std::chrono::duration<double>(clock_type::now() - decode_start).count() / repetitions;
+
+		if (width != static_cast<size_t>(depth_frame.cols) || height != static_cast<size_t>(depth_frame.rows)
+			|| std::memcmp(decoded.data(), depth_frame.data, raw_bytes) != 0) {
+			std::cerr << "ERROR: Decoded frame does not match input for " << filename << std::endl;
+			return 1;
+		}
+
+		std::cout << filename << ": " << depth_frame.cols << "x" << depth_frame.rows
+			<< ", ratio " << raw_bytes / static_cast<double>(encoded.size())
+			<< ", encode " << raw_bytes / encode_time / 1e6 << " MB/s"
+			<< ", decode " << raw_bytes / decode_time / 1e6 << " MB/s" << std::endl;
+		total_raw_bytes += raw_bytes;
+		total_encoded_bytes += encoded.size();
+		total_encode_time += encode_time;
+		total_decode_time += decode_time;
+
+#if WITH_ZLIB
+		ZlibResult zlib_result;
+		if (!benchmarkZlib(depth_frame, repetitions, zlib_result)) {
+			std::cerr << "ERROR: zlib round trip failed for " << filename << std::endl;
+			return 1;
+		}
+		std::cout << "  zlib level " << ZLIB_LEVEL << ": ratio " << raw_bytes / static_cast<double>(zlib_result.compressed_bytes)
+			<< ", encode " << raw_bytes / zlib_result.compress_time / 1e6 << " MB/s"
+			<< ", decode " << raw_bytes / zlib_result.decompress_time / 1e6 << " MB/s" << std::endl;
+		total_zlib_bytes += zlib_result.compressed_bytes;
+		total_zlib_compress_time += zlib_result.compress_time;
+		total_zlib_decompress_time += zlib_result.decompress_time;
+#endif
+	}
+
+	if (total_encoded_bytes > 0) {
+		std::cout << "Total: ratio " << total_raw_bytes / static_cast<double>(total_encoded_bytes)
+			<< ", encode " << total_raw_bytes / total_encode_time / 1e6 << " MB/s"
+			<< ", decode " << total_raw_bytes / total_decode_time / 1e6 << " MB/s" << std::endl;
+#if WITH_ZLIB
+		std::cout << "Total zlib level " << ZLIB_LEVEL << ": ratio " << total_raw_bytes / static_cast<double>(total_zlib_bytes)
+			<< ", encode " << total_raw_bytes / total_zlib_compress_time / 1e6 << " MB/s"
+			<< ", decode " << total_raw_bytes / total_zlib_decompress_time / 1e6 << " MB/s" << std::endl;
+#endif
+	}
+	return 0;
+}
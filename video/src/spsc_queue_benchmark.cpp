@@ -0,0 +1,215 @@
+//==================================================
+// spsc_queue_benchmark.cpp
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 7, 2016
+//==================================================
+
+// Throughput and latency of the lock-free SPSCFixedQueue compared to the previous
+// std::deque + mutex + condition variable queue used by AppSrcSinkQueue.
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <atomic>
+
+#include <ait/video/SPSCFixedQueue.h>
+
+using clock_type = std::chrono::steady_clock;
+
+// Move-only payload resembling a GstBufferWrapper
+struct Payload
+{
+	Payload(void* ptr, clock_type::time_point timestamp)
+		: ptr(ptr), timestamp(timestamp) {
+	}
+
+	Payload(const Payload&) = delete;
+	void operator=(const Payload&) = delete;
+
+	Payload(Payload&& other)
+		: ptr(other.ptr), timestamp(other.timestamp) {
+		other.ptr = nullptr;
+	}
+
+	void* ptr;
+	clock_type::time_point timestamp;
+};
+
+// Previous queue implementation
+template <typename T>
+class MutexDequeQueue
+{
+public:
+	MutexDequeQueue(unsigned int max_queue_size)
+		: max_queue_size_(max_queue_size) {
+	}
+
+	bool pushBack(T& element) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (queue_.size() >= max_queue_size_) {
+			queue_space_available_condition_.wait_for(lock, std::chrono::milliseconds(100),
+				[&]() { return queue_.size() < max_queue_size_; });
+		}
+		queue_.push_back(std::move(element));
+		queue_filled_condition_.notify_one();
+		return true;
+	}
+
+	T popFrontBlocking() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		queue_filled_condition_.wait(lock, [&]() { return !queue_.empty(); });
+		T element(std::move(queue_.front()));
+		queue_.pop_front();
+		queue_space_available_condition_.notify_one();
+		return element;
+	}
+
+private:
+	std::deque<T> queue_;
+	unsigned int max_queue_size_;
+	std::mutex mutex_;
+	std::condition_variable queue_filled_condition_;
+	std::condition_variable queue_space_available_condition_;
+};
+
+template <typename T>
+class RingBufferQueue
+{
+public:
+	RingBufferQueue(unsigned int max_queue_size)
+		: queue_(max_queue_size) {
+	}
+
+	bool pushBack(T& element) {
+		return queue_.pushBack(element, true);
+	}
+
+	T popFrontBlocking() {
+		while (!queue_.waitForElement(std::chrono::milliseconds(100))) {
+		}
+		return queue_.popFront();
+	}
+
+private:
+	ait::SPSCFixedQueue<T> queue_;
+};
+
+struct BenchmarkResult
+{
+	double items_per_second;
+	double mean_latency_us;
+	double median_latency_us;
+	double p99_latency_us;
+	double max_latency_us;
+};
+
+// If producer_period_us > 0 the producer is paced (like a camera) to measure latency of a mostly empty queue.
+template <typename Queue>
+BenchmarkResult runBenchmark(const size_t num_items, const unsigned int queue_size, const int producer_period_us) {
+	Queue queue(queue_size);
+	std::vector<double> latencies_us;
+	latencies_us.reserve(num_items);
+
+	const clock_type::time_point start_time = clock_type::now();
+	std::thread consumer([&]() {
+		for (size_t i = 0; i < num_items; ++i) {
+			Payload payload = queue.popFrontBlocking();
+			const clock_type::time_point now = clock_type::now();
+			latencies_us.push_back(std::chrono::duration<double, std::micro>(now - payload.timestamp).count());
+		}
+	});
+	for (size_t i = 0; i < num_items; ++i) {
+		if (producer_period_us > 0) {
+			const clock_type::time_point next = start_time + std::chrono::microseconds(producer_period_us * i);
+			while (clock_type::now() < next) {
+			}
+		}
+		Payload payload(reinterpret_cast<void*>(i + 1), clock_type::now());
+		queue.pushBack(payload);
+	}
+	consumer.join();
+	const double elapsed = std::chrono::duration<double>(clock_type::now() - start_time).count();
+
+	std::sort(latencies_us.begin(), latencies_us.end());
+	BenchmarkResult result;
+	result.items_per_second = num_items / elapsed;
+	double sum = 0;
+	for (double latency : latencies_us) {
+		sum += latency;
+	}
+	result.mean_latency_us = sum / latencies_us.size();
+	result.median_latency_us = latencies_us[latencies_us.size() / 2];
+	result.p99_latency_us = latencies_us[static_cast<size_t>(0.99 * (latencies_us.size() - 1))];
+	result.max_latency_us = latencies_us.back();
+	return result;
+}
+
+void printResult(const std::string& name, const BenchmarkResult& result) {
+	std::cout << "  " << name << ": " << result.items_per_second / 1e6 << " M items/s"
+		<< ", latency mean " << result.mean_latency_us << " us"
+		<< ", median " << result.median_latency_us << " us"
+		<< ", p99 " << result.p99_latency_us << " us"
+		<< ", max " << result.max_latency_us << " us" << std::endl;
+}
+
+// Keeps all cores busy while a benchmark is running to measure latency under load.
+class BackgroundLoad
+{
+public:
+	BackgroundLoad(const unsigned int num_threads)
+		: stop_(false) {
+		for (unsigned int i = 0; i < num_threads; ++i) {
+			threads_.emplace_back([this]() {
+				volatile unsigned long counter = 0;
+				while (!stop_.load(std::memory_order_relaxed)) {
+					++counter;
+				}
+			});
+		}
+	}
+
+	~BackgroundLoad() {
+		stop_ = true;
+		for (std::thread& thread : threads_) {
+			thread.join();
+		}
+	}
+
+private:
+	std::atomic<bool> stop_;
+	std::vector<std::thread> threads_;
+};
+
+int main(int argc, char** argv) {
+	const size_t num_items = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+	const size_t num_paced_items = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+	const int producer_period_us = 50;
+
+	for (unsigned int queue_size : { 5u, 64u, 1024u }) {
+		std::cout << "Queue size " << queue_size << ", " << num_items << " items, unpaced producer" << std::endl;
+		printResult("mutex + deque ", runBenchmark<MutexDequeQueue<Payload>>(num_items, queue_size, 0));
+		printResult("SPSC ring     ", runBenchmark<RingBufferQueue<Payload>>(num_items, queue_size, 0));
+	}
+	std::cout << "Queue size 5, " << num_paced_items << " items, producer period " << producer_period_us << " us" << std::endl;
+	printResult("mutex + deque ", runBenchmark<MutexDequeQueue<Payload>>(num_paced_items, 5, producer_period_us));
+	printResult("SPSC ring     ", runBenchmark<RingBufferQueue<Payload>>(num_paced_items, 5, producer_period_us));
+	const unsigned int num_load_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::cout << "Queue size 5, " << num_paced_items << " items, producer period " << producer_period_us << " us"
+		<< ", " << num_load_threads << " background load threads" << std::endl;
+	{
+		BackgroundLoad load(num_load_threads);
+		printResult("mutex + deque ", runBenchmark<MutexDequeQueue<Payload>>(num_paced_items, 5, producer_period_us));
+		printResult("SPSC ring     ", runBenchmark<RingBufferQueue<Payload>>(num_paced_items, 5, producer_period_us));
+	}
+
+	return 0;
+}
@@ -36,11 +36,6 @@
 #include <ait/video/StereoNetworkSensorManager.h>
 #include <ait/video/EncodingGstreamerPipeline.h>
 
-// Test direct depth compression (FastLZ, zlib, Snappy)
-//#include <fastlz/fastlz.h>
-//#include <snappy/snappy.h>
-//#include <zlib.h>
-
 volatile bool g_abort;
 
 void signalHandler(int sig)
@@ -142,7 +137,7 @@ std::pair<bool, boost::program_options::variables_map> process_commandline(int a
     network_options.add_options()
         ("remote-ip", po::value<std::string>()->default_value("127.0.0.1"), "Remote IP address")
         ("remote-port", po::value<int>()->default_value(1337), "Remote port")
-        ("compress", po::bool_switch()->default_value(false), "Use compression")
+        ("compress", po::bool_switch()->default_value(false), "Send lossless compressed 16 bit depth frames in addition to the video stream")
         ;
 
     po::options_description frame_options("Frame options");
@@ -350,26 +345,6 @@ int main(int argc, char** argv)
                 }
             }
 
-//            // Test direct depth compression (FastLZ, zlib, Snappy)
-//            using clock = std::chrono::high_resolution_clock;
-//            cv::Mat depth_frame_uint16 = convertDepthFrameFloatToUint16(depth_frame);
-//            if (!prev_depth_frame_uint16.empty()) {
-//                size_t input_size = depth_frame_uint16.rows * depth_frame_uint16.cols * depth_frame_uint16.elemSize();
-//                size_t output_size = static_cast<size_t>(input_size * 1.1);
-////                size_t output_size = snappy::MaxCompressedLength(input_size);
-//                uint8_t* output = new uint8_t[output_size];
-//                auto start_time = clock::now();
-//    //            size_t compressed_size = static_cast<int>(fastlz_compress_level(1, depth_frame_uint16.data, input_size, output));
-//                size_t compressed_size;
-////                snappy::RawCompress((const char*)dframe.data, input_size, (char*)output, &compressed_size);
-//                int level = 5;
-//                compress2((Bytef*)output, &compressed_size, (const Bytef*)depth_frame_uint16.data, input_size, level);
-//                auto stop_time = clock::now();
-//                delete[] output;
-//                auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(stop_time - start_time).count();
-//                std::cout << "Compressed " << input_size/1024. << " kB to " << compressed_size/1024. << " kB in " << dt << " ms" << std::endl;
-//            }
-
             if (manager.pushNewStereoFrame(timestamp, left_frame, right_frame, depth_frame)) {
                 frame_rate_counter.count();
                 double rate;
@@ -263,7 +263,7 @@ std::pair<bool, boost::program_options::variables_map> process_commandline(int a
     network_options.add_options()
         ("remote-ip", po::value<std::string>()->default_value("127.0.0.1"), "Remote IP address")
         ("remote-port", po::value<int>()->default_value(1337), "Remote port")
-        ("compress", po::bool_switch()->default_value(false), "Use compression")
+        ("compress", po::bool_switch()->default_value(false), "Send lossless compressed 16 bit depth frames in addition to the video stream")
         ;
 
     po::options_description frame_options("Frame options");
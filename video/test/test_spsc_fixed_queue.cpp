@@ -0,0 +1,79 @@
+//==================================================
+// test_spsc_fixed_queue.cpp
+//
+//  Copyright (c) 2016 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Nov 7, 2016
+//==================================================
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+#include <ait/video/SPSCFixedQueue.h>
+
+using clock_type = std::chrono::steady_clock;
+
+TEST(SPSCFixedQueueTest, PushAndPopShouldKeepOrder) {
+	ait::SPSCFixedQueue<int> queue(3);
+	for (int i = 0; i < 3; ++i) {
+		int value = i;
+		EXPECT_TRUE(queue.pushBack(value));
+	}
+	int value = 3;
+	EXPECT_FALSE(queue.pushBack(value));
+	for (int i = 0; i < 3; ++i) {
+		ASSERT_TRUE(queue.waitForElement(std::chrono::milliseconds(0)));
+		EXPECT_EQ(queue.popFront(), i);
+	}
+	EXPECT_TRUE(queue.empty());
+}
+
+TEST(SPSCFixedQueueTest, WaitingConsumerShouldBlockWhileDiscarding) {
+	ait::SPSCFixedQueue<int> queue(3);
+	queue.setDiscardEverything(true);
+	const auto timeout = std::chrono::milliseconds(50);
+	const auto duration = std::chrono::milliseconds(300);
+	size_t num_waits = 0;
+	const clock_type::time_point start = clock_type::now();
+	while (clock_type::now() - start < duration) {
+		EXPECT_FALSE(queue.waitForElement(timeout));
+		++num_waits;
+	}
+	// A spinning consumer would return immediately and loop many thousand times
+	EXPECT_LE(num_waits, duration / timeout + 1);
+}
+
+TEST(SPSCFixedQueueTest, WaitingConsumerShouldWakeUpOnPushWhileDiscarding) {
+	ait::SPSCFixedQueue<int> queue(3);
+	queue.setDiscardEverything(true);
+	std::atomic<bool> consumer_done(false);
+	bool got_element = false;
+	std::thread consumer([&]() {
+		got_element = queue.waitForElement(std::chrono::seconds(5));
+		consumer_done = true;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_FALSE(consumer_done);
+	int value = 42;
+	EXPECT_TRUE(queue.tryPushBack(std::move(value)));
+	consumer.join();
+	EXPECT_TRUE(got_element);
+	EXPECT_EQ(queue.popFront(), 42);
+}
+
+TEST(SPSCFixedQueueTest, DiscardingShouldRejectBlockedProducer) {
+	ait::SPSCFixedQueue<int> queue(1);
+	int value = 1;
+	ASSERT_TRUE(queue.pushBack(value, true));
+	bool pushed = true;
+	std::thread producer([&]() {
+		int value = 2;
+		pushed = queue.pushBack(value, true);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	queue.setDiscardEverything(true);
+	producer.join();
+	EXPECT_FALSE(pushed);
+	EXPECT_EQ(queue.size(), 1);
+}
@@ -9,10 +9,16 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <stack>
 #include <utility>
+#include <vector>
+#include <boost/crc.hpp>
 #include <boost/serialization/access.hpp>
 #include <boost/iterator_adaptors.hpp>
 #include <bh/common.h>
+#include <bh/algorithm.h>
 #include <bh/eigen.h>
 #include <bh/math/geometry.h>
 #include <bh/utilities.h>
@@ -249,7 +255,7 @@ public:
   using ConstIterator = _Iterator<const NodeType>;
 
   Tree()
-  : root_(nullptr), stored_as_vector_(false), owns_objects_(false), depth_(0), num_nodes_(0), num_leaf_nodes_(0) {
+  : root_(nullptr), owns_objects_(false), depth_(0), num_nodes_(0), num_leaf_nodes_(0) {
 #if WITH_CUDA
     cuda_tree_ = nullptr;
 #endif
@@ -297,34 +303,51 @@ public:
 #if WITH_CUDA
     SAFE_DELETE(cuda_tree_);
 #endif
-    if (owns_objects_) {
+    if (owns_objects_ && root_ != nullptr) {
       clearObjectsRecursive(root_);
     }
-    if (root_ != nullptr && !stored_as_vector_) {
-      clearRecursive(root_);
-    }
     root_ = nullptr;
     nodes_.clear();
+    object_storage_.clear();
     depth_ = 0;
+    num_nodes_ = 0;
     num_leaf_nodes_ = 0;
-    stored_as_vector_ = false;
     owns_objects_ = false;
-    voxel_index_map_.clear();
-    index_voxel_map_.clear();
   }
 
-  const std::unordered_map<std::size_t, const NodeType*>& getIndexVoxelMap() const {
-    if (index_voxel_map_.empty()) {
-      computeIndexVoxelMap();
-    }
-    return index_voxel_map_;
+  /// All nodes are stored in a contiguous array in iteration order (depth-first, right child first).
+  /// The index of a node is its offset in this array. Built trees are ordered by the Morton code of
+  /// the leaf centers so that spatially close voxels have close indices.
+  std::size_t getNodeIndex(const NodeType* node) const {
+    assert(node >= nodes_.data() && node < nodes_.data() + nodes_.size());
+    return static_cast<std::size_t>(node - nodes_.data());
+  }
+
+  NodeType* getNode(const std::size_t index) {
+    assert(index < nodes_.size());
+    return &nodes_[index];
+  }
+
+  const NodeType* getNode(const std::size_t index) const {
+    assert(index < nodes_.size());
+    return &nodes_[index];
   }
 
-  const std::unordered_map<const NodeType*, std::size_t>& getVoxelIndexMap() const {
-    if (voxel_index_map_.empty()) {
-      computeVoxelIndexMap();
+  /// CRC-32 of the node layout (child indices and bounding boxes in index order).
+  /// Data that refers to nodes by index is only valid for a tree with the same layout checksum.
+  uint32_t computeLayoutChecksum() const {
+    boost::crc_32_type crc;
+    for (const NodeType& node : nodes_) {
+      const uint64_t left_child_index = node.hasLeftChild() ? getNodeIndex(node.getLeftChild()) : 0;
+      const uint64_t right_child_index = node.hasRightChild() ? getNodeIndex(node.getRightChild()) : 0;
+      crc.process_bytes(&left_child_index, sizeof(left_child_index));
+      crc.process_bytes(&right_child_index, sizeof(right_child_index));
+      const Vector3 bbox_min = node.getBoundingBox().getMinimum();
+      const Vector3 bbox_max = node.getBoundingBox().getMaximum();
+      crc.process_bytes(bbox_min.data(), 3 * sizeof(FloatType));
+      crc.process_bytes(bbox_max.data(), 3 * sizeof(FloatType));
     }
-    return voxel_index_map_;
+    return crc.checksum();
   }
 
   NodeType* getRoot() {
@@ -360,11 +383,14 @@ public:
 
   void build(std::vector<ObjectWithBoundingBox> objects, bool take_ownership=true) {
     clear();
-//    nodes_.emplace_back();
-    root_ = allocateNode();
-    buildRecursive(root_, objects);
+    BH_ASSERT(!objects.empty());
+    sortByMortonCode(&objects);
+    // A median split tree with n leaves has 2n - 1 nodes
+    nodes_.resize(2 * objects.size() - 1);
+    const std::size_t num_of_nodes = splitMedian(0, objects.begin(), objects.end());
+    BH_ASSERT(num_of_nodes == nodes_.size());
+    root_ = &nodes_.front();
     owns_objects_ = take_ownership;
-//    nodes_.shrink_to_fit();
     computeInfo();
     printInfo();
 //    for (auto it = begin(); it != end(); ++it) {
@@ -372,6 +398,14 @@ public:
 //    }
   }
 
+  /// Build from objects that point into object_storage. The tree takes ownership of the storage
+  /// so that all objects are stored contiguously and freed at once.
+  void build(std::vector<ObjectWithBoundingBox> objects, std::vector<ObjectType>&& object_storage) {
+    build(std::move(objects), false);
+    // Moving the vector keeps the object pointers valid
+    object_storage_ = std::move(object_storage);
+  }
+
   // Cannot be const because BBoxIntersectionResult contains a non-const pointer to a node
   std::pair<bool, IntersectionResult> intersects(const RayType& ray, FloatType min_range = 0, FloatType max_range = -1) {
     IntersectionData data;
@@ -623,6 +657,7 @@ private:
     ar & depth;
     ar & num_of_nodes;
     ar & num_of_leaf_nodes;
+    clear();
     if (num_of_nodes == 0) {
       return;
     }
@@ -631,6 +666,9 @@ private:
     std::vector<NodeType> nodes;
     std::size_t leaf_counter = 0;
     nodes.resize(num_of_nodes);
+    // Objects are only stored in leaves
+    std::vector<ObjectType> object_storage;
+    object_storage.reserve(num_of_leaf_nodes);
     for (auto it = nodes.begin(); it != nodes.end(); ++it) {
 //        std::cout << "Reading node " << (it - nodes.begin()) << " of " << nodes.size() << std::endl;
       std::size_t left_child_index;
@@ -656,7 +694,9 @@ private:
       bool has_object;
       ar & has_object;
       if (has_object) {
-        node.object_ = new ObjectType();
+        BH_ASSERT_STR(object_storage.size() < object_storage.capacity(), "Found more objects than leaf nodes");
+        object_storage.emplace_back();
+        node.object_ = &object_storage.back();
         ar & (*node.object_);
       }
       else {
@@ -672,10 +712,13 @@ private:
 //      depth_ = depth;
 //      num_nodes_ = num_of_nodes;
 //      num_leaf_nodes_ = num_of_leaf_nodes;
-    nodes_ = std::move(nodes);
+    // Nodes are stored breadth-first on disk. Rearrange them in iteration order so that node indices are offsets.
+    nodes_.resize(nodes.size());
+    const std::size_t num_of_copied_nodes = copyInIterationOrder(&nodes.front(), 0);
+    BH_ASSERT(num_of_copied_nodes == nodes_.size());
     root_ = &nodes_.front();
-    stored_as_vector_ = true;
-    owns_objects_ = true;
+    object_storage_ = std::move(object_storage);
+    owns_objects_ = false;
     computeInfo();
     printInfo();
     BH_ASSERT_STR(getDepth() == depth
@@ -709,26 +752,23 @@ private:
     }
   }
 
-  void computeVoxelIndexMap() const {
-    std::cout << "BVH: Computing voxel index map" << std::endl;
-    // Compute consistent ordering of BVH nodes
-    voxel_index_map_.clear();
-    std::size_t voxel_index = 0;
-    for (const NodeType& node : *this) {
-      voxel_index_map_.emplace(&node, voxel_index);
-      ++voxel_index;
+  /// Copy a subtree into nodes_ starting at index. Returns the index after the last copied node.
+  std::size_t copyInIterationOrder(const NodeType* src_node, const std::size_t index) {
+    NodeType& node = nodes_[index];
+    node.bounding_box_ = src_node->bounding_box_;
+    node.object_ = src_node->object_;
+    node.left_child_ = nullptr;
+    node.right_child_ = nullptr;
+    std::size_t next_index = index + 1;
+    if (src_node->right_child_ != nullptr) {
+      node.right_child_ = &nodes_[next_index];
+      next_index = copyInIterationOrder(src_node->right_child_, next_index);
     }
-  }
-
-  void computeIndexVoxelMap() const {
-    std::cout << "BVH: Computing index voxel map" << std::endl;
-    // Compute consistent ordering of BVH nodes
-    index_voxel_map_.clear();
-    std::size_t voxel_index = 0;
-    for (const NodeType& node : *this) {
-      index_voxel_map_.emplace(voxel_index, &node);
-      ++voxel_index;
+    if (src_node->left_child_ != nullptr) {
+      node.left_child_ = &nodes_[next_index];
+      next_index = copyInIterationOrder(src_node->left_child_, next_index);
     }
+    return next_index;
   }
 
   void clearObjectsRecursive(NodeType* node) {
@@ -743,99 +783,72 @@ private:
     SAFE_DELETE(node->object_);
   }
 
-  void clearRecursive(NodeType* node) {
-    if (node->left_child_ != nullptr) {
-      clearRecursive(node->left_child_);
-      node->left_child_ = nullptr;
-    }
-    if (node->right_child_ != nullptr) {
-      clearRecursive(node->right_child_);
-      node->right_child_ = nullptr;
-    }
-    deallocateNode(node);
-  }
-
-  void buildRecursive(NodeType* root, std::vector<ObjectWithBoundingBox>& objects) {
-    assert(objects.size() > 2);
-//    splitMidPoint(root, objects.begin(), objects.end(), 0);
-    splitMedian(root, objects.begin(), objects.end(), 0);
+  static uint64_t spreadBits(uint64_t x) {
+    // Spread the lower 21 bits so that there are two zero bits between each bit
+    x &= 0x1fffff;
+    x = (x | (x << 32)) & 0x1f00000000ffffULL;
+    x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+    x = (x | (x << 8)) & 0x100f00f00f00f00fULL;
+    x = (x | (x << 4)) & 0x10c30c30c30c30c3ULL;
+    x = (x | (x << 2)) & 0x1249249249249249ULL;
+    return x;
   }
 
-  void splitMedian(NodeType* node,
-      typename std::vector<ObjectWithBoundingBox>::iterator begin, typename std::vector<ObjectWithBoundingBox>::iterator end,
-      std::size_t sort_axis) {
-    if (end - begin > 1) {
-      std::stable_sort(begin, end, [&](const ObjectWithBoundingBox& a, const ObjectWithBoundingBox& b) -> bool {
-        return a.bounding_box.getCenter(sort_axis) < b.bounding_box.getCenter(sort_axis);
-      });
-
-      std::size_t next_sort_axis = (sort_axis + 1) % 3;
-
-      node->left_child_ = allocateNode();
-      node->right_child_ = allocateNode();
-
-      splitMedian(node->left_child_, begin, begin + (end - begin) / 2, next_sort_axis);
-      splitMedian(node->right_child_, begin + (end - begin) / 2, end, next_sort_axis);
-
-      node->computeBoundingBox();
+  /// Sort objects by the Morton code of their bounding box center (quantized with 21 bits per axis).
+  /// Ties are resolved by the original order so that the tree is deterministic.
+  static void sortByMortonCode(std::vector<ObjectWithBoundingBox>* objects) {
+    BoundingBoxType center_bbox;
+    for (const ObjectWithBoundingBox& object : *objects) {
+      center_bbox.include(object.bounding_box.getCenter());
     }
-    else {
-      assert(end - begin == 1);
-      node->bounding_box_ = begin->bounding_box;
-      node->object_ = begin->object;
-      BH_ASSERT(begin->object != nullptr);
+    const FloatType max_key = FloatType((1 << 21) - 1);
+    Vector3 scale;
+    for (std::size_t i = 0; i < 3; ++i) {
+      const FloatType extent = center_bbox.getExtent(i);
+      scale(i) = extent > 0 ? max_key / extent : 0;
     }
-  }
-
-  BoundingBoxType computeBoundingBox(typename std::vector<ObjectWithBoundingBox>::iterator begin, typename std::vector<ObjectWithBoundingBox>::iterator end) {
-    BoundingBoxType bbox = begin->bounding_box;
-    for (auto it = begin; it != end; ++it) {
-      bbox.include(it->bounding_box);
+    std::vector<std::pair<uint64_t, std::size_t>> codes(objects->size());
+#pragma omp parallel for
+    for (std::size_t i = 0; i < objects->size(); ++i) {
+      const Vector3 key = ((*objects)[i].bounding_box.getCenter() - center_bbox.getMinimum()).cwiseProduct(scale);
+      uint64_t code = 0;
+      for (std::size_t j = 0; j < 3; ++j) {
+        const uint64_t key_j = static_cast<uint64_t>(std::min(std::max(key(j), FloatType(0)), max_key));
+        code |= spreadBits(key_j) << j;
+      }
+      codes[i] = std::make_pair(code, i);
+    }
+    bh::parallelSort(codes.begin(), codes.end());
+    std::vector<ObjectWithBoundingBox> sorted_objects;
+    sorted_objects.reserve(objects->size());
+    for (const auto& entry : codes) {
+      sorted_objects.push_back((*objects)[entry.second]);
     }
-    return bbox;
+    *objects = std::move(sorted_objects);
   }
 
-  void splitMidPoint(NodeType* node,
-      typename std::vector<ObjectWithBoundingBox>::iterator begin, typename std::vector<ObjectWithBoundingBox>::iterator end, std::size_t cur_depth) {
+  /// Build a subtree into nodes_ starting at index by splitting the (Morton sorted) objects at the median.
+  /// The nodes are laid out in iteration order. Returns the index after the last node of the subtree.
+  std::size_t splitMedian(const std::size_t index,
+      typename std::vector<ObjectWithBoundingBox>::const_iterator begin,
+      typename std::vector<ObjectWithBoundingBox>::const_iterator end) {
+    NodeType& node = nodes_[index];
     if (end - begin > 1) {
-      BoundingBoxType bbox = computeBoundingBox(begin, end);
-
-      std::size_t max_extent_index;
-      FloatType max_extent = bbox.getMaxExtent(&max_extent_index);
-      typename std::vector<ObjectWithBoundingBox>::iterator mid_it = begin + 1;
-      std::stable_sort(begin, end, [&](const ObjectWithBoundingBox& a, const ObjectWithBoundingBox& b) -> bool {
-        return a.bounding_box.getMinimum(max_extent_index) < b.bounding_box.getMinimum(max_extent_index);
-      });
-      FloatType middle = bbox.getMinimum(max_extent_index) + max_extent / 2;
-      for (; mid_it != end - 1; ++mid_it) {
-        if (mid_it->bounding_box.getMinimum(max_extent_index) >= middle) {
-          break;
-        }
-      }
-      BoundingBoxType bbox_left = computeBoundingBox(begin, mid_it);
-      BoundingBoxType bbox_right = computeBoundingBox(mid_it, end);
-      assert(!(bbox == bbox_left));
-      assert(!(bbox == bbox_right));
-      assert(!(bbox_left == bbox_right));
-
-      node->left_child_ = allocateNode();
-      node->right_child_ = allocateNode();
-
-//      assert(node->left_child_ >= nodes_.data());
-//      assert(node->right_child_ >= node->left_child_);
-
-      splitMidPoint(node->left_child_, begin, mid_it, cur_depth + 1);
-      splitMidPoint(node->right_child_, mid_it, end, cur_depth + 1);
-
-//      assert(node->left_child_ >= nodes_.data());
-//      assert(node->right_child_ >= node->left_child_);
-
-      node->computeBoundingBox();
+      const auto mid = begin + (end - begin) / 2;
+      std::size_t next_index = index + 1;
+      node.right_child_ = &nodes_[next_index];
+      next_index = splitMedian(next_index, mid, end);
+      node.left_child_ = &nodes_[next_index];
+      next_index = splitMedian(next_index, begin, mid);
+      node.computeBoundingBox();
+      return next_index;
     }
     else {
       assert(end - begin == 1);
-      node->bounding_box_ = begin->bounding_box;
-      node->object_ = begin->object;
+      node.bounding_box_ = begin->bounding_box;
+      node.object_ = begin->object;
+      BH_ASSERT(begin->object != nullptr);
+      return index + 1;
     }
   }
 
@@ -938,14 +951,6 @@ private:
     }
   }
 
-  NodeType* allocateNode() {
-    return new NodeType;
-  }
-
-  void deallocateNode(NodeType* node) {
-    delete node;
-  }
-
 #if WITH_CUDA
   void ensureCudaTreeIsInitialized() {
     if (cuda_tree_ == nullptr) {
@@ -955,18 +960,15 @@ private:
   }
 #endif
 
-//  std::vector<NodeType> nodes_;
   NodeType* root_;
   std::vector<NodeType> nodes_;
-  bool stored_as_vector_;
+  // Contiguous storage of the objects (if the objects are not owned individually)
+  std::vector<ObjectType> object_storage_;
   bool owns_objects_;
   std::size_t depth_;
   std::size_t num_nodes_;
   std::size_t num_leaf_nodes_;
 
-  mutable std::unordered_map<std::size_t, const NodeType*> index_voxel_map_;
-  mutable std::unordered_map<const NodeType*, std::size_t> voxel_index_map_;
-
 #if WITH_CUDA
   CudaTreeType* cuda_tree_;
 #endif
@@ -77,6 +77,8 @@ public:
       addOption<FloatType>("max_triangle_area", &max_triangle_area);
       addOption<size_t>("sphere_subdivisions", &sphere_subdivisions);
       addOption<FloatType>("min_visible_rays_ratio", &min_visible_rays_ratio);
+      addOption<size_t>("triangle_chunk_size", &triangle_chunk_size);
+      // Unused since visibility is computed on the CPU. Kept for existing config files.
       addOption<int>("cuda_gpu_id", 0);
       addOption<size_t>("cuda_stack_size", 32 * 1024);
       addOption<string>("refined_mesh");
@@ -94,6 +96,7 @@ public:
     FloatType max_triangle_area = FloatType(0.5);
     size_t sphere_subdivisions = 3;
     FloatType min_visible_rays_ratio = FloatType(0.05);
+    size_t triangle_chunk_size = 10000;
   };
 
   struct NodeObject {
@@ -434,6 +437,57 @@ public:
     return mesh;
   }
 
+  /// A triangle is observable if at least min_visible_rays rays from its center (in the direction of the normal)
+  /// reach a valid drone position without hitting the mesh. ray_packet holds the ray directions.
+  bool isTriangleObservable(
+          const Triangle& tri,
+          BvhTreeType& valid_position_bvh_tree,
+          const TriAABBTree& tri_aabb_tree,
+          const size_t min_visible_rays,
+          const FloatType min_range,
+          const FloatType max_range,
+          const std::vector<TriAABBTree::RayDataType, Eigen::aligned_allocator<TriAABBTree::RayDataType>>& ray_packet) const {
+    const FloatType mesh_min_range = FloatType(1e-5);
+    const Vector3 center = tri.getCenter();
+    const Vector3 normal = tri.getNormal();
+    // Rays that reach a valid position are tested against the mesh in packets sharing the triangle center as origin
+    TriAABBTree::RayDataType mesh_rays[TriAABBTree::kPacketSize];
+    bool occluded[TriAABBTree::kPacketSize];
+    size_t num_mesh_rays = 0;
+    size_t visible_rays = 0;
+    const auto test_mesh_rays = [&]() -> bool {
+      tri_aabb_tree.intersectsAny(mesh_rays, num_mesh_rays, 0, max_range, occluded);
+      visible_rays += std::count(occluded, occluded + num_mesh_rays, false);
+      num_mesh_rays = 0;
+      return visible_rays > 0 && visible_rays >= min_visible_rays;
+    };
+    for (size_t i = 0; i < ray_packet.size(); ++i) {
+      const Vector3& direction = ray_packet[i].direction;
+      // Make sure ray direction lies in triangle's oriented half-sphere
+      if (direction.dot(normal) <= 0) {
+        continue;
+      }
+      const BvhTreeType::RayType ray(center + min_range * direction, direction);
+      // Tree traversal is read-only so concurrent queries are safe
+      const std::pair<bool, BvhTreeType::IntersectionResult> result =
+          valid_position_bvh_tree.intersects(ray, 0, max_range);
+      if (!result.first || !result.second.node->getObject()->is_valid_object_position
+          || !pose_sample_bbox_.isInside(result.second.intersection)) {
+        continue;
+      }
+      mesh_rays[num_mesh_rays] = ray_packet[i];
+      mesh_rays[num_mesh_rays].origin = center + mesh_min_range * ray_packet[i].direction;
+      ++num_mesh_rays;
+      if (num_mesh_rays == TriAABBTree::kPacketSize && test_mesh_rays()) {
+        return true;
+      }
+    }
+    if (num_mesh_rays > 0 && test_mesh_rays()) {
+      return true;
+    }
+    return false;
+  }
+
   MeshDataType filterUnobservableTriangles(const MeshDataType& mesh, MeshDataType* non_filtered_mesh = nullptr) {
     cout << "Loading occupancy octree" << endl;
     const string octree_filename = options_.getValue<string>("octree_filename");
@@ -510,23 +564,12 @@ public:
     std::vector<size_t> observed_triangle_indices;
     std::vector<size_t> non_observed_triangle_indices;
 
-    ml::TriMesh<FloatType> ml_tri_mesh(mesh);
-    std::vector<typename ml::TriMesh<FloatType>::Triangle> ml_triangles;
-    for (size_t q = 0; q < ml_tri_mesh.m_indices.size(); ++q) {
-      const auto& v1 = ml_tri_mesh.m_vertices[ml_tri_mesh.m_indices[q][0]];
-      const auto& v2 = ml_tri_mesh.m_vertices[ml_tri_mesh.m_indices[q][1]];
-      const auto& v3 = ml_tri_mesh.m_vertices[ml_tri_mesh.m_indices[q][2]];
-      typename ml::TriMesh<FloatType>::Triangle triangle(&v1, &v2, &v3);
-      ml_triangles.emplace_back(&v1, &v2, &v3);
-    }
-
     cout << "Refined mesh has " << mesh.m_FaceIndicesVertices.size() << " vertices" << endl;
     cout << "Building triangle AABB tree" << endl;
     const TriangleMeshType tri_mesh = bh::MLibUtilities::convertMlibToBh(mesh);
     const std::vector<Triangle> triangles = tri_mesh.getTriangles();
     TriAABBTree tri_aabb_tree(triangles);
     cout << "done" << endl;
-    TriMeshAcceleratorType tri_mesh_acc(mesh);
 
     // Generate ray directions on the unit sphere
     TriangleMeshType icosahedron_mesh = bh::TriangleMeshFactory<FloatType>::createIcosahedron(1);
@@ -538,103 +581,45 @@ public:
     const MeshDataType ml_sphere_mesh = bh::MLibUtilities::convertBhToMlib(sphere_mesh);
     MeshIOType::saveToFile("sphere_mesh.ply", ml_sphere_mesh);
 
-    const FloatType mesh_min_range = FloatType(1e-5);
     const FloatType min_visible_rays_ratio = options_.min_visible_rays_ratio;
     const size_t min_visible_rays = size_t(min_visible_rays_ratio * sphere_mesh.vertices().size());
-    // TODO
-//    size_t min_visible_rays = size_t(min_visible_rays_ratio * sphere_mesh.vertices().size());
-//    min_visible_rays = 1;
     cout << "Minimum number of visible rays for observation = " << min_visible_rays << endl;
 
-    const size_t report_interval = (size_t)(mesh.m_FaceIndicesVertices.size() / 1000.0);
-    size_t report_counter = 0;
-    const size_t batch_size = 100000;
-    for (std::size_t i = 0; i < mesh.m_FaceIndicesVertices.size(); ++i, ++report_counter) {
-//      if (i != 15934) {
-//        continue;
-//      }
-      if (report_counter >= report_interval) {
-        cout << "processed " << i << " out of " << mesh.m_FaceIndicesVertices.size() << " triangles" << endl;
-        report_counter = 0;
+    // All triangles share the same set of ray directions so the inverse directions are only computed once.
+    std::vector<TriAABBTree::RayDataType, Eigen::aligned_allocator<TriAABBTree::RayDataType>> ray_packet;
+    for (const Vector3& direction : sphere_mesh.vertices()) {
+      ray_packet.emplace_back(Vector3::Zero(), direction);
+    }
+
+    const size_t num_triangles = mesh.m_FaceIndicesVertices.size();
+    std::vector<char> triangle_observed(num_triangles, false);
+    const size_t chunk_size = std::max<size_t>(options_.triangle_chunk_size, num_triangles / 1000);
+    bh::Timer timer;
+    for (size_t chunk_begin = 0; chunk_begin < num_triangles; chunk_begin += chunk_size) {
+      const size_t chunk_end = std::min(chunk_begin + chunk_size, num_triangles);
+#pragma omp parallel for schedule(dynamic, 64)
+      for (size_t i = chunk_begin; i < chunk_end; ++i) {
+        const MeshDataType::Indices::Face& face = mesh.m_FaceIndicesVertices[i];
+        BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
+        const Triangle tri(
+                bh::MLibUtilities::convertMlibToEigen(mesh.m_Vertices[face[0]]),
+                bh::MLibUtilities::convertMlibToEigen(mesh.m_Vertices[face[1]]),
+                bh::MLibUtilities::convertMlibToEigen(mesh.m_Vertices[face[2]]));
+        triangle_observed[i] = isTriangleObservable(
+                tri, *valid_position_bvh_tree, tri_aabb_tree, min_visible_rays, min_range, max_range, ray_packet);
       }
+      const double elapsed_seconds = timer.getElapsedTime();
+      cout << "processed " << chunk_end << " out of " << num_triangles << " triangles ("
+           << chunk_end / elapsed_seconds << " triangles/s)" << endl;
+    }
 
+    for (size_t i = 0; i < num_triangles; ++i) {
       const MeshDataType::Indices::Face& face = mesh.m_FaceIndicesVertices[i];
-      BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
-
-      Triangle tri(
+      const Triangle tri(
               bh::MLibUtilities::convertMlibToEigen(mesh.m_Vertices[face[0]]),
               bh::MLibUtilities::convertMlibToEigen(mesh.m_Vertices[face[1]]),
               bh::MLibUtilities::convertMlibToEigen(mesh.m_Vertices[face[2]]));
-      const Vector3 center = tri.getCenter();
-      const Vector3 normal = tri.getNormal();
-
-      bool filter = false;
-      size_t visible_rays = 0;
-      for (size_t j = 0; j < sphere_mesh.vertices().size(); j += batch_size) {
-        std::vector<BvhTreeType::RayType> rays;
-        for (size_t k = 0; k < batch_size; ++k) {
-          size_t idx = j + k;
-          if (idx >= sphere_mesh.vertices().size()) {
-            break;
-          }
-          const Vector3 direction = sphere_mesh.vertices()[idx];
-          const BvhTreeType::RayType ray(center + min_range * direction, direction);
-          // Additional checks: Make sure ray direction lies in triangle's oriented half-sphere
-          const bool valid_direction = ray.direction.dot(normal) > 0;
-          if (valid_direction) {
-            rays.push_back(ray);
-          }
-        }
-//        if (i == 14225) {
-//          BH_PRINT_VALUE(i);
-//        }
-        std::vector<BvhTreeType::IntersectionResult> results = valid_position_bvh_tree->intersectsCuda(rays, 0, max_range);
-        BH_ASSERT(results.size() == rays.size());
-        for (size_t k = 0; k < results.size(); ++k) {
-          const BvhTreeType::IntersectionResult& result = results[k];
-          const BvhTreeType::RayType& ray = rays[k];
-//          if (i == 14225) {
-//            BH_PRINT_VALUE(result.node != nullptr);
-//            BH_PRINT_VALUE(result.node->getObject()->is_valid_object_position);
-//            BH_PRINT_VALUE(pose_sample_bbox_.isInside(result.intersection));
-//          }
-          if (result.node != nullptr && result.node->getObject()->is_valid_object_position
-              && pose_sample_bbox_.isInside(result.intersection)) {
-            const TriAABBTree::RayDataType mesh_ray(center + mesh_min_range * ray.direction, ray.direction);
-            const TriAABBTree::RayIntersection ri = tri_aabb_tree.intersect(mesh_ray, 0, max_range);
-//            const ml::Ray<FloatType> ml_ray(bh::MLibUtilities::convertEigenToMlib(mesh_ray.origin),
-//                                            bh::MLibUtilities::convertEigenToMlib(mesh_ray.direction));
-//            const TriMeshAcceleratorType::Intersection ml_ri = tri_mesh_acc.intersect(ml_ray, 0, max_range);
-//            if (ri.doesIntersect() != ml_ri.isValid()) {
-//              BH_PRINT_VALUE(ri.doesIntersect());
-//              BH_PRINT_VALUE(ml_ri.isValid());
-//            }
-//            BH_ASSERT(ri.doesIntersect() == ml_ri.isValid());
-            if (!ri.doesIntersect()) {
-              ++visible_rays;
-              if (visible_rays >= min_visible_rays) {
-                filter = true;
-                break;
-              }
-            }
-//            if (i == 14225) {
-//              BH_PRINT_VALUE(i);
-//              BH_PRINT_VALUE(ri.doesIntersect());
-//              BH_PRINT_VALUE(mesh_ray.origin.transpose());
-//              BH_PRINT_VALUE(mesh_ray.direction.transpose());
-//            }
-          }
-        }
-        if (filter) {
-          break;
-        }
-      }
-
-//      if (i == 14225) {
-//        BH_PRINT_VALUE(i);
-//        BH_PRINT_VALUE(visible_rays);
-//      }
-      if (filter) {
+      if (triangle_observed[i]) {
         observed_triangles.push_back(tri);
         observed_triangle_indices.push_back(i);
       }
@@ -681,14 +666,6 @@ public:
       MeshIOType::saveToFile(refined_mesh_filename, mesh);
     }
 
-    const int cuda_gpu_id = options_.getValue<int>("cuda_gpu_id");
-    cout << "Selecting CUDA device " << cuda_gpu_id << endl;
-    bh::CudaManager::setActiveGpuId(cuda_gpu_id);
-    cout << "Previous CUDA stack size was " << bh::CudaManager::getStackSize() << endl;
-    size_t cuda_stack_size = options_.getValue<size_t>("cuda_stack_size");
-    cout << "Setting CUDA stack size to " << cuda_stack_size << endl;
-    bh::CudaManager::setStackSize(cuda_stack_size);
-
     cout << "Filtering observable triangles" << endl;
     MeshDataType unobservable_mesh;
     mesh = filterUnobservableTriangles(mesh, &unobservable_mesh);
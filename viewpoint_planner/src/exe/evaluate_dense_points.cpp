@@ -8,12 +8,13 @@
 
 #include <iostream>
 #include <memory>
+#include <numeric>
+#include <fstream>
 #include <csignal>
 
 #include <bh/boost.h>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/functional/hash.hpp>
 
 #include <bh/common.h>
 #include <bh/eigen.h>
@@ -23,8 +24,11 @@
 #include <bh/config_options.h>
 #include <bh/eigen_options.h>
 #include <bh/math/geometry.h>
+#include <bh/string_utils.h>
 #include <bh/mLib/mLibUtils.h>
-#include <bh/nn/approximate_nearest_neighbor.h>
+#include <bh/mesh/triangle_distance_tree.h>
+#include <bh/mesh/ply_point_reader.h>
+#include <bh/nn/voxel_hash_point_index.h>
 
 #include <bh/mLib/mLib.h>
 
@@ -42,9 +46,9 @@ using PointCloudIOType = ml::PointCloudIO<FloatType>;
 using MeshDataType = ml::MeshData<FloatType>;
 using TriMeshType = ml::TriMesh<FloatType>;
 using MeshIOType = ml::MeshIO<FloatType>;
-using RayType = ml::Ray<FloatType>;
-using TriMeshAcceleratorType = ml::TriMeshAcceleratorBVH<FloatType>;
 using Triangle = bh::Triangle<FloatType>;
+using TriangleDistanceTreeType = bh::TriangleDistanceTree<FloatType>;
+using PointIndexType = bh::VoxelHashPointIndex<FloatType>;
 
 class EvaluateDensePointsCmdline {
 public:
@@ -56,8 +60,9 @@ public:
       addOptionRequired<Vector3>("roi_bbox_min", &roi_bbox_min);
       addOptionRequired<Vector3>("roi_bbox_max", &roi_bbox_max);
       addOption<FloatType>("max_correspondence_distance", &max_correspondence_distance);
-      addOption<size_t>("max_radius_search_results", &max_radius_search_results);
       addOption<FloatType>("dist_truncation", &dist_truncation);
+      addOption<string>("evaluation_thresholds", &evaluation_thresholds);
+      addOption<size_t>("point_chunk_size", &point_chunk_size);
     }
 
     ~Options() override {}
@@ -65,8 +70,11 @@ public:
     Vector3 roi_bbox_min;
     Vector3 roi_bbox_max;
     FloatType max_correspondence_distance = FloatType(0.2);
-    size_t max_radius_search_results = 500;
     FloatType dist_truncation = FloatType(0.2);
+    // Distance thresholds for precision and recall (comma separated)
+    string evaluation_thresholds = "0.01,0.02,0.05,0.1,0.2";
+    // Number of input points that are processed at once
+    size_t point_chunk_size = 1000000;
   };
 
   static std::map<string, std::unique_ptr<bh::ConfigOptions>> getConfigOptions() {
@@ -82,206 +90,265 @@ public:
       const string& ground_truth_mesh_filename,
       const string& in_point_cloud_filename,
       const string& negative_output_mesh_filename,
-      const string& positive_output_mesh_filename)
+      const string& positive_output_mesh_filename,
+      const string& out_statistics_filename)
   : options_(*dynamic_cast<Options*>(config_options.at(Options::kPrefix).get())),
     ground_truth_mesh_filename_(ground_truth_mesh_filename),
     in_point_cloud_filename_(in_point_cloud_filename),
     negative_output_mesh_filename_(negative_output_mesh_filename),
     positive_output_mesh_filename_(positive_output_mesh_filename),
-    roi_bbox_(options_.roi_bbox_min, options_.roi_bbox_max) {}
+    out_statistics_filename_(out_statistics_filename),
+    roi_bbox_(options_.roi_bbox_min, options_.roi_bbox_max) {
+    evaluation_thresholds_ = bh::splitString<FloatType>(options_.evaluation_thresholds, ",");
+    if (evaluation_thresholds_.empty()) {
+      throw BH_EXCEPTION("At least one evaluation threshold is required");
+    }
+    std::sort(evaluation_thresholds_.begin(), evaluation_thresholds_.end());
+    BH_ASSERT(options_.point_chunk_size > 0);
+  }
 
   ~EvaluateDensePointsCmdline() {
   }
 
-  struct Vector3Hash {
-    size_t operator()(const Vector3& v) const {
-      size_t val { 0 };
-      boost::hash_combine(val, boost::hash<float>{}(v(0)));
-      boost::hash_combine(val, boost::hash<float>{}(v(1)));
-      boost::hash_combine(val, boost::hash<float>{}(v(2)));
-      return val;
-    }
+  struct Statistics {
+    // Accuracy: Distances from the input points inside the region of interest to the ground truth mesh
+    size_t num_accuracy_points = 0;
+    FloatType average_trunc_accuracy_dist_square = 0;
+    std::vector<size_t> accuracy_histogram;
+    std::vector<FloatType> precision;
+    // Completeness: Distances from the ground truth triangles to the input points
+    FloatType average_trunc_dist_square = 0;
+    FloatType coverage_ratio = 0;
+    FloatType coverage_area_ratio = 0;
+    std::vector<size_t> completeness_histogram;
+    size_t num_triangles = 0;
+    std::vector<FloatType> recall;
   };
 
-  std::tuple<MeshDataType, MeshDataType> evaluate(const MeshDataType& gt_mesh, const PointCloudType& input_point_cloud) const {
-    std::vector<FloatType> triangle_areas;
-    triangle_areas.reserve(gt_mesh.m_FaceIndicesVertices.size());
+  /// Calls func(const std::vector<Vector3>& points) for consecutive chunks of the input point cloud.
+  /// PLY files are streamed from disk, other formats are loaded with mLib.
+  template <typename Func>
+  void forEachPointChunk(const string& filename, Func func) const {
+    std::vector<Vector3> points;
+    if (boost::filesystem::path(filename).extension() == ".ply") {
+      bh::PlyPointReader reader(filename);
+      cout << "Number of vertices in input point cloud: " << reader.numOfPoints() << endl;
+      while (reader.readPoints(options_.point_chunk_size, &points) > 0) {
+        func(points);
+      }
+    }
+    else {
+      PointCloudType input_point_cloud;
+      PointCloudIOType::loadFromFile(filename, input_point_cloud);
+      cout << "Number of vertices in input point cloud: " << input_point_cloud.m_points.size() << endl;
+      for (size_t i = 0; i < input_point_cloud.m_points.size(); i += options_.point_chunk_size) {
+        const size_t chunk_end = std::min(i + options_.point_chunk_size, input_point_cloud.m_points.size());
+        points.clear();
+        for (size_t j = i; j < chunk_end; ++j) {
+          points.push_back(bh::MLibUtilities::convertMlibToEigen(input_point_cloud.m_points[j]));
+        }
+        func(points);
+      }
+    }
+  }
+
+  std::vector<FloatType> getHistogramBins() const {
+    // Bins of squared distances
+    const size_t num_bins = 10;
+    const FloatType dist_square_truncation = options_.dist_truncation * options_.dist_truncation;
+    std::vector<FloatType> histogram_bins;
+    for (size_t i = 0; i < num_bins; ++i) {
+      const FloatType factor = i / FloatType(num_bins);
+      histogram_bins.push_back(factor * dist_square_truncation);
+    }
+    return histogram_bins;
+  }
+
+  std::tuple<MeshDataType, MeshDataType, Statistics> evaluate(
+          const MeshDataType& gt_mesh, const string& point_cloud_filename) const {
+    const size_t num_triangles = gt_mesh.m_FaceIndicesVertices.size();
+    std::vector<Triangle> triangles(num_triangles);
+    std::vector<FloatType> triangle_areas(num_triangles);
 #pragma omp parallel for
-    for (std::size_t i = 0; i < gt_mesh.m_FaceIndicesVertices.size(); ++i) {
+    for (std::size_t i = 0; i < num_triangles; ++i) {
       const MeshDataType::Indices::Face &face = gt_mesh.m_FaceIndicesVertices[i];
       BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
 
-      Triangle tri(
+      triangles[i] = Triangle(
               bh::MLibUtilities::convertMlibToEigen(gt_mesh.m_Vertices[face[0]]),
               bh::MLibUtilities::convertMlibToEigen(gt_mesh.m_Vertices[face[1]]),
               bh::MLibUtilities::convertMlibToEigen(gt_mesh.m_Vertices[face[2]]));
-      const FloatType area = std::sqrt(tri.computeTriangleAreaSquare());
-      triangle_areas.push_back(area);
+      triangle_areas[i] = std::sqrt(triangles[i].computeTriangleAreaSquare());
     }
 
-    std::vector<Vector3> eigen_point_cloud;
-    eigen_point_cloud.reserve(input_point_cloud.m_points.size());
-    for (size_t i = 0; i < input_point_cloud.m_points.size(); ++i) {
-      const ml::vec3f& v = input_point_cloud.m_points[i];
-      eigen_point_cloud.push_back(bh::MLibUtilities::convertMlibToEigen(v));
+    const std::vector<FloatType>& thresholds = evaluation_thresholds_;
+    const FloatType max_threshold = thresholds.back();
+    const FloatType dist_square_truncation = options_.dist_truncation * options_.dist_truncation;
+    const std::vector<FloatType> histogram_bins = getHistogramBins();
+
+    Statistics stats;
+    stats.num_triangles = num_triangles;
+    stats.accuracy_histogram.resize(histogram_bins.size(), 0);
+    stats.precision.resize(thresholds.size(), 0);
+    stats.recall.resize(thresholds.size(), 0);
+
+    // Accuracy is computed on the fly for each chunk of points. Points that can contribute to the completeness
+    // (i.e. within completeness_radius of the ground truth mesh) are kept for the completeness computation.
+    // Only these points are held in memory, the remaining input is streamed.
+    bh::Timer timer;
+    const TriangleDistanceTreeType gt_tree(triangles);
+    timer.printTimingMs("Building triangle distance tree");
+    const FloatType accuracy_max_distance = std::max(options_.dist_truncation, max_threshold);
+    const FloatType completeness_radius = std::max(
+            std::max(options_.max_correspondence_distance, options_.dist_truncation), max_threshold);
+    BoundingBoxType completeness_bbox;
+    for (const Triangle& tri : triangles) {
+      completeness_bbox.include(tri.v1());
+      completeness_bbox.include(tri.v2());
+      completeness_bbox.include(tri.v3());
     }
-    bh::ApproximateNearestNeighbor<FloatType, 3> point_cloud_ann;
-    point_cloud_ann.initIndex(eigen_point_cloud.begin(), eigen_point_cloud.end());
-
-//    std::vector<size_t> ind;
-//    std::vector<FloatType> dist;
-//    flann::SearchParams search_params;
-//    search_params.checks = flann::FLANN_CHECKS_UNLIMITED;
-//    point_cloud_ann.setSearchParams(search_params);
-//    point_cloud_ann.radiusSearch(eigen_point_cloud.front(), 100, 1000, &ind, &dist);
-//    BH_PRINT_VALUE(ind.size());
-//    BH_PRINT_VALUE(dist.size());
-//    for (size_t i = 0; i < ind.size(); ++i) {
-//      BH_PRINT_VALUE(i);
-//      BH_PRINT_VALUE(ind[i]);
-//      BH_PRINT_VALUE(dist[i]);
-//    }
-//    ind.resize(1000);
-//    dist.resize(1000);
-//    point_cloud_ann.knnSearch(eigen_point_cloud.front(), 1000, &ind, &dist);
-//    BH_PRINT_VALUE(ind.size());
-//    BH_PRINT_VALUE(dist.size());
-//    for (size_t i = 0; i < ind.size(); ++i) {
-//      BH_PRINT_VALUE(i);
-//      BH_PRINT_VALUE(ind[i]);
-//      BH_PRINT_VALUE(dist[i]);
-//    }
-//    point_cloud_ann.radiusSearchExact(eigen_point_cloud.front(), 100, 1000, &ind, &dist);
-//    BH_PRINT_VALUE(ind.size());
-//    BH_PRINT_VALUE(dist.size());
-//    for (size_t i = 0; i < ind.size(); ++i) {
-//      BH_PRINT_VALUE(i);
-//      BH_PRINT_VALUE(ind[i]);
-//      BH_PRINT_VALUE(dist[i]);
-//    }
-//    BH_DEBUG_BREAK;
-
-//    point_cloud_ann.
+    completeness_bbox = BoundingBoxType(
+            completeness_bbox.getMinimum() - Vector3::Constant(completeness_radius),
+            completeness_bbox.getMaximum() + Vector3::Constant(completeness_radius));
+
+    timer.reset();
+    const FloatType completeness_radius_square = completeness_radius * completeness_radius;
+    std::vector<Vector3> completeness_points;
+    std::vector<Vector3> completeness_candidates;
+    std::vector<Vector3> roi_points;
+    std::vector<TriangleDistanceTreeType::QueryResult> query_results;
+    std::vector<FloatType> accuracy_dist_square;
+    std::vector<size_t> num_precise_points(thresholds.size(), 0);
+    FloatType sum_trunc_accuracy_dist_square = 0;
+    forEachPointChunk(point_cloud_filename, [&](const std::vector<Vector3>& points) {
+      roi_points.clear();
+      completeness_candidates.clear();
+      for (const Vector3& point : points) {
+        if (roi_bbox_.isInside(point)) {
+          roi_points.push_back(point);
+        }
+        if (completeness_bbox.isInside(point)) {
+          completeness_candidates.push_back(point);
+        }
+      }
+      query_results.resize(completeness_candidates.size());
+      gt_tree.findClosestTriangles(completeness_candidates.data(), completeness_candidates.size(),
+                                   completeness_radius, query_results.data());
+      for (size_t i = 0; i < query_results.size(); ++i) {
+        if (query_results[i].isValid() && query_results[i].distance_square <= completeness_radius_square) {
+          completeness_points.push_back(completeness_candidates[i]);
+        }
+      }
 
-    const FloatType max_correspondence_dist = options_.max_correspondence_distance;
-    const size_t max_results = options_.max_radius_search_results;
+      query_results.resize(roi_points.size());
+      gt_tree.findClosestTriangles(roi_points.data(), roi_points.size(), accuracy_max_distance, query_results.data());
+      accuracy_dist_square.resize(roi_points.size());
+      for (size_t i = 0; i < query_results.size(); ++i) {
+        const FloatType dist_square = query_results[i].distance_square;
+        accuracy_dist_square[i] = dist_square;
+        sum_trunc_accuracy_dist_square += std::min(dist_square, dist_square_truncation);
+        for (size_t k = 0; k < thresholds.size(); ++k) {
+          if (dist_square <= thresholds[k] * thresholds[k]) {
+            ++num_precise_points[k];
+          }
+        }
+      }
+      const std::vector<size_t> chunk_histogram = bh::computeHistogram(
+              accuracy_dist_square.begin(), accuracy_dist_square.end(),
+              histogram_bins.begin(), histogram_bins.end());
+      for (size_t i = 0; i < chunk_histogram.size(); ++i) {
+        stats.accuracy_histogram[i] += chunk_histogram[i];
+      }
+      stats.num_accuracy_points += roi_points.size();
+    });
+    timer.printTimingMs("Computing accuracy");
+    if (stats.num_accuracy_points > 0) {
+      stats.average_trunc_accuracy_dist_square = sum_trunc_accuracy_dist_square / stats.num_accuracy_points;
+      for (size_t k = 0; k < thresholds.size(); ++k) {
+        stats.precision[k] = num_precise_points[k] / FloatType(stats.num_accuracy_points);
+      }
+    }
 
-    std::vector<size_t> num_correspondences(gt_mesh.m_FaceIndicesVertices.size(), 0);
-    std::vector<FloatType> dist_square_closest_point(gt_mesh.m_FaceIndicesVertices.size(), std::numeric_limits<FloatType>::max());
-    std::vector<Vector3> closest_point(gt_mesh.m_FaceIndicesVertices.size());
-#pragma omp parallel for
-    for (std::size_t i = 0; i < gt_mesh.m_FaceIndicesVertices.size(); ++i) {
-//      if (i != 9012) {
-//        continue;
-//      }
-      const MeshDataType::Indices::Face& face = gt_mesh.m_FaceIndicesVertices[i];
-      BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
+    timer.reset();
+    cout << "Number of points for completeness: " << completeness_points.size() << endl;
+    PointIndexType point_index(completeness_radius);
+    point_index.build(completeness_points.begin(), completeness_points.end());
+    completeness_points = std::vector<Vector3>();
 
-      Triangle tri(
-              bh::MLibUtilities::convertMlibToEigen(gt_mesh.m_Vertices[face[0]]),
-              bh::MLibUtilities::convertMlibToEigen(gt_mesh.m_Vertices[face[1]]),
-              bh::MLibUtilities::convertMlibToEigen(gt_mesh.m_Vertices[face[2]]));
-      const Vector3 center = tri.getCenter();
-//      const FloatType l1 = (tri.v1() - center).squaredNorm();
-//      const FloatType l2 = (tri.v2() - center).squaredNorm();
-//      const FloatType l3 = (tri.v3() - center).squaredNorm();
-//      const FloatType max_length_square = std::max(l1, std::max(l2, l3));
-//      const FloatType max_length = std::sqrt(max_length_square);
-
-//      const FloatType radius = std::max(max_length, options_.max_correspondence_distance);
-//      const FloatType radius_square = radius * radius;
-      std::vector<size_t> indices;
-      std::vector<FloatType> distances;
-//      point_cloud_ann.radiusSearch(center, radius_square, max_results, &indices, &distances);
-      indices.resize(max_results);
-      distances.resize(max_results);
-      point_cloud_ann.knnSearch(center, max_results, &indices, &distances);
-//      // Testing radius search
-//      std::vector<size_t> indices2;
-//      std::vector<FloatType> distances2;
-//      point_cloud_ann.radiusSearchExact(center, radius_square, max_results, &indices2, &distances2);
-////      BH_ASSERT(indices.size() == indices2.size());
-//      indices = indices2;
-//      distances = distances2;
-      for (size_t j = 0; j < indices.size(); ++j) {
-        const size_t index = indices[j];
-//        const FloatType distance_square = distances[j];
-        const Vector3 point = eigen_point_cloud[index];
+    const FloatType max_correspondence_dist = options_.max_correspondence_distance;
+
+    std::vector<size_t> num_correspondences(num_triangles, 0);
+    std::vector<FloatType> dist_square_closest_point(num_triangles, std::numeric_limits<FloatType>::max());
+    std::vector<FloatType> dist_square_closest_point_any(num_triangles, std::numeric_limits<FloatType>::max());
+    // Each triangle considers all points within completeness_radius of its bounding box.
+    // Points further away cannot affect the statistics because the truncation distance and all
+    // thresholds are at most completeness_radius.
+#pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t i = 0; i < num_triangles; ++i) {
+      const Triangle& tri = triangles[i];
+      BoundingBoxType search_bbox;
+      search_bbox.include(tri.v1());
+      search_bbox.include(tri.v2());
+      search_bbox.include(tri.v3());
+      search_bbox = BoundingBoxType(
+              search_bbox.getMinimum() - Vector3::Constant(completeness_radius),
+              search_bbox.getMaximum() + Vector3::Constant(completeness_radius));
+      point_index.forEachPointInBox(search_bbox, [&](const Vector3& point) {
+        // Closest distance of any point (used for recall)
+        const FloatType dist_square_any = TriangleDistanceTreeType::computePointTriangleDistanceSquare(point, tri);
+        dist_square_closest_point_any[i] = std::min(dist_square_closest_point_any[i], dist_square_any);
         const bool projects_onto_triangle = tri.doesPointProjectOntoTriangle(point);
         if (projects_onto_triangle) {
           const FloatType distance_to_triangle = tri.distanceToSurface(point);
           const FloatType distance_to_triangle_square = distance_to_triangle * distance_to_triangle;
           if (distance_to_triangle_square <= dist_square_closest_point[i]) {
             dist_square_closest_point[i] = distance_to_triangle_square;
-            closest_point[i] = point;
           }
           if (std::abs(distance_to_triangle) <= max_correspondence_dist) {
             ++num_correspondences[i];
           }
         }
-      }
+      });
     }
+    timer.printTimingMs("Computing completeness");
 
     const size_t min_num_correspondences_for_coverage = 1;
-    const FloatType dist_square_truncation = options_.dist_truncation * options_.dist_truncation;
 
     const FloatType sum_trunc_dist_square = std::accumulate(dist_square_closest_point.begin(), dist_square_closest_point.end(), FloatType(0),
                                                     [&] (const FloatType value, const FloatType dist_square) {
       const FloatType dist_square_truncated = std::min(dist_square, dist_square_truncation);
       return value + dist_square_truncated;
     });
-    const FloatType average_trunc_dist_square = sum_trunc_dist_square / dist_square_closest_point.size();
-    cout << "average_trunc_dist_square = " << average_trunc_dist_square << endl;
+    stats.average_trunc_dist_square = sum_trunc_dist_square / dist_square_closest_point.size();
 
     const size_t num_covered_triangles = std::count_if(num_correspondences.begin(), num_correspondences.end(),
                                                        [&] (const size_t num_correspondence) {
       return num_correspondence >= min_num_correspondences_for_coverage;
     });
-    const FloatType coverage_ratio = num_covered_triangles / FloatType(num_correspondences.size());
-    cout << "coverage_ratio = " << coverage_ratio << endl;
+    stats.coverage_ratio = num_covered_triangles / FloatType(num_correspondences.size());
 
-    // TODO: Compute covered area
     FloatType covered_area= 0;
     FloatType total_area = 0;
+    std::vector<FloatType> recalled_area(thresholds.size(), 0);
     for (size_t i = 0; i < triangle_areas.size(); ++i) {
       if (num_correspondences[i] >= min_num_correspondences_for_coverage) {
         covered_area += triangle_areas[i];
       }
+      for (size_t k = 0; k < thresholds.size(); ++k) {
+        if (dist_square_closest_point_any[i] <= thresholds[k] * thresholds[k]) {
+          recalled_area[k] += triangle_areas[i];
+        }
+      }
       total_area += triangle_areas[i];
     }
-    const FloatType coverage_area_ratio = covered_area / FloatType(total_area);
-    cout << "coverage_area_ratio = " << coverage_area_ratio << endl;
-
-    // Compute histogram of truncated squared distances
-//    std::vector<FloatType> dist_square_trunc_closest_point;
-//    std::transform(dist_square_closest_point.begin(), dist_square_closest_point.end(),
-//                   std::back_inserter(dist_square_trunc_closest_point),
-//                   [&](const FloatType dist_square) {
-//                     return std::min(dist_square, dist_square_truncation);
-//                   });
-    const size_t num_bins = 10;
-    std::vector<FloatType> histogram_bins;
-    for (size_t i = 0; i < num_bins; ++i) {
-      const FloatType factor = i / FloatType(num_bins);
-      histogram_bins.push_back(factor * dist_square_truncation);
+    stats.coverage_area_ratio = covered_area / FloatType(total_area);
+    for (size_t k = 0; k < thresholds.size(); ++k) {
+      stats.recall[k] = recalled_area[k] / total_area;
     }
-    const std::vector<size_t> histogram = bh::computeHistogram(
+
+    stats.completeness_histogram = bh::computeHistogram(
             dist_square_closest_point.begin(), dist_square_closest_point.end(),
             histogram_bins.begin(), histogram_bins.end());
-    cout << "Histogram of distances:" << endl;
-    for (size_t i = 0; i < histogram_bins.size(); ++i) {
-      const FloatType bin_low = std::sqrt(histogram_bins[i]);
-      FloatType bin_high;
-      if (i + 1< histogram_bins.size()) {
-        bin_high = std::sqrt(histogram_bins[i + 1]);
-      }
-      else {
-        bin_high = std::numeric_limits<FloatType>::infinity();
-      }
-      const size_t count = histogram[i];
-      const FloatType relative_count = count / (FloatType)dist_square_closest_point.size();
-      cout << "  Bin [" << bin_low << ", " << bin_high << "): " << relative_count << endl;
-    }
 
     // Copy mesh and add different colors for covered and non-covered triangles
     MeshDataType negative_output_mesh;
@@ -303,7 +370,45 @@ public:
       negative_output_mesh.m_Colors.push_back(ml::vec4<FloatType>(0.8, 0, 0, 1));
       positive_output_mesh.m_Colors.push_back(ml::vec4<FloatType>(0, 0.8, 0, 1));
     }
-    return std::make_tuple(std::move(negative_output_mesh), std::move(positive_output_mesh));
+    return std::make_tuple(std::move(negative_output_mesh), std::move(positive_output_mesh), std::move(stats));
+  }
+
+  void printHistogram(std::ostream& out, const std::vector<size_t>& histogram, const size_t total_count) const {
+    const std::vector<FloatType> histogram_bins = getHistogramBins();
+    for (size_t i = 0; i < histogram_bins.size(); ++i) {
+      const FloatType bin_low = std::sqrt(histogram_bins[i]);
+      FloatType bin_high;
+      if (i + 1< histogram_bins.size()) {
+        bin_high = std::sqrt(histogram_bins[i + 1]);
+      }
+      else {
+        bin_high = std::numeric_limits<FloatType>::infinity();
+      }
+      const size_t count = histogram[i];
+      const FloatType relative_count = total_count > 0 ? count / (FloatType)total_count : 0;
+      out << "  Bin [" << bin_low << ", " << bin_high << "): " << relative_count << endl;
+    }
+  }
+
+  void printStatistics(std::ostream& out, const Statistics& stats) const {
+    out << "num_accuracy_points = " << stats.num_accuracy_points << endl;
+    out << "average_trunc_accuracy_dist_square = " << stats.average_trunc_accuracy_dist_square << endl;
+    out << "Histogram of accuracy distances:" << endl;
+    printHistogram(out, stats.accuracy_histogram, stats.num_accuracy_points);
+    out << "average_trunc_dist_square = " << stats.average_trunc_dist_square << endl;
+    out << "coverage_ratio = " << stats.coverage_ratio << endl;
+    out << "coverage_area_ratio = " << stats.coverage_area_ratio << endl;
+    out << "Histogram of distances:" << endl;
+    printHistogram(out, stats.completeness_histogram, stats.num_triangles);
+    for (size_t k = 0; k < evaluation_thresholds_.size(); ++k) {
+      const FloatType precision = stats.precision[k];
+      const FloatType recall = stats.recall[k];
+      const FloatType f_score = precision + recall > 0 ? 2 * precision * recall / (precision + recall) : 0;
+      out << "threshold = " << evaluation_thresholds_[k]
+          << ", precision = " << precision
+          << ", recall = " << recall
+          << ", f_score = " << f_score << endl;
+    }
   }
 
   bool run() {
@@ -311,13 +416,18 @@ public:
     MeshIOType::loadFromFile(ground_truth_mesh_filename_, gt_mesh);
     cout << "Number of vertices in ground truth mesh: " << gt_mesh.m_Vertices.size() << endl;
 
-    PointCloudType input_point_cloud;
-    PointCloudIOType::loadFromFile(in_point_cloud_filename_, input_point_cloud);
-    cout << "Number of vertices in input point cloud: " << input_point_cloud.m_points.size() << endl;
-
     MeshDataType negative_output_mesh;
     MeshDataType positive_output_mesh;
-    std::tie(negative_output_mesh, positive_output_mesh) = evaluate(gt_mesh, input_point_cloud);
+    Statistics stats;
+    std::tie(negative_output_mesh, positive_output_mesh, stats) = evaluate(gt_mesh, in_point_cloud_filename_);
+    printStatistics(cout, stats);
+    if (!out_statistics_filename_.empty()) {
+      std::ofstream ofs(out_statistics_filename_);
+      if (!ofs) {
+        throw BH_EXCEPTION("Unable to open statistics output file");
+      }
+      printStatistics(ofs, stats);
+    }
     if (!negative_output_mesh_filename_.empty()) {
       MeshIOType::saveToFile(negative_output_mesh_filename_, negative_output_mesh);
     }
@@ -334,7 +444,9 @@ private:
   string in_point_cloud_filename_;
   string negative_output_mesh_filename_;
   string positive_output_mesh_filename_;
+  string out_statistics_filename_;
   BoundingBoxType roi_bbox_;
+  std::vector<FloatType> evaluation_thresholds_;
 };
 
 const string EvaluateDensePointsCmdline::Options::kPrefix = "evaluate_dense_points";
@@ -354,6 +466,7 @@ std::pair<bool, boost::program_options::variables_map> processOptions(
         ("in-point-cloud", po::value<string>()->required(), "File to load the input point cloud from.")
         ("negative-output-mesh", po::value<string>()->default_value(""), "File to write the negative mesh to.")
         ("positive-output-mesh", po::value<string>()->default_value(""), "File to write the positive mesh to.")
+        ("out-statistics", po::value<string>()->default_value(""), "File to write the evaluation statistics to.")
         ;
 
     po::options_description options;
@@ -425,7 +538,8 @@ int main(int argc, char** argv)
       vm["ground-truth-mesh"].as<string>(),
       vm["in-point-cloud"].as<string>(),
       vm["negative-output-mesh"].as<string>(),
-      vm["positive-output-mesh"].as<string>());
+      vm["positive-output-mesh"].as<string>(),
+      vm["out-statistics"].as<string>());
 
   if (evaluate_cmdline.run()) {
     return 0;
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <memory>
 #include <csignal>
+#include <unordered_set>
 
 #include <bh/boost.h>
 #include <boost/program_options.hpp>
@@ -18,6 +19,8 @@
 #include <bh/common.h>
 #include <bh/eigen.h>
 #include <bh/utilities.h>
+#include <bh/thread.h>
+#include <bh/memory.h>
 #include <bh/math/utilities.h>
 #include <bh/config_options.h>
 #include <bh/filesystem.h>
@@ -33,6 +36,10 @@
 #include <QApplication>
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <bh/gps.h>
 #include <bh/string_utils.h>
 #include <bh/pose.h>
@@ -100,6 +107,14 @@ public:
       addOption<size_t>("num_ransac_iterations", &num_ransac_iterations);
       addOption<bool>("guided_matching", &guided_matching);
       addOption<bool>("delete_feature_matches_in_db", &delete_feature_matches_in_db);
+      addOption<bool>("resume", &resume);
+      addOption<size_t>("num_matching_threads", &num_matching_threads);
+      addOption<size_t>("num_verification_threads", &num_verification_threads);
+      addOption<size_t>("omp_threads_per_worker", &omp_threads_per_worker);
+      addOption<size_t>("feature_cache_size", &feature_cache_size);
+      addOption<size_t>("pipeline_queue_size", &pipeline_queue_size);
+      addOption<size_t>("db_write_batch_size", &db_write_batch_size);
+      addOption<size_t>("progress_report_interval", &progress_report_interval);
       addOption<bool>("dump_prior_mesh_images", &dump_prior_mesh_images);
       addOption<bool>("dump_keypoint_images", &dump_keypoint_images);
       addOption<bool>("dump_match_images", &dump_match_images);
@@ -133,6 +148,18 @@ public:
     size_t num_ransac_iterations = 10000;
     bool guided_matching = true;
     bool delete_feature_matches_in_db = false;
+    // Skip image pairs that already have an entry in the matches and inlier matches tables
+    bool resume = false;
+    size_t num_matching_threads = 2;
+    size_t num_verification_threads = 2;
+    // Number of OpenMP threads used within each matching and verification worker (0 to divide the cores evenly)
+    size_t omp_threads_per_worker = 0;
+    // Maximum number of images whose keypoints and descriptors are kept in memory
+    size_t feature_cache_size = 200;
+    size_t pipeline_queue_size = 16;
+    // Number of image pairs written to the database in one transaction
+    size_t db_write_batch_size = 50;
+    size_t progress_report_interval = 100;
     bool dump_prior_mesh_images = false;
     bool dump_keypoint_images = false;
     bool dump_match_images = false;
@@ -166,6 +193,66 @@ public:
   using ImageIdToSiftDescriptorMap = EIGEN_ALIGNED_UNORDERED_MAP(ImageId, SiftDescriptor);
   using ImageIdToSiftDescriptorVectorMap = EIGEN_ALIGNED_UNORDERED_MAP(ImageId, SiftDescriptorVector);
 
+  /// Keypoints and descriptors of a single image as needed by the matching and verification stages
+  struct ImageFeatures {
+    std::vector<Keypoint> keypoints;
+    std::vector<Keypoint> undist_keypoints;
+    std::vector<Vector2> world_points;
+    SiftDescriptorVector descriptors;
+  };
+
+  using ImageFeaturesPtr = std::shared_ptr<const ImageFeatures>;
+  using ImageFeaturesCache = bh::LRUCache<ImageId, const ImageFeatures>;
+  using ImageMatches = std::vector<std::pair<size_t, size_t>>;
+
+  /// Work item that is passed through the stages of the matching pipeline
+  struct ImagePairJob {
+    ImageId image_id1;
+    ImageId image_id2;
+    ImageFeaturesPtr features1;
+    ImageFeaturesPtr features2;
+    ImageMatches matches;
+    ImageMatches inlier_matches;
+  };
+
+  struct PipelineStageStatistics {
+    PipelineStageStatistics()
+            : num_processed(0), busy_time_us(0) {}
+
+    void addBusyTime(const bh::Timer& timer) {
+      busy_time_us += static_cast<uint64_t>(timer.getElapsedTime() * 1e6);
+    }
+
+    double busyTime() const {
+      return busy_time_us * 1e-6;
+    }
+
+    std::atomic<size_t> num_processed;
+    std::atomic<uint64_t> busy_time_us;
+  };
+
+  /// Loader -> matching workers -> verification workers -> database writer.
+  /// All stages are connected by bounded queues so that memory does not grow with the dataset.
+  struct MatchingPipeline {
+    explicit MatchingPipeline(const size_t queue_size)
+            : match_queue(queue_size), verification_queue(queue_size), write_queue(queue_size),
+              num_skipped_pairs(0), feature_cache_hits(0), feature_cache_misses(0) {}
+
+    bh::BoundedQueue<ImagePairJob> match_queue;
+    bh::BoundedQueue<ImagePairJob> verification_queue;
+    bh::BoundedQueue<ImagePairJob> write_queue;
+    PipelineStageStatistics loader_statistics;
+    PipelineStageStatistics matching_statistics;
+    PipelineStageStatistics verification_statistics;
+    PipelineStageStatistics writer_statistics;
+    std::atomic<size_t> num_skipped_pairs;
+    std::atomic<size_t> feature_cache_hits;
+    std::atomic<size_t> feature_cache_misses;
+    bh::Timer timer;
+  };
+
+  static constexpr int kSQLiteBusyTimeoutMs = 60000;
+
   static std::map<string, std::unique_ptr<bh::ConfigOptions>> getConfigOptions() {
     std::map<string, std::unique_ptr<bh::ConfigOptions>> config_options;
     config_options.emplace(std::piecewise_construct,
@@ -286,19 +373,17 @@ public:
     return cameras_;
   };
 
-  std::unordered_map<ImageId, std::vector<Keypoint>> getKeypointsFromColmap() {
-    std::unordered_map<ImageId, std::vector<Keypoint>> all_keypoints;
-    const string query = "SELECT image_id, rows, cols, data FROM keypoints";
-    sqlite_db_->execute(
+  std::vector<Keypoint> getKeypointsFromColmap(bh::SQLite3& sqlite_db, const ImageId image_id) const {
+    std::vector<Keypoint> keypoints;
+    const string query = string("SELECT rows, cols, data FROM keypoints WHERE image_id == ") + std::to_string(image_id);
+    sqlite_db.execute(
             query,
             [&](const bh::SQLite3::RowResult& row_result) {
-              const ImageId image_id = row_result.getInt(0);
-              const int rows = row_result.getInt(1);
-              const int cols = row_result.getInt(2);
+              const int rows = row_result.getInt(0);
+              const int cols = row_result.getInt(1);
               BH_ASSERT(cols == 4);
-              std::vector<Keypoint> keypoints;
               keypoints.reserve(rows);
-              std::vector<float> data = row_result.getData<float>(3);
+              std::vector<float> data = row_result.getData<float>(2);
               BH_ASSERT(data.size() == size_t(rows * cols));
               for (size_t row = 0; row < (size_t)rows; ++row) {
                 const FloatType x = data[row * cols + 0];
@@ -308,35 +393,43 @@ public:
                 Keypoint kp(x, y, scale, orientation);
                 keypoints.push_back(kp);
               }
-              all_keypoints.emplace(image_id, keypoints);
             });
-    return all_keypoints;
+    return keypoints;
   };
 
-  ImageIdToSiftDescriptorVectorMap getDescriptorsFromColmap() {
-    ImageIdToSiftDescriptorVectorMap all_descriptors;
-    const string query = "SELECT image_id, rows, cols, data FROM descriptors";
-    sqlite_db_->execute(
+  SiftDescriptorVector getDescriptorsFromColmap(bh::SQLite3& sqlite_db, const ImageId image_id) const {
+    SiftDescriptorVector descriptors;
+    const string query = string("SELECT rows, cols, data FROM descriptors WHERE image_id == ") + std::to_string(image_id);
+    sqlite_db.execute(
             query,
             [&](const bh::SQLite3::RowResult& row_result) {
-              const ImageId image_id = row_result.getInt(0);
-              const int rows = row_result.getInt(1);
-              const int cols = row_result.getInt(2);
+              const int rows = row_result.getInt(0);
+              const int cols = row_result.getInt(1);
               BH_ASSERT(cols == 128);
-              SiftDescriptorVector descriptors;
               descriptors.reserve(rows);
-              std::vector<uint8_t> data = row_result.getData<uint8_t>(3);
+              std::vector<uint8_t> data = row_result.getData<uint8_t>(2);
               BH_ASSERT(data.size() == size_t(rows * cols));
               for (size_t row = 0; row < (size_t)rows; ++row) {
                 SiftDescriptor sd;
                 std::memcpy(sd.desc.data(), &data[0] + row * cols, sd.desc.size() * sizeof(sd.desc[0]));
                 descriptors.push_back(sd);
               }
-              all_descriptors.emplace(image_id, descriptors);
             });
-    return all_descriptors;
+    return descriptors;
   };
 
+  /// Read keypoints and descriptors of an image and compute undistorted keypoints and back-projected points.
+  ImageFeaturesPtr readImageFeatures(bh::SQLite3& sqlite_db, const ImageId image_id) const {
+    std::shared_ptr<ImageFeatures> features = std::make_shared<ImageFeatures>();
+    features->keypoints = getKeypointsFromColmap(sqlite_db, image_id);
+    features->descriptors = getDescriptorsFromColmap(sqlite_db, image_id);
+    BH_ASSERT(features->keypoints.size() == features->descriptors.size());
+    const OpenCVCameraType& camera = cameras_.at(image_camera_ids_.at(image_id));
+    features->undist_keypoints = undistortKeypoints(camera, features->keypoints);
+    features->world_points = backprojectKeypoints(camera, features->keypoints);
+    return features;
+  }
+
 //  std::vector<Keypoint> undistortKeypoints(const OpenCVCameraType& camera, const std::vector<Keypoint>& keypoints) {
 //    std::vector<Keypoint> undist_keypoints;
 //    undist_keypoints.reserve(keypoints.size());
@@ -522,6 +615,8 @@ public:
   }
 
   void invalidateMatchesBasedOnPriorGeometry(const ImageId image_id1, const ImageId image_id2,
+                                             const std::vector<Keypoint>& keypoints1,
+                                             const std::vector<Keypoint>& keypoints2,
                                              SiftMatchMatrix& match_scores,
                                              const FloatType min_depth,
                                              const FloatType max_depth,
@@ -544,8 +639,6 @@ public:
             cv_camera2.width(), cv_camera2.height(), cv_camera2.intrinsics());
     offscreen_renderer_->setCamera(camera2);
     QImage depth_image2 = offscreen_renderer_->drawPoissonMeshDepth(pose2);
-    const std::vector<Keypoint>& keypoints1 = all_undist_keypoints_.at(image_id1);
-    const std::vector<Keypoint>& keypoints2 = all_undist_keypoints_.at(image_id2);
 #pragma omp parallel for
     for (size_t row = 0; row < (size_t)match_scores.rows(); ++row) {
       const FloatType x1 = keypoints1[row].x();
@@ -603,7 +696,7 @@ public:
   std::vector<size_t> getMatchIndicesBasedOnLoweRatioTest(
           const SiftMatchMatrix& match_scores,
           const FloatType ratio_threshold = FloatType(0.8),
-          const FloatType max_feature_distance = FloatType(0.7)) {
+          const FloatType max_feature_distance = FloatType(0.7)) const {
     std::vector<size_t> match_indices(match_scores.rows());
 #pragma omp parallel for
     for (size_t row = 0; row < (size_t)match_scores.rows(); ++row) {
@@ -651,17 +744,14 @@ public:
           const SiftMatchMatrix& match_scores,
           const FloatType ratio_threshold = FloatType(0.8),
           const FloatType max_feature_distance = FloatType(0.7),
-          const bool cross_check = true) {
-    cout << "Selecting matches based on ratio test" << endl;
+          const bool cross_check = true) const {
     std::vector<size_t> match_indices1 = getMatchIndicesBasedOnLoweRatioTest(
             match_scores, ratio_threshold, max_feature_distance);
-    cout << "Matches #1 after ratio test: " << match_indices1.size() << endl;
     // Perform cross-check
     std::vector<std::pair<size_t, size_t>> matches;
     if (cross_check) {
       std::vector<size_t> match_indices2 = getMatchIndicesBasedOnLoweRatioTest(
               match_scores.transpose(), ratio_threshold, max_feature_distance);
-      cout << "Matches #2 after ratio test: " << match_indices2.size() << endl;
       for (size_t i = 0; i < match_indices1.size(); ++i) {
         const size_t keypoint_index2 = match_indices1[i];
         if (keypoint_index2 == (size_t) -1) {
@@ -681,7 +771,6 @@ public:
         matches.emplace_back(i, keypoint_index2);
       }
     }
-    cout << "Matches after cross-check: " << matches.size() << endl;
     return matches;
   }
 
@@ -709,91 +798,79 @@ public:
   }
 
 #pragma GCC optimize("O3")
-  size_t colmapImageIdsToPairId(const ImageId image_id1, const ImageId image_id2) {
+  size_t colmapImageIdsToPairId(const ImageId image_id1, const ImageId image_id2) const {
     if (image_id1 > image_id2) {
       return colmapImageIdsToPairId(image_id2, image_id1);
     }
     return (size_t)2147483647 * (size_t)image_id1 + (size_t)image_id2;
   }
 
-  void exportInlierMatchesToColmap(const ImageId image_id1, const ImageId image_id2,
-                                   const std::vector<std::pair<size_t, size_t>> match_indices) {
-//    // Colmap Essential Matrix
-//    const size_t config = 2;
-    // Colmap Fundamental Matrix
-    const size_t config = 3;
-
-    const size_t pair_id = colmapImageIdsToPairId(image_id1, image_id2);
-    const size_t blob_rows = match_indices.size();
-    const size_t blob_cols = 2;
+  std::vector<uint32_t> createMatchBlob(const ImageMatches& match_indices) const {
     std::vector<uint32_t> match_blob;
     match_blob.reserve(2 * match_indices.size());
     for (const auto &entry : match_indices) {
       match_blob.push_back((uint32_t) entry.first);
       match_blob.push_back((uint32_t) entry.second);
     }
-    const string count_query = "SELECT COUNT(*) FROM inlier_matches WHERE pair_id = ?1";
-    bh::SQLite3::Statement query_statement = sqlite_db_->prepare(count_query);
-    query_statement.bindValue64(1, pair_id);
-    const bh::SQLite3::RowResult query_result = sqlite_db_->executeSingle(query_statement);
-    const bool record_exists = query_result.getInt(0) > 0;
-    query_statement.finish();
-    // Export matches to database
-    auto bind_and_execute_values_lambda = [&](bh::SQLite3::Statement& statement) {
-      statement.bindValue64(1, pair_id);
-      statement.bindValue(2, blob_rows);
-      statement.bindValue(3, blob_cols);
-      statement.bindData(4, match_blob);
-      statement.bindValue(5, config);
-      sqlite_db_->executeWithoutResult(statement);
-    };
-    if (record_exists) {
-      const string update_query = "UPDATE inlier_matches SET rows = ?2, cols = ?3, data = ?4, config = ?5 WHERE pair_id = ?1";
-      bh::SQLite3::Statement statement = sqlite_db_->prepare(update_query);
-      bind_and_execute_values_lambda(statement);
-    }
-    else {
-      const string insert_query = "INSERT INTO inlier_matches (pair_id, rows, cols, data, config) VALUES (?1, ?2, ?3, ?4, ?5)";
-      bh::SQLite3::Statement statement = sqlite_db_->prepare(insert_query);
-      bind_and_execute_values_lambda(statement);
-    }
+    return match_blob;
   }
 
-  void exportMatchesToColmap(const ImageId image_id1, const ImageId image_id2,
-                             const std::vector<std::pair<size_t, size_t>> match_indices) {
-    const size_t pair_id = colmapImageIdsToPairId(image_id1, image_id2);
-    const size_t blob_rows = match_indices.size();
+  /// Export matches and inlier matches of a batch of image pairs to the database in a single transaction.
+  void exportMatchesToColmap(const std::vector<ImagePairJob>& jobs) {
+//    // Colmap Essential Matrix
+//    const size_t config = 2;
+    // Colmap Fundamental Matrix
+    const size_t config = 3;
     const size_t blob_cols = 2;
-    std::vector<uint32_t> match_blob;
-    match_blob.reserve(2 * match_indices.size());
-    for (const auto &entry : match_indices) {
-      match_blob.push_back((uint32_t) entry.first);
-      match_blob.push_back((uint32_t) entry.second);
-    }
-    const string count_query = "SELECT COUNT(*) FROM matches WHERE pair_id = ?1";
-    bh::SQLite3::Statement query_statement = sqlite_db_->prepare(count_query);
-    query_statement.bindValue64(1, pair_id);
-    const bh::SQLite3::RowResult query_result = sqlite_db_->executeSingle(query_statement);
-    const bool record_exists = query_result.getInt(0) > 0;
-    query_statement.finish();
-    // Export matches to database
-    auto bind_and_execute_values_lambda = [&](bh::SQLite3::Statement& statement) {
-      statement.bindValue64(1, pair_id);
-      statement.bindValue(2, blob_rows);
-      statement.bindValue(3, blob_cols);
-      statement.bindData(4, match_blob);
-      sqlite_db_->executeWithoutResult(statement);
-    };
-    if (record_exists) {
-      const string update_query = "UPDATE matches SET rows = ?2, cols = ?3, data = ?4 WHERE pair_id = ?1";
-      bh::SQLite3::Statement statement = sqlite_db_->prepare(update_query);
-      bind_and_execute_values_lambda(statement);
-    }
-    else {
-      const string insert_query = "INSERT INTO matches (pair_id, rows, cols, data) VALUES (?1, ?2, ?3, ?4)";
-      bh::SQLite3::Statement statement = sqlite_db_->prepare(insert_query);
-      bind_and_execute_values_lambda(statement);
+
+    sqlite_db_->executeWithoutResult("BEGIN TRANSACTION");
+    {
+      const string matches_query = "INSERT OR REPLACE INTO matches (pair_id, rows, cols, data) VALUES (?1, ?2, ?3, ?4)";
+      bh::SQLite3::Statement matches_statement = sqlite_db_->prepare(matches_query);
+      const string inlier_matches_query = string("INSERT OR REPLACE INTO ") + inlier_matches_table_
+                                          + " (pair_id, rows, cols, data, config) VALUES (?1, ?2, ?3, ?4, ?5)";
+      bh::SQLite3::Statement inlier_matches_statement = sqlite_db_->prepare(inlier_matches_query);
+      for (const ImagePairJob& job : jobs) {
+        const size_t pair_id = colmapImageIdsToPairId(job.image_id1, job.image_id2);
+        const std::vector<uint32_t> match_blob = createMatchBlob(job.matches);
+        matches_statement.bindValue64(1, pair_id);
+        matches_statement.bindValue(2, job.matches.size());
+        matches_statement.bindValue(3, blob_cols);
+        matches_statement.bindData(4, match_blob);
+        sqlite_db_->executeWithoutResult(matches_statement);
+        matches_statement.reset();
+
+        const std::vector<uint32_t> inlier_match_blob = createMatchBlob(job.inlier_matches);
+        inlier_matches_statement.bindValue64(1, pair_id);
+        inlier_matches_statement.bindValue(2, job.inlier_matches.size());
+        inlier_matches_statement.bindValue(3, blob_cols);
+        inlier_matches_statement.bindData(4, inlier_match_blob);
+        inlier_matches_statement.bindValue(5, config);
+        sqlite_db_->executeWithoutResult(inlier_matches_statement);
+        inlier_matches_statement.reset();
+      }
     }
+    sqlite_db_->executeWithoutResult("COMMIT");
+  }
+
+  /// Return pair ids of image pairs that have both matches and inlier matches stored in the database.
+  std::unordered_set<size_t> getProcessedImagePairIdsFromColmap() {
+    std::unordered_set<size_t> matched_pair_ids;
+    sqlite_db_->execute(
+            "SELECT pair_id FROM matches",
+            [&](const bh::SQLite3::RowResult& row_result) {
+              matched_pair_ids.insert((size_t)row_result.getInt64(0));
+            });
+    std::unordered_set<size_t> processed_pair_ids;
+    sqlite_db_->execute(
+            string("SELECT pair_id FROM ") + inlier_matches_table_,
+            [&](const bh::SQLite3::RowResult& row_result) {
+              const size_t pair_id = (size_t)row_result.getInt64(0);
+              if (matched_pair_ids.count(pair_id) > 0) {
+                processed_pair_ids.insert(pair_id);
+              }
+            });
+    return processed_pair_ids;
   }
 
   Vector3 triangulatePoint(const ProjectionMatrix& projection_matrix_left,
@@ -928,13 +1005,454 @@ public:
     return std::make_pair(best_model, best_inlier_indices);
   }
 
+  void dumpMatchImage(const ImageId image_id1, const ImageId image_id2,
+                      const std::vector<KeypointMatch>& keypoint_matches, const string& prefix) const {
+    boostfs::path image_path1 = options_.images_path;
+    image_path1 /= image_names_.at(image_id1);
+    boostfs::path image_path2 = options_.images_path;
+    image_path2 /= image_names_.at(image_id2);
+    QImage keypoints_img1;
+    keypoints_img1.load(QString::fromStdString(image_path1.string()));
+    QImage keypoints_img2;
+    keypoints_img2.load(QString::fromStdString(image_path2.string()));
+    QImage match_img = bh::vision::drawKeypointsAndMatches(keypoints_img1, keypoints_img2, keypoint_matches);
+    const string match_dump_filename = string("dump/") + prefix + "_" +
+                                       std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
+    match_img.save(QString::fromStdString(match_dump_filename));
+  }
+
+  void dumpEpipolarLinesImage(const ImageId image_id1, const ImageId image_id2,
+                              const ImageFeatures& features1, const ImageFeatures& features2,
+                              const ImageMatches& matches, const FundamentalMatrix& fundamental_matrix,
+                              const string& prefix) const {
+    std::vector<Keypoint> tmp_keypoints1;
+    std::vector<Keypoint> tmp_keypoints2;
+    for (const auto& match : matches) {
+      tmp_keypoints1.push_back(features1.undist_keypoints[match.first]);
+      tmp_keypoints2.push_back(features2.undist_keypoints[match.second]);
+    }
+    boostfs::path image_path1 = options_.images_path;
+    image_path1 /= image_names_.at(image_id1);
+    boostfs::path image_path2 = options_.images_path;
+    image_path2 /= image_names_.at(image_id2);
+    QImage keypoints_img1;
+    keypoints_img1.load(QString::fromStdString(image_path1.string()));
+    bh::vision::drawKeypoints(&keypoints_img1, tmp_keypoints1);
+    QImage keypoints_img2;
+    keypoints_img2.load(QString::fromStdString(image_path2.string()));
+    bh::vision::drawKeypoints(&keypoints_img2, tmp_keypoints2);
+    QImage epipolar_lines_img = bh::vision::drawKeypointsAndEpipolarLines(
+            keypoints_img1, keypoints_img2, fundamental_matrix, tmp_keypoints1, tmp_keypoints2);
+    const string epipolar_lines_dump_filename = string("dump/") + prefix + "_" +
+                                                std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
+    epipolar_lines_img.save(QString::fromStdString(epipolar_lines_dump_filename));
+  }
+
+  void dumpKeypointImages() {
+    bh::SQLite3 sqlite_db(options_.colmap_db_filename, bh::SQLite3::READONLY);
+    for (const ImageId image_id : image_ids_) {
+      const std::vector<Keypoint> keypoints = getKeypointsFromColmap(sqlite_db, image_id);
+      boostfs::path image_path = options_.images_path;
+      image_path /= image_names_.at(image_id);
+      QImage keypoints_img;
+      keypoints_img.load(QString::fromStdString(image_path.string()));
+      bh::vision::drawKeypoints(&keypoints_img, keypoints);
+      const string keypoint_dump_filename = string("dump/keypoints_") + std::to_string(image_id) + ".png";
+      keypoints_img.save(QString::fromStdString(keypoint_dump_filename));
+    }
+  }
+
+  /// Geometric verification of putative matches.
+  /// Returns the inlier matches (or the guided matches if enabled) or an empty vector if no model was found.
+  ImageMatches verifyMatches(const ImagePairJob& job) const {
+    const ImageId image_id1 = job.image_id1;
+    const ImageId image_id2 = job.image_id2;
+    const ImageMatches& matches = job.matches;
+    const ImageFeatures& features1 = *job.features1;
+    const ImageFeatures& features2 = *job.features2;
+    const std::vector<Keypoint>& undist_keypoints1 = features1.undist_keypoints;
+    const std::vector<Keypoint>& undist_keypoints2 = features2.undist_keypoints;
+    const std::vector<Vector2>& world_points1 = features1.world_points;
+    const std::vector<Vector2>& world_points2 = features2.world_points;
+
+    const PoseType& pose1 = prior_image_poses_.at(image_id1);
+    const PoseType& pose2 = prior_image_poses_.at(image_id2);
+    const Vector3 prior_world_translation = pose1.getWorldPosition() - pose2.getWorldPosition();
+    const Vector3 prior_translation = pose1.rotation().inverse() * prior_world_translation;
+    const Vector3 normalized_prior_translation = prior_translation.normalized();
+    const Quaternion prior_quaternion = pose2.quaternion() * pose1.quaternion().inverse();
+
+    const OpenCVCameraType& cv_camera1 = cameras_.at(image_camera_ids_.at(image_id1));
+    const OpenCVCameraType& cv_camera2 = cameras_.at(image_camera_ids_.at(image_id2));
+
+    ImageMatches inlier_matches;
+    if (matches.empty()) {
+      return inlier_matches;
+    }
+
+    // Perform RANSAC to find inlier set
+    const size_t num_samples = matches.size();
+    const size_t num_samples_for_solver = 8;
+    const size_t num_ransac_iterations = options_.num_ransac_iterations;
+    const size_t min_num_inliers = std::max(options_.min_num_inliers, num_samples_for_solver);
+    const FloatType sampson_distance_threshold = options_.sampson_distance_threshold;
+
+    auto get_match_points = [&](const std::vector<size_t> &sample_indices,
+                                std::vector<Vector2>* points1, std::vector<Vector2>* points2) {
+      for (size_t sample_index : sample_indices) {
+        size_t index1;
+        size_t index2;
+        std::tie(index1, index2) = matches[sample_index];
+        const Keypoint keypoint1 = undist_keypoints1[index1];
+        const Keypoint keypoint2 = undist_keypoints2[index2];
+        points1->push_back(Vector2(keypoint1.x(), keypoint1.y()));
+        points2->push_back(Vector2(keypoint2.x(), keypoint2.y()));
+      }
+    };
+
+    auto fundamental_matrix_solver_8point
+            = [&](const std::vector<size_t> &sample_indices) -> std::pair<bool, FundamentalMatrix> {
+      std::vector<Vector2> points1;
+      std::vector<Vector2> points2;
+      get_match_points(sample_indices, &points1, &points2);
+      return bh::vision::computeFundamentalMatrix8Point<FloatType>(points1, points2);
+    };
+
+    auto fundamental_matrix_solver
+            = [&](const std::vector<size_t> &sample_indices) -> std::pair<bool, FundamentalMatrix> {
+      std::vector<Vector2> points1;
+      std::vector<Vector2> points2;
+      get_match_points(sample_indices, &points1, &points2);
+      return bh::vision::computeFundamentalMatrix<FloatType>(points1, points2);
+    };
+
+    auto fundamental_matrix_inlier_predicate = [&](const FundamentalMatrix &fundamental_matrix, const size_t sample_index) {
+      size_t index1;
+      size_t index2;
+      std::tie(index1, index2) = matches[sample_index];
+      const Keypoint keypoint1 = undist_keypoints1[index1];
+      const Keypoint keypoint2 = undist_keypoints2[index2];
+      const Vector2 point1(keypoint1.x(), keypoint1.y());
+      const Vector2 point2(keypoint2.x(), keypoint2.y());
+      const FloatType sampson_distance = bh::vision::computeSampsonDistance(point1, point2, fundamental_matrix);
+      return sampson_distance <= sampson_distance_threshold;
+    };
+
+    const FloatType max_angular_distance_to_prior = options_.max_angular_distance_to_prior_degrees * M_PI / FloatType(180.0);
+
+    auto fundamental_matrix_model_predicate = [&](const FundamentalMatrix &fundamental_matrix,
+                                                  const std::vector<size_t>& inlier_indices) {
+      return true;
+      BH_ASSERT(inlier_indices.size() > 0);
+      const EssentialMatrix essential_matrix = bh::vision::essentialMatrixFromFundamentalMatrix(
+              fundamental_matrix, cv_camera1, cv_camera2);
+      size_t index1;
+      size_t index2;
+      std::tie(index1, index2) = matches[inlier_indices[0]];
+      const Vector2 point1 = world_points1[index1];
+      const Vector2 point2 = world_points2[index2];
+      bool decompose_essential_matrix_success;
+      SE3Transform se3_transform;
+      std::tie(decompose_essential_matrix_success, se3_transform) = bh::vision::decomposeEssentialMatrix(
+              essential_matrix, point1, point2);
+      if (!decompose_essential_matrix_success) {
+        return false;
+      }
+      const SE3Transform right_to_left_se3_transform = se3_transform.inverse();
+      const FloatType angular_distance_to_prior
+              = right_to_left_se3_transform.quaternion().angularDistance(prior_quaternion);
+      if (angular_distance_to_prior > max_angular_distance_to_prior) {
+        return false;
+      }
+      const Vector3 normalized_estimated_translation = right_to_left_se3_transform.translation().normalized();
+      const FloatType dot_product = normalized_estimated_translation.dot(normalized_prior_translation);
+      if (dot_product < options_.min_translation_dot_product_with_prior) {
+        return false;
+      }
+      return true;
+    };
+
+    std::vector<size_t> inlier_indices;
+    FundamentalMatrix fundamental_matrix_ransac;
+    std::tie(fundamental_matrix_ransac, inlier_indices) = ransacFindInliers<FundamentalMatrix>(
+            num_samples,
+            num_samples_for_solver,
+            num_ransac_iterations,
+            fundamental_matrix_solver_8point,
+            fundamental_matrix_inlier_predicate,
+            fundamental_matrix_model_predicate
+    );
+    if (inlier_indices.size() < min_num_inliers) {
+      return inlier_matches;
+    }
+
+    if (options_.dump_match_images) {
+      std::vector<KeypointMatch> tmp_keypoint_matches;
+      for (size_t inlier_index : inlier_indices) {
+        const auto& match = matches[inlier_index];
+        tmp_keypoint_matches.push_back(KeypointMatch(undist_keypoints1[match.first], undist_keypoints2[match.second]));
+      }
+      dumpMatchImage(image_id1, image_id2, tmp_keypoint_matches, "inlier_matches");
+    }
+
+    if (options_.dump_epipolar_lines) {
+      ImageMatches ransac_inlier_matches;
+      for (size_t inlier_index : inlier_indices) {
+        ransac_inlier_matches.push_back(matches[inlier_index]);
+      }
+      dumpEpipolarLinesImage(image_id1, image_id2, features1, features2,
+                             ransac_inlier_matches, fundamental_matrix_ransac, "inlier_epipolar_lines");
+    }
+
+    bool model_valid;
+    FundamentalMatrix fundamental_matrix;
+    std::tie(model_valid, fundamental_matrix) = fundamental_matrix_solver(inlier_indices);
+    if (model_valid) {
+      for (size_t inlier_index : inlier_indices) {
+        inlier_matches.push_back(matches[inlier_index]);
+      }
+    }
+    const bool fundamental_matrix_valid = inlier_matches.size() >= num_samples_for_solver;
+    if (!fundamental_matrix_valid) {
+      inlier_matches.clear();
+      return inlier_matches;
+    }
+
+    if (options_.guided_matching) {
+      SiftMatchMatrix guided_match_scores = computeMatchScoresGuided(
+              features1.descriptors, features2.descriptors,
+              [&](const size_t index1, const size_t index2) {
+                const Keypoint keypoint1 = undist_keypoints1[index1];
+                const Keypoint keypoint2 = undist_keypoints2[index2];
+                const Vector2 point1(keypoint1.x(), keypoint1.y());
+                const Vector2 point2(keypoint2.x(), keypoint2.y());
+                const FloatType sampson_distance
+                        = bh::vision::computeSampsonDistance(point1, point2, fundamental_matrix);
+                return sampson_distance <= options_.max_epipolar_error * options_.max_epipolar_error;
+              });
+
+      inlier_matches = selectBestMatches(
+              guided_match_scores,
+              options_.lowe_ratio_threshold,
+              options_.max_feature_distance,
+              options_.cross_check);
+
+      if (options_.dump_match_images) {
+        std::vector<KeypointMatch> tmp_keypoint_matches;
+        for (const auto& inlier_match : inlier_matches) {
+          tmp_keypoint_matches.push_back(KeypointMatch(
+                  undist_keypoints1[inlier_match.first], undist_keypoints2[inlier_match.second]));
+        }
+        dumpMatchImage(image_id1, image_id2, tmp_keypoint_matches, "guided_matches");
+      }
+
+      if (options_.dump_epipolar_lines) {
+        dumpEpipolarLinesImage(image_id1, image_id2, features1, features2,
+                               inlier_matches, fundamental_matrix, "guided_epipolar_lines");
+      }
+    }
+
+    return inlier_matches;
+  }
+
+  void setWorkerOpenMPThreads() const {
+#ifdef _OPENMP
+    size_t num_threads = options_.omp_threads_per_worker;
+    if (num_threads == 0) {
+      const size_t num_workers = options_.num_matching_threads + options_.num_verification_threads;
+      num_threads = std::max<size_t>(bh::Thread::getHardwareConcurrency() / num_workers, 1);
+    }
+    omp_set_num_threads(num_threads);
+#endif
+  }
+
+  /// Stage 1: Enumerate image pairs and attach their features from an LRU cache.
+  void runFeatureLoaderStage(const std::unordered_set<size_t>& processed_pair_ids, MatchingPipeline* pipeline) {
+    bh::SQLite3 sqlite_db(options_.colmap_db_filename, bh::SQLite3::READONLY);
+    sqlite_db.setBusyTimeout(kSQLiteBusyTimeoutMs);
+    ImageFeaturesCache features_cache(
+            options_.feature_cache_size,
+            [&](const ImageId image_id) {
+              return readImageFeatures(sqlite_db, image_id);
+            });
+
+    std::vector<ImageId> image_ids = image_ids_;
+    std::sort(image_ids.begin(), image_ids.end());
+    // Visit the upper triangle of the pair matrix in tiles of block_size x block_size images.
+    // A tile only touches 2 * block_size images so features are reloaded once per tile instead of once per pair.
+    const size_t num_images = image_ids.size();
+    const size_t block_size = std::max<size_t>(options_.feature_cache_size / 2, 1);
+    for (size_t block1 = 0; block1 < num_images; block1 += block_size) {
+      const size_t block1_end = std::min(block1 + block_size, num_images);
+      for (size_t block2 = block1; block2 < num_images; block2 += block_size) {
+        const size_t block2_end = std::min(block2 + block_size, num_images);
+        for (size_t i = block1; i < block1_end; ++i) {
+          for (size_t j = std::max(block2, i + 1); j < block2_end; ++j) {
+            ImagePairJob job;
+            job.image_id1 = image_ids[i];
+            job.image_id2 = image_ids[j];
+            if (processed_pair_ids.count(colmapImageIdsToPairId(job.image_id1, job.image_id2)) > 0) {
+              ++pipeline->num_skipped_pairs;
+              continue;
+            }
+            bh::Timer timer;
+            job.features1 = features_cache.getInstance(job.image_id1);
+            job.features2 = features_cache.getInstance(job.image_id2);
+            pipeline->loader_statistics.addBusyTime(timer);
+            pipeline->feature_cache_hits = features_cache.numHits();
+            pipeline->feature_cache_misses = features_cache.numMisses();
+            if (!pipeline->match_queue.push(std::move(job))) {
+              return;
+            }
+            ++pipeline->loader_statistics.num_processed;
+          }
+        }
+      }
+    }
+  }
+
+  /// Stage 2: Compute descriptor scores and select putative matches with ratio test and cross-check.
+  void runMatchingStage(MatchingPipeline* pipeline) {
+    setWorkerOpenMPThreads();
+    ImagePairJob job;
+    while (pipeline->match_queue.pop(&job)) {
+      bh::Timer timer;
+      const SiftMatchMatrix match_scores = computeMatchScores(job.features1->descriptors, job.features2->descriptors);
+      job.matches = selectBestMatches(
+              match_scores, options_.lowe_ratio_threshold, options_.max_feature_distance, options_.cross_check);
+      if (options_.dump_match_images) {
+        std::vector<KeypointMatch> keypoint_matches;
+        for (const auto& entry : job.matches) {
+          keypoint_matches.push_back(KeypointMatch(
+                  job.features1->keypoints[entry.first], job.features2->keypoints[entry.second]));
+        }
+        dumpMatchImage(job.image_id1, job.image_id2, keypoint_matches, "raw_matches");
+      }
+      pipeline->matching_statistics.addBusyTime(timer);
+      ++pipeline->matching_statistics.num_processed;
+      pipeline->verification_queue.push(std::move(job));
+    }
+  }
+
+  /// Stage 3: Geometric verification. Features are released before the job is handed to the writer.
+  void runVerificationStage(MatchingPipeline* pipeline) {
+    setWorkerOpenMPThreads();
+    ImagePairJob job;
+    while (pipeline->verification_queue.pop(&job)) {
+      bh::Timer timer;
+      job.inlier_matches = verifyMatches(job);
+      job.features1.reset();
+      job.features2.reset();
+      pipeline->verification_statistics.addBusyTime(timer);
+      ++pipeline->verification_statistics.num_processed;
+      pipeline->write_queue.push(std::move(job));
+    }
+  }
+
+  /// Stage 4: Write results to the database in batches.
+  void runDatabaseWriterStage(MatchingPipeline* pipeline) {
+    std::vector<ImagePairJob> batch;
+    batch.reserve(options_.db_write_batch_size);
+    size_t next_report = options_.progress_report_interval;
+    bool queue_open = true;
+    while (queue_open) {
+      ImagePairJob job;
+      queue_open = pipeline->write_queue.pop(&job);
+      if (queue_open) {
+        batch.push_back(std::move(job));
+      }
+      if (batch.size() >= options_.db_write_batch_size || (!queue_open && !batch.empty())) {
+        bh::Timer timer;
+        exportMatchesToColmap(batch);
+        pipeline->writer_statistics.addBusyTime(timer);
+        pipeline->writer_statistics.num_processed += batch.size();
+        batch.clear();
+        if (options_.progress_report_interval > 0 && pipeline->writer_statistics.num_processed >= next_report) {
+          printPipelineStatistics(*pipeline);
+          next_report = pipeline->writer_statistics.num_processed + options_.progress_report_interval;
+        }
+      }
+    }
+  }
+
+  void printPipelineStatistics(const MatchingPipeline& pipeline) const {
+    const double elapsed_time = pipeline.timer.getElapsedTime();
+    auto print_stage = [&](const string& name, const PipelineStageStatistics& statistics, const size_t num_threads) {
+      const size_t num_processed = statistics.num_processed;
+      const double busy_time = statistics.busyTime();
+      cout << "  " << name << ": " << num_processed << " pairs, "
+           << num_processed / elapsed_time << " pairs/s, "
+           << "busy " << busy_time << " s"
+           << " (" << 100 * busy_time / (elapsed_time * num_threads) << " %)" << endl;
+    };
+    cout << "Matching pipeline after " << elapsed_time << " s (skipped " << pipeline.num_skipped_pairs << " pairs)" << endl;
+    print_stage("Loading     ", pipeline.loader_statistics, 1);
+    print_stage("Matching    ", pipeline.matching_statistics, options_.num_matching_threads);
+    print_stage("Verification", pipeline.verification_statistics, options_.num_verification_threads);
+    print_stage("Writing     ", pipeline.writer_statistics, 1);
+    cout << "  Feature cache: " << pipeline.feature_cache_hits << " hits, "
+         << pipeline.feature_cache_misses << " misses" << endl;
+    cout << "  Queue waits (push/pop): match " << pipeline.match_queue.numPushWaits()
+         << "/" << pipeline.match_queue.numPopWaits()
+         << ", verification " << pipeline.verification_queue.numPushWaits()
+         << "/" << pipeline.verification_queue.numPopWaits()
+         << ", write " << pipeline.write_queue.numPushWaits()
+         << "/" << pipeline.write_queue.numPopWaits() << endl;
+  }
+
+  void runMatchingPipeline() {
+    std::unordered_set<size_t> processed_pair_ids;
+    if (options_.resume) {
+      processed_pair_ids = getProcessedImagePairIdsFromColmap();
+      cout << "Found " << processed_pair_ids.size() << " already processed image pairs" << endl;
+    }
+    sqlite_db_->setBusyTimeout(kSQLiteBusyTimeoutMs);
+
+    BH_ASSERT(options_.num_matching_threads > 0);
+    BH_ASSERT(options_.num_verification_threads > 0);
+    MatchingPipeline pipeline(options_.pipeline_queue_size);
+    std::thread loader_thread([&]() {
+      runFeatureLoaderStage(processed_pair_ids, &pipeline);
+    });
+    std::vector<std::thread> matching_threads;
+    for (size_t i = 0; i < options_.num_matching_threads; ++i) {
+      matching_threads.emplace_back([&]() {
+        runMatchingStage(&pipeline);
+      });
+    }
+    std::vector<std::thread> verification_threads;
+    for (size_t i = 0; i < options_.num_verification_threads; ++i) {
+      verification_threads.emplace_back([&]() {
+        runVerificationStage(&pipeline);
+      });
+    }
+    std::thread writer_thread([&]() {
+      runDatabaseWriterStage(&pipeline);
+    });
+
+    // Shut down stages in order so that every queue is drained before it is closed
+    loader_thread.join();
+    pipeline.match_queue.close();
+    for (std::thread& thread : matching_threads) {
+      thread.join();
+    }
+    pipeline.verification_queue.close();
+    for (std::thread& thread : verification_threads) {
+      thread.join();
+    }
+    pipeline.write_queue.close();
+    writer_thread.join();
+
+    printPipelineStatistics(pipeline);
+  }
+
 #pragma GCC optimize("O0")
   bool run() {
     cout << "Reading mesh ..." << endl;
     MeshIOType::loadFromFile(options_.poisson_mesh_filename, poisson_mesh_);
     cout << "Number of vertices in input mesh: " << poisson_mesh_.m_Vertices.size() << endl;
 
-    cout << "Reading features from Colmap ..." << endl;
+    cout << "Reading image information from Colmap ..." << endl;
     image_ids_ = getImageIdsFromColmap();
     image_names_ = getImageNamesFromColmap();
 //    cout << "Image names: " << endl;
@@ -947,25 +1465,12 @@ public:
 
     cameras_ = getCamerasFromColmap();
 
-    all_keypoints_ = getKeypointsFromColmap();
-    all_descriptors_ = getDescriptorsFromColmap();
-
-    // Undistort keypoints
-    for (const auto& entry : all_keypoints_) {
-      const ImageId image_id = entry.first;
-      const std::vector<Keypoint>& keypoints = entry.second;
-      const OpenCVCameraType &camera = cameras_.at(image_camera_ids_.at(image_id));
-      std::vector<Keypoint> undist_keypoints = undistortKeypoints(camera, keypoints);
-      all_undist_keypoints_.emplace(entry.first, std::move(undist_keypoints));
+    // Newer Colmap versions store verified matches in the two_view_geometries table
+    if (sqlite_db_->hasTable("two_view_geometries") && !sqlite_db_->hasTable("inlier_matches")) {
+      inlier_matches_table_ = "two_view_geometries";
     }
-
-    // Compute back-projected 3d points
-    for (const auto& entry : all_keypoints_) {
-      const ImageId image_id = entry.first;
-      const std::vector<Keypoint>& keypoints = entry.second;
-      const OpenCVCameraType &camera = cameras_.at(image_camera_ids_.at(image_id));
-      std::vector<Vector2> world_points = backprojectKeypoints(camera, keypoints);
-      all_world_points_.emplace(entry.first, std::move(world_points));
+    else {
+      inlier_matches_table_ = "inlier_matches";
     }
 
     // Read prior image information
@@ -1002,622 +1507,12 @@ public:
     }
 
     boostfs::create_directory("dump");
-    // Match features
-    for (const ImageId image_id1 : image_ids_) {
-//      if (image_id1 != 2) {
-//        continue;
-//      }
-      // Render depth image
-      const PoseType pose1 = prior_image_poses_.at(image_id1);
-      const OpenCVCameraType cv_camera1 = cameras_.at(image_camera_ids_.at(image_id1));
-      const PinholeCamera camera1(
-              cv_camera1.width(), cv_camera1.height(), cv_camera1.intrinsics());
-//      offscreen_renderer_->setCamera(camera1);
-//      QImage mesh_image1 = offscreen_renderer_->drawPoissonMesh(pose1);
-//      QImage depth_image1 = offscreen_renderer_->drawPoissonMeshDepth(pose1);
-//      QImage depth_image1_cmap = offscreen_renderer_->convertEncodedDepthImageToRGB(
-//              depth_image1, options_.cmap_min_depth, options_.cmap_max_depth);
-
-      const std::vector<Keypoint>& keypoints1 = all_keypoints_.at(image_id1);
-      const std::vector<Keypoint>& undist_keypoints1 = all_undist_keypoints_.at(image_id1);
-      const std::vector<Vector2>& world_points1 = all_world_points_.at(image_id1);
-
-      if (options_.dump_keypoint_images) {
-        // Dump keypoints of image 1
-        boostfs::path image_path1 = options_.images_path;
-        image_path1 /= image_names_.at(image_id1);
-        QImage keypoints_img1;
-        keypoints_img1.load(QString::fromStdString(image_path1.string()));
-        bh::vision::drawKeypoints(&keypoints_img1, keypoints1);
-        const string keypoint_dump_filename = string("dump/keypoints_") + std::to_string(image_id1) + ".png";
-        keypoints_img1.save(QString::fromStdString(keypoint_dump_filename));
-      }
-
-//      if (options_.dump_keypoint_images) {
-//        // Dump keypoints of image 1 with mesh image
-//        QImage mesh_keypoints_img1 = mesh_image1;
-//        bh::vision::drawKeypoints(&mesh_keypoints_img1, undist_keypoints1);
-//        const string mesh_keypoint_dump_filename1 = string("dump/keypoints_mesh_") + std::to_string(image_id1) + ".png";
-//        mesh_keypoints_img1.save(QString::fromStdString(mesh_keypoint_dump_filename1));
-//      }
-
-      for (ImageId image_id2 : image_ids_) {
-//        if (image_id2 != 4) {
-//          continue;
-//        }
-        // No need to match each image twice
-        if (image_id2 <= image_id1) {
-          continue;
-        }
-
-        // Render depth image
-        const PoseType pose2 = prior_image_poses_.at(image_id2);
-        const PoseType pose1_inverse = pose1.inverse();
-        const Vector3 prior_world_translation = pose1.getWorldPosition() - pose2.getWorldPosition();
-        const Vector3 prior_translation = pose1.rotation().inverse() * prior_world_translation;
-        const Vector3 normalized_prior_translation = prior_translation.normalized();
-        const Quaternion prior_quaternion = pose2.quaternion() * pose1.quaternion().inverse();
-        const Matrix3x3 prior_abs_rotation1 = pose1.rotation();
-        const Matrix3x3 prior_abs_rotation2 = pose2.rotation();
-        const Matrix3x3 prior_rotation = prior_quaternion.toRotationMatrix();
-        const FloatType prior_angular_distance = (pose2.quaternion() * pose1.quaternion().inverse()).angularDistance(Quaternion::Identity());
-        const FloatType prior_angular_distance2 = pose2.quaternion().angularDistance(pose1.quaternion());
-
-        const OpenCVCameraType cv_camera2 = cameras_.at(image_camera_ids_.at(image_id2));
-        const PinholeCamera camera2(
-                cv_camera2.width(), cv_camera2.height(), cv_camera2.intrinsics());
-//        offscreen_renderer_->setCamera(camera2);
-//        QImage mesh_image2 = offscreen_renderer_->drawPoissonMesh(pose2);
-//        QImage depth_image2 = offscreen_renderer_->drawPoissonMeshDepth(pose2);
-//        QImage depth_image2_cmap = offscreen_renderer_->convertEncodedDepthImageToRGB(
-//                depth_image2, options_.cmap_min_depth, options_.cmap_max_depth);
-
-        const std::vector<Keypoint>& keypoints2 = all_keypoints_.at(image_id2);
-        const std::vector<Keypoint>& undist_keypoints2 = all_undist_keypoints_.at(image_id2);
-        const std::vector<Vector2>& world_points2 = all_world_points_.at(image_id2);
-
-        cout << "Matching image " << image_id1 << " with " << image_id2 << endl;
-//        BH_PRINT_VALUE(keypoints1.size());
-//        BH_PRINT_VALUE(keypoints2.size());
-        SiftMatchMatrix match_scores = computeMatchScores(
-                all_descriptors_.at(image_id1), all_descriptors_.at(image_id2));
-
-//        cout << "Invalidating matches based on minimum feature distance" << endl;
-//        invalidateMatchesBasedOnFeatureDistance(
-//                image_id1, image_id2, match_scores,
-//                options_.max_feature_distance);
-//        cout << "Invalidating matches based on geometry" << endl;
-//        invalidateMatchesBasedOnPriorGeometry(
-//                image_id1, image_id2, match_scores,
-//                options_.min_depth, options_.max_depth, options_.max_projection_error);
-//        for (size_t row = 0; row < (size_t)match_scores.rows(); ++row) {
-//          const size_t match_count = match_scores.row(row).array().isFinite().count();
-//          if (match_count > 0) {
-//            cout << "Matches for descriptor " << row << ": " << match_count << endl;
-//          }
-//        }
-
-        std::vector<std::pair<size_t, size_t>> matches = selectBestMatches(
-                match_scores, options_.lowe_ratio_threshold, options_.max_feature_distance, options_.cross_check);
-
-        exportMatchesToColmap(image_id1, image_id2, matches);
-
-
-
-        {
-          // Create keypoint-matches vector
-          std::vector<KeypointMatch> keypoint_matches;
-          for (const auto& entry : matches) {
-            keypoint_matches.push_back(KeypointMatch(keypoints1[entry.first], keypoints2[entry.second]));
-          }
-
-          if (options_.dump_keypoint_images) {
-            // Dump keypoints of image 2
-            boostfs::path image_path2 = options_.images_path;
-            image_path2 /= image_names_.at(image_id2);
-            QImage keypoints_img2;
-            keypoints_img2.load(QString::fromStdString(image_path2.string()));
-            bh::vision::drawKeypoints(&keypoints_img2, keypoints2);
-            const string keypoint_dump_filename2 = string("dump/raw_keypoints_") + std::to_string(image_id2) + ".png";
-            keypoints_img2.save(QString::fromStdString(keypoint_dump_filename2));
-          }
-
-          if (options_.dump_match_images) {
-            // Dump keypoint matches
-            boostfs::path image_path1 = options_.images_path;
-            image_path1 /= image_names_.at(image_id1);
-            boostfs::path image_path2 = options_.images_path;
-            image_path2 /= image_names_.at(image_id2);
-            QImage keypoints_img1;
-            keypoints_img1.load(QString::fromStdString(image_path1.string()));
-            QImage keypoints_img2;
-            keypoints_img2.load(QString::fromStdString(image_path2.string()));
-            QImage match_img = bh::vision::drawKeypointsAndMatches(keypoints_img1, keypoints_img2, keypoint_matches);
-            const string match_dump_filename = string("dump/raw_matches_") +
-                                               std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
-            match_img.save(QString::fromStdString(match_dump_filename));
-          }
-        }
-
-        std::vector<std::pair<size_t, size_t>> inlier_matches;
-        if (matches.size() > 0) {
-          // Perform RANSAC to find inlier set
-          const size_t num_samples = matches.size();
-          const size_t num_samples_for_solver = 8;
-          const size_t num_ransac_iterations = options_.num_ransac_iterations;
-          const size_t min_num_inliers = std::max(options_.min_num_inliers, num_samples_for_solver);
-//          const FloatType epipolar_constraint_threshold = FloatType(0.01);
-          const FloatType sampson_distance_threshold = options_.sampson_distance_threshold;
-
-          auto fundamental_matrix_solver_8point
-                  = [&](const std::vector<size_t> &sample_indices) -> std::pair<bool, FundamentalMatrix> {
-            std::vector<Vector2> points1;
-            std::vector<Vector2> points2;
-            for (size_t sample_index : sample_indices) {
-              size_t index1;
-              size_t index2;
-              std::tie(index1, index2) = matches[sample_index];
-              const Keypoint keypoint1 = undist_keypoints1[index1];
-              const Keypoint keypoint2 = undist_keypoints2[index2];
-              points1.push_back(Vector2(keypoint1.x(), keypoint1.y()));
-              points2.push_back(Vector2(keypoint2.x(), keypoint2.y()));
-            }
-            bool fundamental_matrix_valid;
-            FundamentalMatrix fundamental_matrix;
-            std::tie(fundamental_matrix_valid, fundamental_matrix)
-                    = bh::vision::computeFundamentalMatrix8Point<FloatType>(points1, points2);
-            return std::make_pair(fundamental_matrix_valid, fundamental_matrix);
-          };
-
-          auto fundamental_matrix_solver
-                  = [&](const std::vector<size_t> &sample_indices) -> std::pair<bool, FundamentalMatrix> {
-                    std::vector<Vector2> points1;
-                    std::vector<Vector2> points2;
-                    for (size_t sample_index : sample_indices) {
-                      size_t index1;
-                      size_t index2;
-                      std::tie(index1, index2) = matches[sample_index];
-                      const Keypoint keypoint1 = undist_keypoints1[index1];
-                      const Keypoint keypoint2 = undist_keypoints2[index2];
-                      points1.push_back(Vector2(keypoint1.x(), keypoint1.y()));
-                      points2.push_back(Vector2(keypoint2.x(), keypoint2.y()));
-                    }
-                    bool fundamental_matrix_valid;
-                    FundamentalMatrix fundamental_matrix;
-                    std::tie(fundamental_matrix_valid, fundamental_matrix)
-                            = bh::vision::computeFundamentalMatrix<FloatType>(points1, points2);
-                    return std::make_pair(fundamental_matrix_valid, fundamental_matrix);
-                  };
-
-          auto fundamental_matrix_inlier_predicate = [&](const FundamentalMatrix &fundamental_matrix, const size_t sample_index) {
-            size_t index1;
-            size_t index2;
-            std::tie(index1, index2) = matches[sample_index];
-            const Keypoint keypoint1 = undist_keypoints1[index1];
-            const Keypoint keypoint2 = undist_keypoints2[index2];
-            const Vector2 point1(keypoint1.x(), keypoint1.y());
-            const Vector2 point2(keypoint2.x(), keypoint2.y());
-            const FloatType sampson_distance = bh::vision::computeSampsonDistance(point1, point2, fundamental_matrix);
-//            const Vector3 product_right = fundamental_matrix * point2.homogeneous();
-//            const FloatType dot_product = point1.homogeneous().dot(product_right);
-            if (sampson_distance <= sampson_distance_threshold) {
-//            if (std::abs(dot_product) <= epipolar_constraint_threshold) {
-              return true;
-            }
-            else {
-              return false;
-            }
-          };
-
-          const FloatType max_angular_distance_to_prior = options_.max_angular_distance_to_prior_degrees * M_PI / FloatType(180.0);
-
-          auto fundamental_matrix_model_predicate = [&](const FundamentalMatrix &fundamental_matrix,
-                                                        const std::vector<size_t>& inlier_indices) {
-            return true;
-            BH_ASSERT(inlier_indices.size() > 0);
-            const EssentialMatrix essential_matrix = bh::vision::essentialMatrixFromFundamentalMatrix(
-                    fundamental_matrix, cv_camera1, cv_camera2);
-            size_t index1;
-            size_t index2;
-            std::tie(index1, index2) = matches[inlier_indices[0]];
-            const Vector2 point1 = world_points1[index1];
-            const Vector2 point2 = world_points2[index2];
-            bool decompose_essential_matrix_success;
-            SE3Transform se3_transform;
-            std::tie(decompose_essential_matrix_success, se3_transform) = bh::vision::decomposeEssentialMatrix(
-                    essential_matrix, point1, point2);
-            if (!decompose_essential_matrix_success) {
-              return false;
-            }
-            const SE3Transform right_to_left_se3_transform = se3_transform.inverse();
-            const Matrix3x3 rotation = right_to_left_se3_transform.rotation();
-            const FloatType angular_distance_to_prior
-                    = right_to_left_se3_transform.quaternion().angularDistance(prior_quaternion);
-            if (angular_distance_to_prior > max_angular_distance_to_prior) {
-              return false;
-            }
-            const Vector3 normalized_estimated_translation = right_to_left_se3_transform.translation().normalized();
-            const FloatType dot_product = normalized_estimated_translation.dot(normalized_prior_translation);
-            if (dot_product < options_.min_translation_dot_product_with_prior) {
-              return false;
-            }
-            return true;
-          };
-
-//          auto essential_matrix_solver_8point
-//                  = [&](const std::vector<size_t> &sample_indices) -> std::pair<bool, EssentialMatrix> {
-//                    std::vector<Vector2> points1;
-//                    std::vector<Vector2> points2;
-//                    for (size_t sample_index : sample_indices) {
-//                      size_t index1;
-//                      size_t index2;
-//                      std::tie(index1, index2) = matches[sample_index];
-//                      points1.push_back(world_points1[index1]);
-//                      points2.push_back(world_points1[index2]);
-//                    }
-//                    bool essential_matrix_valid;
-//                    EssentialMatrix essential_matrix;
-//                    std::tie(essential_matrix_valid, essential_matrix)
-//                            = bh::vision::computeFundamentalMatrix8Point<FloatType>(points1, points2);
-//                    return std::make_pair(essential_matrix_valid, essential_matrix);
-//                  };
-//
-//          auto essential_matrix_solver
-//                  = [&](const std::vector<size_t> &sample_indices) -> std::pair<bool, EssentialMatrix> {
-//                    std::vector<Vector2> points1;
-//                    std::vector<Vector2> points2;
-//                    for (size_t sample_index : sample_indices) {
-//                      size_t index1;
-//                      size_t index2;
-//                      std::tie(index1, index2) = matches[sample_index];
-//                      points1.push_back(world_points1[index1]);
-//                      points2.push_back(world_points1[index2]);
-//                    }
-//                    bool essential_matrix_valid;
-//                    EssentialMatrix essential_matrix;
-//                    std::tie(essential_matrix_valid, essential_matrix)
-//                            = bh::vision::computeFundamentalMatrix<FloatType>(points1, points2);
-//                    return std::make_pair(essential_matrix_valid, essential_matrix);
-//                  };
-//
-//          auto essential_matrix_inlier_predicate = [&](const EssentialMatrix &essential_matrix, const size_t sample_index) {
-//            size_t index1;
-//            size_t index2;
-//            std::tie(index1, index2) = matches[sample_index];
-//            const Vector2 point1 = world_points1[index1];
-//            const Vector2 point2 = world_points2[index2];
-//            const FloatType sampson_distance = bh::vision::computeSampsonDistance(point1, point2, essential_matrix);
-////            const Vector3 product_right = fundamental_matrix * point2.homogeneous();
-////            const FloatType dot_product = point1.homogeneous().dot(product_right);
-//            if (sampson_distance <= sampson_distance_threshold) {
-////            if (std::abs(dot_product) <= epipolar_constraint_threshold) {
-//              return true;
-//            }
-//            else {
-//              return false;
-//            }
-//          };
-//
-//          auto essential_matrix_model_predicate = [&](const EssentialMatrix &essential_matrix,
-//                                                      const std::vector<size_t>& inlier_indices) {
-//            BH_ASSERT(inlier_indices.size() > 0);
-//            size_t index1;
-//            size_t index2;
-//            std::tie(index1, index2) = matches[inlier_indices[0]];
-//            const Vector2 point1 = world_points1[index1];
-//            const Vector2 point2 = world_points2[index2];
-//            bool decompose_essential_matrix_success;
-//            SE3Transform se3_transform;
-//            std::tie(decompose_essential_matrix_success, se3_transform) = bh::vision::decomposeEssentialMatrix(
-//                    essential_matrix, point1, point2);
-//            if (!decompose_essential_matrix_success) {
-//              return false;
-//            }
-//            const SE3Transform right_to_left_se3_transform = se3_transform.inverse();
-//            const Matrix3x3 rotation = right_to_left_se3_transform.rotation();
-//            const FloatType angular_distance_to_prior
-//                    = right_to_left_se3_transform.quaternion().angularDistance(prior_quaternion);
-//            if (angular_distance_to_prior > max_angular_distance_to_prior) {
-//              return false;
-//            }
-//            const Vector3 normalized_estimated_translation = right_to_left_se3_transform.translation().normalized();
-//            const FloatType dot_product = normalized_estimated_translation.dot(normalized_prior_translation);
-//            if (dot_product < options_.min_translation_dot_product_with_prior) {
-//              return false;
-//            }
-//            return true;
-//          };
-
-          std::vector<size_t> inlier_indices;
-//          FundamentalMatrix fundamental_matrix_ransac;
-//          std::tie(fundamental_matrix_ransac, inlier_indices) = ransacFindInliers<FundamentalMatrix>(
-//                  num_samples,
-//                  num_samples_for_solver,
-//                  num_ransac_iterations,
-//                  fundamental_matrix_solver_8point,
-//                  fundamental_matrix_inlier_predicate,
-//                  fundamental_matrix_model_predicate
-//          );
-          FundamentalMatrix fundamental_matrix_ransac;
-          std::tie(fundamental_matrix_ransac, inlier_indices) = ransacFindInliers<FundamentalMatrix>(
-                  num_samples,
-                  num_samples_for_solver,
-                  num_ransac_iterations,
-                  fundamental_matrix_solver_8point,
-                  fundamental_matrix_inlier_predicate,
-                  fundamental_matrix_model_predicate
-          );
-          if (inlier_indices.size() >= min_num_inliers) {
-
-            // TODO
-            exportInlierMatchesToColmap(image_id1, image_id2, inlier_matches);
-
-            if (options_.dump_match_images) {
-              std::vector<KeypointMatch> tmp_keypoint_matches;
-              for (size_t inlier_index : inlier_indices) {
-                size_t index1;
-                size_t index2;
-                std::tie(index1, index2) = matches[inlier_index];
-                const Keypoint keypoint1 = undist_keypoints1[index1];
-                const Keypoint keypoint2 = undist_keypoints2[index2];
-                tmp_keypoint_matches.push_back(KeypointMatch(keypoint1, keypoint2));
-              }
-              // Dump keypoint matches
-              boostfs::path image_path1 = options_.images_path;
-              image_path1 /= image_names_.at(image_id1);
-              boostfs::path image_path2 = options_.images_path;
-              image_path2 /= image_names_.at(image_id2);
-              QImage keypoints_img1;
-              keypoints_img1.load(QString::fromStdString(image_path1.string()));
-              QImage keypoints_img2;
-              keypoints_img2.load(QString::fromStdString(image_path2.string()));
-              QImage match_img = bh::vision::drawKeypointsAndMatches(keypoints_img1, keypoints_img2, tmp_keypoint_matches);
-              const string match_dump_filename = string("dump/inlier_matches_") +
-                                                 std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
-              match_img.save(QString::fromStdString(match_dump_filename));
-            }
-
-            if (options_.dump_epipolar_lines) {
-              // Dump epipolar lines of matches
-              std::vector<Keypoint> tmp_keypoints1;
-              std::vector<Keypoint> tmp_keypoints2;
-              for (size_t inlier_index : inlier_indices) {
-                size_t index1;
-                size_t index2;
-                std::tie(index1, index2) = matches[inlier_index];
-                const Keypoint keypoint1 = undist_keypoints1[index1];
-                const Keypoint keypoint2 = undist_keypoints2[index2];
-                tmp_keypoints1.push_back(keypoint1);
-                tmp_keypoints2.push_back(keypoint2);
-              }
-              boostfs::path image_path1 = options_.images_path;
-              image_path1 /= image_names_.at(image_id1);
-              boostfs::path image_path2 = options_.images_path;
-              image_path2 /= image_names_.at(image_id2);
-              QImage keypoints_img1;
-              keypoints_img1.load(QString::fromStdString(image_path1.string()));
-              bh::vision::drawKeypoints(&keypoints_img1, tmp_keypoints1);
-              QImage keypoints_img2;
-              keypoints_img2.load(QString::fromStdString(image_path2.string()));
-              bh::vision::drawKeypoints(&keypoints_img2, tmp_keypoints2);
-//              const FundamentalMatrix fundamental_matrix = bh::vision::fundamentalMatrixFromEssentialMatrix(
-//                      fundamental_matrix_ransac, cv_camera1, cv_camera2);
-              QImage epipolar_lines_img = bh::vision::drawKeypointsAndEpipolarLines(
-                      keypoints_img1, keypoints_img2, fundamental_matrix_ransac, tmp_keypoints1, tmp_keypoints2);
-              const string epipolar_lines_dump_filename = string("dump/inlier_epipolar_lines_") +
-                                                          std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
-              epipolar_lines_img.save(QString::fromStdString(epipolar_lines_dump_filename));
-            }
-
-//            bool model_valid = true;
-//            FundamentalMatrix fundamental_matrix = fundamental_matrix_ransac;
-            bool model_valid;
-            FundamentalMatrix fundamental_matrix;
-            std::tie(model_valid, fundamental_matrix) = fundamental_matrix_solver(inlier_indices);
-            if (model_valid) {
-              for (size_t inlier_index : inlier_indices) {
-                inlier_matches.push_back(matches[inlier_index]);
-              }
-            }
-            const bool fundamental_matrix_valid = inlier_matches.size() >= num_samples_for_solver;
-            if (fundamental_matrix_valid) {
-              BH_ASSERT(inlier_indices.size() > 0);
-              const EssentialMatrix essential_matrix = bh::vision::essentialMatrixFromFundamentalMatrix(
-                      fundamental_matrix, cv_camera1, cv_camera2);
-              BH_PRINT_VALUE(fundamental_matrix_model_predicate(fundamental_matrix_ransac, inlier_indices));
-              BH_PRINT_VALUE(fundamental_matrix_model_predicate(fundamental_matrix, inlier_indices));
-              size_t index1;
-              size_t index2;
-              std::tie(index1, index2) = matches[inlier_indices[0]];
-              const Vector2 point1 = world_points1[index1];
-              const Vector2 point2 = world_points2[index2];
-              bool decompose_essential_matrix_success;
-              SE3Transform se3_transform;
-              std::tie(decompose_essential_matrix_success, se3_transform) = bh::vision::decomposeEssentialMatrix(
-                      essential_matrix, point1, point2);
-              if (decompose_essential_matrix_success) {
-                const SE3Transform right_to_left_se3_transform = se3_transform.inverse();
-                const Matrix3x3 rotation = right_to_left_se3_transform.rotation();
-                const Matrix3x3 rotation2 = right_to_left_se3_transform.rotation().inverse();
-                const FloatType angular_distance_to_prior
-                        = right_to_left_se3_transform.quaternion().angularDistance(prior_quaternion);
-                const Vector3 normalized_estimated_translation = right_to_left_se3_transform.translation().normalized();
-                const FloatType angular_distance = right_to_left_se3_transform.quaternion().angularDistance(
-                        Quaternion::Identity());
-                const FloatType dot_product = normalized_estimated_translation.dot(normalized_prior_translation);
-                BH_PRINT_VALUE(angular_distance_to_prior * 180 / M_PI);
-                BH_PRINT_VALUE(dot_product);
-                BH_PRINT_VALUE(std::acos(dot_product) * 180 / M_PI);
-                BH_PRINT_VALUE(fundamental_matrix_ransac);
-                BH_PRINT_VALUE(fundamental_matrix);
-                BH_ASSERT(fundamental_matrix_model_predicate(fundamental_matrix_ransac, inlier_indices));
-              }
-
-              // TODO
-              exportInlierMatchesToColmap(image_id1, image_id2, inlier_matches);
-
-              cout << "Inlier matches: " << inlier_matches.size() << endl;
-
-              if (options_.guided_matching) {
-                cout << "Performing guided matching of image " << image_id1 << " with " << image_id2 << endl;
-                SiftMatchMatrix guided_match_scores = computeMatchScoresGuided(
-                        all_descriptors_.at(image_id1), all_descriptors_.at(image_id2),
-                        [&](const size_t index1, const size_t index2) {
-                          const Keypoint keypoint1 = undist_keypoints1[index1];
-                          const Keypoint keypoint2 = undist_keypoints2[index2];
-                          const Vector2 point1(keypoint1.x(), keypoint1.y());
-                          const Vector2 point2(keypoint2.x(), keypoint2.y());
-                          const FloatType sampson_distance
-                                  = bh::vision::computeSampsonDistance(point1, point2, fundamental_matrix);
-                          const bool accept = sampson_distance <= options_.max_epipolar_error * options_.max_epipolar_error;
-                          //                        if (accept && std::abs(image_point1(1) - image_point2(1) > 50)) {
-                          //                          BH_PRINT_VALUE((fundamental_matrix * image_point1.homogeneous()).transpose());
-                          //                          BH_PRINT_VALUE((image_point2.homogeneous().transpose() * fundamental_matrix));
-                          //                          BH_PRINT_VALUE(fundamental_matrix);
-                          //                        }
-                          return accept;
-                        });
-
-                inlier_matches = selectBestMatches(
-                        guided_match_scores,
-                        options_.lowe_ratio_threshold,
-                        options_.max_feature_distance,
-                        options_.cross_check);
-
-                cout << "Guided matches: " << inlier_matches.size() << endl;
-
-                if (options_.dump_match_images) {
-                  std::vector<KeypointMatch> tmp_keypoint_matches;
-                  for (const auto& inlier_match : inlier_matches) {
-                    const Keypoint keypoint1 = undist_keypoints1[inlier_match.first];
-                    const Keypoint keypoint2 = undist_keypoints2[inlier_match.second];
-                    tmp_keypoint_matches.push_back(KeypointMatch(keypoint1, keypoint2));
-                  }
-                  // Dump keypoint matches
-                  boostfs::path image_path1 = options_.images_path;
-                  image_path1 /= image_names_.at(image_id1);
-                  boostfs::path image_path2 = options_.images_path;
-                  image_path2 /= image_names_.at(image_id2);
-                  QImage keypoints_img1;
-                  keypoints_img1.load(QString::fromStdString(image_path1.string()));
-                  QImage keypoints_img2;
-                  keypoints_img2.load(QString::fromStdString(image_path2.string()));
-                  QImage match_img = bh::vision::drawKeypointsAndMatches(keypoints_img1, keypoints_img2, tmp_keypoint_matches);
-                  const string match_dump_filename = string("dump/guided_matches_") +
-                                                     std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
-                  match_img.save(QString::fromStdString(match_dump_filename));
-                }
-
-                if (options_.dump_epipolar_lines) {
-                  // Dump epipolar lines of matches
-                  std::vector<Keypoint> tmp_keypoints1;
-                  std::vector<Keypoint> tmp_keypoints2;
-                  for (const auto& inlier_match : inlier_matches) {
-                    const Keypoint keypoint1 = undist_keypoints1[inlier_match.first];
-                    const Keypoint keypoint2 = undist_keypoints2[inlier_match.second];
-                    tmp_keypoints1.push_back(keypoint1);
-                    tmp_keypoints2.push_back(keypoint2);
-                  }
-                  boostfs::path image_path1 = options_.images_path;
-                  image_path1 /= image_names_.at(image_id1);
-                  boostfs::path image_path2 = options_.images_path;
-                  image_path2 /= image_names_.at(image_id2);
-                  QImage keypoints_img1;
-                  keypoints_img1.load(QString::fromStdString(image_path1.string()));
-                  QImage keypoints_img2;
-                  keypoints_img2.load(QString::fromStdString(image_path2.string()));
-//                const FundamentalMatrix fundamental_matrix = bh::vision::fundamentalMatrixFromEssentialMatrix(
-//                        essential_matrix_ransac, cv_camera1, cv_camera2);
-                  QImage epipolar_lines_img = bh::vision::drawKeypointsAndEpipolarLines(
-                          keypoints_img1, keypoints_img2, fundamental_matrix, tmp_keypoints1, tmp_keypoints2);
-                  const string epipolar_lines_dump_filename = string("dump/guided_epipolar_lines_") +
-                                                              std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
-                  epipolar_lines_img.save(QString::fromStdString(epipolar_lines_dump_filename));
-                }
-              }
-
-            }
-            else {
-              std::cout << "Could not find suitable model" << std::endl;
-              inlier_matches.clear();
-            }
-          }
-        }
-
-        // Create keypoint-matches vector
-        std::vector<KeypointMatch> keypoint_matches;
-        std::vector<KeypointMatch> undist_keypoint_matches;
-        for (const auto& entry : inlier_matches) {
-          keypoint_matches.push_back(KeypointMatch(keypoints1[entry.first], keypoints2[entry.second]));
-          undist_keypoint_matches.push_back(KeypointMatch(undist_keypoints1[entry.first], undist_keypoints2[entry.second]));
-        }
-//        // Create undistorted keypoint-matches
-//        std::vector<KeypointMatch> undist_keypoint_matches;
-//        for (const KeypointMatch& keypoint_match : keypoint_matches) {
-//          // Undistort keypoint 1
-//          const Keypoint& keypoint1 = keypoint_match.keypoint1();
-//          const Vector2 world_point1 = cv_camera1.imageToWorld(Vector2(keypoint1.x(), keypoint1.y()));
-//          const Vector2 undist_image_point1 = virtual_camera1.worldToImage(world_point1);
-//          const Keypoint undist_keypoint1(undist_image_point1(0), undist_image_point1(1), keypoint1.scale(), keypoint1.orientation());
-//          // Undistort keypoint 2
-//          const Keypoint& keypoint2 = keypoint_match.keypoint2();
-//          const Vector2 world_point2 = cv_camera2.imageToWorld(Vector2(keypoint2.x(), keypoint2.y()));
-//          const Vector2 undist_image_point2 = virtual_camera2.worldToImage(world_point2);
-//          const Keypoint undist_keypoint2(undist_image_point2(0), undist_image_point2(1), keypoint2.scale(), keypoint2.orientation());
-//          // Add undistorted keypoint match
-//          const KeypointMatch undist_keypoint_match(undist_keypoint1, undist_keypoint2);
-//          undist_keypoint_matches.push_back(undist_keypoint_match);
-//
-////          cout << "keypoint1=(" << keypoint1.x() << ", " << keypoint1.y() << ")" << endl;
-////          cout << "keypoint2=(" << keypoint2.x() << ", " << keypoint2.y() << ")" << endl;
-////          cout << "undist_keypoint1=(" << undist_keypoint1.x() << ", " << undist_keypoint1.y() << ")" << endl;
-////          cout << "undist_keypoint2=(" << undist_keypoint2.x() << ", " << undist_keypoint2.y() << ")" << endl;
-////          const FloatType depth1 = offscreen_renderer_->decodeDepthValue(depth_image1, undist_image_point1);
-////          const FloatType depth2 = offscreen_renderer_->decodeDepthValue(depth_image2, undist_image_point2);
-////          cout << "depth1=" << depth1 << endl;
-////          cout << "depth2=" << depth2 << endl;
-//        }
-
-        exportInlierMatchesToColmap(image_id1, image_id2, inlier_matches);
-
-        if (options_.dump_keypoint_images) {
-          // Dump keypoints of image 2
-          boostfs::path image_path2 = options_.images_path;
-          image_path2 /= image_names_.at(image_id2);
-          QImage keypoints_img2;
-          keypoints_img2.load(QString::fromStdString(image_path2.string()));
-          bh::vision::drawKeypoints(&keypoints_img2, keypoints2);
-          const string keypoint_dump_filename2 = string("dump/keypoints_") + std::to_string(image_id2) + ".png";
-          keypoints_img2.save(QString::fromStdString(keypoint_dump_filename2));
-        }
-
-//        if (options_.dump_keypoint_images) {
-//          // Dump keypoints of image 2 with mesh image
-//          QImage mesh_keypoints_img2 = mesh_image2;
-//          bh::vision::drawKeypoints(&mesh_keypoints_img2, undist_keypoints2);
-//          const string mesh_keypoint_dump_filename2 =
-//                  string("dump/keypoints_mesh_") + std::to_string(image_id2) + ".png";
-//          mesh_keypoints_img2.save(QString::fromStdString(mesh_keypoint_dump_filename2));
-//        }
-
-//        if (options_.dump_match_images) {
-//          // Dump keypoint matches with mesh images
-//          QImage mesh_match_img = bh::vision::drawKeypointsAndMatches(mesh_image1, mesh_image2,
-//                                                                      undist_keypoint_matches);
-//          const string mesh_match_dump_filename = string("dump/matches_mesh_") +
-//                                                  std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
-//          mesh_match_img.save(QString::fromStdString(mesh_match_dump_filename));
-//          // Dump keypoint matches with mesh depth images
-//          QImage depth_match_img = bh::vision::drawKeypointsAndMatches(depth_image1_cmap, depth_image2_cmap,
-//                                                                       undist_keypoint_matches);
-//          const string depth_match_dump_filename = string("dump/matches_depth_") +
-//                                                   std::to_string(image_id1) + "_" + std::to_string(image_id2) + ".png";
-//          depth_match_img.save(QString::fromStdString(depth_match_dump_filename));
-//        }
-      }
+    if (options_.dump_keypoint_images) {
+      dumpKeypointImages();
     }
 
-    // Dump images with feature matches
+    // Match features
+    runMatchingPipeline();
 
     return true;
   }
@@ -1631,10 +1526,7 @@ private:
   std::unordered_map<ImageId, string> image_names_;
   std::unordered_map<ImageId, CameraId> image_camera_ids_;
   CameraIdToOpenCVCameraMap cameras_;
-  std::unordered_map<ImageId, std::vector<Keypoint>> all_keypoints_;
-  std::unordered_map<ImageId, std::vector<Keypoint>> all_undist_keypoints_;
-  std::unordered_map<ImageId, std::vector<Vector2>> all_world_points_;
-  ImageIdToSiftDescriptorVectorMap all_descriptors_;
+  string inlier_matches_table_;
   ImageIdToPoseMap prior_image_poses_;
   std::unique_ptr<ViewpointOffscreenRenderer> offscreen_renderer_;
 };
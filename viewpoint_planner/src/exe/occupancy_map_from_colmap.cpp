@@ -5,7 +5,12 @@
  *      Author: bhepp
  */
 
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
 
 #include <boost/program_options.hpp>
 
@@ -14,6 +19,8 @@
 #include <bh/eigen.h>
 #include <bh/vision/cameras.h>
 #include <bh/string_utils.h>
+#include <bh/thread.h>
+#include <bh/utilities.h>
 #include "../reconstruction/dense_reconstruction.h"
 
 #include <opencv2/core.hpp>
@@ -30,6 +37,119 @@ USE_FIXED_EIGEN_TYPES(FloatType)
 namespace oct = octomap;
 using reconstruction::DenseReconstruction;
 
+/// Depth map read by the I/O stage
+struct DepthFrame {
+  size_t index;
+  reconstruction::ImageId image_id;
+  std::shared_ptr<DenseReconstruction::DepthMap> depth_map;
+};
+
+/// Point cloud produced by the back-projection stage
+struct PointCloudFrame {
+  size_t index;
+  reconstruction::ImageId image_id;
+  std::shared_ptr<DenseReconstruction::DepthMap> depth_map;
+  oct::point3d sensor_origin;
+  std::unique_ptr<oct::Pointcloud> point_cloud;
+};
+
+/// Calls a function when leaving the scope. Used to stop the pipeline threads if the main thread throws.
+class ScopeGuard {
+public:
+  explicit ScopeGuard(std::function<void()> function)
+  : function_(std::move(function)) {}
+
+  ~ScopeGuard() {
+    function_();
+  }
+
+  ScopeGuard(const ScopeGuard&) = delete;
+  ScopeGuard& operator=(const ScopeGuard&) = delete;
+
+private:
+  std::function<void()> function_;
+};
+
+/// Viewing rays (in camera coordinates with unit depth) of all pixels of a depth map
+struct PixelRays {
+  size_t width;
+  size_t height;
+  Eigen::Matrix<FloatType, 3, Eigen::Dynamic> rays;
+};
+
+const PixelRays& getPixelRays(
+    const reconstruction::PinholeCameraColmap& camera, const size_t width, const size_t height,
+    std::unordered_map<reconstruction::CameraId, PixelRays>* pixel_rays_cache) {
+  auto it = pixel_rays_cache->find(camera.id());
+  if (it != pixel_rays_cache->end() && it->second.width == width && it->second.height == height) {
+    return it->second;
+  }
+  const FloatType depth_camera_scale = width / (FloatType)camera.width();
+  const reconstruction::CameraMatrix depth_intrinsics = bh::vision::getScaledIntrinsics(
+      camera.intrinsics(), depth_camera_scale);
+  const reconstruction::CameraMatrix inv_depth_intrinsics = depth_intrinsics.inverse();
+  PixelRays pixel_rays;
+  pixel_rays.width = width;
+  pixel_rays.height = height;
+  pixel_rays.rays.resize(3, width * height);
+#pragma omp parallel for
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < width; ++x) {
+      const Vector4 p4d = inv_depth_intrinsics * Vector4(x, y, 1, 1);
+      pixel_rays.rays.col(y * width + x) = p4d.topRows(3);
+    }
+  }
+  return (*pixel_rays_cache)[camera.id()] = std::move(pixel_rays);
+}
+
+/// Back-project all valid pixels of a depth map into world coordinates.
+/// Rows are processed in parallel but the points are emitted in row-major pixel order.
+std::unique_ptr<oct::Pointcloud> backProjectDepthMap(
+    const DenseReconstruction::DepthMap& depth_map, const PixelRays& pixel_rays,
+    const Matrix3x4& transform_image_to_world, const FloatType max_range, const size_t pixel_stride) {
+  using Matrix3X = Eigen::Matrix<FloatType, 3, Eigen::Dynamic>;
+  const size_t num_rows = (depth_map.height() + pixel_stride - 1) / pixel_stride;
+  const Matrix3x3 rotation = transform_image_to_world.leftCols<3>();
+  const Vector3 translation = transform_image_to_world.col(3);
+  std::vector<std::vector<oct::point3d>> row_points(num_rows);
+#pragma omp parallel
+  {
+    Matrix3X camera_points(3, depth_map.width());
+    Matrix3X world_points(3, depth_map.width());
+#pragma omp for schedule(dynamic, 16)
+    for (size_t row = 0; row < num_rows; ++row) {
+      const size_t y = row * pixel_stride;
+      size_t num_points = 0;
+      for (size_t x = 0; x < depth_map.width(); x += pixel_stride) {
+        const DenseReconstruction::DepthMap::ValueType depth = depth_map(y, x);
+        if (depth <= 0 || !std::isfinite(depth) || depth > max_range) {
+          continue;
+        }
+        camera_points.col(num_points) = depth * pixel_rays.rays.col(y * depth_map.width() + x);
+        ++num_points;
+      }
+      world_points.leftCols(num_points).noalias() = rotation * camera_points.leftCols(num_points);
+      world_points.leftCols(num_points).colwise() += translation;
+      row_points[row].reserve(num_points);
+      for (size_t i = 0; i < num_points; ++i) {
+        row_points[row].emplace_back(world_points(0, i), world_points(1, i), world_points(2, i));
+      }
+    }
+  }
+  std::unique_ptr<oct::Pointcloud> point_cloud(new oct::Pointcloud());
+  size_t total_num_points = 0;
+  for (const std::vector<oct::point3d>& points : row_points) {
+    total_num_points += points.size();
+  }
+  point_cloud->reserve(total_num_points);
+  for (const std::vector<oct::point3d>& points : row_points) {
+    for (const oct::point3d& point : points) {
+      point_cloud->push_back(point);
+    }
+  }
+  return point_cloud;
+}
+
 std::pair<bool, boost::program_options::variables_map> process_commandline(int argc, char** argv) {
   namespace po = boost::program_options;
 
@@ -53,6 +173,8 @@ std::pair<bool, boost::program_options::variables_map> process_commandline(int a
       ("no-display", po::bool_switch()->default_value(false), "Do not show depth maps")
       ("set-all-unknown", po::bool_switch()->default_value(false), "Set all occupied voxels to unknown voxels")
       ("colmap-fusion-file", po::value<string>(), "Colmap MVS fusion.cfg file to specify which depth maps to use")
+      ("pixel-stride", po::value<size_t>()->default_value(1), "Only integrate every n-th pixel of a depth map (in x and y)")
+      ("pipeline-queue-size", po::value<size_t>()->default_value(4), "Number of frames buffered between pipeline stages")
       ;
 
     po::options_description options;
@@ -148,19 +270,100 @@ int main(int argc, char** argv) {
   }
   std::cout << "Total number of frames to integrate: " << images_to_integrate.size() << std::endl;
 
-  for (auto it = images_to_integrate.begin(); it != images_to_integrate.end(); ++it) {
-    const reconstruction::ImageId image_id = *it;
-    const reconstruction::ImageColmap& image = reconstruction.getImages().at(image_id);
-    const reconstruction::PinholeCameraColmap& camera = reconstruction.getCameras().at(image.camera_id());
-
-    cout << "Integrating frame " << (it - images_to_integrate.begin() + 1) << " of " << images_to_integrate.size()
-         << " (image ID " << image_id << ")" << endl;
-
-    DenseReconstruction::DepthMap depth_map =
-        reconstruction.readDepthMap(image_id, DenseReconstruction::DenseMapType::GEOMETRIC_FUSED);
+  // Integration is a pipeline of three stages connected by bounded queues:
+  // reading depth maps, back-projecting them into point clouds and inserting the point clouds into the tree.
+  // The point clouds are inserted in the order of images_to_integrate so the resulting map does not depend
+  // on the timing of the stages.
+  const size_t pixel_stride = vm["pixel-stride"].as<size_t>();
+  BH_ASSERT_STR(pixel_stride > 0, "Pixel stride must be positive");
+  const size_t queue_size = vm["pipeline-queue-size"].as<size_t>();
+  const bool display_depth_maps = !vm["no-display"].as<bool>();
+  bh::BoundedQueue<DepthFrame> depth_frame_queue(queue_size);
+  bh::BoundedQueue<PointCloudFrame> point_cloud_queue(queue_size);
+  std::exception_ptr reader_exception;
+  std::exception_ptr back_projection_exception;
+  std::thread reader_thread;
+  std::thread back_projection_thread;
+  // Closing the queues makes both stages finish so that the threads can always be joined
+  const auto stop_pipeline = [&]() {
+    depth_frame_queue.close();
+    point_cloud_queue.close();
+    if (reader_thread.joinable()) {
+      reader_thread.join();
+    }
+    if (back_projection_thread.joinable()) {
+      back_projection_thread.join();
+    }
+  };
+  const ScopeGuard pipeline_guard(stop_pipeline);
+
+  bh::Timer timer;
+  reader_thread = std::thread([&]() {
+    try {
+      for (size_t i = 0; i < images_to_integrate.size(); ++i) {
+        DepthFrame frame;
+        frame.index = i;
+        frame.image_id = images_to_integrate[i];
+        frame.depth_map = std::make_shared<DenseReconstruction::DepthMap>(
+            reconstruction.readDepthMap(frame.image_id, DenseReconstruction::DenseMapType::GEOMETRIC_FUSED));
+        if (!depth_frame_queue.push(std::move(frame))) {
+          break;
+        }
+      }
+    }
+    catch (...) {
+      reader_exception = std::current_exception();
+    }
+    depth_frame_queue.close();
+  });
+
+  back_projection_thread = std::thread([&]() {
+    try {
+      std::unordered_map<reconstruction::CameraId, PixelRays> pixel_rays_cache;
+      DepthFrame depth_frame;
+      while (depth_frame_queue.pop(&depth_frame)) {
+        const reconstruction::ImageColmap& image = reconstruction.getImages().at(depth_frame.image_id);
+        const reconstruction::PinholeCameraColmap& camera = reconstruction.getCameras().at(image.camera_id());
+        const DenseReconstruction::DepthMap& depth_map = *depth_frame.depth_map;
+        const PixelRays& pixel_rays = getPixelRays(camera, depth_map.width(), depth_map.height(), &pixel_rays_cache);
+        const Matrix3x4 transform_image_to_world = image.pose().getTransformationImageToWorld();
+        const Vector3 sensor_pos = transform_image_to_world.col(3).topRows(3);
+
+        PointCloudFrame point_cloud_frame;
+        point_cloud_frame.index = depth_frame.index;
+        point_cloud_frame.image_id = depth_frame.image_id;
+        point_cloud_frame.sensor_origin = oct::point3d(sensor_pos(0), sensor_pos(1), sensor_pos(2));
+        point_cloud_frame.point_cloud = backProjectDepthMap(
+            depth_map, pixel_rays, transform_image_to_world, max_range, pixel_stride);
+        if (display_depth_maps) {
+          point_cloud_frame.depth_map = std::move(depth_frame.depth_map);
+        }
+        depth_frame.depth_map.reset();
+        if (!point_cloud_queue.push(std::move(point_cloud_frame))) {
+          break;
+        }
+      }
+    }
+    catch (...) {
+      back_projection_exception = std::current_exception();
+    }
+    // Unblock the reader in case this stage stopped early
+    depth_frame_queue.close();
+    point_cloud_queue.close();
+  });
+
+  PointCloudFrame point_cloud_frame;
+  size_t num_integrated_frames = 0;
+  size_t num_integrated_points = 0;
+  while (point_cloud_queue.pop(&point_cloud_frame)) {
+    BH_ASSERT(point_cloud_frame.index == num_integrated_frames);
+    cout << "Integrating frame " << (point_cloud_frame.index + 1) << " of " << images_to_integrate.size()
+         << " (image ID " << point_cloud_frame.image_id << ", "
+         << point_cloud_frame.point_cloud->size() << " points)" << endl;
 
     // Show depth maps for debugging
-    if (!vm["no-display"].as<bool>()) {
+    if (display_depth_maps) {
+      const DenseReconstruction::DepthMap& depth_map = *point_cloud_frame.depth_map;
       cv::Mat depth_img(depth_map.height(), depth_map.width(), CV_32F);
       for (std::size_t y = 0; y < depth_map.height(); ++y) {
         for (std::size_t x = 0; x < depth_map.width(); ++x) {
@@ -177,38 +380,24 @@ int main(int argc, char** argv) {
       cv::waitKey(100);
     }
 
-    const reconstruction::CameraMatrix& intrinsics = camera.intrinsics();
-//    std::cout << "intrinsics=" << intrinsics << std::endl;
-    FloatType depth_camera_scale = depth_map.width() / (FloatType)camera.width();
-    const reconstruction::CameraMatrix depth_intrinsics = bh::vision::getScaledIntrinsics(intrinsics, depth_camera_scale);
-    const reconstruction::CameraMatrix inv_depth_intrinsics = depth_intrinsics.inverse();
-    cout << "depth_intrinsics=" << depth_intrinsics << endl;
-//    cout << "inv_depth_intrinsics=" << inv_depth_intrinsics << endl;
-    const Matrix3x4 transform_image_to_world = image.pose().getTransformationImageToWorld();
-//    std::cout << "transform_image_to_world: " << transform_image_to_world << std::endl;
-
-//    const bh::Pose::Vector3 sensor_pos = image.pose().getWorldPosition();
-    const Vector3 sensor_pos = transform_image_to_world.col(3).topRows(3);
-    oct::point3d sensor_origin(sensor_pos(0), sensor_pos(1), sensor_pos(2));
-    std::cout << "sensor_position=" << sensor_pos.transpose() << std::endl;
-
-    oct::Pointcloud pc;
-    for (size_t y = 0; y < depth_map.height(); ++y) {
-      for (size_t x = 0; x < depth_map.width(); ++x) {
-        DenseReconstruction::DepthMap::ValueType depth = depth_map(y, x);
-        if (depth <= 0 || !std::isfinite(depth) || depth > max_range) {
-          continue;
-        }
-//        cout << "x=" << x << ", y=" << y << ", depth=" << depth << endl;
-        Vector4 p4d = inv_depth_intrinsics * Vector4(x, y, 1, 1);
-        Vector3 p3d = depth * p4d.topRows(3);
-        p3d = transform_image_to_world * p3d.homogeneous();
-        oct::point3d p(p3d(0), p3d(1), p3d(2));
-        pc.push_back(p);
-      }
-    }
-    tree->insertPointCloud(pc, sensor_origin, max_range, vm["lazy-eval"].as<bool>());
+    tree->insertPointCloud(*point_cloud_frame.point_cloud, point_cloud_frame.sensor_origin,
+                           max_range, vm["lazy-eval"].as<bool>());
+    ++num_integrated_frames;
+    num_integrated_points += point_cloud_frame.point_cloud->size();
+  }
+  stop_pipeline();
+  // Worker exceptions are reported on the main thread
+  if (reader_exception) {
+    std::rethrow_exception(reader_exception);
+  }
+  if (back_projection_exception) {
+    std::rethrow_exception(back_projection_exception);
   }
+  BH_ASSERT(num_integrated_frames == images_to_integrate.size());
+  cout << "Integrated " << num_integrated_frames << " frames with " << num_integrated_points << " points" << endl;
+  timer.printTimingMs("Integrating frames");
+  cout << "Back-projection waited " << depth_frame_queue.numPopWaits() << " times for depth maps, "
+       << "integration waited " << point_cloud_queue.numPopWaits() << " times for point clouds" << endl;
 
   if (vm["set-all-unknown"].as<bool>()) {
     std::cout << "Setting all occupied nodes to unknown nodes" << std::endl;
@@ -7,6 +7,7 @@
 //==================================================
 
 
+#include <algorithm>
 #include <iostream>
 
 #include <boost/program_options.hpp>
@@ -17,6 +18,7 @@
 #include <bh/config_options.h>
 #include <bh/eigen_options.h>
 #include <bh/math/geometry.h>
+#include <bh/aabb/aabb_tree.h>
 
 #include "../octree/occupancy_map.h"
 
@@ -36,8 +38,8 @@ using BoundingBoxType = bh::BoundingBox3D<FloatType>;
 using MeshType = ml::MeshData<FloatType>;
 using MeshIOType = ml::MeshIO<FloatType>;
 using TriMeshType = ml::TriMesh<FloatType>;
-using RayType = ml::Ray<FloatType>;
-using TriMeshAcceleratorType = ml::TriMeshAcceleratorBVH<FloatType>;
+using Triangle = bh::Triangle<FloatType>;
+using TriAABBTree = bh::AABBTree<Triangle, FloatType>;
 using OccupancyMapType = OccupancyMap<OccupancyNode>;
 
 class OccupancyMapFromMeshCmdline {
@@ -54,10 +56,11 @@ public:
       addOption<FloatType>("mesh_scale", &mesh_scale);
       addOption<FloatType>("resolution", &resolution);
       addOption<bool>("make_dense", &make_dense);
-      addOption<bool>("lazy_eval", &lazy_eval);
       addOption<bool>("allow_raycast_from_inside_mesh", &allow_raycast_from_inside_mesh);
       addOption<bool>("fill_to_bottom_as_occupied", &fill_to_bottom_as_occupied);
       addOption<bool>("verbose", &verbose);
+      addOption<string>("voxelization_mode", &voxelization_mode);
+      addOption<size_t>("sweep_axis", &sweep_axis);
     }
 
     ~Options() override {}
@@ -67,10 +70,13 @@ public:
     FloatType resolution = FloatType(0.2);
     FloatType mesh_scale = FloatType(1);
     bool make_dense = false;
-    bool lazy_eval = false;
     bool allow_raycast_from_inside_mesh = false;
     bool fill_to_bottom_as_occupied = false;
     bool verbose = false;
+    // "surface" marks voxels intersecting the mesh as occupied.
+    // "columns" casts rays along sweep_axis and marks voxels inside of the mesh as occupied and outside as free.
+    string voxelization_mode = "surface";
+    size_t sweep_axis = 2;
   };
 
   static std::map<string, std::unique_ptr<bh::ConfigOptions>> getConfigOptions() {
@@ -90,6 +96,31 @@ public:
   ~OccupancyMapFromMeshCmdline() {
   }
 
+  struct LeafVoxel {
+    octomap::OcTreeKey key;
+    bool occupied;
+  };
+
+  /// Builds the tree from the leaf voxels in one pass. Occupied voxels take precedence over free ones.
+  void insertLeafVoxels(std::vector<LeafVoxel>* voxels, OccupancyMapType& tree) const {
+    // Same values as a single updateNode() on an unknown voxel (updateNode() does not count observations)
+    const OccupancyMapType::OccupancyType occupied_occupancy = tree.getProbHit();
+    const OccupancyMapType::OccupancyType free_occupancy = tree.getProbMiss();
+    std::vector<OccupancyMapType::LeafData> leaves(voxels->size());
+#pragma omp parallel for
+    for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(voxels->size()); ++i) {
+      const LeafVoxel& voxel = (*voxels)[i];
+      leaves[i].key = voxel.key;
+      leaves[i].occupancy = voxel.occupied ? occupied_occupancy : free_occupancy;
+      leaves[i].observation_count = 0;
+    }
+    voxels->clear();
+    voxels->shrink_to_fit();
+    cout << "Building octree from " << leaves.size() << " voxels" << endl;
+    const bool prune = true;
+    tree.buildFromLeaves(leaves, prune);
+  }
+
   void voxelizeMesh(const OccupancyMapFromMeshCmdline::Options& options,
                     const TriMeshType& tri_mesh,
                     OccupancyMapType& tree) {
@@ -119,228 +150,149 @@ public:
     const bool solid = false;
     tri_mesh.voxelize(binary_grid, world_to_voxel, solid, verbose);
     const ml::Matrix4x4<FloatType> voxel_to_world = world_to_voxel.getInverse();
-    for (size_t ix = 0; ix < binary_grid.getDimX(); ++ix) {
-      for (size_t iy = 0; iy < binary_grid.getDimY(); ++iy) {
-        for (size_t iz = 0; iz < binary_grid.getDimZ(); ++iz) {
-          const bool occupied = binary_grid.isVoxelSet(ix, iy, iz);
-          if (occupied) {
-            const ml::vec3<FloatType> ml_point = voxel_to_world * ml::vec3<FloatType>(ix, iy, iz);
-            const octomap::point3d point(ml_point[0], ml_point[1], ml_point[2]);
-            tree.updateNode(point, occupied, options.lazy_eval);
+    std::vector<LeafVoxel> voxels;
+#pragma omp parallel
+    {
+      std::vector<LeafVoxel> thread_voxels;
+#pragma omp for schedule(dynamic, 1)
+      for (std::ptrdiff_t ix = 0; ix < static_cast<std::ptrdiff_t>(binary_grid.getDimX()); ++ix) {
+        for (size_t iy = 0; iy < binary_grid.getDimY(); ++iy) {
+          for (size_t iz = 0; iz < binary_grid.getDimZ(); ++iz) {
+            const bool occupied = binary_grid.isVoxelSet(ix, iy, iz);
+            if (occupied) {
+              const ml::vec3<FloatType> ml_point = voxel_to_world * ml::vec3<FloatType>(ix, iy, iz);
+              const octomap::point3d point(ml_point[0], ml_point[1], ml_point[2]);
+              thread_voxels.push_back(LeafVoxel { tree.coordToKey(point), occupied });
+            }
           }
         }
       }
+#pragma omp critical
+      voxels.insert(voxels.end(), thread_voxels.begin(), thread_voxels.end());
     }
+    insertLeafVoxels(&voxels, tree);
   }
 
-  void sweepAxisAndUpdateOccupiedNodes(size_t sweep_axis_index,
-                                       const OccupancyMapFromMeshCmdline::Options& options,
-                                       const TriMeshAcceleratorType& tri_mesh_acc,
-                                       OccupancyMapType& tree) {
-    cout << "Sweeping axis " << sweep_axis_index << endl;
-
-    const bool verbose = options.verbose;
-
-    BoundingBoxType clip_bbox(
-        options.clip_bbox_min,
-        options.clip_bbox_max);
-
-    octomap::point3d clip_bbox_min(clip_bbox.getMinimum(0), clip_bbox.getMinimum(1), clip_bbox.getMinimum(2));
-    octomap::point3d clip_bbox_max(clip_bbox.getMaximum(0), clip_bbox.getMaximum(1), clip_bbox.getMaximum(2));
-    octomap::OcTreeKey key_min = tree.coordToKey(clip_bbox_min);
-    octomap::OcTreeKey key_max = tree.coordToKey(clip_bbox_max);
-    clip_bbox_min = tree.keyToCoord(key_min);
-    clip_bbox_max = tree.keyToCoord(key_max);
-
-    ml::vec3<FloatType> ray_direction;
-    ray_direction[sweep_axis_index] = -1;
-    const FloatType tmin = FloatType(1e-5) / options.mesh_scale;
-    const FloatType tmax = std::numeric_limits<FloatType>::max();
-
-    size_t free_count = 0;
-    size_t occupied_count = 0;
-
-    cout << "clip_bbox_min=" << clip_bbox_min << endl;
-    cout << "clip_bbox_max=" << clip_bbox_max << endl;
-
-    size_t axis1_index = sweep_axis_index + 1;
-    if (axis1_index >= 3) {
-      axis1_index = 0;
+  /// Adds the voxels of a column in the range [lower, upper] of the sweep axis.
+  void addColumnSpan(const octomap::OcTreeKey& column_key, const size_t sweep_axis_index,
+                     const FloatType lower, const FloatType upper, const bool occupied,
+                     const OccupancyMapType& tree, std::vector<LeafVoxel>* voxels) const {
+    if (options_.make_dense && !occupied) {
+      return;
     }
-    size_t axis2_index = axis1_index + 1;
-    if (axis2_index >= 3) {
-      axis2_index = 0;
+    const FloatType clipped_lower = std::max(lower, options_.clip_bbox_min(sweep_axis_index));
+    const FloatType clipped_upper = std::min(upper, options_.clip_bbox_max(sweep_axis_index));
+    if (clipped_lower > clipped_upper) {
+      return;
     }
-    cout << "sweep_axis_index=" << sweep_axis_index << ", axis1_index=" << axis1_index << ", axis2_index=" << axis2_index << endl;
-
-    for (FloatType x1 = clip_bbox_min(axis1_index); x1 <= clip_bbox_max(axis1_index); x1 += options.resolution) {
-      cout << "x1=" << x1 << endl;
-      for (FloatType x2 = clip_bbox_min(axis2_index); x2 <= clip_bbox_max(axis2_index); x2 += options.resolution) {
-        cout << "x2=" << x2 << endl;
-//    FloatType x = -4.1f;
-//    FloatType y = 3.7f;
-//    {
-//      {
-        const FloatType x_sweep_min = clip_bbox_min(sweep_axis_index);
-        const FloatType x_sweep_max = clip_bbox_max(sweep_axis_index);
-        // Shoot ray down along z-axis and find intersections with mesh.
-
-        bool occupied_space = false;
-        bool first_intersection = true;
-        FloatType x_sweep_previous = x_sweep_max;
-        FloatType sweep_progress = std::numeric_limits<FloatType>::max();
-        while (x_sweep_previous > x_sweep_min && sweep_progress > 1e-5) {
-          ml::vec3<FloatType> ray_origin;
-          ray_origin[axis1_index] = x1;
-          ray_origin[axis2_index] = x2;
-          ray_origin[sweep_axis_index] = x_sweep_previous;
-          const RayType ray(ray_origin / options.mesh_scale, ray_direction / options.mesh_scale);
-          const bool only_front_faces = false;
-          TriMeshAcceleratorType::Intersection intersection = tri_mesh_acc.intersect(ray, tmin, tmax, only_front_faces);
-          if (verbose) {
-            cout << "Cast ray for x1=" << x1 << ", x2=" << x2 << ", sweep_previous=" << x_sweep_previous << endl;
-            cout << "Intersection: " << intersection.isValid() << endl;
-          }
-          if (intersection.isValid()) {
-            const FloatType x_sweep_next = intersection.getSurfacePosition().z * options.mesh_scale;
-            const FloatType dot_product = ml::vec3<FloatType>::dot(intersection.getSurfaceNormal(), ray_direction);
-            if (verbose) {
-              cout << "Hit at z_next=" << x_sweep_next << endl;
-              cout << "dot_product=" << dot_product << endl;
-              cout << "surface=" << intersection.getSurfaceNormal() << endl;
-            }
-            // We started a ray from inside the mesh
-            bool transition_to_occupied = false;
-            const ml::vec3<FloatType> next_ray_origin(x1, x2, x_sweep_next);
-            const RayType next_ray(next_ray_origin / options.mesh_scale, ray_direction / options.mesh_scale);
-            TriMeshAcceleratorType::Intersection next_intersection = tri_mesh_acc.intersect(next_ray, tmin, tmax, only_front_faces);
-            if (next_intersection.isValid()) {
-              const FloatType next_dot_product = ml::vec3<FloatType>::dot(next_intersection.getSurfaceNormal(), ray_direction);
-              if (verbose) {
-                cout << "next_next_z=" << next_intersection.getSurfacePosition().z << endl;
-                cout << "next_surfacez=" << next_intersection.getSurfaceNormal() << endl;
-                cout << "next_dot_product=" << next_dot_product << endl;
-              }
-              if (dot_product < 0) {
-                transition_to_occupied = true;
-              }
-//              if (dot_product < 0 && next_dot_product > 0) {
-//                transition_to_occupied = true;
-//              }
-            }
-            else {
-              if (verbose) {
-                cout << "No next intersection" << endl;
-              }
-              transition_to_occupied = true;
-            }
-            if (transition_to_occupied) {
-              if (verbose) {
-                cout << "Transition to occupied space" << endl;
-              }
-            }
-            if (dot_product > 0 && first_intersection && options.allow_raycast_from_inside_mesh) {
-              if (verbose) {
-                cout << "Started ray from inside mesh" << endl;
-              }
-              occupied_space = true;
-            }
-            for (FloatType x_sweep = x_sweep_previous; x_sweep >= x_sweep_next; x_sweep -= options.resolution) {
-              const bool occupied = occupied_space;
-              octomap::point3d point;
-              point(axis1_index) = x1;
-              point(axis2_index) = x2;
-              point(sweep_axis_index) = x_sweep;
-#pragma omp critical
-              if (!options_.make_dense || occupied) {
-                tree.updateNode(point, occupied, options_.lazy_eval);
-//                OccupancyNode* node = tree.search(point, tree.getTreeDepth());
-//                BH_PRINT_VALUE(point);
-//                BH_PRINT_VALUE(node);
-//                BH_PRINT_VALUE(tree.keyToCoord(tree.coordToKey(point)));
-              }
-              {
-                if (occupied) {
-                  ++occupied_count;
-                }
-                else {
-                  ++free_count;
-                }
-              }
-            }
-            // Make sure the end voxel of the intersecting ray is marked as occupied
-            const bool occupied = occupied_space;
-            octomap::point3d point;
-            point(axis1_index) = x1;
-            point(axis2_index) = x2;
-            point(sweep_axis_index) = x_sweep_next;
-            if (!options_.make_dense || occupied) {
-              tree.updateNode(point, occupied, options_.lazy_eval);
-            }
-            {
-              if (occupied) {
-                ++occupied_count;
-              }
-              else {
-                ++free_count;
-              }
-            }
-            if (transition_to_occupied) {
-//              if (z_next >= 45) {
-//                cout << "Cast ray for x=" << x << ", y=" << y << ", z_start=" << z_previous << endl;
-//                cout << "Intersection: " << intersection.isValid() << endl;
-//                cout << "dot_product=" << dot_product << endl;
-//                cout << "surface=" << intersection.getSurfaceNormal() << endl;
-//                cout << "z_next=" << z_next << endl;
-//              }
-//              BH_ASSERT(z_next < 45);
-              // Transition from outside to inside
-              if (verbose) {
-                cout << "Switching to occupied space" << endl;
-              }
-              occupied_space = true;
-            }
-            else {
-              if (verbose) {
-                cout << "Switching to free space" << endl;
-              }
-              occupied_space = false;
-            }
-            sweep_progress = x_sweep_previous - x_sweep_next;
-            x_sweep_previous = x_sweep_next;
-            first_intersection = false;
-          }
-          else {
-            if (options_.fill_to_bottom_as_occupied) {
-              if (verbose) {
-                cout << "Filling nodes to bottom as occupied=" << occupied_space << endl;
-              }
-              for (FloatType x_sweep = x_sweep_previous; x_sweep >= x_sweep_min; x_sweep -= options_.resolution) {
-                const bool occupied = occupied_space;
-                octomap::point3d point;
-                point(axis1_index) = x1;
-                point(axis2_index) = x2;
-                point(sweep_axis_index) = x_sweep;
-  #pragma omp critical
-                {
-                  if (!options_.make_dense || occupied) {
-                    tree.updateNode(point, occupied, options_.lazy_eval);
-                  }
-                  if (occupied) {
-                    ++occupied_count;
-                  }
-                  else {
-                    ++free_count;
-                  }
-                }
-              }
-            }
-            sweep_progress = x_sweep_previous - x_sweep_min;
-            x_sweep_previous = x_sweep_min;
-          }
+    const octomap::key_type key_lower = tree.coordToKey(clipped_lower);
+    const octomap::key_type key_upper = tree.coordToKey(clipped_upper);
+    octomap::OcTreeKey key = column_key;
+    for (size_t k = key_lower; k <= key_upper; ++k) {
+      key[sweep_axis_index] = static_cast<octomap::key_type>(k);
+      voxels->push_back(LeafVoxel { key, occupied });
+    }
+  }
+
+  /// Casts one ray per column of voxels along the negative sweep axis and collects all mesh intersections.
+  /// The intersections split the column into spans that are inside (occupied) or outside (free) of the mesh.
+  /// Hits with a surface facing against the ray enter the mesh, hits with a surface facing along the ray
+  /// leave the mesh. Voxels containing a hit are occupied. The columns are processed in parallel.
+  void voxelizeMeshColumns(const size_t sweep_axis_index,
+                           const OccupancyMapFromMeshCmdline::Options& options,
+                           const MeshType& mesh_data,
+                           OccupancyMapType& tree) {
+    cout << "Sweeping axis " << sweep_axis_index << endl;
+    BH_ASSERT(sweep_axis_index < 3);
+    const size_t axis1_index = (sweep_axis_index + 1) % 3;
+    const size_t axis2_index = (sweep_axis_index + 2) % 3;
+
+    std::vector<Triangle> triangles;
+    triangles.reserve(mesh_data.m_FaceIndicesVertices.size());
+    BoundingBoxType mesh_bbox;
+    for (size_t i = 0; i < mesh_data.m_FaceIndicesVertices.size(); ++i) {
+      const MeshType::Indices::Face& face = mesh_data.m_FaceIndicesVertices[i];
+      BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
+      const Triangle tri(
+          options.mesh_scale * bh::MLibUtilities::convertMlibToEigen(mesh_data.m_Vertices[face[0]]),
+          options.mesh_scale * bh::MLibUtilities::convertMlibToEigen(mesh_data.m_Vertices[face[1]]),
+          options.mesh_scale * bh::MLibUtilities::convertMlibToEigen(mesh_data.m_Vertices[face[2]]));
+      mesh_bbox.include(tri.v1());
+      mesh_bbox.include(tri.v2());
+      mesh_bbox.include(tri.v3());
+      triangles.push_back(tri);
+    }
+    cout << "Building AABB tree for " << triangles.size() << " triangles" << endl;
+    const TriAABBTree aabb_tree(triangles);
+
+    const octomap::point3d clip_bbox_min(options.clip_bbox_min(0), options.clip_bbox_min(1), options.clip_bbox_min(2));
+    const octomap::point3d clip_bbox_max(options.clip_bbox_max(0), options.clip_bbox_max(1), options.clip_bbox_max(2));
+    const octomap::OcTreeKey key_min = tree.coordToKey(clip_bbox_min);
+    const octomap::OcTreeKey key_max = tree.coordToKey(clip_bbox_max);
+    // Rays start above the mesh so that the inside/outside state at the top of the clip box is known
+    const FloatType ray_start = std::max(mesh_bbox.getMaximum(sweep_axis_index), options.clip_bbox_max(sweep_axis_index))
+                                + options.resolution;
+    Vector3 ray_direction = Vector3::Zero();
+    ray_direction(sweep_axis_index) = -1;
+
+    const size_t num_columns1 = key_max[axis1_index] - key_min[axis1_index] + 1;
+    const size_t num_columns2 = key_max[axis2_index] - key_min[axis2_index] + 1;
+    const size_t num_columns = num_columns1 * num_columns2;
+    cout << "Casting rays for " << num_columns << " columns" << endl;
+
+    std::vector<LeafVoxel> voxels;
+#pragma omp parallel
+    {
+      std::vector<LeafVoxel> thread_voxels;
+      // Sweep axis coordinate of each hit and whether the ray enters the mesh
+      std::vector<std::pair<FloatType, bool>> hits;
+#pragma omp for schedule(dynamic, 64)
+      for (std::ptrdiff_t column = 0; column < static_cast<std::ptrdiff_t>(num_columns); ++column) {
+        octomap::OcTreeKey column_key;
+        column_key[axis1_index] = static_cast<octomap::key_type>(key_min[axis1_index] + column / num_columns2);
+        column_key[axis2_index] = static_cast<octomap::key_type>(key_min[axis2_index] + column % num_columns2);
+        column_key[sweep_axis_index] = key_max[sweep_axis_index];
+        Vector3 ray_origin;
+        ray_origin(axis1_index) = tree.keyToCoord(column_key[axis1_index]);
+        ray_origin(axis2_index) = tree.keyToCoord(column_key[axis2_index]);
+        ray_origin(sweep_axis_index) = ray_start;
+        const TriAABBTree::RayDataType ray(ray_origin, ray_direction);
+
+        hits.clear();
+        for (const TriAABBTree::RayIntersection& intersection : aabb_tree.intersectRange(ray)) {
+          const Triangle& tri = aabb_tree.getCollider(intersection.nodeIndex());
+          const FloatType dot_product = tri.getNormal(false).dot(ray_direction);
+          hits.emplace_back(ray_start - intersection.rayT(), dot_product < 0);
+        }
+        std::sort(hits.begin(), hits.end(), [](const std::pair<FloatType, bool>& a, const std::pair<FloatType, bool>& b) {
+          return a.first > b.first;
+        });
+        if (options.verbose) {
+          cout << "Column " << column << " has " << hits.size() << " hits" << endl;
+        }
+
+        int inside_count = 0;
+        if (options.allow_raycast_from_inside_mesh && !hits.empty() && !hits.front().second) {
+          // We started the ray from inside the mesh
+          inside_count = 1;
+        }
+        FloatType upper = ray_start;
+        for (const std::pair<FloatType, bool>& hit : hits) {
+          addColumnSpan(column_key, sweep_axis_index, hit.first, upper, inside_count > 0, tree, &thread_voxels);
+          // Make sure the voxel of the hit is marked as occupied
+          addColumnSpan(column_key, sweep_axis_index, hit.first, hit.first, true, tree, &thread_voxels);
+          inside_count = std::max(inside_count + (hit.second ? 1 : -1), 0);
+          upper = hit.first;
+        }
+        if (options.fill_to_bottom_as_occupied) {
+          addColumnSpan(column_key, sweep_axis_index, std::numeric_limits<FloatType>::lowest(), upper,
+                        inside_count > 0, tree, &thread_voxels);
         }
       }
+#pragma omp critical
+      voxels.insert(voxels.end(), thread_voxels.begin(), thread_voxels.end());
     }
+    insertLeafVoxels(&voxels, tree);
   }
 
   bool run() {
@@ -351,20 +303,14 @@ public:
 
     OccupancyMapType tree(options_.resolution);
 
-//    // Build accelerator structure
-//    cout << "Building mesh accelerator structure" << endl;
-//    TriMeshAcceleratorType tri_mesh_acc(tri_mesh);
-//    cout << "Done" << endl;
-
-//    sweepAxisAndUpdateOccupiedNodes(2, options_, tri_mesh_acc, tree);
-//    sweepAxisAndUpdateOccupiedNodes(0, options_, tri_mesh_acc, tree);
-//    sweepAxisAndUpdateOccupiedNodes(1, options_, tri_mesh_acc, tree);
-
-    voxelizeMesh(options_, tri_mesh, tree);
-
-    if (options_.lazy_eval) {
-      cout << "Updating inner nodes" << endl;
-      tree.updateInnerOccupancy();
+    if (options_.voxelization_mode == "surface") {
+      voxelizeMesh(options_, tri_mesh, tree);
+    }
+    else if (options_.voxelization_mode == "columns") {
+      voxelizeMeshColumns(options_.sweep_axis, options_, mesh_data, tree);
+    }
+    else {
+      throw BH_EXCEPTION(std::string("Unknown voxelization mode: ") + options_.voxelization_mode);
     }
 
     octomap::point3d point(-4.1f, 3.7f, 11.5f);
@@ -80,9 +80,26 @@ public:
   }
 
   void run(const boost::program_options::variables_map& vm) {
-    if (vm.count("in-viewpoint-graph-file") > 0) {
+    const bool use_journal = vm.count("journal-file") > 0;
+    if (use_journal && vm.count("out-viewpoint-graph-file") == 0) {
+      throw BH_EXCEPTION("A journal requires an output viewpoint graph file to compact into");
+    }
+    if (use_journal && boost::filesystem::exists(vm["journal-file"].as<std::string>())) {
+      // Resume from the last compacted viewpoint graph and replay the journal on top of it
+      const std::string out_viewpoint_graph_file = vm["out-viewpoint-graph-file"].as<std::string>();
+      if (boost::filesystem::exists(out_viewpoint_graph_file)) {
+        getPlanner().loadViewpointGraph(out_viewpoint_graph_file);
+      }
+      else if (vm.count("in-viewpoint-graph-file") > 0) {
+        getPlanner().loadViewpointGraph(vm["in-viewpoint-graph-file"].as<std::string>());
+      }
+    }
+    else if (vm.count("in-viewpoint-graph-file") > 0) {
       getPlanner().loadViewpointGraph(vm["in-viewpoint-graph-file"].as<std::string>());
     }
+    if (use_journal) {
+      getPlanner().openJournal(vm["journal-file"].as<std::string>());
+    }
 
     if (vm.count("out-viewpoint-graph-file") > 0) {
       enableCtrlCHandler(signalIntHandler);
@@ -93,6 +110,7 @@ public:
       while (!ctrl_c_pressed && getPlanner().getViewpointGraph().numVertices() < max_num_candidates) {
         const bool result = getPlanner().generateNextViewpointEntry2();
         graph_modified = true;
+        getPlanner().compactJournalIfNeeded(vm["out-viewpoint-graph-file"].as<std::string>());
         std::cout << "Generate next viewpoint result -> " << result << std::endl;
         std::cout << "Sampled " << getPlanner().getViewpointGraph().numVertices()
             << " of " << vm["num-candidates"].as<std::size_t>() << " viewpoints" << std::endl;
@@ -104,23 +122,31 @@ public:
       }
       std::cout << "Done" << std::endl;
       disableCtrlCHandler();
+      if (getPlanner().getOptions().viewpoint_coarse_evaluation) {
+        getPlanner().printCandidateEvaluationStatistics();
+      }
 
       if (graph_modified) {
-        getPlanner().saveViewpointGraph(vm["out-viewpoint-graph-file"].as<std::string>());
+        saveViewpointGraph(vm["out-viewpoint-graph-file"].as<std::string>());
       }
 
       if (!vm["no-motion-computation"].as<bool>()) {
         std::cout << "Computing motions" << std::endl;
         getPlanner().computeViewpointMotions();
         std::cout << "Done" << std::endl;
-        getPlanner().saveViewpointGraph(vm["out-viewpoint-graph-file"].as<std::string>());
+        saveViewpointGraph(vm["out-viewpoint-graph-file"].as<std::string>());
+      }
+      else if (!getPlanner().getOptions().viewpoint_motion_lazy
+               && getPlanner().getViewpointGraph().numEdges() == 0) {
+        std::cout << "WARNING: Motion computation is disabled and the viewpoint graph has no motions."
+            << " Viewpoint paths cannot be connected." << std::endl;
       }
 
       if (vm["stereo-viewpoint-computation"].as<bool>()) {
         std::cout << "Computing stereo viewpoints" << std::endl;
         getPlanner().computeMatchingStereoViewpoints();
         std::cout << "Done" << std::endl;
-        getPlanner().saveViewpointGraph(vm["out-viewpoint-graph-file"].as<std::string>());
+        saveViewpointGraph(vm["out-viewpoint-graph-file"].as<std::string>());
       }
     }
 
@@ -128,7 +154,8 @@ public:
     if (vm.count("out-viewpoint-path-file") > 0) {
 //      const bool use_manual_drone_start_position = vm.count("drone-start-viewpoint-ids") == 0;
 
-      if (vm.count("drone-start-viewpoint-ids") > 0) {
+      // Resumed viewpoint paths already contain the starting viewpoints
+      if (vm.count("drone-start-viewpoint-ids") > 0 && getPlanner().getBestViewpointPath().entries.empty()) {
         const bool drone_start_viewpoint_mvs = vm["drone-start-viewpoint-mvs"].as<bool>();
         const std::string drone_start_viewpoint_ids_str = vm["drone-start-viewpoint-ids"].as<std::string>();
         std::vector<std::size_t> drone_start_viewpoint_ids;
@@ -154,6 +181,7 @@ public:
             getPlanner().addViewpointPathEntry(path_index, path_entry, ignore_observed_voxels);
           }
         }
+        getPlanner().journalViewpointPaths();
       }
 
       enableCtrlCHandler(signalIntHandler);
@@ -162,6 +190,9 @@ public:
       std::cout << "Computing viewpoint paths" << std::endl;
       while (!ctrl_c_pressed && getPlanner().getNumMVSViewpoints(getPlanner().getBestViewpointPath()) < num_viewpoints) {
         ViewpointPlanner::NextViewpointPathEntryStatus result = getPlanner().findNextViewpointPathEntries();
+        if (use_journal) {
+          getPlanner().compactJournalIfNeeded(vm["out-viewpoint-graph-file"].as<std::string>());
+        }
         std::cout << "Find next viewpoint path entries result -> " << result << std::endl;
         std::cout << "Computed " << getPlanner().getBestViewpointPath().entries.size()
             << " of " << num_viewpoints << " viewpoint path entries" << std::endl;
@@ -194,6 +225,10 @@ public:
 
       disableCtrlCHandler();
       std::cout << "Done" << std::endl;
+      if (use_journal) {
+        // Tour computation and augmentation are cheap compared to the path search and are not journaled
+        getPlanner().closeJournal();
+      }
 
       const std::string out_viewpoint_path_file = vm["out-viewpoint-path-file"].as<std::string>();
       getPlanner().saveViewpointPath(out_viewpoint_path_file + ".bs");
@@ -225,6 +260,16 @@ public:
   }
 
 private:
+  /// Saves the viewpoint graph. With a journal the graph is saved by compacting the journal into it.
+  void saveViewpointGraph(const std::string& filename) {
+    if (getPlanner().hasJournal()) {
+      getPlanner().compactJournal(filename);
+    }
+    else {
+      getPlanner().saveViewpointGraph(filename);
+    }
+  }
+
   ViewpointPlanner *planner_ptr_;
 };
 
@@ -243,6 +288,7 @@ std::pair<bool, boost::program_options::variables_map> processOptions(
         ("in-viewpoint-graph-file", po::value<std::string>(), "Viewpoint graph file to load before processing.")
         ("out-viewpoint-graph-file", po::value<std::string>(), "File to save the viewpoint graph to after processing.")
         ("out-viewpoint-path-file", po::value<std::string>(), "File to save the viewpoint path to after processing.")
+        ("journal-file", po::value<std::string>(), "Journal of planner changes for resuming an interrupted run. Requires an output viewpoint graph file.")
         ("no-motion-computation", po::bool_switch()->default_value(false), "Whether to prevent motion computation")
         ("stereo-viewpoint-computation", po::bool_switch()->default_value(false), "Whether to compute stereo viewpoints")
         ("no-tour-computation", po::bool_switch()->default_value(false), "Whether to prevent tour computation")
@@ -0,0 +1,141 @@
+//==================================================
+// viewpoint_planner_service.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 18.05.17
+//==================================================
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <csignal>
+
+#include <bh/boost.h>
+#include <boost/program_options.hpp>
+
+#include <QApplication>
+
+#include <bh/common.h>
+#include <bh/config_options.h>
+
+#include "../planner/viewpoint_planner.h"
+#include "../web/web_socket_server.h"
+#include "../web/planner_service.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+void signalIntHandler(int sig) {
+  QCoreApplication::quit();
+}
+
+std::map<std::string, std::unique_ptr<bh::ConfigOptions>> getConfigOptions() {
+  std::map<std::string, std::unique_ptr<bh::ConfigOptions>> config_options;
+  config_options.emplace(std::piecewise_construct,
+    std::forward_as_tuple("viewpoint_planner.data"),
+    std::forward_as_tuple(static_cast<bh::ConfigOptions*>(new ViewpointPlannerData::Options())));
+  config_options.emplace(std::piecewise_construct,
+    std::forward_as_tuple("viewpoint_planner"),
+    std::forward_as_tuple(static_cast<bh::ConfigOptions*>(new ViewpointPlanner::Options())));
+  config_options.emplace(std::piecewise_construct,
+    std::forward_as_tuple("motion_planner"),
+    std::forward_as_tuple(static_cast<bh::ConfigOptions*>(new ViewpointPlanner::MotionPlannerType::Options())));
+  return config_options;
+}
+
+std::pair<bool, boost::program_options::variables_map> processOptions(
+    int argc, char** argv, std::map<std::string, std::unique_ptr<bh::ConfigOptions>>& config_options) {
+  namespace po = boost::program_options;
+
+  po::variables_map vm;
+  try {
+    po::options_description generic_options("Generic options");
+    generic_options.add_options()
+        ("help", "Produce help message")
+        ("config-file", po::value<string>()->default_value("viewpoint_planner.cfg"), "Config file.")
+        ("port", po::value<quint16>()->default_value(8765), "Port of the WebSocket server.")
+        ("listen-any", po::bool_switch()->default_value(false), "Listen on all interfaces instead of only on localhost.")
+        ("in-viewpoint-graph-file", po::value<std::string>(), "Viewpoint graph file to load for each new session.")
+        ;
+
+    po::options_description options;
+    options.add(generic_options);
+    po::store(po::command_line_parser(argc, argv).options(options).run(), vm);
+    if (vm.count("help")) {
+      std::cout << options << std::endl;
+      return std::make_pair(false, vm);
+    }
+    po::notify(vm);
+
+    po::options_description config_file_options;
+    for (auto& entry : config_options) {
+      config_file_options.add(entry.second->getBoostOptions());
+    }
+    std::ifstream config_in(vm["config-file"].as<string>());
+    if (!config_in) {
+      throw BH_EXCEPTION("Unable to open config file");
+    }
+    else {
+      const bool allow_unregistered = true;
+      po::store(parse_config_file(config_in, config_file_options, allow_unregistered), vm);
+      notify(vm);
+    }
+
+    for (auto& entry : config_options) {
+      entry.second->setVariablesMap(vm);
+    }
+
+    return std::make_pair(true, vm);
+  }
+  catch (const po::required_option& err) {
+    std::cerr << "Error parsing command line: Required option '" << err.get_option_name() << "' is missing" << std::endl;
+    return std::make_pair(false, vm);
+  }
+  catch (const po::error& err) {
+    std::cerr << "Error parsing command line: " << err.what() << std::endl;
+    return std::make_pair(false, vm);
+  }
+}
+
+int main(int argc, char** argv) {
+  QApplication qapp(argc, argv);
+  qapp.setApplicationName("Quad3DR viewpoint planner service");
+
+  std::map<std::string, std::unique_ptr<bh::ConfigOptions>> config_options = getConfigOptions();
+
+  // Handle command line and config file
+  std::pair<bool, boost::program_options::variables_map> cmdline_result =
+    processOptions(argc, argv, config_options);
+  if (!cmdline_result.first) {
+    return 1;
+  }
+  boost::program_options::variables_map vm = std::move(cmdline_result.second);
+
+  // The scene data is loaded once and shared by all planner sessions
+  const ViewpointPlannerData::Options* planner_data_options =
+    dynamic_cast<ViewpointPlannerData::Options*>(config_options.at("viewpoint_planner.data").get());
+  std::shared_ptr<ViewpointPlannerData> planner_data(new ViewpointPlannerData(planner_data_options));
+
+  const QHostAddress address = vm["listen-any"].as<bool>() ? QHostAddress(QHostAddress::Any) : QHostAddress(QHostAddress::LocalHost);
+  const bool echo_messages = false;
+  WebSocketServer server(vm["port"].as<quint16>(), address, echo_messages);
+  if (!server.isListening()) {
+    std::cerr << "Unable to listen on port " << vm["port"].as<quint16>() << std::endl;
+    return 1;
+  }
+  const std::string viewpoint_graph_filename = vm.count("in-viewpoint-graph-file") > 0 ?
+                                               vm["in-viewpoint-graph-file"].as<std::string>() : std::string();
+  planner_service::PlannerService service(
+    &server, planner_data,
+    dynamic_cast<ViewpointPlanner::Options*>(config_options.at("viewpoint_planner").get()),
+    dynamic_cast<ViewpointPlanner::MotionPlannerType::Options*>(config_options.at("motion_planner").get()),
+    viewpoint_graph_filename);
+
+  std::signal(SIGINT, signalIntHandler);
+  cout << "Planner service is ready" << endl;
+  const int result = qapp.exec();
+  std::signal(SIGINT, SIG_DFL);
+  return result;
+}
@@ -27,6 +27,9 @@ std::string OccupancyMap<AugmentedOccupancyNode>::getTreeType() const {
 template <>
 std::unique_ptr<OccupancyMap<AugmentedOccupancyNode>> OccupancyMap<AugmentedOccupancyNode>::read(const std::string& filename) {
   std::unique_ptr<OccupancyMap<AugmentedOccupancyNode>> tree(reinterpret_cast<OccupancyMap<AugmentedOccupancyNode>*>(octomap::AbstractOcTree::read(filename)));
+  if (!tree) {
+    return std::move(tree);
+  }
 
   using TreeNavigatorType = OccupancyMap<AugmentedOccupancyNode>::TreeNavigatorType;
 
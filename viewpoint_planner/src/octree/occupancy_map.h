@@ -33,6 +33,7 @@
  * along with this program. If not, see http://www.gnu.org/licenses/.
  */
 
+#include <array>
 #include <list>
 #include <stdlib.h>
 #include <vector>
@@ -45,6 +46,7 @@
 #include <octomap/OcTreeBaseImpl.h>
 #include <octomap/AbstractOccupancyOcTree.h>
 #include <ait/eigen.h>
+#include <bh/memory.h>
 #include <src/octree/occupancy_node.h>
 
 using octomap::OcTreeKey;
@@ -178,15 +180,15 @@ public:
   }
 
   OccupancyType getProbHit() const {
-    return prob_hit_log_;
+    return octomap::probability(prob_hit_log_);
   }
 
   void setProbMiss(OccupancyType prob) {
     prob_miss_log_ = octomap::logodds(prob);
   }
 
-  OccupancyType setProbMiss() const {
-    return prob_miss_log_;
+  OccupancyType getProbMiss() const {
+    return octomap::probability(prob_miss_log_);
   }
 
 protected:
@@ -323,6 +325,25 @@ public:
    NodeT* setNodeOccupancyAndObservationCount(
        const OcTreeKey& key, OccupancyType occupancy, CounterType observation_count, bool lazy_eval);
 
+   /// Leaf record for buildFromLeaves()
+   struct LeafData {
+     OcTreeKey key;
+     OccupancyType occupancy;
+     CounterType observation_count;
+   };
+
+   /**
+    * Replaces the content of the tree with the given leaves (at the lowest tree level).
+    * The leaves are sorted by Morton code in parallel and the tree is built bottom-up in a single pass.
+    * Inner nodes are aggregated with updateFromChildren() and collapsible nodes are pruned while building.
+    * This is much faster than inserting many leaves one by one. No call to updateInnerOccupancy() is needed.
+    * If a key appears multiple times the leaf with the highest occupancy is used.
+    *
+    * @param leaves leaf records
+    * @param prune whether collapsible nodes are pruned
+    */
+   void buildFromLeaves(const std::vector<LeafData>& leaves, bool prune = true);
+
    /**
     * Integrate occupancy measurement.
     *
@@ -384,6 +405,39 @@ public:
 
   void allocNodeChild(NodeT* node, size_t pos);
 
+  // -- node memory  ----------------------------
+  // The tree owns the memory of its nodes and child arrays (see node_arena_). The following functions
+  // replace the OctoMap versions that allocate with new and delete.
+
+  /// Creates a new child of node at child_idx. Allocates the child array if needed.
+  NodeT* createNodeChild(NodeT* node, unsigned int child_idx);
+
+  /// Deletes the child of node at child_idx. The child must not have children of its own.
+  void deleteNodeChild(NodeT* node, unsigned int child_idx);
+
+  /// Creates all 8 children of a leaf with the data of the node
+  virtual void expandNode(NodeT* node);
+
+  /// Deletes the node at the given key and depth (0: lowest level) including its children.
+  /// Pruned parents are expanded first.
+  bool deleteNode(const OcTreeKey& key, unsigned int depth = 0);
+
+  bool deleteNode(const point3d& value, unsigned int depth = 0);
+
+  bool deleteNode(double x, double y, double z, unsigned int depth = 0);
+
+  /// Deletes the whole tree. All node memory is released at once.
+  virtual void clear();
+
+  /// Swaps the nodes (and their memory) with another tree
+  void swapContent(OccupancyMap& other);
+
+  /// Bytes held by the tree including unused node memory
+  virtual size_t memoryUsage() const;
+
+  /// Reads the nodes of a tree. The tree has to be empty.
+  virtual std::istream& readData(std::istream& s);
+
   /// converts from a discrete key at the lowest tree level into a coordinate
   /// corresponding to the key's center
   inline float keyToCoordFloat(unsigned short int key) const{
@@ -624,6 +678,37 @@ protected:
 
   void updateInnerOccupancyRecurs(NodeT* node, unsigned int depth);
 
+  /// Interleaves the key bits so that the code is the sequence of child indices from the root to the leaf.
+  static uint64_t computeMortonCode(const OcTreeKey& key);
+
+  /// Creates an inner node with the given children for buildFromLeaves() and prunes it if possible.
+  NodeT* createBulkNode(NodeT* const* children, bool prune);
+
+  /// Allocates a default constructed node from the arena. Does not change the tree size.
+  NodeT* allocateNode();
+
+  /// Destroys a node and returns its memory to the arena. The child array has to be freed before.
+  void freeNode(NodeT* node);
+
+  /// Returns the child array of a node to the arena. The children have to be deleted before.
+  void freeNodeChildren(NodeT* node);
+
+  /// Pre-order deep copy of a subtree (of another tree) into this tree's arena
+  NodeT* copyNodeRecurs(const NodeT* node);
+
+  bool deleteNodeRecurs(NodeT* node, unsigned int depth, unsigned int max_depth, const OcTreeKey& key);
+
+  std::istream& readNodesRecurs(NodeT* node, std::istream& s);
+
+  using ChildArray = std::array<octomap::AbstractOcTreeNode*, 8>;
+
+  /// Memory of all nodes and child arrays of this tree. Nodes are allocated in creation order,
+  /// i.e. depth-first for trees that are read from a file or built with buildFromLeaves().
+  /// clear() and the destructor release all of it at once without visiting the nodes,
+  /// so NodeT must not own any resources.
+  bh::ObjectArena<NodeT> node_arena_;
+  bh::ObjectArena<ChildArray> child_array_arena_;
+
 protected:
   bool use_bbx_limit;  ///< use bounding box for queries (needs to be set)?
   point3d bbx_min;
@@ -35,8 +35,12 @@
 #include <algorithm>
 #include <cmath>
 //#include <octomap/MCTables.h>
+#include <array>
+#include <bitset>
+#include <new>
 #include <ait/common.h>
 #include <ait/utilities.h>
+#include <bh/algorithm.h>
 
 template <typename NodeT>
 AbstractOccupancyMap<NodeT>::AbstractOccupancyMap() {
@@ -57,16 +61,25 @@ OccupancyMap<NodeT>::OccupancyMap(double resolution, unsigned int tree_depth, un
 {}
 
 template <typename NodeT>
-OccupancyMap<NodeT>::~OccupancyMap(){}
+OccupancyMap<NodeT>::~OccupancyMap() {
+  // The arenas release the node memory. The OctoMap destructor must not delete the nodes again.
+  this->root = nullptr;
+  this->tree_size = 0;
+}
 
 template <typename NodeT>
 OccupancyMap<NodeT>::OccupancyMap(const OccupancyMap& rhs)
-: OcTreeBaseImpl<NodeT, AbstractOccupancyMap<NodeT>>(rhs), use_bbx_limit(rhs.use_bbx_limit),
+: OcTreeBaseImpl<NodeT, AbstractOccupancyMap<NodeT>>(rhs.resolution, rhs.tree_depth, rhs.tree_max_val),
+  use_bbx_limit(rhs.use_bbx_limit),
   bbx_min(rhs.bbx_min), bbx_max(rhs.bbx_max),
   bbx_min_key(rhs.bbx_min_key), bbx_max_key(rhs.bbx_max_key),
   use_change_detection(rhs.use_change_detection), changed_keys(rhs.changed_keys) {
   this->occ_prob_thres_ = rhs.occ_prob_thres_;
   this->observation_thres_ = rhs.observation_thres_;
+  if (rhs.root != nullptr) {
+    this->root = copyNodeRecurs(rhs.root);
+  }
+  this->tree_size = rhs.tree_size;
 }
 
 template <>
@@ -259,7 +272,7 @@ NodeT* OccupancyMap<NodeT>::setNodeOccupancyAndObservationCount(
     const OcTreeKey& key, OccupancyType occupancy, CounterType observation_count, bool lazy_eval) {
   bool createdRoot = false;
   if (this->root == NULL){
-    this->root = new NodeT();
+    this->root = allocateNode();
     this->tree_size++;
     createdRoot = true;
   }
@@ -267,6 +280,106 @@ NodeT* OccupancyMap<NodeT>::setNodeOccupancyAndObservationCount(
   return setNodeOccupancyAndObservationCountRecurs(this->root, createdRoot, key, 0, occupancy, observation_count, lazy_eval);
 }
 
+template <typename NodeT>
+uint64_t OccupancyMap<NodeT>::computeMortonCode(const OcTreeKey& key) {
+  // Spread the 16 bits of each key component to every third bit
+  const auto spread_bits = [](uint64_t x) -> uint64_t {
+    x &= 0xFFFF;
+    x = (x | (x << 16)) & 0x0000FF0000FFull;
+    x = (x | (x << 8)) & 0x00F00F00F00Full;
+    x = (x | (x << 4)) & 0x0C30C30C30C3ull;
+    x = (x | (x << 2)) & 0x249249249249ull;
+    return x;
+  };
+  // Same bit order as computeChildIdx()
+  return spread_bits(key[0]) | (spread_bits(key[1]) << 1) | (spread_bits(key[2]) << 2);
+}
+
+template <typename NodeT>
+NodeT* OccupancyMap<NodeT>::createBulkNode(NodeT* const* children, bool prune) {
+  NodeT* node = allocateNode();
+  this->tree_size++;
+  allocNodeChildren(node);
+  for (unsigned int i = 0; i < 8; ++i) {
+    node->children[i] = children[i];
+  }
+  if (!prune || !this->pruneNode(node)) {
+    node->updateFromChildren();
+  }
+  return node;
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::buildFromLeaves(const std::vector<LeafData>& leaves, bool prune) {
+  this->clear();
+  if (leaves.empty()) {
+    return;
+  }
+
+  std::vector<std::pair<uint64_t, size_t>> codes(leaves.size());
+#pragma omp parallel for
+  for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(leaves.size()); ++i) {
+    codes[i] = std::make_pair(computeMortonCode(leaves[i].key), static_cast<size_t>(i));
+  }
+  bh::parallelSort(codes.begin(), codes.end());
+
+  // Leaves arrive in depth-first order so only the nodes on the path to the current leaf are open.
+  // open_children[d] holds the children of the open node at depth d. A node is created once all of its
+  // leaves have been seen and is then added to its parent.
+  const unsigned int depth = this->tree_depth;
+  const auto child_index = [depth](const uint64_t code, const unsigned int node_depth) -> unsigned int {
+    return (code >> (3 * (depth - 1 - node_depth))) & 7;
+  };
+  std::vector<std::array<NodeT*, 8>> open_children(depth);
+  for (std::array<NodeT*, 8>& children : open_children) {
+    children.fill(nullptr);
+  }
+  const auto close_node = [&](const unsigned int node_depth, const uint64_t code) {
+    NodeT* node = createBulkNode(open_children[node_depth].data(), prune);
+    open_children[node_depth].fill(nullptr);
+    if (node_depth > 0) {
+      open_children[node_depth - 1][child_index(code, node_depth - 1)] = node;
+    }
+    else {
+      this->root = node;
+    }
+  };
+
+  uint64_t prev_code = 0;
+  bool first_leaf = true;
+  for (size_t k = 0; k < codes.size();) {
+    const uint64_t code = codes[k].first;
+    const LeafData* leaf = &leaves[codes[k].second];
+    for (++k; k < codes.size() && codes[k].first == code; ++k) {
+      if (leaves[codes[k].second].occupancy > leaf->occupancy) {
+        leaf = &leaves[codes[k].second];
+      }
+    }
+    if (!first_leaf) {
+      // Close all open nodes below the common ancestor of this leaf and the previous leaf
+      const uint64_t diff = code ^ prev_code;
+      unsigned int level = 0;
+      while ((diff >> (3 * (level + 1))) != 0) {
+        ++level;
+      }
+      for (unsigned int d = depth - 1; d >= depth - level; --d) {
+        close_node(d, prev_code);
+      }
+    }
+    NodeT* leaf_node = allocateNode();
+    this->tree_size++;
+    leaf_node->setOccupancy(leaf->occupancy);
+    leaf_node->setObservationCount(leaf->observation_count);
+    open_children[depth - 1][child_index(code, depth - 1)] = leaf_node;
+    prev_code = code;
+    first_leaf = false;
+  }
+  for (unsigned int d = depth; d > 0; --d) {
+    close_node(d - 1, prev_code);
+  }
+  this->size_changed = true;
+}
+
 template <typename NodeT>
 bool OccupancyMap<NodeT>::pruneNode(NodeT* node) {
   if (!isNodeCollapsible(node)) {
@@ -281,8 +394,7 @@ bool OccupancyMap<NodeT>::pruneNode(NodeT* node) {
   for (size_t i = 0; i < 8; i++) {
     this->deleteNodeChild(node, i);
   }
-  delete[] node->children;
-  node->children = nullptr;
+  freeNodeChildren(node);
 
   return true;
 }
@@ -331,7 +443,7 @@ template <typename NodeT>
 NodeT* OccupancyMap<NodeT>::updateNode(const OcTreeKey& key, OccupancyType occupancy_log, bool lazy_eval) {
   bool createdRoot = false;
   if (this->root == NULL){
-    this->root = new NodeT();
+    this->root = allocateNode();
     this->tree_size++;
     createdRoot = true;
   }
@@ -343,7 +455,7 @@ template <typename NodeT>
 NodeT* OccupancyMap<NodeT>::updateNode(const OcTreeKey& key, bool occupied, bool lazy_eval) {
   bool createdRoot = false;
   if (this->root == NULL){
-    this->root = new NodeT();
+    this->root = allocateNode();
     this->tree_size++;
     createdRoot = true;
   }
@@ -717,7 +829,9 @@ bool OccupancyMap<NodeT>::castRay(const point3d& origin, const point3d& directio
 
 template <typename NodeT>
 void OccupancyMap<NodeT>::allocNodeChildren(NodeT* node) {
-  node->allocChildren();
+  ChildArray* child_array = new (child_array_arena_.allocate()) ChildArray();
+  child_array->fill(nullptr);
+  node->children = child_array->data();
 }
 
 template <typename NodeT>
@@ -751,8 +865,210 @@ OcTreeKey OccupancyMap<NodeT>::getParentKey(const OcTreeKey& child_key, size_t c
 template <typename NodeT>
 void OccupancyMap<NodeT>::createRoot() {
   AIT_ASSERT(this->root == nullptr);
-  this->root = new NodeT();
+  this->root = allocateNode();
+  this->tree_size++;
+}
+
+template <typename NodeT>
+NodeT* OccupancyMap<NodeT>::allocateNode() {
+  return new (node_arena_.allocate()) NodeT();
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::freeNode(NodeT* node) {
+  AIT_ASSERT(node->children == nullptr);
+  node->~NodeT();
+  node_arena_.deallocate(node);
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::freeNodeChildren(NodeT* node) {
+  if (node->children != nullptr) {
+    child_array_arena_.deallocate(reinterpret_cast<ChildArray*>(node->children));
+    node->children = nullptr;
+  }
+}
+
+template <typename NodeT>
+NodeT* OccupancyMap<NodeT>::createNodeChild(NodeT* node, unsigned int child_idx) {
+  if (node->children == nullptr) {
+    allocNodeChildren(node);
+  }
+  AIT_ASSERT(node->children[child_idx] == nullptr);
+  NodeT* child = allocateNode();
+  node->children[child_idx] = child;
   this->tree_size++;
+  this->size_changed = true;
+  return child;
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::deleteNodeChild(NodeT* node, unsigned int child_idx) {
+  NodeT* child = this->getNodeChild(node, child_idx);
+  freeNode(child);
+  node->children[child_idx] = nullptr;
+  this->tree_size--;
+  this->size_changed = true;
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::expandNode(NodeT* node) {
+  AIT_ASSERT(!this->nodeHasChildren(node));
+  for (unsigned int k = 0; k < 8; ++k) {
+    NodeT* child = createNodeChild(node, k);
+    child->copyData(*node);
+  }
+}
+
+template <typename NodeT>
+bool OccupancyMap<NodeT>::deleteNode(const OcTreeKey& key, unsigned int depth) {
+  if (this->root == nullptr) {
+    return true;
+  }
+  if (depth == 0) {
+    depth = this->tree_depth;
+  }
+  return deleteNodeRecurs(this->root, 0, depth, key);
+}
+
+template <typename NodeT>
+bool OccupancyMap<NodeT>::deleteNode(const point3d& value, unsigned int depth) {
+  OcTreeKey key;
+  if (!this->coordToKeyChecked(value, key)) {
+    return false;
+  }
+  return deleteNode(key, depth);
+}
+
+template <typename NodeT>
+bool OccupancyMap<NodeT>::deleteNode(double x, double y, double z, unsigned int depth) {
+  return deleteNode(point3d(float(x), float(y), float(z)), depth);
+}
+
+template <typename NodeT>
+bool OccupancyMap<NodeT>::deleteNodeRecurs(NodeT* node, unsigned int depth, unsigned int max_depth, const OcTreeKey& key) {
+  if (depth >= max_depth) {
+    return true;
+  }
+  const unsigned int pos = computeChildIdx(key, this->tree_depth - 1 - depth);
+  if (!this->nodeChildExists(node, pos)) {
+    // The child does not exist but the node might have been pruned
+    if (!this->nodeHasChildren(node) && node != this->root) {
+      expandNode(node);
+    }
+    else {
+      return false;
+    }
+  }
+
+  NodeT* child = this->getNodeChild(node, pos);
+  const bool delete_child = deleteNodeRecurs(child, depth + 1, max_depth, key);
+  if (delete_child) {
+    // Free the whole subtree of the child
+    std::vector<NodeT*> node_stack;
+    node_stack.push_back(child);
+    while (!node_stack.empty()) {
+      NodeT* subtree_node = node_stack.back();
+      node_stack.pop_back();
+      if (subtree_node->children != nullptr) {
+        for (unsigned int i = 0; i < 8; ++i) {
+          if (subtree_node->children[i] != nullptr) {
+            NodeT* subtree_child = this->getNodeChild(subtree_node, i);
+            subtree_node->children[i] = nullptr;
+            this->tree_size--;
+            node_stack.push_back(subtree_child);
+          }
+        }
+        freeNodeChildren(subtree_node);
+      }
+      if (subtree_node != child) {
+        freeNode(subtree_node);
+      }
+    }
+    deleteNodeChild(node, pos);
+    if (!this->nodeHasChildren(node)) {
+      freeNodeChildren(node);
+      return true;
+    }
+    else {
+      node->updateFromChildren();
+    }
+  }
+  return false;
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::clear() {
+  if (this->root != nullptr) {
+    this->root = nullptr;
+    this->tree_size = 0;
+    this->size_changed = true;
+  }
+  node_arena_.release();
+  child_array_arena_.release();
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::swapContent(OccupancyMap& other) {
+  std::swap(this->root, other.root);
+  std::swap(this->tree_size, other.tree_size);
+  node_arena_.swap(other.node_arena_);
+  child_array_arena_.swap(other.child_array_arena_);
+  this->size_changed = true;
+  other.size_changed = true;
+}
+
+template <typename NodeT>
+size_t OccupancyMap<NodeT>::memoryUsage() const {
+  return sizeof(OccupancyMap) + node_arena_.memoryUsage() + child_array_arena_.memoryUsage();
+}
+
+template <typename NodeT>
+std::istream& OccupancyMap<NodeT>::readData(std::istream& s) {
+  if (!s.good()) {
+    OCTOMAP_WARNING_STR(__FILE__ << ":" << __LINE__ << "Warning: Input filestream not \"good\"");
+  }
+  this->tree_size = 0;
+  this->size_changed = true;
+  // The tree needs to be newly created or cleared externally
+  if (this->root != nullptr) {
+    OCTOMAP_ERROR_STR("Trying to read into an existing tree.");
+    return s;
+  }
+  this->root = allocateNode();
+  readNodesRecurs(this->root, s);
+  this->tree_size = this->calcNumNodes();
+  return s;
+}
+
+template <typename NodeT>
+std::istream& OccupancyMap<NodeT>::readNodesRecurs(NodeT* node, std::istream& s) {
+  node->readData(s);
+  char children_char;
+  s.read(&children_char, sizeof(char));
+  const std::bitset<8> children(static_cast<unsigned long long>(static_cast<unsigned char>(children_char)));
+  for (unsigned int i = 0; i < 8; ++i) {
+    if (children[i]) {
+      NodeT* child = createNodeChild(node, i);
+      readNodesRecurs(child, s);
+    }
+  }
+  return s;
+}
+
+template <typename NodeT>
+NodeT* OccupancyMap<NodeT>::copyNodeRecurs(const NodeT* node) {
+  NodeT* copy = allocateNode();
+  copy->copyData(*node);
+  if (node->children != nullptr) {
+    allocNodeChildren(copy);
+    for (unsigned int i = 0; i < 8; ++i) {
+      if (node->children[i] != nullptr) {
+        copy->children[i] = copyNodeRecurs(static_cast<const NodeT*>(node->children[i]));
+      }
+    }
+  }
+  return copy;
 }
 
 template <typename NodeT>
@@ -19,24 +19,25 @@
 using std::swap;
 
 ViewpointPlanner::ViewpointPlanner(
-    const Options* options, const MotionPlannerType::Options* motion_options, std::unique_ptr<ViewpointPlannerData> data)
+    const Options* options, const MotionPlannerType::Options* motion_options, std::shared_ptr<ViewpointPlannerData> data)
 : options_(*options), data_(std::move(data)),
   raycaster_(&data_->occupied_bvh_, options_.raycast_min_range, options_.raycast_max_range),
   scorer_(viewpoint_planner::ViewpointScore::Options(), [&](const Viewpoint& viewpoint, const VoxelType* node, const Vector2& image_coordinates) -> Vector3 {
     return computeNormalVector(viewpoint, node, image_coordinates);
   }),
   motion_planner_(motion_options, data_.get(), options->motion_planner_log_filename),
-  viewpoint_sampling_distribution_update_size_(0),
+  next_candidate_stream_id_(0),
+  viewpoint_sampling_max_grid_count_(0),
   viewpoint_graph_components_valid_(false), viewpoint_paths_initialized_(false),
   viewpoint_path_time_constraint_(options_.viewpoint_path_time_constraint) {
 #if WITH_CUDA
   raycaster_.setEnableCuda(options_.enable_cuda);
 #endif
-  size_t random_seed = options_.rng_seed;
-  if (random_seed == 0) {
-    random_seed = std::chrono::system_clock::now().time_since_epoch().count();
+  random_seed_ = options_.rng_seed;
+  if (random_seed_ == 0) {
+    random_seed_ = std::chrono::system_clock::now().time_since_epoch().count();
   }
-  random_.setSeed(random_seed);
+  random_.setSeed(random_seed_);
   if (options_.virtual_camera_width > 0) {
     BH_ASSERT(options_.virtual_camera_height > 0);
     BH_ASSERT(options_.virtual_camera_focal_length > 0);
@@ -110,6 +111,11 @@ ViewpointPlanner::ViewpointPlanner(
 
   sparse_matching_max_angular_distance_ = options_.sparse_matching_max_angular_distance_degrees * M_PI / FloatType(180);
 
+  // Most neighbor queries are for viewpoints within the discard distance
+  if (options_.viewpoint_discard_dist_thres_square > 0) {
+    viewpoint_ann_.setCellSize(std::sqrt(options_.viewpoint_discard_dist_thres_square));
+  }
+
   if (!options_.viewpoint_graph_filename.empty()) {
     loadViewpointGraph(options_.viewpoint_graph_filename);
   }
@@ -119,8 +125,19 @@ ViewpointPlanner::ViewpointPlanner(
 }
 
 void ViewpointPlanner::reset() {
+  if (hasJournal()) {
+    std::cout << "WARNING: Closing journal because the planner is reset" << std::endl;
+    closeJournal();
+  }
   std::unique_lock<std::mutex> lock(mutex_);
+  viewpoint_graph_checksum_ = 0;
   num_of_failed_viewpoint_entry_samples_ = 0;
+  num_of_evaluated_candidates_ = 0;
+  num_of_coarse_rejected_candidates_ = 0;
+  num_of_accepted_candidates_ = 0;
+  num_of_coarse_rays_ = 0;
+  num_of_full_rays_ = 0;
+  num_of_saved_full_rays_ = 0;
   viewpoint_entries_.clear();
   stereo_viewpoint_indices_.clear();
   viewpoint_ann_.clear();
@@ -129,9 +146,13 @@ void ViewpointPlanner::reset() {
   viewpoint_graph_components_.first.clear();
   viewpoint_graph_components_valid_ = false;
   viewpoint_graph_motions_.clear();
+  lazy_viewpoint_motions_.clear();
+  invalid_viewpoint_motions_.clear();
   viewpoint_count_grid_.setAllValues(0);
-  grid_cell_probabilities_ = std::vector<FloatType>(viewpoint_count_grid_.getNumElements());
-  std::fill(grid_cell_probabilities_.begin(), grid_cell_probabilities_.end(), 1 / FloatType(grid_cell_probabilities_.size()));
+  viewpoint_sampling_cells_.clear();
+  viewpoint_sampling_cell_slots_.clear();
+  viewpoint_sampling_distribution_.clear();
+  viewpoint_sampling_max_grid_count_ = 0;
   cached_visible_sparse_points_.clear();
   cached_visible_voxels_.clear();
   viewpoint_paths_initialized_ = false;
@@ -173,6 +194,9 @@ void ViewpointPlanner::resetViewpointMotions() {
   }
   viewpoint_graph_components_valid_ = false;
   viewpoint_graph_motions_.clear();
+  lazy_viewpoint_motions_.clear();
+  invalid_viewpoint_motions_.clear();
+  journalViewpointMotionsReset();
   lock.unlock();
 }
 
@@ -183,6 +207,7 @@ void ViewpointPlanner::resetViewpointPaths() {
   viewpoint_paths_.resize(options_.viewpoint_path_branches);
   viewpoint_paths_data_.clear();
   viewpoint_paths_data_.resize(options_.viewpoint_path_branches);
+  journalViewpointPathsReset();
   lock.unlock();
 }
 
@@ -239,10 +264,8 @@ bool ViewpointPlanner::isValidObjectPosition(const Vector3& position, const Boun
 auto ViewpointPlanner::findViewpointEntryWithPose(const Pose& pose) const -> std::pair<bool, ViewpointEntryIndex> {
   ViewpointEntryIndex matching_viewpoint_index = (ViewpointEntryIndex)-1;
   const std::size_t knn = options_.viewpoint_motion_max_neighbors;
-  static std::vector<ViewpointANN::IndexType> knn_indices;
-  static std::vector<ViewpointANN::DistanceType> knn_distances;
-  knn_indices.resize(knn);
-  knn_distances.resize(knn);
+  std::vector<ViewpointANN::IndexType> knn_indices;
+  std::vector<ViewpointANN::DistanceType> knn_distances;
   viewpoint_ann_.knnSearch(pose.getWorldPosition(), knn, &knn_indices, &knn_distances);
   bool found = false;
   for (std::size_t i = 0; i < knn_distances.size(); ++i) {
@@ -19,13 +19,15 @@
 #include <bh/boost_serialization_utils.h>
 #include <rapidjson/document.h>
 #include <bh/common.h>
+#include <bh/append_only_journal.h>
 #include <bh/config_options.h>
 #include <bh/eigen_options.h>
 #include <bh/random.h>
 #include <bh/eigen_utils.h>
 #include <bh/graph_boost.h>
 #include <bh/math/continuous_grid3d.h>
-#include <bh/nn/approximate_nearest_neighbor.h>
+#include <bh/math/dynamic_discrete_distribution.h>
+#include <bh/nn/hash_grid_nearest_neighbor.h>
 #include <bh/opengl/offscreen_opengl.h>
 #include "../rendering/octree_drawer.h"
 #include "../mLib/mLib.h"
@@ -106,6 +108,9 @@ public:
       addOption<FloatType>("viewpoint_voxel_distance_threshold", &viewpoint_voxel_distance_threshold);
       addOption<FloatType>("viewpoint_max_too_close_voxel_ratio", &viewpoint_max_too_close_voxel_ratio);
       addOption<FloatType>("viewpoint_min_information", &viewpoint_min_information);
+      addOption<bool>("viewpoint_coarse_evaluation", &viewpoint_coarse_evaluation);
+      addOption<size_t>("viewpoint_coarse_evaluation_stride", &viewpoint_coarse_evaluation_stride);
+      addOption<FloatType>("viewpoint_coarse_evaluation_margin", &viewpoint_coarse_evaluation_margin);
       addOption<size_t>("viewpoint_sample_motion_and_matching_knn", &viewpoint_sample_motion_and_matching_knn);
       addOption<FloatType>("viewpoint_information_factor", &viewpoint_information_factor);
       addOption<bool>("viewpoint_generate_stereo_pairs", &viewpoint_generate_stereo_pairs);
@@ -130,6 +135,7 @@ public:
       addOption<FloatType>("viewpoint_motion_max_dist_square", &viewpoint_motion_max_dist_square);
       addOption<size_t>("viewpoint_motion_densification_max_depth", &viewpoint_motion_densification_max_depth);
       addOption<FloatType>("viewpoint_motion_penalty_per_graph_vertex", &viewpoint_motion_penalty_per_graph_vertex);
+      addOption<bool>("viewpoint_motion_lazy", &viewpoint_motion_lazy);
       addOption<size_t>("viewpoint_path_branches", &viewpoint_path_branches);
       addOption<FloatType>("viewpoint_path_initial_distance", &viewpoint_path_initial_distance);
       addOption<bool>("viewpoint_path_compute_connections_incremental", &viewpoint_path_compute_connections_incremental);
@@ -166,6 +172,9 @@ public:
       addOption<size_t>("viewpoint_path_2opt_max_k_length", &viewpoint_path_2opt_max_k_length);
       addOption<bool>("viewpoint_path_2opt_check_sparse_matching", &viewpoint_path_2opt_check_sparse_matching);
       addOption<std::string>("viewpoint_graph_filename", &viewpoint_graph_filename);
+      addOption<size_t>("journal_sync_batch_size", &journal_sync_batch_size);
+      addOption<FloatType>("journal_sync_interval", &journal_sync_interval);
+      addOption<size_t>("journal_compaction_size", &journal_compaction_size);
       // TODO:
       addOption<size_t>("num_sampled_poses", &num_sampled_poses);
       addOption<size_t>("num_planned_viewpoints", &num_planned_viewpoints);
@@ -249,6 +258,14 @@ public:
     FloatType viewpoint_max_too_close_voxel_ratio = FloatType(0.5);
     // Minimum information for viewpoints
     FloatType viewpoint_min_information = 10;
+    // Raycast a sparse pixel lattice first and reject candidates that are unlikely to reach the minimum voxel count
+    // or information or that are too close to too many voxels before raycasting at full resolution.
+    // The rejection is based on an extrapolation and can reject candidates that the full raycast would accept.
+    bool viewpoint_coarse_evaluation = false;
+    // Pixel stride of the lattice for coarse evaluation
+    size_t viewpoint_coarse_evaluation_stride = 4;
+    // Safety factor (>= 1) for the extrapolated voxel count, information and too close voxel ratio
+    FloatType viewpoint_coarse_evaluation_margin = 2;
     // Number of neighbours to check for reachability and matchability when generating new viewpoint entry
     size_t viewpoint_sample_motion_and_matching_knn = 20;
 
@@ -299,6 +316,9 @@ public:
     size_t viewpoint_motion_densification_max_depth = 5;
     // Motion penalty for each viewpoint graph vertex on a motion path
     FloatType viewpoint_motion_penalty_per_graph_vertex = 0;
+    // Lazy viewpoint graph: Motions are inserted as candidates with optimistic straight line costs and only
+    // validated (sparse matching and motion planning) when a shortest motion search uses them
+    bool viewpoint_motion_lazy = false;
 
     // Number of viewpoint path branches to explore in parallel
     size_t viewpoint_path_branches = 10;
@@ -373,6 +393,13 @@ public:
     // Filename of serialized viewpoint graph
     std::string viewpoint_graph_filename = "";
 
+    // Number of journal records that are written and synced to disk together
+    size_t journal_sync_batch_size = 64;
+    // Maximum time in seconds that a journal record stays unsynced
+    FloatType journal_sync_interval = 10;
+    // Journal size in bytes after which it is folded into the viewpoint graph file
+    size_t journal_compaction_size = 256 * 1024 * 1024;
+
     // TODO: Needed?
     size_t num_sampled_poses = 100;
     size_t num_planned_viewpoints = 10;
@@ -756,12 +783,14 @@ public:
   };
 
   using ViewpointGraph = bh::Graph<ViewpointEntryIndex, FloatType>;
-  using ViewpointANN = bh::ApproximateNearestNeighbor<FloatType, 3>;
+  // Exact nearest neighbor index. Viewpoints are inserted one by one so an index without rebuilds is used.
+  using ViewpointANN = bh::HashGridNearestNeighbor<FloatType>;
   using FeatureViewpointMap = std::unordered_map<size_t, std::vector<const Viewpoint*>>;
 
 
+  /// The planner data is only read by the planner so it can be shared by multiple planners.
   ViewpointPlanner(const Options* options,
-      const MotionPlannerType::Options* motion_options, std::unique_ptr<ViewpointPlannerData> data);
+      const MotionPlannerType::Options* motion_options, std::shared_ptr<ViewpointPlannerData> data);
 
   const Options& getOptions() const;
 
@@ -812,6 +841,8 @@ public:
 
   void setViewpointPathTimeConstraint(const FloatType time_constraint);
 
+  /// Writes the viewpoint graph to a temporary file that replaces the file once it is complete.
+  /// The old file is kept if writing fails.
   void saveViewpointGraph(const std::string& filename) const;
 
   void loadViewpointGraph(const std::string& filename);
@@ -820,6 +851,26 @@ public:
 
   void loadViewpointPath(const std::string& filename);
 
+  /// Opens a journal that records all further mutations of the viewpoint graph and paths.
+  /// The viewpoint graph has to be loaded before. A journal that was written on top of the loaded
+  /// viewpoint graph is replayed first so that planning resumes where it stopped.
+  void openJournal(const std::string& filename);
+
+  /// Writes all buffered journal records to disk and closes the journal.
+  void closeJournal();
+
+  bool hasJournal() const;
+
+  /// Folds the journal into the viewpoint graph file and starts a new journal on top of it.
+  /// If this fails the old journal stays open and the exception is rethrown.
+  void compactJournal(const std::string& viewpoint_graph_filename);
+
+  /// Compacts the journal if it is larger than journal_compaction_size. Returns true if it was compacted.
+  bool compactJournalIfNeeded(const std::string& viewpoint_graph_filename);
+
+  /// Records the viewpoint path entries that changed since the last call in the journal.
+  void journalViewpointPaths();
+
   rapidjson::Document getViewpointPathAsJson(const ViewpointPath& viewpoint_path) const;
 
   std::string getViewpointPathAsJsonString(const ViewpointPath& viewpoint_path) const;
@@ -1130,16 +1181,28 @@ public:
   std::tuple<bool, ViewpointPlanner::Pose, size_t>
   sampleSurroundingPose(IteratorT first, IteratorT last) const;
 
-  template <typename IteratorT>
-  IteratorT sampleViewpointByGridCounts(IteratorT first, IteratorT last) const;
+  /// Samples a non-real viewpoint. The probability decreases with the viewpoint count of the viewpoint's grid cell.
+  /// Returns (ViewpointEntryIndex)-1 if there is no viewpoint to sample.
+  ViewpointEntryIndex sampleViewpointIndexByGridCounts(bh::RandomStream<FloatType>& random) const;
+
+  /// Adds a viewpoint to the sampling distribution and updates the weight of its grid cell.
+  void updateViewpointSamplingDistribution(const ViewpointEntryIndex viewpoint_index);
+
+  /// Recomputes the sampling distribution from all viewpoints (i.e. after loading a viewpoint graph).
+  void rebuildViewpointSamplingDistribution();
+
+  FloatType computeViewpointSamplingCellWeight(const size_t cell_slot) const;
 
-  void updateViewpointSamplingDistribution();
+  /// Probability to accept a sampled viewpoint position based on the viewpoint count of its grid cell.
+  FloatType computeGridCellSamplingProbability(const Vector3& position) const;
 
 //  template <typename IteratorT>
 //  std::pair<bool, Pose> sampleSurroundingPoseFromEntries(IteratorT first, IteratorT last) const;
 
   std::pair<bool, Pose> sampleSurroundingPose(const Pose& pose) const;
 
+  std::pair<bool, Pose> sampleSurroundingPose(const Pose& pose, bh::RandomStream<FloatType>& random) const;
+
   std::pair<bool, Pose> samplePose(const size_t max_trials = (size_t)-1,
        const bool biased_orientation = true) const;
 
@@ -1151,6 +1214,12 @@ public:
       const BoundingBoxType& object_bbox, size_t max_trials = (size_t)-1,
       const bool biased_orientation = true) const;
 
+  /// Samples a pose from a random stream instead of the shared random number generator.
+  /// Can be called concurrently with different streams.
+  std::pair<bool, Pose> samplePose(bh::RandomStream<FloatType>& random, const BoundingBoxType& bbox,
+      const BoundingBoxType& object_bbox, size_t max_trials = (size_t)-1,
+      const bool biased_orientation = true) const;
+
   std::pair<bool, ViewpointPlanner::Vector3> samplePosition(const size_t max_trials = (size_t)-1) const;
 
   std::pair<bool, ViewpointPlanner::Vector3> samplePosition(const BoundingBoxType& bbox,
@@ -1169,6 +1238,29 @@ public:
   /// seen from pos.
   Pose::Quaternion sampleBiasedOrientation(const Vector3& pos, const BoundingBoxType& bias_bbox) const;
 
+  Pose::Quaternion sampleBiasedOrientation(const Vector3& pos, const BoundingBoxType& bias_bbox,
+      bh::RandomStream<FloatType>& random) const;
+
+  // Sampling functions parameterized by the random number generator (either random_ or a bh::RandomStream)
+
+  template <typename RandomT>
+  std::pair<bool, Pose> samplePoseWithRandom(RandomT& random, const BoundingBoxType& bbox,
+      const BoundingBoxType& object_bbox, const size_t max_trials, const bool biased_orientation) const;
+
+  template <typename RandomT>
+  std::pair<bool, ViewpointPlanner::Vector3> samplePositionWithRandom(RandomT& random, const BoundingBoxType& bbox,
+      const BoundingBoxType& object_bbox, const size_t max_trials) const;
+
+  template <typename RandomT>
+  Pose::Quaternion sampleOrientationWithRandom(RandomT& random) const;
+
+  template <typename RandomT>
+  Pose::Quaternion sampleBiasedOrientationWithRandom(
+      RandomT& random, const Vector3& pos, const BoundingBoxType& bias_bbox) const;
+
+  template <typename RandomT>
+  std::pair<bool, Pose> sampleSurroundingPoseWithRandom(RandomT& random, const Pose& pose) const;
+
   /// Check if an object can be placed at a position (i.e. is it free space)
   bool isValidObjectPosition(
           const Vector3& position, const BoundingBoxType& object_bbox, const bool ignore_no_fly_zones = false) const;
@@ -1177,6 +1269,10 @@ public:
   /// Returns whether a matching viewpoint was found and the corresponding index
   std::pair<bool, ViewpointEntryIndex> findViewpointEntryWithPose(const Pose& pose) const;
 
+  /// Random stream for the next viewpoint candidate. Candidate i draws from the stream (rng seed, i) so that the
+  /// samples do not depend on other users of the shared random number generator.
+  bh::RandomStream<FloatType> getNextCandidateRandomStream();
+
   /// Generate a new viewpoint entry and add it to the graph.
   bool generateNextViewpointEntry();
 
@@ -1194,7 +1290,14 @@ public:
   /// Generate a new viewpoint entry and add it to the graph.
   bool generateNextViewpointEntry2();
   bool tryToAddViewpointEntry(const Pose& pose, const bool no_raycast = false);
-  bool tryToAddViewpointEntries(const Vector3& position, const bool no_raycast = false);
+
+  /// Raycast a sparse pixel lattice and return true if the viewpoint can be rejected because the
+  /// extrapolated voxel count or information stays below the minimum or too many voxels are too close.
+  bool isHopelessViewpointCandidate(const Viewpoint& viewpoint);
+
+  void printCandidateEvaluationStatistics() const;
+  bool tryToAddViewpointEntries(const Vector3& position, bh::RandomStream<FloatType>& random,
+      const bool no_raycast = false);
 
   FloatType computeExplorationStep(const Vector3& position) const;
 
@@ -1660,6 +1763,31 @@ private:
   /// Find shortest motion between two viewpoints using A-Star on the viewpoint graph.
   ViewpointMotion findShortestMotionAStar(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index) const;
 
+  /// Find shortest motion between two viewpoints on the lazy viewpoint graph.
+  /// Candidate motions on the shortest path are validated until the path consists only of validated motions.
+  ViewpointMotion findShortestMotionLazyAStar(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index);
+
+  /// Find the viewpoint sequence of the shortest path between two viewpoints using A-Star.
+  /// If use_lazy_motions is true candidate motions are included with their straight line distance as cost.
+  /// Returns an empty vector if no path exists.
+  std::vector<ViewpointEntryIndex> findShortestViewpointSequenceAStar(
+          const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index, const bool use_lazy_motions) const;
+
+  /// Concatenate the motions along a sequence of viewpoints.
+  ViewpointMotion concatenateViewpointMotions(const std::vector<ViewpointEntryIndex>& viewpoint_indices) const;
+
+  /// Adds candidate motions from a viewpoint to its neighbors to the lazy viewpoint graph. Returns the number of new candidates.
+  size_t addLazyViewpointMotions(const ViewpointEntryIndex from_index);
+
+  /// Removes a candidate motion from the lazy viewpoint graph. Returns false if there was no such candidate.
+  bool removeLazyViewpointMotion(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index);
+
+  /// Validates a candidate motion. A valid motion is added to the viewpoint graph, an invalid one is memoized.
+  bool validateLazyViewpointMotion(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index);
+
+  /// Connected components of the viewpoint graph including the candidate motions of the lazy viewpoint graph.
+  std::size_t computeLazyConnectedComponents(std::vector<std::size_t>* component) const;
+
   /// Optimize viewpoint motion by reducing redundant in-between viewpoints
   ViewpointMotion optimizeViewpointMotion(const ViewpointMotion& motion) const;
 
@@ -1681,6 +1809,71 @@ private:
   /// Create a subgraph with the nodes from a viewpoint path
   ViewpointPathGraphWrapper createViewpointPathGraph(const ViewpointPath& viewpoint_path, const ViewpointPathComputationData& comp_data);
 
+  // Journal of planner mutations
+
+  enum JournalRecordType : uint32_t {
+    JOURNAL_BASE = 1,
+    JOURNAL_ADD_VIEWPOINT_ENTRY,
+    JOURNAL_ADD_VIEWPOINT_MOTION,
+    JOURNAL_REMOVE_VIEWPOINT_MOTION,
+    JOURNAL_RESET_VIEWPOINT_MOTIONS,
+    JOURNAL_EXPLORATION_FRONT_PUSH,
+    JOURNAL_EXPLORATION_FRONT_TAKE,
+    JOURNAL_STEREO_VIEWPOINT_PAIR,
+    JOURNAL_VIEWPOINT_PATHS,
+    JOURNAL_RESET_VIEWPOINT_PATH,
+    JOURNAL_ADD_VIEWPOINT_PATH_ENTRY,
+  };
+
+  // Viewpoint graph file, BVH tree and graph size that a journal was started on
+  struct JournalBase {
+    uint32_t viewpoint_graph_checksum;
+    // Journaled viewpoint entries refer to voxels by their BVH node index
+    uint32_t bvh_layout_checksum;
+    size_t num_real_viewpoints;
+    size_t num_viewpoint_entries;
+    size_t num_viewpoint_motions;
+    size_t exploration_front_size;
+
+    bool operator==(const JournalBase& other) const;
+  };
+
+  static constexpr uint32_t kJournalVersion = 3;
+
+  JournalBase getJournalBase() const;
+
+  /// Reads a journal file. Returns false if the file is empty or missing.
+  static bool readJournal(const std::string& filename, JournalBase* base,
+                          std::vector<bh::AppendOnlyJournal::Record>* records, size_t* valid_size);
+
+  /// Writes the viewpoint graph file and throws if the stream fails (i.e. the disk is full).
+  void writeViewpointGraphFile(const std::string& filename) const;
+
+  /// Starts a new journal file on top of the current viewpoint graph (including the current viewpoint paths).
+  void startJournalWithoutLock(const std::string& filename);
+
+  void replayJournalWithoutLock(const std::vector<bh::AppendOnlyJournal::Record>& records);
+
+  void journalViewpointEntry(const ViewpointEntry& viewpoint_entry, const bool ignore_viewpoint_count_grid);
+
+  void journalViewpointMotion(const ViewpointMotion& motion);
+
+  void journalViewpointMotionRemoval(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index);
+
+  void journalViewpointMotionsReset();
+
+  void journalExplorationFrontPush(const ViewpointEntryIndex viewpoint_index);
+
+  void journalExplorationFrontTake(const size_t front_position);
+
+  void journalStereoViewpointPair(const ViewpointEntryIndex viewpoint_index,
+                                  const ViewpointEntryIndex stereo_viewpoint_index);
+
+  void journalViewpointPathsReset();
+
+  void journalViewpointPathsWithoutLock();
+
+  std::uint64_t random_seed_;
   mutable bh::Random<FloatType, std::int64_t> random_;
 
   Options options_;
@@ -1697,7 +1890,7 @@ private:
   FloatType voxel_sensor_size_ratio_falloff_factor_;
   FloatType sparse_matching_max_angular_distance_;
 
-  std::unique_ptr<ViewpointPlannerData> data_;
+  std::shared_ptr<ViewpointPlannerData> data_;
   PinholeCamera virtual_camera_;
   viewpoint_planner::ViewpointRaycast raycaster_;
   viewpoint_planner::ViewpointScore scorer_;
@@ -1712,6 +1905,15 @@ private:
 
   // Counter of failed viewpoint entry samples. Reset to 0 after each successfull sample.
   size_t num_of_failed_viewpoint_entry_samples_;
+  // Stream id of the next viewpoint candidate. Not reset with the graph so that a reset does not repeat candidates.
+  std::uint64_t next_candidate_stream_id_;
+  // Statistics of viewpoint candidate evaluation
+  size_t num_of_evaluated_candidates_;
+  size_t num_of_coarse_rejected_candidates_;
+  size_t num_of_accepted_candidates_;
+  size_t num_of_coarse_rays_;
+  size_t num_of_full_rays_;
+  size_t num_of_saved_full_rays_;
   // All tentative viewpoints
   ViewpointEntryVector viewpoint_entries_;
   // Matching stereo viewpoint index for each viewpoint (or -1 if not matching stereo viewpoint)
@@ -1735,18 +1937,30 @@ private:
   ViewpointGraph viewpoint_graph_;
   // Grid of viewpoint counts in the sampling space
   ContinuousGridType viewpoint_count_grid_;
-  // Probability for sampling a new viewpoint in a grid cell
-  std::vector<FloatType> grid_cell_probabilities_;
-  // Discrete distribution to sample from viewpoints
-  mutable std::discrete_distribution<size_t> viewpoint_sampling_distribution_;
-  // Size of viewpoint graph when distribution was last updated
-  size_t viewpoint_sampling_distribution_update_size_;
+  // Grid cell with the viewpoints that can be sampled from it
+  struct ViewpointSamplingCell {
+    size_t grid_index;
+    std::vector<ViewpointEntryIndex> viewpoint_indices;
+  };
+  // Grid cells containing viewpoints for sampling. A viewpoint is sampled by
+  // sampling a cell and then sampling uniformly from the viewpoints in the cell.
+  std::vector<ViewpointSamplingCell> viewpoint_sampling_cells_;
+  // Mapping from grid index to the index of the sampling cell
+  std::unordered_map<size_t, size_t> viewpoint_sampling_cell_slots_;
+  // Discrete distribution over the sampling cells
+  bh::DynamicDiscreteDistribution<FloatType> viewpoint_sampling_distribution_;
+  // Maximum viewpoint count of the sampling cells (used for normalization)
+  FloatType viewpoint_sampling_max_grid_count_;
   // Connected components of viewpoint graph
   mutable std::pair<std::vector<size_t>, size_t> viewpoint_graph_components_;
   // Flag indicating whether connected components are valid
   mutable bool viewpoint_graph_components_valid_;
   // Motion description of the connections in the viewpoint graph (indexed by viewpoint id pair)
   std::unordered_map<ViewpointIndexPair, ViewpointMotion, ViewpointIndexPair::Hash> viewpoint_graph_motions_;
+  // Candidate motions of the lazy viewpoint graph that have not been validated yet (adjacency lists by viewpoint index)
+  std::vector<std::vector<ViewpointEntryIndex>> lazy_viewpoint_motions_;
+  // Candidate motions that failed validation (memoized so that they are not added or validated again)
+  std::unordered_set<ViewpointIndexPair, ViewpointIndexPair::Hash> invalid_viewpoint_motions_;
   /// Flag indicating whether viewpoint paths have been initialized
   bool viewpoint_paths_initialized_;
   // Current viewpoint paths
@@ -1758,6 +1972,13 @@ private:
 
   // Maximum time constraint for viewpoint paths
   FloatType viewpoint_path_time_constraint_;
+
+  // Journal of planner mutations (only open when checkpointing is enabled)
+  std::unique_ptr<bh::AppendOnlyJournal> journal_;
+  // CRC-32 of the viewpoint graph file that was loaded or last compacted into (0 if there is none)
+  uint32_t viewpoint_graph_checksum_;
+  // Viewpoint indices of the path entries that have been recorded in the journal (for each path)
+  std::vector<std::vector<ViewpointEntryIndex>> journaled_viewpoint_paths_;
 };
 
 BOOST_CLASS_VERSION(ViewpointPlanner::ViewpointPathEntry, 2)
@@ -20,13 +20,6 @@ ViewpointPlanner::sampleSurroundingPose(IteratorT first, IteratorT last) const {
   return std::make_tuple(found_pose, sampled_pose, index);
 }
 
-template <typename IteratorT>
-IteratorT ViewpointPlanner::sampleViewpointByGridCounts(IteratorT first, IteratorT last) const {
-  BH_ASSERT_STR(last - first > 0, "Unable to sample surrounding pose from empty pose set");
-  size_t index = viewpoint_sampling_distribution_(random_.rng());
-  return first + index;
-}
-
 template <typename Iterator>
 std::pair<bool, ViewpointPlanner::ViewpointEntryIndex> ViewpointPlanner::canVoxelBeTriangulated(
     const ViewpointPath& viewpoint_path, const ViewpointPathComputationData& comp_data,
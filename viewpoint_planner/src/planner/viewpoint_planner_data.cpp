@@ -5,6 +5,12 @@
  *      Author: bhepp
  */
 
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <stack>
+#include <unordered_map>
+#include <omp.h>
 #include <boost/filesystem.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
@@ -499,58 +505,119 @@ void ViewpointPlannerData::updateWeightsWithRealViewpoints() {
   if (!options_.ignore_real_observed_voxels && options_.invalid_pixel_observation_factor > 0) {
     std::cout << "Computing observed voxels for " << reconstruction_->getImages().size()
               << " previous camera viewpoints" << std::endl;
-    std::unique_ptr<viewpoint_planner::ViewpointOffscreenRenderer> offscreen_renderer;
+    bh::Timer timer;
+    std::vector<const reconstruction::ImageColmap*> images;
+    // Depth maps are only used once so they are read ahead in iteration order
+    std::vector<reconstruction::ImageId> image_ids;
     for (const auto& entry : reconstruction_->getImages()) {
-      const reconstruction::PinholeCamera &real_camera = reconstruction_->getCameras().at(entry.second.camera_id());
-      const reconstruction::DenseReconstruction::DepthMap& depth_map = reconstruction_->readDepthMap(
-              entry.second.id(), reconstruction::DenseReconstruction::DenseMapType::GEOMETRIC_FUSED);
-      const FloatType depth_camera_scale_factor = depth_map.width() / FloatType(real_camera.width());
-      const reconstruction::PinholeCamera depth_camera = real_camera.getScaledCamera(depth_camera_scale_factor);
-      if (!offscreen_renderer) {
-        viewpoint_planner::ViewpointOffscreenRenderer::Options offscreen_renderer_options;
-//        offscreen_renderer_options.dump_poisson_mesh_depth_image = true;
-//        offscreen_renderer_options.dump_poisson_mesh_normals_image = true;
-        offscreen_renderer.reset(new viewpoint_planner::ViewpointOffscreenRenderer(
-                offscreen_renderer_options, depth_camera, poisson_mesh_.get()));
-      }
-      else {
-        offscreen_renderer->setCamera(depth_camera);
-      }
-      const reconstruction::Pose& pose = entry.second.pose();
-      const Viewpoint viewpoint(&depth_camera, pose);
-      // Compute observed voxels and information
-      const bool remove_duplicates = false;
-      const FloatType min_range = options_.real_observed_voxels_raycast_min_range;
-      const FloatType max_range = options_.real_observed_voxels_raycast_max_range > 0 ?
-                                  options_.real_observed_voxels_raycast_max_range :
-                                  std::numeric_limits<FloatType>::max();
-      viewpoint_planner::ViewpointRaycast raycaster(&occupied_bvh_, min_range, max_range);
-      viewpoint_planner::ViewpointScore scorer(
-              options_.getOptionsAs<viewpoint_planner::ViewpointScore::Options>(),
-              [&](const Viewpoint& viewpoint,
-                  const viewpoint_planner::VoxelType* node,
-                  const viewpoint_planner::Vector2& image_coordinates) -> Vector3 {
-                Vector3 normal_vector;
-                if (options_.enable_opengl) {
-                  const std::size_t x = static_cast<std::size_t>(image_coordinates(0));
-                  const std::size_t y = static_cast<std::size_t>(image_coordinates(1));
-                  normal_vector = offscreen_renderer->computePoissonMeshNormalVector(viewpoint, x, y);
-                }
-                else {
-                  normal_vector = node->getObject()->normal;
-                }
-                return normal_vector;
-              });
+      images.push_back(&entry.second);
+      image_ids.push_back(entry.first);
+    }
+    reconstruction_->setAccessHint(image_ids, reconstruction::DenseReconstruction::DenseMapType::GEOMETRIC_FUSED);
+
+    // The images are raycast in parallel in batches. Only the hits of invalid depth pixels are kept.
+    // The decrement of a voxel weight depends on its current weight so the weights are updated serially
+    // in image order after each batch. This is also the only place where the normals are rendered
+    // so that a single OpenGL context is used on the calling thread.
+    struct InvalidPixelHits {
+      reconstruction::PinholeCamera depth_camera;
+      std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates> hits;
+
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    const std::size_t num_threads = static_cast<std::size_t>(omp_get_max_threads());
+    const std::size_t batch_size = 4 * num_threads;
+    std::vector<InvalidPixelHits, Eigen::aligned_allocator<InvalidPixelHits>> batch_hits(batch_size);
+
+    std::unique_ptr<viewpoint_planner::ViewpointOffscreenRenderer> offscreen_renderer;
+    viewpoint_planner::ViewpointScore scorer(
+            options_.getOptionsAs<viewpoint_planner::ViewpointScore::Options>(),
+            [&](const Viewpoint& viewpoint,
+                const viewpoint_planner::VoxelType* node,
+                const viewpoint_planner::Vector2& image_coordinates) -> Vector3 {
+              Vector3 normal_vector;
+              if (options_.enable_opengl) {
+                const std::size_t x = static_cast<std::size_t>(image_coordinates(0));
+                const std::size_t y = static_cast<std::size_t>(image_coordinates(1));
+                normal_vector = offscreen_renderer->computePoissonMeshNormalVector(viewpoint, x, y);
+              }
+              else {
+                normal_vector = node->getObject()->normal;
+              }
+              return normal_vector;
+            });
+    // Octree leaves on the boundary of neighboring voxels are covered by both voxels so the leaves
+    // are written at the end in the order of the last update of each voxel.
+    std::unordered_map<viewpoint_planner::VoxelType*, std::size_t> last_voxel_updates;
+    std::size_t num_voxel_updates = 0;
+
+    std::exception_ptr exception_ptr;
+    std::mutex exception_mutex;
+    for (std::size_t batch_start = 0; batch_start < images.size(); batch_start += batch_size) {
+      const std::size_t batch_end = std::min(batch_start + batch_size, images.size());
+#pragma omp parallel num_threads(num_threads)
+      {
+        const FloatType min_range = options_.real_observed_voxels_raycast_min_range;
+        const FloatType max_range = options_.real_observed_voxels_raycast_max_range > 0 ?
+                                    options_.real_observed_voxels_raycast_max_range :
+                                    std::numeric_limits<FloatType>::max();
+        viewpoint_planner::ViewpointRaycast raycaster(&occupied_bvh_, min_range, max_range);
 #if WITH_CUDA
-      raycaster.setEnableCuda(options_.enable_cuda);
+        raycaster.setEnableCuda(options_.enable_cuda);
 #endif
-      // TODO: Add minimum range to raycast query. Otherwise unknown voxels are captured instead of the interesting ones.
-      std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates> raycast_results =
-              raycaster.getRaycastHitVoxelsWithScreenCoordinates(viewpoint, remove_duplicates);
-      for (size_t i = 0; i < raycast_results.size(); ++i) {
-        OccupiedTreeType::IntersectionResultWithScreenCoordinates& ir = raycast_results[i];
-        const FloatType depth = depth_map(ir.screen_coordinates(1), ir.screen_coordinates(0));
-        if (depth <= 0 || std::isinf(depth)) {
+#pragma omp for schedule(dynamic)
+        for (std::size_t image_index = batch_start; image_index < batch_end; ++image_index) {
+          try {
+            const reconstruction::ImageColmap& image = *images[image_index];
+            const reconstruction::PinholeCamera &real_camera = reconstruction_->getCameras().at(image.camera_id());
+            const reconstruction::DenseReconstruction::DepthMapPtr depth_map_ptr = reconstruction_->getDepthMap(
+                    image.id(), reconstruction::DenseReconstruction::DenseMapType::GEOMETRIC_FUSED);
+            const reconstruction::DenseReconstruction::DepthMap& depth_map = *depth_map_ptr;
+            const FloatType depth_camera_scale_factor = depth_map.width() / FloatType(real_camera.width());
+            InvalidPixelHits& image_hits = batch_hits[image_index - batch_start];
+            image_hits.depth_camera = real_camera.getScaledCamera(depth_camera_scale_factor);
+            image_hits.hits.clear();
+            const Viewpoint viewpoint(&image_hits.depth_camera, image.pose());
+            // Compute observed voxels
+            const bool remove_duplicates = false;
+            // TODO: Add minimum range to raycast query. Otherwise unknown voxels are captured instead of the interesting ones.
+            const std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates> raycast_results =
+                    raycaster.getRaycastHitVoxelsWithScreenCoordinates(viewpoint, remove_duplicates);
+            for (const OccupiedTreeType::IntersectionResultWithScreenCoordinates& ir : raycast_results) {
+              const FloatType depth = depth_map(ir.screen_coordinates(1), ir.screen_coordinates(0));
+              if (depth <= 0 || std::isinf(depth)) {
+                image_hits.hits.push_back(ir);
+              }
+            }
+          }
+          catch (...) {
+            std::lock_guard<std::mutex> lock(exception_mutex);
+            if (!exception_ptr) {
+              exception_ptr = std::current_exception();
+            }
+          }
+        }
+      }
+      if (exception_ptr) {
+        break;
+      }
+
+      for (std::size_t image_index = batch_start; image_index < batch_end; ++image_index) {
+        InvalidPixelHits& image_hits = batch_hits[image_index - batch_start];
+        if (options_.enable_opengl) {
+          if (!offscreen_renderer) {
+            viewpoint_planner::ViewpointOffscreenRenderer::Options offscreen_renderer_options;
+//            offscreen_renderer_options.dump_poisson_mesh_depth_image = true;
+//            offscreen_renderer_options.dump_poisson_mesh_normals_image = true;
+            offscreen_renderer.reset(new viewpoint_planner::ViewpointOffscreenRenderer(
+                    offscreen_renderer_options, image_hits.depth_camera, poisson_mesh_.get()));
+          }
+          else {
+            offscreen_renderer->setCamera(image_hits.depth_camera);
+          }
+        }
+        const Viewpoint viewpoint(&image_hits.depth_camera, images[image_index]->pose());
+        for (const OccupiedTreeType::IntersectionResultWithScreenCoordinates& ir : image_hits.hits) {
           const WeightType information = scorer.computeViewpointObservationScore(
                   viewpoint, ir.intersection_result.node, ir.screen_coordinates);
           viewpoint_planner::VoxelType* voxel = ir.intersection_result.node;
@@ -558,15 +625,36 @@ void ViewpointPlannerData::updateWeightsWithRealViewpoints() {
                   0, voxel->getObject()->weight - options_.invalid_pixel_observation_factor * information);
           voxel->getObject()->weight = new_weight;
           BH_ASSERT(voxel->getObject()->weight >= 0);
-          const BoundingBoxType& bbox = voxel->getBoundingBox();
-          const octomap::point3d oct_min(bbox.getMinimum(0), bbox.getMinimum(1), bbox.getMinimum(2));
-          const octomap::point3d oct_max(bbox.getMaximum(0), bbox.getMaximum(1), bbox.getMaximum(2));
-          for (auto it = octree_->begin_leafs_bbx(oct_min, oct_max); it != octree_->end_leafs_bbx(); ++it) {
-            it->setWeight(new_weight);
-          }
+          last_voxel_updates[voxel] = num_voxel_updates;
+          ++num_voxel_updates;
         }
+        std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates>().swap(image_hits.hits);
       }
     }
+    reconstruction_->setAccessHint(std::vector<reconstruction::ImageId>());
+    reconstruction_->clearCachedDepthMaps();
+    if (exception_ptr) {
+      std::rethrow_exception(exception_ptr);
+    }
+    timer.printTimingMs("Computing invalid pixel observations");
+
+    std::vector<std::pair<std::size_t, viewpoint_planner::VoxelType*>> updated_voxels;
+    updated_voxels.reserve(last_voxel_updates.size());
+    for (const auto& entry : last_voxel_updates) {
+      updated_voxels.emplace_back(entry.second, entry.first);
+    }
+    std::sort(updated_voxels.begin(), updated_voxels.end());
+    for (const auto& entry : updated_voxels) {
+      const viewpoint_planner::VoxelType* voxel = entry.second;
+      const WeightType new_weight = voxel->getObject()->weight;
+      const BoundingBoxType& bbox = voxel->getBoundingBox();
+      const octomap::point3d oct_min(bbox.getMinimum(0), bbox.getMinimum(1), bbox.getMinimum(2));
+      const octomap::point3d oct_max(bbox.getMaximum(0), bbox.getMaximum(1), bbox.getMaximum(2));
+      for (auto it = octree_->begin_leafs_bbx(oct_min, oct_max); it != octree_->end_leafs_bbx(); ++it) {
+        it->setWeight(new_weight);
+      }
+    }
+    timer.printTimingMs("Updating octree weights with real viewpoints");
   }
 }
 
@@ -781,13 +869,41 @@ bool ViewpointPlannerData::isTreeConsistent(const TreeT& tree) {
   return consistent;
 }
 
+namespace {
+
+/// Call func(nav) for all leaves of the subtree of nav
+template <typename TreeNavigatorT, typename Func>
+void forEachLeafOfSubtree(const TreeNavigatorT& subtree_nav, Func func) {
+  std::stack<TreeNavigatorT> node_stack;
+  node_stack.push(subtree_nav);
+  while (!node_stack.empty()) {
+    const TreeNavigatorT nav = node_stack.top();
+    node_stack.pop();
+    if (nav.hasChildren()) {
+      for (size_t i = 0; i < 8; ++i) {
+        if (nav.hasChild(i)) {
+          node_stack.push(nav.child(i));
+        }
+      }
+    }
+    else {
+      func(nav);
+    }
+  }
+}
+
+}
+
 void ViewpointPlannerData::generateBVHTree(const OccupancyMapType* octree) {
+  using ObjectWithBoundingBox = typename OccupiedTreeType::ObjectWithBoundingBox;
+  using ConstTreeNavigatorType = typename OccupancyMapType::ConstTreeNavigatorType;
+
   // Initialize nearest neighbor index for mesh faces
   using MeshAnn = bh::ApproximateNearestNeighbor<FloatType, 3>;
   MeshAnn mesh_ann;
   std::vector<Vector3> triangle_centers;
   triangle_centers.resize(poisson_mesh_->m_FaceIndicesVertices.size());
-//#pragma omp parallel for
+#pragma omp parallel for
   for (size_t i = 0; i < poisson_mesh_->m_FaceIndicesVertices.size(); ++i) {
     const MeshType::Indices::Face& face = poisson_mesh_->m_FaceIndicesVertices[i];
     BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
@@ -803,109 +919,137 @@ void ViewpointPlannerData::generateBVHTree(const OccupancyMapType* octree) {
   const std::size_t mesh_knn = options_.bvh_normal_mesh_knn;
   const FloatType max_dist_square = options_.bvh_normal_mesh_max_dist * options_.bvh_normal_mesh_max_dist;
 
-  std::vector<std::vector<typename OccupiedTreeType::ObjectWithBoundingBox>> objects_vector;
-//#pragma omp parallel
-  {
-    const std::size_t thread_index = (std::size_t)omp_get_thread_num();
-    const std::size_t num_threads = (std::size_t)omp_get_num_threads();
-//#pragma omp single
-    {
-      objects_vector.resize(num_threads);
+  // Bounding box of a leaf in the BVH. Returns false if the leaf is not part of the BVH.
+  auto compute_leaf_bbox = [&](const ConstTreeNavigatorType& nav, BoundingBoxType* bbox) -> bool {
+    if (octree->isNodeFree(nav.getNode()) && octree->isNodeKnown(nav.getNode())) {
+      return false;
     }
+    *bbox = BoundingBoxType(nav.getPosition(), nav.getSize());
+    bbox->constrainTo(bvh_bbox_);
+    if (bbox->isEmpty()) {
+      return false;
+    }
+    if (bbox->getMaximum(2) >= options_.obstacle_free_height) {
+      Vector3 min = bbox->getMinimum();
+      min(2) = std::min(options_.obstacle_free_height, min(2));
+      Vector3 max = bbox->getMaximum();
+      max(2) = options_.obstacle_free_height;
+      *bbox = BoundingBoxType(min, max);
+    }
+    return !bbox->isEmpty();
+  };
+
+  // Partition the octree into the subtrees at a fixed depth. Each subtree covers a contiguous range of keys.
+  const size_t partition_depth = std::min<size_t>(5, octree->getTreeDepth());
+  std::vector<ConstTreeNavigatorType> subtree_navs;
+  std::stack<ConstTreeNavigatorType> node_stack;
+  node_stack.push(ConstTreeNavigatorType::getRootNavigator(octree));
+  while (!node_stack.empty()) {
+    const ConstTreeNavigatorType nav = node_stack.top();
+    node_stack.pop();
+    if (nav.getDepth() < partition_depth && nav.hasChildren()) {
+      for (size_t i = 8; i > 0; --i) {
+        if (nav.hasChild(i - 1)) {
+          node_stack.push(nav.child(i - 1));
+        }
+      }
+    }
+    else {
+      subtree_navs.push_back(nav);
+    }
+  }
+  std::cout << "Partitioned octree into " << subtree_navs.size() << " subtrees" << std::endl;
+
+  // Count the BVH leaves of each subtree so that the objects can be written to their final position in parallel
+  std::vector<size_t> subtree_offsets(subtree_navs.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < subtree_navs.size(); ++i) {
+    size_t count = 0;
+    BoundingBoxType bbox;
+    forEachLeafOfSubtree(subtree_navs[i], [&](const ConstTreeNavigatorType& nav) {
+      if (compute_leaf_bbox(nav, &bbox)) {
+        ++count;
+      }
+    });
+    subtree_offsets[i + 1] = count;
+  }
+  std::partial_sum(subtree_offsets.begin(), subtree_offsets.end(), subtree_offsets.begin());
+  const size_t num_objects = subtree_offsets.back();
+
+  std::vector<ObjectWithBoundingBox> objects(num_objects);
+  std::vector<NodeObjectType> object_storage(num_objects);
+  const size_t normal_batch_size = 1024;
+#pragma omp parallel
+  {
+    // Normals are computed by batched nearest neighbor queries of the voxel centers
+    std::vector<Vector3> batch_centers;
+    std::vector<size_t> batch_object_indices;
     std::vector<MeshAnn::IndexType> knn_indices;
     std::vector<MeshAnn::DistanceType> knn_distances;
-    std::vector<typename OccupiedTreeType::ObjectWithBoundingBox>& local_objects = objects_vector[thread_index];
-    const size_t report_leaf_interval = (size_t)octree->size() / 50.0;
-    std::size_t i = 0;
-    for (auto it = octree->begin_tree(); it != octree->end_tree(); ++it, ++i) {
-      if (thread_index == 0 && i % report_leaf_interval == 0) {
-        const FloatType percentage = FloatType(100) * i / FloatType(octree->size());
-        std::cout << "  processed " << percentage << " % of octree nodes" << std::endl;
+    auto compute_batch_normals = [&]() {
+      if (batch_centers.empty()) {
+        return;
       }
-      if (i % num_threads != thread_index) {
-        continue;
-      }
-      if (it.isLeaf()) {
-  //      if (octree->isNodeFree(&(*it)) || octree->isNodeUnknown(&(*it))) {
-        if (octree->isNodeFree(&(*it)) && octree->isNodeKnown(&(*it))) {
-          continue;
+      mesh_ann.knnSearch(batch_centers.begin(), batch_centers.end(), mesh_knn, &knn_indices, &knn_distances);
+      for (size_t j = 0; j < batch_centers.size(); ++j) {
+        NodeObjectType& object = object_storage[batch_object_indices[j]];
+        for (size_t k = j * mesh_knn; k < (j + 1) * mesh_knn; ++k) {
+          const MeshAnn::DistanceType dist_square = knn_distances[k];
+          const MeshAnn::IndexType index = knn_indices[k];
+          if (index != static_cast<MeshAnn::IndexType>(-1) && dist_square <= max_dist_square) {
+            const MeshType::Indices::Face &face = poisson_mesh_->m_FaceIndicesVertices[index];
+            const ml::vec3f &ml_v1 = poisson_mesh_->m_Vertices[face[0]];
+            const ml::vec3f &ml_v2 = poisson_mesh_->m_Vertices[face[1]];
+            const ml::vec3f &ml_v3 = poisson_mesh_->m_Vertices[face[2]];
+            const Vector3 v1(ml_v1.x, ml_v1.y, ml_v1.z);
+            const Vector3 v2(ml_v2.x, ml_v2.y, ml_v2.z);
+            const Vector3 v3(ml_v3.x, ml_v3.y, ml_v3.z);
+            const Vector3 normal = (v1 - v2).cross(v2 - v3).normalized();
+            const FloatType normal_weight = 1 / dist_square;
+            object.normal += normal_weight * normal;
+          }
         }
-        typename OccupiedTreeType::ObjectWithBoundingBox object_with_bbox;
-        octomap::point3d center_octomap = it.getCoordinate();
-        Eigen::Vector3f center;
-        center << center_octomap.x(), center_octomap.y(), center_octomap.z();
-        const float size = it.getSize();
-        object_with_bbox.bounding_box = typename OccupiedTreeType::BoundingBoxType(center, size);
-//        BH_ASSERT(object_with_bbox.bounding_box.isValid());
-        const BoundingBoxType old_bbox = object_with_bbox.bounding_box;
-        object_with_bbox.bounding_box.constrainTo(bvh_bbox_);
-        if (object_with_bbox.bounding_box.isEmpty()) {
-          continue;
+        if (object.normal != Vector3::Zero()) {
+          object.normal.normalize();
         }
+      }
+      batch_centers.clear();
+      batch_object_indices.clear();
+    };
 
-        const BoundingBoxType old_bbox2 = object_with_bbox.bounding_box;
-        if (object_with_bbox.bounding_box.getMaximum(2) >= options_.obstacle_free_height) {
-          const BoundingBoxType old_bbox = object_with_bbox.bounding_box;
-          Vector3 min = object_with_bbox.bounding_box.getMinimum();
-          min(2) = std::min(options_.obstacle_free_height, min(2));
-          Vector3 max = object_with_bbox.bounding_box.getMaximum();
-          max(2) = options_.obstacle_free_height;
-          object_with_bbox.bounding_box = typename OccupiedTreeType::BoundingBoxType(min, max);
-//          BH_ASSERT(object_with_bbox.bounding_box.isValid());
-        }
-        if (object_with_bbox.bounding_box.isEmpty()) {
-          continue;
+#pragma omp for schedule(dynamic)
+    for (size_t i = 0; i < subtree_navs.size(); ++i) {
+      size_t object_index = subtree_offsets[i];
+      BoundingBoxType bbox;
+      forEachLeafOfSubtree(subtree_navs[i], [&](const ConstTreeNavigatorType& nav) {
+        if (!compute_leaf_bbox(nav, &bbox)) {
+          return;
         }
-
-//        BH_ASSERT(object_with_bbox.bounding_box.isValid());
-        object_with_bbox.object = new NodeObjectType();
-        object_with_bbox.object->occupancy = it->getOccupancy();
-        object_with_bbox.object->observation_count = it->getObservationCount();
-        object_with_bbox.object->weight = it->getWeight();
-        object_with_bbox.object->normal.setZero();
-        // Find nearest neighbor faces to compute normal of voxel/node
+        NodeObjectType& object = object_storage[object_index];
+        object.occupancy = nav->getOccupancy();
+        object.observation_count = nav->getObservationCount();
+        object.weight = nav->getWeight();
+        object.normal.setZero();
+        objects[object_index].bounding_box = bbox;
+        objects[object_index].object = &object;
+        // If normals are not computed with OpenGL we average the normals of the nearest mesh faces
         if (!options_.enable_opengl) {
-          // If normals are not computed with OpenGL we average nearest neighbors
-          knn_indices.resize(mesh_knn);
-          knn_distances.resize(mesh_knn);
-          mesh_ann.knnSearch(center, mesh_knn, &knn_indices, &knn_distances);
-          for (std::size_t i = 0; i < knn_distances.size(); ++i) {
-            const MeshAnn::DistanceType dist_square = knn_distances[i];
-            const MeshAnn::IndexType index = knn_indices[i];
-            if (dist_square <= max_dist_square) {
-              const MeshType::Indices::Face &face = poisson_mesh_->m_FaceIndicesVertices[index];
-              const ml::vec3f &ml_v1 = poisson_mesh_->m_Vertices[face[0]];
-              const ml::vec3f &ml_v2 = poisson_mesh_->m_Vertices[face[1]];
-              const ml::vec3f &ml_v3 = poisson_mesh_->m_Vertices[face[2]];
-              const Vector3 v1(ml_v1.x, ml_v1.y, ml_v1.z);
-              const Vector3 v2(ml_v2.x, ml_v2.y, ml_v2.z);
-              const Vector3 v3(ml_v3.x, ml_v3.y, ml_v3.z);
-              //          Vector3 triangle_center(v1.x + v2.x + v3.x, v1.y + v2.y + v3.y, v1.z + v2.z + v3.z);
-              //          triangle_center /= 3;
-              const Vector3 normal = (v1 - v2).cross(v2 - v3).normalized();
-              const FloatType normal_weight = 1 / dist_square;
-              object_with_bbox.object->normal += normal_weight * normal;
-            }
-          }
-          if (object_with_bbox.object->normal != Vector3::Zero()) {
-            object_with_bbox.object->normal.normalize();
+          batch_centers.push_back(nav.getPosition());
+          batch_object_indices.push_back(object_index);
+          if (batch_centers.size() >= normal_batch_size) {
+            compute_batch_normals();
           }
         }
-
-//        objects.push_back(object_with_bbox);
-        local_objects.push_back(object_with_bbox);
-      }
+        ++object_index;
+      });
+      BH_ASSERT(object_index == subtree_offsets[i + 1]);
+      compute_batch_normals();
     }
   }
-  std::cout << "Merging local object vectors" << std::endl;
-  std::vector<typename OccupiedTreeType::ObjectWithBoundingBox> objects;
-  for (auto& local_objects : objects_vector) {
-    objects.insert(std::end(objects), std::begin(local_objects), std::end(local_objects));
-    local_objects.clear();
-  }
+
   std::cout << "Building BVH tree with " << objects.size() << " objects" << std::endl;
   bh::Timer timer;
-  occupied_bvh_.build(std::move(objects));
+  occupied_bvh_.build(std::move(objects), std::move(object_storage));
   timer.printTimingMs("Building BVH tree");
 }
 
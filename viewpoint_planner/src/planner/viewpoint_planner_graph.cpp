@@ -62,6 +62,7 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntry(
               ViewpointEntry(Viewpoint(&virtual_camera_, pose), total_information, std::move(voxel_set)),
               ignore_viewpoint_count_grid);
       viewpoint_exploration_front_.push_back(new_viewpoint_index);
+      journalExplorationFrontPush(new_viewpoint_index);
       return new_viewpoint_index;
     }
     else {
@@ -72,6 +73,7 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntry(
               ViewpointEntry(Viewpoint(&virtual_camera_, pose), total_information, std::move(voxel_set)),
               ignore_viewpoint_count_grid);
       viewpoint_exploration_front_.push_back(new_viewpoint_index);
+      journalExplorationFrontPush(new_viewpoint_index);
       return new_viewpoint_index;
     }
   }
@@ -84,6 +86,7 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntry(
 
 ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntryWithoutLock(
         ViewpointEntry&& viewpoint_entry, const bool ignore_viewpoint_count_grid) {
+  journalViewpointEntry(viewpoint_entry, ignore_viewpoint_count_grid);
   const ViewpointEntryIndex viewpoint_index = viewpoint_entries_.size();
   const Vector3 viewpoint_position = viewpoint_entry.viewpoint.pose().getWorldPosition();
 //  std::cout << "Adding position to ANN index" << std::endl;
@@ -106,23 +109,12 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntryWithout
 //    BH_ASSERT(viewpoint_count_grid_.isInsideGrid(viewpoint_position));
 //  }
 //#endif
-  if (!ignore_viewpoint_count_grid && options_.viewpoint_count_grid_enable) {
-    if (viewpoint_count_grid_.isInsideGrid(viewpoint_position)) {
-      if (viewpoint_entries_.size() > num_real_viewpoints_) {
-        viewpoint_count_grid_(viewpoint_position) += 1;
-      }
-      // Check if viewpoint sampling distribution should be updated
-      const size_t increase_since_last_update =
-              viewpoint_entries_.size() - viewpoint_sampling_distribution_update_size_;
-      const FloatType relative_increase_since_last_update =
-              increase_since_last_update / FloatType(viewpoint_entries_.size());
-      if (viewpoint_entries_.size() >= num_real_viewpoints_
-          && (viewpoint_entries_.size() == num_real_viewpoints_ + 1
-              || relative_increase_since_last_update >= FloatType(0.05))) {
-        std::cout << "Updating viewpoint sampling distribution" << std::endl;
-        updateViewpointSamplingDistribution();
-        viewpoint_sampling_distribution_update_size_ = viewpoint_entries_.size();
-      }
+  if (options_.viewpoint_count_grid_enable && viewpoint_count_grid_.isInsideGrid(viewpoint_position)) {
+    if (!ignore_viewpoint_count_grid && viewpoint_entries_.size() > num_real_viewpoints_) {
+      viewpoint_count_grid_(viewpoint_position) += 1;
+    }
+    if (viewpoint_index >= num_real_viewpoints_) {
+      updateViewpointSamplingDistribution(viewpoint_index);
     }
   }
   return viewpoint_index;
@@ -134,51 +126,84 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntryWithout
   return addViewpointEntryWithoutLock(std::move(viewpoint_entry_copy), ignore_viewpoint_count_grid);
 }
 
-void ViewpointPlanner::updateViewpointSamplingDistribution() {
-  std::vector<FloatType> weights;
-  weights.reserve(viewpoint_entries_.size() - num_real_viewpoints_);
-  const auto grid_count_lambda = [&](const ViewpointEntry& entry) {
-    const Vector3 viewpoint_position = entry.viewpoint.pose().getWorldPosition();
-    return viewpoint_count_grid_(viewpoint_position);
-  };
-  const auto max_it = std::max_element(viewpoint_entries_.begin() + num_real_viewpoints_, viewpoint_entries_.end(),
-                                       [&] (const ViewpointEntry& entry1, const ViewpointEntry& entry2) {
-    return grid_count_lambda(entry1) < grid_count_lambda(entry2);
-  });
-  const FloatType max_grid_count = grid_count_lambda(*max_it);
-//  FloatType exp_factor = 20;
-  FloatType exp_factor = 1;
-  if (viewpoint_entries_.size() >= num_real_viewpoints_ + 100) {
-    exp_factor = 1;
-  }
-  for (auto it = viewpoint_entries_.begin() + num_real_viewpoints_; it != viewpoint_entries_.end(); ++it) {
-    const FloatType grid_count = grid_count_lambda(*it);
-    BH_ASSERT(grid_count > 0);
-    const FloatType weight = std::exp(-grid_count * exp_factor / max_grid_count);
-    weights.push_back(weight);
-  }
-  viewpoint_sampling_distribution_ = std::discrete_distribution<size_t>(weights.begin(), weights.end());
-  const FloatType grid_exp_factor = 2;
-//  // Display non-empty grid cells
-  if (viewpoint_entries_.size() >= num_real_viewpoints_ + 100) {
-  //  std::cout << "Viewpoint grid:" << std::endl;
-    for (size_t ix = 0; ix < viewpoint_count_grid_.getDimX(); ++ix) {
-      for (size_t iy = 0; iy < viewpoint_count_grid_.getDimY(); ++iy) {
-        for (size_t iz = 0; iz < viewpoint_count_grid_.getDimZ(); ++iz) {
-          const size_t index = viewpoint_count_grid_.getIndex(ix, iy, iz);
-          const FloatType grid_count = viewpoint_count_grid_(ix, iy, iz);
-          const FloatType probability = std::exp(-grid_count * grid_exp_factor / max_grid_count);
-          grid_cell_probabilities_[index] = probability;
-  //        if (grid_count > 0) {
-  //          std::cout << "  grid element (" << ix << ", " << iy << ", " << iz << ") has " << grid_count << " viewpoints" << std::endl;
-  //        }
-        }
-      }
+void ViewpointPlanner::updateViewpointSamplingDistribution(const ViewpointEntryIndex viewpoint_index) {
+  const Vector3 viewpoint_position = viewpoint_entries_[viewpoint_index].viewpoint.pose().getWorldPosition();
+  const size_t grid_index = viewpoint_count_grid_.getIndex(viewpoint_count_grid_.getGridIndices(viewpoint_position));
+  auto slot_it = viewpoint_sampling_cell_slots_.find(grid_index);
+  if (slot_it == viewpoint_sampling_cell_slots_.end()) {
+    slot_it = viewpoint_sampling_cell_slots_.emplace(grid_index, viewpoint_sampling_cells_.size()).first;
+    viewpoint_sampling_cells_.push_back(ViewpointSamplingCell { grid_index, { } });
+    viewpoint_sampling_distribution_.push_back(0);
+  }
+  const size_t cell_slot = slot_it->second;
+  viewpoint_sampling_cells_[cell_slot].viewpoint_indices.push_back(viewpoint_index);
+  const FloatType grid_count = viewpoint_count_grid_(grid_index);
+  if (grid_count > viewpoint_sampling_max_grid_count_) {
+    // The weights of all cells are normalized by the maximum count so they all have to be recomputed
+    viewpoint_sampling_max_grid_count_ = grid_count;
+    std::vector<FloatType> weights;
+    weights.reserve(viewpoint_sampling_cells_.size());
+    for (size_t i = 0; i < viewpoint_sampling_cells_.size(); ++i) {
+      weights.push_back(computeViewpointSamplingCellWeight(i));
     }
+    viewpoint_sampling_distribution_.assign(weights.begin(), weights.end());
   }
   else {
-    std::fill(grid_cell_probabilities_.begin(), grid_cell_probabilities_.end(), 1);
+    viewpoint_sampling_distribution_.setWeight(cell_slot, computeViewpointSamplingCellWeight(cell_slot));
+  }
+}
+
+void ViewpointPlanner::rebuildViewpointSamplingDistribution() {
+  viewpoint_sampling_cells_.clear();
+  viewpoint_sampling_cell_slots_.clear();
+  viewpoint_sampling_distribution_.clear();
+  viewpoint_sampling_max_grid_count_ = 0;
+  if (!options_.viewpoint_count_grid_enable) {
+    return;
+  }
+  for (ViewpointEntryIndex i = num_real_viewpoints_; i < viewpoint_entries_.size(); ++i) {
+    const Vector3 viewpoint_position = viewpoint_entries_[i].viewpoint.pose().getWorldPosition();
+    if (viewpoint_count_grid_.isInsideGrid(viewpoint_position)) {
+      updateViewpointSamplingDistribution(i);
+    }
+  }
+}
+
+ViewpointPlanner::FloatType ViewpointPlanner::computeViewpointSamplingCellWeight(const size_t cell_slot) const {
+  // Each viewpoint in a cell has weight exp(-grid_count * exp_factor / max_grid_count)
+  const FloatType exp_factor = 1;
+  const ViewpointSamplingCell& cell = viewpoint_sampling_cells_[cell_slot];
+  const FloatType num_viewpoints = cell.viewpoint_indices.size();
+  if (viewpoint_sampling_max_grid_count_ <= 0) {
+    return num_viewpoints;
   }
+  const FloatType grid_count = viewpoint_count_grid_(cell.grid_index);
+  return num_viewpoints * std::exp(-grid_count * exp_factor / viewpoint_sampling_max_grid_count_);
+}
+
+ViewpointPlanner::FloatType ViewpointPlanner::computeGridCellSamplingProbability(const Vector3& position) const {
+  const FloatType grid_exp_factor = 2;
+  if (viewpoint_entries_.size() < num_real_viewpoints_ + 100
+      || viewpoint_sampling_max_grid_count_ <= 0
+      || !viewpoint_count_grid_.isInsideGrid(position)) {
+    return 1;
+  }
+  const FloatType grid_count = viewpoint_count_grid_(position);
+  return std::exp(-grid_count * grid_exp_factor / viewpoint_sampling_max_grid_count_);
+}
+
+ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::sampleViewpointIndexByGridCounts(
+    bh::RandomStream<FloatType>& random) const {
+  if (viewpoint_sampling_distribution_.empty()) {
+    // No viewpoint count grid available so sample uniformly
+    if (viewpoint_entries_.size() <= num_real_viewpoints_) {
+      return (ViewpointEntryIndex)-1;
+    }
+    return num_real_viewpoints_ + random.sampleUniformIntExclusive(viewpoint_entries_.size() - num_real_viewpoints_);
+  }
+  const size_t cell_slot = viewpoint_sampling_distribution_.sample(random.sampleUniform());
+  const std::vector<ViewpointEntryIndex>& viewpoint_indices = viewpoint_sampling_cells_[cell_slot].viewpoint_indices;
+  return viewpoint_indices[random.sampleUniformIntExclusive(viewpoint_indices.size())];
 }
 
 ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntry(
@@ -199,13 +224,60 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntry(
 const std::pair<std::vector<std::size_t>, std::size_t>& ViewpointPlanner::getConnectedComponents() const {
   if (!viewpoint_graph_components_valid_) {
     std::vector<std::size_t> component(viewpoint_graph_.numVertices());
-    std::size_t num_components = boost::connected_components(viewpoint_graph_.boostGraph(), &component.front());
+    std::size_t num_components;
+    if (options_.viewpoint_motion_lazy) {
+      num_components = computeLazyConnectedComponents(&component);
+    }
+    else {
+      num_components = boost::connected_components(viewpoint_graph_.boostGraph(), &component.front());
+    }
     viewpoint_graph_components_.first = std::move(component);
     viewpoint_graph_components_.second = num_components;
   }
   return viewpoint_graph_components_;
 }
 
+std::size_t ViewpointPlanner::computeLazyConnectedComponents(std::vector<std::size_t>* component) const {
+  const std::size_t unvisited = (std::size_t)-1;
+  std::fill(component->begin(), component->end(), unvisited);
+  std::size_t num_components = 0;
+  std::vector<ViewpointEntryIndex> stack;
+  for (ViewpointEntryIndex root_index = 0; root_index < component->size(); ++root_index) {
+    if ((*component)[root_index] != unvisited) {
+      continue;
+    }
+    (*component)[root_index] = num_components;
+    stack.push_back(root_index);
+    while (!stack.empty()) {
+      const ViewpointEntryIndex index = stack.back();
+      stack.pop_back();
+      const auto visit_lambda = [&] (const ViewpointEntryIndex other_index) {
+        if ((*component)[other_index] == unvisited) {
+          (*component)[other_index] = num_components;
+          stack.push_back(other_index);
+        }
+      };
+      const auto edges = viewpoint_graph_.getEdgesByNode(index);
+      for (auto it = edges.begin(); it != edges.end(); ++it) {
+        visit_lambda(it.targetNode());
+      }
+      if (index < lazy_viewpoint_motions_.size()) {
+        for (const ViewpointEntryIndex other_index : lazy_viewpoint_motions_[index]) {
+          visit_lambda(other_index);
+        }
+      }
+    }
+    ++num_components;
+  }
+  return num_components;
+}
+
+bh::RandomStream<ViewpointPlanner::FloatType> ViewpointPlanner::getNextCandidateRandomStream() {
+  const std::uint64_t stream_id = next_candidate_stream_id_;
+  ++next_candidate_stream_id_;
+  return bh::RandomStream<FloatType>(random_seed_, stream_id);
+}
+
 bool ViewpointPlanner::generateNextViewpointEntry() {
   const bool verbose = true;
 
@@ -219,6 +291,7 @@ bool ViewpointPlanner::generateNextViewpointEntry() {
 
   // Sample viewpoint and add it to the viewpoint graph
 
+  bh::RandomStream<FloatType> random = getNextCandidateRandomStream();
   bool found_sample;
   Pose sampled_pose;
   ViewpointEntryIndex reference_viewpoint_index = (ViewpointEntryIndex)-1;
@@ -230,38 +303,35 @@ bool ViewpointPlanner::generateNextViewpointEntry() {
     if (options_.isSet("drone_start_position")) {
       const Pose drone_start_pose = Pose::createFromImageToWorldTransformation(options_.drone_start_position, Quaternion::Identity());
       std::cout << "Sampling around start position" << std::endl;
-      std::tie(found_sample, sampled_pose) = sampleSurroundingPose(drone_start_pose);
+      std::tie(found_sample, sampled_pose) = sampleSurroundingPose(drone_start_pose, random);
     }
     else {
-      reference_viewpoint_index = random_.sampleUniformIntExclusive(viewpoint_entries_.size());
+      reference_viewpoint_index = random.sampleUniformIntExclusive(viewpoint_entries_.size());
       const Pose& reference_pose = viewpoint_entries_[reference_viewpoint_index].viewpoint.pose();
       std::cout << "Sampling around previous viewpoint position" << std::endl;
-      std::tie(found_sample, sampled_pose) = sampleSurroundingPose(reference_pose);
+      std::tie(found_sample, sampled_pose) = sampleSurroundingPose(reference_pose, random);
     }
   }
   else {
-    const bool sample_without_reference = random_.sampleBernoulli(options_.viewpoint_sample_without_reference_probability);
+    const bool sample_without_reference = random.sampleBernoulli(options_.viewpoint_sample_without_reference_probability);
     if (sample_without_reference) {
       std::cout << "Sampling uniformly in pose sample bounding box" << std::endl;
-      std::tie(found_sample, sampled_pose) = samplePose(pose_sample_bbox_, drone_bbox_);
+      std::tie(found_sample, sampled_pose) = samplePose(random, pose_sample_bbox_, drone_bbox_);
     }
     else {
       std::cout << "Sampling around existing viewpoint" << std::endl;
-      const auto viewpoint_it = sampleViewpointByGridCounts(
-          viewpoint_entries_.cbegin() + num_real_viewpoints_, viewpoint_entries_.cend());
-      if (viewpoint_it == viewpoint_entries_.cend()) {
+      const ViewpointEntryIndex sampled_viewpoint_index = sampleViewpointIndexByGridCounts(random);
+      if (sampled_viewpoint_index == (ViewpointEntryIndex)-1) {
         std::cout << "Could not sample viewpoint from grid" << std::endl;
         found_sample = false;
       }
       else {
-        const Pose& reference_pose = viewpoint_it->viewpoint.pose();
-        std::tie(found_sample, sampled_pose) = sampleSurroundingPose(reference_pose);
+        const Pose& reference_pose = viewpoint_entries_[sampled_viewpoint_index].viewpoint.pose();
+        std::tie(found_sample, sampled_pose) = sampleSurroundingPose(reference_pose, random);
         if (found_sample) {
           if (options_.viewpoint_count_grid_enable) {
-            const size_t grid_index = viewpoint_count_grid_.getIndex(
-                    viewpoint_count_grid_.getGridIndices(sampled_pose.getWorldPosition()));
-            const FloatType prob = grid_cell_probabilities_[grid_index];
-            const FloatType u = random_.sampleUniform();
+            const FloatType prob = computeGridCellSamplingProbability(sampled_pose.getWorldPosition());
+            const FloatType u = random.sampleUniform();
             if (u > prob) {
               std::cout << "Sample was rejected because of viewpoint count grid" << std::endl;
               found_sample = false;
@@ -289,10 +359,8 @@ bool ViewpointPlanner::generateNextViewpointEntry() {
   const FloatType dist_thres_square = options_.viewpoint_discard_dist_thres_square;
   const std::size_t dist_count_thres = options_.viewpoint_discard_dist_count_thres;
   const FloatType dist_real_thres_square = options_.viewpoint_discard_dist_real_thres_square;
-  static std::vector<ViewpointANN::IndexType> knn_indices;
-  static std::vector<ViewpointANN::DistanceType> knn_distances;
-  knn_indices.resize(dist_knn);
-  knn_distances.resize(dist_knn);
+  std::vector<ViewpointANN::IndexType> knn_indices;
+  std::vector<ViewpointANN::DistanceType> knn_distances;
   viewpoint_ann_.knnSearch(sampled_pose.getWorldPosition(), dist_knn, &knn_indices, &knn_distances);
   std::size_t too_close_count = 0;
 //  for (ViewpointANN::IndexType viewpoint_index : knn_indices) {
@@ -473,6 +541,14 @@ bool ViewpointPlanner::generateNextViewpointEntry() {
   // Compute observed voxels and information and discard if too few voxels or too little information.
   // Also discard if too close to too many voxels.
   try {
+    if (options_.viewpoint_coarse_evaluation && isHopelessViewpointCandidate(viewpoint)) {
+      if (verbose) {
+        std::cout << "Viewpoint rejected by coarse evaluation" << std::endl;
+      }
+      ++num_of_failed_viewpoint_entry_samples_;
+      return false;
+    }
+    num_of_full_rays_ += virtual_camera_.width() * virtual_camera_.height();
     const bool ignore_voxels_with_zero_information = true;
     std::pair<VoxelWithInformationSet, FloatType> raycast_result =
         getRaycastHitVoxelsWithInformationScore(viewpoint, ignore_voxels_with_zero_information);
@@ -506,12 +582,13 @@ bool ViewpointPlanner::generateNextViewpointEntry() {
         ++too_close_voxel_count;
       }
     }
-    const FloatType too_close_voxel_ratio = too_close_voxel_count / voxel_set.size();
+    const FloatType too_close_voxel_ratio = too_close_voxel_count / FloatType(voxel_set.size());
     if (too_close_voxel_ratio >= options_.viewpoint_max_too_close_voxel_ratio) {
       if (verbose) {
-        std::cout << "too_close_voxel_ratio < options_.viewpoint_max_too_close_voxel_ratio" << std::endl;
+        std::cout << "too_close_voxel_ratio >= options_.viewpoint_max_too_close_voxel_ratio" << std::endl;
       }
       ++num_of_failed_viewpoint_entry_samples_;
+      return false;
     }
 
   //  if (verbose) {
@@ -520,6 +597,7 @@ bool ViewpointPlanner::generateNextViewpointEntry() {
 
     addViewpointEntry(
         ViewpointEntry(Viewpoint(&virtual_camera_, sampled_pose), total_information, std::move(voxel_set)));
+    ++num_of_accepted_candidates_;
 
 //    if (found_motion) {
 //      ViewpointMotion motion({ reference_viewpoint_index, new_viewpoint_index }, { se3_motion });
@@ -551,10 +629,8 @@ bool ViewpointPlanner::tryToAddViewpointEntry(const Pose& pose, const bool no_ra
 //  const FloatType dist_thres_square = options_.viewpoint_discard_dist_thres_square;
 //  const std::size_t dist_count_thres = options_.viewpoint_discard_dist_count_thres;
 //  const FloatType dist_real_thres_square = options_.viewpoint_discard_dist_real_thres_square;
-  static std::vector<ViewpointANN::IndexType> knn_indices;
-  static std::vector<ViewpointANN::DistanceType> knn_distances;
-  knn_indices.resize(dist_knn);
-  knn_distances.resize(dist_knn);
+  std::vector<ViewpointANN::IndexType> knn_indices;
+  std::vector<ViewpointANN::DistanceType> knn_distances;
   viewpoint_ann_.knnSearch(pose.getWorldPosition(), dist_knn, &knn_indices, &knn_distances);
   //  for (ViewpointANN::IndexType viewpoint_index : knn_indices) {
   //    const ViewpointEntry& other_viewpoint = viewpoint_entries_[viewpoint_index];
@@ -588,6 +664,13 @@ bool ViewpointPlanner::tryToAddViewpointEntry(const Pose& pose, const bool no_ra
   // Also discard if too close to too many voxels.
   try {
     if (!no_raycast && !options_.viewpoint_no_raycast) {
+      if (options_.viewpoint_coarse_evaluation && isHopelessViewpointCandidate(viewpoint)) {
+        if (verbose) {
+          std::cout << "Viewpoint rejected by coarse evaluation" << std::endl;
+        }
+        return false;
+      }
+      num_of_full_rays_ += virtual_camera_.width() * virtual_camera_.height();
       const bool ignore_voxels_with_zero_information = true;
       std::pair<VoxelWithInformationSet, FloatType> raycast_result =
               getRaycastHitVoxelsWithInformationScore(viewpoint, ignore_voxels_with_zero_information);
@@ -620,11 +703,12 @@ bool ViewpointPlanner::tryToAddViewpointEntry(const Pose& pose, const bool no_ra
           ++too_close_voxel_count;
         }
       }
-      const FloatType too_close_voxel_ratio = too_close_voxel_count / voxel_set.size();
+      const FloatType too_close_voxel_ratio = too_close_voxel_count / FloatType(voxel_set.size());
       if (too_close_voxel_ratio >= options_.viewpoint_max_too_close_voxel_ratio) {
         if (verbose) {
-          std::cout << "too_close_voxel_ratio < options_.viewpoint_max_too_close_voxel_ratio" << std::endl;
+          std::cout << "too_close_voxel_ratio >= options_.viewpoint_max_too_close_voxel_ratio" << std::endl;
         }
+        return false;
       }
 
       const bool ignore_viewpoint_count_grid = true;
@@ -632,6 +716,8 @@ bool ViewpointPlanner::tryToAddViewpointEntry(const Pose& pose, const bool no_ra
               ViewpointEntry(Viewpoint(&virtual_camera_, pose), total_information, std::move(voxel_set)),
               ignore_viewpoint_count_grid);
       viewpoint_exploration_front_.push_back(new_viewpoint_index);
+      journalExplorationFrontPush(new_viewpoint_index);
+      ++num_of_accepted_candidates_;
     }
     else {
       VoxelWithInformationSet voxel_set;
@@ -641,6 +727,7 @@ bool ViewpointPlanner::tryToAddViewpointEntry(const Pose& pose, const bool no_ra
               ViewpointEntry(Viewpoint(&virtual_camera_, pose), total_information, std::move(voxel_set)),
               ignore_viewpoint_count_grid);
       viewpoint_exploration_front_.push_back(new_viewpoint_index);
+      journalExplorationFrontPush(new_viewpoint_index);
     }
 
     return true;
@@ -654,14 +741,83 @@ bool ViewpointPlanner::tryToAddViewpointEntry(const Pose& pose, const bool no_ra
   return true;
 }
 
-bool ViewpointPlanner::tryToAddViewpointEntries(const Vector3& position, const bool no_raycast) {
+bool ViewpointPlanner::isHopelessViewpointCandidate(const Viewpoint& viewpoint) {
+  const size_t stride = std::max<size_t>(options_.viewpoint_coarse_evaluation_stride, 1);
+  const std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates> raycast_results =
+          raycaster_.getRaycastHitVoxelsWithScreenCoordinatesOnLattice(viewpoint, stride);
+  const size_t num_of_lattice_rays = viewpoint_planner::ViewpointRaycast::getNumOfLatticeRays(viewpoint, stride);
+  const size_t num_of_full_rays = virtual_camera_.width() * virtual_camera_.height();
+  ++num_of_evaluated_candidates_;
+  num_of_coarse_rays_ += num_of_lattice_rays;
+  size_t hit_count = 0;
+  FloatType information_sum = 0;
+  std::unordered_set<const VoxelType*> hit_voxels;
+  size_t too_close_voxel_count = 0;
+  for (const OccupiedTreeType::IntersectionResultWithScreenCoordinates& result : raycast_results) {
+    const FloatType information = computeViewpointObservationScore(
+            viewpoint, result.intersection_result.node, result.screen_coordinates);
+    if (information > 0) {
+      ++hit_count;
+      information_sum += information;
+      if (hit_voxels.insert(result.intersection_result.node).second) {
+        const FloatType squared_distance = (viewpoint.pose().getWorldPosition() -
+                                            result.intersection_result.node->getBoundingBox().getCenter()).squaredNorm();
+        if (squared_distance < options_.viewpoint_voxel_distance_threshold) {
+          ++too_close_voxel_count;
+        }
+      }
+    }
+  }
+  // Every lattice ray stands for num_of_full_rays / num_of_lattice_rays rays at full resolution.
+  // Each voxel needs at least one ray so the extrapolated number of hit rays already tends to overestimate
+  // the voxel count. The margin accounts for the sampling error of the lattice.
+  const FloatType margin = std::max<FloatType>(options_.viewpoint_coarse_evaluation_margin, 1);
+  const FloatType extrapolation_factor = margin * num_of_full_rays / FloatType(std::max<size_t>(num_of_lattice_rays, 1));
+  const FloatType voxel_count_estimate = extrapolation_factor * hit_count;
+  const FloatType information_estimate = extrapolation_factor * information_sum;
+  // For the too close voxel ratio the fraction of voxels at a sufficient distance is scaled up by the margin
+  FloatType too_close_voxel_ratio_estimate = 0;
+  if (!hit_voxels.empty()) {
+    const FloatType far_voxel_ratio = (hit_voxels.size() - too_close_voxel_count) / FloatType(hit_voxels.size());
+    too_close_voxel_ratio_estimate = std::max<FloatType>(1 - margin * far_voxel_ratio, 0);
+  }
+  const bool hopeless = voxel_count_estimate < options_.viewpoint_min_voxel_count
+                        || information_estimate < options_.viewpoint_min_information
+                        || too_close_voxel_ratio_estimate >= options_.viewpoint_max_too_close_voxel_ratio;
+  if (hopeless) {
+    ++num_of_coarse_rejected_candidates_;
+    num_of_saved_full_rays_ += num_of_full_rays;
+  }
+  return hopeless;
+}
+
+void ViewpointPlanner::printCandidateEvaluationStatistics() const {
+  const size_t num_of_total_rays = num_of_coarse_rays_ + num_of_full_rays_;
+  const size_t num_of_total_rays_without_coarse = num_of_full_rays_ + num_of_saved_full_rays_;
+  std::cout << "Evaluated " << num_of_evaluated_candidates_ << " viewpoint candidates: "
+            << num_of_coarse_rejected_candidates_ << " rejected by coarse evaluation, "
+            << num_of_accepted_candidates_ << " accepted" << std::endl;
+  if (num_of_evaluated_candidates_ > 0) {
+    std::cout << "  Acceptance rate: " << num_of_accepted_candidates_ / FloatType(num_of_evaluated_candidates_)
+              << ", coarse rejection rate: "
+              << num_of_coarse_rejected_candidates_ / FloatType(num_of_evaluated_candidates_) << std::endl;
+  }
+  if (num_of_total_rays_without_coarse > 0) {
+    std::cout << "  Rays cast: " << num_of_total_rays << " (" << num_of_coarse_rays_ << " coarse), "
+              << "without coarse evaluation: " << num_of_total_rays_without_coarse
+              << ", ratio: " << num_of_total_rays / FloatType(num_of_total_rays_without_coarse) << std::endl;
+  }
+}
+
+bool ViewpointPlanner::tryToAddViewpointEntries(const Vector3& position, bh::RandomStream<FloatType>& random,
+    const bool no_raycast) {
   const bool valid = isValidObjectPosition(position, drone_bbox_);
   if (!valid) {
     return false;
   }
   bool success = false;
   for (size_t i = 0; i < options_.viewpoint_exploration_num_orientations; ++i) {
-    Pose::Quaternion sampled_orientation = sampleBiasedOrientation(position, data_->roi_bbox_);
+    Pose::Quaternion sampled_orientation = sampleBiasedOrientation(position, data_->roi_bbox_, random);
     const Pose sampled_pose = Pose::createFromImageToWorldTransformation(position, sampled_orientation);
     const bool local_success = tryToAddViewpointEntry(sampled_pose, no_raycast);
     success = success || local_success;
@@ -694,25 +850,29 @@ bool ViewpointPlanner::generateNextViewpointEntry2() {
 
   // Sample viewpoint and add it to the viewpoint graph
 
+  bh::RandomStream<FloatType> random = getNextCandidateRandomStream();
   bool found_sample;
   Pose sampled_pose;
 
   if (viewpoint_entries_.size() <= num_real_viewpoints_ && viewpoint_exploration_front_.empty()) {
     for (size_t i = 0; i < viewpoint_entries_.size(); ++i) {
       viewpoint_exploration_front_.push_back(i);
+      journalExplorationFrontPush(i);
     }
   }
 
-  const bool sample_without_reference = random_.sampleBernoulli(options_.viewpoint_sample_without_reference_probability);
+  const bool sample_without_reference = random.sampleBernoulli(options_.viewpoint_sample_without_reference_probability);
   if (sample_without_reference || viewpoint_exploration_front_.empty()) {
     std::cout << "Sampling uniformly in pose sample bounding box" << std::endl;
-    std::tie(found_sample, sampled_pose) = samplePose(pose_sample_bbox_, drone_bbox_);
+    std::tie(found_sample, sampled_pose) = samplePose(random, pose_sample_bbox_, drone_bbox_);
   }
   else {
     std::cout << "Sampling around existing viewpoint" << std::endl;
     std::cout << "Size of exploration front: " << viewpoint_exploration_front_.size() << std::endl;
-    const auto exploration_it = random_.sampleDiscrete(viewpoint_exploration_front_.begin(), viewpoint_exploration_front_.end());
+    const auto exploration_it = viewpoint_exploration_front_.begin()
+        + random.sampleUniformIntExclusive(viewpoint_exploration_front_.size());
     const ViewpointEntryIndex exploration_index = *exploration_it;
+    journalExplorationFrontTake(exploration_it - viewpoint_exploration_front_.begin());
     // Swap exploration_it with last element and afterwards remove last element
     using std::swap;
     swap(*exploration_it, viewpoint_exploration_front_.back());
@@ -724,12 +884,12 @@ bool ViewpointPlanner::generateNextViewpointEntry2() {
 //    viewpoint_exploration_front_.pop_front();
     const Vector3 exploration_position = viewpoint_entries_[exploration_index].viewpoint.pose().getWorldPosition();
     const FloatType exploration_step = computeExplorationStep(exploration_position);
-    const bool success1 = tryToAddViewpointEntries(exploration_position - exploration_step * Vector3::UnitX());
-    const bool success2 = tryToAddViewpointEntries(exploration_position + exploration_step * Vector3::UnitX());
-    const bool success3 = tryToAddViewpointEntries(exploration_position - exploration_step * Vector3::UnitY());
-    const bool success4 = tryToAddViewpointEntries(exploration_position + exploration_step * Vector3::UnitY());
-    const bool success5 = tryToAddViewpointEntries(exploration_position - exploration_step * Vector3::UnitZ());
-    const bool success6 = tryToAddViewpointEntries(exploration_position + exploration_step * Vector3::UnitZ());
+    const bool success1 = tryToAddViewpointEntries(exploration_position - exploration_step * Vector3::UnitX(), random);
+    const bool success2 = tryToAddViewpointEntries(exploration_position + exploration_step * Vector3::UnitX(), random);
+    const bool success3 = tryToAddViewpointEntries(exploration_position - exploration_step * Vector3::UnitY(), random);
+    const bool success4 = tryToAddViewpointEntries(exploration_position + exploration_step * Vector3::UnitY(), random);
+    const bool success5 = tryToAddViewpointEntries(exploration_position - exploration_step * Vector3::UnitZ(), random);
+    const bool success6 = tryToAddViewpointEntries(exploration_position + exploration_step * Vector3::UnitZ(), random);
     const bool success = success1 || success2 || success3 || success4 || success5 || success6;
     return success;
   }
@@ -0,0 +1,474 @@
+//==================================================
+// viewpoint_planner_journal.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 20.05.17
+//==================================================
+
+#include "viewpoint_planner.h"
+#include "viewpoint_planner_serialization.h"
+#include <sstream>
+#include <bh/filesystem.h>
+
+namespace {
+
+// Journal records are small boost binary archives without the archive header
+
+template <typename WriteFunc>
+std::string writeJournalPayload(WriteFunc write_func) {
+  std::ostringstream oss;
+  {
+    boost::archive::binary_oarchive oa(oss, boost::archive::no_header);
+    write_func(oa);
+  }
+  return oss.str();
+}
+
+std::string getTemporaryFilename(const std::string& filename) {
+  return filename + ".tmp";
+}
+
+void syncParentDirectory(const std::string& filename) {
+  const bh::boostfs::path parent_path = bh::boostfs::absolute(filename).parent_path();
+  bh::AppendOnlyJournal::syncFile(parent_path.string());
+}
+
+}
+
+constexpr uint32_t ViewpointPlanner::kJournalVersion;
+
+bool ViewpointPlanner::JournalBase::operator==(const JournalBase& other) const {
+  return viewpoint_graph_checksum == other.viewpoint_graph_checksum
+         && bvh_layout_checksum == other.bvh_layout_checksum
+         && num_real_viewpoints == other.num_real_viewpoints
+         && num_viewpoint_entries == other.num_viewpoint_entries
+         && num_viewpoint_motions == other.num_viewpoint_motions
+         && exploration_front_size == other.exploration_front_size;
+}
+
+auto ViewpointPlanner::getJournalBase() const -> JournalBase {
+  JournalBase base;
+  base.viewpoint_graph_checksum = viewpoint_graph_checksum_;
+  base.bvh_layout_checksum = data_->occupied_bvh_.computeLayoutChecksum();
+  base.num_real_viewpoints = num_real_viewpoints_;
+  base.num_viewpoint_entries = viewpoint_entries_.size();
+  base.num_viewpoint_motions = viewpoint_graph_motions_.size();
+  base.exploration_front_size = viewpoint_exploration_front_.size();
+  return base;
+}
+
+bool ViewpointPlanner::readJournal(const std::string& filename, JournalBase* base,
+                                   std::vector<bh::AppendOnlyJournal::Record>* records, size_t* valid_size) {
+  *valid_size = bh::AppendOnlyJournal::readRecords(filename, records);
+  if (records->empty()) {
+    return false;
+  }
+  const bh::AppendOnlyJournal::Record& base_record = records->front();
+  if (base_record.type != JOURNAL_BASE) {
+    throw BH_EXCEPTION(std::string("Journal does not start with a base record: ") + filename);
+  }
+  std::istringstream iss(base_record.payload);
+  boost::archive::binary_iarchive ia(iss, boost::archive::no_header);
+  uint32_t version;
+  ia >> version;
+  if (version != kJournalVersion) {
+    throw BH_EXCEPTION(std::string("Unsupported journal version: ") + std::to_string(version));
+  }
+  ia >> base->viewpoint_graph_checksum;
+  ia >> base->bvh_layout_checksum;
+  ia >> base->num_real_viewpoints;
+  ia >> base->num_viewpoint_entries;
+  ia >> base->num_viewpoint_motions;
+  ia >> base->exploration_front_size;
+  return true;
+}
+
+void ViewpointPlanner::openJournal(const std::string& filename) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  BH_ASSERT_STR(!journal_, "Journal is already open");
+  const JournalBase graph_base = getJournalBase();
+  JournalBase base;
+  std::vector<bh::AppendOnlyJournal::Record> records;
+  size_t valid_size;
+
+  // A compaction that was interrupted after the viewpoint graph file was replaced leaves the new journal behind
+  const std::string tmp_filename = getTemporaryFilename(filename);
+  if (readJournal(tmp_filename, &base, &records, &valid_size) && base == graph_base) {
+    std::cout << "Recovering journal from interrupted compaction" << std::endl;
+    bh::boostfs::rename(tmp_filename, filename);
+  }
+  else if (bh::boostfs::exists(tmp_filename)) {
+    bh::boostfs::remove(tmp_filename);
+  }
+
+  if (!readJournal(filename, &base, &records, &valid_size)) {
+    std::cout << "Starting new journal " << filename << std::endl;
+    startJournalWithoutLock(filename);
+    return;
+  }
+  if (!(base == graph_base)) {
+    throw BH_EXCEPTION(std::string("Journal was not started on the loaded viewpoint graph: ") + filename);
+  }
+  std::cout << "Replaying " << records.size() - 1 << " journal records from " << filename << std::endl;
+  replayJournalWithoutLock(records);
+  std::cout << "Resuming with " << viewpoint_entries_.size() << " viewpoints and "
+            << viewpoint_graph_motions_.size() << " motions" << std::endl;
+  journal_.reset(new bh::AppendOnlyJournal(options_.journal_sync_batch_size, options_.journal_sync_interval));
+  // Cuts off a torn record at the end
+  journal_->open(filename, valid_size);
+}
+
+void ViewpointPlanner::closeJournal() {
+  if (journal_) {
+    journal_->close();
+    journal_.reset();
+  }
+  journaled_viewpoint_paths_.clear();
+}
+
+bool ViewpointPlanner::hasJournal() const {
+  return static_cast<bool>(journal_);
+}
+
+void ViewpointPlanner::compactJournal(const std::string& viewpoint_graph_filename) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  BH_ASSERT_STR(journal_, "Journal is not open");
+  const std::string filename = journal_->filename();
+  const std::string tmp_filename = getTemporaryFilename(filename);
+  const std::string tmp_viewpoint_graph_filename = getTemporaryFilename(viewpoint_graph_filename);
+  std::cout << "Compacting journal " << filename << " into " << viewpoint_graph_filename << std::endl;
+
+  // The order makes sure that a crash at any point leaves a matching pair of viewpoint graph file and journal:
+  // 1. Write the new viewpoint graph file and a new journal (viewpoint paths only) on top of it next to the old ones.
+  // 2. Atomically replace the viewpoint graph file.
+  // 3. Atomically replace the old journal.
+  // The old journal stays open until the viewpoint graph file is replaced so that it can be restored on failure.
+  journal_->sync();
+  std::unique_ptr<bh::AppendOnlyJournal> old_journal = std::move(journal_);
+  const uint32_t old_viewpoint_graph_checksum = viewpoint_graph_checksum_;
+  const std::vector<std::vector<ViewpointEntryIndex>> old_journaled_viewpoint_paths = journaled_viewpoint_paths_;
+  try {
+    writeViewpointGraphFile(tmp_viewpoint_graph_filename);
+    bh::AppendOnlyJournal::syncFile(tmp_viewpoint_graph_filename);
+    viewpoint_graph_checksum_ = bh::AppendOnlyJournal::computeFileChecksum(tmp_viewpoint_graph_filename);
+    startJournalWithoutLock(tmp_filename);
+    journal_->close();
+    journal_.reset();
+    bh::boostfs::rename(tmp_viewpoint_graph_filename, viewpoint_graph_filename);
+    syncParentDirectory(viewpoint_graph_filename);
+  }
+  catch (...) {
+    journal_ = std::move(old_journal);
+    viewpoint_graph_checksum_ = old_viewpoint_graph_checksum;
+    journaled_viewpoint_paths_ = old_journaled_viewpoint_paths;
+    boost::system::error_code error_code;
+    bh::boostfs::remove(tmp_viewpoint_graph_filename, error_code);
+    bh::boostfs::remove(tmp_filename, error_code);
+    throw;
+  }
+  old_journal->close();
+  old_journal.reset();
+
+  // From here on only the new journal matches the viewpoint graph file. If it cannot be moved into place
+  // it is kept open under the temporary name and recovered by openJournal.
+  std::string new_filename = tmp_filename;
+  try {
+    bh::boostfs::rename(tmp_filename, filename);
+    new_filename = filename;
+    syncParentDirectory(filename);
+  }
+  catch (...) {
+    journal_.reset(new bh::AppendOnlyJournal(options_.journal_sync_batch_size, options_.journal_sync_interval));
+    journal_->open(new_filename, bh::boostfs::file_size(new_filename));
+    throw;
+  }
+  journal_.reset(new bh::AppendOnlyJournal(options_.journal_sync_batch_size, options_.journal_sync_interval));
+  journal_->open(filename, bh::boostfs::file_size(filename));
+}
+
+bool ViewpointPlanner::compactJournalIfNeeded(const std::string& viewpoint_graph_filename) {
+  if (journal_ && journal_->size() > options_.journal_compaction_size) {
+    compactJournal(viewpoint_graph_filename);
+    return true;
+  }
+  return false;
+}
+
+void ViewpointPlanner::journalViewpointPaths() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  journalViewpointPathsWithoutLock();
+}
+
+void ViewpointPlanner::startJournalWithoutLock(const std::string& filename) {
+  journal_.reset(new bh::AppendOnlyJournal(options_.journal_sync_batch_size, options_.journal_sync_interval));
+  journal_->open(filename, 0);
+  const JournalBase base = getJournalBase();
+  journal_->append(JOURNAL_BASE, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+    oa << kJournalVersion;
+    oa << base.viewpoint_graph_checksum;
+    oa << base.bvh_layout_checksum;
+    oa << base.num_real_viewpoints;
+    oa << base.num_viewpoint_entries;
+    oa << base.num_viewpoint_motions;
+    oa << base.exploration_front_size;
+  }));
+  // Viewpoint paths are not part of the viewpoint graph file so they are recorded again
+  journaled_viewpoint_paths_.clear();
+  if (viewpoint_paths_initialized_) {
+    journalViewpointPathsWithoutLock();
+  }
+  journal_->sync();
+}
+
+void ViewpointPlanner::replayJournalWithoutLock(const std::vector<bh::AppendOnlyJournal::Record>& records) {
+  BH_ASSERT(!journal_);
+  bool paths_initialized = viewpoint_paths_initialized_;
+  std::vector<std::vector<ViewpointPathEntry>> path_entries(viewpoint_paths_.size());
+  for (size_t i = 0; i < viewpoint_paths_.size(); ++i) {
+    path_entries[i] = viewpoint_paths_[i].entries;
+  }
+  for (auto it = records.begin() + 1; it != records.end(); ++it) {
+    std::istringstream iss(it->payload);
+    boost::archive::binary_iarchive ia(iss, boost::archive::no_header);
+    switch (it->type) {
+      case JOURNAL_ADD_VIEWPOINT_ENTRY: {
+        Pose pose;
+        ViewpointEntry viewpoint_entry;
+        bool ignore_viewpoint_count_grid;
+        ia >> pose;
+        ia >> viewpoint_entry.total_information;
+        ia >> ignore_viewpoint_count_grid;
+        VoxelWithInformationSetLoader voxel_set_loader(&data_->occupied_bvh_);
+        voxel_set_loader.load(&viewpoint_entry.voxel_set, ia, 0);
+        viewpoint_entry.viewpoint = Viewpoint(&virtual_camera_, pose);
+        addViewpointEntryWithoutLock(std::move(viewpoint_entry), ignore_viewpoint_count_grid);
+        break;
+      }
+      case JOURNAL_ADD_VIEWPOINT_MOTION: {
+        ViewpointMotion motion;
+        ia >> motion;
+        addViewpointMotion(std::move(motion));
+        break;
+      }
+      case JOURNAL_REMOVE_VIEWPOINT_MOTION: {
+        ViewpointEntryIndex from_index;
+        ViewpointEntryIndex to_index;
+        ia >> from_index;
+        ia >> to_index;
+        removeViewpointMotion(from_index, to_index);
+        break;
+      }
+      case JOURNAL_RESET_VIEWPOINT_MOTIONS: {
+        for (const ViewpointEntryIndex index : viewpoint_graph_) {
+          viewpoint_graph_.getEdgesByNode(index).clear();
+        }
+        viewpoint_graph_components_valid_ = false;
+        viewpoint_graph_motions_.clear();
+        break;
+      }
+      case JOURNAL_EXPLORATION_FRONT_PUSH: {
+        ViewpointEntryIndex viewpoint_index;
+        ia >> viewpoint_index;
+        viewpoint_exploration_front_.push_back(viewpoint_index);
+        break;
+      }
+      case JOURNAL_EXPLORATION_FRONT_TAKE: {
+        size_t front_position;
+        ia >> front_position;
+        BH_ASSERT(front_position < viewpoint_exploration_front_.size());
+        using std::swap;
+        swap(viewpoint_exploration_front_[front_position], viewpoint_exploration_front_.back());
+        viewpoint_exploration_front_.pop_back();
+        break;
+      }
+      case JOURNAL_STEREO_VIEWPOINT_PAIR: {
+        ViewpointEntryIndex viewpoint_index;
+        ViewpointEntryIndex stereo_viewpoint_index;
+        ia >> viewpoint_index;
+        ia >> stereo_viewpoint_index;
+        stereo_viewpoint_indices_[viewpoint_index] = stereo_viewpoint_index;
+        stereo_viewpoint_computed_flags_[viewpoint_index] = true;
+        if (!stereo_viewpoint_computed_flags_[stereo_viewpoint_index]) {
+          stereo_viewpoint_indices_[stereo_viewpoint_index] = viewpoint_index;
+          stereo_viewpoint_computed_flags_[stereo_viewpoint_index] = true;
+        }
+        break;
+      }
+      case JOURNAL_VIEWPOINT_PATHS: {
+        size_t num_paths;
+        ia >> num_paths;
+        paths_initialized = false;
+        path_entries.clear();
+        path_entries.resize(num_paths);
+        break;
+      }
+      case JOURNAL_RESET_VIEWPOINT_PATH: {
+        size_t path_index;
+        ia >> path_index;
+        BH_ASSERT(path_index < path_entries.size());
+        path_entries[path_index].clear();
+        break;
+      }
+      case JOURNAL_ADD_VIEWPOINT_PATH_ENTRY: {
+        size_t path_index;
+        ViewpointPathEntry path_entry;
+        ia >> path_index;
+        ia >> path_entry;
+        BH_ASSERT(path_index < path_entries.size());
+        BH_ASSERT(path_entry.viewpoint_index < viewpoint_entries_.size());
+        path_entry.viewpoint = viewpoint_entries_[path_entry.viewpoint_index].viewpoint;
+        path_entries[path_index].push_back(std::move(path_entry));
+        paths_initialized = true;
+        break;
+      }
+      default:
+        throw BH_EXCEPTION(std::string("Unknown journal record type: ") + std::to_string(it->type));
+    }
+  }
+  BH_ASSERT(viewpoint_entries_.size() == viewpoint_graph_.numVertices());
+  BH_ASSERT(viewpoint_graph_.numEdges() == viewpoint_graph_motions_.size());
+
+  // Recompute the viewpoint paths from their entries (same as when loading viewpoint paths)
+  viewpoint_paths_initialized_ = paths_initialized;
+  viewpoint_paths_.clear();
+  viewpoint_paths_data_.clear();
+  viewpoint_paths_.resize(path_entries.size());
+  viewpoint_paths_data_.resize(path_entries.size());
+  if (viewpoint_paths_initialized_) {
+#pragma omp parallel for
+    for (size_t i = 0; i < path_entries.size(); ++i) {
+      ViewpointPath& viewpoint_path = viewpoint_paths_[i];
+      ViewpointPathComputationData& comp_data = viewpoint_paths_data_[i];
+      initializeViewpointPathInformations(&viewpoint_path, &comp_data);
+      for (const ViewpointPathEntry& path_entry : path_entries[i]) {
+        addViewpointPathEntryWithoutLock(&viewpoint_path, &comp_data, path_entry);
+      }
+      updateViewpointPathInformations(&viewpoint_path, &comp_data);
+    }
+  }
+  // The replayed paths are already recorded in the journal
+  journaled_viewpoint_paths_.clear();
+  journaled_viewpoint_paths_.resize(path_entries.size());
+  for (size_t i = 0; i < path_entries.size(); ++i) {
+    for (const ViewpointPathEntry& path_entry : path_entries[i]) {
+      journaled_viewpoint_paths_[i].push_back(path_entry.viewpoint_index);
+    }
+  }
+}
+
+void ViewpointPlanner::journalViewpointEntry(const ViewpointEntry& viewpoint_entry,
+                                             const bool ignore_viewpoint_count_grid) {
+  if (!journal_) {
+    return;
+  }
+  const VoxelWithInformationSetSaver voxel_set_saver(data_->occupied_bvh_);
+  journal_->append(JOURNAL_ADD_VIEWPOINT_ENTRY, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+    oa << viewpoint_entry.viewpoint.pose();
+    oa << viewpoint_entry.total_information;
+    oa << ignore_viewpoint_count_grid;
+    voxel_set_saver.save(viewpoint_entry.voxel_set, oa, 0);
+  }));
+}
+
+void ViewpointPlanner::journalViewpointMotion(const ViewpointMotion& motion) {
+  if (!journal_) {
+    return;
+  }
+  journal_->append(JOURNAL_ADD_VIEWPOINT_MOTION, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+    oa << motion;
+  }));
+}
+
+void ViewpointPlanner::journalViewpointMotionRemoval(const ViewpointEntryIndex from_index,
+                                                     const ViewpointEntryIndex to_index) {
+  if (!journal_) {
+    return;
+  }
+  journal_->append(JOURNAL_REMOVE_VIEWPOINT_MOTION, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+    oa << from_index;
+    oa << to_index;
+  }));
+}
+
+void ViewpointPlanner::journalViewpointMotionsReset() {
+  if (!journal_) {
+    return;
+  }
+  journal_->append(JOURNAL_RESET_VIEWPOINT_MOTIONS, std::string());
+}
+
+void ViewpointPlanner::journalExplorationFrontPush(const ViewpointEntryIndex viewpoint_index) {
+  if (!journal_) {
+    return;
+  }
+  journal_->append(JOURNAL_EXPLORATION_FRONT_PUSH, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+    oa << viewpoint_index;
+  }));
+}
+
+void ViewpointPlanner::journalExplorationFrontTake(const size_t front_position) {
+  if (!journal_) {
+    return;
+  }
+  journal_->append(JOURNAL_EXPLORATION_FRONT_TAKE, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+    oa << front_position;
+  }));
+}
+
+void ViewpointPlanner::journalStereoViewpointPair(const ViewpointEntryIndex viewpoint_index,
+                                                  const ViewpointEntryIndex stereo_viewpoint_index) {
+  if (!journal_) {
+    return;
+  }
+  journal_->append(JOURNAL_STEREO_VIEWPOINT_PAIR, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+    oa << viewpoint_index;
+    oa << stereo_viewpoint_index;
+  }));
+}
+
+void ViewpointPlanner::journalViewpointPathsReset() {
+  if (!journal_) {
+    return;
+  }
+  // Records the empty paths
+  journaled_viewpoint_paths_.clear();
+  journalViewpointPathsWithoutLock();
+}
+
+void ViewpointPlanner::journalViewpointPathsWithoutLock() {
+  if (!journal_) {
+    return;
+  }
+  if (journaled_viewpoint_paths_.size() != viewpoint_paths_.size()) {
+    journaled_viewpoint_paths_.clear();
+    journaled_viewpoint_paths_.resize(viewpoint_paths_.size());
+    journal_->append(JOURNAL_VIEWPOINT_PATHS, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+      oa << viewpoint_paths_.size();
+    }));
+  }
+  // Paths usually only grow so only the new entries are recorded.
+  // If a recorded entry was removed or replaced the whole path is recorded again.
+  for (size_t i = 0; i < viewpoint_paths_.size(); ++i) {
+    const ViewpointPath& viewpoint_path = viewpoint_paths_[i];
+    std::vector<ViewpointEntryIndex>& journaled_indices = journaled_viewpoint_paths_[i];
+    bool is_prefix = journaled_indices.size() <= viewpoint_path.entries.size();
+    for (size_t j = 0; is_prefix && j < journaled_indices.size(); ++j) {
+      is_prefix = journaled_indices[j] == viewpoint_path.entries[j].viewpoint_index;
+    }
+    if (!is_prefix) {
+      journal_->append(JOURNAL_RESET_VIEWPOINT_PATH, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+        oa << i;
+      }));
+      journaled_indices.clear();
+    }
+    for (size_t j = journaled_indices.size(); j < viewpoint_path.entries.size(); ++j) {
+      const ViewpointPathEntry& path_entry = viewpoint_path.entries[j];
+      journal_->append(JOURNAL_ADD_VIEWPOINT_PATH_ENTRY, writeJournalPayload([&](boost::archive::binary_oarchive& oa) {
+        oa << i;
+        oa << path_entry;
+      }));
+      journaled_indices.push_back(path_entry.viewpoint_index);
+    }
+  }
+}
@@ -45,6 +45,7 @@ void ViewpointPlanner::addViewpointMotion(ViewpointMotion&& motion) {
   }
   const ViewpointEntryIndex from_index = motion.fromIndex();
   const ViewpointEntryIndex to_index = motion.toIndex();
+  journalViewpointMotion(motion);
 #if !BH_RELEASE
   BH_ASSERT(from_index < to_index);
   BH_ASSERT(motion.se3Motions().front().poses().front() == viewpoint_entries_[from_index].viewpoint.pose());
@@ -52,6 +53,7 @@ void ViewpointPlanner::addViewpointMotion(ViewpointMotion&& motion) {
 #endif
   // Currently graph is unidirectional so edges are automatically symmetric.
   const FloatType distance = motion.distance();
+  removeLazyViewpointMotion(from_index, to_index);
   viewpoint_graph_.addEdgeByNode(from_index, to_index, distance);
   viewpoint_graph_components_valid_ = false;
   const ViewpointIndexPair vip(from_index, to_index);
@@ -77,6 +79,7 @@ bool ViewpointPlanner::removeViewpointMotion(const ViewpointEntryIndex from_inde
     return false;
   }
   viewpoint_graph_motions_.erase(it);
+  journalViewpointMotionRemoval(from_index, to_index);
   const ViewpointGraph::Vertex from_vertex = viewpoint_graph_.getVertexByNode(from_index);
   const ViewpointGraph::Vertex to_vertex = viewpoint_graph_.getVertexByNode(to_index);
   boost::remove_edge(from_vertex, to_vertex, viewpoint_graph_.boostGraph());
@@ -96,6 +99,17 @@ void ViewpointPlanner::removeViewpointMotions(const ViewpointEntryIndex index) {
 }
 
 void ViewpointPlanner::computeViewpointMotions() {
+  if (options_.viewpoint_motion_lazy) {
+    std::cout << "Adding candidate motions to lazy viewpoint graph" << std::endl;
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t num_candidates = 0;
+    for (auto it = viewpoint_graph_.begin(); it != viewpoint_graph_.end(); ++it) {
+      num_candidates += addLazyViewpointMotions(it.node());
+    }
+    lock.unlock();
+    std::cout << "Added " << num_candidates << " candidate motions. Motions are validated when they are used." << std::endl;
+    return;
+  }
   std::cout << "Computing motions on viewpoint graph" << std::endl;
   for (auto it = viewpoint_graph_.begin(); it != viewpoint_graph_.end(); ++it) {
     const ViewpointEntryIndex from_index = it.node();
@@ -165,6 +179,14 @@ void ViewpointPlanner::computeViewpointMotions() {
 }
 
 size_t ViewpointPlanner::computeViewpointMotions(const ViewpointEntryIndex from_index, const bool verbose /*= false*/) {
+  if (options_.viewpoint_motion_lazy) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const size_t num_candidates = addLazyViewpointMotions(from_index);
+    if (verbose) {
+      std::cout << "Added " << num_candidates << " candidate motions from viewpoint " << from_index << std::endl;
+    }
+    return num_candidates;
+  }
   std::vector<ViewpointPlanner::ViewpointMotion> motions = findViewpointMotions(from_index, verbose);
   if (verbose) {
     std::cout << "Found " << motions.size() << " connections from viewpoint " << from_index << std::endl;
@@ -179,6 +201,84 @@ size_t ViewpointPlanner::computeViewpointMotions(const ViewpointEntryIndex from_
   return motions.size();
 }
 
+size_t ViewpointPlanner::addLazyViewpointMotions(const ViewpointEntryIndex from_index) {
+  const bool ignore_no_fly_zones = true;
+  const ViewpointEntry& from_viewpoint = viewpoint_entries_[from_index];
+  if (!isValidObjectPosition(from_viewpoint.viewpoint.pose().getWorldPosition(), drone_bbox_, ignore_no_fly_zones)) {
+    return 0;
+  }
+  if (lazy_viewpoint_motions_.size() < viewpoint_entries_.size()) {
+    lazy_viewpoint_motions_.resize(viewpoint_entries_.size());
+  }
+  // Only the cheap checks of findViewpointMotions() are done here.
+  // Sparse matching and motion planning are deferred to validateLazyViewpointMotion().
+  const std::size_t dist_knn = options_.viewpoint_motion_max_neighbors;
+  const FloatType max_dist_square = options_.viewpoint_motion_max_dist_square;
+  std::vector<ViewpointANN::IndexType> knn_indices(dist_knn);
+  std::vector<ViewpointANN::DistanceType> knn_distances(dist_knn);
+  viewpoint_ann_.knnSearch(from_viewpoint.viewpoint.pose().getWorldPosition(), dist_knn, &knn_indices, &knn_distances);
+  size_t num_candidates = 0;
+  for (std::size_t i = 0; i < knn_indices.size(); ++i) {
+    const ViewpointEntryIndex to_index = knn_indices[i];
+    if (from_index == to_index || knn_distances[i] > max_dist_square) {
+      continue;
+    }
+    if (hasViewpointMotion(from_index, to_index)
+        || invalid_viewpoint_motions_.count(ViewpointIndexPair(from_index, to_index)) > 0) {
+      continue;
+    }
+    const ViewpointEntry& to_viewpoint = viewpoint_entries_[to_index];
+    if (!isValidObjectPosition(to_viewpoint.viewpoint.pose().getWorldPosition(), drone_bbox_, ignore_no_fly_zones)) {
+      continue;
+    }
+    std::vector<ViewpointEntryIndex>& from_candidates = lazy_viewpoint_motions_[from_index];
+    if (std::find(from_candidates.begin(), from_candidates.end(), to_index) != from_candidates.end()) {
+      continue;
+    }
+    from_candidates.push_back(to_index);
+    lazy_viewpoint_motions_[to_index].push_back(from_index);
+    ++num_candidates;
+  }
+  if (num_candidates > 0) {
+    viewpoint_graph_components_valid_ = false;
+  }
+  return num_candidates;
+}
+
+bool ViewpointPlanner::removeLazyViewpointMotion(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index) {
+  if (from_index >= lazy_viewpoint_motions_.size() || to_index >= lazy_viewpoint_motions_.size()) {
+    return false;
+  }
+  std::vector<ViewpointEntryIndex>& from_candidates = lazy_viewpoint_motions_[from_index];
+  const auto it = std::find(from_candidates.begin(), from_candidates.end(), to_index);
+  if (it == from_candidates.end()) {
+    return false;
+  }
+  from_candidates.erase(it);
+  std::vector<ViewpointEntryIndex>& to_candidates = lazy_viewpoint_motions_[to_index];
+  to_candidates.erase(std::find(to_candidates.begin(), to_candidates.end(), from_index));
+  viewpoint_graph_components_valid_ = false;
+  return true;
+}
+
+bool ViewpointPlanner::validateLazyViewpointMotion(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index) {
+  removeLazyViewpointMotion(from_index, to_index);
+  const ViewpointEntry& from_viewpoint = viewpoint_entries_[from_index];
+  const ViewpointEntry& to_viewpoint = viewpoint_entries_[to_index];
+  if (isSparseMatchable2(from_index, to_index)) {
+    SE3Motion se3_motion;
+    bool found_motion;
+    std::tie(se3_motion, found_motion) = motion_planner_.findMotion(
+            from_viewpoint.viewpoint.pose(), to_viewpoint.viewpoint.pose());
+    if (found_motion) {
+      addViewpointMotion(ViewpointMotion({ from_index, to_index }, { se3_motion }));
+      return true;
+    }
+  }
+  invalid_viewpoint_motions_.emplace(from_index, to_index);
+  return false;
+}
+
 std::vector<std::pair<ViewpointPlanner::ViewpointEntryIndex, ViewpointPlanner::SE3Motion>>
 ViewpointPlanner::findSE3Motions(const Pose& from_pose) {
   const bool ignore_no_fly_zones = true;
@@ -189,10 +289,8 @@ ViewpointPlanner::findSE3Motions(const Pose& from_pose) {
   // Find motion to other viewpoints in the graph
   const std::size_t dist_knn = options_.viewpoint_motion_max_neighbors;
   const FloatType max_dist_square = options_.viewpoint_motion_max_dist_square;
-  static std::vector<ViewpointANN::IndexType> knn_indices;
-  static std::vector<ViewpointANN::DistanceType> knn_distances;
-  knn_indices.resize(dist_knn);
-  knn_distances.resize(dist_knn);
+  std::vector<ViewpointANN::IndexType> knn_indices;
+  std::vector<ViewpointANN::DistanceType> knn_distances;
   viewpoint_ann_.knnSearch(from_pose.getWorldPosition(), dist_knn, &knn_indices, &knn_distances);
   std::size_t num_connections = 0;
   std::vector<std::pair<ViewpointEntryIndex, SE3Motion>> se3_motions;
@@ -289,10 +387,8 @@ ViewpointPlanner::findViewpointMotions(const ViewpointEntryIndex from_index,cons
   // Find motion to other viewpoints in the graph
   const std::size_t dist_knn = options_.viewpoint_motion_max_neighbors;
   const FloatType max_dist_square = options_.viewpoint_motion_max_dist_square;
-  static std::vector<ViewpointANN::IndexType> knn_indices;
-  static std::vector<ViewpointANN::DistanceType> knn_distances;
-  knn_indices.resize(dist_knn);
-  knn_distances.resize(dist_knn);
+  std::vector<ViewpointANN::IndexType> knn_indices;
+  std::vector<ViewpointANN::DistanceType> knn_distances;
   viewpoint_ann_.knnSearch(from_viewpoint.viewpoint.pose().getWorldPosition(), dist_knn, &knn_indices, &knn_distances);
   std::size_t num_connections = 0;
   std::vector<ViewpointMotion> motions;
@@ -415,6 +511,60 @@ struct ViewpointGraphVertexFloatCompare {
 
 ViewpointPlanner::ViewpointMotion ViewpointPlanner::findShortestMotionAStar(
         const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index) const {
+  const bool use_lazy_motions = false;
+  const std::vector<ViewpointEntryIndex> viewpoint_indices =
+          findShortestViewpointSequenceAStar(from_index, to_index, use_lazy_motions);
+  if (viewpoint_indices.empty()) {
+    return ViewpointMotion();
+  }
+  return concatenateViewpointMotions(viewpoint_indices);
+}
+
+ViewpointPlanner::ViewpointMotion ViewpointPlanner::findShortestMotionLazyAStar(
+        const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index) {
+  const bool verbose = false;
+  const bool use_lazy_motions = true;
+  // Search with optimistic costs for candidate motions and validate the candidate motions on the shortest path
+  // until the shortest path consists only of validated motions (LazySP).
+  while (true) {
+    const std::vector<ViewpointEntryIndex> viewpoint_indices =
+            findShortestViewpointSequenceAStar(from_index, to_index, use_lazy_motions);
+    if (viewpoint_indices.empty()) {
+      return ViewpointMotion();
+    }
+    bool all_motions_validated = true;
+    for (auto it = viewpoint_indices.begin() + 1; it != viewpoint_indices.end(); ++it) {
+      if (hasViewpointMotion(*(it - 1), *it)) {
+        continue;
+      }
+      all_motions_validated = false;
+      const bool valid = validateLazyViewpointMotion(*(it - 1), *it);
+      if (verbose) {
+        std::cout << "Validated lazy motion from " << *(it - 1) << " to " << *it << ": " << valid << std::endl;
+      }
+      if (!valid) {
+        break;
+      }
+    }
+    if (all_motions_validated) {
+      return concatenateViewpointMotions(viewpoint_indices);
+    }
+  }
+}
+
+ViewpointPlanner::ViewpointMotion ViewpointPlanner::concatenateViewpointMotions(
+        const std::vector<ViewpointEntryIndex>& viewpoint_indices) const {
+  ViewpointMotion motion;
+  for (auto it = viewpoint_indices.begin() + 1; it != viewpoint_indices.end(); ++it) {
+    const ViewpointMotion sub_motion = getViewpointMotion(*(it - 1), *it);
+    motion.append(sub_motion);
+  }
+  return motion;
+}
+
+std::vector<ViewpointPlanner::ViewpointEntryIndex> ViewpointPlanner::findShortestViewpointSequenceAStar(
+        const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index,
+        const bool use_lazy_motions) const {
   const bool verbose = false;
 
   ViewpointGraph::Vertex start = viewpoint_graph_.getVertexByNode(from_index);
@@ -464,13 +614,11 @@ ViewpointPlanner::ViewpointMotion ViewpointPlanner::findShortestMotionAStar(
       found_goal = true;
       break;
     }
-    const ViewpointGraph::ConstOutEdgesWrapper out_edges = viewpoint_graph_.getEdges(current_vertex);
-    for (auto it = out_edges.begin(); it != out_edges.end(); ++it) {
-      const ViewpointGraph::Vertex new_vertex = it.target();
+    const auto relax_edge_lambda = [&] (const ViewpointGraph::Vertex new_vertex, const FloatType edge_weight) {
       if (processed_flags[new_vertex]) {
-        continue;
+        return;
       }
-      const FloatType weight = it.weight() * it.weight();
+      const FloatType weight = edge_weight * edge_weight;
       const FloatType new_distance = current_distance + weight + options_.viewpoint_motion_penalty_per_graph_vertex;
       if (new_distance < distances[new_vertex]) {
         distances[new_vertex] = new_distance;
@@ -487,6 +635,18 @@ ViewpointPlanner::ViewpointMotion ViewpointPlanner::findShortestMotionAStar(
           pq_handles[new_vertex] = handle;
         }
       }
+    };
+    const ViewpointGraph::ConstOutEdgesWrapper out_edges = viewpoint_graph_.getEdges(current_vertex);
+    for (auto it = out_edges.begin(); it != out_edges.end(); ++it) {
+      relax_edge_lambda(it.target(), it.weight());
+    }
+    if (use_lazy_motions && current_vertex < lazy_viewpoint_motions_.size()) {
+      // Candidate motions have the straight line distance as an optimistic cost
+      const Vector3 current_position = viewpoint_entries_[current_vertex].viewpoint.pose().getWorldPosition();
+      for (const ViewpointEntryIndex other_index : lazy_viewpoint_motions_[current_vertex]) {
+        const Vector3 other_position = viewpoint_entries_[other_index].viewpoint.pose().getWorldPosition();
+        relax_edge_lambda(viewpoint_graph_.getVertexByNode(other_index), (other_position - current_position).norm());
+      }
     }
   }
 
@@ -519,11 +679,6 @@ ViewpointPlanner::ViewpointMotion ViewpointPlanner::findShortestMotionAStar(
     std::vector<ViewpointEntryIndex> viewpoint_indices;
     viewpoint_indices.reserve(reverse_viewpoint_indices.size());
     std::copy(reverse_viewpoint_indices.rbegin(), reverse_viewpoint_indices.rend(), std::back_inserter(viewpoint_indices));
-    ViewpointMotion motion;
-    for (auto it = viewpoint_indices.begin() + 1; it != viewpoint_indices.end(); ++it) {
-      const ViewpointMotion sub_motion = getViewpointMotion(*(it - 1), *it);
-      motion.append(sub_motion);
-    }
 
 //    // Densify viewpoint graph motions (add all shortest paths that were found to the graph)
 //    for (auto from_it = viewpoint_indices.begin(); from_it != viewpoint_indices.end(); ++from_it) {
@@ -550,13 +705,13 @@ ViewpointPlanner::ViewpointMotion ViewpointPlanner::findShortestMotionAStar(
 //      }
 //    }
 
-    return motion;
+    return viewpoint_indices;
   }
   else {
     if (verbose) {
       std::cout << "Could not find a motion from " << from_index << " to " << to_index << std::endl;
     }
-    return ViewpointMotion();
+    return std::vector<ViewpointEntryIndex>();
   }
 }
 
@@ -777,7 +932,9 @@ ViewpointPlanner::ViewpointMotion ViewpointPlanner::optimizeViewpointMotion(cons
 bool ViewpointPlanner::findAndAddShortestMotion(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index) {
   const bool verbose = false;
 
-  const ViewpointMotion motion = findShortestMotionAStar(from_index, to_index);
+  const ViewpointMotion motion = options_.viewpoint_motion_lazy
+                                 ? findShortestMotionLazyAStar(from_index, to_index)
+                                 : findShortestMotionAStar(from_index, to_index);
   if (motion.isValid()) {
     const ViewpointMotion optimized_motion = optimizeViewpointMotion(motion);
     if (verbose) {
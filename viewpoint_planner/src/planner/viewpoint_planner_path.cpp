@@ -659,6 +659,7 @@ ViewpointPlanner::NextViewpointPathEntryStatus ViewpointPlanner::findNextViewpoi
       status = result.status;
     }
   }
+  journalViewpointPaths();
   reportViewpointPathsStats();
 
   std::cout << "changes=" << changes << ", alpha=" << alpha << ", beta=" << beta << std::endl;
@@ -765,6 +766,7 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::getMatchingStereoViewpoi
             ignore_sparse_matching,
             ignore_graph_component);
     if (found_stereo_viewpoint) {
+      journalStereoViewpointPair(viewpoint_index, stereo_viewpoint_index);
       stereo_viewpoint_indices_[viewpoint_index] = stereo_viewpoint_index;
       stereo_viewpoint_computed_flags_[viewpoint_index] = true;
       if (!stereo_viewpoint_computed_flags_[stereo_viewpoint_index]) {
@@ -858,10 +860,8 @@ std::pair<bool, ViewpointPlanner::ViewpointEntryIndex> ViewpointPlanner::findMat
     // Find viewpoint in baseline range with highest information overlap for same viewing direction
     // TODO: Should use a radius search
     const std::size_t knn = options_.triangulation_knn;
-    static std::vector<ViewpointANN::IndexType> knn_indices;
-    static std::vector<ViewpointANN::DistanceType> knn_distances;
-    knn_indices.resize(knn);
-    knn_distances.resize(knn);
+    std::vector<ViewpointANN::IndexType> knn_indices;
+    std::vector<ViewpointANN::DistanceType> knn_distances;
     viewpoint_ann_.knnSearch(pose.getWorldPosition(), knn, &knn_indices, &knn_distances);
     for (ViewpointANN::IndexType other_index : knn_indices) {
       if (!ignore_graph_component && component[other_index] != component[viewpoint_index]) {
@@ -1304,6 +1304,18 @@ auto ViewpointPlanner::findNextViewpointPathEntry(
     return result;
   }
 
+  // Connected components of the lazy viewpoint graph are optimistic. Validate the connection to the path
+  // before accepting the viewpoint. Otherwise the path might not be connectable later on.
+  if (options_.viewpoint_motion_lazy && !viewpoint_path->entries.empty()
+      && !connectViewpoints(viewpoint_path->entries.front().viewpoint_index, best_path_entry.viewpoint_index)) {
+    if (verbose) {
+      std::cout << "Selected viewpoint cannot be reached from the viewpoint path. Invalidating: " << best_path_entry.viewpoint_index << std::endl;
+    }
+    std::get<2>(*comp_data->sorted_new_informations.rbegin()) = false;
+    result.status = NO_VALID_PATH_ENTRY;
+    return result;
+  }
+
   ViewpointEntryIndex stereo_viewpoint_index = (ViewpointEntryIndex)-1;
   bool stereo_viewpoint_already_in_path = false;
   if (options_.viewpoint_generate_stereo_pairs) {
@@ -1352,6 +1364,15 @@ auto ViewpointPlanner::findNextViewpointPathEntry(
       result.status = NO_VALID_PATH_ENTRY;
       return result;
     }
+    if (options_.viewpoint_motion_lazy && !stereo_viewpoint_already_in_path
+        && !connectViewpoints(best_path_entry.viewpoint_index, stereo_viewpoint_index)) {
+      if (verbose) {
+        std::cout << "Matched stereo viewpoint cannot be reached. Invalidating: " << best_path_entry.viewpoint_index << std::endl;
+      }
+      std::get<2>(*comp_data->sorted_new_informations.rbegin()) = false;
+      result.status = NO_VALID_PATH_ENTRY;
+      return result;
+    }
   }
 
   // Mark viewpoint as invalid to prevent use in the future
@@ -15,28 +15,44 @@ std::pair<bool, ViewpointPlanner::Pose> ViewpointPlanner::samplePose(
   return samplePose(pose_sample_bbox_, drone_bbox_, max_trials, biased_orientation);
 }
 
-std::pair<bool, ViewpointPlanner::Pose> ViewpointPlanner::samplePose(const BoundingBoxType& bbox,
-    const BoundingBoxType& object_bbox, std::size_t max_trials /*= (std::size_t)-1*/,
-    const bool biased_orientation /*=true*/) const {
-  if (max_trials == (std::size_t)-1) {
-    max_trials = options_.pose_sample_num_trials;
-  }
-  std::pair<bool, ViewpointPlanner::Vector3> pos_result = samplePosition(bbox, object_bbox, max_trials);
+template <typename RandomT>
+std::pair<bool, ViewpointPlanner::Pose> ViewpointPlanner::samplePoseWithRandom(RandomT& random,
+    const BoundingBoxType& bbox, const BoundingBoxType& object_bbox,
+    const std::size_t max_trials, const bool biased_orientation) const {
+  std::pair<bool, ViewpointPlanner::Vector3> pos_result = samplePositionWithRandom(random, bbox, object_bbox, max_trials);
   if (!pos_result.first) {
     return std::make_pair(false, Pose());
   }
   const Pose::Vector3 pos = pos_result.second.cast<Pose::Vector3::Scalar>();
   Pose::Quaternion orientation;
   if (biased_orientation) {
-    orientation = sampleBiasedOrientation(pos, data_->roi_bbox_);
+    orientation = sampleBiasedOrientationWithRandom(random, pos, data_->roi_bbox_);
   }
   else {
-    orientation = sampleOrientation();
+    orientation = sampleOrientationWithRandom(random);
   }
   Pose pose = Pose::createFromImageToWorldTransformation(pos, orientation);
   return std::make_pair(true, pose);
 }
 
+std::pair<bool, ViewpointPlanner::Pose> ViewpointPlanner::samplePose(const BoundingBoxType& bbox,
+    const BoundingBoxType& object_bbox, std::size_t max_trials /*= (std::size_t)-1*/,
+    const bool biased_orientation /*=true*/) const {
+  if (max_trials == (std::size_t)-1) {
+    max_trials = options_.pose_sample_num_trials;
+  }
+  return samplePoseWithRandom(random_, bbox, object_bbox, max_trials, biased_orientation);
+}
+
+std::pair<bool, ViewpointPlanner::Pose> ViewpointPlanner::samplePose(bh::RandomStream<FloatType>& random,
+    const BoundingBoxType& bbox, const BoundingBoxType& object_bbox, std::size_t max_trials /*= (std::size_t)-1*/,
+    const bool biased_orientation /*=true*/) const {
+  if (max_trials == (std::size_t)-1) {
+    max_trials = options_.pose_sample_num_trials;
+  }
+  return samplePoseWithRandom(random, bbox, object_bbox, max_trials, biased_orientation);
+}
+
 std::pair<bool, ViewpointPlanner::Pose> ViewpointPlanner::samplePose(const RegionType& region,
     const BoundingBoxType& object_bbox, std::size_t max_trials /*= (std::size_t)-1*/,
     const bool biased_orientation /*=true*/) const {
@@ -60,6 +76,11 @@ std::pair<bool, ViewpointPlanner::Pose> ViewpointPlanner::samplePose(const Regio
 }
 
 ViewpointPlanner::Pose::Quaternion ViewpointPlanner::sampleOrientation() const {
+  return sampleOrientationWithRandom(random_);
+}
+
+template <typename RandomT>
+ViewpointPlanner::Pose::Quaternion ViewpointPlanner::sampleOrientationWithRandom(RandomT& random) const {
   // We just sample from the lower sphere
 //    using Scalar = Pose::Quaternion::Scalar;
 //    Pose::Quaternion orientation = Pose::Quaternion::UnitRandom();
@@ -68,8 +89,8 @@ ViewpointPlanner::Pose::Quaternion ViewpointPlanner::sampleOrientation() const {
 //    Scalar yaw = euler_angles(0);
 //    Scalar pitch = euler_angles(1);
 //    Scalar roll = euler_angles(2);
-  FloatType z = random_.sampleUniform(-1, 0);
-  FloatType theta = random_.sampleUniform(-M_PI, +M_PI);
+  FloatType z = random.sampleUniform(-1, 0);
+  FloatType theta = random.sampleUniform(-M_PI, +M_PI);
   FloatType x = std::sin(theta) * std::sqrt(1 - z*z);
   FloatType y = std::cos(theta) * std::sqrt(1 - z*z);
   Pose::Vector3 z_axis(0, 0, 1);
@@ -90,11 +111,22 @@ ViewpointPlanner::Pose::Quaternion ViewpointPlanner::sampleOrientation() const {
 }
 
 ViewpointPlanner::Pose::Quaternion ViewpointPlanner::sampleBiasedOrientation(const Vector3& pos, const BoundingBoxType& bias_bbox) const {
+  return sampleBiasedOrientationWithRandom(random_, pos, bias_bbox);
+}
+
+ViewpointPlanner::Pose::Quaternion ViewpointPlanner::sampleBiasedOrientation(const Vector3& pos, const BoundingBoxType& bias_bbox,
+    bh::RandomStream<FloatType>& random) const {
+  return sampleBiasedOrientationWithRandom(random, pos, bias_bbox);
+}
+
+template <typename RandomT>
+ViewpointPlanner::Pose::Quaternion ViewpointPlanner::sampleBiasedOrientationWithRandom(
+    RandomT& random, const Vector3& pos, const BoundingBoxType& bias_bbox) const {
   const FloatType dist = (pos - bias_bbox.getCenter()).norm();
   const FloatType bbox_fov_angle = std::atan(bias_bbox.getMaxExtent() / (2 * dist));
   const FloatType angle_stddev = bh::clamp<FloatType>(bbox_fov_angle, 0, M_PI / 2);
-  FloatType angle1 = random_.sampleNormal(0, angle_stddev);
-  FloatType angle2 = random_.sampleNormal(0, angle_stddev);
+  FloatType angle1 = random.sampleNormal(0, angle_stddev);
+  FloatType angle2 = random.sampleNormal(0, angle_stddev);
   Vector3 bbox_direction = (bias_bbox.getCenter() - pos).normalized();
   angle1 = bh::wrapRadiansToMinusPiAndPi(angle1);
   angle2 = bh::wrapRadiansToMinusPiAndPi(angle2);
@@ -147,11 +179,17 @@ std::pair<bool, ViewpointPlanner::Vector3> ViewpointPlanner::samplePosition(cons
   if (max_trials == (std::size_t)-1) {
     max_trials = options_.pose_sample_num_trials;
   }
+  return samplePositionWithRandom(random_, bbox, object_bbox, max_trials);
+}
+
+template <typename RandomT>
+std::pair<bool, ViewpointPlanner::Vector3> ViewpointPlanner::samplePositionWithRandom(RandomT& random,
+    const BoundingBoxType& bbox, const BoundingBoxType& object_bbox, const std::size_t max_trials) const {
   for (size_t i = 0; i < max_trials; ++i) {
     Vector3 pos(
-        random_.sampleUniform(bbox.getMinimum(0), bbox.getMaximum(0)),
-        random_.sampleUniform(bbox.getMinimum(1), bbox.getMaximum(1)),
-        random_.sampleUniform(bbox.getMinimum(2), bbox.getMaximum(2)));
+        random.sampleUniform(bbox.getMinimum(0), bbox.getMaximum(0)),
+        random.sampleUniform(bbox.getMinimum(1), bbox.getMaximum(1)),
+        random.sampleUniform(bbox.getMinimum(2), bbox.getMaximum(2)));
     const bool valid = isValidObjectPosition(pos, object_bbox);
     if (valid) {
       return std::make_pair(true, pos);
@@ -182,11 +220,22 @@ std::pair<bool, ViewpointPlanner::Vector3> ViewpointPlanner::samplePosition(cons
 
 std::pair<bool, ViewpointPlanner::Pose>
 ViewpointPlanner::sampleSurroundingPose(const Pose& pose) const {
+  return sampleSurroundingPoseWithRandom(random_, pose);
+}
+
+std::pair<bool, ViewpointPlanner::Pose>
+ViewpointPlanner::sampleSurroundingPose(const Pose& pose, bh::RandomStream<FloatType>& random) const {
+  return sampleSurroundingPoseWithRandom(random, pose);
+}
+
+template <typename RandomT>
+std::pair<bool, ViewpointPlanner::Pose>
+ViewpointPlanner::sampleSurroundingPoseWithRandom(RandomT& random, const Pose& pose) const {
   // Sample position from sphere around pose
   Vector3 sampled_pos;
   bool found_position = false;
   for (size_t i = 0; i < options_.pose_sample_num_trials; ++i) {
-    random_.sampleSphericalShell(options_.pose_sample_min_radius, options_.pose_sample_max_radius, &sampled_pos);
+    random.sampleSphericalShell(options_.pose_sample_min_radius, options_.pose_sample_max_radius, &sampled_pos);
     sampled_pos += pose.getWorldPosition();
     if (pose_sample_bbox_.isInside(sampled_pos)
         && isValidObjectPosition(sampled_pos, drone_bbox_)) {
@@ -197,7 +246,7 @@ ViewpointPlanner::sampleSurroundingPose(const Pose& pose) const {
   if (!found_position) {
     return std::make_pair(false, Pose());
   }
-  Pose::Quaternion sampled_orientation = sampleBiasedOrientation(sampled_pos, data_->roi_bbox_);
+  Pose::Quaternion sampled_orientation = sampleBiasedOrientationWithRandom(random, sampled_pos, data_->roi_bbox_);
   Pose sampled_pose = Pose::createFromImageToWorldTransformation(sampled_pos, sampled_orientation);
   return std::make_pair(true, sampled_pose);
 }
@@ -9,21 +9,58 @@
 #include "viewpoint_planner.h"
 #include "viewpoint_planner_serialization.h"
 #include <boost/serialization/deque.hpp>
+#include <bh/filesystem.h>
+
+namespace {
+// Viewpoint graph files start with this marker followed by the format version and the layout checksum of the
+// BVH tree. Viewpoint entries refer to voxels by their BVH node index. Older files start with the number of real
+// viewpoints.
+const std::size_t kViewpointGraphMarker = 0x5650475241504853ull;
+const uint32_t kViewpointGraphVersion = 1;
+}
 
 void ViewpointPlanner::saveViewpointGraph(const std::string& filename) const {
+  // Write next to the old file so that it is kept if writing fails
+  const std::string tmp_filename = filename + ".tmp";
+  try {
+    writeViewpointGraphFile(tmp_filename);
+    bh::AppendOnlyJournal::syncFile(tmp_filename);
+    bh::boostfs::rename(tmp_filename, filename);
+  }
+  catch (...) {
+    boost::system::error_code error_code;
+    bh::boostfs::remove(tmp_filename, error_code);
+    throw;
+  }
+}
+
+void ViewpointPlanner::writeViewpointGraphFile(const std::string& filename) const {
   std::cout << "Writing viewpoint graph to " << filename << std::endl;
   std::cout << "Graph has " << viewpoint_graph_.numVertices() << " viewpoints"
       << " and " << viewpoint_graph_.numEdges() << " motions" << std::endl;
-  std::ofstream ofs(filename);
-  boost::archive::binary_oarchive oa(ofs);
-  ViewpointEntrySaver ves(viewpoint_entries_, data_->occupied_bvh_);
-  oa << num_real_viewpoints_;
-  oa << ves;
-  oa << stereo_viewpoint_indices_;
-  oa << stereo_viewpoint_computed_flags_;
-  oa << viewpoint_exploration_front_;
-  oa << viewpoint_graph_;
-  oa << viewpoint_graph_motions_;
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs) {
+    throw BH_EXCEPTION(std::string("Unable to open file for writing: ") + filename);
+  }
+  {
+    boost::archive::binary_oarchive oa(ofs);
+    ViewpointEntrySaver ves(viewpoint_entries_, data_->occupied_bvh_);
+    const uint32_t bvh_layout_checksum = data_->occupied_bvh_.computeLayoutChecksum();
+    oa << kViewpointGraphMarker;
+    oa << kViewpointGraphVersion;
+    oa << bvh_layout_checksum;
+    oa << num_real_viewpoints_;
+    oa << ves;
+    oa << stereo_viewpoint_indices_;
+    oa << stereo_viewpoint_computed_flags_;
+    oa << viewpoint_exploration_front_;
+    oa << viewpoint_graph_;
+    oa << viewpoint_graph_motions_;
+  }
+  ofs.flush();
+  if (!ofs) {
+    throw BH_EXCEPTION(std::string("Unable to write viewpoint graph file: ") + filename);
+  }
   std::cout << "Done" << std::endl;
 }
 
@@ -33,7 +70,27 @@ void ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
   std::ifstream ifs(filename);
   boost::archive::binary_iarchive ia(ifs);
   std::size_t new_num_real_viewpoints;
-  ia >> new_num_real_viewpoints;
+  std::size_t marker;
+  ia >> marker;
+  if (marker == kViewpointGraphMarker) {
+    uint32_t version;
+    ia >> version;
+    if (version != kViewpointGraphVersion) {
+      throw BH_EXCEPTION(std::string("Unsupported viewpoint graph version: ") + std::to_string(version));
+    }
+    uint32_t bvh_layout_checksum;
+    ia >> bvh_layout_checksum;
+    if (bvh_layout_checksum != data_->occupied_bvh_.computeLayoutChecksum()) {
+      throw BH_EXCEPTION(std::string("Viewpoint graph was computed for a different BVH tree. ")
+                         + "Use the cached BVH tree it was computed with or regenerate the graph: " + filename);
+    }
+    ia >> new_num_real_viewpoints;
+  }
+  else {
+    std::cout << "WARNING: Viewpoint graph has no BVH layout checksum. Make sure that the BVH tree"
+        << " has not been rebuilt since the graph was saved" << std::endl;
+    new_num_real_viewpoints = marker;
+  }
   BH_ASSERT(new_num_real_viewpoints == num_real_viewpoints_);
   ViewpointEntryLoader vel(&viewpoint_entries_, &data_->occupied_bvh_, &virtual_camera_);
   ia >> vel;
@@ -43,8 +100,11 @@ void ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
   viewpoint_graph_.clear();
   ia >> viewpoint_graph_;
   viewpoint_graph_components_valid_ = false;
-  std::cout << "Regenerating approximate nearest neighbor index" << std::endl;
+  lazy_viewpoint_motions_.clear();
+  invalid_viewpoint_motions_.clear();
+  std::cout << "Regenerating nearest neighbor index" << std::endl;
   viewpoint_ann_.clear();
+  viewpoint_ann_.reserve(viewpoint_entries_.size());
   for (const ViewpointEntry& viewpoint_entry : viewpoint_entries_) {
     viewpoint_ann_.addPoint(viewpoint_entry.viewpoint.pose().getWorldPosition());
   }
@@ -61,12 +121,15 @@ void ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
       }
     }
   }
+  rebuildViewpointSamplingDistribution();
   std::cout << "Loading motions" << std::endl;
   ia >> viewpoint_graph_motions_;
   std::cout << "Loaded viewpoint graph with " << viewpoint_entries_.size() << " viewpoints "
       << " and " << viewpoint_graph_.numEdges() << " motions" << std::endl;
   BH_ASSERT(viewpoint_entries_.size() == viewpoint_graph_.numVertices());
   BH_ASSERT(viewpoint_graph_.numEdges() == viewpoint_graph_motions_.size());
+  // Identifies the graph file for journals that are written on top of it
+  viewpoint_graph_checksum_ = bh::AppendOnlyJournal::computeFileChecksum(filename);
 
   // Consistency check that viewpoint motion distances and graph edge weights are equal
   for (ViewpointEntryIndex viewpoint_index = 0; viewpoint_index < viewpoint_entries_.size(); ++viewpoint_index) {
@@ -84,6 +147,16 @@ void ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
     }
   }
 
+  // Candidate motions of the lazy viewpoint graph are not serialized so they have to be regenerated.
+  // Otherwise a graph that was saved in lazy mode would have no connections at all.
+  if (options_.viewpoint_motion_lazy) {
+    computeViewpointMotions();
+  }
+  else if (viewpoint_graph_.numEdges() == 0 && viewpoint_entries_.size() > num_real_viewpoints_ + 1) {
+    std::cout << "WARNING: Loaded viewpoint graph has no motions. Compute motions or enable viewpoint_motion_lazy"
+        << " before computing a viewpoint path" << std::endl;
+  }
+
   std::cout << "Clearing observed voxels for previous camera viewpoints" << std::endl;
   for (std::size_t i = 0; i < num_real_viewpoints_; ++i) {
     ViewpointEntry& viewpoint_entry = viewpoint_entries_[i];
@@ -205,10 +278,8 @@ void ViewpointPlanner::loadViewpointPath(const std::string& filename) {
             const Pose& pose = entry.viewpoint.pose();
             if (isValidObjectPosition(pose.getWorldPosition(), drone_bbox_)) {
               const std::size_t knn = options_.viewpoint_motion_max_neighbors;
-              static std::vector<ViewpointANN::IndexType> knn_indices;
-              static std::vector<ViewpointANN::DistanceType> knn_distances;
-              knn_indices.resize(knn);
-              knn_distances.resize(knn);
+              std::vector<ViewpointANN::IndexType> knn_indices;
+              std::vector<ViewpointANN::DistanceType> knn_distances;
               viewpoint_ann_.knnSearch(entry.viewpoint.pose().getWorldPosition(), knn, &knn_indices, &knn_distances);
               for (std::size_t j = 0; j < knn_distances.size(); ++j) {
                 const ViewpointANN::DistanceType dist_square = knn_distances[j];
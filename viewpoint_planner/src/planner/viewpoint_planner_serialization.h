@@ -16,14 +16,8 @@ public:
   using VoxelType = ViewpointPlanner::VoxelType;
   using VoxelMap = ViewpointPlanner::VoxelMap;
 
-  VoxelMapSaver(const ViewpointPlannerData::OccupiedTreeType& bvh_tree) {
-    // Compute consistent ordering of BVH nodes
-    std::size_t voxel_index = 0;
-    for (const ViewpointPlannerData::OccupiedTreeType::NodeType& node : bvh_tree) {
-      voxel_index_map_.emplace(&node, voxel_index);
-      ++voxel_index;
-    }
-  }
+  VoxelMapSaver(const ViewpointPlannerData::OccupiedTreeType& bvh_tree)
+  : bvh_tree_(bvh_tree) {}
 
   template <typename Archive>
   void save(const VoxelMap& voxel_map, Archive& ar, const unsigned int version) const {
@@ -31,14 +25,14 @@ public:
     for (const auto& entry : voxel_map) {
       const VoxelType* voxel_ptr = entry.first.voxel;
       const FloatType information = entry.second;
-      std::size_t voxel_index = voxel_index_map_.at(voxel_ptr);
+      std::size_t voxel_index = bvh_tree_.getNodeIndex(voxel_ptr);
       ar & voxel_index;
       ar & information;
     }
   }
 
 private:
-  std::unordered_map<const VoxelType*, std::size_t> voxel_index_map_;
+  const ViewpointPlannerData::OccupiedTreeType& bvh_tree_;
 };
 
 class VoxelMapLoader {
@@ -47,14 +41,8 @@ public:
   using VoxelType = ViewpointPlanner::VoxelType;
   using VoxelMap = ViewpointPlanner::VoxelMap;
 
-  VoxelMapLoader(ViewpointPlannerData::OccupiedTreeType* bvh_tree) {
-    // Compute consistent ordering of BVH nodes
-    std::size_t voxel_index = 0;
-    for (ViewpointPlannerData::OccupiedTreeType::NodeType& node : *bvh_tree) {
-      index_voxel_map_.emplace(voxel_index, &node);
-      ++voxel_index;
-    }
-  }
+  VoxelMapLoader(ViewpointPlannerData::OccupiedTreeType* bvh_tree)
+  : bvh_tree_(bvh_tree) {}
 
   template <typename Archive>
   void load(VoxelMap* voxel_map, Archive& ar, const unsigned int version) const {
@@ -68,14 +56,15 @@ public:
 //        VoxelWithInformation voxel_with_information(voxel, information);
 //        voxel_map->emplace(std::move(voxel_with_information));
       if (voxel_map != nullptr) {
-        VoxelType* voxel = index_voxel_map_.at(voxel_index);
+        BH_ASSERT_STR(voxel_index < bvh_tree_->getNumOfNodes(), "Invalid voxel index");
+        VoxelType* voxel = bvh_tree_->getNode(voxel_index);
         voxel_map->emplace(voxel, information);
       }
     }
   }
 
 private:
-  std::unordered_map<std::size_t, VoxelType*> index_voxel_map_;
+  ViewpointPlannerData::OccupiedTreeType* bvh_tree_;
 };
 
 class VoxelWithInformationSetSaver {
@@ -85,27 +74,21 @@ public:
   using VoxelWithInformation = ViewpointPlanner::VoxelWithInformation;
   using VoxelWithInformationSet = ViewpointPlanner::VoxelWithInformationSet;
 
-  VoxelWithInformationSetSaver(const ViewpointPlannerData::OccupiedTreeType& bvh_tree) {
-    // Compute consistent ordering of BVH nodes
-    std::size_t voxel_index = 0;
-    for (const ViewpointPlannerData::OccupiedTreeType::NodeType& node : bvh_tree) {
-      voxel_index_map_.emplace(&node, voxel_index);
-      ++voxel_index;
-    }
-  }
+  VoxelWithInformationSetSaver(const ViewpointPlannerData::OccupiedTreeType& bvh_tree)
+  : bvh_tree_(bvh_tree) {}
 
   template <typename Archive>
   void save(const VoxelWithInformationSet& voxel_set, Archive& ar, const unsigned int version) const {
     ar & voxel_set.size();
     for (const VoxelWithInformation& voxel_with_information : voxel_set) {
-      std::size_t voxel_index = voxel_index_map_.at(voxel_with_information.voxel);
+      std::size_t voxel_index = bvh_tree_.getNodeIndex(voxel_with_information.voxel);
       ar & voxel_index;
       ar & voxel_with_information.information;
     }
   }
 
 private:
-  std::unordered_map<const VoxelType*, std::size_t> voxel_index_map_;
+  const ViewpointPlannerData::OccupiedTreeType& bvh_tree_;
 };
 
 class VoxelWithInformationSetLoader {
@@ -115,14 +98,8 @@ public:
   using VoxelWithInformation = ViewpointPlanner::VoxelWithInformation;
   using VoxelWithInformationSet = ViewpointPlanner::VoxelWithInformationSet;
 
-  VoxelWithInformationSetLoader(ViewpointPlannerData::OccupiedTreeType* bvh_tree) {
-    // Compute consistent ordering of BVH nodes
-    std::size_t voxel_index = 0;
-    for (ViewpointPlannerData::OccupiedTreeType::NodeType& node : *bvh_tree) {
-      index_voxel_map_.emplace(voxel_index, &node);
-      ++voxel_index;
-    }
-  }
+  VoxelWithInformationSetLoader(ViewpointPlannerData::OccupiedTreeType* bvh_tree)
+  : bvh_tree_(bvh_tree) {}
 
   template <typename Archive>
   void load(VoxelWithInformationSet* voxel_set, Archive& ar, const unsigned int version) const {
@@ -131,7 +108,8 @@ public:
     for (std::size_t i = 0; i < num_voxels; ++i) {
       std::size_t voxel_index;
       ar & voxel_index;
-      VoxelType* voxel = index_voxel_map_.at(voxel_index);
+      BH_ASSERT_STR(voxel_index < bvh_tree_->getNumOfNodes(), "Invalid voxel index");
+      VoxelType* voxel = bvh_tree_->getNode(voxel_index);
       FloatType information;
       ar & information;
       VoxelWithInformation voxel_with_information(voxel, information);
@@ -140,7 +118,7 @@ public:
   }
 
 private:
-  std::unordered_map<std::size_t, VoxelType*> index_voxel_map_;
+  ViewpointPlannerData::OccupiedTreeType* bvh_tree_;
 };
 
 class ViewpointEntrySaver {
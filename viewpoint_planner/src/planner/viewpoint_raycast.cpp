@@ -218,6 +218,34 @@ ViewpointRaycast::getRaycastHitVoxelsWithScreenCoordinatesCpu(
   return raycast_results;
 }
 
+std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates>
+ViewpointRaycast::getRaycastHitVoxelsWithScreenCoordinatesOnLattice(
+        const Viewpoint &viewpoint, const std::size_t stride) const {
+  BH_ASSERT(stride > 0);
+  std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates> raycast_results;
+  raycast_results.reserve(getNumOfLatticeRays(viewpoint, stride));
+  for (size_t y = stride / 2; y < viewpoint.camera().height(); y += stride) {
+    for (size_t x = stride / 2; x < viewpoint.camera().width(); x += stride) {
+      const RayType ray = viewpoint.getCameraRay(x, y);
+      std::pair<bool, OccupiedTreeType::IntersectionResult> result =
+              bvh_tree_->intersects(ray, min_range_, max_range_);
+      if (result.first) {
+        OccupiedTreeType::IntersectionResultWithScreenCoordinates result_with_screen_coordinates;
+        result_with_screen_coordinates.intersection_result = result.second;
+        result_with_screen_coordinates.screen_coordinates = Vector2(x, y);
+        raycast_results.push_back(result_with_screen_coordinates);
+      }
+    }
+  }
+  return raycast_results;
+}
+
+std::size_t ViewpointRaycast::getNumOfLatticeRays(const Viewpoint &viewpoint, const std::size_t stride) {
+  const std::size_t num_columns = (viewpoint.camera().width() + stride - 1 - stride / 2) / stride;
+  const std::size_t num_rows = (viewpoint.camera().height() + stride - 1 - stride / 2) / stride;
+  return num_columns * num_rows;
+}
+
 #if WITH_CUDA
 
 std::vector<OccupiedTreeType::IntersectionResult>
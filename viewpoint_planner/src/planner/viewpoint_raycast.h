@@ -73,6 +73,16 @@ public:
           const bool remove_duplicates = true,
           const bool fail_on_error = true) const;
 
+  /// Perform raycast on the BVH tree for a sparse lattice of pixels (every stride-th pixel in x and y,
+  /// starting at stride / 2). Duplicate hit voxels are not removed.
+  /// Returns a vector of hit voxels with additional info.
+  std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates>
+  getRaycastHitVoxelsWithScreenCoordinatesOnLattice(
+          const Viewpoint &viewpoint, const size_t stride) const;
+
+  /// Number of rays cast by getRaycastHitVoxelsWithScreenCoordinatesOnLattice()
+  static size_t getNumOfLatticeRays(const Viewpoint &viewpoint, const size_t stride);
+
   /// Remove invalid hit voxels from raycast results
   void removeInvalidRaycastHitVoxels(
           std::vector<OccupiedTreeType::IntersectionResult> *raycast_results) const;
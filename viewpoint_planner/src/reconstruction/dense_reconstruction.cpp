@@ -12,65 +12,135 @@
 
 using namespace reconstruction;
 
-DenseReconstruction::DenseReconstruction() {}
+constexpr size_t DenseReconstruction::kDefaultCacheCapacity;
+constexpr size_t DenseReconstruction::kDefaultPrefetchCount;
 
-DenseReconstruction::~DenseReconstruction() {}
+DenseReconstruction::DenseReconstruction()
+: cache_(kDefaultCacheCapacity,
+         [](const MapKey& key) -> std::shared_ptr<DataArray<FloatType>> {
+           throw BH_EXCEPTION("Dense maps have to be inserted into the cache explicitly");
+         },
+         [](const DataArray<FloatType>& map) {
+           return map.byteSize();
+         }),
+  access_hint_dense_map_type_(GEOMETRIC),
+  prefetch_depth_maps_(true),
+  prefetch_normal_maps_(false),
+  prefetch_count_(kDefaultPrefetchCount),
+  stop_prefetch_thread_(false),
+  num_hits_(0),
+  num_misses_(0),
+  num_prefetched_(0),
+  bytes_read_(0) {}
+
+DenseReconstruction::~DenseReconstruction() {
+  stopPrefetchThread();
+}
 
 void DenseReconstruction::read(const std::string& path, const bool read_sfm_gps_transformation /*=false*/) {
+  setAccessHint(std::vector<ImageId>());
   path_ = path;
-  depth_maps_.clear();
-  normal_maps_.clear();
+  {
+    std::unique_lock<std::mutex> lock(cache_mutex_);
+    cache_.clear();
+    prefetch_errors_.clear();
+  }
   SparseReconstruction::read(bh::joinPaths(path, "sparse"), read_sfm_gps_transformation);
 }
 
-const DenseReconstruction::DepthMap& DenseReconstruction::getDepthMap(ImageId image_id, DenseMapType dense_map_type) const {
-  auto it = depth_maps_.find(image_id);
-  if (it == depth_maps_.cend()) {
-    readAndCacheDepthMap(image_id, dense_map_type);
-    return depth_maps_.at(image_id);
-  }
-  return it->second;
+DenseReconstruction::DepthMapPtr DenseReconstruction::getDepthMap(
+    ImageId image_id, DenseMapType dense_map_type) const {
+  return getMap(DEPTH_MAP, image_id, dense_map_type);
 }
 
-const DenseReconstruction::NormalMap& DenseReconstruction::getNormalMap(ImageId image_id, DenseMapType dense_map_type) const {
-  auto it = normal_maps_.find(image_id);
-  if (it == normal_maps_.cend()) {
-    readAndCacheNormalMap(image_id, dense_map_type);
-    return normal_maps_.at(image_id);
-  }
-  return it->second;
+DenseReconstruction::NormalMapPtr DenseReconstruction::getNormalMap(
+    ImageId image_id, DenseMapType dense_map_type) const {
+  return getMap(NORMAL_MAP, image_id, dense_map_type);
 }
 
 /// Clear cached depth maps
 void DenseReconstruction::clearCachedDepthMaps() const {
-  depth_maps_.clear();
+  clearCachedMaps(DEPTH_MAP);
 }
 
 /// Clear cached normal maps
 void DenseReconstruction::clearCachedNormalMaps() const {
-  normal_maps_.clear();
+  clearCachedMaps(NORMAL_MAP);
+}
+
+void DenseReconstruction::setCacheCapacity(const size_t capacity_bytes) const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  cache_.setCapacity(capacity_bytes);
+}
+
+void DenseReconstruction::setPrefetchCount(const size_t prefetch_count) const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  prefetch_count_ = prefetch_count;
+}
+
+void DenseReconstruction::setAccessHint(const std::vector<ImageId>& image_ids, DenseMapType dense_map_type,
+                                        const bool prefetch_depth_maps, const bool prefetch_normal_maps) const {
+  if (image_ids.empty()) {
+    stopPrefetchThread();
+  }
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  prefetch_queue_.clear();
+  access_hint_ = image_ids;
+  access_hint_positions_.clear();
+  for (size_t i = 0; i < access_hint_.size(); ++i) {
+    access_hint_positions_.emplace(access_hint_[i], i);
+  }
+  access_hint_dense_map_type_ = dense_map_type;
+  prefetch_depth_maps_ = prefetch_depth_maps;
+  prefetch_normal_maps_ = prefetch_normal_maps;
+  if (access_hint_.empty()) {
+    return;
+  }
+  // Start reading ahead with the first image
+  schedulePrefetch(access_hint_.front());
+  if (prefetch_normal_maps_) {
+    prefetch_queue_.push_front(makeMapKey(NORMAL_MAP, access_hint_.front(), dense_map_type));
+  }
+  if (prefetch_depth_maps_) {
+    prefetch_queue_.push_front(makeMapKey(DEPTH_MAP, access_hint_.front(), dense_map_type));
+  }
+  lock.unlock();
+  startPrefetchThread();
+  cache_cond_.notify_all();
+}
+
+DenseReconstruction::CacheStatistics DenseReconstruction::getCacheStatistics() const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  CacheStatistics statistics;
+  statistics.num_hits = num_hits_;
+  statistics.num_misses = num_misses_;
+  statistics.num_prefetched = num_prefetched_;
+  statistics.num_evictions = cache_.numEvictions();
+  statistics.bytes_read = bytes_read_;
+  statistics.bytes_cached = cache_.weight();
+  return statistics;
+}
+
+void DenseReconstruction::resetCacheStatistics() const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  num_hits_ = 0;
+  num_misses_ = 0;
+  num_prefetched_ = 0;
+  bytes_read_ = 0;
+  cache_.resetStatistics();
 }
 
 DenseReconstruction::DepthMap DenseReconstruction::readDepthMap(ImageId image_id, DenseMapType dense_map_type) const {
-  const ImageColmap& image = getImages().at(image_id);
-  std::string depth_maps_path = bh::joinPaths(path_, "stereo", "depth_maps");
-  std::string depth_map_filename = image.name() + "." + denseTypeToString(dense_map_type) + ".bin";
-  std::cout << "Reading depth map " << depth_map_filename << " for image " << image.name() << std::endl;
-  DepthMap depth_map;
-  depth_map.readColmapFormat(bh::joinPaths(depth_maps_path, depth_map_filename));
-  BH_ASSERT_STR(depth_map.channels() == 1, "Depth map must have 1 channel");
-  return depth_map;
+  return readMap(DEPTH_MAP, image_id, dense_map_type, true);
 }
 
 DenseReconstruction::NormalMap DenseReconstruction::readNormalMap(ImageId image_id, DenseMapType dense_map_type) const {
-  const ImageColmap& image = getImages().at(image_id);
-  std::string normal_maps_path = bh::joinPaths(path_, "stereo", "normal_maps");
-  std::string normal_map_filename = image.name() + "." + denseTypeToString(dense_map_type) + ".bin";
-  std::cout << "Reading normal map " << normal_map_filename << " for image " << image.name() << std::endl;
-  NormalMap normal_map;
-  normal_map.readColmapFormat(bh::joinPaths(normal_maps_path, normal_map_filename));
-  BH_ASSERT_STR(normal_map.channels() == 3, "Normal map must have 3 channel");
-  return normal_map;
+  return readMap(NORMAL_MAP, image_id, dense_map_type, true);
+}
+
+DenseReconstruction::MapKey DenseReconstruction::makeMapKey(
+    const MapKind kind, const ImageId image_id, const DenseMapType dense_map_type) {
+  return (static_cast<MapKey>(image_id) << 3) | (static_cast<MapKey>(kind) << 2) | static_cast<MapKey>(dense_map_type);
 }
 
 std::string DenseReconstruction::denseTypeToString(DenseMapType dense_map_type) const {
@@ -87,12 +157,166 @@ std::string DenseReconstruction::denseTypeToString(DenseMapType dense_map_type)
   throw BH_EXCEPTION("Unknown dense map type");
 }
 
-void DenseReconstruction::readAndCacheDepthMap(ImageId image_id, DenseMapType dense_map_type) const {
-  DepthMap depth_map = readDepthMap(image_id, dense_map_type);
-  depth_maps_.emplace(image_id, depth_map);
+DataArray<FloatType> DenseReconstruction::readMap(
+    const MapKind kind, ImageId image_id, DenseMapType dense_map_type, const bool verbose) const {
+  const ImageColmap& image = getImages().at(image_id);
+  const std::string map_name = kind == DEPTH_MAP ? "depth" : "normal";
+  const std::string maps_path = bh::joinPaths(path_, "stereo", map_name + "_maps");
+  const std::string map_filename = image.name() + "." + denseTypeToString(dense_map_type) + ".bin";
+  if (verbose) {
+    std::cout << "Reading " << map_name << " map " << map_filename << " for image " << image.name() << std::endl;
+  }
+  DataArray<FloatType> map;
+  bytes_read_ += map.readColmapFormat(bh::joinPaths(maps_path, map_filename));
+  if (kind == DEPTH_MAP) {
+    BH_ASSERT_STR(map.channels() == 1, "Depth map must have 1 channel");
+  }
+  else {
+    BH_ASSERT_STR(map.channels() == 3, "Normal map must have 3 channel");
+  }
+  return map;
+}
+
+DenseReconstruction::MapPtr DenseReconstruction::getMap(
+    const MapKind kind, ImageId image_id, DenseMapType dense_map_type) const {
+  const MapKey key = makeMapKey(kind, image_id, dense_map_type);
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  schedulePrefetch(image_id);
+  if (!prefetch_queue_.empty()) {
+    cache_cond_.notify_all();
+  }
+  // Wait if the map is currently being read by the prefetch thread
+  bool waited = false;
+  while (maps_in_flight_.count(key) > 0) {
+    waited = true;
+    cache_cond_.wait(lock);
+  }
+  const auto error_it = prefetch_errors_.find(key);
+  if (error_it != prefetch_errors_.end()) {
+    const std::exception_ptr error = error_it->second;
+    prefetch_errors_.erase(error_it);
+    ++num_misses_;
+    std::rethrow_exception(error);
+  }
+  MapPtr map = cache_.find(key);
+  if (map) {
+    if (waited) {
+      ++num_misses_;
+    }
+    else {
+      ++num_hits_;
+    }
+    return map;
+  }
+  ++num_misses_;
+  maps_in_flight_.insert(key);
+  lock.unlock();
+  std::shared_ptr<DataArray<FloatType>> new_map;
+  try {
+    new_map = std::make_shared<DataArray<FloatType>>(readMap(kind, image_id, dense_map_type, true));
+  }
+  catch (...) {
+    lock.lock();
+    maps_in_flight_.erase(key);
+    cache_cond_.notify_all();
+    throw;
+  }
+  lock.lock();
+  cache_.insert(key, new_map);
+  maps_in_flight_.erase(key);
+  cache_cond_.notify_all();
+  return new_map;
 }
 
-void DenseReconstruction::readAndCacheNormalMap(ImageId image_id, DenseMapType dense_map_type) const {
-  NormalMap normal_map = readNormalMap(image_id, dense_map_type);
-  normal_maps_.emplace(image_id, normal_map);
+void DenseReconstruction::clearCachedMaps(const MapKind kind) const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  for (const auto& entry : getImages()) {
+    for (const DenseMapType dense_map_type : { PHOTOMETRIC, PHOTOMETRIC_FUSED, GEOMETRIC, GEOMETRIC_FUSED }) {
+      const MapKey key = makeMapKey(kind, entry.first, dense_map_type);
+      cache_.erase(key);
+      prefetch_errors_.erase(key);
+    }
+  }
+}
+
+void DenseReconstruction::schedulePrefetch(ImageId image_id) const {
+  const auto it = access_hint_positions_.find(image_id);
+  if (it == access_hint_positions_.end()) {
+    return;
+  }
+  prefetch_queue_.clear();
+  const size_t end_position = std::min(it->second + 1 + prefetch_count_, access_hint_.size());
+  for (size_t i = it->second + 1; i < end_position; ++i) {
+    if (prefetch_depth_maps_) {
+      prefetch_queue_.push_back(makeMapKey(DEPTH_MAP, access_hint_[i], access_hint_dense_map_type_));
+    }
+    if (prefetch_normal_maps_) {
+      prefetch_queue_.push_back(makeMapKey(NORMAL_MAP, access_hint_[i], access_hint_dense_map_type_));
+    }
+  }
+}
+
+void DenseReconstruction::startPrefetchThread() const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  if (prefetch_thread_.joinable()) {
+    return;
+  }
+  stop_prefetch_thread_ = false;
+  prefetch_thread_ = std::thread([this]() {
+    runPrefetchThread();
+  });
+}
+
+void DenseReconstruction::stopPrefetchThread() const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  if (!prefetch_thread_.joinable()) {
+    return;
+  }
+  stop_prefetch_thread_ = true;
+  prefetch_queue_.clear();
+  lock.unlock();
+  cache_cond_.notify_all();
+  prefetch_thread_.join();
+}
+
+void DenseReconstruction::runPrefetchThread() const {
+  std::unique_lock<std::mutex> lock(cache_mutex_);
+  while (true) {
+    cache_cond_.wait(lock, [this]() {
+      return stop_prefetch_thread_ || !prefetch_queue_.empty();
+    });
+    if (stop_prefetch_thread_) {
+      break;
+    }
+    const MapKey key = prefetch_queue_.front();
+    prefetch_queue_.pop_front();
+    if (maps_in_flight_.count(key) > 0 || cache_.hasInstance(key)) {
+      continue;
+    }
+    maps_in_flight_.insert(key);
+    lock.unlock();
+    const MapKind kind = static_cast<MapKind>((key >> 2) & 1);
+    const ImageId image_id = static_cast<ImageId>(key >> 3);
+    const DenseMapType dense_map_type = static_cast<DenseMapType>(key & 3);
+    std::shared_ptr<DataArray<FloatType>> map;
+    std::exception_ptr error;
+    try {
+      map = std::make_shared<DataArray<FloatType>>(readMap(kind, image_id, dense_map_type, false));
+    }
+    catch (...) {
+      // Any exception (e.g. std::bad_alloc) is passed on to the thread that requests the map
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (map) {
+      cache_.insert(key, map);
+      prefetch_errors_.erase(key);
+      ++num_prefetched_;
+    }
+    else {
+      prefetch_errors_[key] = error;
+    }
+    maps_in_flight_.erase(key);
+    cache_cond_.notify_all();
+  }
 }
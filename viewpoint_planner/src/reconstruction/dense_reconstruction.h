@@ -7,8 +7,22 @@
 //==================================================
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <bh/common.h>
+#include <bh/memory.h>
+#include <bh/memory_mapped_file.h>
 #include "sparse_reconstruction.h"
 
 namespace reconstruction {
@@ -58,27 +72,53 @@ public:
     return data_;
   }
 
-  void readColmapFormat(const std::string& filename) {
-    std::ifstream text_in(filename, std::ios_base::in);
-    BH_ASSERT_STR(text_in, std::string("Unable to open colmap array for reading: ") + filename);
-
-    char unused_char;
-    text_in >> width_ >> unused_char
-            >> height_ >> unused_char
-            >> channels_ >> unused_char;
-    std::streampos pos = text_in.tellg();
-    text_in.close();
-
-    BH_ASSERT(width_ > 0);
-    BH_ASSERT(height_ > 0);
-    BH_ASSERT(channels_ > 0);
-    data_.resize(width_ * height_ * channels_);
-
-    std::ifstream binary_in(filename, std::ios_base::in | std::ios_base::binary);
-    BH_ASSERT_STR(binary_in, std::string("Unable to open colmap array for reading: ") + filename);
-    binary_in.seekg(pos);
-    binary_in.read(reinterpret_cast<char*>(data_.data()), data_.size() * sizeof(T));
-    binary_in.close();
+  /// Size of the array data in bytes
+  size_t byteSize() const {
+    return data_.size() * sizeof(T);
+  }
+
+  /// Reads an array in COLMAP format (text header "width&height&channels&" followed by the binary data).
+  /// Returns the number of bytes read from the file.
+  size_t readColmapFormat(const std::string& filename) {
+    const bh::MemoryMappedFile file(filename);
+    const char* ptr = file.begin();
+    size_t dimensions[3];
+    for (size_t i = 0; i < 3; ++i) {
+      while (ptr != file.end() && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n')) {
+        ++ptr;
+      }
+      const char* digits_begin = ptr;
+      dimensions[i] = 0;
+      while (ptr != file.end() && *ptr >= '0' && *ptr <= '9') {
+        const size_t digit = *ptr - '0';
+        BH_ASSERT_STR(dimensions[i] <= (std::numeric_limits<size_t>::max() - digit) / 10,
+                      std::string("Invalid header in colmap array: ") + filename);
+        dimensions[i] = 10 * dimensions[i] + digit;
+        ++ptr;
+      }
+      BH_ASSERT_STR(ptr != digits_begin && ptr != file.end() && *ptr == '&',
+                    std::string("Invalid header in colmap array: ") + filename);
+      ++ptr;
+    }
+    BH_ASSERT(dimensions[0] > 0);
+    BH_ASSERT(dimensions[1] > 0);
+    BH_ASSERT(dimensions[2] > 0);
+
+    // Validate the element count against the file size before allocating anything
+    const size_t max_num_elements = std::numeric_limits<size_t>::max() / sizeof(T);
+    BH_ASSERT_STR(dimensions[0] <= max_num_elements / dimensions[1]
+                  && dimensions[0] * dimensions[1] <= max_num_elements / dimensions[2],
+                  std::string("Invalid dimensions in colmap array: ") + filename);
+    const size_t num_elements = dimensions[0] * dimensions[1] * dimensions[2];
+    BH_ASSERT_STR(static_cast<size_t>(file.end() - ptr) / sizeof(T) >= num_elements,
+                  std::string("Colmap array is truncated: ") + filename);
+
+    width_ = dimensions[0];
+    height_ = dimensions[1];
+    channels_ = dimensions[2];
+    data_.resize(num_elements);
+    std::memcpy(data_.data(), ptr, byteSize());
+    return file.size();
   }
 
   void writeColmapFormat(const std::string& filename) {
@@ -100,12 +140,15 @@ private:
   std::vector<T> data_;
 };
 
+/// Dense reconstruction from COLMAP with a byte-budgeted LRU cache for depth and normal maps.
+/// If an access hint (i.e. the order in which images will be visited) is given, the maps following
+/// the last accessed image are read ahead by a background thread.
 class DenseReconstruction : public SparseReconstruction {
 public:
   using DepthMap = DataArray<FloatType>;
   using NormalMap = DataArray<FloatType>;
-  using DepthMapMapType = EIGEN_ALIGNED_UNORDERED_MAP(ImageId, DepthMap);
-  using NormalMapMapType = EIGEN_ALIGNED_UNORDERED_MAP(ImageId, NormalMap);
+  using DepthMapPtr = std::shared_ptr<const DepthMap>;
+  using NormalMapPtr = std::shared_ptr<const NormalMap>;
 
   enum DenseMapType {
     PHOTOMETRIC,
@@ -114,17 +157,30 @@ public:
     GEOMETRIC_FUSED,
   };
 
+  struct CacheStatistics {
+    size_t num_hits;
+    size_t num_misses;
+    size_t num_prefetched;
+    size_t num_evictions;
+    size_t bytes_read;
+    size_t bytes_cached;
+  };
+
+  static constexpr size_t kDefaultCacheCapacity = size_t(1) << 30;
+  static constexpr size_t kDefaultPrefetchCount = 4;
+
   DenseReconstruction();
 
   ~DenseReconstruction() override;
 
   void read(const std::string& path, const bool read_sfm_gps_transformation=false) override;
 
-  /// Returns the depth map corresponding to the image (lazy loading of depth maps)
-  const DepthMap& getDepthMap(ImageId image_id, DenseMapType dense_map_type = GEOMETRIC) const;
+  /// Returns the depth map corresponding to the image (lazy loading of depth maps).
+  /// The map stays valid as long as the pointer is held even if it is evicted from the cache.
+  DepthMapPtr getDepthMap(ImageId image_id, DenseMapType dense_map_type = GEOMETRIC) const;
 
   /// Returns the normal map corresponding to the image (lazy loading of normal maps)
-  const NormalMap& getNormalMap(ImageId image_id, DenseMapType dense_map_type = GEOMETRIC) const;
+  NormalMapPtr getNormalMap(ImageId image_id, DenseMapType dense_map_type = GEOMETRIC) const;
 
   /// Clear cached depth maps
   void clearCachedDepthMaps() const;
@@ -132,6 +188,21 @@ public:
   /// Clear cached normal maps
   void clearCachedNormalMaps() const;
 
+  /// Set the maximum number of bytes used by cached depth and normal maps
+  void setCacheCapacity(const size_t capacity_bytes) const;
+
+  /// Set the number of maps that are read ahead of the current image of the access hint
+  void setPrefetchCount(const size_t prefetch_count) const;
+
+  /// Set the order in which images will be accessed to enable prefetching.
+  /// An empty list disables prefetching.
+  void setAccessHint(const std::vector<ImageId>& image_ids, DenseMapType dense_map_type = GEOMETRIC,
+                     const bool prefetch_depth_maps = true, const bool prefetch_normal_maps = false) const;
+
+  CacheStatistics getCacheStatistics() const;
+
+  void resetCacheStatistics() const;
+
   /// Reads the depth map corresponding to the image (does not store it internally)
   DepthMap readDepthMap(ImageId image_id, DenseMapType dense_map_type = GEOMETRIC) const;
 
@@ -139,13 +210,57 @@ public:
   NormalMap readNormalMap(ImageId image_id, DenseMapType dense_map_type = GEOMETRIC) const;
 
 private:
+  enum MapKind {
+    DEPTH_MAP = 0,
+    NORMAL_MAP = 1,
+  };
+
+  using MapKey = uint64_t;
+  using MapPtr = std::shared_ptr<const DataArray<FloatType>>;
+  using MapCache = bh::LRUCache<MapKey, DataArray<FloatType>>;
+
+  static MapKey makeMapKey(const MapKind kind, const ImageId image_id, const DenseMapType dense_map_type);
+
   std::string denseTypeToString(DenseMapType dense_map_type) const;
-  void readAndCacheDepthMap(const ImageId image_id, DenseMapType dense_map_type) const;
-  void readAndCacheNormalMap(const ImageId image_id, DenseMapType dense_map_type) const;
+
+  DataArray<FloatType> readMap(const MapKind kind, ImageId image_id, DenseMapType dense_map_type,
+                               const bool verbose) const;
+
+  MapPtr getMap(const MapKind kind, ImageId image_id, DenseMapType dense_map_type) const;
+
+  void clearCachedMaps(const MapKind kind) const;
+
+  /// Queue the maps following the image in the access hint for prefetching. Requires the mutex to be held.
+  void schedulePrefetch(ImageId image_id) const;
+
+  void startPrefetchThread() const;
+
+  void stopPrefetchThread() const;
+
+  void runPrefetchThread() const;
 
   std::string path_;
-  mutable DepthMapMapType depth_maps_;
-  mutable NormalMapMapType normal_maps_;
+
+  mutable std::mutex cache_mutex_;
+  mutable std::condition_variable cache_cond_;
+  mutable MapCache cache_;
+  mutable std::unordered_set<MapKey> maps_in_flight_;
+  mutable std::deque<MapKey> prefetch_queue_;
+  // Exceptions of the prefetch thread. They are rethrown when the map is requested.
+  mutable std::unordered_map<MapKey, std::exception_ptr> prefetch_errors_;
+  mutable std::unordered_map<ImageId, size_t> access_hint_positions_;
+  mutable std::vector<ImageId> access_hint_;
+  mutable DenseMapType access_hint_dense_map_type_;
+  mutable bool prefetch_depth_maps_;
+  mutable bool prefetch_normal_maps_;
+  mutable size_t prefetch_count_;
+  mutable bool stop_prefetch_thread_;
+  mutable std::thread prefetch_thread_;
+
+  mutable std::atomic<size_t> num_hits_;
+  mutable std::atomic<size_t> num_misses_;
+  mutable std::atomic<size_t> num_prefetched_;
+  mutable std::atomic<size_t> bytes_read_;
 };
 
 }
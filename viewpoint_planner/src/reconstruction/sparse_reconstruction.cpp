@@ -7,7 +7,14 @@
 //==================================================
 
 #include "sparse_reconstruction.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <sstream>
 #include <unordered_map>
 #include <bh/boost.h>
@@ -18,6 +25,7 @@
 #include <bh/eigen_utils.h>
 #include <bh/common.h>
 #include <bh/filesystem.h>
+#include <bh/memory_mapped_file.h>
 #include <bh/utilities.h>
 #include <bh/string_utils.h>
 #include <bh/vision/cameras.h>
@@ -48,6 +56,302 @@ using CameraMapType = SparseReconstruction::CameraMapType;
 using ImageMapType = SparseReconstruction::ImageMapType;
 using Point3DMapType = SparseReconstruction::Point3DMapType;
 
+namespace {
+
+// COLMAP camera model id of the PINHOLE model
+const int kColmapPinholeModelId = 1;
+
+// Minimum sizes of the records in the binary COLMAP model files
+// camera_id, model_id, width, height, 4 parameters (PINHOLE)
+const size_t kBinaryCameraMinSize = 4 + 4 + 8 + 8 + 4 * 8;
+// image_id, qvec, tvec, camera_id, empty name, num_points2D
+const size_t kBinaryImageMinSize = 4 + 7 * 8 + 4 + 1 + 8;
+// x, y, point3D_id
+const size_t kBinaryPoint2DSize = 2 * 8 + 8;
+// point3D_id, xyz, rgb, error, track_length
+const size_t kBinaryPoint3DMinSize = 8 + 3 * 8 + 3 + 8 + 8;
+// image_id, point2D_idx
+const size_t kBinaryTrackEntrySize = 4 + 4;
+
+/// Sequential reader for the little-endian binary COLMAP model files.
+/// Assumes a little-endian host.
+class BinaryReader {
+public:
+  BinaryReader(const char* begin, const char* end)
+  : ptr_(begin), end_(end) {}
+
+  template <typename T>
+  T read() {
+    if (static_cast<size_t>(end_ - ptr_) < sizeof(T)) {
+      throw BH_EXCEPTION("Unexpected end of binary file");
+    }
+    T value;
+    std::memcpy(&value, ptr_, sizeof(T));
+    ptr_ += sizeof(T);
+    return value;
+  }
+
+  /// Read an element count and make sure that the remaining bytes can hold that many elements
+  /// of at least min_element_size bytes. This avoids huge allocations for corrupt files.
+  uint64_t readCount(const size_t min_element_size) {
+    const uint64_t count = read<uint64_t>();
+    if (count > remainingBytes() / min_element_size) {
+      throw BH_EXCEPTION("Element count exceeds the size of the binary file");
+    }
+    return count;
+  }
+
+  size_t remainingBytes() const {
+    return end_ - ptr_;
+  }
+
+  /// Read a null-terminated string
+  std::string readString() {
+    const char* str_end = static_cast<const char*>(std::memchr(ptr_, '\0', end_ - ptr_));
+    if (str_end == nullptr) {
+      throw BH_EXCEPTION("Unexpected end of binary file");
+    }
+    std::string str(ptr_, str_end);
+    ptr_ = str_end + 1;
+    return str;
+  }
+
+private:
+  const char* ptr_;
+  const char* end_;
+};
+
+inline bool isWhitespace(const char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/// Parse a floating point number. Plain decimal numbers (with optional exponent) are parsed directly,
+/// everything else (i.e. inf or nan) is handed to strtod.
+double parseDouble(const char* begin, const char* end) {
+  static const double powers_of_10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const int max_significant_digits = 19;
+  const char* ptr = begin;
+  bool negative = false;
+  if (ptr != end && (*ptr == '-' || *ptr == '+')) {
+    negative = *ptr == '-';
+    ++ptr;
+  }
+  uint64_t mantissa = 0;
+  int num_significant_digits = 0;
+  int exponent = 0;
+  bool has_digits = false;
+  for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr) {
+    has_digits = true;
+    if (num_significant_digits < max_significant_digits) {
+      mantissa = 10 * mantissa + (*ptr - '0');
+      if (mantissa != 0) {
+        ++num_significant_digits;
+      }
+    }
+    else {
+      ++exponent;
+    }
+  }
+  if (ptr != end && *ptr == '.') {
+    ++ptr;
+    for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr) {
+      has_digits = true;
+      if (num_significant_digits < max_significant_digits) {
+        mantissa = 10 * mantissa + (*ptr - '0');
+        if (mantissa != 0) {
+          ++num_significant_digits;
+        }
+        --exponent;
+      }
+    }
+  }
+  bool valid = has_digits;
+  if (valid && ptr != end && (*ptr == 'e' || *ptr == 'E')) {
+    ++ptr;
+    bool negative_exponent = false;
+    if (ptr != end && (*ptr == '-' || *ptr == '+')) {
+      negative_exponent = *ptr == '-';
+      ++ptr;
+    }
+    valid = ptr != end;
+    int exponent_value = 0;
+    for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr) {
+      if (exponent_value < 10000) {
+        exponent_value = 10 * exponent_value + (*ptr - '0');
+      }
+    }
+    exponent += negative_exponent ? -exponent_value : exponent_value;
+  }
+  if (!valid || ptr != end) {
+    const std::string str(begin, end);
+    char* str_end;
+    const double value = std::strtod(str.c_str(), &str_end);
+    if (str.empty() || str_end != str.c_str() + str.size()) {
+      throw BH_EXCEPTION(std::string("Invalid number: ") + str);
+    }
+    return value;
+  }
+  double value = static_cast<double>(mantissa);
+  if (exponent >= 0 && exponent <= 22) {
+    value *= powers_of_10[exponent];
+  }
+  else if (exponent < 0 && exponent >= -22) {
+    value /= powers_of_10[-exponent];
+  }
+  else {
+    value *= std::pow(10.0, exponent);
+  }
+  return negative ? -value : value;
+}
+
+/// Whitespace separated tokens of a line of a COLMAP text file
+class TokenParser {
+public:
+  TokenParser(const char* begin, const char* end)
+  : ptr_(begin), end_(end) {}
+
+  bool hasMoreTokens() {
+    skipWhitespace();
+    return ptr_ != end_;
+  }
+
+  std::string nextString() {
+    const std::pair<const char*, const char*> token = nextToken();
+    return std::string(token.first, token.second);
+  }
+
+  double nextDouble() {
+    const std::pair<const char*, const char*> token = nextToken();
+    return parseDouble(token.first, token.second);
+  }
+
+  uint64_t nextUnsigned() {
+    const std::pair<const char*, const char*> token = nextToken();
+    uint64_t value = 0;
+    for (const char* ptr = token.first; ptr != token.second; ++ptr) {
+      if (*ptr < '0' || *ptr > '9') {
+        throw BH_EXCEPTION(std::string("Invalid unsigned integer: ") + std::string(token.first, token.second));
+      }
+      value = 10 * value + (*ptr - '0');
+    }
+    return value;
+  }
+
+  int64_t nextInteger() {
+    skipWhitespace();
+    if (ptr_ != end_ && *ptr_ == '-') {
+      ++ptr_;
+      return -static_cast<int64_t>(nextUnsigned());
+    }
+    return static_cast<int64_t>(nextUnsigned());
+  }
+
+private:
+  void skipWhitespace() {
+    while (ptr_ != end_ && isWhitespace(*ptr_)) {
+      ++ptr_;
+    }
+  }
+
+  std::pair<const char*, const char*> nextToken() {
+    skipWhitespace();
+    if (ptr_ == end_) {
+      throw BH_EXCEPTION("Missing value in line");
+    }
+    const char* token_begin = ptr_;
+    while (ptr_ != end_ && !isWhitespace(*ptr_)) {
+      ++ptr_;
+    }
+    return std::make_pair(token_begin, ptr_);
+  }
+
+  const char* ptr_;
+  const char* end_;
+};
+
+using Line = std::pair<const char*, const char*>;
+
+/// Split a text buffer into lines (without line endings)
+std::vector<Line> splitLines(const char* begin, const char* end) {
+  std::vector<Line> lines;
+  const char* ptr = begin;
+  while (ptr != end) {
+    const char* line_end = static_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    const char* content_end = line_end;
+    if (content_end != ptr && *(content_end - 1) == '\r') {
+      --content_end;
+    }
+    lines.push_back(std::make_pair(ptr, content_end));
+    ptr = line_end == end ? end : line_end + 1;
+  }
+  return lines;
+}
+
+bool isEmptyOrCommentLine(const Line& line) {
+  const char* ptr = line.first;
+  while (ptr != line.second && isWhitespace(*ptr)) {
+    ++ptr;
+  }
+  return ptr == line.second || *ptr == '#';
+}
+
+/// Parallel loop that rethrows the first exception after the loop
+template <typename Func>
+void parallelForWithExceptions(const size_t count, Func func) {
+  std::atomic<bool> failed(false);
+  std::string error_message;
+#pragma omp parallel for schedule(dynamic, 256)
+  for (size_t i = 0; i < count; ++i) {
+    if (failed) {
+      continue;
+    }
+    try {
+      func(i);
+    }
+    catch (const std::exception& err) {
+#pragma omp critical
+      {
+        if (!failed) {
+          error_message = err.what();
+          failed = true;
+        }
+      }
+    }
+  }
+  if (failed) {
+    throw BH_EXCEPTION(error_message);
+  }
+}
+
+struct ImageRecord {
+  ImageId id;
+  Pose pose;
+  std::string name;
+  std::vector<Feature> features;
+  CameraId camera_id;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/// Image pose from a COLMAP world-to-image transformation
+Pose makeImagePose(const double qw, const double qx, const double qy, const double qz,
+                   const double tx, const double ty, const double tz) {
+  Pose image_pose_world_to_image;
+  image_pose_world_to_image.quaternion() = Quaternion(qw, qx, qy, qz);
+  image_pose_world_to_image.quaternion().normalize();
+  image_pose_world_to_image.translation()(0) = tx;
+  image_pose_world_to_image.translation()(1) = ty;
+  image_pose_world_to_image.translation()(2) = tz;
+  return image_pose_world_to_image.inverse();
+}
+
+}
+
 auto PinholeCamera::createSimple(
         const size_t width, const size_t height, const FloatType focal_length) -> PinholeCamera {
   return createSimple(width, height, focal_length, focal_length);
@@ -297,9 +601,20 @@ void SparseReconstruction::read(const std::string& path, const bool read_sfm_gps
   cameras_.clear();
   images_.clear();
   points3D_.clear();
-  readCameras(bh::joinPaths(path, "cameras.txt"));
-  readImages(bh::joinPaths(path, "images.txt"));
-  readPoints3D(bh::joinPaths(path, "points3D.txt"));
+  const bool binary_model = boost::filesystem::exists(bh::joinPaths(path, "cameras.bin"))
+      && boost::filesystem::exists(bh::joinPaths(path, "images.bin"))
+      && boost::filesystem::exists(bh::joinPaths(path, "points3D.bin"));
+  if (binary_model) {
+    readCamerasBinary(bh::joinPaths(path, "cameras.bin"));
+    readImagesBinary(bh::joinPaths(path, "images.bin"));
+    readPoints3DBinary(bh::joinPaths(path, "points3D.bin"));
+  }
+  else {
+    readCamerasText(bh::joinPaths(path, "cameras.txt"));
+    readImagesText(bh::joinPaths(path, "images.txt"));
+    readPoints3DText(bh::joinPaths(path, "points3D.txt"));
+  }
+  computePoint3DNormalsAndStatistics();
   if (read_sfm_gps_transformation) {
     readGpsTransformation(bh::joinPaths(path, "gps_transformation.txt"));
     has_sfm_gps_transformation_ = true;
@@ -379,234 +694,199 @@ void SparseReconstruction::computePoint3DNormalAndStatistics(Point3D& point) con
 //  std::cout << "      normal: " << average_normal.transpose() << std::endl;
 }
 
-void SparseReconstruction::readCameras(std::string filename) {
-  std::ifstream in(filename);
-  if (!in) {
-    throw BH_EXCEPTION("Unable to open cameras file");
+void SparseReconstruction::computePoint3DNormalsAndStatistics() {
+  std::vector<Point3D*> points;
+  points.reserve(points3D_.size());
+  for (auto& entry : points3D_) {
+    points.push_back(&entry.second);
   }
-  readCameras(in);
+  parallelForWithExceptions(points.size(), [&](const size_t i) {
+    computePoint3DNormalAndStatistics(*points[i]);
+  });
 }
 
-void SparseReconstruction::readCameras(std::istream& in) {
-  std::string line;
-  std::string item;
-
-  while (std::getline(in, line)) {
-    bh::trim(line);
-
-    if (line.empty() || line[0] == '#') {
+void SparseReconstruction::readCamerasText(const std::string& filename) {
+  const bh::MemoryMappedFile file(filename);
+  for (const Line& line : splitLines(file.begin(), file.end())) {
+    if (isEmptyOrCommentLine(line)) {
       continue;
     }
-
-    std::stringstream line_stream(line);
-
-    // ID
-    std::getline(line_stream, item, ' ');
-    bh::trim(item);
-    CameraId camera_id = boost::lexical_cast<CameraId>(item);
-
-    // MODEL
-    std::getline(line_stream, item, ' ');
-    bh::trim(item);
-    if (item != "PINHOLE") {
-      throw BH_EXCEPTION(std::string("Unsupported camera model: ") + item);
+    TokenParser parser(line.first, line.second);
+    const CameraId camera_id = parser.nextUnsigned();
+    const std::string model = parser.nextString();
+    if (model != "PINHOLE") {
+      throw BH_EXCEPTION(std::string("Unsupported camera model: ") + model);
     }
-
-    // WIDTH
-    std::getline(line_stream, item, ' ');
-    bh::trim(item);
-    size_t width = boost::lexical_cast<size_t>(item);
-
-    // HEIGHT
-    std::getline(line_stream, item, ' ');
-    bh::trim(item);
-    size_t height = boost::lexical_cast<size_t>(item);
-
-    // PARAMS
+    const size_t width = parser.nextUnsigned();
+    const size_t height = parser.nextUnsigned();
     std::vector<FloatType> params;
-    while (!line_stream.eof()) {
-      std::getline(line_stream, item, ' ');
-      bh::trim(item);
-      params.push_back(boost::lexical_cast<FloatType>(item));
+    while (parser.hasMoreTokens()) {
+      params.push_back(static_cast<FloatType>(parser.nextDouble()));
     }
-
     PinholeCameraColmap camera(camera_id, width, height, params);
-
     cameras_.emplace(camera_id, camera);
   }
 }
 
-void SparseReconstruction::readImages(std::string filename) {
-  std::ifstream in(filename);
-  if (!in) {
-    throw BH_EXCEPTION("Unable to open images file");
+void SparseReconstruction::readCamerasBinary(const std::string& filename) {
+  const bh::MemoryMappedFile file(filename);
+  BinaryReader reader(file.begin(), file.end());
+  const uint64_t num_cameras = reader.readCount(kBinaryCameraMinSize);
+  for (uint64_t i = 0; i < num_cameras; ++i) {
+    const CameraId camera_id = reader.read<uint32_t>();
+    const int model_id = reader.read<int32_t>();
+    if (model_id != kColmapPinholeModelId) {
+      throw BH_EXCEPTION(std::string("Unsupported camera model id: ") + std::to_string(model_id));
+    }
+    const size_t width = reader.read<uint64_t>();
+    const size_t height = reader.read<uint64_t>();
+    std::vector<FloatType> params(4);
+    for (FloatType& param : params) {
+      param = static_cast<FloatType>(reader.read<double>());
+    }
+    PinholeCameraColmap camera(camera_id, width, height, params);
+    cameras_.emplace(camera_id, camera);
   }
-  readImages(in);
 }
 
-void SparseReconstruction::readImages(std::istream& in) {
-  std::string line;
-  std::string item;
-
-  while (std::getline(in, line)) {
-    bh::trim(line);
-
-    if (line.empty() || line[0] == '#') {
+void SparseReconstruction::readImagesText(const std::string& filename) {
+  const bh::MemoryMappedFile file(filename);
+  const std::vector<Line> lines = splitLines(file.begin(), file.end());
+  // Each image has a header line followed by a (possibly empty) line of 2D points
+  std::vector<size_t> header_line_indices;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (isEmptyOrCommentLine(lines[i])) {
       continue;
     }
+    header_line_indices.push_back(i);
+    ++i;
+  }
 
-    std::stringstream line_stream1(line);
-
-    // ID
-    std::getline(line_stream1, item, ' ');
-    ImageId image_id = boost::lexical_cast<ImageId>(item);
-
-    // QVEC (qw, qx, qy, qz)
-    std::getline(line_stream1, item, ' ');
-    FloatType qw = boost::lexical_cast<FloatType>(item);
-
-    std::getline(line_stream1, item, ' ');
-    FloatType qx = boost::lexical_cast<FloatType>(item);
-
-    std::getline(line_stream1, item, ' ');
-    FloatType qy = boost::lexical_cast<FloatType>(item);
-
-    std::getline(line_stream1, item, ' ');
-    FloatType qz = boost::lexical_cast<FloatType>(item);
-
-    Pose image_pose_world_to_image;
-    image_pose_world_to_image.quaternion() = Quaternion(qw, qx, qy, qz);
-    image_pose_world_to_image.quaternion().normalize();
-
-    // TVEC
-    std::getline(line_stream1, item, ' ');
-    image_pose_world_to_image.translation()(0) = boost::lexical_cast<FloatType>(item);
-
-    std::getline(line_stream1, item, ' ');
-    image_pose_world_to_image.translation()(1) = boost::lexical_cast<FloatType>(item);
-
-    std::getline(line_stream1, item, ' ');
-    image_pose_world_to_image.translation()(2) = boost::lexical_cast<FloatType>(item);
-
-    const Pose image_pose = image_pose_world_to_image.inverse();
-//    std::cout << "image_pose: " << image_pose << std::endl;
-
-    // CAMERA_ID
-    std::getline(line_stream1, item, ' ');
-    CameraId camera_id = boost::lexical_cast<CameraId>(item);
-
-    // NAME
-    std::getline(line_stream1, item, ' ');
-    std::string image_name = item;
+  std::vector<ImageRecord, Eigen::aligned_allocator<ImageRecord>> records(header_line_indices.size());
+  parallelForWithExceptions(records.size(), [&](const size_t i) {
+    ImageRecord& record = records[i];
+    const size_t line_index = header_line_indices[i];
+    TokenParser parser1(lines[line_index].first, lines[line_index].second);
+    record.id = parser1.nextUnsigned();
+    // QVEC (qw, qx, qy, qz) and TVEC
+    double values[7];
+    for (double& value : values) {
+      value = parser1.nextDouble();
+    }
+    record.pose = makeImagePose(values[0], values[1], values[2], values[3], values[4], values[5], values[6]);
+    record.camera_id = parser1.nextUnsigned();
+    record.name = parser1.nextString();
 
     // POINTS2D
-    std::getline(in, line);
-    bh::trim(line);
-    std::stringstream line_stream2(line);
-
-    std::vector<Vector2> points;
-    std::vector<Point3DId> point3D_ids;
-
-    std::vector<Feature> image_features;
-    while (!line_stream2.eof()) {
+    if (line_index + 1 >= lines.size()) {
+      return;
+    }
+    TokenParser parser2(lines[line_index + 1].first, lines[line_index + 1].second);
+    while (parser2.hasMoreTokens()) {
       Feature feature;
-
-      std::getline(line_stream2, item, ' ');
-      feature.point(0) = boost::lexical_cast<FloatType>(item);
-
-      std::getline(line_stream2, item, ' ');
-      feature.point(1) = boost::lexical_cast<FloatType>(item);
-
-      std::getline(line_stream2, item, ' ');
-      if (item == "-1") {
-        feature.point3d_id = invalid_point3d_id;
-      }
-      else {
-        feature.point3d_id = boost::lexical_cast<Point3DId>(item);
-      }
-
-      image_features.push_back(feature);
+      feature.point(0) = static_cast<FloatType>(parser2.nextDouble());
+      feature.point(1) = static_cast<FloatType>(parser2.nextDouble());
+      const int64_t point3d_id = parser2.nextInteger();
+      feature.point3d_id = point3d_id < 0 ? invalid_point3d_id : static_cast<Point3DId>(point3d_id);
+      record.features.push_back(feature);
     }
-    image_features.shrink_to_fit();
-
-    ImageColmap image(image_id, image_pose, image_name, image_features, camera_id);
-    //std::cout << "Image " << image_id << " has pose " << image_pose << std::endl;
+    record.features.shrink_to_fit();
+  });
 
+  images_.reserve(records.size());
+  for (ImageRecord& record : records) {
+    ImageColmap image(record.id, record.pose, record.name, record.features, record.camera_id);
     images_.emplace(image.id(), image);
   }
 }
 
-void SparseReconstruction::readPoints3D(std::string filename) {
-  std::ifstream in(filename);
-  if (!in) {
-    throw BH_EXCEPTION("Unable to open points3D file");
+void SparseReconstruction::readImagesBinary(const std::string& filename) {
+  const bh::MemoryMappedFile file(filename);
+  BinaryReader reader(file.begin(), file.end());
+  const uint64_t num_images = reader.readCount(kBinaryImageMinSize);
+  images_.reserve(num_images);
+  for (uint64_t i = 0; i < num_images; ++i) {
+    const ImageId image_id = reader.read<uint32_t>();
+    double values[7];
+    for (double& value : values) {
+      value = reader.read<double>();
+    }
+    const Pose image_pose = makeImagePose(values[0], values[1], values[2], values[3], values[4], values[5], values[6]);
+    const CameraId camera_id = reader.read<uint32_t>();
+    const std::string image_name = reader.readString();
+    const uint64_t num_points2D = reader.readCount(kBinaryPoint2DSize);
+    std::vector<Feature> image_features(num_points2D);
+    for (Feature& feature : image_features) {
+      feature.point(0) = static_cast<FloatType>(reader.read<double>());
+      feature.point(1) = static_cast<FloatType>(reader.read<double>());
+      const uint64_t point3d_id = reader.read<uint64_t>();
+      feature.point3d_id = point3d_id == std::numeric_limits<uint64_t>::max() ? invalid_point3d_id : point3d_id;
+    }
+    ImageColmap image(image_id, image_pose, image_name, image_features, camera_id);
+    images_.emplace(image.id(), image);
   }
-  readPoints3D(in);
 }
 
-void SparseReconstruction::readPoints3D(std::istream& in) {
-  std::string line;
-  std::string item;
-
-  while (std::getline(in, line)) {
-    bh::trim(line);
-
-    if (line.empty() || line[0] == '#') {
-      continue;
-    }
-
-    std::stringstream line_stream(line);
-
-    Point3D point3D;
-
-    // ID
-    std::getline(line_stream, item, ' ');
-    point3D.id = boost::lexical_cast<Point3DId>(item);
+void SparseReconstruction::readPoints3DText(const std::string& filename) {
+  const bh::MemoryMappedFile file(filename);
+  std::vector<Line> lines = splitLines(file.begin(), file.end());
+  lines.erase(std::remove_if(lines.begin(), lines.end(), isEmptyOrCommentLine), lines.end());
 
+  std::vector<Point3D, Eigen::aligned_allocator<Point3D>> points(lines.size());
+  parallelForWithExceptions(points.size(), [&](const size_t i) {
+    Point3D& point3D = points[i];
+    TokenParser parser(lines[i].first, lines[i].second);
+    point3D.id = parser.nextUnsigned();
     // XYZ
-    std::getline(line_stream, item, ' ');
-    point3D.pos(0) = boost::lexical_cast<FloatType>(item);
-
-    std::getline(line_stream, item, ' ');
-    point3D.pos(1) = boost::lexical_cast<FloatType>(item);
-
-    std::getline(line_stream, item, ' ');
-    point3D.pos(2) = boost::lexical_cast<FloatType>(item);
-
+    for (size_t j = 0; j < 3; ++j) {
+      point3D.pos(j) = static_cast<FloatType>(parser.nextDouble());
+    }
     // Color
-    std::getline(line_stream, item, ' ');
-    point3D.color.r() = static_cast<uint8_t>(boost::lexical_cast<int>(item));
-
-    std::getline(line_stream, item, ' ');
-    point3D.color.g() = static_cast<uint8_t>(boost::lexical_cast<int>(item));
-
-    std::getline(line_stream, item, ' ');
-    point3D.color.b() = static_cast<uint8_t>(boost::lexical_cast<int>(item));
-
+    point3D.color.r() = static_cast<uint8_t>(parser.nextUnsigned());
+    point3D.color.g() = static_cast<uint8_t>(parser.nextUnsigned());
+    point3D.color.b() = static_cast<uint8_t>(parser.nextUnsigned());
     // ERROR
-    std::getline(line_stream, item, ' ');
-    point3D.error = boost::lexical_cast<FloatType>(item);
-
+    point3D.error = static_cast<FloatType>(parser.nextDouble());
     // TRACK
-    while (!line_stream.eof()) {
+    while (parser.hasMoreTokens()) {
       Point3D::TrackEntry track_entry;
-
-      std::getline(line_stream, item, ' ');
-      bh::trim(item);
-      if (item.empty()) {
-        break;
-      }
-      track_entry.image_id = boost::lexical_cast<ImageId>(item);
-
-      std::getline(line_stream, item, ' ');
-      track_entry.feature_index = boost::lexical_cast<FeatureId>(item);
-
+      track_entry.image_id = parser.nextUnsigned();
+      track_entry.feature_index = parser.nextUnsigned();
       point3D.feature_track.push_back(track_entry);
     }
     point3D.feature_track.shrink_to_fit();
-    computePoint3DNormalAndStatistics(point3D);
+  });
 
-    points3D_.emplace(point3D.id, std::move(point3D));
+  points3D_.reserve(points.size());
+  for (Point3D& point3D : points) {
+    const Point3DId id = point3D.id;
+    points3D_.emplace(id, std::move(point3D));
+  }
+}
+
+void SparseReconstruction::readPoints3DBinary(const std::string& filename) {
+  const bh::MemoryMappedFile file(filename);
+  BinaryReader reader(file.begin(), file.end());
+  const uint64_t num_points = reader.readCount(kBinaryPoint3DMinSize);
+  points3D_.reserve(num_points);
+  for (uint64_t i = 0; i < num_points; ++i) {
+    Point3D point3D;
+    point3D.id = reader.read<uint64_t>();
+    for (size_t j = 0; j < 3; ++j) {
+      point3D.pos(j) = static_cast<FloatType>(reader.read<double>());
+    }
+    point3D.color.r() = reader.read<uint8_t>();
+    point3D.color.g() = reader.read<uint8_t>();
+    point3D.color.b() = reader.read<uint8_t>();
+    point3D.error = static_cast<FloatType>(reader.read<double>());
+    const uint64_t track_length = reader.readCount(kBinaryTrackEntrySize);
+    point3D.feature_track.resize(track_length);
+    for (Point3D::TrackEntry& track_entry : point3D.feature_track) {
+      track_entry.image_id = reader.read<uint32_t>();
+      track_entry.feature_index = reader.read<uint32_t>();
+    }
+    const Point3DId id = point3D.id;
+    points3D_.emplace(id, std::move(point3D));
   }
 }
 
@@ -259,6 +259,8 @@ public:
 
   virtual ~SparseReconstruction();
 
+  /// Read a COLMAP model. The binary format (cameras.bin, images.bin, points3D.bin) is used if available,
+  /// otherwise the text format.
   virtual void read(const std::string& path, const bool read_sfm_gps_transformation=false);
 
   const CameraMapType& getCameras() const;
@@ -282,17 +284,20 @@ public:
 private:
   void computePoint3DNormalAndStatistics(Point3D& point) const;
 
-  void readCameras(std::string filename);
+  /// Compute normals and statistics of all points in parallel (needs the images)
+  void computePoint3DNormalsAndStatistics();
 
-  void readCameras(std::istream& in);
+  void readCamerasText(const std::string& filename);
 
-  void readImages(std::string filename);
+  void readCamerasBinary(const std::string& filename);
 
-  void readImages(std::istream& in);
+  void readImagesText(const std::string& filename);
 
-  void readPoints3D(std::string filename);
+  void readImagesBinary(const std::string& filename);
 
-  void readPoints3D(std::istream& in);
+  void readPoints3DText(const std::string& filename);
+
+  void readPoints3DBinary(const std::string& filename);
 
   void readGpsTransformation(std::string filename);
 
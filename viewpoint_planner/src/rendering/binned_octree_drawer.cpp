@@ -26,6 +26,8 @@ BinnedOcTreeDrawer::BinnedOcTreeDrawer()
     draw_free_voxels_(false), alpha_override_(1.0),
     draw_single_bin_(false), render_tree_depth_(20),
     render_observation_threshold_(1),
+    min_z_limit_(std::numeric_limits<FloatType>::lowest()),
+    max_z_limit_(std::numeric_limits<FloatType>::max()),
     min_occupancy_(0), max_occupancy_(1),
     min_observations_(0), max_observations_(std::numeric_limits<uint32_t>::max()),
     low_observation_count_(0), high_observation_count_(std::numeric_limits<uint32_t>::max()),
@@ -38,6 +40,7 @@ BinnedOcTreeDrawer::BinnedOcTreeDrawer()
     occupancy_bins_.push_back(occupancy_bin);
   }
   occupancy_threshold_ = occupancy_bins_[occupancy_bins_.size() / 2];
+  stream_builder_.reset(new VoxelStreamBuilder(occupancy_bins_));
 }
 
 BinnedOcTreeDrawer::~BinnedOcTreeDrawer() {}
@@ -187,7 +190,13 @@ size_t BinnedOcTreeDrawer::getRenderTreeDepth() const {
 }
 
 void BinnedOcTreeDrawer::setRenderTreeDepth(size_t render_tree_depth) {
+  if (render_tree_depth == render_tree_depth_) {
+    return;
+  }
   render_tree_depth_ = render_tree_depth;
+  if (octree_ != nullptr) {
+    updateVoxelData(min_z_limit_, max_z_limit_);
+  }
 }
 
 size_t BinnedOcTreeDrawer::getRenderObservationThreshold() const {
@@ -195,17 +204,42 @@ size_t BinnedOcTreeDrawer::getRenderObservationThreshold() const {
 }
 
 void BinnedOcTreeDrawer::setRenderObservationThreshold(size_t render_observation_threshold) {
+  if (render_observation_threshold == render_observation_threshold_) {
+    return;
+  }
   render_observation_threshold_ = render_observation_threshold;
+  if (octree_ != nullptr) {
+    updateVoxelData(min_z_limit_, max_z_limit_);
+  }
+}
+
+const VoxelStreamBuilder::CullingOptions& BinnedOcTreeDrawer::getCullingOptions() const {
+  return culling_options_;
+}
+
+void BinnedOcTreeDrawer::setCullingOptions(const VoxelStreamBuilder::CullingOptions& culling_options) {
+  culling_options_ = culling_options;
+  if (octree_ != nullptr) {
+    buildAndUploadVoxelStreams();
+  }
 }
 
 void BinnedOcTreeDrawer::setOctree(
         const viewpoint_planner::OccupancyMapType* octree,
         const FloatType min_z_limit /*= std::numeric_limits<FloatType>::lowest()*/,
         const FloatType max_z_limit /*= std::numeric_limits<FloatType>::max()*/) {
+    // Cached voxels are kept when the same octree is refreshed
+    if (octree != octree_) {
+      stream_builder_->clear();
+    }
     octree_ = octree;
     updateVoxelsFromOctree(min_z_limit, max_z_limit);
 }
 
+void BinnedOcTreeDrawer::invalidateCache() {
+  stream_builder_->clear();
+}
+
 void BinnedOcTreeDrawer::updateVoxelsFromOctree(
         const FloatType min_z_limit /*= std::numeric_limits<FloatType>::lowest()*/,
         const FloatType max_z_limit /*= std::numeric_limits<FloatType>::max()*/) {
@@ -265,10 +299,7 @@ void BinnedOcTreeDrawer::updateRaycastVoxels(
     high_information = std::max(information, high_information);
   }
 
-  if (!raycast_drawer_) {
-    raycast_drawer_.reset(new VoxelDrawer());
-  }
-  raycast_drawer_->init();
+  getInitializedRaycastDrawer();
   configVoxelDrawer(*raycast_drawer_);
   raycast_drawer_->setInformationRange(low_information, high_information);
   raycast_drawer_->upload(voxel_data, color_data, info_data);
@@ -327,10 +358,7 @@ void BinnedOcTreeDrawer::updateRaycastVoxels(
     high_weight = std::max(weight, high_weight);
   }
 
-  if (!raycast_drawer_) {
-    raycast_drawer_.reset(new VoxelDrawer());
-  }
-  raycast_drawer_->init();
+  getInitializedRaycastDrawer();
   configVoxelDrawer(*raycast_drawer_);
   raycast_drawer_->setVoxelSizeDilation(kRaycastVoxelSizeDilation);
   raycast_drawer_->setInformationRange(low_information, high_information);
@@ -347,10 +375,7 @@ void BinnedOcTreeDrawer::updateSingleRaycastVoxel(
   voxel_data.push_back(voxel);
   color_data.push_back(color);
   info_data.push_back(info);
-  if (!raycast_drawer_) {
-    raycast_drawer_.reset(new VoxelDrawer());
-  }
-  raycast_drawer_->init();
+  getInitializedRaycastDrawer();
   configVoxelDrawer(*raycast_drawer_);
   raycast_drawer_->setVoxelSizeDilation(kRaycastVoxelSizeDilation);
   raycast_drawer_->upload(voxel_data, color_data, info_data);
@@ -408,10 +433,7 @@ void BinnedOcTreeDrawer::updateRaycastVoxels(
     high_weight = std::max(weight, high_weight);
   }
 
-  if (!raycast_drawer_) {
-    raycast_drawer_.reset(new VoxelDrawer());
-  }
-  raycast_drawer_->init();
+  getInitializedRaycastDrawer();
   configVoxelDrawer(*raycast_drawer_);
   raycast_drawer_->setVoxelSizeDilation(kRaycastVoxelSizeDilation);
   raycast_drawer_->setInformationRange(low_information, high_information);
@@ -473,10 +495,7 @@ void BinnedOcTreeDrawer::updateRaycastVoxels(
     high_weight = std::max(weight, high_weight);
   }
 
-  if (!raycast_drawer_) {
-    raycast_drawer_.reset(new VoxelDrawer());
-  }
-  raycast_drawer_->init();
+  getInitializedRaycastDrawer();
   configVoxelDrawer(*raycast_drawer_);
   raycast_drawer_->setVoxelSizeDilation(kRaycastVoxelSizeDilation);
   raycast_drawer_->setInformationRange(low_information, high_information);
@@ -538,10 +557,7 @@ void BinnedOcTreeDrawer::updateRaycastVoxels(
     high_weight = std::max(weight, high_weight);
   }
 
-  if (!raycast_drawer_) {
-    raycast_drawer_.reset(new VoxelDrawer());
-  }
-  raycast_drawer_->init();
+  getInitializedRaycastDrawer();
   configVoxelDrawer(*raycast_drawer_);
   raycast_drawer_->setVoxelSizeDilation(kRaycastVoxelSizeDilation);
   raycast_drawer_->setInformationRange(low_information, high_information);
@@ -550,98 +566,89 @@ void BinnedOcTreeDrawer::updateRaycastVoxels(
   std::cout << "Weight range: [" << low_weight << ", " << high_weight << "]" << std::endl;
 }
 
-#pragma optimize("O0")
+void BinnedOcTreeDrawer::cacheVoxelsAtRenderDepth() {
+  VoxelStreamBuilder::VoxelArrays arrays;
+  for(viewpoint_planner::OccupancyMapType::tree_iterator it = octree_->begin_tree(render_tree_depth_), end=octree_->end_tree(); it!= end; ++it) {
+    if (it.isLeaf()) {
+      const octomap::point3d& voxel_position = it.getCoordinate();
+      arrays.push_back(voxel_position.x(), voxel_position.y(), voxel_position.z(), it.getSize(),
+                       it->getOccupancy(), it->getObservationCount(), it->getWeight());
+    }
+  }
+  stream_builder_->setDepthArrays(render_tree_depth_, std::move(arrays));
+}
+
 void BinnedOcTreeDrawer::updateVoxelData(
         const FloatType min_z_limit /*= std::numeric_limits<FloatType>::lowest()*/,
         const FloatType max_z_limit /*= std::numeric_limits<FloatType>::max()*/) {
   BH_ASSERT_STR(octree_ != nullptr, "Octree was not initialized");
+  min_z_limit_ = min_z_limit;
+  max_z_limit_ = max_z_limit;
+  buildAndUploadVoxelStreams();
 
-  std::unordered_map<FloatType, std::vector<OGLVoxelData>> voxel_data;
-  std::unordered_map<FloatType, std::vector<OGLColorData>> color_data;
-  std::unordered_map<FloatType, std::vector<OGLVoxelInfoData>> info_data;
-  for (FloatType occupancy_bin : occupancy_bins_) {
-    voxel_data.emplace(occupancy_bin, std::vector<OGLVoxelData>());
-    color_data.emplace(occupancy_bin, std::vector<OGLColorData>());
-    info_data.emplace(occupancy_bin, std::vector<OGLVoxelInfoData>());
-  }
-
-  // Ranges of weight and observation counts
-  low_weight_ = std::numeric_limits<FloatType>::max();
-  high_weight_ = std::numeric_limits<FloatType>::lowest();
-  low_observation_count_ = std::numeric_limits<uint32_t>::max();
-  high_observation_count_ = std::numeric_limits<uint32_t>::lowest();
   // Range of z coordinate height color map
-  FloatType min_z = std::numeric_limits<FloatType>::max();
-  FloatType max_z = std::numeric_limits<FloatType>::lowest();
-
-  for(viewpoint_planner::OccupancyMapType::tree_iterator it = octree_->begin_tree(render_tree_depth_), end=octree_->end_tree(); it!= end; ++it) {
-    if (it.isLeaf() && it->getObservationCount() >= render_observation_threshold_) {
-
-      const octomap::point3d& voxel_position = it.getCoordinate();
-      FloatType voxel_size = it.getSize();
-
-      FloatType occupancy = it->getOccupancy();
-      FloatType occupancy_bin = findOccupancyBin(occupancy);
-      FloatType weight = it->getWeight();
+  const VoxelStreamBuilder::Ranges& ranges = stream_builder_->getRanges();
+  const FloatType min_z = std::max(ranges.min_z, min_z_limit);
+  const FloatType max_z = std::min(ranges.max_z, max_z_limit);
+  std::cout << "Occupancy map z range: " << "[" << min_z << ", " << max_z << "]" << std::endl;
+  std::cout << "Weight range: [" << low_weight_ << ", " << high_weight_ << "]" << std::endl;
+  std::cout << "Observation count range: [" << low_observation_count_ << ", " << high_observation_count_ << "]" << std::endl;
+  for (const auto& entry : voxel_drawer_map_) {
+    std::cout << "Voxels in bin " << entry.first << ": " << entry.second.numOfVoxels() << std::endl;
+  }
+}
 
-      OGLVertexData vertex(voxel_position.x(), voxel_position.y(), voxel_position.z());
-      voxel_data.at(occupancy_bin).emplace_back(vertex, voxel_size);
+void BinnedOcTreeDrawer::buildAndUploadVoxelStreams() {
+  // The octree is only traversed the first time a render depth is shown
+  if (!stream_builder_->hasDepth(render_tree_depth_)) {
+    cacheVoxelsAtRenderDepth();
+  }
 
-      info_data.at(occupancy_bin).emplace_back(occupancy, it->getObservationCount(), weight);
+  VoxelStreamBuilder::FilterOptions filter;
+  filter.min_observation_count = static_cast<uint32_t>(
+      std::min<size_t>(render_observation_threshold_, std::numeric_limits<uint32_t>::max()));
+  filter.min_z_limit = min_z_limit_;
+  filter.max_z_limit = max_z_limit_;
+  filter.alpha = alpha_override_;
+  const std::vector<VoxelStreamBuilder::StreamUpdate>& stream_updates =
+      stream_builder_->build(render_tree_depth_, filter, culling_options_);
 
-      if (voxel_position.z() < min_z) {
-        min_z = voxel_position.z();
-      }
-      if (voxel_position.z() > max_z) {
-        max_z = voxel_position.z();
-      }
-      low_weight_ = std::min(weight, low_weight_);
-      high_weight_ = std::max(weight, high_weight_);
-      low_observation_count_ = std::min(it->getObservationCount(), low_observation_count_);
-      high_observation_count_ = std::max(it->getObservationCount(), high_observation_count_);
+  // Ranges of weight and observation counts
+  const VoxelStreamBuilder::Ranges& ranges = stream_builder_->getRanges();
+  low_weight_ = ranges.low_weight;
+  high_weight_ = ranges.high_weight;
+  low_observation_count_ = ranges.low_observation_count;
+  high_observation_count_ = ranges.high_observation_count;
+
+  static_assert(sizeof(OGLVoxelData) == VoxelStreamBuilder::VoxelStream::kFloatsPerVoxel * sizeof(FloatType),
+                "Voxel stream layout does not match OGLVoxelData");
+  static_assert(sizeof(OGLColorData) == VoxelStreamBuilder::VoxelStream::kFloatsPerVoxel * sizeof(FloatType),
+                "Voxel stream layout does not match OGLColorData");
+  static_assert(sizeof(OGLVoxelInfoData) == VoxelStreamBuilder::VoxelStream::kFloatsPerVoxel * sizeof(FloatType),
+                "Voxel stream layout does not match OGLVoxelInfoData");
+  // Only bins that changed since the last update are uploaded
+  for (size_t bin_index = 0; bin_index < stream_builder_->numOfBins(); ++bin_index) {
+    const FloatType occupancy_bin = stream_builder_->getOccupancyBins()[bin_index];
+    VoxelDrawer& voxel_drawer = voxel_drawer_map_[occupancy_bin];
+    if (!voxel_drawer.isInitialized()) {
+      voxel_drawer.init();
     }
-  }
-  min_z = std::max(min_z, min_z_limit);
-  max_z = std::min(max_z, max_z_limit);
-  // Compute and output observation and weight ranges for each bin
-  for (FloatType occupancy_bin : occupancy_bins_) {
-    for (const OGLVoxelData& voxel : voxel_data.at(occupancy_bin)) {
-      OGLColorData color = getVoxelColorData(voxel, min_z, max_z);
-      color_data.at(occupancy_bin).emplace_back(color);
+    configVoxelDrawer(voxel_drawer);
+    const VoxelStreamBuilder::VoxelStream& stream = stream_builder_->getStream(bin_index);
+    const VoxelStreamBuilder::StreamUpdate& update = stream_updates[bin_index];
+    if (update.geometry_changed) {
+      voxel_drawer.upload(
+          reinterpret_cast<const OGLVoxelData*>(stream.voxels.data()),
+          reinterpret_cast<const OGLColorData*>(stream.colors.data()),
+          reinterpret_cast<const OGLVoxelInfoData*>(stream.infos.data()),
+          stream.numOfVoxels());
     }
-    FloatType weight_low = std::numeric_limits<FloatType>::max();
-    FloatType weight_high = std::numeric_limits<FloatType>::lowest();
-    FloatType observation_low = std::numeric_limits<FloatType>::max();
-    FloatType observation_high = std::numeric_limits<FloatType>::lowest();
-    for (const OGLVoxelInfoData& info : info_data.at(occupancy_bin)) {
-      weight_low = std::min(info.weight, weight_low);
-      weight_high = std::max(info.weight, weight_high);
-      observation_low = std::min(info.observation_count, observation_low);
-      observation_high = std::max(info.observation_count, observation_high);
+    else if (update.colors_changed) {
+      voxel_drawer.uploadColors(reinterpret_cast<const OGLColorData*>(stream.colors.data()), stream.numOfVoxels());
     }
-//    std::cout << "Weight range for bin " << occupancy_bin << ": [" << weight_low << ", " << weight_high << "]" << std::endl;
-//    std::cout << "Observation range for bin " << occupancy_bin << ": [" << observation_low << ", " << observation_high << "]" << std::endl;
-  }
-
-  std::cout << "Occupancy map z range: " << "[" << min_z << ", " << max_z << "]" << std::endl;
-  std::cout << "Weight range: [" << low_weight_ << ", " << high_weight_ << "]" << std::endl;
-  std::cout << "Observation count range: [" << low_observation_count_ << ", " << high_observation_count_ << "]" << std::endl;
-
-  voxel_drawer_map_.clear();
-  for (FloatType occupancy_bin : occupancy_bins_) {
-    const auto result = voxel_drawer_map_.emplace(std::piecewise_construct, std::make_tuple(occupancy_bin), std::make_tuple());
-    VoxelDrawer& voxel_drawer = result.first->second;
-    voxel_drawer.init();
-    configVoxelDrawer(voxel_drawer);
-//    std::cout << "Uploading " << voxel_data.at(occupancy_bin).size() << " voxels" << std::endl;
-    voxel_drawer.upload(voxel_data.at(occupancy_bin), color_data.at(occupancy_bin), info_data.at(occupancy_bin));
     voxel_drawer.setWeightRange(0, 1);
     voxel_drawer.setInformationRange(0, 1);
   }
-
-  for (const auto& entry : voxel_drawer_map_) {
-    std::cout << "Voxels in bin " << entry.first << ": " << entry.second.numOfVoxels() << std::endl;
-  }
 }
 
 void BinnedOcTreeDrawer::configVoxelDrawer(VoxelDrawer& voxel_drawer) const {
@@ -665,57 +672,9 @@ void BinnedOcTreeDrawer::setVertexDataFromOctomathVector(OGLVertexDataRGBA& vert
 }
 
 OGLColorData BinnedOcTreeDrawer::getVoxelColorData(const OGLVoxelData& voxel_data, FloatType min_z, FloatType max_z) const {
-  FloatType h = voxel_data.vertex.z;
-
-  if (min_z >= max_z)
-    h = 0.5f;
-  else{
-    h = (1.0f - std::min(std::max((h-min_z)/ (max_z - min_z), 0.0f), 1.0f)) * 0.8f;
-  }
-
-  // blend over HSV-values (more colors)
-  FloatType r, g, b;
-  FloatType s = 1.0f;
-  FloatType v = 1.0f;
-
-  h -= floor(h);
-  h *= 6;
-  int i;
-  FloatType m, n, f;
-
-  i = floor(h);
-  f = h - i;
-  if (!(i & 1))
-    f = 1 - f; // if i is even
-  m = v * (1 - s);
-  n = v * (1 - s * f);
-
-  switch (i) {
-  case 6:
-  case 0:
-    r = v; g = n; b = m;
-    break;
-  case 1:
-    r = n; g = v; b = m;
-    break;
-  case 2:
-    r = m; g = v; b = n;
-    break;
-  case 3:
-    r = m; g = n; b = v;
-    break;
-  case 4:
-    r = n; g = m; b = v;
-    break;
-  case 5:
-    r = v; g = m; b = n;
-    break;
-  default:
-    r = 1; g = 0.5f; b = 0.5f;
-    break;
-  }
-
-  return OGLColorData(r, g, b, alpha_override_);
+  FloatType rgba[4];
+  VoxelStreamBuilder::computeHeightColor(voxel_data.vertex.z, min_z, max_z, alpha_override_, rgba);
+  return OGLColorData(rgba[0], rgba[1], rgba[2], rgba[3]);
 }
 
 void BinnedOcTreeDrawer::drawVoxelsAboveThreshold(const QMatrix4x4& pvm_matrix, const QMatrix4x4& vm_matrix,
@@ -746,6 +705,17 @@ void BinnedOcTreeDrawer::drawVoxelsAboveThreshold(const QMatrix4x4& pvm_matrix,
   }
 }
 
+VoxelDrawer& BinnedOcTreeDrawer::getInitializedRaycastDrawer() {
+  // Shaders and buffers are only created once and reused for every raycast
+  if (!raycast_drawer_) {
+    raycast_drawer_.reset(new VoxelDrawer());
+  }
+  if (!raycast_drawer_->isInitialized()) {
+    raycast_drawer_->init();
+  }
+  return *raycast_drawer_;
+}
+
 void BinnedOcTreeDrawer::forEachVoxelDrawer(const std::function<void(VoxelDrawer&)> func) {
   for (auto& entry : voxel_drawer_map_) {
     func(entry.second);
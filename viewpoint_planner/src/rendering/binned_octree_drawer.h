@@ -13,6 +13,7 @@
 #include "../planner/occupied_tree.h"
 #include "triangle_drawer.h"
 #include "voxel_drawer.h"
+#include "voxel_stream_builder.h"
 
 namespace rendering {
 
@@ -37,6 +38,9 @@ public:
                  const FloatType min_z_limit = std::numeric_limits<FloatType>::lowest(),
                  const FloatType max_z_limit = std::numeric_limits<FloatType>::max());
 
+  /// Drops the cached voxels. Has to be called when the content of the current octree changed.
+  void invalidateCache();
+
   const std::vector<FloatType> &getOccupancyBins() const;
 
   FloatType findOccupancyBin(FloatType occupancy) const;
@@ -113,12 +117,21 @@ public:
 
   size_t getRenderTreeDepth() const;
 
+  /// Rebuilds the voxels from the cache (the octree is only traversed for a new render depth).
+  /// Requires a current OpenGL context once an octree is set.
   void setRenderTreeDepth(size_t render_tree_depth);
 
   size_t getRenderObservationThreshold() const;
 
+  /// Rebuilds the voxels from the cache. Requires a current OpenGL context once an octree is set.
   void setRenderObservationThreshold(size_t min_observations);
 
+  const VoxelStreamBuilder::CullingOptions& getCullingOptions() const;
+
+  /// Frustum and distance culling. Rebuilds the voxels from the cache and only uploads the changed bins.
+  /// Requires a current OpenGL context once an octree is set.
+  void setCullingOptions(const VoxelStreamBuilder::CullingOptions& culling_options);
+
 private:
   void
   drawVoxelsAboveThreshold(const QMatrix4x4 &pvm_matrix, const QMatrix4x4 &vm_matrix,
@@ -130,10 +143,20 @@ private:
 
   void forEachVoxelDrawer(const std::function<void(VoxelDrawer &)> func);
 
+  /// Fills the cache of the stream builder with the octree voxels of the current render depth
+  void cacheVoxelsAtRenderDepth();
+
+  /// Builds the voxel streams from the cache with the current filter and culling and uploads the changed bins
+  void buildAndUploadVoxelStreams();
+
+  VoxelDrawer& getInitializedRaycastDrawer();
+
   const viewpoint_planner::OccupancyMapType *octree_;
 
   std::vector<FloatType> occupancy_bins_;
   std::unordered_map<FloatType, VoxelDrawer> voxel_drawer_map_;
+  std::unique_ptr<VoxelStreamBuilder> stream_builder_;
+  VoxelStreamBuilder::CullingOptions culling_options_;
   bool draw_octree_;
 
   std::unique_ptr<VoxelDrawer> raycast_drawer_;
@@ -146,6 +169,9 @@ private:
   bool draw_single_bin_;
   size_t render_tree_depth_;
   size_t render_observation_threshold_;
+  // Limits of the height color map of the last update
+  FloatType min_z_limit_;
+  FloatType max_z_limit_;
 
   FloatType min_occupancy_;
   FloatType max_occupancy_;
@@ -105,6 +105,10 @@ void VoxelDrawer::init() {
   voxel_info_tex_.create();
 }
 
+bool VoxelDrawer::isInitialized() const {
+  return vao_.isCreated();
+}
+
 const QThread* VoxelDrawer::getVaoThread() const {
   return vao_.thread();
 }
@@ -263,24 +267,35 @@ std::vector<OGLVertexData> VoxelDrawer::computeVertexOffsets() {
 }
 
 void VoxelDrawer::uploadColors(const std::vector<OGLColorData> &color_data) {
-  assert(color_data.size() == num_voxels_);
+  uploadColors(color_data.data(), color_data.size());
+}
+
+void VoxelDrawer::uploadColors(const OGLColorData *color_data, const size_t num_voxels) {
+  assert(num_voxels == num_voxels_);
 
   // Create texture with voxel positions
   glBindBuffer(GL_TEXTURE_BUFFER, color_vbo_.bufferId());
-  glBufferData(GL_TEXTURE_BUFFER, color_data.size() * sizeof(OGLColorData), color_data.data(), GL_DYNAMIC_DRAW);
+  glBufferData(GL_TEXTURE_BUFFER, num_voxels * sizeof(OGLColorData), color_data, GL_DYNAMIC_DRAW);
   glBindBuffer(GL_TEXTURE_BUFFER, 0);
 }
 
 void VoxelDrawer::upload(const std::vector<OGLVoxelData> &voxel_data, const std::vector<OGLColorData> &color_data,
                          const std::vector<OGLVoxelInfoData> &info_data) {
-  num_voxels_ = voxel_data.size();
+  assert(color_data.size() == voxel_data.size());
+  assert(info_data.size() == voxel_data.size());
+  upload(voxel_data.data(), color_data.data(), info_data.data(), voxel_data.size());
+}
+
+void VoxelDrawer::upload(const OGLVoxelData *voxel_data, const OGLColorData *color_data,
+                         const OGLVoxelInfoData *info_data, const size_t num_voxels) {
+  num_voxels_ = num_voxels;
 
   program_.bind();
   vao_.bind();
 
   // Create texture with voxel positions
   glBindBuffer(GL_TEXTURE_BUFFER, voxel_position_vbo_.bufferId());
-  glBufferData(GL_TEXTURE_BUFFER, voxel_data.size() * sizeof(OGLVoxelData), voxel_data.data(), GL_DYNAMIC_DRAW);
+  glBufferData(GL_TEXTURE_BUFFER, num_voxels * sizeof(OGLVoxelData), voxel_data, GL_DYNAMIC_DRAW);
   glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
   // Create texture with vertex offsets (same for each voxel)
@@ -292,13 +307,13 @@ void VoxelDrawer::upload(const std::vector<OGLVoxelData> &voxel_data, const std:
 
   // Create texture with voxel info
   glBindBuffer(GL_TEXTURE_BUFFER, voxel_info_vbo_.bufferId());
-  glBufferData(GL_TEXTURE_BUFFER, info_data.size() * sizeof(OGLVoxelInfoData), info_data.data(), GL_DYNAMIC_DRAW);
+  glBufferData(GL_TEXTURE_BUFFER, num_voxels * sizeof(OGLVoxelInfoData), info_data, GL_DYNAMIC_DRAW);
   glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
   vao_.release();
   program_.release();
 
-  uploadColors(color_data);
+  uploadColors(color_data, num_voxels);
 }
 
 void VoxelDrawer::draw(const QMatrix4x4 &pvm_matrix, const QMatrix4x4 &view_matrix, const QMatrix4x4 &model_matrix) {
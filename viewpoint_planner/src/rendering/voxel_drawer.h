@@ -65,6 +65,8 @@ public:
 
   void init();
 
+  bool isInitialized() const;
+
   const QThread* getVaoThread() const;
 
   size_t numOfVoxels() const;
@@ -73,9 +75,14 @@ public:
 
   void uploadColors(const std::vector<OGLColorData> &color_data);
 
+  void uploadColors(const OGLColorData *color_data, const size_t num_voxels);
+
   void upload(const std::vector<OGLVoxelData> &voxel_data, const std::vector<OGLColorData> &color_data,
               const std::vector<OGLVoxelInfoData> &info_data);
 
+  void upload(const OGLVoxelData *voxel_data, const OGLColorData *color_data,
+              const OGLVoxelInfoData *info_data, const size_t num_voxels);
+
   void draw(const QMatrix4x4 &pvm_matrix, const QMatrix4x4 &vm_matrix);
 
   void draw(const QMatrix4x4 &pvm_matrix, const QMatrix4x4 &view_matrix, const QMatrix4x4 &model_matrix);
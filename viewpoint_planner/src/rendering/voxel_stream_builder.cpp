@@ -0,0 +1,392 @@
+//==================================================
+// voxel_stream_builder.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 19.05.17
+//==================================================
+
+#include "voxel_stream_builder.h"
+#include <algorithm>
+#include <cmath>
+#if _OPENMP
+  #include <omp.h>
+#endif
+#include <bh/common.h>
+
+namespace rendering {
+
+constexpr std::size_t VoxelStreamBuilder::VoxelStream::kFloatsPerVoxel;
+
+void VoxelStreamBuilder::VoxelArrays::reserve(const std::size_t num_voxels) {
+  x.reserve(num_voxels);
+  y.reserve(num_voxels);
+  z.reserve(num_voxels);
+  voxel_size.reserve(num_voxels);
+  occupancy.reserve(num_voxels);
+  observation_count.reserve(num_voxels);
+  weight.reserve(num_voxels);
+}
+
+void VoxelStreamBuilder::VoxelArrays::clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  voxel_size.clear();
+  occupancy.clear();
+  observation_count.clear();
+  weight.clear();
+}
+
+void VoxelStreamBuilder::VoxelArrays::push_back(
+    const FloatType x_, const FloatType y_, const FloatType z_, const FloatType size_,
+    const FloatType occupancy_, const uint32_t observation_count_, const FloatType weight_) {
+  x.push_back(x_);
+  y.push_back(y_);
+  z.push_back(z_);
+  voxel_size.push_back(size_);
+  occupancy.push_back(occupancy_);
+  observation_count.push_back(observation_count_);
+  weight.push_back(weight_);
+}
+
+void VoxelStreamBuilder::CullingOptions::setFrustumFromMatrix(const Eigen::Matrix4f& pvm_matrix) {
+  // Clip space planes -w <= x, y, z <= w expressed in object space
+  const Eigen::Vector4f row0 = pvm_matrix.row(0).transpose();
+  const Eigen::Vector4f row1 = pvm_matrix.row(1).transpose();
+  const Eigen::Vector4f row2 = pvm_matrix.row(2).transpose();
+  const Eigen::Vector4f row3 = pvm_matrix.row(3).transpose();
+  frustum_planes[0] = row3 + row0;
+  frustum_planes[1] = row3 - row0;
+  frustum_planes[2] = row3 + row1;
+  frustum_planes[3] = row3 - row1;
+  frustum_planes[4] = row3 + row2;
+  frustum_planes[5] = row3 - row2;
+}
+
+VoxelStreamBuilder::Ranges::Ranges()
+    : min_z(std::numeric_limits<FloatType>::max()),
+      max_z(std::numeric_limits<FloatType>::lowest()),
+      low_weight(std::numeric_limits<FloatType>::max()),
+      high_weight(std::numeric_limits<FloatType>::lowest()),
+      low_observation_count(std::numeric_limits<uint32_t>::max()),
+      high_observation_count(std::numeric_limits<uint32_t>::lowest()) {}
+
+VoxelStreamBuilder::VoxelStreamBuilder(const std::vector<FloatType>& occupancy_bins)
+    : occupancy_bins_(occupancy_bins),
+      has_built_(false),
+      built_depth_(0),
+      color_min_z_(0),
+      color_max_z_(0),
+      color_alpha_(1),
+      bin_voxel_indices_(occupancy_bins.size()),
+      streams_(occupancy_bins.size()),
+      stream_updates_(occupancy_bins.size()) {
+  BH_ASSERT_STR(!occupancy_bins_.empty(), "At least one occupancy bin is required");
+  BH_ASSERT_STR(occupancy_bins_.size() <= std::numeric_limits<uint8_t>::max(), "Too many occupancy bins");
+  BH_ASSERT_STR(std::is_sorted(occupancy_bins_.begin(), occupancy_bins_.end()), "Occupancy bins have to be sorted");
+}
+
+const std::vector<VoxelStreamBuilder::FloatType>& VoxelStreamBuilder::getOccupancyBins() const {
+  return occupancy_bins_;
+}
+
+std::size_t VoxelStreamBuilder::numOfBins() const {
+  return occupancy_bins_.size();
+}
+
+std::size_t VoxelStreamBuilder::findOccupancyBinIndex(const FloatType occupancy) const {
+  auto it = std::upper_bound(occupancy_bins_.cbegin(), occupancy_bins_.cend(), occupancy);
+  if (it == occupancy_bins_.cend()) {
+    return occupancy_bins_.size() - 1;
+  }
+  if (it != occupancy_bins_.cbegin()) {
+    --it;
+  }
+  return it - occupancy_bins_.cbegin();
+}
+
+bool VoxelStreamBuilder::hasDepth(const std::size_t depth) const {
+  return depth_entries_.count(depth) > 0;
+}
+
+void VoxelStreamBuilder::setDepthArrays(const std::size_t depth, VoxelArrays&& arrays) {
+  BH_ASSERT(arrays.y.size() == arrays.size() && arrays.z.size() == arrays.size()
+            && arrays.voxel_size.size() == arrays.size() && arrays.occupancy.size() == arrays.size()
+            && arrays.observation_count.size() == arrays.size() && arrays.weight.size() == arrays.size());
+  DepthEntry& entry = depth_entries_[depth];
+  entry.arrays = std::move(arrays);
+  entry.bin_indices.resize(entry.arrays.size());
+#pragma omp parallel for schedule(static)
+  for (std::size_t i = 0; i < entry.arrays.size(); ++i) {
+    entry.bin_indices[i] = static_cast<uint8_t>(findOccupancyBinIndex(entry.arrays.occupancy[i]));
+  }
+  if (has_built_ && built_depth_ == depth) {
+    // Indices of the last build refer to the replaced voxels
+    has_built_ = false;
+  }
+}
+
+const VoxelStreamBuilder::VoxelArrays& VoxelStreamBuilder::getDepthArrays(const std::size_t depth) const {
+  const auto it = depth_entries_.find(depth);
+  if (it == depth_entries_.end()) {
+    throw BH_EXCEPTION("No voxels cached for render depth");
+  }
+  return it->second.arrays;
+}
+
+void VoxelStreamBuilder::clear() {
+  depth_entries_.clear();
+  has_built_ = false;
+  ranges_ = Ranges();
+  for (std::size_t bin_index = 0; bin_index < numOfBins(); ++bin_index) {
+    bin_voxel_indices_[bin_index].clear();
+    streams_[bin_index] = VoxelStream();
+    stream_updates_[bin_index] = StreamUpdate();
+  }
+}
+
+const std::vector<VoxelStreamBuilder::StreamUpdate>& VoxelStreamBuilder::build(
+    const std::size_t depth, const FilterOptions& filter, const CullingOptions& culling) {
+  const auto it = depth_entries_.find(depth);
+  if (it == depth_entries_.end()) {
+    throw BH_EXCEPTION("No voxels cached for render depth");
+  }
+  const VoxelArrays& arrays = it->second.arrays;
+  const std::vector<uint8_t>& bin_indices = it->second.bin_indices;
+  const std::size_t num_voxels = arrays.size();
+
+  // Predicate pass. Ranges are computed before culling so that colors don't depend on the camera.
+  const uint8_t kFiltered = 0;
+  const uint8_t kCulled = 1;
+  const uint8_t kVisible = 2;
+  std::vector<uint8_t> voxel_states(num_voxels);
+  Ranges ranges;
+#pragma omp parallel
+  {
+    Ranges thread_ranges;
+#pragma omp for schedule(static)
+    for (std::size_t i = 0; i < num_voxels; ++i) {
+      if (arrays.observation_count[i] < filter.min_observation_count) {
+        voxel_states[i] = kFiltered;
+        continue;
+      }
+      thread_ranges.min_z = std::min(arrays.z[i], thread_ranges.min_z);
+      thread_ranges.max_z = std::max(arrays.z[i], thread_ranges.max_z);
+      thread_ranges.low_weight = std::min(arrays.weight[i], thread_ranges.low_weight);
+      thread_ranges.high_weight = std::max(arrays.weight[i], thread_ranges.high_weight);
+      thread_ranges.low_observation_count = std::min(arrays.observation_count[i], thread_ranges.low_observation_count);
+      thread_ranges.high_observation_count = std::max(arrays.observation_count[i], thread_ranges.high_observation_count);
+      voxel_states[i] = isCulled(arrays, i, culling) ? kCulled : kVisible;
+    }
+#pragma omp critical
+    {
+      ranges.min_z = std::min(thread_ranges.min_z, ranges.min_z);
+      ranges.max_z = std::max(thread_ranges.max_z, ranges.max_z);
+      ranges.low_weight = std::min(thread_ranges.low_weight, ranges.low_weight);
+      ranges.high_weight = std::max(thread_ranges.high_weight, ranges.high_weight);
+      ranges.low_observation_count = std::min(thread_ranges.low_observation_count, ranges.low_observation_count);
+      ranges.high_observation_count = std::max(thread_ranges.high_observation_count, ranges.high_observation_count);
+    }
+  }
+
+  // Stable compaction of the visible voxels into the bins: count per chunk, prefix sum, scatter
+#if _OPENMP
+  const std::size_t num_chunks = static_cast<std::size_t>(omp_get_max_threads());
+#else
+  const std::size_t num_chunks = 1;
+#endif
+  const std::size_t chunk_size = (num_voxels + num_chunks - 1) / num_chunks;
+  const std::size_t num_bins = numOfBins();
+  std::vector<std::size_t> chunk_bin_offsets(num_chunks * num_bins, 0);
+#pragma omp parallel for schedule(static)
+  for (std::size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    const std::size_t chunk_end = std::min((chunk + 1) * chunk_size, num_voxels);
+    for (std::size_t i = chunk * chunk_size; i < chunk_end; ++i) {
+      if (voxel_states[i] == kVisible) {
+        ++chunk_bin_offsets[chunk * num_bins + bin_indices[i]];
+      }
+    }
+  }
+  std::vector<std::vector<uint32_t>> new_bin_voxel_indices(num_bins);
+  for (std::size_t bin_index = 0; bin_index < num_bins; ++bin_index) {
+    std::size_t offset = 0;
+    for (std::size_t chunk = 0; chunk < num_chunks; ++chunk) {
+      const std::size_t count = chunk_bin_offsets[chunk * num_bins + bin_index];
+      chunk_bin_offsets[chunk * num_bins + bin_index] = offset;
+      offset += count;
+    }
+    new_bin_voxel_indices[bin_index].resize(offset);
+  }
+#pragma omp parallel for schedule(static)
+  for (std::size_t chunk = 0; chunk < num_chunks; ++chunk) {
+    const std::size_t chunk_end = std::min((chunk + 1) * chunk_size, num_voxels);
+    std::size_t* offsets = &chunk_bin_offsets[chunk * num_bins];
+    for (std::size_t i = chunk * chunk_size; i < chunk_end; ++i) {
+      if (voxel_states[i] == kVisible) {
+        const uint8_t bin_index = bin_indices[i];
+        new_bin_voxel_indices[bin_index][offsets[bin_index]] = static_cast<uint32_t>(i);
+        ++offsets[bin_index];
+      }
+    }
+  }
+
+  // Delta against the previous build
+  const FloatType color_min_z = std::max(ranges.min_z, filter.min_z_limit);
+  const FloatType color_max_z = std::min(ranges.max_z, filter.max_z_limit);
+  const bool same_depth = has_built_ && built_depth_ == depth;
+  const bool same_colors = same_depth && color_min_z == color_min_z_ && color_max_z == color_max_z_
+                           && filter.alpha == color_alpha_;
+  ranges_ = ranges;
+  color_min_z_ = color_min_z;
+  color_max_z_ = color_max_z;
+  color_alpha_ = filter.alpha;
+  for (std::size_t bin_index = 0; bin_index < num_bins; ++bin_index) {
+    StreamUpdate& update = stream_updates_[bin_index];
+    update.geometry_changed = !same_depth || new_bin_voxel_indices[bin_index] != bin_voxel_indices_[bin_index];
+    update.colors_changed = update.geometry_changed || !same_colors;
+    if (update.geometry_changed) {
+      bin_voxel_indices_[bin_index] = std::move(new_bin_voxel_indices[bin_index]);
+      fillGeometry(arrays, bin_voxel_indices_[bin_index], &streams_[bin_index]);
+    }
+    if (update.colors_changed) {
+      fillColors(arrays, bin_voxel_indices_[bin_index], &streams_[bin_index]);
+    }
+  }
+  has_built_ = true;
+  built_depth_ = depth;
+  return stream_updates_;
+}
+
+const VoxelStreamBuilder::VoxelStream& VoxelStreamBuilder::getStream(const std::size_t bin_index) const {
+  return streams_.at(bin_index);
+}
+
+const VoxelStreamBuilder::StreamUpdate& VoxelStreamBuilder::getStreamUpdate(const std::size_t bin_index) const {
+  return stream_updates_.at(bin_index);
+}
+
+const VoxelStreamBuilder::Ranges& VoxelStreamBuilder::getRanges() const {
+  return ranges_;
+}
+
+bool VoxelStreamBuilder::isCulled(const VoxelArrays& arrays, const std::size_t index,
+                                  const CullingOptions& culling) const {
+  const FloatType x = arrays.x[index];
+  const FloatType y = arrays.y[index];
+  const FloatType z = arrays.z[index];
+  const FloatType size = arrays.voxel_size[index];
+  if (culling.frustum_culling) {
+    const FloatType half_size = size / 2;
+    for (const Plane& plane : culling.frustum_planes) {
+      // Signed distance of the box corner that is furthest along the plane normal
+      const FloatType distance = plane(0) * x + plane(1) * y + plane(2) * z + plane(3)
+          + half_size * (std::abs(plane(0)) + std::abs(plane(1)) + std::abs(plane(2)));
+      if (distance < 0) {
+        return true;
+      }
+    }
+  }
+  if (culling.distance_lod) {
+    const FloatType dx = x - culling.eye_position(0);
+    const FloatType dy = y - culling.eye_position(1);
+    const FloatType dz = z - culling.eye_position(2);
+    const FloatType distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+    if (size < culling.min_size_distance_ratio * distance) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VoxelStreamBuilder::fillGeometry(
+    const VoxelArrays& arrays, const std::vector<uint32_t>& indices, VoxelStream* stream) const {
+  const std::size_t num_voxels = indices.size();
+  stream->voxels.resize(num_voxels * VoxelStream::kFloatsPerVoxel);
+  stream->infos.resize(num_voxels * VoxelStream::kFloatsPerVoxel);
+#pragma omp parallel for schedule(static)
+  for (std::size_t i = 0; i < num_voxels; ++i) {
+    const uint32_t index = indices[i];
+    FloatType* voxel = &stream->voxels[i * VoxelStream::kFloatsPerVoxel];
+    voxel[0] = arrays.x[index];
+    voxel[1] = arrays.y[index];
+    voxel[2] = arrays.z[index];
+    voxel[3] = arrays.voxel_size[index];
+    FloatType* info = &stream->infos[i * VoxelStream::kFloatsPerVoxel];
+    info[0] = arrays.occupancy[index];
+    info[1] = static_cast<FloatType>(arrays.observation_count[index]);
+    info[2] = arrays.weight[index];
+    info[3] = 0;
+  }
+}
+
+void VoxelStreamBuilder::fillColors(
+    const VoxelArrays& arrays, const std::vector<uint32_t>& indices, VoxelStream* stream) const {
+  const std::size_t num_voxels = indices.size();
+  stream->colors.resize(num_voxels * VoxelStream::kFloatsPerVoxel);
+#pragma omp parallel for schedule(static)
+  for (std::size_t i = 0; i < num_voxels; ++i) {
+    computeHeightColor(arrays.z[indices[i]], color_min_z_, color_max_z_, color_alpha_,
+                       &stream->colors[i * VoxelStream::kFloatsPerVoxel]);
+  }
+}
+
+void VoxelStreamBuilder::computeHeightColor(const FloatType z, const FloatType min_z, const FloatType max_z,
+                                            const FloatType alpha, FloatType* rgba) {
+  FloatType h = z;
+
+  if (min_z >= max_z)
+    h = 0.5f;
+  else{
+    h = (1.0f - std::min(std::max((h-min_z)/ (max_z - min_z), 0.0f), 1.0f)) * 0.8f;
+  }
+
+  // blend over HSV-values (more colors)
+  FloatType r, g, b;
+  FloatType s = 1.0f;
+  FloatType v = 1.0f;
+
+  h -= std::floor(h);
+  h *= 6;
+  int i;
+  FloatType m, n, f;
+
+  i = std::floor(h);
+  f = h - i;
+  if (!(i & 1))
+    f = 1 - f; // if i is even
+  m = v * (1 - s);
+  n = v * (1 - s * f);
+
+  switch (i) {
+  case 6:
+  case 0:
+    r = v; g = n; b = m;
+    break;
+  case 1:
+    r = n; g = v; b = m;
+    break;
+  case 2:
+    r = m; g = v; b = n;
+    break;
+  case 3:
+    r = m; g = n; b = v;
+    break;
+  case 4:
+    r = n; g = m; b = v;
+    break;
+  case 5:
+    r = v; g = m; b = n;
+    break;
+  default:
+    r = 1; g = 0.5f; b = 0.5f;
+    break;
+  }
+
+  rgba[0] = r;
+  rgba[1] = g;
+  rgba[2] = b;
+  rgba[3] = alpha;
+}
+
+}
@@ -0,0 +1,190 @@
+//==================================================
+// voxel_stream_builder.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 19.05.17
+//==================================================
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace rendering {
+
+///
+/// CPU-side generation of the voxel arrays that are uploaded by the BinnedOcTreeDrawer.
+///
+/// The voxels of each render depth are cached as structure-of-arrays. Filtering, binning by occupancy
+/// and culling are done with parallel passes over these arrays instead of walking the octree.
+/// Each build reports which bins changed so that only those have to be uploaded again.
+/// No OpenGL context is required.
+///
+class VoxelStreamBuilder {
+public:
+  using FloatType = float;
+  // Unaligned so that the options can be stored as members without aligned allocation
+  using Vector3 = Eigen::Matrix<FloatType, 3, 1, Eigen::DontAlign>;
+  using Plane = Eigen::Matrix<FloatType, 4, 1, Eigen::DontAlign>;
+
+  /// Voxels of a single render depth
+  struct VoxelArrays {
+    std::size_t size() const {
+      return x.size();
+    }
+
+    void reserve(const std::size_t num_voxels);
+
+    void clear();
+
+    void push_back(const FloatType x, const FloatType y, const FloatType z, const FloatType size,
+                   const FloatType occupancy, const uint32_t observation_count, const FloatType weight);
+
+    std::vector<FloatType> x;
+    std::vector<FloatType> y;
+    std::vector<FloatType> z;
+    std::vector<FloatType> voxel_size;
+    std::vector<FloatType> occupancy;
+    std::vector<uint32_t> observation_count;
+    std::vector<FloatType> weight;
+  };
+
+  struct FilterOptions {
+    FilterOptions()
+        : min_observation_count(0),
+          min_z_limit(std::numeric_limits<FloatType>::lowest()),
+          max_z_limit(std::numeric_limits<FloatType>::max()),
+          alpha(1) {}
+
+    uint32_t min_observation_count;
+    // Limits of the z range for the height color map
+    FloatType min_z_limit;
+    FloatType max_z_limit;
+    FloatType alpha;
+  };
+
+  struct CullingOptions {
+    CullingOptions()
+        : frustum_culling(false),
+          distance_lod(false),
+          eye_position(Vector3::Zero()),
+          min_size_distance_ratio(0) {}
+
+    /// Extracts the frustum planes from a projection-view-model matrix.
+    void setFrustumFromMatrix(const Eigen::Matrix4f& pvm_matrix);
+
+    // Voxels completely outside of the frustum are dropped
+    bool frustum_culling;
+    // Planes (a, b, c, d) with normals pointing into the frustum
+    std::array<Plane, 6> frustum_planes;
+    // Voxels whose size relative to their distance from the eye is below the ratio are dropped
+    bool distance_lod;
+    Vector3 eye_position;
+    FloatType min_size_distance_ratio;
+  };
+
+  /// Interleaved arrays of one occupancy bin.
+  /// The layout matches OGLVoxelData (x, y, z, size), OGLColorData (r, g, b, a)
+  /// and OGLVoxelInfoData (occupancy, observation count, weight, information).
+  struct VoxelStream {
+    static constexpr std::size_t kFloatsPerVoxel = 4;
+
+    std::size_t numOfVoxels() const {
+      return voxels.size() / kFloatsPerVoxel;
+    }
+
+    std::vector<FloatType> voxels;
+    std::vector<FloatType> colors;
+    std::vector<FloatType> infos;
+  };
+
+  /// Changes of a bin in the last build
+  struct StreamUpdate {
+    StreamUpdate()
+        : geometry_changed(false), colors_changed(false) {}
+
+    // Voxels, colors and infos have to be uploaded
+    bool geometry_changed;
+    // Only the colors have to be uploaded
+    bool colors_changed;
+  };
+
+  /// Value ranges of the voxels that passed the filter (culling is not considered)
+  struct Ranges {
+    Ranges();
+
+    FloatType min_z;
+    FloatType max_z;
+    FloatType low_weight;
+    FloatType high_weight;
+    uint32_t low_observation_count;
+    uint32_t high_observation_count;
+  };
+
+  explicit VoxelStreamBuilder(const std::vector<FloatType>& occupancy_bins);
+
+  const std::vector<FloatType>& getOccupancyBins() const;
+
+  std::size_t numOfBins() const;
+
+  /// Index of the highest bin that is not above the occupancy (same as BinnedOcTreeDrawer::findOccupancyBin).
+  std::size_t findOccupancyBinIndex(const FloatType occupancy) const;
+
+  bool hasDepth(const std::size_t depth) const;
+
+  /// Caches the voxels of a render depth. Replaces previously cached voxels of the depth.
+  void setDepthArrays(const std::size_t depth, VoxelArrays&& arrays);
+
+  const VoxelArrays& getDepthArrays(const std::size_t depth) const;
+
+  /// Drops all cached voxels and streams (i.e. when the octree changed).
+  void clear();
+
+  /// Filters, bins and culls the cached voxels of a depth and updates the streams.
+  /// Returns the changes of each bin compared to the previous build.
+  const std::vector<StreamUpdate>& build(const std::size_t depth,
+                                         const FilterOptions& filter,
+                                         const CullingOptions& culling = CullingOptions());
+
+  const VoxelStream& getStream(const std::size_t bin_index) const;
+
+  const StreamUpdate& getStreamUpdate(const std::size_t bin_index) const;
+
+  const Ranges& getRanges() const;
+
+  /// HSV height color map of the octomap viewer
+  static void computeHeightColor(const FloatType z, const FloatType min_z, const FloatType max_z,
+                                 const FloatType alpha, FloatType* rgba);
+
+private:
+  struct DepthEntry {
+    VoxelArrays arrays;
+    std::vector<uint8_t> bin_indices;
+  };
+
+  bool isCulled(const VoxelArrays& arrays, const std::size_t index, const CullingOptions& culling) const;
+
+  void fillGeometry(const VoxelArrays& arrays, const std::vector<uint32_t>& indices, VoxelStream* stream) const;
+
+  void fillColors(const VoxelArrays& arrays, const std::vector<uint32_t>& indices, VoxelStream* stream) const;
+
+  std::vector<FloatType> occupancy_bins_;
+  std::unordered_map<std::size_t, DepthEntry> depth_entries_;
+
+  // State of the last build
+  bool has_built_;
+  std::size_t built_depth_;
+  Ranges ranges_;
+  FloatType color_min_z_;
+  FloatType color_max_z_;
+  FloatType color_alpha_;
+  std::vector<std::vector<uint32_t>> bin_voxel_indices_;
+  std::vector<VoxelStream> streams_;
+  std::vector<StreamUpdate> stream_updates_;
+};
+
+}
@@ -314,6 +314,8 @@ void ViewerWidget::showOctree(const ViewpointPlanner::OccupancyMapType* octree)
     if (!initialized_) {
         return;
     }
+    // The octree content might have changed (i.e. weights or observation counts)
+    octree_drawer_.invalidateCache();
 
     // update viewer stat
     double minX, minY, minZ, maxX, maxY, maxZ;
@@ -1353,7 +1355,7 @@ void ViewerWidget::onRaycastFinished() {
 //  std::cout << "Node with weight > 0.5" << std::endl;
 //  for (auto it = raycast_results.cbegin(); it != raycast_results.cend(); ++it) {
 //    if (it->node->getObject()->weight > 0.5) {
-//      std::cout << "  &node_idx=" << planner_->getBvhTree().getVoxelIndexMap().at(it->node)
+//      std::cout << "  &node_idx=" << planner_->getBvhTree().getNodeIndex(it->node)
 //          << ", weight=" << it->node->getObject()->weight
 //          << ", obs_count=" << it->node->getObject()->observation_count << std::endl;
 //    }
@@ -1978,6 +1980,7 @@ void ViewerWidget::setMaxInformation(double max_information) {
 void ViewerWidget::setRenderTreeDepth(std::size_t render_tree_depth)
 {
 //    std::cout << "Setting render tree depth to " << render_tree_depth << std::endl;
+    makeCurrent();
     octree_drawer_.setRenderTreeDepth(render_tree_depth);
     update();
 }
@@ -1985,6 +1988,7 @@ void ViewerWidget::setRenderTreeDepth(std::size_t render_tree_depth)
 void ViewerWidget::setRenderObservationThreshold(std::size_t render_observation_threshold)
 {
 //    std::cout << "Setting render observation threshold to " << observation_threshold << std::endl;
+    makeCurrent();
     octree_drawer_.setRenderObservationThreshold(render_observation_threshold);
     update();
 }
@@ -1997,6 +2001,18 @@ void ViewerWidget::setSceneBoundingBox(const qglviewer::Vec& min, const qglviewe
     QGLViewer::setSceneBoundingBox(min, max);
 }
 
+void ViewerWidget::updateOctreeCulling(const QMatrix4x4& pvm_matrix) {
+  rendering::VoxelStreamBuilder::CullingOptions culling_options;
+  culling_options.frustum_culling = options_.octree_frustum_culling;
+  culling_options.setFrustumFromMatrix(Eigen::Map<const Eigen::Matrix4f>(pvm_matrix.constData()));
+  culling_options.distance_lod = options_.octree_lod_min_size_distance_ratio > 0;
+  culling_options.eye_position = qglviewerToEigen(camera()->position());
+  culling_options.min_size_distance_ratio = options_.octree_lod_min_size_distance_ratio;
+  // Only the bins that changed are uploaded again
+  octree_drawer_.setCullingOptions(culling_options);
+  culling_pvm_matrix_ = pvm_matrix;
+}
+
 void ViewerWidget::updateGL() {
   QGLViewer::updateGL();
 }
@@ -2041,6 +2057,10 @@ void ViewerWidget::draw() {
   viewpoint_motion_line_drawer_.draw(pvm_matrix, width(), height(), viewpoint_motion_line_width_);
 
   // Draw octree after mesh in case it is transparent
+  if ((options_.octree_frustum_culling || options_.octree_lod_min_size_distance_ratio > 0)
+      && pvm_matrix != culling_pvm_matrix_) {
+    updateOctreeCulling(pvm_matrix);
+  }
   octree_drawer_.draw(pvm_matrix, view_matrix, model_matrix);
 
   // Draw path before graph so that the graph is hidden
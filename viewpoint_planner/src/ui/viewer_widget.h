@@ -206,6 +206,8 @@ public:
       addOption<bool>("show_poisson_mesh_normals", &show_poisson_mesh_normals);
       addOption<double>("overlay_alpha", &overlay_alpha);
       addOption<std::string>("images_path", &images_path);
+      addOption<bool>("octree_frustum_culling", &octree_frustum_culling);
+      addOption<float>("octree_lod_min_size_distance_ratio", &octree_lod_min_size_distance_ratio);
     }
 
     ~Options() override {}
@@ -217,6 +219,10 @@ public:
     bool show_poisson_mesh_normals = false;
     double overlay_alpha = 0.5;
     std::string images_path = "images";
+    // Only upload octree voxels inside of the view frustum (the voxels are rebuilt when the camera moves)
+    bool octree_frustum_culling = false;
+    // Drop octree voxels whose size relative to their distance from the camera is below the ratio (0 disables it)
+    float octree_lod_min_size_distance_ratio = 0;
   };
 
   using FloatType = float;
@@ -392,6 +398,8 @@ protected:
   };
 
   void draw() override;
+  /// Rebuilds the octree voxels with frustum and distance culling for the given view
+  void updateOctreeCulling(const QMatrix4x4& pvm_matrix);
   void drawWithNames() override;
   void init() override;
   void initAxesDrawer();
@@ -459,6 +467,8 @@ private:
   FloatType aspect_ratio_;
   rendering::LineDrawer axes_drawer_;
   rendering::BinnedOcTreeDrawer octree_drawer_;
+  // Projection-view-model matrix of the last octree culling update
+  QMatrix4x4 culling_pvm_matrix_;
   rendering::SparseReconstructionDrawer sparse_recon_drawer_;
   rendering::PointDrawer dense_points_drawer_;
   rendering::TriangleDrawer poisson_mesh_drawer_;
@@ -0,0 +1,341 @@
+//==================================================
+// planner_service.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 18.05.17
+//==================================================
+
+#include <iostream>
+#include <QtWebSockets/qwebsocket.h>
+#include <bh/utilities.h>
+#include "planner_service.h"
+
+using std::cout;
+using std::endl;
+
+namespace planner_service {
+
+constexpr std::size_t PlannerService::kMaxQueuedJobs;
+
+PlannerSession::PlannerSession(std::shared_ptr<ViewpointPlannerData> planner_data,
+                               const ViewpointPlanner::Options* planner_options,
+                               const ViewpointPlanner::MotionPlannerType::Options* motion_options,
+                               const std::string& viewpoint_graph_filename,
+                               const std::size_t max_queued_jobs)
+: viewpoint_graph_filename_(viewpoint_graph_filename),
+  job_queue_(max_queued_jobs), cancel_generation_(0) {
+  planner_.reset(new ViewpointPlanner(planner_options, motion_options, std::move(planner_data)));
+  // The viewpoint graph is loaded by the worker thread so that the event loop is not blocked
+  worker_thread_ = std::thread([this]() {
+    run();
+  });
+}
+
+PlannerSession::~PlannerSession() {
+  close();
+  if (worker_thread_.joinable()) {
+    worker_thread_.join();
+  }
+}
+
+bool PlannerSession::submitJob(const MessageType type, const uint32_t job_id,
+                               const uint32_t count, const double time_budget) {
+  if (job_queue_.size() >= job_queue_.capacity()) {
+    return false;
+  }
+  return job_queue_.push(Job { type, job_id, count, time_budget, cancel_generation_ });
+}
+
+void PlannerSession::cancelJobs() {
+  ++cancel_generation_;
+}
+
+void PlannerSession::close() {
+  cancelJobs();
+  job_queue_.close();
+}
+
+void PlannerSession::run() {
+  if (!viewpoint_graph_filename_.empty()) {
+    try {
+      planner_->loadViewpointGraph(viewpoint_graph_filename_);
+    }
+    catch (const std::exception& err) {
+      sendError(0, std::string("Unable to load viewpoint graph: ") + err.what());
+    }
+  }
+  Job job;
+  while (job_queue_.pop(&job)) {
+    runJob(job);
+  }
+  emit closed();
+}
+
+bool PlannerSession::isCanceled(const Job& job) const {
+  return job.cancel_generation != cancel_generation_;
+}
+
+void PlannerSession::runJob(const Job& job) {
+  if (isCanceled(job)) {
+    sendJobFinished(job.job_id, JobStatus::CANCELED, "Canceled before start");
+    return;
+  }
+  try {
+    std::string status_message;
+    JobStatus status = JobStatus::SUCCESS;
+    switch (job.type) {
+      case MessageType::SAMPLE_CANDIDATES:
+        status = sampleCandidates(job, &status_message);
+        break;
+      case MessageType::COMPUTE_PATH:
+        status = computePath(job, &status_message);
+        break;
+      case MessageType::EXPORT_JSON: {
+        const std::string json = planner_->getViewpointPathAsJsonString(planner_->getBestViewpointPath());
+        MessageWriter writer(MessageType::JSON_RESULT, job.job_id);
+        writer.writeString(json);
+        send(writer);
+        break;
+      }
+      default:
+        throw BH_EXCEPTION("Unsupported planner service job type");
+    }
+    sendJobFinished(job.job_id, status, status_message);
+  }
+  catch (const std::exception& err) {
+    sendError(job.job_id, err.what());
+    sendJobFinished(job.job_id, JobStatus::FAILED, err.what());
+  }
+}
+
+JobStatus PlannerSession::sampleCandidates(const Job& job, std::string* status_message) {
+  const std::size_t max_num_candidates = job.count;
+  bh::Timer timer;
+  while (planner_->getViewpointGraph().numVertices() < max_num_candidates) {
+    if (isCanceled(job)) {
+      return JobStatus::CANCELED;
+    }
+    if (job.time_budget > 0 && timer.getElapsedTime() >= job.time_budget) {
+      return JobStatus::TIME_BUDGET_EXCEEDED;
+    }
+    planner_->generateNextViewpointEntry2();
+    sendProgress(job.job_id, planner_->getViewpointGraph().numVertices(), max_num_candidates);
+    if (planner_->getViewpointExplorationFront().empty()
+        && planner_->getViewpointEntries().size() > planner_->getNumOfRealViewpoints()) {
+      *status_message = "Exploration front is empty";
+      break;
+    }
+  }
+  planner_->computeViewpointMotions();
+  return JobStatus::SUCCESS;
+}
+
+JobStatus PlannerSession::computePath(const Job& job, std::string* status_message) {
+  const std::size_t num_viewpoints = job.count;
+  bh::Timer timer;
+  while (planner_->getNumMVSViewpoints(planner_->getBestViewpointPath()) < num_viewpoints) {
+    if (isCanceled(job)) {
+      return JobStatus::CANCELED;
+    }
+    if (job.time_budget > 0 && timer.getElapsedTime() >= job.time_budget) {
+      return JobStatus::TIME_BUDGET_EXCEEDED;
+    }
+    const ViewpointPlanner::NextViewpointPathEntryStatus result = planner_->findNextViewpointPathEntries();
+    sendPathUpdate(job.job_id);
+    sendCoverageUpdate(job.job_id);
+    sendProgress(job.job_id, planner_->getNumMVSViewpoints(planner_->getBestViewpointPath()), num_viewpoints);
+    if (result == ViewpointPlanner::NO_IMPROVEMENT_IN_OBJECTIVE) {
+      *status_message = "No more improvement in objective";
+      break;
+    }
+    else if (result == ViewpointPlanner::NO_VIEWPOINTS_LEFT) {
+      *status_message = "No more viewpoints left";
+      break;
+    }
+    else if (result == ViewpointPlanner::TIME_CONSTRAINT_EXCEEDED) {
+      *status_message = "Reached viewpoint path time constraint";
+      break;
+    }
+  }
+  return JobStatus::SUCCESS;
+}
+
+void PlannerSession::sendProgress(const uint32_t job_id, const std::size_t current, const std::size_t total) {
+  MessageWriter writer(MessageType::PROGRESS, job_id);
+  writer.write<uint32_t>(static_cast<uint32_t>(current));
+  writer.write<uint32_t>(static_cast<uint32_t>(total));
+  send(writer);
+}
+
+void PlannerSession::sendPathUpdate(const uint32_t job_id) {
+  const ViewpointPlanner::ViewpointPath& viewpoint_path = planner_->getBestViewpointPath();
+  MessageWriter writer(MessageType::PATH_UPDATE, job_id);
+  writer.write<float>(viewpoint_path.acc_information);
+  writer.write<float>(viewpoint_path.acc_motion_distance);
+  writer.write<uint32_t>(static_cast<uint32_t>(viewpoint_path.entries.size()));
+  const bool has_order = viewpoint_path.order.size() == viewpoint_path.entries.size();
+  for (std::size_t i = 0; i < viewpoint_path.entries.size(); ++i) {
+    const ViewpointPlanner::ViewpointPathEntry& entry = viewpoint_path.entries[has_order ? viewpoint_path.order[i] : i];
+    const ViewpointPlanner::Pose& pose = entry.viewpoint.pose();
+    writer.write<uint32_t>(static_cast<uint32_t>(entry.viewpoint_index));
+    writer.write<uint8_t>(entry.mvs_viewpoint ? 1 : 0);
+    for (std::size_t k = 0; k < 3; ++k) {
+      writer.write<float>(pose.getWorldPosition()(k));
+    }
+    writer.write<float>(pose.quaternion().w());
+    writer.write<float>(pose.quaternion().x());
+    writer.write<float>(pose.quaternion().y());
+    writer.write<float>(pose.quaternion().z());
+  }
+  send(writer);
+}
+
+void PlannerSession::sendCoverageUpdate(const uint32_t job_id) {
+  const ViewpointPlanner::VoxelMap& observed_voxel_map = planner_->getBestViewpointPath().observed_voxel_map;
+  std::vector<std::pair<const ViewpointPlanner::VoxelType*, ViewpointPlanner::FloatType>> changed_voxels;
+  for (const auto& entry : observed_voxel_map) {
+    const auto it = sent_voxel_information_.find(entry.first.voxel);
+    if (it == sent_voxel_information_.end() || it->second != entry.second) {
+      changed_voxels.emplace_back(entry.first.voxel, entry.second);
+      sent_voxel_information_[entry.first.voxel] = entry.second;
+    }
+  }
+  // Voxels that are not observed anymore are reported with zero information
+  for (auto it = sent_voxel_information_.begin(); it != sent_voxel_information_.end();) {
+    if (observed_voxel_map.count(ViewpointPlanner::VoxelWrapper(it->first)) == 0) {
+      changed_voxels.emplace_back(it->first, 0);
+      it = sent_voxel_information_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  MessageWriter writer(MessageType::COVERAGE_UPDATE, job_id);
+  writer.write<uint32_t>(static_cast<uint32_t>(observed_voxel_map.size()));
+  writer.write<uint32_t>(static_cast<uint32_t>(changed_voxels.size()));
+  for (const auto& changed_voxel : changed_voxels) {
+    const ViewpointPlanner::BoundingBoxType& bbox = changed_voxel.first->getBoundingBox();
+    for (std::size_t k = 0; k < 3; ++k) {
+      writer.write<float>(bbox.getCenter(k));
+    }
+    writer.write<float>(bbox.getMaxExtent());
+    writer.write<float>(changed_voxel.second);
+  }
+  send(writer);
+}
+
+void PlannerSession::sendJobFinished(const uint32_t job_id, const JobStatus status, const std::string& status_message) {
+  MessageWriter writer(MessageType::JOB_FINISHED, job_id);
+  writer.write<uint8_t>(static_cast<uint8_t>(status));
+  writer.writeString(status_message);
+  send(writer);
+}
+
+void PlannerSession::sendError(const uint32_t job_id, const std::string& error_message) {
+  MessageWriter writer(MessageType::ERROR_MESSAGE, job_id);
+  writer.writeString(error_message);
+  send(writer);
+}
+
+void PlannerSession::send(const MessageWriter& writer) {
+  // The signal is delivered in the thread of the web socket server
+  emit messageReady(writer.data());
+}
+
+PlannerService::PlannerService(WebSocketServer* server,
+                               std::shared_ptr<ViewpointPlannerData> planner_data,
+                               const ViewpointPlanner::Options* planner_options,
+                               const ViewpointPlanner::MotionPlannerType::Options* motion_options,
+                               const std::string& viewpoint_graph_filename,
+                               QObject* parent)
+: QObject(parent), server_(server), planner_data_(planner_data),
+  planner_options_(planner_options), motion_options_(motion_options),
+  viewpoint_graph_filename_(viewpoint_graph_filename) {
+  connect(server_, &WebSocketServer::clientConnected, this, &PlannerService::onClientConnected);
+  connect(server_, &WebSocketServer::clientDisconnected, this, &PlannerService::onClientDisconnected);
+  connect(server_, &WebSocketServer::binaryMessageReceived, this, &PlannerService::onBinaryMessageReceived);
+}
+
+PlannerService::~PlannerService() {
+  // Let all sessions cancel their jobs before waiting for the first one
+  for (auto& entry : sessions_) {
+    entry.second->close();
+  }
+  sessions_.clear();
+}
+
+void PlannerService::onClientConnected(QWebSocket* client) {
+  cout << "PlannerService: Creating session for new client" << endl;
+  std::unique_ptr<PlannerSession> session(new PlannerSession(
+      planner_data_, planner_options_, motion_options_, viewpoint_graph_filename_, kMaxQueuedJobs));
+  connect(session.get(), &PlannerSession::messageReady, this, [this, client](QByteArray message) {
+    server_->sendBinaryMessage(client, message);
+  }, Qt::QueuedConnection);
+  sessions_.emplace(client, std::move(session));
+}
+
+void PlannerService::onClientDisconnected(QWebSocket* client) {
+  const auto it = sessions_.find(client);
+  if (it == sessions_.end()) {
+    return;
+  }
+  cout << "PlannerService: Closing session of client" << endl;
+  // The running job might take a while to notice the cancellation. Instead of joining the worker thread
+  // here the session deletes itself once the worker thread is done. Until then it is a child of the service
+  // so that it is joined on shutdown.
+  PlannerSession* session = it->second.release();
+  sessions_.erase(it);
+  session->disconnect(this);
+  session->setParent(this);
+  connect(session, &PlannerSession::closed, session, &QObject::deleteLater, Qt::QueuedConnection);
+  session->close();
+}
+
+void PlannerService::onBinaryMessageReceived(QWebSocket* client, QByteArray message) {
+  const auto it = sessions_.find(client);
+  if (it == sessions_.end()) {
+    return;
+  }
+  PlannerSession& session = *it->second;
+  uint32_t job_id = 0;
+  try {
+    MessageReader reader(message);
+    job_id = reader.jobId();
+    uint32_t count = 0;
+    double time_budget = 0;
+    switch (reader.type()) {
+      case MessageType::SAMPLE_CANDIDATES:
+        count = reader.read<uint32_t>();
+        break;
+      case MessageType::COMPUTE_PATH:
+        count = reader.read<uint32_t>();
+        time_budget = reader.read<double>();
+        break;
+      case MessageType::EXPORT_JSON:
+        break;
+      case MessageType::CANCEL:
+        session.cancelJobs();
+        return;
+      default:
+        sendError(client, job_id, "Unknown message type");
+        return;
+    }
+    if (!session.submitJob(reader.type(), job_id, count, time_budget)) {
+      sendError(client, job_id, "Job queue is full");
+      return;
+    }
+    server_->sendBinaryMessage(client, MessageWriter(MessageType::JOB_ACCEPTED, job_id).data());
+  }
+  catch (const std::exception& err) {
+    sendError(client, job_id, err.what());
+  }
+}
+
+void PlannerService::sendError(QWebSocket* client, const uint32_t job_id, const std::string& error_message) {
+  MessageWriter writer(MessageType::ERROR_MESSAGE, job_id);
+  writer.writeString(error_message);
+  server_->sendBinaryMessage(client, writer.data());
+}
+
+}
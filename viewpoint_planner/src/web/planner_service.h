@@ -0,0 +1,137 @@
+//==================================================
+// planner_service.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 18.05.17
+//==================================================
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <bh/thread.h>
+#include "../planner/viewpoint_planner.h"
+#include "planner_service_protocol.h"
+#include "web_socket_server.h"
+
+namespace planner_service {
+
+///
+/// Planning session of a single client.
+/// Each session has its own viewpoint planner (viewpoint graph and paths) but shares the
+/// planner data (octree, BVH, reconstruction) with the other sessions. The viewpoint graph is loaded
+/// and jobs are run in order on a worker thread. Results are reported with the messageReady signal.
+///
+class PlannerSession : public QObject {
+
+  Q_OBJECT
+
+public:
+  struct Job {
+    MessageType type;
+    uint32_t job_id;
+    uint32_t count;
+    double time_budget;
+    uint32_t cancel_generation;
+  };
+
+  /// Has to be called from the main thread because the planner sets up its offscreen OpenGL context.
+  PlannerSession(std::shared_ptr<ViewpointPlannerData> planner_data,
+                 const ViewpointPlanner::Options* planner_options,
+                 const ViewpointPlanner::MotionPlannerType::Options* motion_options,
+                 const std::string& viewpoint_graph_filename,
+                 const std::size_t max_queued_jobs);
+
+  ~PlannerSession();
+
+  /// Returns false if the job queue is full.
+  bool submitJob(const MessageType type, const uint32_t job_id, const uint32_t count, const double time_budget);
+
+  /// Cancels the running and all queued jobs.
+  void cancelJobs();
+
+  /// Cancels all jobs and lets the worker thread finish without waiting for it.
+  /// The closed signal is emitted from the worker thread when it is done.
+  void close();
+
+signals:
+  void messageReady(QByteArray message);
+
+  void closed();
+
+private:
+  void run();
+
+  void runJob(const Job& job);
+
+  bool isCanceled(const Job& job) const;
+
+  JobStatus sampleCandidates(const Job& job, std::string* status_message);
+
+  JobStatus computePath(const Job& job, std::string* status_message);
+
+  void sendProgress(const uint32_t job_id, const std::size_t current, const std::size_t total);
+
+  void sendPathUpdate(const uint32_t job_id);
+
+  /// Sends the voxels whose observed information changed since the last coverage update.
+  void sendCoverageUpdate(const uint32_t job_id);
+
+  void sendJobFinished(const uint32_t job_id, const JobStatus status, const std::string& status_message);
+
+  void sendError(const uint32_t job_id, const std::string& error_message);
+
+  void send(const MessageWriter& writer);
+
+  std::unique_ptr<ViewpointPlanner> planner_;
+  std::string viewpoint_graph_filename_;
+  bh::BoundedQueue<Job> job_queue_;
+  std::atomic<uint32_t> cancel_generation_;
+  // Observed information of voxels that was last sent to the client
+  std::unordered_map<const ViewpointPlanner::VoxelType*, ViewpointPlanner::FloatType> sent_voxel_information_;
+  std::thread worker_thread_;
+};
+
+///
+/// Local planning service. Clients connect with a WebSocket and send jobs with the binary protocol
+/// in planner_service_protocol.h. The scene data is loaded once and kept in memory for all sessions.
+///
+class PlannerService : public QObject {
+
+  Q_OBJECT
+
+public:
+  PlannerService(WebSocketServer* server,
+                 std::shared_ptr<ViewpointPlannerData> planner_data,
+                 const ViewpointPlanner::Options* planner_options,
+                 const ViewpointPlanner::MotionPlannerType::Options* motion_options,
+                 const std::string& viewpoint_graph_filename,
+                 QObject* parent = nullptr);
+
+  ~PlannerService();
+
+private Q_SLOTS:
+  void onClientConnected(QWebSocket* client);
+  void onClientDisconnected(QWebSocket* client);
+  void onBinaryMessageReceived(QWebSocket* client, QByteArray message);
+
+private:
+  void sendError(QWebSocket* client, const uint32_t job_id, const std::string& error_message);
+
+  static constexpr std::size_t kMaxQueuedJobs = 16;
+
+  WebSocketServer* server_;
+  std::shared_ptr<ViewpointPlannerData> planner_data_;
+  const ViewpointPlanner::Options* planner_options_;
+  const ViewpointPlanner::MotionPlannerType::Options* motion_options_;
+  std::string viewpoint_graph_filename_;
+  std::unordered_map<QWebSocket*, std::unique_ptr<PlannerSession>> sessions_;
+};
+
+}
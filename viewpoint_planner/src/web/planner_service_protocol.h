@@ -0,0 +1,164 @@
+//==================================================
+// planner_service_protocol.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 18.05.17
+//==================================================
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <QtCore/QByteArray>
+#include <bh/common.h>
+
+/// Binary protocol of the planner service.
+///
+/// Each WebSocket binary message starts with a header
+///   uint8 message type | uint32 job id
+/// followed by the payload of the message type. All values are little-endian.
+/// Strings are encoded as uint32 length followed by the UTF-8 bytes.
+namespace planner_service {
+
+enum class MessageType : uint8_t {
+  // Client requests
+  // Payload: uint32 number of viewpoint candidates in the viewpoint graph after sampling
+  SAMPLE_CANDIDATES = 0x01,
+  // Payload: uint32 number of viewpoints on the path, float64 time budget in seconds (<= 0 for no budget)
+  COMPUTE_PATH = 0x02,
+  // Payload: none. The JSON of the best viewpoint path is returned with a JSON_RESULT message.
+  EXPORT_JSON = 0x03,
+  // Payload: none. Cancels the running and all queued jobs of the session.
+  CANCEL = 0x04,
+
+  // Server responses
+  // Payload: none
+  JOB_ACCEPTED = 0x81,
+  // Payload: uint32 current, uint32 total
+  PROGRESS = 0x82,
+  // Payload: float32 acc_information, float32 acc_motion_distance, uint32 number of entries,
+  //          per entry: uint32 viewpoint index, uint8 mvs flag, 3 x float32 position, 4 x float32 quaternion (w, x, y, z)
+  //          in the order of the flight path.
+  PATH_UPDATE = 0x83,
+  // Payload: uint32 number of observed voxels on the path, uint32 number of changed voxels,
+  //          per changed voxel: 3 x float32 center, float32 size, float32 observed information
+  COVERAGE_UPDATE = 0x84,
+  // Payload: uint8 job status (JobStatus), string status message
+  JOB_FINISHED = 0x85,
+  // Payload: string JSON document
+  JSON_RESULT = 0x86,
+  // Payload: string error message
+  ERROR_MESSAGE = 0x87,
+};
+
+enum class JobStatus : uint8_t {
+  SUCCESS = 0,
+  CANCELED = 1,
+  TIME_BUDGET_EXCEEDED = 2,
+  FAILED = 3,
+};
+
+/// Appends little-endian values to a message
+class MessageWriter {
+public:
+  MessageWriter(const MessageType type, const uint32_t job_id) {
+    write<uint8_t>(static_cast<uint8_t>(type));
+    write<uint32_t>(job_id);
+  }
+
+  template <typename T>
+  MessageWriter& write(const T value) {
+    static_assert(std::is_arithmetic<T>::value, "Only arithmetic types can be written");
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if (!isHostLittleEndian()) {
+      std::reverse(bytes, bytes + sizeof(T));
+    }
+    data_.append(bytes, sizeof(T));
+    return *this;
+  }
+
+  MessageWriter& writeString(const std::string& str) {
+    write<uint32_t>(static_cast<uint32_t>(str.size()));
+    data_.append(str.data(), static_cast<int>(str.size()));
+    return *this;
+  }
+
+  const QByteArray& data() const {
+    return data_;
+  }
+
+private:
+  static bool isHostLittleEndian() {
+    const uint16_t value = 1;
+    char byte;
+    std::memcpy(&byte, &value, 1);
+    return byte == 1;
+  }
+
+  QByteArray data_;
+};
+
+/// Reads little-endian values from a message. Throws if the message is too short.
+class MessageReader {
+public:
+  explicit MessageReader(const QByteArray& data)
+      : data_(data), offset_(0) {
+    type_ = static_cast<MessageType>(read<uint8_t>());
+    job_id_ = read<uint32_t>();
+  }
+
+  MessageType type() const {
+    return type_;
+  }
+
+  uint32_t jobId() const {
+    return job_id_;
+  }
+
+  template <typename T>
+  T read() {
+    static_assert(std::is_arithmetic<T>::value, "Only arithmetic types can be read");
+    if (offset_ + sizeof(T) > static_cast<std::size_t>(data_.size())) {
+      throw BH_EXCEPTION("Planner service message is too short");
+    }
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, data_.constData() + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    if (!isHostLittleEndian()) {
+      std::reverse(bytes, bytes + sizeof(T));
+    }
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+  }
+
+  std::string readString() {
+    const std::size_t length = read<uint32_t>();
+    if (offset_ + length > static_cast<std::size_t>(data_.size())) {
+      throw BH_EXCEPTION("Planner service message is too short");
+    }
+    const std::string str(data_.constData() + offset_, length);
+    offset_ += length;
+    return str;
+  }
+
+private:
+  static bool isHostLittleEndian() {
+    const uint16_t value = 1;
+    char byte;
+    std::memcpy(&byte, &value, 1);
+    return byte == 1;
+  }
+
+  const QByteArray& data_;
+  std::size_t offset_;
+  MessageType type_;
+  uint32_t job_id_;
+};
+
+}
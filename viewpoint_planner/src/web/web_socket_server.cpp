@@ -6,6 +6,7 @@
 //  Created on: Jan 14, 2017
 //==================================================
 
+#include <algorithm>
 #include <iostream>
 
 #include <QtWebSockets/qwebsocketserver.h>
@@ -21,10 +22,15 @@ using std::endl;
 QT_USE_NAMESPACE
 
 WebSocketServer::WebSocketServer(quint16 port, QObject *parent /*= nullptr*/)
+: WebSocketServer(port, QHostAddress::Any, true, parent) {}
+
+WebSocketServer::WebSocketServer(quint16 port, const QHostAddress& address, bool echo_messages,
+                                 QObject *parent /*= nullptr*/)
 : QObject(parent),
   web_socket_server_(new QWebSocketServer(QStringLiteral("Quad3DR server"),
-      QWebSocketServer::NonSecureMode, this)) {
-  if (web_socket_server_->listen(QHostAddress::Any, port)) {
+      QWebSocketServer::NonSecureMode, this)),
+  echo_messages_(echo_messages) {
+  if (web_socket_server_->listen(address, port)) {
     cout << "WebSocketServer: Listening on port " << port << endl;
     connect(web_socket_server_, &QWebSocketServer::newConnection,
         this, &WebSocketServer::onNewConnection);
@@ -43,6 +49,10 @@ WebSocketServer::~WebSocketServer()
   web_socket_server_->close();
 }
 
+bool WebSocketServer::isListening() const {
+  return web_socket_server_->isListening();
+}
+
 void WebSocketServer::sendTextMessage(const std::string& msg) {
 //  cout << "WebSocketServer: Sending: " << msg << endl;
   for (QWebSocket* client : clients_) {
@@ -56,6 +66,12 @@ void WebSocketServer::sendBinaryMessage(const std::string& msg) {
   }
 }
 
+void WebSocketServer::sendBinaryMessage(QWebSocket* client, const QByteArray& msg) {
+  if (std::find(clients_.begin(), clients_.end(), client) != clients_.end()) {
+    client->sendBinaryMessage(msg);
+  }
+}
+
 void WebSocketServer::onNewConnection()
 {
     QWebSocket* client = web_socket_server_->nextPendingConnection();
@@ -67,24 +83,33 @@ void WebSocketServer::onNewConnection()
     clients_.push_back(client);
     cout << "WebSocketServer: Connection " << clients_.size()
         << " from " << getPeerString(client) << endl;
+    emit clientConnected(client);
 }
 
 void WebSocketServer::processTextMessage(QString message)
 {
     QWebSocket* client = qobject_cast<QWebSocket*>(sender());
-    cout << "WebSocketServer: Message received from " << getPeerString(client) << ":" << message.toStdString() << endl;
-    if (client) {
+    if (!client) {
+      return;
+    }
+    if (echo_messages_) {
+      cout << "WebSocketServer: Message received from " << getPeerString(client) << ":" << message.toStdString() << endl;
       client->sendTextMessage(message);
     }
+    emit textMessageReceived(client, message);
 }
 
 void WebSocketServer::processBinaryMessage(QByteArray message)
 {
     QWebSocket* client = qobject_cast<QWebSocket*>(sender());
-    cout << "WebSocketServer: Binary message received from " << getPeerString(client) << ":" << message.toStdString() << endl;
-    if (client) {
+    if (!client) {
+      return;
+    }
+    if (echo_messages_) {
+      cout << "WebSocketServer: Binary message received from " << getPeerString(client) << ":" << message.toStdString() << endl;
       client->sendBinaryMessage(message);
     }
+    emit binaryMessageReceived(client, message);
 }
 
 void WebSocketServer::socketDisconnected()
@@ -93,6 +118,7 @@ void WebSocketServer::socketDisconnected()
     cout << "WebSocketServer: Connection from " << getPeerString(client) << " closed" << endl;
     if (client) {
       clients_.erase(std::remove(clients_.begin(), clients_.end(), client));
+      emit clientDisconnected(client);
       client->deleteLater();
     }
 }
@@ -11,6 +11,7 @@
 #include <QtCore/QObject>
 #include <QtCore/QList>
 #include <QtCore/QByteArray>
+#include <QtNetwork/QHostAddress>
 
 QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
 QT_FORWARD_DECLARE_CLASS(QWebSocket)
@@ -21,14 +22,26 @@ class WebSocketServer : public QObject {
 
 public:
   explicit WebSocketServer(quint16 port, QObject* parent = nullptr);
+
+  /// If echo_messages is false received messages are only reported with the message signals.
+  WebSocketServer(quint16 port, const QHostAddress& address, bool echo_messages, QObject* parent = nullptr);
+
   ~WebSocketServer();
 
+  bool isListening() const;
+
   void sendTextMessage(const std::string& msg);
 
   void sendBinaryMessage(const std::string& msg);
 
+  void sendBinaryMessage(QWebSocket* client, const QByteArray& msg);
+
 signals:
   void closed();
+  void clientConnected(QWebSocket* client);
+  void clientDisconnected(QWebSocket* client);
+  void textMessageReceived(QWebSocket* client, QString message);
+  void binaryMessageReceived(QWebSocket* client, QByteArray message);
 
 private Q_SLOTS:
   void onNewConnection();
@@ -39,6 +52,7 @@ private Q_SLOTS:
 private:
   QWebSocketServer* web_socket_server_;
   std::vector<QWebSocket*> clients_;
+  bool echo_messages_;
 
   std::string getPeerString(const QWebSocket* socket) const;
 };
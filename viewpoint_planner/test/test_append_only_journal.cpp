@@ -0,0 +1,104 @@
+//==================================================
+// test_append_only_journal.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 20.05.17
+//
+
+#include <cstdio>
+#include <fstream>
+#include "gtest/gtest.h"
+#include <bh/append_only_journal.h>
+
+namespace {
+using bh::AppendOnlyJournal;
+
+class AppendOnlyJournalTest : public ::testing::Test {
+protected:
+  AppendOnlyJournalTest()
+      : filename(::testing::TempDir() + "test_append_only_journal.log") {
+    std::remove(filename.c_str());
+  }
+
+  ~AppendOnlyJournalTest() override {
+    std::remove(filename.c_str());
+  }
+
+  std::size_t writeRecords(const std::size_t num_records) {
+    AppendOnlyJournal journal(4, 10);
+    journal.open(filename, 0);
+    for (std::size_t i = 0; i < num_records; ++i) {
+      journal.append(static_cast<uint32_t>(i), std::string(i, 'a' + i % 26));
+    }
+    journal.close();
+    return journal.size();
+  }
+
+  std::string filename;
+};
+}
+
+TEST_F(AppendOnlyJournalTest, RecordsShouldBeReadBack) {
+  const std::size_t size = writeRecords(10);
+  std::vector<AppendOnlyJournal::Record> records;
+  EXPECT_EQ(AppendOnlyJournal::readRecords(filename, &records), size);
+  ASSERT_EQ(records.size(), 10);
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    EXPECT_EQ(records[i].type, i);
+    EXPECT_EQ(records[i].payload, std::string(i, 'a' + i % 26));
+  }
+}
+
+TEST_F(AppendOnlyJournalTest, MissingFileShouldHaveNoRecords) {
+  std::vector<AppendOnlyJournal::Record> records;
+  EXPECT_EQ(AppendOnlyJournal::readRecords(filename, &records), 0);
+  EXPECT_TRUE(records.empty());
+}
+
+TEST_F(AppendOnlyJournalTest, TornRecordShouldBeIgnoredAndCutOff) {
+  const std::size_t size = writeRecords(5);
+  {
+    // Partially written record at the end of the file
+    std::ofstream ofs(filename, std::ios::binary | std::ios::app);
+    const uint32_t header[2] = { 7, 100 };
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    ofs << "partial";
+  }
+  std::vector<AppendOnlyJournal::Record> records;
+  const std::size_t valid_size = AppendOnlyJournal::readRecords(filename, &records);
+  EXPECT_EQ(valid_size, size);
+  EXPECT_EQ(records.size(), 5);
+
+  AppendOnlyJournal journal;
+  journal.open(filename, valid_size);
+  journal.append(42, "resumed");
+  journal.close();
+  AppendOnlyJournal::readRecords(filename, &records);
+  ASSERT_EQ(records.size(), 6);
+  EXPECT_EQ(records.back().type, 42);
+  EXPECT_EQ(records.back().payload, "resumed");
+}
+
+TEST_F(AppendOnlyJournalTest, CorruptedRecordShouldEndJournal) {
+  writeRecords(5);
+  {
+    // Flip a payload byte of the third record (header 8 bytes, payload i bytes, checksum 4 bytes)
+    std::fstream fs(filename, std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp((8 + 0 + 4) + (8 + 1 + 4) + 8);
+    fs.put('z');
+  }
+  std::vector<AppendOnlyJournal::Record> records;
+  AppendOnlyJournal::readRecords(filename, &records);
+  EXPECT_EQ(records.size(), 2);
+}
+
+TEST_F(AppendOnlyJournalTest, FileChecksumShouldDependOnContent) {
+  EXPECT_EQ(AppendOnlyJournal::computeFileChecksum(filename), 0);
+  writeRecords(3);
+  const uint32_t checksum = AppendOnlyJournal::computeFileChecksum(filename);
+  EXPECT_NE(checksum, 0);
+  EXPECT_EQ(AppendOnlyJournal::computeFileChecksum(filename), checksum);
+  writeRecords(4);
+  EXPECT_NE(AppendOnlyJournal::computeFileChecksum(filename), checksum);
+}
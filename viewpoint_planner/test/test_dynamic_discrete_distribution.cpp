@@ -0,0 +1,178 @@
+//==================================================
+// test_dynamic_discrete_distribution.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 17.05.17
+//
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+#include <bh/math/dynamic_discrete_distribution.h>
+#include <bh/random.h>
+
+namespace {
+using FloatType = double;
+using size_t = std::size_t;
+using Distribution = bh::DynamicDiscreteDistribution<FloatType>;
+using RandomStream = bh::RandomStream<FloatType>;
+
+const size_t kNumSamples = 200000;
+// Allowed deviation of the sampled frequencies in standard deviations of the binomial distribution
+const FloatType kMaxSigmas = 5;
+
+/// Small integer weights so that all sums are exact
+std::vector<FloatType> generateWeights(const size_t num_weights, std::mt19937_64* rnd) {
+  std::uniform_int_distribution<int> weight_dist(0, 10);
+  std::vector<FloatType> weights;
+  for (size_t i = 0; i < num_weights; ++i) {
+    weights.push_back(weight_dist(*rnd));
+  }
+  return weights;
+}
+
+void expectSameWeights(const Distribution& distribution, const std::vector<FloatType>& weights) {
+  ASSERT_EQ(distribution.size(), weights.size());
+  FloatType prefix_weight = 0;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    EXPECT_EQ(distribution.weight(i), weights[i]);
+    EXPECT_EQ(distribution.prefixWeight(i), prefix_weight);
+    prefix_weight += weights[i];
+  }
+  EXPECT_EQ(distribution.prefixWeight(weights.size()), prefix_weight);
+  EXPECT_EQ(distribution.totalWeight(), prefix_weight);
+}
+
+/// Index of the element whose cumulative weight range [prefix(i), prefix(i + 1)) contains u * total weight
+size_t sampleReference(const std::vector<FloatType>& weights, const FloatType u) {
+  std::vector<FloatType> cumulative_weights(weights.size());
+  std::partial_sum(weights.begin(), weights.end(), cumulative_weights.begin());
+  const FloatType target = u * cumulative_weights.back();
+  const auto it = std::upper_bound(cumulative_weights.begin(), cumulative_weights.end(), target);
+  return std::min<size_t>(it - cumulative_weights.begin(), weights.size() - 1);
+}
+
+/// Compares sampled frequencies with the probabilities of std::discrete_distribution for the same weights
+void expectSamplingFrequencies(const Distribution& distribution, const std::vector<FloatType>& weights,
+                               RandomStream* random) {
+  const std::vector<double> probabilities = std::discrete_distribution<size_t>(
+      weights.begin(), weights.end()).probabilities();
+  std::vector<size_t> counts(weights.size(), 0);
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    const size_t index = distribution(*random);
+    ASSERT_LT(index, weights.size());
+    ++counts[index];
+  }
+  for (size_t i = 0; i < weights.size(); ++i) {
+    const FloatType expected_count = probabilities[i] * kNumSamples;
+    const FloatType sigma = std::sqrt(kNumSamples * probabilities[i] * (1 - probabilities[i]));
+    if (probabilities[i] == 0) {
+      EXPECT_EQ(counts[i], 0u);
+    }
+    else {
+      EXPECT_NEAR(counts[i], expected_count, kMaxSigmas * sigma) << "index " << i;
+    }
+  }
+}
+}
+
+TEST(DynamicDiscreteDistributionTest, EmptyDistribution) {
+  Distribution distribution;
+  EXPECT_TRUE(distribution.empty());
+  EXPECT_EQ(distribution.size(), 0u);
+  EXPECT_EQ(distribution.totalWeight(), 0);
+  distribution.push_back(1);
+  EXPECT_FALSE(distribution.empty());
+  distribution.clear();
+  EXPECT_TRUE(distribution.empty());
+  EXPECT_EQ(distribution.totalWeight(), 0);
+}
+
+TEST(DynamicDiscreteDistributionTest, PushBackShouldMatchAssign) {
+  std::mt19937_64 rnd;
+  for (const size_t num_weights : { 1, 2, 3, 7, 8, 9, 100, 1000 }) {
+    const std::vector<FloatType> weights = generateWeights(num_weights, &rnd);
+    Distribution assigned_distribution;
+    assigned_distribution.assign(weights.begin(), weights.end());
+    expectSameWeights(assigned_distribution, weights);
+    Distribution pushed_distribution;
+    for (const FloatType weight : weights) {
+      pushed_distribution.push_back(weight);
+    }
+    expectSameWeights(pushed_distribution, weights);
+  }
+}
+
+TEST(DynamicDiscreteDistributionTest, SetWeightShouldUpdatePrefixWeights) {
+  std::mt19937_64 rnd;
+  std::vector<FloatType> weights = generateWeights(100, &rnd);
+  Distribution distribution;
+  distribution.assign(weights.begin(), weights.end());
+  std::uniform_int_distribution<size_t> index_dist(0, weights.size() - 1);
+  std::uniform_int_distribution<int> weight_dist(0, 10);
+  for (size_t i = 0; i < 1000; ++i) {
+    const size_t index = index_dist(rnd);
+    weights[index] = weight_dist(rnd);
+    distribution.setWeight(index, weights[index]);
+  }
+  expectSameWeights(distribution, weights);
+  // Appending after updates has to take the updated weights into account
+  for (size_t i = 0; i < 50; ++i) {
+    weights.push_back(weight_dist(rnd));
+    distribution.push_back(weights.back());
+  }
+  expectSameWeights(distribution, weights);
+}
+
+TEST(DynamicDiscreteDistributionTest, SampleShouldMatchCumulativeWeights) {
+  std::mt19937_64 rnd;
+  const std::vector<FloatType> weights = generateWeights(37, &rnd);
+  Distribution distribution;
+  distribution.assign(weights.begin(), weights.end());
+  const size_t num_steps = 10000;
+  for (size_t i = 0; i < num_steps; ++i) {
+    const FloatType u = i / FloatType(num_steps);
+    EXPECT_EQ(distribution.sample(u), sampleReference(weights, u)) << "u=" << u;
+  }
+}
+
+TEST(DynamicDiscreteDistributionTest, ZeroWeightsShouldNeverBeSampled) {
+  const std::vector<FloatType> weights = { 0, 0, 3, 0, 1, 0, 0, 2, 0 };
+  Distribution distribution;
+  distribution.assign(weights.begin(), weights.end());
+  const size_t num_steps = 10000;
+  for (size_t i = 0; i < num_steps; ++i) {
+    const FloatType u = i / FloatType(num_steps);
+    EXPECT_GT(weights[distribution.sample(u)], 0) << "u=" << u;
+  }
+  // Largest value below 1
+  EXPECT_EQ(distribution.sample(std::nextafter(FloatType(1), FloatType(0))), 7u);
+  // Elements that are set to zero are not sampled any more
+  distribution.setWeight(2, 0);
+  distribution.setWeight(7, 0);
+  for (size_t i = 0; i < num_steps; ++i) {
+    const FloatType u = i / FloatType(num_steps);
+    EXPECT_EQ(distribution.sample(u), 4u) << "u=" << u;
+  }
+}
+
+TEST(DynamicDiscreteDistributionTest, SamplingFrequenciesShouldMatchDiscreteDistribution) {
+  std::mt19937_64 rnd;
+  std::vector<FloatType> weights = generateWeights(20, &rnd);
+  Distribution distribution;
+  distribution.assign(weights.begin(), weights.end());
+  RandomStream random(42, 0);
+  expectSamplingFrequencies(distribution, weights, &random);
+  // Updated and appended weights
+  weights[3] = 0;
+  distribution.setWeight(3, 0);
+  weights[11] = 25;
+  distribution.setWeight(11, 25);
+  weights.push_back(7);
+  distribution.push_back(7);
+  expectSamplingFrequencies(distribution, weights, &random);
+}
@@ -0,0 +1,194 @@
+//==================================================
+// test_hash_grid_nearest_neighbor.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 16.05.17
+//
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+#include <bh/nn/hash_grid_nearest_neighbor.h>
+#include "gtest/gtest.h"
+
+namespace {
+using FloatType = float;
+using size_t = std::size_t;
+
+const size_t kNumPoints = 1000;
+const size_t kNumQueries = 200;
+const size_t kKnn = 20;
+const FloatType kCellSize = 2;
+
+using NNType = bh::HashGridNearestNeighbor<FloatType>;
+using PointType = NNType::Point;
+using Neighbor = std::pair<NNType::DistanceType, NNType::IndexType>;
+
+/// Reference result sorted by increasing distance (ties are broken by the point index)
+std::vector<Neighbor> computeBruteForceNeighbors(const std::vector<PointType>& points, const PointType& query_point) {
+  std::vector<Neighbor> neighbors;
+  for (size_t i = 0; i < points.size(); ++i) {
+    neighbors.emplace_back((points[i] - query_point).squaredNorm(), i);
+  }
+  std::sort(neighbors.begin(), neighbors.end());
+  return neighbors;
+}
+
+void expectSameNeighbors(const std::vector<Neighbor>& expected_neighbors,
+                         const std::vector<NNType::IndexType>& indices,
+                         const std::vector<NNType::DistanceType>& distances) {
+  ASSERT_EQ(indices.size(), expected_neighbors.size());
+  ASSERT_EQ(distances.size(), expected_neighbors.size());
+  for (size_t i = 0; i < expected_neighbors.size(); ++i) {
+    EXPECT_EQ(distances[i], expected_neighbors[i].first);
+    EXPECT_EQ(indices[i], expected_neighbors[i].second);
+  }
+}
+
+class HashGridNearestNeighborTest : public ::testing::Test {
+protected:
+  HashGridNearestNeighborTest()
+      : nn(kCellSize), uniform_dist(-10, 10), cell_dist(-5, 5) {
+    for (size_t i = 0; i < kNumPoints; ++i) {
+      points.push_back(getRandomPoint());
+    }
+    // Points on cell boundaries (multiples of the cell size)
+    for (size_t i = 0; i < kNumPoints / 4; ++i) {
+      points.push_back(getRandomCellCorner());
+    }
+    for (const PointType& point : points) {
+      nn.addPoint(point);
+    }
+    for (size_t i = 0; i < kNumQueries; ++i) {
+      query_points.push_back(getRandomPoint());
+      query_points.push_back(getRandomCellCorner());
+    }
+    // Queries outside of the occupied cells
+    query_points.push_back(PointType(100, -100, 50));
+    query_points.push_back(PointType(-1000, 0, 0));
+  }
+
+  virtual ~HashGridNearestNeighborTest() override {}
+
+  PointType getRandomPoint() {
+    return PointType(uniform_dist(rnd), uniform_dist(rnd), uniform_dist(rnd));
+  }
+
+  PointType getRandomCellCorner() {
+    return kCellSize * PointType(cell_dist(rnd), cell_dist(rnd), cell_dist(rnd));
+  }
+
+  std::mt19937_64 rnd;
+  NNType nn;
+  std::uniform_real_distribution<FloatType> uniform_dist;
+  std::uniform_int_distribution<int> cell_dist;
+  std::vector<PointType> points;
+  std::vector<PointType> query_points;
+};
+}
+
+TEST(HashGridNearestNeighborEmptyTest, QueriesOnEmptyGridShouldReturnNothing) {
+  NNType nn(kCellSize);
+  EXPECT_TRUE(nn.empty());
+  EXPECT_EQ(nn.numPoints(), 0u);
+  EXPECT_EQ(nn.numCells(), 0u);
+  std::vector<NNType::IndexType> indices(3, 0);
+  std::vector<NNType::DistanceType> distances(3, 0);
+  nn.knnSearch(PointType(0, 0, 0), kKnn, &indices, &distances);
+  EXPECT_TRUE(indices.empty());
+  EXPECT_TRUE(distances.empty());
+  indices.resize(3);
+  distances.resize(3);
+  nn.radiusSearch(PointType(0, 0, 0), 100, kNumPoints, &indices, &distances);
+  EXPECT_TRUE(indices.empty());
+  EXPECT_TRUE(distances.empty());
+}
+
+TEST(HashGridNearestNeighborEmptyTest, ClearShouldRemoveAllPoints) {
+  NNType nn(kCellSize);
+  nn.addPoint(PointType(1, 2, 3));
+  ASSERT_FALSE(nn.empty());
+  nn.clear();
+  EXPECT_TRUE(nn.empty());
+  EXPECT_EQ(nn.numCells(), 0u);
+  EXPECT_TRUE(nn.knnSearch(PointType(1, 2, 3), 1).indices.empty());
+}
+
+TEST_F(HashGridNearestNeighborTest, AddPointsShouldBeCorrect) {
+  ASSERT_EQ(nn.numPoints(), points.size());
+  for (size_t i = 0; i < nn.numPoints(); ++i) {
+    EXPECT_EQ(nn.getPoint(i), points[i]);
+  }
+}
+
+TEST_F(HashGridNearestNeighborTest, KnnSearchShouldMatchBruteForce) {
+  std::vector<NNType::IndexType> indices;
+  std::vector<NNType::DistanceType> distances;
+  for (const PointType& query_point : query_points) {
+    std::vector<Neighbor> expected_neighbors = computeBruteForceNeighbors(points, query_point);
+    expected_neighbors.resize(kKnn);
+    nn.knnSearch(query_point, kKnn, &indices, &distances);
+    expectSameNeighbors(expected_neighbors, indices, distances);
+  }
+}
+
+TEST_F(HashGridNearestNeighborTest, KnnSearchWithMoreNeighborsThanPointsShouldReturnAllPoints) {
+  const PointType query_point(0, 0, 0);
+  const std::vector<Neighbor> expected_neighbors = computeBruteForceNeighbors(points, query_point);
+  const NNType::SingleResult result = nn.knnSearch(query_point, 2 * points.size());
+  expectSameNeighbors(expected_neighbors, result.indices, result.distances);
+}
+
+TEST_F(HashGridNearestNeighborTest, RadiusSearchShouldMatchBruteForce) {
+  std::vector<NNType::IndexType> indices;
+  std::vector<NNType::DistanceType> distances;
+  // Radii below, at and above the cell size. The squared cell size hits points on cell boundaries exactly.
+  for (const FloatType radius_square : { FloatType(0.5), kCellSize * kCellSize, FloatType(30) }) {
+    for (const PointType& query_point : query_points) {
+      std::vector<Neighbor> expected_neighbors = computeBruteForceNeighbors(points, query_point);
+      expected_neighbors.erase(std::find_if(expected_neighbors.begin(), expected_neighbors.end(),
+                                            [&](const Neighbor& neighbor) {
+                                              return neighbor.first > radius_square;
+                                            }),
+                               expected_neighbors.end());
+      nn.radiusSearch(query_point, radius_square, points.size(), &indices, &distances);
+      expectSameNeighbors(expected_neighbors, indices, distances);
+    }
+  }
+}
+
+TEST_F(HashGridNearestNeighborTest, RadiusSearchShouldReturnAtMostMaxResults) {
+  std::vector<NNType::IndexType> indices;
+  std::vector<NNType::DistanceType> distances;
+  const PointType query_point(0, 0, 0);
+  const FloatType radius_square = 30;
+  const size_t max_results = 5;
+  std::vector<Neighbor> expected_neighbors = computeBruteForceNeighbors(points, query_point);
+  ASSERT_GT(expected_neighbors[max_results].first, 0);
+  ASSERT_LE(expected_neighbors[max_results].first, radius_square);
+  expected_neighbors.resize(max_results);
+  nn.radiusSearch(query_point, radius_square, max_results, &indices, &distances);
+  expectSameNeighbors(expected_neighbors, indices, distances);
+}
+
+TEST_F(HashGridNearestNeighborTest, SetCellSizeShouldKeepPointsAndResults) {
+  nn.setCellSize(kCellSize / 4);
+  ASSERT_EQ(nn.numPoints(), points.size());
+  for (size_t i = 0; i < nn.numPoints(); ++i) {
+    EXPECT_EQ(nn.getPoint(i), points[i]);
+  }
+  for (const PointType& query_point : query_points) {
+    std::vector<Neighbor> expected_neighbors = computeBruteForceNeighbors(points, query_point);
+    expected_neighbors.resize(kKnn);
+    const NNType::SingleResult result = nn.knnSearch(query_point, kKnn);
+    expectSameNeighbors(expected_neighbors, result.indices, result.distances);
+  }
+}
+
+TEST_F(HashGridNearestNeighborTest, PointsOutsideOfGridRangeShouldThrow) {
+  const size_t num_points = nn.numPoints();
+  EXPECT_THROW(nn.addPoint(PointType(kCellSize * (FloatType(1) * (1 << 21)), 0, 0)), bh::Exception);
+  EXPECT_EQ(nn.numPoints(), num_points);
+}
@@ -0,0 +1,102 @@
+//==================================================
+// test_object_arena.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 24.05.17
+//
+
+#include <array>
+#include <set>
+#include <vector>
+#include "gtest/gtest.h"
+#include <bh/memory.h>
+
+namespace {
+struct Node {
+  Node* children;
+  float occupancy;
+  std::uint32_t count;
+};
+
+using Arena = bh::ObjectArena<Node>;
+}
+
+TEST(ObjectArenaTest, AllocationsShouldBeDistinctAndAligned) {
+  Arena arena;
+  std::set<void*> pointers;
+  for (std::size_t i = 0; i < 10000; ++i) {
+    void* ptr = arena.allocate();
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr) % alignof(Node), 0u);
+    EXPECT_TRUE(pointers.insert(ptr).second);
+  }
+  EXPECT_EQ(arena.numAllocated(), 10000u);
+  EXPECT_GE(arena.memoryUsage(), 10000 * sizeof(Node));
+}
+
+TEST(ObjectArenaTest, FreedObjectsShouldBeReused) {
+  Arena arena;
+  std::vector<void*> pointers;
+  for (std::size_t i = 0; i < 100; ++i) {
+    pointers.push_back(arena.allocate());
+  }
+  const std::size_t memory_usage = arena.memoryUsage();
+  for (void* ptr : pointers) {
+    arena.deallocate(ptr);
+  }
+  EXPECT_EQ(arena.numAllocated(), 0u);
+  const std::set<void*> freed(pointers.begin(), pointers.end());
+  for (std::size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(freed.count(arena.allocate()), 1u);
+  }
+  EXPECT_EQ(arena.memoryUsage(), memory_usage);
+}
+
+TEST(ObjectArenaTest, SlabsShouldGrowGeometricallyUpToTheMaximum) {
+  Arena arena(256);
+  EXPECT_EQ(arena.memoryUsage(), 0u);
+  arena.allocate();
+  const std::size_t first_slab_usage = arena.memoryUsage();
+  EXPECT_LT(first_slab_usage, 2 * Arena::kInitialSlabCapacity * sizeof(Node) + 1024);
+  for (std::size_t i = 1; i < 10 * 256; ++i) {
+    arena.allocate();
+  }
+  // 64 + 128 + 256 + 256 + ... slots for 2560 objects
+  EXPECT_LT(arena.memoryUsage(), (10 * 256 + 256) * sizeof(Node) + 1024);
+}
+
+TEST(ObjectArenaTest, ReleaseShouldFreeEverything) {
+  Arena arena;
+  for (std::size_t i = 0; i < 5000; ++i) {
+    arena.allocate();
+  }
+  arena.release();
+  EXPECT_EQ(arena.numAllocated(), 0u);
+  EXPECT_EQ(arena.memoryUsage(), 0u);
+  // The arena can be used again after a release
+  Node* node = new (arena.allocate()) Node();
+  node->count = 3;
+  EXPECT_EQ(arena.numAllocated(), 1u);
+}
+
+TEST(ObjectArenaTest, SwapShouldExchangeOwnership) {
+  Arena arena1;
+  Arena arena2;
+  void* ptr = arena1.allocate();
+  arena1.swap(arena2);
+  EXPECT_EQ(arena1.numAllocated(), 0u);
+  EXPECT_EQ(arena2.numAllocated(), 1u);
+  arena2.deallocate(ptr);
+  EXPECT_EQ(arena2.allocate(), ptr);
+}
+
+TEST(ObjectArenaTest, ShouldHoldChildArrays) {
+  using ChildArray = std::array<Node*, 8>;
+  bh::ObjectArena<ChildArray> arena;
+  ChildArray* array = new (arena.allocate()) ChildArray();
+  array->fill(nullptr);
+  Node** children = array->data();
+  EXPECT_EQ(static_cast<void*>(children), static_cast<void*>(array));
+  arena.deallocate(reinterpret_cast<ChildArray*>(children));
+  EXPECT_EQ(arena.numAllocated(), 0u);
+}
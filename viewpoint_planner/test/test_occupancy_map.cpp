@@ -0,0 +1,150 @@
+//==================================================
+// test_occupancy_map.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 24.05.17
+//
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+#include "gtest/gtest.h"
+#include "../src/octree/occupancy_map.h"
+
+namespace {
+using TreeType = OccupancyMap<OccupancyNode>;
+using LeafData = TreeType::LeafData;
+using LeafKey = std::tuple<octomap::key_type, octomap::key_type, octomap::key_type, unsigned int>;
+using LeafValue = std::tuple<TreeType::OccupancyType, TreeType::CounterType>;
+
+const double kResolution = 0.1;
+
+std::map<LeafKey, LeafValue> getLeaves(const TreeType& tree) {
+  std::map<LeafKey, LeafValue> leaves;
+  for (auto it = tree.begin_leafs(); it != tree.end_leafs(); ++it) {
+    const octomap::OcTreeKey key = it.getKey();
+    const LeafKey leaf_key = std::make_tuple(key[0], key[1], key[2], it.getDepth());
+    EXPECT_EQ(leaves.count(leaf_key), 0u);
+    leaves.emplace(leaf_key, std::make_tuple(it->getOccupancy(), it->getObservationCount()));
+  }
+  return leaves;
+}
+
+/// Inserts the leaves one by one. Inner nodes are updated and pruned along the way.
+void insertLeaves(const std::vector<LeafData>& leaves, TreeType* tree) {
+  const bool lazy_eval = false;
+  for (const LeafData& leaf : leaves) {
+    tree->setNodeOccupancyAndObservationCount(leaf.key, leaf.occupancy, leaf.observation_count, lazy_eval);
+  }
+}
+
+void expectSameTree(const TreeType& tree, const TreeType& expected_tree) {
+  EXPECT_EQ(tree.size(), expected_tree.size());
+  EXPECT_EQ(tree.getNumLeafNodes(), expected_tree.getNumLeafNodes());
+  const std::map<LeafKey, LeafValue> leaves = getLeaves(tree);
+  const std::map<LeafKey, LeafValue> expected_leaves = getLeaves(expected_tree);
+  ASSERT_EQ(leaves.size(), expected_leaves.size());
+  for (auto it = leaves.begin(), expected_it = expected_leaves.begin(); it != leaves.end(); ++it, ++expected_it) {
+    EXPECT_EQ(it->first, expected_it->first);
+    EXPECT_FLOAT_EQ(std::get<0>(it->second), std::get<0>(expected_it->second));
+    EXPECT_EQ(std::get<1>(it->second), std::get<1>(expected_it->second));
+  }
+  // Inner nodes have to be aggregated as well
+  ASSERT_NE(tree.getRoot(), nullptr);
+  ASSERT_NE(expected_tree.getRoot(), nullptr);
+  EXPECT_FLOAT_EQ(tree.getRoot()->getOccupancy(), expected_tree.getRoot()->getOccupancy());
+  EXPECT_EQ(tree.getRoot()->getObservationCount(), expected_tree.getRoot()->getObservationCount());
+}
+
+/// Leaves with unique keys. Contains a solid block that can be pruned and randomly scattered leaves.
+std::vector<LeafData> generateLeaves(const TreeType& tree) {
+  std::mt19937 random(42);
+  const octomap::key_type center = tree.coordToKey(octomap::point3d(0, 0, 0))[0];
+  std::map<std::tuple<octomap::key_type, octomap::key_type, octomap::key_type>, LeafData> leaves;
+  const auto add_leaf = [&](const octomap::key_type k0, const octomap::key_type k1, const octomap::key_type k2,
+                            const bool occupied, const TreeType::CounterType observation_count) {
+    LeafData leaf;
+    leaf.key = octomap::OcTreeKey(k0, k1, k2);
+    leaf.occupancy = occupied ? tree.getProbHit() : tree.getProbMiss();
+    leaf.observation_count = observation_count;
+    leaves[std::make_tuple(k0, k1, k2)] = leaf;
+  };
+  // Aligned 8x8x8 block of identical leaves collapses into a single node
+  for (octomap::key_type i = 0; i < 8; ++i) {
+    for (octomap::key_type j = 0; j < 8; ++j) {
+      for (octomap::key_type k = 0; k < 8; ++k) {
+        add_leaf(center + i, center + j, center + k, true, 1);
+      }
+    }
+  }
+  std::uniform_int_distribution<int> key_dist(-200, 200);
+  std::uniform_int_distribution<int> occupied_dist(0, 1);
+  std::uniform_int_distribution<TreeType::CounterType> count_dist(0, 3);
+  for (size_t i = 0; i < 2000; ++i) {
+    add_leaf(center + key_dist(random), center + key_dist(random), center - 300 + key_dist(random),
+             occupied_dist(random) == 1, count_dist(random));
+  }
+  std::vector<LeafData> leaf_vector;
+  for (const auto& entry : leaves) {
+    leaf_vector.push_back(entry.second);
+  }
+  std::shuffle(leaf_vector.begin(), leaf_vector.end(), random);
+  return leaf_vector;
+}
+}
+
+TEST(OccupancyMapTest, BuildFromLeavesShouldMatchIncrementalInsertion) {
+  TreeType tree(kResolution);
+  const std::vector<LeafData> leaves = generateLeaves(tree);
+  const bool prune = true;
+  tree.buildFromLeaves(leaves, prune);
+  TreeType expected_tree(kResolution);
+  insertLeaves(leaves, &expected_tree);
+  expectSameTree(tree, expected_tree);
+  // The solid block has been pruned
+  EXPECT_LT(tree.getNumLeafNodes(), leaves.size());
+}
+
+TEST(OccupancyMapTest, BuildFromLeavesWithoutPruningShouldKeepAllLeaves) {
+  TreeType tree(kResolution);
+  const std::vector<LeafData> leaves = generateLeaves(tree);
+  const bool prune = false;
+  tree.buildFromLeaves(leaves, prune);
+  EXPECT_EQ(tree.getNumLeafNodes(), leaves.size());
+  for (const LeafData& leaf : leaves) {
+    const OccupancyNode* node = tree.search(leaf.key, tree.getTreeDepth());
+    ASSERT_NE(node, nullptr);
+    EXPECT_FLOAT_EQ(node->getOccupancy(), leaf.occupancy);
+    EXPECT_EQ(node->getObservationCount(), leaf.observation_count);
+  }
+}
+
+TEST(OccupancyMapTest, BuildFromLeavesShouldPreferHighestOccupancyForDuplicateKeys) {
+  TreeType tree(kResolution);
+  const octomap::key_type center = tree.coordToKey(octomap::point3d(0, 0, 0))[0];
+  std::vector<LeafData> leaves(2);
+  leaves[0].key = octomap::OcTreeKey(center, center, center);
+  leaves[0].occupancy = tree.getProbMiss();
+  leaves[0].observation_count = 2;
+  leaves[1] = leaves[0];
+  leaves[1].occupancy = tree.getProbHit();
+  leaves[1].observation_count = 1;
+  tree.buildFromLeaves(leaves);
+  EXPECT_EQ(tree.getNumLeafNodes(), 1u);
+  const OccupancyNode* node = tree.search(leaves[0].key, tree.getTreeDepth());
+  ASSERT_NE(node, nullptr);
+  EXPECT_FLOAT_EQ(node->getOccupancy(), tree.getProbHit());
+  EXPECT_EQ(node->getObservationCount(), 1u);
+}
+
+TEST(OccupancyMapTest, BuildFromEmptyLeavesShouldClearTree) {
+  TreeType tree(kResolution);
+  tree.updateNode(octomap::point3d(0, 0, 0), true);
+  ASSERT_GT(tree.size(), 0u);
+  tree.buildFromLeaves(std::vector<LeafData>());
+  EXPECT_EQ(tree.size(), 0u);
+  EXPECT_EQ(tree.getRoot(), nullptr);
+}
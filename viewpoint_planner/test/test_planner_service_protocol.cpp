@@ -0,0 +1,88 @@
+//==================================================
+// test_planner_service_protocol.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 24.05.17
+//
+
+#include <string>
+#include "gtest/gtest.h"
+#include "../src/web/planner_service_protocol.h"
+
+namespace {
+using planner_service::JobStatus;
+using planner_service::MessageReader;
+using planner_service::MessageType;
+using planner_service::MessageWriter;
+}
+
+TEST(PlannerServiceProtocolTest, HeaderShouldBeLittleEndian) {
+  const MessageWriter writer(MessageType::SAMPLE_CANDIDATES, 0x01020304);
+  const QByteArray& data = writer.data();
+  ASSERT_EQ(data.size(), 5);
+  EXPECT_EQ(static_cast<uint8_t>(data[0]), 0x01);
+  EXPECT_EQ(static_cast<uint8_t>(data[1]), 0x04);
+  EXPECT_EQ(static_cast<uint8_t>(data[2]), 0x03);
+  EXPECT_EQ(static_cast<uint8_t>(data[3]), 0x02);
+  EXPECT_EQ(static_cast<uint8_t>(data[4]), 0x01);
+}
+
+TEST(PlannerServiceProtocolTest, ComputePathRequestShouldRoundTrip) {
+  MessageWriter writer(MessageType::COMPUTE_PATH, 42);
+  writer.write<uint32_t>(25);
+  writer.write<double>(12.5);
+  const QByteArray data = writer.data();
+  MessageReader reader(data);
+  EXPECT_EQ(reader.type(), MessageType::COMPUTE_PATH);
+  EXPECT_EQ(reader.jobId(), 42);
+  EXPECT_EQ(reader.read<uint32_t>(), 25);
+  EXPECT_EQ(reader.read<double>(), 12.5);
+  EXPECT_THROW(reader.read<uint8_t>(), bh::Exception);
+}
+
+TEST(PlannerServiceProtocolTest, JobFinishedResponseShouldRoundTrip) {
+  MessageWriter writer(MessageType::JOB_FINISHED, 7);
+  writer.write<uint8_t>(static_cast<uint8_t>(JobStatus::TIME_BUDGET_EXCEEDED));
+  writer.writeString("Reached time budget");
+  const QByteArray data = writer.data();
+  MessageReader reader(data);
+  EXPECT_EQ(reader.type(), MessageType::JOB_FINISHED);
+  EXPECT_EQ(reader.jobId(), 7);
+  EXPECT_EQ(static_cast<JobStatus>(reader.read<uint8_t>()), JobStatus::TIME_BUDGET_EXCEEDED);
+  EXPECT_EQ(reader.readString(), "Reached time budget");
+}
+
+TEST(PlannerServiceProtocolTest, PathUpdateResponseShouldRoundTrip) {
+  MessageWriter writer(MessageType::PATH_UPDATE, 3);
+  writer.write<float>(1.5f).write<float>(100.25f).write<uint32_t>(1);
+  writer.write<uint32_t>(9).write<uint8_t>(1);
+  for (const float value : { 1.f, 2.f, 3.f, 1.f, 0.f, 0.f, 0.f }) {
+    writer.write<float>(value);
+  }
+  const QByteArray data = writer.data();
+  MessageReader reader(data);
+  EXPECT_EQ(reader.type(), MessageType::PATH_UPDATE);
+  EXPECT_EQ(reader.read<float>(), 1.5f);
+  EXPECT_EQ(reader.read<float>(), 100.25f);
+  ASSERT_EQ(reader.read<uint32_t>(), 1);
+  EXPECT_EQ(reader.read<uint32_t>(), 9);
+  EXPECT_EQ(reader.read<uint8_t>(), 1);
+  for (const float value : { 1.f, 2.f, 3.f, 1.f, 0.f, 0.f, 0.f }) {
+    EXPECT_EQ(reader.read<float>(), value);
+  }
+  EXPECT_THROW(reader.read<float>(), bh::Exception);
+}
+
+TEST(PlannerServiceProtocolTest, TruncatedHeaderShouldThrow) {
+  const QByteArray data = MessageWriter(MessageType::CANCEL, 1).data().left(3);
+  EXPECT_THROW(MessageReader reader(data), bh::Exception);
+}
+
+TEST(PlannerServiceProtocolTest, TruncatedStringShouldThrow) {
+  MessageWriter writer(MessageType::ERROR_MESSAGE, 5);
+  writer.writeString("Unknown message type");
+  const QByteArray data = writer.data().left(writer.data().size() - 1);
+  MessageReader reader(data);
+  EXPECT_THROW(reader.readString(), bh::Exception);
+}
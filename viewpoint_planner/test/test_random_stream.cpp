@@ -0,0 +1,101 @@
+//==================================================
+// test_random_stream.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 22.05.17
+//
+
+#include <vector>
+#include "gtest/gtest.h"
+#include <bh/random.h>
+
+namespace {
+using bh::Philox4x32;
+using RandomStream = bh::RandomStream<double>;
+using RandomStreamf = bh::RandomStream<float>;
+}
+
+TEST(Philox4x32Test, KnownAnswers) {
+  // Known answer tests of the Random123 reference implementation
+  const Philox4x32::Counter result1 = Philox4x32::generate({{ 0, 0, 0, 0 }}, {{ 0, 0 }});
+  EXPECT_EQ(result1, (Philox4x32::Counter {{ 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 }}));
+  const Philox4x32::Counter result2 = Philox4x32::generate(
+      {{ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }}, {{ 0xffffffff, 0xffffffff }});
+  EXPECT_EQ(result2, (Philox4x32::Counter {{ 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd }}));
+  const Philox4x32::Counter result3 = Philox4x32::generate(
+      {{ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }}, {{ 0xa4093822, 0x299f31d0 }});
+  EXPECT_EQ(result3, (Philox4x32::Counter {{ 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }}));
+}
+
+TEST(RandomStreamTest, StreamsShouldBeReproducibleAndIndependent) {
+  RandomStream stream1(42, 7);
+  RandomStream stream2(42, 7);
+  RandomStream other_stream(42, 8);
+  RandomStream other_seed(43, 7);
+  for (std::size_t i = 0; i < 100; ++i) {
+    const double u = stream1.sampleUniform();
+    EXPECT_EQ(u, stream2.sampleUniform());
+    EXPECT_NE(u, other_stream.sampleUniform());
+    EXPECT_NE(u, other_seed.sampleUniform());
+    EXPECT_GE(u, 0);
+    EXPECT_LT(u, 1);
+  }
+}
+
+TEST(RandomStreamTest, StreamShouldStartAtBlockIndex) {
+  RandomStream stream(42, 7);
+  for (std::size_t i = 0; i < 5 * RandomStream::kUniformsPerBlock; ++i) {
+    stream.sampleUniform();
+  }
+  RandomStream seeked_stream(42, 7, 5);
+  for (std::size_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(stream.sampleUniform(), seeked_stream.sampleUniform());
+  }
+}
+
+TEST(RandomStreamTest, BatchUniformsShouldMatchScalarSamples) {
+  for (const std::size_t offset : { 0, 1, 3 }) {
+    RandomStream scalar_stream(42, 7);
+    RandomStream batch_stream(42, 7);
+    RandomStreamf scalar_streamf(42, 7);
+    RandomStreamf batch_streamf(42, 7);
+    for (std::size_t i = 0; i < offset; ++i) {
+      scalar_stream.sampleUniform();
+      batch_stream.sampleUniform();
+      scalar_streamf.sampleUniform();
+      batch_streamf.sampleUniform();
+    }
+    std::vector<double> uniforms(101);
+    batch_stream.generateUniforms(uniforms.size(), uniforms.data());
+    std::vector<float> uniformsf(101);
+    batch_streamf.generateUniforms(uniformsf.size(), uniformsf.data());
+    for (std::size_t i = 0; i < uniforms.size(); ++i) {
+      EXPECT_EQ(uniforms[i], scalar_stream.sampleUniform());
+      EXPECT_EQ(uniformsf[i], scalar_streamf.sampleUniform());
+    }
+    EXPECT_EQ(batch_stream.sampleUniform(), scalar_stream.sampleUniform());
+  }
+}
+
+TEST(RandomStreamTest, BatchQuaternionsShouldMatchScalarSamples) {
+  RandomStream scalar_stream(42, 7);
+  RandomStream batch_stream(42, 7);
+  std::vector<RandomStream::Quaternion, Eigen::aligned_allocator<RandomStream::Quaternion>> quaternions;
+  batch_stream.generateUnitQuaternions(33, &quaternions);
+  ASSERT_EQ(quaternions.size(), 33);
+  for (const RandomStream::Quaternion& quaternion : quaternions) {
+    const RandomStream::Quaternion scalar_quaternion = scalar_stream.sampleUnitQuaternion();
+    EXPECT_EQ(quaternion.coeffs(), scalar_quaternion.coeffs());
+    EXPECT_NEAR(quaternion.norm(), 1, 1e-12);
+  }
+}
+
+TEST(RandomStreamTest, UniformIntShouldBeInRangeAndRejectEmptyRange) {
+  RandomStream stream(1, 0);
+  for (size_t i = 0; i < 1000; ++i) {
+    EXPECT_LT(stream.sampleUniformIntExclusive(7), 7u);
+  }
+  EXPECT_EQ(stream.sampleUniformIntExclusive(1), 0u);
+  EXPECT_THROW(stream.sampleUniformIntExclusive(0), bh::Exception);
+}
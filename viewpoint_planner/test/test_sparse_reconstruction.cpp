@@ -0,0 +1,207 @@
+//==================================================
+// test_sparse_reconstruction.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 24.05.17
+//
+
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include "gtest/gtest.h"
+#include <boost/filesystem.hpp>
+#include <bh/common.h>
+#include "../src/reconstruction/sparse_reconstruction.h"
+
+namespace {
+using reconstruction::SparseReconstruction;
+
+/// Little-endian writer for binary COLMAP model files.
+class BinaryWriter {
+public:
+  explicit BinaryWriter(const std::string& filename)
+      : out_(filename, std::ios_base::binary) {}
+
+  template <typename T>
+  void write(const T value) {
+    out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void writeString(const std::string& str) {
+    out_.write(str.c_str(), str.size() + 1);
+  }
+
+private:
+  std::ofstream out_;
+};
+
+class SparseReconstructionTest : public ::testing::Test {
+protected:
+  SparseReconstructionTest()
+      : text_path((boost::filesystem::path(::testing::TempDir()) / "test_sparse_reconstruction_text").string()),
+        binary_path((boost::filesystem::path(::testing::TempDir()) / "test_sparse_reconstruction_binary").string()) {
+    boost::filesystem::remove_all(text_path);
+    boost::filesystem::remove_all(binary_path);
+    boost::filesystem::create_directories(text_path);
+    boost::filesystem::create_directories(binary_path);
+  }
+
+  ~SparseReconstructionTest() override {
+    boost::filesystem::remove_all(text_path);
+    boost::filesystem::remove_all(binary_path);
+  }
+
+  std::string textFile(const std::string& name) const {
+    return (boost::filesystem::path(text_path) / name).string();
+  }
+
+  std::string binaryFile(const std::string& name) const {
+    return (boost::filesystem::path(binary_path) / name).string();
+  }
+
+  void writeTextModel() {
+    std::ofstream cameras(textFile("cameras.txt"));
+    cameras << "# Camera list" << std::endl;
+    cameras << "1 PINHOLE 640 480 500 510 320 240" << std::endl;
+    std::ofstream images(textFile("images.txt"));
+    images << "# Image list" << std::endl;
+    images << "1 1 0 0 0 0.5 -1 2 1 image1.png" << std::endl;
+    images << "10 20 1 11 21 -1" << std::endl;
+    images << "2 0 1 0 0 1 0 0 1 image2.png" << std::endl;
+    images << std::endl;
+    std::ofstream points(textFile("points3D.txt"));
+    points << "# 3D point list" << std::endl;
+    points << "1 0.5 1.5 2.5 255 128 0 0.25 1 0 1 1" << std::endl;
+  }
+
+  void writeBinaryModel() {
+    BinaryWriter cameras(binaryFile("cameras.bin"));
+    cameras.write<uint64_t>(1);
+    cameras.write<uint32_t>(1);
+    cameras.write<int32_t>(1);
+    cameras.write<uint64_t>(640);
+    cameras.write<uint64_t>(480);
+    for (const double param : {500.0, 510.0, 320.0, 240.0}) {
+      cameras.write<double>(param);
+    }
+    writeBinaryImages(2);
+    writeBinaryPoints3D(2);
+  }
+
+  void writeBinaryImages(const uint64_t num_points2D_of_first_image) {
+    BinaryWriter images(binaryFile("images.bin"));
+    images.write<uint64_t>(2);
+    images.write<uint32_t>(1);
+    for (const double value : {1.0, 0.0, 0.0, 0.0, 0.5, -1.0, 2.0}) {
+      images.write<double>(value);
+    }
+    images.write<uint32_t>(1);
+    images.writeString("image1.png");
+    images.write<uint64_t>(num_points2D_of_first_image);
+    images.write<double>(10);
+    images.write<double>(20);
+    images.write<uint64_t>(1);
+    images.write<double>(11);
+    images.write<double>(21);
+    images.write<uint64_t>(std::numeric_limits<uint64_t>::max());
+    images.write<uint32_t>(2);
+    for (const double value : {0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0}) {
+      images.write<double>(value);
+    }
+    images.write<uint32_t>(1);
+    images.writeString("image2.png");
+    images.write<uint64_t>(0);
+  }
+
+  void writeBinaryPoints3D(const uint64_t track_length) {
+    BinaryWriter points(binaryFile("points3D.bin"));
+    points.write<uint64_t>(1);
+    points.write<uint64_t>(1);
+    for (const double value : {0.5, 1.5, 2.5}) {
+      points.write<double>(value);
+    }
+    points.write<uint8_t>(255);
+    points.write<uint8_t>(128);
+    points.write<uint8_t>(0);
+    points.write<double>(0.25);
+    points.write<uint64_t>(track_length);
+    points.write<uint32_t>(1);
+    points.write<uint32_t>(0);
+    points.write<uint32_t>(1);
+    points.write<uint32_t>(1);
+  }
+
+  std::string text_path;
+  std::string binary_path;
+};
+}
+
+TEST_F(SparseReconstructionTest, BinaryAndTextModelsShouldMatch) {
+  writeTextModel();
+  writeBinaryModel();
+  SparseReconstruction text_reconstruction;
+  text_reconstruction.read(text_path);
+  SparseReconstruction binary_reconstruction;
+  binary_reconstruction.read(binary_path);
+
+  ASSERT_EQ(text_reconstruction.getCameras().size(), 1);
+  ASSERT_EQ(binary_reconstruction.getCameras().size(), 1);
+  EXPECT_TRUE(text_reconstruction.getCameras().at(1) == binary_reconstruction.getCameras().at(1));
+  EXPECT_EQ(binary_reconstruction.getCameras().at(1).width(), 640);
+  EXPECT_EQ(binary_reconstruction.getCameras().at(1).height(), 480);
+
+  ASSERT_EQ(text_reconstruction.getImages().size(), 2);
+  ASSERT_EQ(binary_reconstruction.getImages().size(), 2);
+  for (const auto& entry : text_reconstruction.getImages()) {
+    const auto& text_image = entry.second;
+    const auto& binary_image = binary_reconstruction.getImages().at(entry.first);
+    EXPECT_EQ(text_image.name(), binary_image.name());
+    EXPECT_EQ(text_image.camera_id(), binary_image.camera_id());
+    EXPECT_TRUE(text_image.pose().translation().isApprox(binary_image.pose().translation()));
+    EXPECT_TRUE(text_image.pose().quaternion().isApprox(binary_image.pose().quaternion()));
+    ASSERT_EQ(text_image.features().size(), binary_image.features().size());
+    for (size_t i = 0; i < text_image.features().size(); ++i) {
+      EXPECT_EQ(text_image.features()[i].point, binary_image.features()[i].point);
+      EXPECT_EQ(text_image.features()[i].point3d_id, binary_image.features()[i].point3d_id);
+    }
+  }
+  EXPECT_EQ(binary_reconstruction.getImages().at(1).features().size(), 2);
+  EXPECT_TRUE(binary_reconstruction.getImages().at(2).features().empty());
+
+  ASSERT_EQ(text_reconstruction.getPoints3D().size(), 1);
+  ASSERT_EQ(binary_reconstruction.getPoints3D().size(), 1);
+  const auto& text_point = text_reconstruction.getPoints3D().at(1);
+  const auto& binary_point = binary_reconstruction.getPoints3D().at(1);
+  EXPECT_EQ(text_point.getPosition(), binary_point.getPosition());
+  EXPECT_EQ(text_point.color, binary_point.color);
+  EXPECT_EQ(text_point.error, binary_point.error);
+  ASSERT_EQ(text_point.feature_track.size(), 2);
+  ASSERT_EQ(binary_point.feature_track.size(), 2);
+  for (size_t i = 0; i < text_point.feature_track.size(); ++i) {
+    EXPECT_EQ(text_point.feature_track[i].image_id, binary_point.feature_track[i].image_id);
+    EXPECT_EQ(text_point.feature_track[i].feature_index, binary_point.feature_track[i].feature_index);
+  }
+}
+
+TEST_F(SparseReconstructionTest, HugeNumPoints2DShouldThrow) {
+  writeBinaryModel();
+  writeBinaryImages(std::numeric_limits<uint64_t>::max() / 2);
+  SparseReconstruction reconstruction;
+  EXPECT_THROW(reconstruction.read(binary_path), bh::Exception);
+}
+
+TEST_F(SparseReconstructionTest, HugeTrackLengthShouldThrow) {
+  writeBinaryModel();
+  writeBinaryPoints3D(std::numeric_limits<uint64_t>::max() / 2);
+  SparseReconstruction reconstruction;
+  EXPECT_THROW(reconstruction.read(binary_path), bh::Exception);
+}
+
+TEST_F(SparseReconstructionTest, TruncatedBinaryModelShouldThrow) {
+  writeBinaryModel();
+  boost::filesystem::resize_file(binaryFile("points3D.bin"), 40);
+  SparseReconstruction reconstruction;
+  EXPECT_THROW(reconstruction.read(binary_path), bh::Exception);
+}
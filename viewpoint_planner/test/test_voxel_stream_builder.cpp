@@ -0,0 +1,188 @@
+//==================================================
+// test_voxel_stream_builder.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: 19.05.17
+//
+
+#include <random>
+#include "gtest/gtest.h"
+#include "../src/rendering/voxel_stream_builder.h"
+
+namespace {
+using rendering::VoxelStreamBuilder;
+using FloatType = VoxelStreamBuilder::FloatType;
+using size_t = std::size_t;
+
+const size_t kNumVoxels = 10000;
+const size_t kDepth = 16;
+const size_t kFloatsPerVoxel = VoxelStreamBuilder::VoxelStream::kFloatsPerVoxel;
+
+class VoxelStreamBuilderTest : public ::testing::Test {
+protected:
+  VoxelStreamBuilderTest()
+      : builder(getOccupancyBins()) {
+    std::mt19937_64 rnd;
+    std::uniform_real_distribution<FloatType> position_dist(-10, 10);
+    std::uniform_real_distribution<FloatType> unit_dist(0, 1);
+    std::uniform_int_distribution<uint32_t> observation_dist(0, 10);
+    for (size_t i = 0; i < kNumVoxels; ++i) {
+      voxels.push_back(position_dist(rnd), position_dist(rnd), position_dist(rnd), 0.5f,
+                       unit_dist(rnd), observation_dist(rnd), unit_dist(rnd));
+    }
+    VoxelStreamBuilder::VoxelArrays arrays = voxels;
+    builder.setDepthArrays(kDepth, std::move(arrays));
+  }
+
+  static std::vector<FloatType> getOccupancyBins() {
+    std::vector<FloatType> occupancy_bins;
+    for (size_t i = 0; i < 10; ++i) {
+      occupancy_bins.push_back(i / FloatType(10));
+    }
+    return occupancy_bins;
+  }
+
+  /// Indices of the voxels in each bin as computed by a serial loop
+  std::vector<std::vector<size_t>> getExpectedBinIndices(const uint32_t min_observation_count) const {
+    std::vector<std::vector<size_t>> bin_indices(builder.numOfBins());
+    for (size_t i = 0; i < voxels.size(); ++i) {
+      if (voxels.observation_count[i] >= min_observation_count) {
+        bin_indices[builder.findOccupancyBinIndex(voxels.occupancy[i])].push_back(i);
+      }
+    }
+    return bin_indices;
+  }
+
+  VoxelStreamBuilder builder;
+  VoxelStreamBuilder::VoxelArrays voxels;
+};
+}
+
+TEST_F(VoxelStreamBuilderTest, StreamsShouldMatchSerialReference) {
+  VoxelStreamBuilder::FilterOptions filter;
+  filter.min_observation_count = 3;
+  filter.alpha = 0.5f;
+  builder.build(kDepth, filter);
+
+  FloatType min_z = std::numeric_limits<FloatType>::max();
+  FloatType max_z = std::numeric_limits<FloatType>::lowest();
+  for (size_t i = 0; i < voxels.size(); ++i) {
+    if (voxels.observation_count[i] >= filter.min_observation_count) {
+      min_z = std::min(voxels.z[i], min_z);
+      max_z = std::max(voxels.z[i], max_z);
+    }
+  }
+  EXPECT_EQ(builder.getRanges().min_z, min_z);
+  EXPECT_EQ(builder.getRanges().max_z, max_z);
+
+  const std::vector<std::vector<size_t>> expected_bin_indices = getExpectedBinIndices(filter.min_observation_count);
+  for (size_t bin_index = 0; bin_index < builder.numOfBins(); ++bin_index) {
+    const VoxelStreamBuilder::VoxelStream& stream = builder.getStream(bin_index);
+    ASSERT_EQ(stream.numOfVoxels(), expected_bin_indices[bin_index].size());
+    ASSERT_EQ(stream.colors.size(), stream.voxels.size());
+    ASSERT_EQ(stream.infos.size(), stream.voxels.size());
+    for (size_t i = 0; i < stream.numOfVoxels(); ++i) {
+      const size_t index = expected_bin_indices[bin_index][i];
+      EXPECT_EQ(stream.voxels[i * kFloatsPerVoxel + 0], voxels.x[index]);
+      EXPECT_EQ(stream.voxels[i * kFloatsPerVoxel + 1], voxels.y[index]);
+      EXPECT_EQ(stream.voxels[i * kFloatsPerVoxel + 2], voxels.z[index]);
+      EXPECT_EQ(stream.voxels[i * kFloatsPerVoxel + 3], voxels.voxel_size[index]);
+      EXPECT_EQ(stream.infos[i * kFloatsPerVoxel + 0], voxels.occupancy[index]);
+      EXPECT_EQ(stream.infos[i * kFloatsPerVoxel + 1], voxels.observation_count[index]);
+      EXPECT_EQ(stream.infos[i * kFloatsPerVoxel + 2], voxels.weight[index]);
+      FloatType color[4];
+      VoxelStreamBuilder::computeHeightColor(voxels.z[index], min_z, max_z, filter.alpha, color);
+      for (size_t j = 0; j < 4; ++j) {
+        EXPECT_EQ(stream.colors[i * kFloatsPerVoxel + j], color[j]);
+      }
+    }
+  }
+}
+
+TEST_F(VoxelStreamBuilderTest, RebuildShouldOnlyReportChangedBins) {
+  VoxelStreamBuilder::FilterOptions filter;
+  const std::vector<VoxelStreamBuilder::StreamUpdate>& updates = builder.build(kDepth, filter);
+  for (const VoxelStreamBuilder::StreamUpdate& update : updates) {
+    EXPECT_TRUE(update.geometry_changed);
+  }
+
+  builder.build(kDepth, filter);
+  for (const VoxelStreamBuilder::StreamUpdate& update : updates) {
+    EXPECT_FALSE(update.geometry_changed);
+    EXPECT_FALSE(update.colors_changed);
+  }
+
+  filter.alpha = 0.25f;
+  builder.build(kDepth, filter);
+  for (size_t bin_index = 0; bin_index < builder.numOfBins(); ++bin_index) {
+    EXPECT_FALSE(updates[bin_index].geometry_changed);
+    EXPECT_TRUE(updates[bin_index].colors_changed);
+    EXPECT_EQ(builder.getStream(bin_index).colors[3], filter.alpha);
+  }
+
+  // Only the voxels of the first bin fall below the new observation threshold
+  VoxelStreamBuilder::VoxelArrays arrays = voxels;
+  for (size_t i = 0; i < arrays.size(); ++i) {
+    if (builder.findOccupancyBinIndex(arrays.occupancy[i]) != 0) {
+      arrays.observation_count[i] = 100;
+    }
+  }
+  builder.setDepthArrays(kDepth, std::move(arrays));
+  builder.build(kDepth, filter);
+  filter.min_observation_count = 100;
+  builder.build(kDepth, filter);
+  EXPECT_TRUE(updates[0].geometry_changed);
+  EXPECT_EQ(builder.getStream(0).numOfVoxels(), 0);
+  for (size_t bin_index = 1; bin_index < builder.numOfBins(); ++bin_index) {
+    EXPECT_FALSE(updates[bin_index].geometry_changed);
+  }
+}
+
+TEST_F(VoxelStreamBuilderTest, FrustumCullingShouldKeepVisibleVoxels) {
+  // Identity matrix: the frustum is the box [-1, 1]^3
+  VoxelStreamBuilder::CullingOptions culling;
+  culling.frustum_culling = true;
+  culling.setFrustumFromMatrix(Eigen::Matrix4f::Identity());
+  VoxelStreamBuilder::FilterOptions filter;
+  builder.build(kDepth, filter, culling);
+  const VoxelStreamBuilder::Ranges ranges = builder.getRanges();
+
+  size_t num_expected = 0;
+  for (size_t i = 0; i < voxels.size(); ++i) {
+    const FloatType half_size = voxels.voxel_size[i] / 2;
+    if (std::abs(voxels.x[i]) <= 1 + half_size && std::abs(voxels.y[i]) <= 1 + half_size
+        && std::abs(voxels.z[i]) <= 1 + half_size) {
+      ++num_expected;
+    }
+  }
+  size_t num_voxels = 0;
+  for (size_t bin_index = 0; bin_index < builder.numOfBins(); ++bin_index) {
+    num_voxels += builder.getStream(bin_index).numOfVoxels();
+  }
+  EXPECT_GT(num_expected, 0);
+  EXPECT_EQ(num_voxels, num_expected);
+
+  // Culling must not change the color ranges
+  builder.build(kDepth, filter);
+  EXPECT_EQ(builder.getRanges().min_z, ranges.min_z);
+  EXPECT_EQ(builder.getRanges().max_z, ranges.max_z);
+}
+
+TEST_F(VoxelStreamBuilderTest, DistanceLodShouldDropSmallDistantVoxels) {
+  VoxelStreamBuilder::CullingOptions culling;
+  culling.distance_lod = true;
+  culling.eye_position = VoxelStreamBuilder::Vector3::Zero();
+  culling.min_size_distance_ratio = 0.1f;
+  VoxelStreamBuilder::FilterOptions filter;
+  builder.build(kDepth, filter, culling);
+  for (size_t bin_index = 0; bin_index < builder.numOfBins(); ++bin_index) {
+    const VoxelStreamBuilder::VoxelStream& stream = builder.getStream(bin_index);
+    for (size_t i = 0; i < stream.numOfVoxels(); ++i) {
+      const Eigen::Vector3f position(stream.voxels[i * kFloatsPerVoxel + 0],
+                                     stream.voxels[i * kFloatsPerVoxel + 1],
+                                     stream.voxels[i * kFloatsPerVoxel + 2]);
+      EXPECT_LE(position.norm() * culling.min_size_distance_ratio, stream.voxels[i * kFloatsPerVoxel + 3]);
+    }
+  }
+}